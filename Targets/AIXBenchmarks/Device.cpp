@@ -23,7 +23,7 @@ class BenchmarkDeviceAdd : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t1 = aix::randn({1, elementCount}, opt);
         m_t2 = aix::randn({1, elementCount}, opt);
@@ -43,6 +43,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 3.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t1, m_t2, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -62,7 +65,7 @@ class BenchmarkDeviceSub : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t1 = aix::randn({1, elementCount}, opt);
         m_t2 = aix::randn({1, elementCount}, opt);
@@ -82,6 +85,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 3.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t1, m_t2, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -101,7 +107,7 @@ class BenchmarkDeviceMul : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t1 = aix::randn({1, elementCount}, opt);
         m_t2 = aix::randn({1, elementCount}, opt);
@@ -121,6 +127,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 3.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t1, m_t2, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -140,7 +149,7 @@ class BenchmarkDeviceDiv : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t1 = aix::randn({1, elementCount}, opt);
         m_t2 = aix::randn({1, elementCount}, opt);
@@ -160,6 +169,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 3.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t1, m_t2, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -179,7 +191,7 @@ class BenchmarkDeviceUnary : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_result = aix::Tensor(aix::Shape{1, elementCount}, opt);
@@ -198,6 +210,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -217,7 +232,7 @@ class BenchmarkDeviceFill : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dstDataType, .m_device=m_device.get() };
         m_result = aix::Tensor(aix::Shape{elementCount}, opt);  // No fill
         m_device->synchronize();
@@ -236,6 +251,8 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 1.0 * elementCount * aix::Device::dataTypeSize(dstDataType); }
+
 private:
     aix::Tensor  m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -255,7 +272,7 @@ class BenchmarkDeviceSum : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_result = aix::Tensor(aix::Shape{1, elementCount}, opt);
@@ -274,6 +291,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 1.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -293,7 +313,7 @@ class BenchmarkDeviceMax : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_result = aix::Tensor(aix::Shape{1, elementCount}, opt);
@@ -312,6 +332,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 1.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -331,7 +354,7 @@ class BenchmarkDeviceSqrt : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_result = aix::Tensor(aix::Shape{1, elementCount}, opt);
@@ -350,6 +373,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -369,7 +395,7 @@ class BenchmarkDeviceSin : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_result = aix::Tensor(aix::Shape{1, elementCount}, opt);
@@ -388,6 +414,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -407,7 +436,7 @@ class BenchmarkDeviceCos : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_result = aix::Tensor(aix::Shape{1, elementCount}, opt);
@@ -426,6 +455,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -445,7 +477,7 @@ class BenchmarkDeviceTanh : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_result = aix::Tensor(aix::Shape{1, elementCount}, opt);
@@ -464,6 +496,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -483,7 +518,7 @@ class BenchmarkDeviceLog : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_result = aix::Tensor(aix::Shape{1, elementCount}, opt);
@@ -502,6 +537,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -521,7 +559,7 @@ class BenchmarkDeviceExp : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_result = aix::Tensor(aix::Shape{1, elementCount}, opt);
@@ -540,6 +578,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -559,7 +600,7 @@ class BenchmarkDevicePow : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_exp = 2 + aix::randn({1, elementCount}, opt);
@@ -579,6 +620,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 3.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t, m_exp, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -598,7 +642,7 @@ class BenchmarkDeviceMatMul : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t1 = aix::randn({M, M}, opt);
         m_t2 = aix::randn({M, M}, opt);
@@ -618,6 +662,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 3.0 * M * M * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return 2.0 * M * M * M; }
+
 private:
     aix::Tensor  m_t1, m_t2, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -673,7 +720,7 @@ class BenchmarkDeviceTranspose : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({M, M}, opt);
         m_result = aix::Tensor(aix::Shape{M, M}, opt);
@@ -692,6 +739,8 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * M * M * aix::Device::dataTypeSize(dataType); }
+
 private:
     aix::Tensor  m_t, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -752,7 +801,7 @@ class BenchmarkDeviceCopy : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         m_src = aix::Tensor(aix::Shape{elementCount}, { .m_dtype=srcDataType, .m_device=m_device.get() });  // No fill
         m_dst = aix::Tensor(aix::Shape{elementCount}, { .m_dtype=dstDataType, .m_device=m_device.get() });  // No fill
         m_device->synchronize();
@@ -770,6 +819,11 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final
+    {
+        return 1.0 * elementCount * (aix::Device::dataTypeSize(srcDataType) + aix::Device::dataTypeSize(dstDataType));
+    }
+
 private:
     aix::Tensor  m_src, m_dst;
     std::unique_ptr<aix::Device>  m_device;
@@ -11,6 +11,7 @@
 #include "common.hpp"
 // External includes
 // System includes
+#include <filesystem>
 
 
 // --------------------------------------------------------------------------------
@@ -29,7 +30,7 @@ public:
         constexpr float kLearningRate  = 0.01f;
 
         // Create a device that uses Apple Metal for GPU computations.
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
 
         m_model = aix::nn::Sequential();
         m_model.add(new aix::nn::Linear(kNumInputs, layerSize));
@@ -87,3 +88,310 @@ using BenchmarkModelXORF3210 = BenchmarkModelXOR<aix::DataType::kFloat32, 10>;
 
 BENCHMARK(BenchmarkModelXORF321K,  "model_xor_f32_1k")
 BENCHMARK(BenchmarkModelXORF3210, "model_xor_f32_10")
+
+
+// --------------------------------------------------------------------------------
+// MODEL XOR FORWARD
+// --------------------------------------------------------------------------------
+
+// Measures the forward latency of a model with and without recording the autograd graph.
+template<aix::DataType dataType, size_t layerSize, bool noGrad>
+class BenchmarkModelXORForward : public BenchmarkBase
+{
+public:
+    void setup(const AIXBenchmarkConfigs& configs) final
+    {
+        constexpr int kNumSamples  = 4;
+        constexpr int kNumInputs   = 2;
+        constexpr int kNumTargets  = 1;
+
+        m_device = createDevice(configs);
+
+        m_model = aix::nn::Sequential();
+        m_model.add(new aix::nn::Linear(kNumInputs, layerSize));
+        m_model.add(new aix::nn::Tanh());
+        m_model.add(new aix::nn::Linear(layerSize, layerSize));
+        m_model.add(new aix::nn::Tanh());
+        m_model.add(new aix::nn::Linear(layerSize, kNumTargets));
+
+        m_model.to(m_device);
+        m_model.to(dataType);
+
+        m_inputs = aix::tensor({0.0, 0.0,
+                                0.0, 1.0,
+                                1.0, 0.0,
+                                1.0, 1.0}, {kNumSamples, kNumInputs}).to(m_device).to(dataType);
+    }
+
+    void run(const AIXBenchmarkConfigs&) final
+    {
+        std::optional<aix::NoGradGuard> guard;
+        if constexpr (noGrad) guard.emplace();
+        auto predictions = m_model.forward(m_inputs);
+        predictions.synchronize();
+    }
+
+    void cleanUp() final
+    {
+        m_device.release();
+        m_device = nullptr;
+    }
+
+private:
+    aix::nn::Sequential  m_model;
+    aix::Tensor  m_inputs;
+    std::unique_ptr<aix::Device>  m_device;
+};
+
+using BenchmarkModelXORForwardF3210        = BenchmarkModelXORForward<aix::DataType::kFloat32, 10, false>;
+using BenchmarkModelXORForwardNoGradF3210  = BenchmarkModelXORForward<aix::DataType::kFloat32, 10, true>;
+using BenchmarkModelXORForwardF321K        = BenchmarkModelXORForward<aix::DataType::kFloat32, 1000, false>;
+using BenchmarkModelXORForwardNoGradF321K  = BenchmarkModelXORForward<aix::DataType::kFloat32, 1000, true>;
+
+BENCHMARK(BenchmarkModelXORForwardF3210,       "model_xor_forward_f32_10")
+BENCHMARK(BenchmarkModelXORForwardNoGradF3210, "model_xor_forward_nograd_f32_10")
+BENCHMARK(BenchmarkModelXORForwardF321K,       "model_xor_forward_f32_1k")
+BENCHMARK(BenchmarkModelXORForwardNoGradF321K, "model_xor_forward_nograd_f32_1k")
+
+
+// --------------------------------------------------------------------------------
+// MODEL DATA LOADER
+// --------------------------------------------------------------------------------
+
+// Measures a training epoch of a model that streams its batches from a dataset with and without worker threads.
+template<aix::DataType dataType, size_t workerCount>
+class BenchmarkModelDataLoader : public BenchmarkBase
+{
+public:
+    void setup(const AIXBenchmarkConfigs& configs) final
+    {
+        constexpr size_t kNumSamples  = 16384;
+        constexpr size_t kNumInputs   = 64;
+        constexpr size_t kNumTargets  = 1;
+        constexpr size_t kBatchSize   = 256;
+        constexpr float kLearningRate = 0.01f;
+
+        m_device = createDevice(configs);
+
+        m_model = aix::nn::Sequential();
+        m_model.add(new aix::nn::Linear(kNumInputs, 256));
+        m_model.add(new aix::nn::Tanh());
+        m_model.add(new aix::nn::Linear(256, kNumTargets));
+        m_model.to(m_device);
+        m_model.to(dataType);
+
+        auto inputs  = aix::randn({kNumSamples, kNumInputs}).to(dataType);
+        auto targets = aix::randn({kNumSamples, kNumTargets}).to(dataType);
+        auto dataset = std::make_shared<aix::data::TensorDataset>(
+            std::vector<std::pair<std::string,aix::Tensor>>{{"inputs", inputs}, {"targets", targets}});
+        m_loader = std::make_unique<aix::data::DataLoader>(dataset, aix::data::DataLoaderOptions{
+            .m_batchSize=kBatchSize, .m_shuffle=true, .m_workerCount=workerCount, .m_device=m_device.get() });
+
+        m_optimizer = aix::optim::Adam(m_model.parameters(), kLearningRate);
+        m_lossFunc = aix::nn::MSELoss();
+    }
+
+    void run(const AIXBenchmarkConfigs&) final
+    {
+        m_loader->reset();
+        for (auto batch = m_loader->next(); !batch.empty(); batch = m_loader->next())
+        {
+            auto loss = m_lossFunc(m_model.forward(batch[0]), batch[1]);
+            m_optimizer.zeroGrad();
+            loss.backward();
+            m_optimizer.step();
+        }
+        m_device->synchronize();
+    }
+
+    void cleanUp() final
+    {
+        m_loader.reset();
+        m_device.release();
+        m_device = nullptr;
+    }
+
+private:
+    aix::nn::Sequential  m_model;
+    aix::optim::Adam  m_optimizer;
+    aix::nn::MSELoss  m_lossFunc;
+    std::unique_ptr<aix::data::DataLoader>  m_loader;
+    std::unique_ptr<aix::Device>  m_device;
+};
+
+using BenchmarkModelDataLoaderF32          = BenchmarkModelDataLoader<aix::DataType::kFloat32, 0>;
+using BenchmarkModelDataLoaderPrefetchF32  = BenchmarkModelDataLoader<aix::DataType::kFloat32, 2>;
+
+BENCHMARK(BenchmarkModelDataLoaderF32,         "model_dataloader_f32_16k")
+BENCHMARK(BenchmarkModelDataLoaderPrefetchF32, "model_dataloader_prefetch_f32_16k")
+
+
+// --------------------------------------------------------------------------------
+// MODEL MLP
+// --------------------------------------------------------------------------------
+
+// Measures a training step of a multi-layer perceptron, which is dominated by the GEMMs of the fused linear layers.
+template<aix::DataType dataType, size_t batchSize, size_t width, size_t layerCount>
+class BenchmarkModelMLP : public BenchmarkBase
+{
+public:
+    void setup(const AIXBenchmarkConfigs& configs) final
+    {
+        constexpr float kLearningRate = 0.001f;
+
+        m_device = createDevice(configs);
+
+        m_model = aix::nn::Sequential();
+        for (size_t i=0; i<layerCount-1; ++i)
+        {
+            m_model.add(new aix::nn::LinearAct(width, width, aix::Activation::kGeLU));
+        }
+        m_model.add(new aix::nn::Linear(width, width));
+        m_model.to(m_device);
+        m_model.to(dataType);
+
+        aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
+        m_inputs  = aix::randn({batchSize, width}, opt);
+        m_targets = aix::randn({batchSize, width}, opt);
+
+        m_optimizer = aix::optim::Adam(m_model.parameters(), kLearningRate);
+        m_lossFunc = aix::nn::MSELoss();
+        m_device->synchronize();
+    }
+
+    void run(const AIXBenchmarkConfigs&) final
+    {
+        auto loss = m_lossFunc(m_model.forward(m_inputs), m_targets);
+        m_optimizer.zeroGrad();
+        loss.backward();
+        m_optimizer.step();
+        m_device->synchronize();
+    }
+
+    void cleanUp() final
+    {
+        m_device.release();
+        m_device = nullptr;
+    }
+
+    // The forward and the backward pass read the weights and write their gradients, and the optimizer reads the
+    // weights, the gradients and the moments and writes the weights and the moments.
+    double bytes() const final { return 10.0 * layerCount * width * width * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return 6.0 * layerCount * batchSize * width * width; }
+
+private:
+    aix::nn::Sequential  m_model;
+    aix::optim::Adam  m_optimizer;
+    aix::nn::MSELoss  m_lossFunc;
+    aix::Tensor  m_inputs;
+    aix::Tensor  m_targets;
+    std::unique_ptr<aix::Device>  m_device;
+};
+
+using BenchmarkModelMLPF32256 = BenchmarkModelMLP<aix::DataType::kFloat32, 256, 1024, 4>;
+
+BENCHMARK(BenchmarkModelMLPF32256, "model_mlp_f32_256_1k_4")
+
+
+// --------------------------------------------------------------------------------
+// MODEL ADAM
+// --------------------------------------------------------------------------------
+
+// Measures an optimizer step over the parameters of a large model, which is bound by the memory bandwidth.
+template<aix::DataType dataType, size_t tensorCount, size_t tensorSize>
+class BenchmarkModelAdam : public BenchmarkBase
+{
+public:
+    void setup(const AIXBenchmarkConfigs& configs) final
+    {
+        m_device = createDevice(configs);
+
+        aix::TensorOptions opt = { .m_requireGrad=true, .m_dtype=dataType, .m_device=m_device.get() };
+        std::vector<aix::Tensor> parameters;
+        for (size_t i=0; i<tensorCount; ++i)
+        {
+            auto parameter = aix::randn({tensorSize}, opt);
+            parameter.grad().fill(0.01f);
+            parameters.emplace_back(parameter);
+        }
+        m_optimizer = aix::optim::Adam(parameters, 0.001f);
+        m_device->synchronize();
+    }
+
+    void run(const AIXBenchmarkConfigs&) final
+    {
+        m_optimizer.step();
+        m_device->synchronize();
+    }
+
+    void cleanUp() final
+    {
+        // The tensors return their buffers to the device, so they must be released before the device.
+        m_optimizer = aix::optim::Adam();
+        m_device.reset();
+    }
+
+    // Reads the parameters, the gradients and the moments, and writes the parameters and the moments.
+    double bytes() const final { return 7.0 * tensorCount * tensorSize * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return 12.0 * tensorCount * tensorSize; }
+
+private:
+    aix::optim::Adam  m_optimizer;
+    std::unique_ptr<aix::Device>  m_device;
+};
+
+using BenchmarkModelAdamF32100M = BenchmarkModelAdam<aix::DataType::kFloat32, 100, 1000000>;
+
+BENCHMARK(BenchmarkModelAdamF32100M, "model_adam_f32_100m")
+
+
+// --------------------------------------------------------------------------------
+// MODEL CHECKPOINT LOAD
+// --------------------------------------------------------------------------------
+
+// Measures loading the parameters of a model from a checkpoint file into device tensors. Devices that map host memory
+// use the file pages in place, which are read on first use, so the benchmark declares no bytes.
+template<aix::DataType dataType, size_t width, size_t layerCount>
+class BenchmarkModelCheckpointLoad : public BenchmarkBase
+{
+public:
+    void setup(const AIXBenchmarkConfigs& configs) final
+    {
+        m_device = createDevice(configs);
+
+        m_model = aix::nn::Sequential();
+        for (size_t i=0; i<layerCount; ++i)
+        {
+            m_model.add(new aix::nn::Linear(width, width));
+        }
+        m_model.to(m_device);
+        m_model.to(dataType);
+
+        m_filename = (std::filesystem::temp_directory_path() / (name() + ".pth")).string();
+        aix::save(m_model, m_filename);
+        m_device->synchronize();
+    }
+
+    void run(const AIXBenchmarkConfigs&) final
+    {
+        aix::load(m_model, m_filename);
+        m_device->synchronize();
+    }
+
+    void cleanUp() final
+    {
+        std::filesystem::remove(m_filename);
+        // The tensors return their buffers to the device, so they must be released before the device.
+        m_model = aix::nn::Sequential();
+        m_device.reset();
+    }
+
+private:
+    aix::nn::Sequential  m_model;
+    std::string  m_filename;
+    std::unique_ptr<aix::Device>  m_device;
+};
+
+using BenchmarkModelCheckpointLoadF32 = BenchmarkModelCheckpointLoad<aix::DataType::kFloat32, 2048, 8>;
+
+BENCHMARK(BenchmarkModelCheckpointLoadF32, "model_checkpoint_load_f32_2k_8")
@@ -23,7 +23,7 @@ class BenchmarkTensorAdd : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t1 = aix::randn({1, elementCount}, opt);
         m_t2 = aix::randn({1, elementCount}, opt);
@@ -42,6 +42,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 3.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t1, m_t2;
     std::unique_ptr<aix::Device>  m_device;
@@ -60,7 +63,7 @@ class BenchmarkTensorSub : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t1 = aix::randn({1, elementCount}, opt);
         m_t2 = aix::randn({1, elementCount}, opt);
@@ -79,6 +82,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 3.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t1, m_t2;
     std::unique_ptr<aix::Device>  m_device;
@@ -97,7 +103,7 @@ class BenchmarkTensorMul : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t1 = aix::randn({1, elementCount}, opt);
         m_t2 = aix::randn({1, elementCount}, opt);
@@ -116,6 +122,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 3.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t1, m_t2;
     std::unique_ptr<aix::Device>  m_device;
@@ -134,7 +143,7 @@ class BenchmarkTensorDiv : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t1 = aix::randn({1, elementCount}, opt);
         m_t2 = aix::randn({1, elementCount}, opt);
@@ -153,6 +162,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 3.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t1, m_t2;
     std::unique_ptr<aix::Device>  m_device;
@@ -171,7 +183,7 @@ class BenchmarkTensorUnary : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_device->synchronize();
@@ -189,6 +201,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t;
     std::unique_ptr<aix::Device>  m_device;
@@ -207,7 +222,7 @@ class BenchmarkTensorSum : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_device->synchronize();
@@ -225,6 +240,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 1.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t;
     std::unique_ptr<aix::Device>  m_device;
@@ -243,7 +261,7 @@ class BenchmarkTensorSumWithDim : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({elementCount,elementCount,elementCount}, opt);
         m_device->synchronize();
@@ -261,6 +279,12 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final
+    {
+        return 1.0 * elementCount * elementCount * elementCount * aix::Device::dataTypeSize(dataType);
+    }
+    double flops() const final { return elementCount * elementCount * elementCount; }
+
 private:
     aix::Tensor  m_t;
     std::unique_ptr<aix::Device>  m_device;
@@ -279,7 +303,7 @@ class BenchmarkTensorMax : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_device->synchronize();
@@ -297,6 +321,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 1.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t;
     std::unique_ptr<aix::Device>  m_device;
@@ -315,7 +342,7 @@ class BenchmarkTensorMaxWithDim : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({elementCount, elementCount, elementCount}, opt);
         m_device->synchronize();
@@ -333,6 +360,12 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final
+    {
+        return 1.0 * elementCount * elementCount * elementCount * aix::Device::dataTypeSize(dataType);
+    }
+    double flops() const final { return elementCount * elementCount * elementCount; }
+
 private:
     aix::Tensor  m_t;
     std::unique_ptr<aix::Device>  m_device;
@@ -351,7 +384,7 @@ class BenchmarkTensorSqrt : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_device->synchronize();
@@ -369,6 +402,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t;
     std::unique_ptr<aix::Device>  m_device;
@@ -387,7 +423,7 @@ class BenchmarkTensorSin : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_device->synchronize();
@@ -405,6 +441,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t;
     std::unique_ptr<aix::Device>  m_device;
@@ -423,7 +462,7 @@ class BenchmarkTensorCos : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_device->synchronize();
@@ -441,6 +480,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t;
     std::unique_ptr<aix::Device>  m_device;
@@ -459,7 +501,7 @@ class BenchmarkTensorTanh : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_device->synchronize();
@@ -477,6 +519,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t;
     std::unique_ptr<aix::Device>  m_device;
@@ -495,7 +540,7 @@ class BenchmarkTensorLog : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_device->synchronize();
@@ -513,6 +558,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t;
     std::unique_ptr<aix::Device>  m_device;
@@ -531,7 +579,7 @@ class BenchmarkTensorExp : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_device->synchronize();
@@ -549,6 +597,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t;
     std::unique_ptr<aix::Device>  m_device;
@@ -567,7 +618,7 @@ class BenchmarkTensorPow : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({1, elementCount}, opt);
         m_exp = 2 + aix::randn({1, elementCount}, opt);
@@ -586,6 +637,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 3.0 * elementCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return elementCount; }
+
 private:
     aix::Tensor  m_t, m_exp;
     std::unique_ptr<aix::Device>  m_device;
@@ -604,7 +658,7 @@ class BenchmarkTensorMatMul : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t1 = aix::randn({M, M}, opt);
         m_t2 = aix::randn({M, M}, opt);
@@ -624,6 +678,9 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 3.0 * M * M * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return 2.0 * M * M * M; }
+
 private:
     aix::Tensor  m_t1, m_t2, m_result;
     std::unique_ptr<aix::Device>  m_device;
@@ -681,7 +738,7 @@ class BenchmarkTensorTranspose : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({M, M}, opt);
         m_device->synchronize();
@@ -699,6 +756,8 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * M * M * aix::Device::dataTypeSize(dataType); }
+
 private:
     aix::Tensor  m_t;
     std::unique_ptr<aix::Device>  m_device;
@@ -755,7 +814,7 @@ class BenchmarkTensorPermute : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({M, M, M}, opt);
         m_device->synchronize();
@@ -773,6 +832,8 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * M * M * M * aix::Device::dataTypeSize(dataType); }
+
 private:
     aix::Tensor  m_t;
     std::unique_ptr<aix::Device>  m_device;
@@ -795,7 +856,7 @@ class BenchmarkTensorSlice : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         m_t = aix::randn({elementCount, elementCount}, opt);
         m_device->synchronize();
@@ -813,6 +874,8 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final { return 2.0 * elementCount * elementCount * aix::Device::dataTypeSize(dataType); }
+
 private:
     aix::Tensor  m_t;
     std::unique_ptr<aix::Device>  m_device;
@@ -831,7 +894,7 @@ class BenchmarkTensorCat : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         aix::TensorOptions opt = { .m_dtype=dataType, .m_device=m_device.get() };
         for (size_t i=0; i<10; ++i)
         {
@@ -852,6 +915,9 @@ public:
         m_device = nullptr;
     }
 
+    // Reads ten inputs and writes the result.
+    double bytes() const final { return 20.0 * elementCount * elementCount * aix::Device::dataTypeSize(dataType); }
+
 private:
     std::vector<aix::Tensor>  m_tensors;
     std::unique_ptr<aix::Device>  m_device;
@@ -873,7 +939,7 @@ class BenchmarkTensorIndexSelect : public BenchmarkBase
 public:
     void setup(const AIXBenchmarkConfigs& configs) final
     {
-        m_device = aix::createDevice(configs.deviceType);
+        m_device = createDevice(configs);
         assert(dim < 3);
         auto shape = aix::Shape{elementCount, elementCount, elementCount};
         m_indices = aix::arange(0, shape[dim], { .m_dtype=aix::DataType::kInt32, .m_device=m_device.get()});
@@ -893,6 +959,11 @@ public:
         m_device = nullptr;
     }
 
+    double bytes() const final
+    {
+        return 2.0 * elementCount * elementCount * elementCount * aix::Device::dataTypeSize(dataType);
+    }
+
 private:
     aix::Tensor  m_tensor;
     aix::Tensor  m_indices;
@@ -901,3 +972,86 @@ private:
 
 using BenchmarkTensorIndexSelectF322001 = BenchmarkTensorIndexSelect<aix::DataType::kFloat32, 200, 1>;
 BENCHMARK(BenchmarkTensorIndexSelectF322001, "tensor_isel_f32_200_1")
+
+// --------------------------------------------------------------------------------
+// SOFTMAX
+// --------------------------------------------------------------------------------
+
+template<aix::DataType dataType, size_t batchSize, size_t classCount>
+class BenchmarkTensorSoftmax : public BenchmarkBase
+{
+public:
+    void setup(const AIXBenchmarkConfigs& configs) final
+    {
+        m_device = createDevice(configs);
+        aix::TensorOptions opt = { .m_requireGrad=true, .m_dtype=dataType, .m_device=m_device.get() };
+        m_logits = aix::randn({batchSize, classCount}, opt);
+        m_device->synchronize();
+    }
+
+    void run(const AIXBenchmarkConfigs&) final
+    {
+        auto probs = aix::nn::Softmax(1).forward(m_logits);
+        probs.backward(1, probs.shape());
+        m_device->synchronize();
+    }
+
+    void cleanUp() final
+    {
+        m_device.release();
+        m_device = nullptr;
+    }
+
+    // The forward pass reads the logits and writes the probabilities, and the backward pass reads the probabilities
+    // and the seed and writes the gradient of the logits.
+    double bytes() const final { return 5.0 * batchSize * classCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return 8.0 * batchSize * classCount; }
+
+private:
+    aix::Tensor  m_logits;
+    std::unique_ptr<aix::Device>  m_device;
+};
+
+using BenchmarkTensorSoftmaxF3232K = BenchmarkTensorSoftmax<aix::DataType::kFloat32, 32, 32000>;
+BENCHMARK(BenchmarkTensorSoftmaxF3232K, "tensor_softmax_f32_32_32k")
+
+// A classification head of a large vocabulary. The loss is the fused cross-entropy of the logits.
+template<aix::DataType dataType, size_t batchSize, size_t classCount>
+class BenchmarkTensorCrossEntropy : public BenchmarkBase
+{
+public:
+    void setup(const AIXBenchmarkConfigs& configs) final
+    {
+        m_device = createDevice(configs);
+        aix::TensorOptions opt = { .m_requireGrad=true, .m_dtype=dataType, .m_device=m_device.get() };
+        m_logits  = aix::randn({batchSize, classCount}, opt);
+        m_targets = aix::nn::Softmax(1).forward(aix::randn({batchSize, classCount}, { .m_dtype=dataType,
+                                                                                     .m_device=m_device.get() }));
+        m_device->synchronize();
+    }
+
+    void run(const AIXBenchmarkConfigs&) final
+    {
+        auto loss = aix::nn::CrossEntropyLoss(true)(m_logits, m_targets);
+        loss.backward();
+        m_device->synchronize();
+    }
+
+    void cleanUp() final
+    {
+        m_device.release();
+        m_device = nullptr;
+    }
+
+    // The minimum traffic reads the logits and the targets once and writes the gradient of the logits.
+    double bytes() const final { return 3.0 * batchSize * classCount * aix::Device::dataTypeSize(dataType); }
+    double flops() const final { return 6.0 * batchSize * classCount; }
+
+private:
+    aix::Tensor  m_logits;
+    aix::Tensor  m_targets;
+    std::unique_ptr<aix::Device>  m_device;
+};
+
+using BenchmarkTensorCrossEntropyF3232K = BenchmarkTensorCrossEntropy<aix::DataType::kFloat32, 32, 32000>;
+BENCHMARK(BenchmarkTensorCrossEntropyF3232K, "tensor_xent_f32_32_32k")
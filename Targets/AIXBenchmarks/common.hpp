@@ -26,6 +26,7 @@ struct AIXBenchmarkConfigs
     size_t iterationCount{1000};
     std::string filterPattern;
     const std::unordered_set<std::string> testList;
+    double regressionThreshold{5};      // Slowdown or memory growth in percent that compare reports as a regression.
 };
 
 struct AIXBenchmarkResult
@@ -33,6 +34,12 @@ struct AIXBenchmarkResult
     double min{INT_MAX};
     double max{-INT_MAX};
     double avg{0};
+    double p50{0};                      // Latency percentiles of the runs.
+    double p95{0};
+    double p99{0};
+    double gbps{0};                     // Throughput at the median latency, if the benchmark declares its work.
+    double gflops{0};
+    size_t peakBytes{0};                // Device memory high-water mark, including the setup allocations.
 };
 
 struct BenchmarkBase
@@ -42,10 +49,23 @@ public:
     virtual void setup(const AIXBenchmarkConfigs& configs) = 0;
     virtual void run(const AIXBenchmarkConfigs& configs) = 0;
     virtual void cleanUp() = 0;
+    // Bytes that a run reads and writes, and floating point operations of a run. Zero means unknown.
+    virtual double bytes() const { return 0; }
+    virtual double flops() const { return 0; }
     std::string name() { return m_name; }
     void name(const std::string& name) { m_name = name; }
+    // Returns the peak memory usage of the device that the benchmark created with createDevice().
+    size_t peakDeviceMemory() const { return m_createdDevice ? m_createdDevice->memoryStats().peakBytesInUse : 0; }
+protected:
+    std::unique_ptr<aix::Device> createDevice(const AIXBenchmarkConfigs& configs)
+    {
+        auto device = aix::createDevice(configs.deviceType);
+        m_createdDevice = device.get();
+        return device;
+    }
 private:
     std::string m_name;
+    aix::Device* m_createdDevice{nullptr};
 };
 
 #define BENCHMARK(className, benchName)                 \
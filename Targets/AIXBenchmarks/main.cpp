@@ -13,6 +13,8 @@
 #include <docopt/docopt.h>
 #include <yaml-cpp/yaml.h>
 // System includes
+#include <algorithm>
+#include <cmath>
 #include <filesystem>
 #include <iostream>
 #include <map>
@@ -80,6 +82,8 @@ void registerAllBenchmarks()
     REGISTER_BENCHMARK(BenchmarkTensorCatF32V)
     REGISTER_BENCHMARK(BenchmarkTensorCatF32H)
     REGISTER_BENCHMARK(BenchmarkTensorIndexSelectF322001)
+    REGISTER_BENCHMARK(BenchmarkTensorSoftmaxF3232K)
+    REGISTER_BENCHMARK(BenchmarkTensorCrossEntropyF3232K)
     REGISTER_BENCHMARK(BenchmarkDeviceAddF3210M)
     REGISTER_BENCHMARK(BenchmarkDeviceSubF3210M)
     REGISTER_BENCHMARK(BenchmarkDeviceMulF3210M)
@@ -134,6 +138,15 @@ void registerAllBenchmarks()
     REGISTER_BENCHMARK(BenchmarkDeviceCopyF32F3210M)
     REGISTER_BENCHMARK(BenchmarkModelXORF321K)
     REGISTER_BENCHMARK(BenchmarkModelXORF3210)
+    REGISTER_BENCHMARK(BenchmarkModelXORForwardF3210)
+    REGISTER_BENCHMARK(BenchmarkModelXORForwardNoGradF3210)
+    REGISTER_BENCHMARK(BenchmarkModelXORForwardF321K)
+    REGISTER_BENCHMARK(BenchmarkModelXORForwardNoGradF321K)
+    REGISTER_BENCHMARK(BenchmarkModelDataLoaderF32)
+    REGISTER_BENCHMARK(BenchmarkModelDataLoaderPrefetchF32)
+    REGISTER_BENCHMARK(BenchmarkModelMLPF32256)
+    REGISTER_BENCHMARK(BenchmarkModelAdamF32100M)
+    REGISTER_BENCHMARK(BenchmarkModelCheckpointLoadF32)
 }
 
 
@@ -198,6 +211,10 @@ AIXBenchmarkResult runBenchmark(std::function<std::unique_ptr<BenchmarkBase>()>&
 {
     AIXBenchmarkResult result;
     double avgDurationSum = 0;
+    double bytes = 0;
+    double flops = 0;
+    std::vector<double> durations;
+    durations.reserve(configs.samplingCount * configs.iterationCount);
     for (size_t i=0; i<configs.samplingCount + configs.warmupCount; ++i)
     {
         // Create
@@ -222,13 +239,20 @@ AIXBenchmarkResult runBenchmark(std::function<std::unique_ptr<BenchmarkBase>()>&
             minDuration = std::min(minDuration, duration);
             maxDuration = std::max(maxDuration, duration);
             sumDuration += duration;
+            durations.emplace_back(duration);
         }
 
+        // The device memory stays allocated until the clean-up.
+        auto peakBytes = benchmark->peakDeviceMemory();
+        bytes = benchmark->bytes();
+        flops = benchmark->flops();
+
         // CleanUp
         benchmark->cleanUp();
 
         if (i < configs.warmupCount) continue;   // Skip timing for warm-up.
 
+        result.peakBytes = std::max(result.peakBytes, peakBytes);
         result.min = std::min(result.min, minDuration);
         result.max = std::max(result.max, maxDuration);
         avgDurationSum += sumDuration / static_cast<double>(configs.iterationCount);
@@ -236,6 +260,21 @@ AIXBenchmarkResult runBenchmark(std::function<std::unique_ptr<BenchmarkBase>()>&
 
     result.avg = avgDurationSum / static_cast<double>(configs.samplingCount);
 
+    // Nearest-rank percentiles of all measured runs.
+    std::sort(durations.begin(), durations.end());
+    auto percentile = [&durations](double p)
+    {
+        auto rank = static_cast<size_t>(std::ceil(p * static_cast<double>(durations.size())));
+        return durations[std::clamp<size_t>(rank, 1, durations.size()) - 1];
+    };
+    result.p50 = percentile(0.50);
+    result.p95 = percentile(0.95);
+    result.p99 = percentile(0.99);
+
+    // Durations are in milliseconds.
+    result.gbps   = bytes / result.p50 / 1e6;
+    result.gflops = flops / result.p50 / 1e6;
+
     return result;
 }
 
@@ -264,6 +303,12 @@ void saveBenchmarks(const std::string& filename, const AIXBenchmarkConfigs& conf
         out << YAML::Key << "min" << YAML::Value << result.min;
         out << YAML::Key << "max" << YAML::Value << result.max;
         out << YAML::Key << "avg" << YAML::Value << result.avg;
+        out << YAML::Key << "p50" << YAML::Value << result.p50;
+        out << YAML::Key << "p95" << YAML::Value << result.p95;
+        out << YAML::Key << "p99" << YAML::Value << result.p99;
+        out << YAML::Key << "gbps" << YAML::Value << result.gbps;
+        out << YAML::Key << "gflops" << YAML::Value << result.gflops;
+        out << YAML::Key << "peakBytes" << YAML::Value << result.peakBytes;
         out << YAML::EndMap;
 
         std::cout << "[" << benchmarkName.c_str() << "] : done!" << std::endl;
@@ -277,11 +322,14 @@ void saveBenchmarks(const std::string& filename, const AIXBenchmarkConfigs& conf
 }
 
 
-void compareBenchmarks(const std::string& filename, const AIXBenchmarkConfigs& configs)
+// Returns the number of benchmarks that are slower or use more device memory than the baseline by more than the
+// regression threshold.
+size_t compareBenchmarks(const std::string& filename, const AIXBenchmarkConfigs& configs)
 {
     size_t maxNameLength = longestBenchmarkLength(configs);
     constexpr int timeWidth = 14;
     constexpr int changeWidth = 14;
+    constexpr int rateWidth = 12;
 
     auto config = YAML::LoadFile(filename);
     auto benchmarks = config["benchmarks"];
@@ -291,8 +339,13 @@ void compareBenchmarks(const std::string& filename, const AIXBenchmarkConfigs& c
               << std::right << std::setw(timeWidth) << "Base (ms)"
               << std::right << std::setw(timeWidth) << "New (ms)"
               << std::right << std::setw(changeWidth) << "Change (%)"
-              << std::endl << std::string(maxNameLength + 2*timeWidth + changeWidth, '-') << std::endl;
+              << std::right << std::setw(timeWidth) << "p99 (ms)"
+              << std::right << std::setw(rateWidth) << "GB/s"
+              << std::right << std::setw(rateWidth) << "GFLOP/s"
+              << std::right << std::setw(rateWidth) << "Peak (MB)"
+              << std::endl << std::string(maxNameLength + 3*timeWidth + changeWidth + 3*rateWidth, '-') << std::endl;
 
+    size_t regressionCount = 0;
     for (auto& benchmarkCreateFunc : registeredBenchmarksList)
     {
         auto benchmarkName = benchmarkCreateFunc()->name();
@@ -302,13 +355,32 @@ void compareBenchmarks(const std::string& filename, const AIXBenchmarkConfigs& c
         {
             auto results = runBenchmark(benchmarkCreateFunc, configs);
             auto perfChange = 100 * (test["min"].as<double>() - results.min) / test["min"].as<double>();
-            std::cout << std::left << std::setw(maxNameLength) << benchmarkName
-                      << std::right << std::setw(timeWidth) << std::fixed << std::setprecision(4) << test["min"].as<double>()
-                      << std::right << std::setw(timeWidth) << std::fixed << std::setprecision(4) << results.min
-                      << std::right << std::setw(changeWidth) << std::fixed << std::setprecision(4) << perfChange
+            // Baselines saved before the memory tracking have no peak memory.
+            auto basePeakBytes = test["peakBytes"] ? test["peakBytes"].as<double>() : 0;
+            auto memoryChange = basePeakBytes > 0 ? 100 * (results.peakBytes - basePeakBytes) / basePeakBytes : 0;
+            bool isRegression = perfChange < -configs.regressionThreshold ||
+                                memoryChange > configs.regressionThreshold;
+            regressionCount += isRegression ? 1 : 0;
+
+            std::cout << std::left << std::setw(maxNameLength) << benchmarkName << std::fixed
+                      << std::right << std::setw(timeWidth) << std::setprecision(4) << test["min"].as<double>()
+                      << std::right << std::setw(timeWidth) << std::setprecision(4) << results.min
+                      << std::right << std::setw(changeWidth) << std::setprecision(4) << perfChange
+                      << std::right << std::setw(timeWidth) << std::setprecision(4) << results.p99
+                      << std::right << std::setw(rateWidth) << std::setprecision(2) << results.gbps
+                      << std::right << std::setw(rateWidth) << std::setprecision(2) << results.gflops
+                      << std::right << std::setw(rateWidth) << std::setprecision(2) << results.peakBytes / 1e6
+                      << (isRegression ? "  REGRESSION" : "")
                       << std::endl;
         }
     }
+
+    if (regressionCount > 0)
+    {
+        std::cout << std::endl << regressionCount << " benchmark(s) regressed by more than "
+                  << configs.regressionThreshold << "%." << std::endl;
+    }
+    return regressionCount;
 }
 
 
@@ -332,6 +404,7 @@ int main(int argc, const char* argv[])
     Usage:
         AIXBenchmarks (save|compare) --file=<name> --device=<name> [--testName=<name>... | --filter=<pattern>]
                                                                    [--wc=<number>] [--sc=<number>] [--ic=<number>]
+                                                                   [--threshold=<percent>]
         AIXBenchmarks list [--filter=<pattern>]
 
     Options:
@@ -340,7 +413,7 @@ int main(int argc, const char* argv[])
         list                List test names.
 
         --file=<name>       YAML file that stores benchmark results.
-        --device=<name>     Device Type: CPU|MCS.  [default: CPU]
+        --device=<name>     Device Type: CPU|CPUMT|MCS.  [default: CPU]
         --testName=<name>   Unique test name to run. (Could be multiple)
                             (i.e. --testName=matmul1 --testName=matmul2)
         --filter=<pattern>  Filter test names with wildcards.
@@ -348,6 +421,7 @@ int main(int argc, const char* argv[])
         --wc=<number>       Warm-up count.         [default: 1]
         --sc=<number>       Sampling count.        [default: 1]
         --ic=<number>       Iteration count.       [default: 1000]
+        --threshold=<percent>  Slowdown or peak memory growth that compare reports as a regression.  [default: 5]
 )";
 
     std::map <std::string, docopt::value>  args;
@@ -373,13 +447,15 @@ int main(int argc, const char* argv[])
         }
 
         auto deviceTypeStr = args["--device"] ? args["--device"].asString() : "CPU";
-        if (deviceTypeStr != "CPU" && deviceTypeStr != "MCS")
+        if (deviceTypeStr != "CPU" && deviceTypeStr != "CPUMT" && deviceTypeStr != "MCS")
         {
             std::cerr << "Unknown device type: " << deviceTypeStr << std::endl;
             return -1;
         }
         aix::DeviceType deviceType = aix::DeviceType::kCPU;
-        if (deviceTypeStr == "MCS")
+        if (deviceTypeStr == "CPUMT")
+            deviceType = aix::DeviceType::kCPU_MT;
+        else if (deviceTypeStr == "MCS")
             deviceType = aix::DeviceType::kGPU_METAL;
 
         // Check if this device is available in this platform.
@@ -412,6 +488,13 @@ int main(int argc, const char* argv[])
             return -1;
         }
 
+        auto regressionThreshold = args["--threshold"] ? std::stod(args["--threshold"].asString()) : 5.0;
+        if (regressionThreshold < 0)
+        {
+            std::cerr << "Regression threshold must not be negative." << std::endl;
+            return -1;
+        }
+
         auto filterPattern = args["--filter"] ? args["--filter"].asString() : "";
         auto testsToRun = args["--testName"] ? args["--testName"].asStringList() : std::vector<std::string>();
 
@@ -422,7 +505,8 @@ int main(int argc, const char* argv[])
             .samplingCount  = static_cast<size_t>(samplingCount),
             .iterationCount = static_cast<size_t>(iterationCount),
             .filterPattern  = filterPattern,
-            .testList       = std::unordered_set<std::string>(testsToRun.begin(), testsToRun.end())
+            .testList       = std::unordered_set<std::string>(testsToRun.begin(), testsToRun.end()),
+            .regressionThreshold = regressionThreshold
         };
 
         registerAllBenchmarks();
@@ -433,7 +517,8 @@ int main(int argc, const char* argv[])
         }
         else if (args["compare"].asBool())
         {
-            compareBenchmarks(file, benchConfigs);
+            // A non-zero exit code lets the scripts that run the comparison detect the regressions.
+            if (compareBenchmarks(file, benchConfigs) > 0) return 1;
         }
         else if (args["list"].asBool())
         {
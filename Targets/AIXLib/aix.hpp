@@ -10,26 +10,73 @@
 #pragma once
 
 // Project includes
+#include "aixDeviceCPUCache.hpp"
 #include "aixFloat16.hpp"
+#include "aixSmallVector.hpp"
 // External includes
 // System includes
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <initializer_list>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <numbers>
 #include <numeric>
 #include <optional>
 #include <random>
+#include <sstream>
 #include <stack>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// Compiles the CPU kernels for several x86 instruction sets, and the kernel entry points select the best one at
+// runtime. The variants have their own names, since the IFUNC symbols of target_clones in header templates cannot be
+// resolved between a shared library and an executable that both instantiate them.
+#if defined(__x86_64__) && defined(__GNUC__)
+#define AIX_X86_KERNELS
+#endif
 
 
 namespace aix
 {
 
+#ifdef AIX_X86_KERNELS
+enum class KernelISA
+{
+    kDefault,
+    kAVX2,
+    kAVX512,
+};
+
+// Returns the widest instruction set that the CPU kernels are compiled for and the CPU supports.
+inline KernelISA kernelISA()
+{
+    static const KernelISA isa = __builtin_cpu_supports("avx512f") ? KernelISA::kAVX512 :
+                                 __builtin_cpu_supports("avx2")    ? KernelISA::kAVX2   : KernelISA::kDefault;
+    return isa;
+}
+#endif
+
 enum class DataType : size_t
 {
     kFloat64  = 0,
@@ -47,10 +94,11 @@ enum class DeviceType
 {
     kCPU,
     kGPU_METAL,
+    kCPU_MT,
 };
 
 constexpr size_t DataTypeCount   = 9;
-constexpr size_t DeviceTypeCount = 2;
+constexpr size_t DeviceTypeCount = 3;
 
 // Primary template (default case)
 template <typename T> constexpr DataType getDataType();
@@ -114,11 +162,12 @@ static DataType promoteDataTypeToFloat(DataType dtype)
 // Forward declarations
 class Tensor;
 
-// Tensor Index, Shape and Stride Types
-using Index  = std::vector<size_t>;
-using SIndex = std::vector<ssize_t>;
-using Shape  = std::vector<size_t>;
-using Stride = std::vector<size_t>;
+// Tensor Index, Shape and Stride Types. Up to eight dimensions are stored inline without a heap allocation.
+#define TENSOR_INLINE_DIMENSIONS    8
+using Index  = SmallVector<size_t,  TENSOR_INLINE_DIMENSIONS>;
+using SIndex = SmallVector<ssize_t, TENSOR_INLINE_DIMENSIONS>;
+using Shape  = SmallVector<size_t,  TENSOR_INLINE_DIMENSIONS>;
+using Stride = SmallVector<size_t,  TENSOR_INLINE_DIMENSIONS>;
 
 struct DeviceTensorParams
 {
@@ -126,11 +175,312 @@ struct DeviceTensorParams
     DataType dtype{aix::DataType::kFloat32};
     bool     isContiguous{true};
     size_t   offset{0};         // Start offset of data on storage.
-    Shape    shape;             // The shape of the tensor.
+    Shape    shape{};           // The shape of the tensor.
     size_t   size{0};           // Number of elements in DataType.
-    Stride   strides;           // The strides for indexing the tensor.
+    Stride   strides{};         // The strides for indexing the tensor.
+};
+
+// Operation codes of fused element-wise programs.
+enum class FusedOpCode
+{
+    kInput,         // Loads the elements of an input tensor.
+    kConstant,      // Broadcasts a scalar constant.
+    kAdd,
+    kSub,
+    kMul,
+    kDiv,
+    kNeg,
+    kSqrt,
+    kSin,
+    kCos,
+    kTanh,
+    kLog,
+    kExp,
+};
+
+// An instruction of a fused element-wise program. Operands are the indices of previous instructions, except for
+// kInput, whose first operand is the index of an input tensor.
+struct FusedInstruction
+{
+    FusedOpCode  opCode{FusedOpCode::kInput};
+    size_t       operand1{0};
+    size_t       operand2{0};
+    float        constant{0};
+};
+
+// A fused program is a list of instructions in evaluation order. The last instruction computes the result.
+using FusedProgram = std::vector<FusedInstruction>;
+
+// Update rules of fused optimizer steps.
+enum class OptimizerType
+{
+    kSGD,           // SGD with momentum. No momentum buffer is used if the momentum is zero.
+    kAdam,          // Adam. The weight decay is added to the gradients as an L2 penalty.
+    kAdamW,         // Adam with decoupled weight decay.
+};
+
+// Hyperparameters of a fused optimizer step.
+struct OptimizerStepParams
+{
+    OptimizerType  type{OptimizerType::kAdam};
+    float  lr{0.001f};
+    float  beta1{0.9f};             // Exponential decay rate of the first moment, or the momentum of SGD.
+    float  beta2{0.999f};           // Exponential decay rate of the second moment.
+    float  epsilon{1e-8f};
+    float  weightDecay{0};
+    float  biasCorrection1{1};      // 1 - beta1^t at the time step t.
+    float  biasCorrection2{1};      // 1 - beta2^t at the time step t.
+};
+
+// Tensors of a parameter that a fused optimizer step updates in place. The master weights and the moments are Float32
+// tensors with the same size as the parameter. Unused tensors have null data.
+struct OptimizerTensorParams
+{
+    DeviceTensorParams  param{};
+    DeviceTensorParams  grad{};      // Has the data type of the parameter.
+    DeviceTensorParams  master{};    // Master weights of Float16 and BFloat16 parameters.
+    DeviceTensorParams  m{};         // First moment of Adam, or the momentum buffer of SGD.
+    DeviceTensorParams  v{};         // Second moment of Adam.
+    DeviceTensorParams  indices{};   // Int32 row indices of a sparse gradient, which has one gradient row for each index.
+};
+
+// Layout of the weights of a quantized matrix multiplication. Each UInt8 row holds the weights of an output channel:
+// the Float32 scales of the groups of inputs first, then the signed values of the inputs. Two 4-bit values share a
+// byte, the lower nibble first. Rows are padded to four bytes to keep the scales aligned.
+struct QuantizedLayout
+{
+    size_t  inputs{0};
+    size_t  outputs{0};
+    size_t  bits{8};            // 8 or 4.
+    size_t  groupSize{0};       // Number of consecutive inputs that share a scale.
+
+    // Returns a layout with one scale per output channel if the group size is zero.
+    static QuantizedLayout create(size_t inputs, size_t outputs, size_t bits, size_t groupSize = 0)
+    {
+        if (bits != 8 && bits != 4)
+        {
+            throw std::invalid_argument("Quantized weights support only 8 and 4 bits.");
+        }
+        groupSize = groupSize == 0 ? inputs : std::min(groupSize, inputs);
+        // Groups must start at byte boundaries.
+        if (inputs == 0 || (bits == 4 && groupSize < inputs && groupSize % 2 != 0))
+        {
+            throw std::invalid_argument("Invalid quantization group size.");
+        }
+        return { .inputs=inputs, .outputs=outputs, .bits=bits, .groupSize=groupSize };
+    }
+
+    size_t groupCount() const   { return (inputs + groupSize - 1) / groupSize; }
+    size_t valueOffset() const  { return groupCount() * sizeof(float); }       // Bytes of the scales of a row.
+    size_t rowSize() const      { return (valueOffset() + (inputs * bits + 7) / 8 + 3) / 4 * 4; }   // Bytes.
+    int    maxValue() const     { return bits == 8 ? 127 : 7; }
+
+    // Quantizes the [inputs, outputs] weights into the rows. The scale of a group maps its maximum absolute weight to
+    // the maximum value, and the weights are rounded to the nearest value.
+    void quantize(const float* weights, uint8_t* rows) const
+    {
+        std::fill(rows, rows + outputs * rowSize(), uint8_t(0));
+        for (size_t n = 0; n < outputs; ++n)
+        {
+            auto row = rows + n * rowSize();
+            auto values = row + valueOffset();
+            for (size_t group = 0; group < groupCount(); ++group)
+            {
+                size_t begin = group * groupSize;
+                size_t end   = std::min(begin + groupSize, inputs);
+                float maxAbs = 0;
+                for (size_t k = begin; k < end; ++k)
+                {
+                    maxAbs = std::max(maxAbs, std::abs(weights[k * outputs + n]));
+                }
+                float scale = maxAbs / static_cast<float>(maxValue());
+                std::memcpy(row + group * sizeof(float), &scale, sizeof(float));
+
+                for (size_t k = begin; k < end && scale > 0; ++k)
+                {
+                    auto value = static_cast<int>(std::lround(weights[k * outputs + n] / scale));
+                    auto byte  = static_cast<uint8_t>(std::clamp(value, -maxValue(), maxValue()));
+                    if (bits == 8)
+                        values[k] = byte;
+                    else
+                        values[k / 2] |= static_cast<uint8_t>((byte & 0xF) << (k % 2 * 4));
+                }
+            }
+        }
+    }
+};
+
+// Operations of axis reductions.
+enum class ReduceOp
+{
+    kSum,
+    kMax,
+    kArgmax,        // Writes the Int32 index of the first maximum along the reduced axis.
+};
+
+// An axis reduction viewed as a contiguous [outer, reduce, inner] tensor whose middle axis is reduced into a
+// contiguous [outer, inner] tensor. Any reduction of adjacent dimensions maps to this shape.
+struct ReduceShape
+{
+    size_t  outer{1};
+    size_t  reduce{1};
+    size_t  inner{1};
+};
+
+// Operations along the middle axis of a contiguous [outer, reduce, inner] tensor that compute a softmax or share its
+// statistics. The inputs of each operation are listed in order.
+enum class SoftmaxOp
+{
+    kSoftmax,               // Inputs: x. The result has the shape of x.
+    kLogSoftmax,            // Inputs: x.
+    kSoftmaxBackward,       // Inputs: softmax(x), seed of the softmax. The result is the gradient of x.
+    kLogSoftmaxBackward,    // Inputs: logSoftmax(x), seed of the log-softmax.
+    kCrossEntropy,          // Inputs: logits, target probabilities. The result is the [outer, inner] loss.
+    kCrossEntropyBackward,  // Inputs: logits, target probabilities, [outer, inner] seed of the loss.
+};
+
+// Element-wise activations that the epilogue of a matrix multiplication applies, see Device::linear().
+enum class Activation
+{
+    kNone,
+    kTanh,
+    kSigmoid,
+    kGeLU,          // The tanh approximation of nn::GeLU.
+};
+
+// The stage of a GEMM that adds the bias of the result columns to the accumulators and applies the activation before
+// the result is written. The pointers have the data type of the result and they are optional.
+struct GemmEpilogue
+{
+    const void*  bias{nullptr};
+    Activation   activation{Activation::kNone};
+    void*        preActivation{nullptr};    // Receives the values before the activation.
+
+    inline bool empty() const   { return !bias && activation == Activation::kNone && !preActivation; }
+};
+
+// Profiler of device operations. When enabled, every device operation records its name, data type, shapes, bytes
+// moved and wall time. Nested device calls are part of the outermost operation of a thread.
+namespace profiler
+{
+
+struct Event
+{
+    std::string  name;
+    std::string  category;          // "op" for device operations, "gpu" for GPU command buffer executions.
+    DataType     dtype{DataType::kFloat32};
+    std::string  shapes;
+    size_t       bytes{0};          // Total size of the inputs and the result.
+    double       startTime{0};      // Microseconds.
+    double       duration{0};       // Microseconds.
+    size_t       threadIndex{0};    // Index zero is reserved for the GPU timeline.
+};
+
+struct OpStats
+{
+    std::string  name;
+    size_t       count{0};
+    double       totalTime{0};      // Microseconds.
+    size_t       bytes{0};
+};
+
+struct ProfilerState
+{
+    std::atomic<bool>  enabled{false};
+    std::mutex  mutex;
+    std::vector<Event>  events;
+    std::unordered_map<std::thread::id, size_t>  threadIndices;
+};
+
+inline ProfilerState & state()
+{
+    static ProfilerState profilerState;
+    return profilerState;
+}
+
+// Returns the current time in microseconds. The steady clock shares its time base with the GPU timestamps of Metal.
+inline double now()
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline bool isEnabled()     { return state().enabled.load(std::memory_order_relaxed); }
+inline void start()         { state().enabled = true;  }
+inline void stop()          { state().enabled = false; }
+
+inline void clear()
+{
+    std::lock_guard<std::mutex>  lock(state().mutex);
+    state().events.clear();
+}
+
+inline std::vector<Event> events()
+{
+    std::lock_guard<std::mutex>  lock(state().mutex);
+    return state().events;
+}
+
+inline void record(Event event, bool isGPUEvent = false)
+{
+    auto & profilerState = state();
+    std::lock_guard<std::mutex>  lock(profilerState.mutex);
+    if (!isGPUEvent)
+    {
+        auto [it, inserted] = profilerState.threadIndices.emplace(std::this_thread::get_id(),
+                                                                  profilerState.threadIndices.size() + 1);
+        event.threadIndex = it->second;
+    }
+    profilerState.events.emplace_back(std::move(event));
+}
+
+// Records the execution of a GPU command buffer. Times are in seconds.
+inline void recordGPUEvent(const std::string & name, double startSeconds, double endSeconds, size_t commandCount)
+{
+    if (!isEnabled() || endSeconds <= startSeconds) return;
+    Event event{ .name=name, .category="gpu", .shapes=std::to_string(commandCount) + " commands",
+                 .startTime=startSeconds * 1e6, .duration=(endSeconds - startSeconds) * 1e6, .threadIndex=0 };
+    record(std::move(event), true);
+}
+
+// Returns the statistics of the recorded operations, sorted by total time in descending order.
+inline std::vector<OpStats> aggregate();
+
+// Returns the aggregated statistics as a table.
+inline std::string summary();
+
+// Saves the recorded events in Chrome trace JSON format, which can be viewed in chrome://tracing or Perfetto.
+inline void saveChromeTrace(const std::string & filename);
+
+// Records a device operation from its construction until its destruction.
+class OpScope
+{
+public:
+    OpScope(const char* name, std::initializer_list<const DeviceTensorParams*> params);
+    OpScope(const char* name, const std::vector<DeviceTensorParams> & inputs, const DeviceTensorParams & result);
+    OpScope(const char* name, DataType dtype, size_t bytes);
+    ~OpScope();
+
+    OpScope(const OpScope&) = delete;
+    OpScope& operator=(const OpScope&) = delete;
+
+private:
+    static size_t & nestingDepth()
+    {
+        thread_local size_t depth = 0;
+        return depth;
+    }
+
+    bool begin();
+    void add(const DeviceTensorParams & params);
+
+    bool   m_tracked{false};
+    bool   m_recorded{false};
+    Event  m_event;
 };
 
+}   // profiler namespace
+
+
 class Device
 {
 public:
@@ -160,9 +510,10 @@ public:
         return dTypeSizeTable[static_cast<size_t>(dtype)];
     }
 
+    // Allocations are served by the memory cache of the device. All allocations are aligned to 64 bytes.
     virtual void* allocate(size_t size)
     {
-        return std::malloc(size);
+        return m_memoryCache.allocate(size);
     }
 
     virtual void* allocate(size_t size, DataType dtype)
@@ -172,11 +523,37 @@ public:
 
     virtual void deallocate(void * memory)
     {
-        return std::free(memory);
+        m_memoryCache.deallocate(memory);
+    }
+
+    // Returns device memory that aliases the given page-aligned host memory without copying, or nullptr if the device
+    // cannot use the host memory directly. Mapped memory must be released by unmapHostMemory() instead of deallocate().
+    virtual void* mapHostMemory(void * memory, [[maybe_unused]] size_t size)
+    {
+        return memory;
+    }
+
+    virtual void unmapHostMemory([[maybe_unused]] void * memory)
+    {
+    }
+
+    // Returns device memory that only the device can access, or nullptr if the device does not support it. The host
+    // can access the memory after makeHostAccessible() is called.
+    virtual void* allocatePrivate([[maybe_unused]] size_t size, [[maybe_unused]] DataType dtype)
+    {
+        return nullptr;
+    }
+
+    // Returns memory with the same content that the host can access. Private memory is released and must not be used
+    // after the call. Other memory is returned as is.
+    virtual void* makeHostAccessible(void * memory, [[maybe_unused]] size_t size)
+    {
+        return memory;
     }
 
     virtual void add(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("add", {&a1, &a2, &result});
         static const auto funcTable = std::array
         {
             addGeneric<double    >,
@@ -195,6 +572,7 @@ public:
 
     virtual void sub(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("sub", {&a1, &a2, &result});
         static const auto funcTable = std::array
         {
             subGeneric<double    >,
@@ -213,6 +591,7 @@ public:
 
     virtual void mul(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("mul", {&a1, &a2, &result});
         static const auto funcTable = std::array
         {
             mulGeneric<double    >,
@@ -231,6 +610,7 @@ public:
 
     virtual void div(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("div", {&a1, &a2, &result});
         static const auto funcTable = std::array
         {
             divGeneric<double    >,
@@ -249,6 +629,7 @@ public:
 
     virtual void unary(const DeviceTensorParams& a1, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("unary", {&a1, &result});
         static const auto funcTable = std::array
         {
             unaryGeneric<double    >,
@@ -267,6 +648,7 @@ public:
 
     virtual void fill(const void* scalar, DataType scalarDType, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("fill", {&result});
         // Define a function pointer type for the conversion copy functions.
         using fillFunc = void (*)(const void*, const DeviceTensorParams&);
 
@@ -289,6 +671,7 @@ public:
 
     virtual void fillMin(const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("fillMin", {&result});
         // Create a lookup table of the functions.
         static const auto funcTable = std::array
         {
@@ -308,6 +691,7 @@ public:
 
     virtual void sum(const DeviceTensorParams& a, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("sum", {&a, &result});
         static const auto funcTable = std::array
         {
             sumGeneric<double    >,
@@ -326,6 +710,7 @@ public:
 
     virtual void sqrt(const DeviceTensorParams& a, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("sqrt", {&a, &result});
         static const auto funcTable = std::array
         {
             sqrtGeneric<double    >,
@@ -344,6 +729,7 @@ public:
 
     virtual void sin(const DeviceTensorParams& a, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("sin", {&a, &result});
         static const auto funcTable = std::array
         {
             sinGeneric<double    >,
@@ -362,6 +748,7 @@ public:
 
     virtual void cos(const DeviceTensorParams& a, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("cos", {&a, &result});
         static const auto funcTable = std::array
         {
             cosGeneric<double    >,
@@ -380,6 +767,7 @@ public:
 
     virtual void tanh(const DeviceTensorParams& a, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("tanh", {&a, &result});
         static const auto funcTable = std::array
         {
             tanhGeneric<double    >,
@@ -398,6 +786,7 @@ public:
 
     virtual void log(const DeviceTensorParams& a, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("log", {&a, &result});
         static const auto funcTable = std::array
         {
             logGeneric<double    >,
@@ -416,6 +805,7 @@ public:
 
     virtual void exp(const DeviceTensorParams& a, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("exp", {&a, &result});
         static const auto funcTable = std::array
         {
             expGeneric<double    >,
@@ -434,6 +824,7 @@ public:
 
     virtual void pow(const DeviceTensorParams& a, const DeviceTensorParams& exp, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("pow", {&a, &exp, &result});
         static const auto funcTable = std::array
         {
             powGeneric<double    >,
@@ -452,6 +843,7 @@ public:
 
     virtual void max(const DeviceTensorParams& a, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("max", {&a, &result});
         static const auto funcTable = std::array
         {
             maxGeneric<double    >,
@@ -470,6 +862,7 @@ public:
 
     virtual void argmax(const DeviceTensorParams& a, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("argmax", {&a, &result});
         if (result.dtype != DataType::kInt32)
         {
             throw std::invalid_argument("Device::argmax supports only int32 data type for its result.");
@@ -493,6 +886,7 @@ public:
 
     virtual void argmaxIndices(const DeviceTensorParams& a, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("argmaxIndices", {&a, &result});
         if (result.dtype != DataType::kInt32)
         {
             throw std::invalid_argument("Device::argmaxIndices supports only int32 data type for its result.");
@@ -514,8 +908,19 @@ public:
         funcTable[static_cast<size_t>(a.dtype)](a, result);
     }
 
+    // Matrix multiplication of the last two dimensions. A batched input either has the batch dimensions of the
+    // result or holds a single matrix that is broadcast to all batches.
     virtual void matmul(const DeviceTensorParams& a, const DeviceTensorParams& b, const DeviceTensorParams& result)
     {
+        profiler::OpScope scope("matmul", {&a, &b, &result});
+        matmulTransposed(a, false, b, false, result);
+    }
+
+    // Matrix multiplication that reads the transpose of a and/or b without materializing it.
+    virtual void matmulTransposed(const DeviceTensorParams& a, bool transposeA, const DeviceTensorParams& b,
+                                  bool transposeB, const DeviceTensorParams& result)
+    {
+        profiler::OpScope scope("matmulTransposed", {&a, &b, &result});
         static const auto funcTable = std::array
         {
             matmulGeneric<double    >,
@@ -529,11 +934,59 @@ public:
             matmulGeneric<uint8_t   >,
         };
         // Call the appropriate function from the table.
-        funcTable[static_cast<size_t>(result.dtype)](a, b, result);
+        funcTable[static_cast<size_t>(result.dtype)](a, transposeA, b, transposeB, result);
+    }
+
+    // Computes the [rows, outputs] result of the [rows, inputs] matrix a multiplied by the transpose of the quantized
+    // weights of the layout. The weights are dequantized in registers, so only the quantized bytes are read.
+    virtual void matmulQuantized(const DeviceTensorParams& a, const DeviceTensorParams& w,
+                                 const QuantizedLayout& layout, const DeviceTensorParams& result)
+    {
+        profiler::OpScope scope("matmulQuantized", {&a, &w, &result});
+        static const auto funcTable = std::array
+        {
+            matmulQuantizedGeneric<double    >,
+            matmulQuantizedGeneric<float     >,
+            matmulQuantizedGeneric<float16_t >,
+            matmulQuantizedGeneric<bfloat16_t>,
+            matmulQuantizedGeneric<int64_t   >,
+            matmulQuantizedGeneric<int32_t   >,
+            matmulQuantizedGeneric<int16_t   >,
+            matmulQuantizedGeneric<int8_t    >,
+            matmulQuantizedGeneric<uint8_t   >,
+        };
+        // Call the appropriate function from the table.
+        funcTable[static_cast<size_t>(result.dtype)](a, w, layout, result, 0, layout.outputs);
+    }
+
+    // Computes result = activation(a * b + bias) of the [rows, inputs] matrix a, the [inputs, outputs] matrix b and
+    // the [outputs] bias, which is added to each row. The bias and the activation are applied by the epilogue of the
+    // matrix multiplication, which also writes the values before the activation if preActivation has data.
+    virtual void linear(const DeviceTensorParams& a, const DeviceTensorParams& b, const DeviceTensorParams& bias,
+                        Activation activation, const DeviceTensorParams& preActivation,
+                        const DeviceTensorParams& result)
+    {
+        profiler::OpScope scope("linear", {&a, &b, &bias, &result});
+        static const auto funcTable = std::array
+        {
+            gemmGeneric<double    >,
+            gemmGeneric<float     >,
+            gemmGeneric<float16_t >,
+            gemmGeneric<bfloat16_t>,
+            gemmGeneric<int64_t   >,
+            gemmGeneric<int32_t   >,
+            gemmGeneric<int16_t   >,
+            gemmGeneric<int8_t    >,
+            gemmGeneric<uint8_t   >,
+        };
+        // Call the appropriate function from the table.
+        funcTable[static_cast<size_t>(result.dtype)](a, false, b, false, result, 0, result.shape[0], 0,
+                                                     result.shape[1], { bias.data, activation, preActivation.data });
     }
 
     virtual void transpose(const DeviceTensorParams& a, const DeviceTensorParams& result, size_t dim0, size_t dim1)
     {
+        profiler::OpScope scope("transpose", {&a, &result});
         static const auto funcTable = std::array
         {
             transposeGeneric<double    >,
@@ -547,11 +1000,12 @@ public:
             transposeGeneric<uint8_t   >,
         };
         // Call the appropriate function from the table.
-        funcTable[static_cast<size_t>(result.dtype)](a, result, dim0, dim1);
+        funcTable[static_cast<size_t>(result.dtype)](a, result, dim0, dim1, 0, a.size);
     }
 
     virtual void copy(const void* src, DataType srcDType, void* dst, DataType dstDType, size_t size)
     {
+        profiler::OpScope scope("copy", dstDType, size * (dataTypeSize(srcDType) + dataTypeSize(dstDType)));
         // Define a function pointer type for the conversion copy functions.
         using copyFunc = void (*)(const void*, void*, size_t);
 
@@ -574,12 +1028,14 @@ public:
 
     virtual void copyImmediate(const void* src, DataType srcDType, void* dst, DataType dstDType, size_t size)
     {
+        profiler::OpScope scope("copyImmediate", dstDType, size * (dataTypeSize(srcDType) + dataTypeSize(dstDType)));
         copy(src, srcDType, dst, dstDType, size);
         synchronize();    // This call has no effect, but it shows the difference between copy and copyImmediate.
     }
 
     virtual void contiguous(const DeviceTensorParams& src, const DeviceTensorParams& dst)
     {
+        profiler::OpScope scope("contiguous", {&src, &dst});
         static const auto funcTable = std::array
         {
             contiguousGeneric<double    >,
@@ -593,70 +1049,88 @@ public:
             contiguousGeneric<uint8_t   >,
         };
         // Call the appropriate function from the table.
-        funcTable[static_cast<size_t>(src.dtype)](src, dst);
+        funcTable[static_cast<size_t>(src.dtype)](src, dst, 0, dst.size);
     }
 
-    virtual void reduceTo(const DeviceTensorParams& src, const DeviceTensorParams& dst)
+    // Reduces the middle axis of a contiguous [outer, reduce, inner] source into a contiguous [outer, inner] result.
+    // Both could start at a storage offset.
+    virtual void reduce(ReduceOp op, const DeviceTensorParams& src, const DeviceTensorParams& dst,
+                        const ReduceShape& shape)
     {
+        profiler::OpScope scope("reduce", {&src, &dst});
+        if (op == ReduceOp::kArgmax && dst.dtype != DataType::kInt32)
+        {
+            throw std::invalid_argument("Device::reduce supports only int32 data type for the result of argmax.");
+        }
+
         static const auto funcTable = std::array
         {
-            reduceToGeneric<double    >,
-            reduceToGeneric<float     >,
-            reduceToGeneric<float16_t >,
-            reduceToGeneric<bfloat16_t>,
-            reduceToGeneric<int64_t   >,
-            reduceToGeneric<int32_t   >,
-            reduceToGeneric<int16_t   >,
-            reduceToGeneric<int8_t    >,
-            reduceToGeneric<uint8_t   >,
+            reduceGeneric<double    >,
+            reduceGeneric<float     >,
+            reduceGeneric<float16_t >,
+            reduceGeneric<bfloat16_t>,
+            reduceGeneric<int64_t   >,
+            reduceGeneric<int32_t   >,
+            reduceGeneric<int16_t   >,
+            reduceGeneric<int8_t    >,
+            reduceGeneric<uint8_t   >,
         };
         // Call the appropriate function from the table.
-        funcTable[static_cast<size_t>(src.dtype)](src, dst);
+        funcTable[static_cast<size_t>(src.dtype)](op, src, dst, shape, 0, shape.outer, 0, shape.inner);
     }
 
+    // Sums a contiguous source into the shape of the result, which the source shape is broadcast from. The result is
+    // overwritten. Kept for the callers of the former device API, the sum is computed by reduce().
+    virtual void reduceTo(const DeviceTensorParams& src, const DeviceTensorParams& dst)
+    {
+        reduceToShape(ReduceOp::kSum, src, dst);
+    }
+
+    // Computes the maximum of a contiguous source into the shape of the result, which the source shape is broadcast
+    // from. The result is overwritten.
     virtual void maxTo(const DeviceTensorParams& src, const DeviceTensorParams& dst)
     {
-        static const auto funcTable = std::array
-        {
-            maxToGeneric<double    >,
-            maxToGeneric<float     >,
-            maxToGeneric<float16_t >,
-            maxToGeneric<bfloat16_t>,
-            maxToGeneric<int64_t   >,
-            maxToGeneric<int32_t   >,
-            maxToGeneric<int16_t   >,
-            maxToGeneric<int8_t    >,
-            maxToGeneric<uint8_t   >,
-        };
-        // Call the appropriate function from the table.
-        funcTable[static_cast<size_t>(src.dtype)](src, dst);
+        reduceToShape(ReduceOp::kMax, src, dst);
     }
 
+    // Writes the Int32 indices of the maximum values along the dimension of a contiguous source. The result has the
+    // shape of the source with a size of one in the dimension.
     virtual void argmaxTo(const DeviceTensorParams& src, const DeviceTensorParams& dst, size_t dim)
     {
-        if (dst.dtype != DataType::kInt32)
+        if (dim >= src.shape.size())
         {
-            throw std::invalid_argument("Device::argmaxTo supports only int32 data type for its result.");
+            throw std::invalid_argument("Device::argmaxTo dimension is out of range.");
         }
+        ReduceShape shape{ .reduce=src.shape[dim] };
+        for (size_t i = 0; i < dim; ++i) shape.outer *= src.shape[i];
+        for (size_t i = dim + 1; i < src.shape.size(); ++i) shape.inner *= src.shape[i];
+        reduce(ReduceOp::kArgmax, src, dst, shape);
+    }
 
+    // Computes a softmax operation along the middle axis of contiguous [outer, reduce, inner] inputs.
+    virtual void softmax(SoftmaxOp op, const std::vector<DeviceTensorParams>& inputs, const DeviceTensorParams& result,
+                         const ReduceShape& shape)
+    {
+        profiler::OpScope scope("softmax", inputs, result);
         static const auto funcTable = std::array
         {
-            argmaxToGeneric<double    , int32_t>,
-            argmaxToGeneric<float     , int32_t>,
-            argmaxToGeneric<float16_t , int32_t>,
-            argmaxToGeneric<bfloat16_t, int32_t>,
-            argmaxToGeneric<int64_t   , int32_t>,
-            argmaxToGeneric<int32_t   , int32_t>,
-            argmaxToGeneric<int16_t   , int32_t>,
-            argmaxToGeneric<int8_t    , int32_t>,
-            argmaxToGeneric<uint8_t   , int32_t>,
+            softmaxGeneric<double    >,
+            softmaxGeneric<float     >,
+            softmaxGeneric<float16_t >,
+            softmaxGeneric<bfloat16_t>,
+            softmaxGeneric<int64_t   >,
+            softmaxGeneric<int32_t   >,
+            softmaxGeneric<int16_t   >,
+            softmaxGeneric<int8_t    >,
+            softmaxGeneric<uint8_t   >,
         };
         // Call the appropriate function from the table.
-        funcTable[static_cast<size_t>(src.dtype)](src, dst, dim);
+        funcTable[static_cast<size_t>(result.dtype)](op, inputs, result, shape, 0, shape.outer, 0, shape.inner);
     }
 
     virtual void argmaxIndicesTo(const DeviceTensorParams& src, const DeviceTensorParams& dst, size_t dim)
     {
+        profiler::OpScope scope("argmaxIndicesTo", {&src, &dst});
         if (dst.dtype != DataType::kInt32)
         {
             throw std::invalid_argument("Device::argmaxIndicesTo supports only int32 data type for its result.");
@@ -681,6 +1155,7 @@ public:
     virtual void sliceSet(const DeviceTensorParams& src, const DeviceTensorParams& dst,
                           size_t dim, size_t start, size_t end, size_t step)
     {
+        profiler::OpScope scope("sliceSet", {&src, &dst});
         static const auto funcTable = std::array
         {
             sliceSetGeneric<double    >,
@@ -694,11 +1169,12 @@ public:
             sliceSetGeneric<uint8_t   >,
         };
         // Call the appropriate function from the table.
-        funcTable[static_cast<size_t>(src.dtype)](src, dst, dim, start, end, step);
+        funcTable[static_cast<size_t>(src.dtype)](src, dst, dim, start, end, step, 0, src.size);
     }
 
     virtual void tril(const DeviceTensorParams& dst, ssize_t diagonal)
     {
+        profiler::OpScope scope("tril", {&dst});
         static const auto funcTable = std::array
         {
             trilGeneric<double    >,
@@ -712,11 +1188,12 @@ public:
             trilGeneric<uint8_t   >,
         };
         // Call the appropriate function from the table.
-        funcTable[static_cast<size_t>(dst.dtype)](dst, diagonal);
+        funcTable[static_cast<size_t>(dst.dtype)](dst, diagonal, 0, dst.size);
     }
 
     virtual void triu(const DeviceTensorParams& dst, ssize_t diagonal)
     {
+        profiler::OpScope scope("triu", {&dst});
         static const auto funcTable = std::array
         {
             triuGeneric<double    >,
@@ -730,12 +1207,13 @@ public:
             triuGeneric<uint8_t   >,
         };
         // Call the appropriate function from the table.
-        funcTable[static_cast<size_t>(dst.dtype)](dst, diagonal);
+        funcTable[static_cast<size_t>(dst.dtype)](dst, diagonal, 0, dst.size);
     }
 
     virtual void indexSelect(const DeviceTensorParams& src, const DeviceTensorParams& dst,
                              const DeviceTensorParams& indices, size_t dim)
     {
+        profiler::OpScope scope("indexSelect", {&src, &indices, &dst});
         static const auto funcTable = std::array
         {
             indexSelectGeneric<double    , int32_t>,
@@ -749,12 +1227,13 @@ public:
             indexSelectGeneric<uint8_t   , int32_t>,
         };
         // Call the appropriate function from the table.
-        funcTable[static_cast<size_t>(src.dtype)](src, dst, indices, dim);
+        funcTable[static_cast<size_t>(src.dtype)](src, dst, indices, dim, 0, dst.size);
     }
 
     virtual void indexAdd(const DeviceTensorParams& src, const DeviceTensorParams& dst,
                           const DeviceTensorParams& indices, size_t dim)
     {
+        profiler::OpScope scope("indexAdd", {&src, &indices, &dst});
         static const auto funcTable = std::array
         {
             indexAddGeneric<double    , int32_t>,
@@ -771,197 +1250,459 @@ public:
         funcTable[static_cast<size_t>(src.dtype)](src, dst, indices, dim);
     }
 
+    // Evaluates a fused program of element-wise operations in a single pass over the elements. Inputs and the result
+    // have the same size and data type.
+    virtual void fusedElementwise(const FusedProgram& program, const std::vector<DeviceTensorParams>& inputs,
+                                  const DeviceTensorParams& result)
+    {
+        profiler::OpScope scope("fusedElementwise", inputs, result);
+        static const auto funcTable = std::array
+        {
+            fusedElementwiseGeneric<double    >,
+            fusedElementwiseGeneric<float     >,
+            fusedElementwiseGeneric<float16_t >,
+            fusedElementwiseGeneric<bfloat16_t>,
+            fusedElementwiseGeneric<int64_t   >,
+            fusedElementwiseGeneric<int32_t   >,
+            fusedElementwiseGeneric<int16_t   >,
+            fusedElementwiseGeneric<int8_t    >,
+            fusedElementwiseGeneric<uint8_t   >,
+        };
+        // Call the appropriate function from the table.
+        funcTable[static_cast<size_t>(result.dtype)](program, inputs, result, 0, result.size);
+    }
+
+    // Applies an optimizer step to a list of parameters in place. The parameter, its master weights and its moments
+    // are updated in a single pass over the elements.
+    virtual void optimizerStep(const OptimizerStepParams& step, const std::vector<OptimizerTensorParams>& tensors)
+    {
+        profiler::OpScope scope("optimizerStep", {});
+        static const auto funcTable = std::array
+        {
+            optimizerStepGeneric<double    >,
+            optimizerStepGeneric<float     >,
+            optimizerStepGeneric<float16_t >,
+            optimizerStepGeneric<bfloat16_t>,
+            optimizerStepGeneric<int64_t   >,
+            optimizerStepGeneric<int32_t   >,
+            optimizerStepGeneric<int16_t   >,
+            optimizerStepGeneric<int8_t    >,
+            optimizerStepGeneric<uint8_t   >,
+        };
+        for (const auto& tensor : tensors)
+        {
+            // Call the appropriate function from the table.
+            funcTable[static_cast<size_t>(tensor.param.dtype)](step, tensor, 0, tensor.grad.size);
+        }
+    }
+
+    // Releases the cached memory blocks of the device.
     virtual void emptyCache()
     {
+        m_memoryCache.clear();
     }
 
+    // Returns the memory usage and the cache statistics of the host memory allocations of the device.
+    virtual cpu::MemoryCacheStats memoryStats()         { return m_memoryCache.stats(); }
+
+    // Sets the maximum number of released bytes that the device keeps for reuse.
+    virtual void memoryCacheLimit(size_t bytes)         { m_memoryCache.limit(bytes); }
+
     virtual void synchronize()
     {
+        profiler::OpScope scope("synchronize", {});
     }
 
 protected:
-    template <typename T>
-    static void addGeneric(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
+    // Iterates the storage indices of a strided tensor view, such as a broadcast or a transposed view, in row-major
+    // element order.
+    class StridedIndex
     {
-        auto t1  = static_cast<const T*>(a1.data);
-        auto t2  = static_cast<const T*>(a2.data);
-        auto res = static_cast<T*>(result.data);
-
-        for (size_t i = 0; i < a1.size; ++i)
+    public:
+        explicit StridedIndex(const DeviceTensorParams& params, size_t element = 0) :
+            m_shape{params.shape}, m_strides{params.strides}, m_coords(params.shape.size(), 0), m_index{params.offset}
         {
-            res[i] = t1[i] + t2[i];
+            // Starts from the given element in row-major order, such as the first element of a chunk.
+            for (size_t dim = m_shape.size(); dim-- > 0 && element > 0;)
+            {
+                m_coords[dim] = element % m_shape[dim];
+                element /= m_shape[dim];
+                m_index += m_coords[dim] * m_strides[dim];
+            }
         }
-    }
 
-    template <typename T>
-    static void subGeneric(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
-    {
-        auto t1  = static_cast<const T*>(a1.data);
-        auto t2  = static_cast<const T*>(a2.data);
-        auto res = static_cast<T*>(result.data);
+        inline size_t operator*() const     { return m_index; }
 
-        for (size_t i = 0; i < a1.size; ++i)
+        // Moves to the next element. The innermost dimension changes the fastest.
+        inline void next()
         {
-            res[i] = t1[i] - t2[i];
+            for (size_t dim = m_shape.size(); dim-- > 0;)
+            {
+                m_index += m_strides[dim];
+                if (++m_coords[dim] < m_shape[dim]) return;
+                m_index -= m_coords[dim] * m_strides[dim];
+                m_coords[dim] = 0;
+            }
         }
-    }
+
+    private:
+        const Shape&   m_shape;
+        const Stride&  m_strides;
+        Index   m_coords;
+        size_t  m_index;
+    };
 
     template <typename T>
-    static void mulGeneric(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
+    static constexpr bool isHalfFloat = std::is_same_v<T, float16_t> || std::is_same_v<T, bfloat16_t>;
+
+    // Number of elements of the float32 blocks that half precision kernels compute in.
+    static constexpr size_t halfFloatBlockSize = 256;
+
+    // Applies a binary function element-wise. The result is contiguous, the operands could be strided views.
+    template <typename T, typename Func>
+    static void binaryGeneric(const DeviceTensorParams& a1, const DeviceTensorParams& a2,
+                              const DeviceTensorParams& result, const Func& func)
     {
         auto t1  = static_cast<const T*>(a1.data);
         auto t2  = static_cast<const T*>(a2.data);
         auto res = static_cast<T*>(result.data);
 
-        for (size_t i = 0; i < a1.size; ++i)
+        if (a1.isContiguous && a2.isContiguous)
         {
-            res[i] = t1[i] * t2[i];
-        }
-    }
+            t1 += a1.offset;
+            t2 += a2.offset;
+            if constexpr (isHalfFloat<T>)
+            {
+                // Half precision operands are converted to float32 in blocks with the bulk conversions instead of
+                // converting every element of every operation.
+                float x[halfFloatBlockSize];
+                float y[halfFloatBlockSize];
+                for (size_t begin = 0; begin < result.size; begin += halfFloatBlockSize)
+                {
+                    size_t count = std::min(halfFloatBlockSize, result.size - begin);
+                    convertToFloat32(t1 + begin, x, count);
+                    convertToFloat32(t2 + begin, y, count);
+                    for (size_t j = 0; j < count; ++j)
+                    {
+                        x[j] = func(x[j], y[j]);
+                    }
+                    convertFromFloat32(x, res + begin, count);
+                }
+                return;
+            }
 
-    template <typename T>
-    static void divGeneric(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
-    {
-        auto t1  = static_cast<const T*>(a1.data);
-        auto t2  = static_cast<const T*>(a2.data);
-        auto res = static_cast<T*>(result.data);
+            for (size_t i = 0; i < result.size; ++i)
+            {
+                res[i] = func(t1[i], t2[i]);
+            }
+            return;
+        }
 
-        for (size_t i = 0; i < a1.size; ++i)
+        StridedIndex index1(a1);
+        StridedIndex index2(a2);
+        for (size_t i = 0; i < result.size; ++i, index1.next(), index2.next())
         {
-            res[i] = t1[i] / t2[i];
+            res[i] = func(t1[*index1], t2[*index2]);
         }
     }
 
     template <typename T>
-    static void unaryGeneric(const DeviceTensorParams& a1, const DeviceTensorParams& result)
+    static void addGeneric(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
     {
-        auto t1  = static_cast<const T*>(a1.data);
-        auto res = static_cast<T*>(result.data);
-
-        for (size_t i = 0; i < a1.size; ++i)
-        {
-            res[i] = -t1[i];
-        }
+        binaryGeneric<T>(a1, a2, result, [](auto x, auto y) { return x + y; });
     }
 
-    template <typename SrcType, typename DstType>
-    static void fillGeneric(const void* scalar, const DeviceTensorParams& result)
+    template <typename T>
+    static void subGeneric(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
     {
-        auto tSrc = static_cast<const SrcType*>(scalar);
-        auto tDst = static_cast<DstType*>(result.data);
-        for (size_t i=0; i<result.size; ++i)
-        {
-            tDst[i] = static_cast<DstType>(tSrc[0]);
-        }
+        binaryGeneric<T>(a1, a2, result, [](auto x, auto y) { return x - y; });
     }
 
     template <typename T>
-    static void fillMinGeneric(const DeviceTensorParams& result)
+    static void mulGeneric(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
     {
-        auto tDst = static_cast<T*>(result.data);
-        for (size_t i=0; i<result.size; ++i)
-        {
-            tDst[i] = std::numeric_limits<T>::lowest();
-        }
+        binaryGeneric<T>(a1, a2, result, [](auto x, auto y) { return x * y; });
     }
 
     template <typename T>
-    static void sumGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result)
+    static void divGeneric(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
     {
-        auto t1  = static_cast<const T*>(a.data);
-        auto res = static_cast<T*>(result.data);
-
-        T sum = 0;
-        for (size_t i = 0; i < a.size; ++i)
-        {
-            sum += t1[i];
-        }
-        *res = sum;
+        binaryGeneric<T>(a1, a2, result, [](auto x, auto y) { return x / y; });
     }
 
-    template <typename T>
-    static void sqrtGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result)
+    // Applies a unary function element-wise. The result is contiguous, the input could be a strided view.
+    template <typename T, typename Func>
+    static void mapGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result, const Func& func)
     {
         auto t1  = static_cast<const T*>(a.data);
         auto res = static_cast<T*>(result.data);
 
-        for (size_t i = 0; i < a.size; ++i)
+        if (!a.isContiguous)
         {
-            res[i] = std::sqrt(t1[i]);
+            StridedIndex index(a);
+            for (size_t i = 0; i < result.size; ++i, index.next())
+            {
+                if constexpr (isHalfFloat<T>)
+                    res[i] = static_cast<T>(func(static_cast<float>(t1[*index])));
+                else
+                    res[i] = func(t1[*index]);
+            }
+            return;
         }
-    }
 
-    template <typename T>
-    static void sinGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result)
-    {
-        auto t1  = static_cast<const T*>(a.data);
-        auto res = static_cast<T*>(result.data);
+        t1 += a.offset;
+        if constexpr (isHalfFloat<T>)
+        {
+            float x[halfFloatBlockSize];
+            for (size_t begin = 0; begin < a.size; begin += halfFloatBlockSize)
+            {
+                size_t count = std::min(halfFloatBlockSize, a.size - begin);
+                convertToFloat32(t1 + begin, x, count);
+                for (size_t j = 0; j < count; ++j)
+                {
+                    x[j] = func(x[j]);
+                }
+                convertFromFloat32(x, res + begin, count);
+            }
+            return;
+        }
 
         for (size_t i = 0; i < a.size; ++i)
         {
-            res[i] = std::sin(t1[i]);
+            res[i] = func(t1[i]);
         }
     }
 
     template <typename T>
-    static void cosGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result)
+    static void unaryGeneric(const DeviceTensorParams& a1, const DeviceTensorParams& result)
     {
-        auto t1  = static_cast<const T*>(a.data);
+        mapGeneric<T>(a1, result, [](auto x) { return -x; });
+    }
+
+    // Evaluates a fused program for the [begin, end) element range. The elements are processed in blocks, and each
+    // instruction keeps its results for a block in a scratch buffer that stays in the L1 cache.
+    template <typename T>
+    static void fusedElementwiseGeneric(const FusedProgram& program, const std::vector<DeviceTensorParams>& inputs,
+                                        const DeviceTensorParams& result, size_t begin, size_t end)
+    {
+        using AccType = std::conditional_t<std::is_same_v<T, double>, double, float>;
+        constexpr size_t blockSize = 256;
         auto res = static_cast<T*>(result.data);
 
-        for (size_t i = 0; i < a.size; ++i)
+        thread_local std::vector<AccType> scratch;
+        scratch.resize(program.size() * blockSize);
+
+        for (size_t blockBegin = begin; blockBegin < end; blockBegin += blockSize)
         {
-            res[i] = std::cos(t1[i]);
+            size_t count = std::min(blockSize, end - blockBegin);
+            for (size_t i = 0; i < program.size(); ++i)
+            {
+                const auto& instruction = program[i];
+                auto out = scratch.data() + i * blockSize;
+                auto x = [&]() { return scratch.data() + instruction.operand1 * blockSize; };
+                auto y = [&]() { return scratch.data() + instruction.operand2 * blockSize; };
+                auto unaryOp = [&](const auto& func)
+                {
+                    auto t1 = x();
+                    for (size_t j = 0; j < count; ++j) out[j] = func(t1[j]);
+                };
+                auto binaryOp = [&](const auto& func)
+                {
+                    auto t1 = x();
+                    auto t2 = y();
+                    for (size_t j = 0; j < count; ++j) out[j] = func(t1[j], t2[j]);
+                };
+
+                switch (instruction.opCode)
+                {
+                    case FusedOpCode::kInput:
+                    {
+                        auto t1 = static_cast<const T*>(inputs[instruction.operand1].data) + blockBegin;
+                        if constexpr (isHalfFloat<T>)
+                            convertToFloat32(t1, out, count);
+                        else
+                            for (size_t j = 0; j < count; ++j) out[j] = static_cast<AccType>(t1[j]);
+                        break;
+                    }
+                    case FusedOpCode::kConstant: std::fill_n(out, count, static_cast<AccType>(instruction.constant)); break;
+                    case FusedOpCode::kAdd:  binaryOp([](AccType a, AccType b) { return a + b; });  break;
+                    case FusedOpCode::kSub:  binaryOp([](AccType a, AccType b) { return a - b; });  break;
+                    case FusedOpCode::kMul:  binaryOp([](AccType a, AccType b) { return a * b; });  break;
+                    case FusedOpCode::kDiv:  binaryOp([](AccType a, AccType b) { return a / b; });  break;
+                    case FusedOpCode::kNeg:  unaryOp([](AccType a) { return -a; });                 break;
+                    case FusedOpCode::kSqrt: unaryOp([](AccType a) { return std::sqrt(a); });       break;
+                    case FusedOpCode::kSin:  unaryOp([](AccType a) { return std::sin(a); });        break;
+                    case FusedOpCode::kCos:  unaryOp([](AccType a) { return std::cos(a); });        break;
+                    case FusedOpCode::kTanh: unaryOp([](AccType a) { return std::tanh(a); });       break;
+                    case FusedOpCode::kLog:  unaryOp([](AccType a) { return std::log(a); });        break;
+                    case FusedOpCode::kExp:  unaryOp([](AccType a) { return std::exp(a); });        break;
+                }
+            }
+
+            auto last = scratch.data() + (program.size() - 1) * blockSize;
+            if constexpr (isHalfFloat<T>)
+            {
+                convertFromFloat32(last, res + blockBegin, count);
+                continue;
+            }
+            for (size_t j = 0; j < count; ++j)
+            {
+                res[blockBegin + j] = static_cast<T>(last[j]);
+            }
         }
     }
 
+    // Applies an optimizer step to the [begin, end) element range of a parameter. The update rule is selected outside
+    // of the element loops so that the compiler can vectorize them.
     template <typename T>
-    static void tanhGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result)
-    {
-        auto t1  = static_cast<const T*>(a.data);
-        auto res = static_cast<T*>(result.data);
+    static void optimizerStepGeneric(const OptimizerStepParams& step, const OptimizerTensorParams& tensor,
+                                     size_t begin, size_t end)
+    {
+        using AccType = std::conditional_t<std::is_same_v<T, double>, double, float>;
+        assert(tensor.param.dtype == tensor.grad.dtype);
+        auto param  = static_cast<T*>(tensor.param.data) + tensor.param.offset;
+        auto grad   = static_cast<const T*>(tensor.grad.data) + tensor.grad.offset;
+        auto master = tensor.master.data ? static_cast<float*>(tensor.master.data) + tensor.master.offset : nullptr;
+        auto m      = tensor.m.data ? static_cast<float*>(tensor.m.data) + tensor.m.offset : nullptr;
+        auto v      = tensor.v.data ? static_cast<float*>(tensor.v.data) + tensor.v.offset : nullptr;
+
+        // The element range is the range of the gradient. A sparse gradient updates the rows of its indices.
+        auto indices = tensor.indices.data ? static_cast<const int32_t*>(tensor.indices.data) + tensor.indices.offset
+                                           : nullptr;
+        const size_t rowSize = indices ? tensor.param.size / tensor.param.shape[0] : 0;
+
+        const AccType lr = step.lr;
+        const AccType weightDecay = step.weightDecay;
+        auto update = [&](const auto& func)
+        {
+            auto updateElement = [&](size_t i, size_t gi)
+            {
+                AccType w = master ? static_cast<AccType>(master[i]) : static_cast<AccType>(param[i]);
+                w = func(i, w, static_cast<AccType>(grad[gi]));
+                if (master) master[i] = static_cast<float>(w);
+                param[i] = static_cast<T>(w);
+            };
+            if (!indices)
+            {
+                for (size_t i = begin; i < end; ++i) updateElement(i, i);
+                return;
+            }
+            for (size_t gi = begin; gi < end; ++gi)
+            {
+                updateElement(static_cast<size_t>(indices[gi / rowSize]) * rowSize + gi % rowSize, gi);
+            }
+        };
 
-        for (size_t i = 0; i < a.size; ++i)
+        const AccType beta1 = step.beta1;
+        const AccType beta2 = step.beta2;
+        const AccType epsilon = step.epsilon;
+        const AccType biasCorrection1 = step.biasCorrection1;
+        const AccType biasCorrection2 = step.biasCorrection2;
+        auto adam = [&](size_t i, AccType w, AccType g)
+        {
+            m[i] = static_cast<float>(beta1 * m[i] + (1 - beta1) * g);
+            v[i] = static_cast<float>(beta2 * v[i] + (1 - beta2) * g * g);
+            AccType mHat = m[i] / biasCorrection1;
+            AccType vHat = v[i] / biasCorrection2;
+            return w - lr * mHat / (std::sqrt(vHat) + epsilon);
+        };
+
+        switch (step.type)
         {
-            res[i] = std::tanh(t1[i]);
+            case OptimizerType::kSGD:
+                if (m)
+                    update([&](size_t i, AccType w, AccType g)
+                    {
+                        m[i] = static_cast<float>(beta1 * m[i] + g + weightDecay * w);
+                        return w - lr * m[i];
+                    });
+                else
+                    update([&](size_t, AccType w, AccType g) { return w - lr * (g + weightDecay * w); });
+                break;
+            case OptimizerType::kAdam:
+                update([&](size_t i, AccType w, AccType g) { return adam(i, w, g + weightDecay * w); });
+                break;
+            case OptimizerType::kAdamW:
+                update([&](size_t i, AccType w, AccType g) { return adam(i, w * (1 - lr * weightDecay), g); });
+                break;
         }
     }
 
-    template <typename T>
-    static void logGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result)
+    template <typename SrcType, typename DstType>
+    static void fillGeneric(const void* scalar, const DeviceTensorParams& result)
     {
-        auto t1  = static_cast<const T*>(a.data);
-        auto res = static_cast<T*>(result.data);
-
-        for (size_t i = 0; i < a.size; ++i)
+        auto tSrc = static_cast<const SrcType*>(scalar);
+        auto tDst = static_cast<DstType*>(result.data);
+        for (size_t i=0; i<result.size; ++i)
         {
-            res[i] = std::log(t1[i]);
+            tDst[i] = static_cast<DstType>(tSrc[0]);
         }
     }
 
     template <typename T>
-    static void expGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result)
+    static void fillMinGeneric(const DeviceTensorParams& result)
     {
-        auto t1  = static_cast<const T*>(a.data);
-        auto res = static_cast<T*>(result.data);
-
-        for (size_t i = 0; i < a.size; ++i)
+        auto tDst = static_cast<T*>(result.data);
+        for (size_t i=0; i<result.size; ++i)
         {
-            res[i] = std::exp(t1[i]);
+            tDst[i] = std::numeric_limits<T>::lowest();
         }
     }
 
     template <typename T>
-    static void powGeneric(const DeviceTensorParams& a, const DeviceTensorParams& exp, const DeviceTensorParams& result)
+    static void sumGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result)
     {
         auto t1  = static_cast<const T*>(a.data);
-        auto t2  = static_cast<const T*>(exp.data);
         auto res = static_cast<T*>(result.data);
 
+        T sum = 0;
         for (size_t i = 0; i < a.size; ++i)
         {
-            res[i] = std::pow(t1[i], t2[i]);
+            sum += t1[i];
         }
+        *res = sum;
+    }
+
+    template <typename T>
+    static void sqrtGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result)
+    {
+        mapGeneric<T>(a, result, [](auto x) { return std::sqrt(x); });
+    }
+
+    template <typename T>
+    static void sinGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result)
+    {
+        mapGeneric<T>(a, result, [](auto x) { return std::sin(x); });
+    }
+
+    template <typename T>
+    static void cosGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result)
+    {
+        mapGeneric<T>(a, result, [](auto x) { return std::cos(x); });
+    }
+
+    template <typename T>
+    static void tanhGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result)
+    {
+        mapGeneric<T>(a, result, [](auto x) { return std::tanh(x); });
+    }
+
+    template <typename T>
+    static void logGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result)
+    {
+        mapGeneric<T>(a, result, [](auto x) { return std::log(x); });
+    }
+
+    template <typename T>
+    static void expGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result)
+    {
+        mapGeneric<T>(a, result, [](auto x) { return std::exp(x); });
+    }
+
+    template <typename T>
+    static void powGeneric(const DeviceTensorParams& a, const DeviceTensorParams& exp, const DeviceTensorParams& result)
+    {
+        binaryGeneric<T>(a, exp, result, [](auto x, auto y) { return std::pow(x, y); });
     }
 
     template <typename T>
@@ -995,28 +1736,6 @@ protected:
         }
     }
 
-    template <typename T, typename T2>
-    static void argmaxToGeneric(const DeviceTensorParams& src, const DeviceTensorParams& dst, size_t dim)
-    {
-        auto tSrc = static_cast<const T*>(src.data);
-        auto tDst = static_cast<T2*>(dst.data);
-        auto tmaxTemp = new T[dst.size];     // Temporary helper buffer to store max values for comparison.
-
-        // Initialize the temp buffer with the lowest value of the data type, T.
-        fillMinGeneric<T>({ .data=tmaxTemp, .size=dst.size });
-
-        for (size_t index = 0; index < src.size; ++index)
-        {
-            auto transIndex = translationIndex(index, dst.shape, src.shape);
-            if (tSrc[index] > tmaxTemp[transIndex])
-            {
-                tmaxTemp[transIndex] = tSrc[index];
-                tDst[transIndex] = (index / src.strides[dim]) % src.shape[dim];
-            }
-        }
-        delete [] tmaxTemp;
-    }
-
     template <typename T, typename T2>
     static void argmaxIndicesGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result)
     {
@@ -1076,130 +1795,958 @@ protected:
     }
 
     template <typename T>
-    static void matmulGeneric(const DeviceTensorParams& a, const DeviceTensorParams& b, const DeviceTensorParams& result)
+    static void matmulGeneric(const DeviceTensorParams& a, bool transposeA, const DeviceTensorParams& b,
+                              bool transposeB, const DeviceTensorParams& result)
     {
-        auto t1  = static_cast<const T*>(a.data);
-        auto t2  = static_cast<const T*>(b.data);
+        // NOTE: Since TensorValue validated the parameters, device method do not validate again.
+        size_t m = result.shape[result.shape.size() - 2];
+        size_t n = result.shape.back();
+        for (size_t batch = 0; batch < matrixCount(result); ++batch)
+        {
+            gemmGeneric<T>(matrixParams(a, batch), transposeA, matrixParams(b, batch), transposeB,
+                           matrixParams(result, batch), 0, m, 0, n, {});
+        }
+    }
+
+    // Returns the number of matrices in a batched tensor.
+    static inline size_t matrixCount(const DeviceTensorParams& params)
+    {
+        size_t matrixSize = params.shape[params.shape.size() - 2] * params.shape.back();
+        return matrixSize == 0 ? 0 : params.size / matrixSize;
+    }
+
+    // Returns the 2D parameters of a matrix in a batched tensor. A tensor with a single matrix is broadcast.
+    static DeviceTensorParams matrixParams(const DeviceTensorParams& params, size_t batch)
+    {
+        size_t rows = params.shape[params.shape.size() - 2];
+        size_t cols = params.shape.back();
+        DeviceTensorParams matrix = params;
+        if (params.size != rows * cols)
+        {
+            matrix.data = static_cast<uint8_t*>(params.data) + batch * rows * cols * dataTypeSize(params.dtype);
+        }
+        matrix.shape   = { rows, cols };
+        matrix.size    = rows * cols;
+        matrix.strides = { cols, 1 };
+        return matrix;
+    }
+
+    // Cache blocking sizes of the GEMM engine. A packed A block (MC x KC) stays in L2 cache, and a packed B panel
+    // (KC x NC) stays in L3 cache while the micro-kernel computes MR x NR blocks of the result in registers.
+    static constexpr size_t gemmBlockM = 96;
+    static constexpr size_t gemmBlockK = 256;
+    static constexpr size_t gemmBlockN = 512;
+
+    // Computes the [rowBegin, rowEnd) x [colBegin, colEnd) tile of result = op(a) * op(b), where op() transposes
+    // a 2D matrix if requested. Half precision types are accumulated in float32, and the epilogue is applied to the
+    // accumulators.
+    template <typename T>
+    static void gemmGeneric(const DeviceTensorParams& a, bool transposeA, const DeviceTensorParams& b, bool transposeB,
+                            const DeviceTensorParams& result, size_t rowBegin, size_t rowEnd, size_t colBegin,
+                            size_t colEnd, const GemmEpilogue& epilogue)
+    {
+        using AccType = std::conditional_t<std::is_same_v<T, float16_t> || std::is_same_v<T, bfloat16_t>, float, T>;
+        constexpr size_t MR = std::is_floating_point_v<AccType> ? 6 : 4;
+        constexpr size_t NR = std::is_same_v<AccType, float> ? 16 : 8;
+
+        auto tA  = static_cast<const T*>(a.data);
+        auto tB  = static_cast<const T*>(b.data);
         auto res = static_cast<T*>(result.data);
 
-        // NOTE: Since TensorValue validated the parameters, device method do not validate again.
-        size_t m = a.shape[0];      // Rows of the first matrix
-        size_t n = b.shape[1];      // Columns of the second matrix
-        size_t inner = a.shape[1];  // Inner dimension
+        size_t n     = result.shape[1];                         // Columns of the result matrix
+        size_t inner = transposeA ? a.shape[0] : a.shape[1];    // Inner dimension
+        size_t lda   = a.shape[1];
+        size_t ldb   = b.shape[1];
 
-        // Perform matrix multiplication
-        for (size_t i = 0; i < m; ++i)
+        // Packing buffers are reused by subsequent calls on the same thread.
+        thread_local std::vector<AccType> aPacked;
+        thread_local std::vector<AccType> bPacked;
+        thread_local std::vector<AccType> cTile;
+
+        for (size_t jc = colBegin; jc < colEnd; jc += gemmBlockN)
         {
-            for (size_t j = 0; j < n; ++j)
+            size_t nc = std::min(gemmBlockN, colEnd - jc);
+            size_t ncPadded = (nc + NR - 1) / NR * NR;
+
+            for (size_t ic = rowBegin; ic < rowEnd; ic += gemmBlockM)
             {
-                T sum = 0;
-                for (size_t k = 0; k < inner; ++k)
+                size_t mc = std::min(gemmBlockM, rowEnd - ic);
+                size_t mcPadded = (mc + MR - 1) / MR * MR;
+                cTile.assign(mc * nc, AccType(0));
+
+                for (size_t pc = 0; pc < inner; pc += gemmBlockK)
+                {
+                    size_t kc = std::min(gemmBlockK, inner - pc);
+
+                    // Pack the B panel into column slivers of NR elements. Padding is filled with zeros.
+                    bPacked.resize(kc * ncPadded);
+                    for (size_t jr = 0; jr < ncPadded; jr += NR)
+                    {
+                        auto sliver = bPacked.data() + jr * kc;
+                        for (size_t p = 0; p < kc; ++p)
+                        {
+                            for (size_t j = 0; j < NR; ++j)
+                            {
+                                size_t col = jc + jr + j;
+                                size_t row = pc + p;
+                                sliver[p * NR + j] = jr + j >= nc ? AccType(0) :
+                                    static_cast<AccType>(transposeB ? tB[col * ldb + row] : tB[row * ldb + col]);
+                            }
+                        }
+                    }
+
+                    // Pack the A block into row slivers of MR elements. Padding is filled with zeros.
+                    aPacked.resize(kc * mcPadded);
+                    for (size_t ir = 0; ir < mcPadded; ir += MR)
+                    {
+                        auto sliver = aPacked.data() + ir * kc;
+                        for (size_t p = 0; p < kc; ++p)
+                        {
+                            for (size_t i = 0; i < MR; ++i)
+                            {
+                                size_t row = ic + ir + i;
+                                size_t col = pc + p;
+                                sliver[p * MR + i] = ir + i >= mc ? AccType(0) :
+                                    static_cast<AccType>(transposeA ? tA[col * lda + row] : tA[row * lda + col]);
+                            }
+                        }
+                    }
+
+                    for (size_t jr = 0; jr < nc; jr += NR)
+                    {
+                        for (size_t ir = 0; ir < mc; ir += MR)
+                        {
+                            gemmMicroKernel<AccType, MR, NR>(kc, aPacked.data() + ir * kc, bPacked.data() + jr * kc,
+                                                             cTile.data() + ir * nc + jr, nc,
+                                                             std::min(MR, mc - ir), std::min(NR, nc - jr));
+                        }
+                    }
+                }
+
+                if (epilogue.empty())
+                {
+                    for (size_t i = 0; i < mc; ++i)
+                    {
+                        for (size_t j = 0; j < nc; ++j)
+                        {
+                            res[(ic + i) * n + jc + j] = static_cast<T>(cTile[i * nc + j]);
+                        }
+                    }
+                    continue;
+                }
+
+                auto bias = static_cast<const T*>(epilogue.bias);
+                auto preActivation = static_cast<T*>(epilogue.preActivation);
+                for (size_t i = 0; i < mc; ++i)
                 {
-                    sum += t1[i * a.shape[1] + k] * t2[k * n + j];
+                    for (size_t j = 0; j < nc; ++j)
+                    {
+                        size_t index = (ic + i) * n + jc + j;
+                        auto value = cTile[i * nc + j];
+                        if (bias) value += static_cast<AccType>(bias[jc + j]);
+                        if (preActivation) preActivation[index] = static_cast<T>(value);
+                        res[index] = static_cast<T>(activate(epilogue.activation, value));
+                    }
                 }
-                res[i * n + j] = sum;
             }
         }
     }
 
+    // Returns the activation of the value. Integer values are activated in double precision.
     template <typename T>
-    static void transposeGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result, size_t dim0, size_t dim1)
+    static inline T activate(Activation activation, T value)
     {
-        auto t1  = static_cast<const T*>(a.data);
-        auto res = static_cast<T*>(result.data);
+        using FloatType = std::conditional_t<std::is_floating_point_v<T>, T, double>;
+        auto x = static_cast<FloatType>(value);
+        switch (activation)
+        {
+            case Activation::kTanh:     return static_cast<T>(std::tanh(x));
+            case Activation::kSigmoid:  return static_cast<T>(FloatType(1) / (FloatType(1) + std::exp(-x)));
+            case Activation::kGeLU:
+            {
+                constexpr auto c = std::numbers::sqrt2_v<FloatType> * std::numbers::inv_sqrtpi_v<FloatType>;   // √(2/π)
+                return static_cast<T>(FloatType(0.5) * x *
+                                      (FloatType(1) + std::tanh(c * (x + FloatType(0.044715) * x * x * x))));
+            }
+            default:                    return value;
+        }
+    }
 
-        // Perform the generalized transpose operation.
-        for (size_t i=0; i<a.size; ++i)
+    // Accumulates the product of an MR x kc A sliver and a kc x NR B sliver into the mr x nr block of c.
+    template <typename T, size_t MR, size_t NR>
+    static void gemmMicroKernel(size_t kc, const T* __restrict aSliver, const T* __restrict bSliver, T* __restrict c,
+                                size_t ldc, size_t mr, size_t nr)
+    {
+#ifdef AIX_X86_KERNELS
+        switch (kernelISA())
         {
-            auto oldIndices = unflattenIndex(i, a.strides);
-            std::swap(oldIndices[dim0], oldIndices[dim1]);
-            size_t newIndex = flattenIndex(oldIndices, result.strides);
-            res[newIndex] = t1[i];
+            case KernelISA::kAVX512: return gemmMicroKernelAVX512<T, MR, NR>(kc, aSliver, bSliver, c, ldc, mr, nr);
+            case KernelISA::kAVX2:   return gemmMicroKernelAVX2<T, MR, NR>(kc, aSliver, bSliver, c, ldc, mr, nr);
+            default:                 break;
         }
+#endif
+        gemmMicroKernelBody<T, MR, NR>(kc, aSliver, bSliver, c, ldc, mr, nr);
     }
 
-    template <typename SrcType, typename DstType>
-    static void copyGeneric(const void* src, void* dst, size_t size)
+#ifdef AIX_X86_KERNELS
+    template <typename T, size_t MR, size_t NR>
+    __attribute__((target("avx512f")))
+    static void gemmMicroKernelAVX512(size_t kc, const T* __restrict aSliver, const T* __restrict bSliver,
+                                      T* __restrict c, size_t ldc, size_t mr, size_t nr)
     {
-        if constexpr (std::is_same_v<SrcType, DstType>)
+        gemmMicroKernelBody<T, MR, NR>(kc, aSliver, bSliver, c, ldc, mr, nr);
+    }
+
+    template <typename T, size_t MR, size_t NR>
+    __attribute__((target("avx2")))
+    static void gemmMicroKernelAVX2(size_t kc, const T* __restrict aSliver, const T* __restrict bSliver,
+                                    T* __restrict c, size_t ldc, size_t mr, size_t nr)
+    {
+        gemmMicroKernelBody<T, MR, NR>(kc, aSliver, bSliver, c, ldc, mr, nr);
+    }
+#endif
+
+    // The fully unrolled loops keep the accumulators in vector registers. The body is inlined into the kernel
+    // variants, which compile it for their instruction sets.
+    template <typename T, size_t MR, size_t NR>
+    __attribute__((always_inline))
+    static inline void gemmMicroKernelBody(size_t kc, const T* __restrict aSliver, const T* __restrict bSliver,
+                                           T* __restrict c, size_t ldc, size_t mr, size_t nr)
+    {
+        T acc[MR * NR] = {};
+        for (size_t p = 0; p < kc; ++p)
         {
-            std::memcpy(dst, src, size * sizeof(SrcType));
+            auto aRow = aSliver + p * MR;
+            auto bRow = bSliver + p * NR;
+            #pragma GCC unroll 16
+            for (size_t i = 0; i < MR; ++i)
+            {
+                T aValue = aRow[i];
+                #pragma GCC unroll 16
+                for (size_t j = 0; j < NR; ++j)
+                {
+                    acc[i * NR + j] += aValue * bRow[j];
+                }
+            }
         }
-        else
+
+        for (size_t i = 0; i < mr; ++i)
         {
-            auto tSrc = static_cast<const SrcType*>(src);
-            auto tDst = static_cast<DstType*>(dst);
-            for (size_t i=0; i<size; ++i)
+            for (size_t j = 0; j < nr; ++j)
             {
-                tDst[i] = static_cast<DstType>(tSrc[i]);
+                c[i * ldc + j] += acc[i * NR + j];
             }
         }
     }
 
+    // Computes the [colBegin, colEnd) output columns of a quantized matrix multiplication. Each weight row is read
+    // once and multiplied with all rows of a. Products are accumulated in Float32, or in Float64 for Float64 inputs.
     template <typename T>
-    static void contiguousGeneric(const DeviceTensorParams& src, const DeviceTensorParams& dst)
+    static void matmulQuantizedGeneric(const DeviceTensorParams& a, const DeviceTensorParams& w,
+                                       const QuantizedLayout& layout, const DeviceTensorParams& result,
+                                       size_t colBegin, size_t colEnd)
     {
-        auto tSrc = static_cast<const T*>(src.data);
-        auto tDst = static_cast<T*>(dst.data);
+        using AccType = std::conditional_t<std::is_same_v<T, double>, double, float>;
+        size_t rows = a.size / layout.inputs;
 
-        for (size_t i=0; i<dst.size; ++i)
+        // The inputs are converted once, so the dot products read the accumulation type.
+        thread_local std::vector<AccType> aConverted;
+        auto tA = static_cast<const T*>(a.data);
+        const AccType* aValues = nullptr;
+        if constexpr (std::is_same_v<T, AccType>)
         {
-            size_t idx = i;
-            size_t ofs = src.offset;
-            for (ssize_t dim = ssize_t(src.shape.size()) - 1; dim >= 0; --dim)
+            aValues = tA;
+        }
+        else
+        {
+            aConverted.resize(a.size);
+            for (size_t i = 0; i < a.size; ++i) aConverted[i] = static_cast<AccType>(tA[i]);
+            aValues = aConverted.data();
+        }
+
+        auto weights = static_cast<const uint8_t*>(w.data);
+        auto res = static_cast<T*>(result.data);
+        auto dot = layout.bits == 8 ? quantizedDot<AccType, 8> : quantizedDot<AccType, 4>;
+        for (size_t col = colBegin; col < colEnd; ++col)
+        {
+            auto row = weights + col * layout.rowSize();
+            auto values = row + layout.valueOffset();
+            for (size_t i = 0; i < rows; ++i)
             {
-                auto dimIndex = idx % src.shape[dim];
-                idx /= src.shape[dim];
-                ofs += dimIndex * src.strides[dim];
+                AccType sum = 0;
+                for (size_t group = 0; group < layout.groupCount(); ++group)
+                {
+                    float scale;
+                    std::memcpy(&scale, row + group * sizeof(float), sizeof(float));
+                    size_t begin = group * layout.groupSize;
+                    size_t count = std::min(layout.groupSize, layout.inputs - begin);
+                    sum += static_cast<AccType>(scale) * dot(aValues + i * layout.inputs + begin,
+                                                             values + begin * layout.bits / 8, count);
+                }
+                res[i * layout.outputs + col] = static_cast<T>(sum);
             }
+        }
+    }
 
-            // Copy the element from non-contiguous source to contiguous destination.
-            tDst[i] = tSrc[ofs];
+    // Returns the dot product of the values and the signed quantized values that start at a byte boundary.
+    template <typename T, size_t Bits>
+    static T quantizedDot(const T* __restrict values, const uint8_t* __restrict quantized, size_t count)
+    {
+#ifdef AIX_X86_KERNELS
+        switch (kernelISA())
+        {
+            case KernelISA::kAVX512: return quantizedDotAVX512<T, Bits>(values, quantized, count);
+            case KernelISA::kAVX2:   return quantizedDotAVX2<T, Bits>(values, quantized, count);
+            default:                 break;
         }
+#endif
+        return quantizedDotBody<T, Bits>(values, quantized, count);
     }
 
-    template <typename T>
-    static void reduceToGeneric(const DeviceTensorParams& src, const DeviceTensorParams& dst)
+#ifdef AIX_X86_KERNELS
+    template <typename T, size_t Bits>
+    __attribute__((target("avx512f")))
+    static T quantizedDotAVX512(const T* __restrict values, const uint8_t* __restrict quantized, size_t count)
     {
-        auto tSrc = static_cast<const T*>(src.data);
-        auto tDst = static_cast<T*>(dst.data);
+        return quantizedDotBody<T, Bits>(values, quantized, count);
+    }
 
-        // Sum the values from the broadcasted tensor to the original tensor shape. The reduction involves summation
-        // because each element of the original tensor is used multiple times in the broadcasted operation.
-        // Summing the gradients correctly aggregates these contributions.
-        for (size_t index = 0; index < src.size; ++index)
+    template <typename T, size_t Bits>
+    __attribute__((target("avx2")))
+    static T quantizedDotAVX2(const T* __restrict values, const uint8_t* __restrict quantized, size_t count)
+    {
+        return quantizedDotBody<T, Bits>(values, quantized, count);
+    }
+#endif
+
+    // Partial sums of blocks keep the products in vector registers.
+    template <typename T, size_t Bits>
+    __attribute__((always_inline))
+    static inline T quantizedDotBody(const T* __restrict values, const uint8_t* __restrict quantized, size_t count)
+    {
+        constexpr size_t blockSize = 16;
+        T acc[blockSize] = {};
+        size_t k = 0;
+        for (; k + blockSize <= count; k += blockSize)
+        {
+            #pragma GCC unroll 16
+            for (size_t j = 0; j < blockSize; ++j)
+            {
+                acc[j] += values[k + j] * static_cast<T>(quantizedValue<Bits>(quantized, k + j));
+            }
+        }
+        for (; k < count; ++k)
         {
-            tDst[translationIndex(index, dst.shape, src.shape)] += tSrc[index];
+            acc[0] += values[k] * static_cast<T>(quantizedValue<Bits>(quantized, k));
         }
+
+        T sum = 0;
+        for (auto value : acc) sum += value;
+        return sum;
     }
 
-    template <typename T>
-    static void maxToGeneric(const DeviceTensorParams& src, const DeviceTensorParams& dst)
+    // Returns the signed value at the index. The arithmetic shifts sign-extend the 4-bit values.
+    template <size_t Bits>
+    static inline int quantizedValue(const uint8_t* quantized, size_t index)
     {
-        auto tSrc = static_cast<const T*>(src.data);
-        auto tDst = static_cast<T*>(dst.data);
-
-        for (size_t index = 0; index < src.size; ++index)
+        if constexpr (Bits == 8)
+        {
+            return static_cast<int8_t>(quantized[index]);
+        }
+        else
         {
-            auto transIndex = translationIndex(index, dst.shape, src.shape);
-            tDst[transIndex] = std::max<T>(tDst[transIndex], tSrc[index]);
+            auto byte = static_cast<int8_t>(quantized[index / 2] << (index % 2 == 0 ? 4 : 0));
+            return byte >> 4;
         }
     }
 
     template <typename T>
-    static void sliceSetGeneric(const DeviceTensorParams& src, const DeviceTensorParams& dst,
-                                size_t dim, size_t start, size_t end, size_t step)
+    static void transposeGeneric(const DeviceTensorParams& a, const DeviceTensorParams& result, size_t dim0, size_t dim1,
+                                 size_t begin, size_t end)
     {
-        auto tSrc = static_cast<T*>(src.data);
-        auto tDst = static_cast<T*>(dst.data);
-        auto newShape = dst.shape;
-        newShape[dim] = (end - start + step - 1) / step;    // This computes the size along the slicing dimension.
+        auto t1  = static_cast<const T*>(a.data);
+        auto res = static_cast<T*>(result.data);
 
-        for (size_t index = 0; index < src.size; ++index)
-        {
-            // Translate the flat index into multi-dimensional indices.
-            size_t dstIndex = index;
-            size_t srcIndex = 0;
+        // The result strides with the two dimensions swapped map the source coordinates to the result index.
+        Stride strides = result.strides;
+        std::swap(strides[dim0], strides[dim1]);
+
+        // Perform the generalized transpose operation.
+        for (size_t i=begin; i<end; ++i)
+        {
+            size_t index = i;
+            size_t newIndex = 0;
+            for (size_t dim = 0; dim < strides.size(); ++dim)
+            {
+                newIndex += index / a.strides[dim] * strides[dim];
+                index %= a.strides[dim];
+            }
+            res[newIndex] = t1[i];
+        }
+    }
+
+    template <typename SrcType, typename DstType>
+    static void copyGeneric(const void* src, void* dst, size_t size)
+    {
+        if constexpr (std::is_same_v<SrcType, DstType>)
+        {
+            std::memcpy(dst, src, size * sizeof(SrcType));
+        }
+        else if constexpr (isHalfFloat<SrcType> && std::is_same_v<DstType, float>)
+        {
+            convertToFloat32(static_cast<const SrcType*>(src), static_cast<float*>(dst), size);
+        }
+        else if constexpr (std::is_same_v<SrcType, float> && isHalfFloat<DstType>)
+        {
+            convertFromFloat32(static_cast<const float*>(src), static_cast<DstType*>(dst), size);
+        }
+        else
+        {
+            auto tSrc = static_cast<const SrcType*>(src);
+            auto tDst = static_cast<DstType*>(dst);
+            for (size_t i=0; i<size; ++i)
+            {
+                tDst[i] = static_cast<DstType>(tSrc[i]);
+            }
+        }
+    }
+
+    template <typename T>
+    static void contiguousGeneric(const DeviceTensorParams& src, const DeviceTensorParams& dst, size_t begin, size_t end)
+    {
+        auto tSrc = static_cast<const T*>(src.data);
+        auto tDst = static_cast<T*>(dst.data);
+
+        // Copy the elements from non-contiguous source to contiguous destination.
+        StridedIndex index(src, begin);
+        for (size_t i=begin; i<end; ++i, index.next())
+        {
+            tDst[i] = tSrc[*index];
+        }
+    }
+
+    // Reduces the dimensions of the source that have a size of one in the result shape. The result shape is aligned to
+    // the trailing dimensions of the source. Adjacent reduced dimensions share a pass, and the passes before the last
+    // one write to temporary buffers.
+    void reduceToShape(ReduceOp op, const DeviceTensorParams& src, const DeviceTensorParams& dst)
+    {
+        if (dst.shape.size() > src.shape.size())
+        {
+            throw std::invalid_argument("Device::reduceTo result shape has more dimensions than the source.");
+        }
+        auto shape = src.shape;
+        auto rank = shape.size();
+        auto leading = rank - dst.shape.size();
+        auto isReduced = [&](size_t i) { return shape[i] > 1 && (i < leading || dst.shape[i - leading] == 1); };
+
+        // Each pass reduces a run of adjacent dimensions, the innermost run first.
+        std::vector<std::pair<size_t, size_t>> runs;
+        for (size_t end = rank; end > 0;)
+        {
+            if (!isReduced(end - 1)) { --end; continue; }
+            size_t begin = end - 1;
+            while (begin > 0 && isReduced(begin - 1)) --begin;
+            runs.emplace_back(begin, end);
+            end = begin;
+        }
+        if (runs.empty())
+        {
+            // Nothing to reduce, a pass over a reduced axis of size one copies the source.
+            reduce(op, src, dst, ReduceShape{ .outer=src.size });
+            return;
+        }
+
+        auto input = src;
+        for (size_t pass = 0; pass < runs.size(); ++pass)
+        {
+            auto [begin, end] = runs[pass];
+            ReduceShape reduceShape;
+            for (size_t i = 0; i < begin; ++i) reduceShape.outer *= shape[i];
+            for (size_t i = begin; i < end; ++i) reduceShape.reduce *= shape[i];
+            for (size_t i = end; i < rank; ++i) reduceShape.inner *= shape[i];
+            std::fill(shape.begin() + static_cast<ssize_t>(begin), shape.begin() + static_cast<ssize_t>(end), 1);
+
+            auto output = dst;
+            if (pass + 1 < runs.size())
+            {
+                auto size = reduceShape.outer * reduceShape.inner;
+                output = { .data=allocate(size, src.dtype), .dtype=src.dtype, .isContiguous=true, .offset=0,
+                           .shape=shape, .size=size, .strides={} };
+            }
+            reduce(op, input, output, reduceShape);
+            if (input.data != src.data) deallocate(input.data);
+            input = output;
+        }
+    }
+
+    // Accumulation type of axis reductions. Half precision types accumulate in float, and integers in int64.
+    template <typename T>
+    using ReduceAccumulator = std::conditional_t<std::is_integral_v<T>, int64_t,
+                                                 std::conditional_t<std::is_same_v<T, double>, double, float>>;
+
+    // Reduces the [outerBegin, outerEnd) x [innerBegin, innerEnd) range of the result. Rows of the reduced axis are
+    // accumulated in blocks, and the columns of an inner dimension are accumulated as contiguous row buffers.
+    template <typename T>
+    static void reduceGeneric(ReduceOp op, const DeviceTensorParams& src, const DeviceTensorParams& dst,
+                              const ReduceShape& shape, size_t outerBegin, size_t outerEnd,
+                              size_t innerBegin, size_t innerEnd)
+    {
+        using Acc = ReduceAccumulator<T>;
+        constexpr size_t blockSize = halfFloatBlockSize;
+        auto tSrc = static_cast<const T*>(src.data) + src.offset;
+        auto tDst = static_cast<T*>(dst.data) + dst.offset;
+        auto tIndices = static_cast<int32_t*>(dst.data) + dst.offset;
+        const Acc lowest = static_cast<Acc>(std::numeric_limits<T>::lowest());
+
+        // Returns the source elements [index, index + count) in the accumulation type.
+        Acc buffer[blockSize];
+        auto load = [&](size_t index, size_t count) -> const Acc*
+        {
+            if constexpr (std::is_same_v<T, Acc>)
+            {
+                return tSrc + index;
+            }
+            else if constexpr (isHalfFloat<T>)
+            {
+                convertToFloat32(tSrc + index, buffer, count);
+                return buffer;
+            }
+            else
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    buffer[i] = static_cast<Acc>(tSrc[index + i]);
+                }
+                return buffer;
+            }
+        };
+
+        // Stores the values [0, count) to the result elements starting at the index.
+        auto store = [&](size_t index, const Acc* values, size_t count)
+        {
+            if constexpr (isHalfFloat<T>)
+            {
+                convertFromFloat32(values, tDst + index, count);
+            }
+            else
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    tDst[index + i] = static_cast<T>(values[i]);
+                }
+            }
+        };
+
+        if (shape.inner == 1)
+        {
+            // Each result element reduces a contiguous row. Independent partial results let the compiler vectorize
+            // the blocks, and the block results are combined with Kahan summation to bound the rounding error.
+            constexpr size_t lanes = 8;
+            for (size_t o = outerBegin; o < outerEnd; ++o)
+            {
+                size_t rowBegin = o * shape.reduce;
+                Acc total = op == ReduceOp::kSum ? Acc(0) : lowest;
+                Acc compensation = 0;
+                int32_t index = 0;
+                for (size_t r = 0; r < shape.reduce; r += blockSize)
+                {
+                    size_t count = std::min(blockSize, shape.reduce - r);
+                    auto x = load(rowBegin + r, count);
+                    switch (op)
+                    {
+                        case ReduceOp::kSum:
+                        {
+                            Acc partial[lanes] = {};
+                            size_t i = 0;
+                            for (; i + lanes <= count; i += lanes)
+                            {
+                                for (size_t k = 0; k < lanes; ++k) partial[k] += x[i + k];
+                            }
+                            for (; i < count; ++i) partial[0] += x[i];
+                            Acc blockSum = ((partial[0] + partial[1]) + (partial[2] + partial[3])) +
+                                           ((partial[4] + partial[5]) + (partial[6] + partial[7]));
+                            Acc y = blockSum - compensation;
+                            Acc t = total + y;
+                            compensation = (t - total) - y;     // Always zero for integers.
+                            total = t;
+                            break;
+                        }
+                        case ReduceOp::kMax:
+                        {
+                            Acc partial[lanes];
+                            std::fill_n(partial, lanes, lowest);
+                            size_t i = 0;
+                            for (; i + lanes <= count; i += lanes)
+                            {
+                                for (size_t k = 0; k < lanes; ++k)
+                                {
+                                    partial[k] = x[i + k] > partial[k] ? x[i + k] : partial[k];
+                                }
+                            }
+                            for (; i < count; ++i) partial[0] = x[i] > partial[0] ? x[i] : partial[0];
+                            total = std::max(total, *std::max_element(partial, partial + lanes));
+                            break;
+                        }
+                        case ReduceOp::kArgmax:
+                            for (size_t i = 0; i < count; ++i)
+                            {
+                                if (x[i] > total || r + i == 0)
+                                {
+                                    total = x[i];
+                                    index = static_cast<int32_t>(r + i);
+                                }
+                            }
+                            break;
+                    }
+                }
+
+                if (op == ReduceOp::kArgmax)
+                {
+                    tIndices[o] = index;
+                }
+                else
+                {
+                    store(o, &total, 1);
+                }
+            }
+            return;
+        }
+
+        // Each result element reduces a column. The columns of a block accumulate together so that each step reads
+        // a contiguous block of a row.
+        Acc values[blockSize];
+        Acc compensations[blockSize];
+        int32_t indices[blockSize];
+        for (size_t o = outerBegin; o < outerEnd; ++o)
+        {
+            for (size_t j = innerBegin; j < innerEnd; j += blockSize)
+            {
+                size_t count = std::min(blockSize, innerEnd - j);
+                size_t columnBegin = o * shape.reduce * shape.inner + j;
+                std::fill_n(values, count, op == ReduceOp::kSum ? Acc(0) : lowest);
+                std::fill_n(compensations, count, Acc(0));
+                std::fill_n(indices, count, 0);
+                for (size_t r = 0; r < shape.reduce; ++r)
+                {
+                    auto x = load(columnBegin + r * shape.inner, count);
+                    switch (op)
+                    {
+                        case ReduceOp::kSum:
+                            if constexpr (isHalfFloat<T>)
+                            {
+                                // Kahan summation keeps the error independent of the reduced axis size.
+                                for (size_t i = 0; i < count; ++i)
+                                {
+                                    Acc y = x[i] - compensations[i];
+                                    Acc t = values[i] + y;
+                                    compensations[i] = (t - values[i]) - y;
+                                    values[i] = t;
+                                }
+                            }
+                            else
+                            {
+                                for (size_t i = 0; i < count; ++i) values[i] += x[i];
+                            }
+                            break;
+                        case ReduceOp::kMax:
+                            for (size_t i = 0; i < count; ++i) values[i] = x[i] > values[i] ? x[i] : values[i];
+                            break;
+                        case ReduceOp::kArgmax:
+                            for (size_t i = 0; i < count; ++i)
+                            {
+                                bool isGreater = x[i] > values[i] || r == 0;
+                                values[i]  = isGreater ? x[i] : values[i];
+                                indices[i] = isGreater ? static_cast<int32_t>(r) : indices[i];
+                            }
+                            break;
+                    }
+                }
+
+                size_t resultBegin = o * shape.inner + j;
+                if (op == ReduceOp::kArgmax)
+                {
+                    std::copy_n(indices, count, tIndices + resultBegin);
+                }
+                else
+                {
+                    store(resultBegin, values, count);
+                }
+            }
+        }
+    }
+
+    // Accumulation type of softmax operations. Since the results are fractions, integers accumulate in float too.
+    template <typename T>
+    using SoftmaxAccumulator = std::conditional_t<std::is_same_v<T, double>, double, float>;
+
+    // Computes a softmax operation for the lines of the [outerBegin, outerEnd) x [innerBegin, innerEnd) range of the
+    // outer and inner dimensions. The first pass over a line computes its maximum and the sum of exponentials relative
+    // to it with the online softmax recurrence, which rescales the sum whenever the maximum grows. The second pass
+    // writes the result. The backward operations accumulate the dot product of the seed instead.
+    template <typename T>
+    static void softmaxGeneric(SoftmaxOp op, const std::vector<DeviceTensorParams>& inputs,
+                               const DeviceTensorParams& result, const ReduceShape& shape, size_t outerBegin,
+                               size_t outerEnd, size_t innerBegin, size_t innerEnd)
+    {
+        using Acc = SoftmaxAccumulator<T>;
+        constexpr size_t blockSize = halfFloatBlockSize;
+        bool hasTargets  = op == SoftmaxOp::kCrossEntropy || op == SoftmaxOp::kCrossEntropyBackward;
+        bool hasSeed     = op == SoftmaxOp::kSoftmaxBackward || op == SoftmaxOp::kLogSoftmaxBackward;
+        bool hasLineSeed = op == SoftmaxOp::kCrossEntropyBackward;
+        auto tDst = static_cast<T*>(result.data);
+
+        // Returns the input elements [index, index + count) in the accumulation type.
+        auto load = [](const DeviceTensorParams& input, size_t index, size_t count, Acc* buffer) -> const Acc*
+        {
+            auto data = static_cast<const T*>(input.data) + index;
+            if constexpr (std::is_same_v<T, Acc>)
+            {
+                return data;
+            }
+            else if constexpr (isHalfFloat<T>)
+            {
+                convertToFloat32(data, buffer, count);
+                return buffer;
+            }
+            else
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    buffer[i] = static_cast<Acc>(data[i]);
+                }
+                return buffer;
+            }
+        };
+
+        // Stores the values [0, count) to the result elements starting at the index.
+        auto store = [&](size_t index, const Acc* values, size_t count)
+        {
+            if constexpr (isHalfFloat<T>)
+            {
+                convertFromFloat32(values, tDst + index, count);
+            }
+            else
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    tDst[index + i] = static_cast<T>(values[i]);
+                }
+            }
+        };
+
+        // Statistics of a line. The sum of exponentials is relative to the maximum. The target sums are the sum of
+        // the targets and their dot product with the logits. The backward operations only use the dot product.
+        struct LineStats
+        {
+            Acc max{-std::numeric_limits<Acc>::infinity()};
+            Acc sum{0};
+            Acc targetSum{0};
+            Acc dot{0};
+        };
+
+        auto update = [op](LineStats& stats, Acc x, Acc t, Acc g)
+        {
+            switch (op)
+            {
+                case SoftmaxOp::kSoftmaxBackward:       stats.dot += g * x;     return;
+                case SoftmaxOp::kLogSoftmaxBackward:    stats.dot += g;         return;
+                case SoftmaxOp::kCrossEntropy:
+                case SoftmaxOp::kCrossEntropyBackward:
+                    stats.targetSum += t;
+                    stats.dot += t * x;
+                    break;
+                default:
+                    break;
+            }
+            if (x > stats.max)
+            {
+                stats.sum = stats.sum * std::exp(stats.max - x) + Acc(1);
+                stats.max = x;
+            }
+            else
+            {
+                // Comparing with the maximum keeps leading infinite values from turning the sum into NaN.
+                stats.sum += x == stats.max ? Acc(1) : std::exp(x - stats.max);
+            }
+        };
+
+        auto output = [op](const LineStats& stats, Acc x, Acc t, Acc g, Acc lineSeed) -> Acc
+        {
+            switch (op)
+            {
+                case SoftmaxOp::kSoftmax:               return std::exp(x - stats.max) / stats.sum;
+                case SoftmaxOp::kLogSoftmax:            return x - stats.max - std::log(stats.sum);
+                case SoftmaxOp::kSoftmaxBackward:       return x * (g - stats.dot);
+                case SoftmaxOp::kLogSoftmaxBackward:    return g - std::exp(x) * stats.dot;
+                case SoftmaxOp::kCrossEntropyBackward:
+                    return lineSeed * (std::exp(x - stats.max) / stats.sum * stats.targetSum - t);
+                default:
+                    return 0;
+            }
+        };
+
+        // The loss of a line is -sum(t * logSoftmax(x)) = sum(t) * logSumExp(x) - sum(t * x).
+        auto lineLoss = [](const LineStats& stats)
+        {
+            return stats.targetSum * (stats.max + std::log(stats.sum)) - stats.dot;
+        };
+
+        const auto& x = inputs[0];
+        const auto& other = inputs[hasTargets || hasSeed ? 1 : 0];
+        const DeviceTensorParams* lineSeeds = hasLineSeed ? &inputs[2] : nullptr;
+        Acc xBuffer[blockSize];
+        Acc otherBuffer[blockSize];
+        Acc lineSeedBuffer[blockSize];
+        Acc values[blockSize];
+        const Acc zeros[blockSize] = {};
+
+        if (shape.inner == 1)
+        {
+            // Each line is a contiguous row. The maximum is updated once per block, which leaves a single exponential
+            // per element in the loops. Softmax and the cross-entropy backward store the exponentials relative to the
+            // maximum of their blocks in the first pass and rescale them in the second one, unless the result is an
+            // integer.
+            bool storesExp = !std::is_integral_v<T> &&
+                             (op == SoftmaxOp::kSoftmax || op == SoftmaxOp::kCrossEntropyBackward);
+            std::vector<Acc> blockMaxs(storesExp ? (shape.reduce + blockSize - 1) / blockSize : 0);
+            for (size_t o = outerBegin; o < outerEnd; ++o)
+            {
+                size_t rowBegin = o * shape.reduce;
+                LineStats stats;
+                for (size_t r = 0; r < shape.reduce; r += blockSize)
+                {
+                    size_t count = std::min(blockSize, shape.reduce - r);
+                    auto xs = load(x, rowBegin + r, count, xBuffer);
+                    auto os = hasTargets || hasSeed ? load(other, rowBegin + r, count, otherBuffer) : zeros;
+                    if (hasSeed)
+                    {
+                        for (size_t i = 0; i < count; ++i) update(stats, xs[i], os[i], os[i]);
+                        continue;
+                    }
+
+                    Acc blockMax = *std::max_element(xs, xs + count);
+                    if (blockMax > stats.max)
+                    {
+                        stats.sum = stats.sum > 0 ? stats.sum * std::exp(stats.max - blockMax) : Acc(0);
+                        stats.max = blockMax;
+                    }
+                    Acc sum = 0;
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        // A maximum of negative infinity has only infinite elements, which add nothing.
+                        values[i] = std::isinf(stats.max) ? Acc(0) : std::exp(xs[i] - stats.max);
+                        sum += values[i];
+                    }
+                    stats.sum += sum;
+                    if (hasTargets)
+                    {
+                        for (size_t i = 0; i < count; ++i)
+                        {
+                            stats.targetSum += os[i];
+                            stats.dot += os[i] * xs[i];
+                        }
+                    }
+                    if (storesExp)
+                    {
+                        blockMaxs[r / blockSize] = stats.max;
+                        store(rowBegin + r, values, count);
+                    }
+                }
+
+                if (op == SoftmaxOp::kCrossEntropy)
+                {
+                    Acc loss = lineLoss(stats);
+                    store(o, &loss, 1);
+                    continue;
+                }
+
+                Acc lineSeed = lineSeeds ? load(*lineSeeds, o, 1, lineSeedBuffer)[0] : Acc(0);
+                for (size_t r = 0; r < shape.reduce; r += blockSize)
+                {
+                    size_t count = std::min(blockSize, shape.reduce - r);
+                    if (storesExp)
+                    {
+                        // Converts the exponentials of the block to the probabilities of the final statistics.
+                        Acc scale = std::exp(blockMaxs[r / blockSize] - stats.max) / stats.sum;
+                        auto es = load(result, rowBegin + r, count, xBuffer);
+                        if (op == SoftmaxOp::kSoftmax)
+                        {
+                            for (size_t i = 0; i < count; ++i) values[i] = es[i] * scale;
+                        }
+                        else
+                        {
+                            auto ts = load(other, rowBegin + r, count, otherBuffer);
+                            for (size_t i = 0; i < count; ++i)
+                            {
+                                values[i] = lineSeed * (es[i] * scale * stats.targetSum - ts[i]);
+                            }
+                        }
+                        store(rowBegin + r, values, count);
+                        continue;
+                    }
+
+                    auto xs = load(x, rowBegin + r, count, xBuffer);
+                    auto os = hasTargets || hasSeed ? load(other, rowBegin + r, count, otherBuffer) : zeros;
+                    for (size_t i = 0; i < count; ++i) values[i] = output(stats, xs[i], os[i], os[i], lineSeed);
+                    store(rowBegin + r, values, count);
+                }
+            }
+            return;
+        }
+
+        // Each line is a column. The columns of a block are computed together so that each step reads a contiguous
+        // block of a row.
+        LineStats stats[blockSize];
+        for (size_t o = outerBegin; o < outerEnd; ++o)
+        {
+            for (size_t j = innerBegin; j < innerEnd; j += blockSize)
+            {
+                size_t count = std::min(blockSize, innerEnd - j);
+                size_t columnBegin = o * shape.reduce * shape.inner + j;
+                std::fill_n(stats, count, LineStats{});
+                for (size_t r = 0; r < shape.reduce; ++r)
+                {
+                    size_t index = columnBegin + r * shape.inner;
+                    auto xs = load(x, index, count, xBuffer);
+                    auto os = hasTargets || hasSeed ? load(other, index, count, otherBuffer) : zeros;
+                    for (size_t i = 0; i < count; ++i) update(stats[i], xs[i], os[i], os[i]);
+                }
+
+                size_t lineBegin = o * shape.inner + j;
+                if (op == SoftmaxOp::kCrossEntropy)
+                {
+                    for (size_t i = 0; i < count; ++i) values[i] = lineLoss(stats[i]);
+                    store(lineBegin, values, count);
+                    continue;
+                }
+
+                auto ls = lineSeeds ? load(*lineSeeds, lineBegin, count, lineSeedBuffer) : zeros;
+                for (size_t r = 0; r < shape.reduce; ++r)
+                {
+                    size_t index = columnBegin + r * shape.inner;
+                    auto xs = load(x, index, count, xBuffer);
+                    auto os = hasTargets || hasSeed ? load(other, index, count, otherBuffer) : zeros;
+                    for (size_t i = 0; i < count; ++i) values[i] = output(stats[i], xs[i], os[i], os[i], ls[i]);
+                    store(index, values, count);
+                }
+            }
+        }
+    }
+
+    template <typename T>
+    static void sliceSetGeneric(const DeviceTensorParams& src, const DeviceTensorParams& dst,
+                                size_t dim, size_t start, size_t end, size_t step, size_t first, size_t last)
+    {
+        auto tSrc = static_cast<T*>(src.data);
+        auto tDst = static_cast<T*>(dst.data);
+        auto newShape = dst.shape;
+        newShape[dim] = (end - start + step - 1) / step;    // This computes the size along the slicing dimension.
+
+        for (size_t index = first; index < last; ++index)
+        {
+            // Translate the flat index into multi-dimensional indices.
+            size_t dstIndex = index;
+            size_t srcIndex = 0;
 
             for (ssize_t i = static_cast<ssize_t>(dst.shape.size()) - 1; i >= 0; --i)
             {
@@ -1218,7 +2765,7 @@ protected:
 
     template <typename T, typename T2>
     static void indexSelectGeneric(const DeviceTensorParams& src, const DeviceTensorParams& dst,
-                                   const DeviceTensorParams& indices, size_t dim)
+                                   const DeviceTensorParams& indices, size_t dim, size_t begin, size_t end)
     {
         auto tSrc = static_cast<const T*>(src.data);
         auto tDst = static_cast<T*>(dst.data);
@@ -1234,7 +2781,7 @@ protected:
         // Calculate the size of one entire slice for the dimension in question.
         size_t dimSize = !src.shape.empty() ? src.shape[dim] * sliceSize : 0;
 
-        for (size_t index=0; index<dst.size; ++index)
+        for (size_t index=begin; index<end; ++index)
         {
             // Calculate the outer loop index, index position, and element within the slice.
             size_t elementWithinSlice = index % sliceSize;
@@ -1285,7 +2832,7 @@ protected:
     }
 
     template <typename T>
-    static void trilGeneric(const DeviceTensorParams& dst, ssize_t diagonal)
+    static void trilGeneric(const DeviceTensorParams& dst, ssize_t diagonal, size_t begin, size_t end)
     {
         auto tDst = static_cast<T*>(dst.data);
 
@@ -1293,7 +2840,7 @@ protected:
         size_t rows = dst.shape[shapeSize - 2];      // Rows in the last 2-dim tensor.
         size_t cols = dst.shape[shapeSize - 1];      // Columns in the last 2-dim tensor.
 
-        for (size_t i = 0; i < dst.size; ++i)
+        for (size_t i = begin; i < end; ++i)
         {
             // Calculate the row and column indices for the last 2-dim slice.
             size_t row = (i / dst.strides[shapeSize - 2]) % rows;
@@ -1308,7 +2855,7 @@ protected:
     }
 
     template <typename T>
-    static void triuGeneric(const DeviceTensorParams& dst, ssize_t diagonal)
+    static void triuGeneric(const DeviceTensorParams& dst, ssize_t diagonal, size_t begin, size_t end)
     {
         auto tDst = static_cast<T*>(dst.data);
 
@@ -1316,7 +2863,7 @@ protected:
         size_t rows = dst.shape[shapeSize - 2];      // Rows in the last 2-dim tensor.
         size_t cols = dst.shape[shapeSize - 1];      // Columns in the last 2-dim tensor.
 
-        for (size_t i = 0; i < dst.size; ++i)
+        for (size_t i = begin; i < end; ++i)
         {
             // Calculate the row and column indices for the last 2-dim slice.
             size_t row = (i / dst.strides[shapeSize - 2]) % rows;
@@ -1357,3053 +2904,6762 @@ protected:
         return originalIndex;
     }
 
-    static size_t flattenIndex(const Stride& indices, const Stride& strides)
+    cpu::MemoryCache  m_memoryCache;
+};
+
+
+namespace profiler
+{
+
+inline std::vector<OpStats> aggregate()
+{
+    std::unordered_map<std::string, OpStats> opStats;
+    for (const auto & event : events())
     {
-        size_t index = 0;
-        for (size_t i = 0; i < indices.size(); ++i)
-        {
-            index += indices[i] * strides[i];
-        }
-        return index;
+        auto & stats = opStats[event.category == "gpu" ? "[GPU] " + event.name : event.name];
+        ++stats.count;
+        stats.totalTime += event.duration;
+        stats.bytes += event.bytes;
     }
 
-    static Stride unflattenIndex(size_t index, const Stride& strides)
+    std::vector<OpStats> result;
+    result.reserve(opStats.size());
+    for (auto & [name, stats] : opStats)
     {
-        Stride indices(strides.size());
-        for (size_t i = 0; i < strides.size(); ++i)
-        {
-            indices[i] = index / strides[i];
-            index %= strides[i];
-        }
-        return indices;
+        stats.name = name;
+        result.emplace_back(std::move(stats));
     }
-};
-
-
-// TODO: Global parameters needs to move to a global context.
-static Device defaultDevice;
-static std::random_device randomDevice;
-static std::mt19937 randGen(randomDevice());
-
+    std::sort(result.begin(), result.end(), [](const auto & a, const auto & b) { return a.totalTime > b.totalTime; });
+    return result;
+}
 
-class TensorStorage
+inline std::string summary()
 {
-public:
-    TensorStorage() = default;
+    auto opStats = aggregate();
+    double totalTime = 0;
+    for (const auto & stats : opStats)
+    {
+        if (stats.name.starts_with("[GPU]")) continue;      // GPU times overlap with the operation times.
+        totalTime += stats.totalTime;
+    }
+
+    std::ostringstream oss;
+    oss << std::left << std::setw(24) << "Operation" << std::right << std::setw(10) << "Calls"
+        << std::setw(14) << "Total (ms)" << std::setw(12) << "Avg (us)" << std::setw(9) << "Time %"
+        << std::setw(14) << "Moved (MB)" << std::endl;
+    oss << std::fixed;
+    for (const auto & stats : opStats)
+    {
+        bool isGPU = stats.name.starts_with("[GPU]");
+        oss << std::left << std::setw(24) << stats.name << std::right << std::setw(10) << stats.count
+            << std::setw(14) << std::setprecision(3) << stats.totalTime / 1e3
+            << std::setw(12) << std::setprecision(2) << stats.totalTime / static_cast<double>(stats.count)
+            << std::setw(9) << std::setprecision(1)
+            << (isGPU || totalTime == 0 ? 0.0 : 100.0 * stats.totalTime / totalTime)
+            << std::setw(14) << std::setprecision(3) << static_cast<double>(stats.bytes) / (1024.0 * 1024.0)
+            << std::endl;
+    }
+    return oss.str();
+}
 
-    explicit TensorStorage(Device* device, size_t size) : m_device{device}, m_size{size}
+inline void saveChromeTrace(const std::string & filename)
+{
+    static const char* dataTypeNames[DataTypeCount] =
     {
-        m_data = device->allocate(size);
-    }
+        "float64", "float32", "float16", "bfloat16", "int64", "int32", "int16", "int8", "uint8"
+    };
 
-    explicit TensorStorage(Device* device, size_t size, aix::DataType dtype) : m_device{device}
+    std::ofstream ofs(filename);
+    if (!ofs)
     {
-        m_data = device->allocate(size, dtype);
-        m_size = size * aix::Device::dataTypeSize(dtype);
+        throw std::ios_base::failure("Failed to open file for writing.");
     }
 
-    virtual ~TensorStorage()
+    auto recordedEvents = events();
+    std::unordered_set<size_t> threadIndices;
+    ofs << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    for (size_t i=0; i<recordedEvents.size(); ++i)
     {
-        if (m_device && m_data)
+        const auto & event = recordedEvents[i];
+        threadIndices.insert(event.threadIndex);
+        ofs << (i > 0 ? "," : "") << "\n{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category
+            << "\",\"ph\":\"X\",\"ts\":" << event.startTime << ",\"dur\":" << event.duration
+            << ",\"pid\":0,\"tid\":" << event.threadIndex << ",\"args\":{";
+        if (event.category == "gpu")
+        {
+            ofs << "\"commands\":\"" << event.shapes << "\"";
+        }
+        else
         {
-            m_device->deallocate(m_data);
+            ofs << "\"dtype\":\"" << dataTypeNames[static_cast<size_t>(event.dtype)] << "\",\"shapes\":\""
+                << event.shapes << "\",\"bytes\":" << event.bytes;
         }
+        ofs << "}}";
     }
 
-    inline Device* device()             { return m_device;  }
-    inline void*   data()               { return m_data;    }
-    inline const void* data() const     { return m_data;    }
-    inline size_t  size() const         { return m_size;    }
+    // Name the timelines.
+    for (auto threadIndex : threadIndices)
+    {
+        ofs << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << threadIndex << ",\"args\":{\"name\":\""
+            << (threadIndex == 0 ? std::string("GPU") : "CPU Thread " + std::to_string(threadIndex)) << "\"}}";
+    }
+    ofs << "\n]}\n";
+}
 
-private:
-    Device*   m_device{nullptr};
-    void*     m_data{nullptr};
-    size_t    m_size{0};
-};
+inline OpScope::OpScope(const char* name, std::initializer_list<const DeviceTensorParams*> params)
+{
+    if (!begin()) return;
+    m_event.name = name;
+    for (auto param : params)
+    {
+        add(*param);
+    }
+    m_event.startTime = now();
+}
 
+inline OpScope::OpScope(const char* name, const std::vector<DeviceTensorParams> & inputs,
+                        const DeviceTensorParams & result)
+{
+    if (!begin()) return;
+    m_event.name = name;
+    for (const auto & input : inputs)
+    {
+        add(input);
+    }
+    add(result);
+    m_event.startTime = now();
+}
 
-class TensorValue
+inline OpScope::OpScope(const char* name, DataType dtype, size_t bytes)
+{
+    if (!begin()) return;
+    m_event.name  = name;
+    m_event.dtype = dtype;
+    m_event.bytes = bytes;
+    m_event.startTime = now();
+}
+
+inline OpScope::~OpScope()
+{
+    if (!m_tracked) return;
+    --nestingDepth();
+    if (!m_recorded) return;
+    m_event.duration = now() - m_event.startTime;
+    record(std::move(m_event));
+}
+
+inline bool OpScope::begin()
+{
+    if (!isEnabled()) return false;
+    m_tracked  = true;
+    m_recorded = nestingDepth()++ == 0;     // Only the outermost operation is recorded.
+    if (m_recorded) m_event.category = "op";
+    return m_recorded;
+}
+
+inline void OpScope::add(const DeviceTensorParams & params)
+{
+    // The data type of the operation is the data type of the last tensor, which is the result.
+    m_event.dtype  = params.dtype;
+    m_event.bytes += params.size * Device::dataTypeSize(params.dtype);
+    m_event.shapes += m_event.shapes.empty() ? "[" : " [";
+    for (size_t i=0; i<params.shape.size(); ++i)
+    {
+        if (i > 0) m_event.shapes += ',';
+        m_event.shapes += std::to_string(params.shape[i]);
+    }
+    m_event.shapes += "]";
+}
+
+}   // profiler namespace
+
+
+// Graph Capture
+
+class GraphDevice;
+
+// The device operations of a function recorded by capture(). A replay runs the same operations on the same memory
+// without running the host code of the function again: no autograd graph is built and no tensor is allocated. The
+// buffers that the operations use stay alive until the graph is destroyed. Values that the host computes during the
+// capture, such as host generated random numbers or branches on tensor values, are fixed at the capture time. New
+// inputs are written into the captured input tensors before a replay.
+class Graph
 {
 public:
     // Constructor
-    TensorValue() = default;
+    Graph() = default;
 
-    // Constructor
-    TensorValue(const void* data, size_t size, DataType srcDType, Shape shape, Device* device,
-                DataType dType = DataType::kFloat32) : m_dType(dType), m_shape(std::move(shape)), m_device(device)
+    // Destructor
+    ~Graph()                            { reset(); }
+
+    Graph(Graph&& other) noexcept = default;
+
+    Graph& operator=(Graph&& other) noexcept
     {
-        validateSize(size, m_shape);
-        m_storage = std::make_shared<TensorStorage>(device, size, dType);
-        device->copy(data, srcDType, m_storage->data(), dType, size);
-        m_size = size;
-        // Compute the strides for indexing multi-dimensional data.
-        m_strides = computeStrides();
+        if (this != &other)
+        {
+            reset();
+            m_data = std::move(other.m_data);
+        }
+        return *this;
     }
 
-    // Constructor
-    TensorValue(const std::shared_ptr<TensorStorage>& storage, size_t size, size_t offset, Shape shape, Device* device,
-                DataType dType = DataType::kFloat32) : m_dType(dType), m_shape(std::move(shape)), m_device(device)
+    Graph(const Graph&) = delete;
+    Graph& operator=(const Graph&) = delete;
+
+    // Runs the recorded operations in the capture order.
+    void replay() const
     {
-        assert(storage->device() == device);
-        m_storage = storage;
-        m_size = size;
-        // Compute the strides for indexing multi-dimensional data.
-        m_strides = computeStrides();
-        m_offset = offset;
+        if (!m_data) return;
+        for (const auto & node : m_data->nodes)
+        {
+            node();
+        }
     }
 
-    // Constructor
-    template<typename T>
-    TensorValue(const std::initializer_list<T> & data, Shape shape, Device * device, DataType dType = DataType::kFloat32) :
-        m_dType(dType), m_shape(std::move(shape)), m_device(device)
+    inline size_t nodeCount() const             { return m_data ? m_data->nodes.size() : 0; }
+
+    // Returns true if the calling thread captures a graph.
+    static bool isCapturing()                   { return current() != nullptr; }
+
+    // Runs a host function that computes operation parameters from the host state, such as the time step of an
+    // optimizer. A capture records the function itself instead of its device operations, and a replay runs it again.
+    static void hostNode(const std::function<void()> & func)
     {
-        validateSize(data.size(), m_shape);
-        m_storage = std::make_shared<TensorStorage>(device, data.size(), dType);
-        device->copy(data.begin(), getDataType<T>(), m_storage->data(), dType, data.size());
-        m_size = data.size();
-        // Compute the strides for indexing multi-dimensional data.
-        m_strides = computeStrides();
+        auto data = current();
+        if (!data)
+        {
+            func();
+            return;
+        }
+
+        // The device operations of the function run directly without being recorded.
+        current() = nullptr;
+        try
+        {
+            func();
+        }
+        catch (...)
+        {
+            current() = data;
+            throw;
+        }
+        current() = data;
+        data->nodes.emplace_back(func);
     }
 
-    // Constructor
-    TensorValue(float value, Shape shape, Device * device, DataType dType = DataType::kFloat32) :
-        m_dType(dType), m_shape(std::move(shape)), m_device(device)
+private:
+    friend class GraphDevice;
+    friend Graph capture(const std::function<void()> & func);
+
+    struct Data
     {
-        m_size = std::accumulate(m_shape.begin(), m_shape.end(), 1, std::multiplies<>());
-        // Each tensor array must use device specific memory allocator.
-        m_storage = std::make_shared<TensorStorage>(device, m_size, dType);
-        m_strides = computeStrides();
-        // initialize data.
-        device->fill(&value, DataType::kFloat32, deviceParams());
+        std::vector<std::function<void()>>  nodes;
+        std::unordered_set<GraphDevice*>  devices;      // Devices that keep buffers alive for the graph.
+    };
+
+    static Data*& current()
+    {
+        thread_local Data* data{nullptr};
+        return data;
     }
 
+    void reset();
+
+    std::unique_ptr<Data>  m_data;
+};
+
+
+// A device that runs the operations on another device. It records the operations into the graph that the calling
+// thread captures, and it keeps the buffers that the recorded operations use until the graphs are destroyed. Graphs
+// must not outlive the device.
+class GraphDevice : public Device
+{
+public:
     // Constructor
-    TensorValue(Shape shape, Device * device, DataType dType = DataType::kFloat32) :
-        m_dType(dType), m_shape(std::move(shape)), m_device(device)
+    explicit GraphDevice(Device * device) : m_device{device} { }
+
+    // Destructor
+    ~GraphDevice() override
     {
-        m_size = std::accumulate(m_shape.begin(), m_shape.end(), 1, std::multiplies<>());
-        // Each tensor array must use device specific memory allocator.
-        m_storage = std::make_shared<TensorStorage>(device, m_size, dType);
-        m_strides = computeStrides();
+        for (const auto & [memory, buffer] : m_buffers)
+        {
+            if (buffer.released) free(const_cast<void*>(memory), buffer);
+        }
     }
 
-    // Constructor
-    TensorValue(Shape shape, Device * device, size_t size, Stride strides, DataType dType = DataType::kFloat32) :
-        m_dType(dType), m_size(size), m_shape(std::move(shape)), m_strides(std::move(strides)), m_device(device)
+    DeviceType type() const override    { return m_device->type(); }
+    std::string name() const override   { return m_device->name(); }
+    inline Device* device() const       { return m_device; }
+
+    void* allocate(size_t size) override
     {
-        validateSize(m_size, m_shape);
-        // Each tensor array must use device specific memory allocator.
-        m_storage = std::make_shared<TensorStorage>(device, m_size, dType);
+        return track(m_device->allocate(size), size, false);
     }
 
-    // Constructor
-    TensorValue(float value, Device * device, DataType dType = DataType::kFloat32) :
-        m_dType(dType), m_shape{}, m_device(device)
+    void* allocate(size_t size, DataType dtype) override
     {
-        // Each tensor array must use device specific memory allocator.
-        m_size = 1;
-        m_storage = std::make_shared<TensorStorage>(device, m_size, dType);
-        m_strides = computeStrides();
-        device->fill(&value, DataType::kFloat32, deviceParams());
+        return track(m_device->allocate(size, dtype), size * dataTypeSize(dtype), false);
     }
 
-    // Destructor
-    ~TensorValue()
+    void deallocate(void * memory) override             { release(memory, false); }
+
+    void* mapHostMemory(void * memory, size_t size) override
     {
-        m_device = nullptr;
+        auto mapped = m_device->mapHostMemory(memory, size);
+        return mapped ? track(mapped, size, true) : nullptr;
     }
 
-    // Copy constructor
-    TensorValue(const TensorValue& other) noexcept
+    void unmapHostMemory(void * memory) override        { release(memory, true); }
+
+    // Private memory is not used since it moves to another address at the first host access, which would invalidate
+    // the recorded operations.
+
+    void add(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result) override
     {
-        m_dType   = other.m_dType;
-        m_size    = other.m_size;
-        m_shape   = other.m_shape;
-        m_strides = other.m_strides;
-        m_device  = other.m_device;
-        m_storage = std::make_shared<TensorStorage>(m_device, other.m_size, other.m_dType);
-        m_device->copy(other.data(), other.m_dType, data(), other.m_dType, other.m_size);
+        m_device->add(a1, a2, result);
+        record({&a1, &a2, &result}, [device=m_device, a1, a2, result] { device->add(a1, a2, result); });
     }
 
-    // Copy assignment operator
-    TensorValue& operator=(const TensorValue& other) noexcept
+    void sub(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result) override
     {
-        if (this != &other)     // Protect against self-assignment
-        {
-            m_dType   = other.m_dType;
-            m_size    = other.m_size;
-            m_shape   = other.m_shape;
-            m_strides = other.m_strides;
-            m_device  = other.m_device;
-            m_storage = std::make_shared<TensorStorage>(m_device, other.m_size, other.m_dType);
-            m_device->copy(other.data(), other.m_dType, data(), other.m_dType, other.m_size);
-        }
+        m_device->sub(a1, a2, result);
+        record({&a1, &a2, &result}, [device=m_device, a1, a2, result] { device->sub(a1, a2, result); });
+    }
 
-        return *this;
+    void mul(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result) override
+    {
+        m_device->mul(a1, a2, result);
+        record({&a1, &a2, &result}, [device=m_device, a1, a2, result] { device->mul(a1, a2, result); });
     }
 
-    // Move constructor
-    TensorValue(TensorValue&& other) noexcept
+    void div(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result) override
     {
-        m_dType   = other.m_dType;
-        m_storage = other.m_storage;
-        m_size    = other.m_size;
-        m_shape   = other.m_shape;
-        m_strides = other.m_strides;
-        m_device  = other.m_device;
-        other.m_size   = 0;
-        other.m_device = nullptr;
+        m_device->div(a1, a2, result);
+        record({&a1, &a2, &result}, [device=m_device, a1, a2, result] { device->div(a1, a2, result); });
     }
 
-    // Move assignment operator
-    TensorValue& operator=(TensorValue&& other) noexcept
+    void unary(const DeviceTensorParams& a1, const DeviceTensorParams& result) override
     {
-        if (this != &other)
-        {
-            m_dType   = other.m_dType;
-            m_storage = other.m_storage;
-            m_size    = other.m_size;
-            m_shape   = other.m_shape;
-            m_strides = other.m_strides;
-            m_device  = other.m_device;
-            other.m_size   = 0;
-            other.m_device = nullptr;
-        }
+        m_device->unary(a1, result);
+        record({&a1, &result}, [device=m_device, a1, result] { device->unary(a1, result); });
+    }
 
-        return *this;
+    void fill(const void* scalar, DataType scalarDType, const DeviceTensorParams& result) override
+    {
+        m_device->fill(scalar, scalarDType, result);
+        if (!Graph::current()) return;
+        std::array<uint8_t, sizeof(double)> value{};     // The scalar is copied since it is a host value.
+        std::memcpy(value.data(), scalar, dataTypeSize(scalarDType));
+        record({&result}, [device=m_device, value, scalarDType, result]
+        {
+            device->fill(value.data(), scalarDType, result);
+        });
     }
 
-    // Select operator.
-    TensorValue operator[](ssize_t index) const
+    void fillMin(const DeviceTensorParams& result) override
     {
-        return select(0, index);
+        m_device->fillMin(result);
+        record({&result}, [device=m_device, result] { device->fillMin(result); });
     }
 
-    // Access element at a specific index (non-const version).
-    template<typename T>
-    T & getValueAt(const Index & indices)     { return static_cast<T*>(m_storage->data())[getIndex(indices)]; }
+    void sum(const DeviceTensorParams& a, const DeviceTensorParams& result) override
+    {
+        m_device->sum(a, result);
+        record({&a, &result}, [device=m_device, a, result] { device->sum(a, result); });
+    }
 
-    // Access element at a specific index (const version).
-    template<typename T>
-    T getValueAt(const Index & indices) const { return static_cast<T*>(m_storage->data())[getIndex(indices)]; }
+    void sqrt(const DeviceTensorParams& a, const DeviceTensorParams& result) override
+    {
+        m_device->sqrt(a, result);
+        record({&a, &result}, [device=m_device, a, result] { device->sqrt(a, result); });
+    }
 
-    // Get the data type of the tensor.
-    DataType dataType() const      { return m_dType; }
+    void sin(const DeviceTensorParams& a, const DeviceTensorParams& result) override
+    {
+        m_device->sin(a, result);
+        record({&a, &result}, [device=m_device, a, result] { device->sin(a, result); });
+    }
 
-    // Get the shape of the tensor
-    const Shape & shape() const    { return m_shape; }
+    void cos(const DeviceTensorParams& a, const DeviceTensorParams& result) override
+    {
+        m_device->cos(a, result);
+        record({&a, &result}, [device=m_device, a, result] { device->cos(a, result); });
+    }
 
-    // Get the strides of the tensor
-    const Stride & strides() const  { return m_strides; }
+    void tanh(const DeviceTensorParams& a, const DeviceTensorParams& result) override
+    {
+        m_device->tanh(a, result);
+        record({&a, &result}, [device=m_device, a, result] { device->tanh(a, result); });
+    }
 
-    // Get the raw data of the tensor.
-    const void* data() const    { return m_storage->data(); }
-    void* data()                { return m_storage->data(); }
+    void log(const DeviceTensorParams& a, const DeviceTensorParams& result) override
+    {
+        m_device->log(a, result);
+        record({&a, &result}, [device=m_device, a, result] { device->log(a, result); });
+    }
 
-    // Get storage of the tensor.
-    inline const std::shared_ptr<TensorStorage>& storage()  { return m_storage; };
-    inline size_t storageOffset() const                     { return m_offset; };
+    void exp(const DeviceTensorParams& a, const DeviceTensorParams& result) override
+    {
+        m_device->exp(a, result);
+        record({&a, &result}, [device=m_device, a, result] { device->exp(a, result); });
+    }
 
-    // Get the raw data of the tensor.
-    template<typename T>
-    const T* data() const       { return static_cast<T*>(m_storage->data()); }
-    template<typename T>
-    T* data()                   { return static_cast<T*>(m_storage->data()); }
+    void pow(const DeviceTensorParams& a, const DeviceTensorParams& exp, const DeviceTensorParams& result) override
+    {
+        m_device->pow(a, exp, result);
+        record({&a, &exp, &result}, [device=m_device, a, exp, result] { device->pow(a, exp, result); });
+    }
 
-    // Get the size of the data
-    size_t size() const         { return m_size; }
+    void max(const DeviceTensorParams& a, const DeviceTensorParams& result) override
+    {
+        m_device->max(a, result);
+        record({&a, &result}, [device=m_device, a, result] { device->max(a, result); });
+    }
 
-    // Get the device
-    Device * device() const     { return m_device; }
+    void argmax(const DeviceTensorParams& a, const DeviceTensorParams& result) override
+    {
+        m_device->argmax(a, result);
+        record({&a, &result}, [device=m_device, a, result] { device->argmax(a, result); });
+    }
 
-    // Get device tensor parameters.
-    DeviceTensorParams deviceParams() const
+    void argmaxIndices(const DeviceTensorParams& a, const DeviceTensorParams& result) override
     {
-        return { .data=m_storage->data(), .dtype=m_dType, .isContiguous=m_isContiguous, .offset=m_offset,
-                 .shape=m_shape, .size=m_size, .strides=m_strides };
-    };
+        m_device->argmaxIndices(a, result);
+        record({&a, &result}, [device=m_device, a, result] { device->argmaxIndices(a, result); });
+    }
 
-    // Set the device
-    TensorValue to(Device * device) const
+    void matmul(const DeviceTensorParams& a, const DeviceTensorParams& b, const DeviceTensorParams& result) override
     {
-        if (m_device == device) return *this;
-        return {data(), m_size, m_dType, m_shape, device, m_dType};
+        m_device->matmul(a, b, result);
+        record({&a, &b, &result}, [device=m_device, a, b, result] { device->matmul(a, b, result); });
     }
-    inline TensorValue to(std::unique_ptr<Device>& device) const    { return to(device.get()); }
-    inline TensorValue to(std::shared_ptr<Device>& device) const    { return to(device.get()); }
 
-    template<typename T>
-    T item() const
+    void matmulTransposed(const DeviceTensorParams& a, bool transposeA, const DeviceTensorParams& b,
+                          bool transposeB, const DeviceTensorParams& result) override
     {
-        if (!m_shape.empty())    // Scalar value must have no dimension.
+        m_device->matmulTransposed(a, transposeA, b, transposeB, result);
+        record({&a, &b, &result}, [device=m_device, a, transposeA, b, transposeB, result]
         {
-            throw std::invalid_argument("Tensor is not a scalar.");
-        }
-        return static_cast<T*>(m_storage->data())[0];
+            device->matmulTransposed(a, transposeA, b, transposeB, result);
+        });
     }
 
-    // Returns a new TensorValue with a new shape.
-    TensorValue reshape(const Shape & newShape) const
+    void matmulQuantized(const DeviceTensorParams& a, const DeviceTensorParams& w,
+                         const QuantizedLayout& layout, const DeviceTensorParams& result) override
     {
-        size_t newSize = std::accumulate(newShape.begin(), newShape.end(), 1, std::multiplies<>());
-        if (m_size != newSize)
+        m_device->matmulQuantized(a, w, layout, result);
+        record({&a, &w, &result}, [device=m_device, a, w, layout, result]
         {
-            throw std::invalid_argument("Reshape error: element count mismatch (" +
-                                        std::to_string(m_size) + " vs " + std::to_string(newSize) + ").");
-        }
-        return {m_storage, m_size, m_offset, newShape, m_device, m_dType};
+            device->matmulQuantized(a, w, layout, result);
+        });
     }
 
-    // Equalize tensor data types by promoting data type of tensors.
-    TensorValue to(DataType newDataType) const
+    void linear(const DeviceTensorParams& a, const DeviceTensorParams& b, const DeviceTensorParams& bias,
+                Activation activation, const DeviceTensorParams& preActivation,
+                const DeviceTensorParams& result) override
     {
-        if (dataType() != newDataType)
+        m_device->linear(a, b, bias, activation, preActivation, result);
+        record({&a, &b, &bias, &preActivation, &result},
+               [device=m_device, a, b, bias, activation, preActivation, result]
         {
-            return {data(), size(), dataType(), shape(), device(), newDataType};
-        }
-        return *this;
+            device->linear(a, b, bias, activation, preActivation, result);
+        });
     }
 
-    // Returns true if two TensorValue shapes are compatible for a broadcast operation.
-    static bool checkBroadcastShapes(const Shape& shape1, const Shape& shape2)
+    void transpose(const DeviceTensorParams& a, const DeviceTensorParams& result, size_t dim0, size_t dim1) override
     {
-        auto it1 = shape1.rbegin();
-        auto it2 = shape2.rbegin();
-        while (it1 != shape1.rend() || it2 != shape2.rend())
-        {
-            size_t dim1 = (it1 != shape1.rend()) ? *it1++ : 1;
-            size_t dim2 = (it2 != shape2.rend()) ? *it2++ : 1;
-            if (dim1 != dim2 && dim1 != 1 && dim2 != 1)
-            {
-                return false;
-            }
-        }
-        return true;
+        m_device->transpose(a, result, dim0, dim1);
+        record({&a, &result}, [device=m_device, a, result, dim0, dim1] { device->transpose(a, result, dim0, dim1); });
     }
 
-    // Returns final shape of a broadcast operation.
-    static Shape broadcastShapes(const Shape& shape1, const Shape& shape2)
+    void copy(const void* src, DataType srcDType, void* dst, DataType dstDType, size_t size) override
     {
-        Shape resultShape;
-        auto it1 = shape1.rbegin();
-        auto it2 = shape2.rbegin();
-        while (it1 != shape1.rend() || it2 != shape2.rend())
-        {
-            size_t dim1 = (it1 != shape1.rend()) ? *it1++ : 1;
-            size_t dim2 = (it2 != shape2.rend()) ? *it2++ : 1;
-            if (dim1 != dim2 && dim1 != 1 && dim2 != 1)
-            {
-                throw std::invalid_argument("Shapes are not compatible for broadcasting.");
-            }
-            resultShape.push_back(std::max(dim1, dim2));
-        }
-        std::reverse(resultShape.begin(), resultShape.end());
-        return resultShape;
+        m_device->copy(src, srcDType, dst, dstDType, size);
+        recordCopy(src, srcDType, dst, dstDType, size, false);
     }
 
-    static bool checkBroadcastTo(const Shape& sourceShape, const Shape& targetShape)
+    void copyImmediate(const void* src, DataType srcDType, void* dst, DataType dstDType, size_t size) override
     {
-        if (sourceShape.size() > targetShape.size()) return false;
-
-        auto itSrc = sourceShape.rbegin();
-        auto itTgt = targetShape.rbegin();
-
-        while (itTgt != targetShape.rend())
-        {
-            size_t dimSrc = (itSrc != sourceShape.rend()) ? *itSrc++ : 1;
-            size_t dimTgt = *itTgt++;
-
-            if (dimSrc != dimTgt && dimSrc != 1)
-            {
-                return false;
-            }
-        }
-
-        return true;
+        m_device->copyImmediate(src, srcDType, dst, dstDType, size);
+        recordCopy(src, srcDType, dst, dstDType, size, true);
     }
 
-    // Returns a broadcasted TensorValue with a new shape.
-    TensorValue broadcastTo(const Shape& newShape) const
+    void contiguous(const DeviceTensorParams& src, const DeviceTensorParams& dst) override
     {
-        if (shape() == newShape) return *this;
-        if (!checkBroadcastTo(shape(), newShape))
-        {
-            throw std::invalid_argument("Target TensorValue shape is not broadcastable.");
-        }
-
-        // Calculate new strides for broadcasting.
-        std::vector<size_t> newStrides(newShape.size(), 0);
-        size_t currentStride = 1;
-        for (int i = m_shape.size() - 1, j = newShape.size() - 1; j >= 0; --i, --j)
-        {
-            if (i < 0 || m_shape[i] != newShape[j])
-            {
-                newStrides[j] = 0;      // Broadcast dimension.
-            } 
-            else
-            {
-                newStrides[j] = currentStride;
-                currentStride *= m_shape[i];
-            }
-        }
-
-        // Create a new TensorValue that shares the same storage.
-        TensorValue result(m_storage, m_size, m_offset, newShape, m_device, m_dType);
-        result.m_strides = std::move(newStrides);
-        result.m_isContiguous = false;
-        return result.contiguous();
+        m_device->contiguous(src, dst);
+        record({&src, &dst}, [device=m_device, src, dst] { device->contiguous(src, dst); });
     }
 
-    // Reduces the TensorValue back to the original shape.
-    TensorValue reduceTo(const Shape & originalShape) const
+    void reduce(ReduceOp op, const DeviceTensorParams& src, const DeviceTensorParams& dst,
+                const ReduceShape& shape) override
     {
-        if (shape() == originalShape) return *this;
-        // Ensure tensor values are initialized to zero, as the reduction operation performs a summation.
-        TensorValue result(0, originalShape, device(), m_dType);
-        device()->reduceTo(deviceParams(), result.deviceParams());
-        return result;
+        m_device->reduce(op, src, dst, shape);
+        record({&src, &dst}, [device=m_device, op, src, dst, shape] { device->reduce(op, src, dst, shape); });
     }
 
-    // Returns true if the tensor is contiguous.
-    bool isContiguous() const
+    void softmax(SoftmaxOp op, const std::vector<DeviceTensorParams>& inputs, const DeviceTensorParams& result,
+                 const ReduceShape& shape) override
     {
-        return m_isContiguous;
+        m_device->softmax(op, inputs, result, shape);
+        if (!Graph::current()) return;
+        for (const auto & input : inputs) pin(input.data);
+        record({&result}, [device=m_device, op, inputs, result, shape] { device->softmax(op, inputs, result, shape); });
     }
 
-    TensorValue contiguous() const
+    void argmaxIndicesTo(const DeviceTensorParams& src, const DeviceTensorParams& dst, size_t dim) override
     {
-        if (isContiguous()) return *this;
-
-        TensorValue result(m_shape, m_device, m_dType);
-        m_device->contiguous(deviceParams(), result.deviceParams());
-        return result;
+        m_device->argmaxIndicesTo(src, dst, dim);
+        record({&src, &dst}, [device=m_device, src, dst, dim] { device->argmaxIndicesTo(src, dst, dim); });
     }
 
-    // Operators
-
-    // Overload the + operator
-    TensorValue operator+(const TensorValue & other) const
+    void sliceSet(const DeviceTensorParams& src, const DeviceTensorParams& dst,
+                  size_t dim, size_t start, size_t end, size_t step) override
     {
-        return arithmeticOpFunc(&Device::add, other);
+        m_device->sliceSet(src, dst, dim, start, end, step);
+        record({&src, &dst}, [device=m_device, src, dst, dim, start, end, step]
+        {
+            device->sliceSet(src, dst, dim, start, end, step);
+        });
     }
 
-    // Overload the - operator
-    TensorValue operator-(const TensorValue & other) const
+    void tril(const DeviceTensorParams& dst, ssize_t diagonal) override
     {
-        return arithmeticOpFunc(&Device::sub, other);
+        m_device->tril(dst, diagonal);
+        record({&dst}, [device=m_device, dst, diagonal] { device->tril(dst, diagonal); });
     }
 
-    // Overload the * operator
-    TensorValue operator*(const TensorValue & other) const
+    void triu(const DeviceTensorParams& dst, ssize_t diagonal) override
     {
-        return arithmeticOpFunc(&Device::mul, other);
+        m_device->triu(dst, diagonal);
+        record({&dst}, [device=m_device, dst, diagonal] { device->triu(dst, diagonal); });
     }
 
-    // Overload the / operator
-    TensorValue operator/(const TensorValue & other) const
+    void indexSelect(const DeviceTensorParams& src, const DeviceTensorParams& dst,
+                     const DeviceTensorParams& indices, size_t dim) override
     {
-        return arithmeticOpFunc(&Device::div, other);
+        m_device->indexSelect(src, dst, indices, dim);
+        record({&src, &dst, &indices}, [device=m_device, src, dst, indices, dim]
+        {
+            device->indexSelect(src, dst, indices, dim);
+        });
     }
 
-    // Overload the += operator - In-place operation.
-    TensorValue & operator+=(const TensorValue & other)
+    void indexAdd(const DeviceTensorParams& src, const DeviceTensorParams& dst,
+                  const DeviceTensorParams& indices, size_t dim) override
     {
-        return arithmeticInPlaceOpFunc(&Device::add, other);
+        m_device->indexAdd(src, dst, indices, dim);
+        record({&src, &dst, &indices}, [device=m_device, src, dst, indices, dim]
+        {
+            device->indexAdd(src, dst, indices, dim);
+        });
     }
 
-    // Overload the -= operator - In-place operation.
-    TensorValue & operator-=(const TensorValue & other)
+    void fusedElementwise(const FusedProgram& program, const std::vector<DeviceTensorParams>& inputs,
+                          const DeviceTensorParams& result) override
     {
-        return arithmeticInPlaceOpFunc(&Device::sub, other);
+        m_device->fusedElementwise(program, inputs, result);
+        if (!Graph::current()) return;
+        for (const auto & input : inputs) pin(input.data);
+        record({&result}, [device=m_device, program, inputs, result]
+        {
+            device->fusedElementwise(program, inputs, result);
+        });
     }
 
-    // Overload the *= operator - In-place operation.
-    TensorValue & operator*=(const TensorValue & other)
+    void optimizerStep(const OptimizerStepParams& step, const std::vector<OptimizerTensorParams>& tensors) override
     {
-        return arithmeticInPlaceOpFunc(&Device::mul, other);
+        m_device->optimizerStep(step, tensors);
+        if (!Graph::current()) return;
+        for (const auto & tensor : tensors)
+        {
+            for (auto params : { &tensor.param, &tensor.grad, &tensor.master, &tensor.m, &tensor.v }) pin(params->data);
+        }
+        record({}, [device=m_device, step, tensors] { device->optimizerStep(step, tensors); });
     }
 
-    // Overload the /= operator - In-place operation.
-    TensorValue & operator/=(const TensorValue & other)
-    {
-        return arithmeticInPlaceOpFunc(&Device::div, other);
-    }
+    void emptyCache() override                          { m_device->emptyCache(); }
+    cpu::MemoryCacheStats memoryStats() override        { return m_device->memoryStats(); }
+    void memoryCacheLimit(size_t bytes) override        { m_device->memoryCacheLimit(bytes); }
 
-    // Overload the unary - operator
-    TensorValue operator-() const
+    void synchronize() override
     {
-        // Create a new TensorValue to store the result. Perform element-wise.
-        TensorValue result(m_shape, m_device, m_dType);
-        m_device->unary(deviceParams(), result.deviceParams());
-        return result;
+        m_device->synchronize();
+        record({}, [device=m_device] { device->synchronize(); });
     }
 
-    TensorValue operator+(float scalar) const
+    // Releases the buffers of a destroyed graph that no tensor uses anymore. Other buffers return to their tensors.
+    void releaseGraph(const void * graph)
     {
-        return *this + TensorValue{scalar, m_shape, m_device, promoteDataTypeToFloat(m_dType)};
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        for (auto it = m_buffers.begin(); it != m_buffers.end();)
+        {
+            auto & owners = it->second.owners;
+            owners.erase(std::remove(owners.begin(), owners.end(), graph), owners.end());
+            if (owners.empty() && it->second.released)
+            {
+                free(const_cast<void*>(it->first), it->second);
+                it = m_buffers.erase(it);
+                continue;
+            }
+            ++it;
+        }
     }
 
-    TensorValue operator-(float scalar) const
+private:
+    struct Buffer
     {
-        return *this - TensorValue{scalar, m_shape, m_device, promoteDataTypeToFloat(m_dType)};
-    }
+        size_t  size{0};
+        bool    mapped{false};                  // Mapped host memory is unmapped instead of deallocated.
+        bool    released{false};                // Released by its tensor, kept alive for the graphs.
+        std::vector<const void*>  owners{};     // Graphs that use the buffer.
+    };
 
-    TensorValue operator*(float scalar) const
+    void* track(void * memory, size_t size, bool mapped)
     {
-        return *this * TensorValue{scalar, m_shape, m_device, promoteDataTypeToFloat(m_dType)};
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        auto & buffer = m_buffers[memory];
+        buffer = { .size=size, .mapped=mapped };
+        addOwner(buffer);       // The buffers allocated during a capture are used by the recorded operations.
+        return memory;
     }
 
-    TensorValue operator/(float scalar) const
+    void release(void * memory, bool mapped)
     {
-        return *this / TensorValue{scalar, m_shape, m_device, promoteDataTypeToFloat(m_dType)};
-    }
+        std::unique_lock<std::mutex>  lock(m_syncObj);
+        auto it = m_buffers.find(memory);
+        if (it == m_buffers.end())
+        {
+            lock.unlock();
+            free(memory, { .mapped=mapped });
+            return;
+        }
 
-    TensorValue& operator+=(float scalar)
-    {
-        return *this += TensorValue{scalar, m_shape, m_device, promoteDataTypeToFloat(m_dType)};
+        // Recorded operations could use a buffer that is released during the capture.
+        addOwner(it->second);
+        if (it->second.owners.empty())
+        {
+            free(memory, it->second);
+            m_buffers.erase(it);
+            return;
+        }
+        it->second.released = true;
     }
 
-    TensorValue& operator-=(float scalar)
+    void free(void * memory, const Buffer & buffer)
     {
-        return *this -= TensorValue{scalar, m_shape, m_device, m_dType};
+        if (buffer.mapped)
+            m_device->unmapHostMemory(memory);
+        else
+            m_device->deallocate(memory);
     }
 
-    TensorValue& operator*=(float scalar)
+    void addOwner(Buffer & buffer)
     {
-        return *this *= TensorValue{scalar, m_shape, m_device, m_dType};
+        auto graph = Graph::current();
+        if (!graph || std::find(buffer.owners.begin(), buffer.owners.end(), graph) != buffer.owners.end()) return;
+        buffer.owners.emplace_back(graph);
+        graph->devices.insert(this);
     }
 
-    TensorValue& operator/=(float scalar)
+    // Keeps the buffer that contains the memory alive for the capturing graph. Returns false for host memory.
+    bool pin(const void * memory)
     {
-        return *this /= TensorValue{scalar, m_shape, m_device, m_dType};
+        if (!memory) return true;
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        auto it = m_buffers.upper_bound(memory);
+        if (it == m_buffers.begin()) return false;
+        --it;
+        auto begin = static_cast<const uint8_t*>(it->first);
+        if (static_cast<const uint8_t*>(memory) >= begin + std::max<size_t>(it->second.size, 1)) return false;
+        addOwner(it->second);
+        return true;
     }
 
-    friend TensorValue operator+(float scalar, const TensorValue & tensor)
+    template <typename Func>
+    void record(std::initializer_list<const DeviceTensorParams*> params, Func && node)
     {
-        auto promotedDType = promoteDataTypeToFloat(tensor.dataType());
-        return TensorValue{scalar, tensor.shape(), tensor.device(), promotedDType} + tensor;
+        auto graph = Graph::current();
+        if (!graph) return;
+        for (auto param : params) pin(param->data);
+        graph->nodes.emplace_back(std::forward<Func>(node));
     }
 
-    friend TensorValue operator-(float scalar, const TensorValue & tensor)
+    void recordCopy(const void* src, DataType srcDType, void* dst, DataType dstDType, size_t size, bool immediate)
     {
-        auto promotedDType = promoteDataTypeToFloat(tensor.dataType());
-        return TensorValue{scalar, tensor.shape(), tensor.device(), promotedDType} - tensor;
+        auto graph = Graph::current();
+        if (!graph) return;
+        pin(dst);
+        if (pin(src))
+        {
+            graph->nodes.emplace_back([device=m_device, src, srcDType, dst, dstDType, size, immediate]
+            {
+                immediate ? device->copyImmediate(src, srcDType, dst, dstDType, size)
+                          : device->copy(src, srcDType, dst, dstDType, size);
+            });
+            return;
+        }
+
+        // The source is host memory that could be released after the capture, so the replay copies a snapshot of it.
+        auto bytes = static_cast<const uint8_t*>(src);
+        auto snapshot = std::make_shared<std::vector<uint8_t>>(bytes, bytes + size * dataTypeSize(srcDType));
+        graph->nodes.emplace_back([device=m_device, snapshot, srcDType, dst, dstDType, size, immediate]
+        {
+            immediate ? device->copyImmediate(snapshot->data(), srcDType, dst, dstDType, size)
+                      : device->copy(snapshot->data(), srcDType, dst, dstDType, size);
+        });
     }
 
-    friend TensorValue operator*(float scalar, const TensorValue & tensor)
+    Device*  m_device;
+    std::map<const void*, Buffer>  m_buffers;       // Live buffers and the released buffers that graphs keep alive.
+    std::mutex  m_syncObj;
+};
+
+
+inline void Graph::reset()
+{
+    if (!m_data) return;
+    for (auto device : m_data->devices)
     {
-        auto promotedDType = promoteDataTypeToFloat(tensor.dataType());
-        return TensorValue{scalar, tensor.shape(), tensor.device(), promotedDType} * tensor;
+        device->releaseGraph(m_data.get());
     }
+    m_data.reset();
+}
 
-    friend TensorValue operator/(float scalar, const TensorValue & tensor)
+// Runs the function and records the device operations that it runs on graph devices. The function runs once
+// during the capture, so the capture is also a regular call of the function.
+inline Graph capture(const std::function<void()> & func)
+{
+    if (Graph::isCapturing())
     {
-        auto promotedDType = promoteDataTypeToFloat(tensor.dataType());
-        return TensorValue{scalar, tensor.shape(), tensor.device(), promotedDType} / tensor;
+        throw std::invalid_argument("Graph capture cannot be nested.");
     }
 
-    void fill(float value) const
+    Graph graph;
+    graph.m_data = std::make_unique<Graph::Data>();
+    Graph::current() = graph.m_data.get();
+    try
     {
-        m_device->fill(&value, DataType::kFloat32, deviceParams());
+        func();
     }
-
-    TensorValue sum() const
+    catch (...)
     {
-        TensorValue result({}, device(), m_dType);
-        m_device->sum(deviceParams(), result.deviceParams());
-        return result;
+        Graph::current() = nullptr;
+        throw;
     }
+    Graph::current() = nullptr;
+    return graph;
+}
 
-    TensorValue sum(ssize_t dim, bool keepDim=false) const
-    {
-        if (m_shape.empty()) return *this;      // Return itself if it's a scalar tensor.
 
-        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
-        if (dim < 0 || dim >= static_cast<ssize_t>(m_shape.size()))
-        {
-            throw std::invalid_argument("Dimension parameter of TensorValue::sum() is out of range.");
-        }
+// TODO: Global parameters needs to move to a global context.
+static Device defaultDevice;
+static std::random_device randomDevice;
+static std::mt19937 randGen(randomDevice());
 
-        Shape resultShape = m_shape;
-        resultShape[dim] = 1;
-        auto result = reduceTo(resultShape);
-        return keepDim ? result : result.squeeze(dim);
-    }
 
-    TensorValue mean() const
-    {
-        return sum() / size();
-    }
+// The residency of a tensor storage. Device private storage is preferred for the results of operations, which are
+// mostly read by the next operations on the device. It falls back to shared storage if the device does not support it.
+enum class StorageResidency
+{
+    kShared,
+    kDevicePrivate,
+};
 
-    TensorValue mean(ssize_t dim, bool keepDim=false) const
+
+class TensorStorage
+{
+public:
+    TensorStorage() = default;
+
+    explicit TensorStorage(Device* device, size_t size) : m_device{device}, m_size{size}
     {
-        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
-        return sum(dim, keepDim) / shape()[dim];
+        m_data = device->allocate(size);
     }
 
-    TensorValue sqrt() const
+    explicit TensorStorage(Device* device, size_t size, aix::DataType dtype) : m_device{device}
     {
-        return tensorMathFunc(&Device::sqrt);
+        m_data = device->allocate(size, dtype);
+        m_size = size * aix::Device::dataTypeSize(dtype);
     }
 
-    TensorValue sin() const
+    explicit TensorStorage(Device* device, size_t size, aix::DataType dtype, StorageResidency residency) :
+        m_device{device}
     {
-        return tensorMathFunc(&Device::sin);
+        if (residency == StorageResidency::kDevicePrivate)
+        {
+            m_data = device->allocatePrivate(size, dtype);
+            m_isPrivate = m_data != nullptr;
+        }
+        if (!m_data)
+        {
+            m_data = device->allocate(size, dtype);
+        }
+        m_size = size * aix::Device::dataTypeSize(dtype);
     }
 
-    TensorValue cos() const
+    // Constructor. Wraps memory mapped by Device::mapHostMemory(). The owner keeps the host memory alive.
+    explicit TensorStorage(Device* device, void* data, size_t size, std::shared_ptr<void> owner) :
+        m_device{device}, m_data{data}, m_size{size}, m_owner{std::move(owner)}
     {
-        return tensorMathFunc(&Device::cos);
     }
 
-    TensorValue tanh() const
+    virtual ~TensorStorage()
     {
-        return tensorMathFunc(&Device::tanh);
+        if (m_device && m_data)
+        {
+            if (m_owner)
+                m_device->unmapHostMemory(m_data);
+            else
+                m_device->deallocate(m_data);
+        }
     }
 
-    TensorValue log() const
+    inline Device* device()             { return m_device;  }
+    inline void*   data()               { makeHostAccessible(); return m_data; }
+    inline const void* data() const     { makeHostAccessible(); return m_data; }
+    inline size_t  size() const         { return m_size;    }
+    inline bool    isPrivate() const    { return m_isPrivate.load(std::memory_order_acquire); }
+
+    // The version counts the in-place writes to the storage. Autograd compares it to the version that an operation saw
+    // to detect a value changed after it was saved for the backward pass.
+    inline size_t  version() const      { return m_version; }
+    inline void    bumpVersion()        { ++m_version; }
+
+    // Returns the memory for device operations without moving private memory to the host.
+    inline void*   deviceData()             { return m_data; }
+    inline const void* deviceData() const   { return m_data; }
+
+private:
+    // Private memory moves to the host at the first host access and stays there. Threads that share a tensor, such as
+    // data loader workers, may access it first at the same time, so only one of them moves the memory.
+    void makeHostAccessible() const
     {
-        return tensorMathFunc(&Device::log);
+        if (!m_isPrivate.load(std::memory_order_acquire)) return;
+        std::lock_guard<std::mutex>  lock(m_hostAccessMutex);
+        if (!m_isPrivate.load(std::memory_order_relaxed)) return;
+        m_data = m_device->makeHostAccessible(m_data, m_size);
+        m_isPrivate.store(false, std::memory_order_release);
     }
 
-    TensorValue exp() const
-    {
-        return tensorMathFunc(&Device::exp);
+    Device*   m_device{nullptr};
+    mutable void*  m_data{nullptr};
+    size_t    m_size{0};
+    size_t    m_version{0};
+    mutable std::atomic<bool>  m_isPrivate{false};
+    mutable std::mutex  m_hostAccessMutex;      // Guards the move of private memory to the host.
+    std::shared_ptr<void>  m_owner;     // Owner of the host memory of a mapped storage.
+};
+
+
+class TensorValue
+{
+public:
+    // Constructor
+    TensorValue() = default;
+
+    // Constructor
+    TensorValue(const void* data, size_t size, DataType srcDType, Shape shape, Device* device,
+                DataType dType = DataType::kFloat32) : m_dType(dType), m_shape(std::move(shape)), m_device(device)
+    {
+        validateSize(size, m_shape);
+        m_storage = std::make_shared<TensorStorage>(device, size, dType);
+        device->copy(data, srcDType, m_storage->data(), dType, size);
+        m_size = size;
+        // Compute the strides for indexing multi-dimensional data.
+        m_strides = computeStrides();
     }
 
-    TensorValue pow(const TensorValue & exp) const
+    // Constructor
+    TensorValue(const std::shared_ptr<TensorStorage>& storage, size_t size, size_t offset, Shape shape, Device* device,
+                DataType dType = DataType::kFloat32) : m_dType(dType), m_shape(std::move(shape)), m_device(device)
     {
-        if (shape() != exp.shape() || dataType() != exp.dataType())
-        {
-            TensorValue lhs = *this;
-            TensorValue rhs = exp;
-            auto result = prepareTensors(lhs, rhs);
-            result.device()->pow(lhs.deviceParams(), rhs.deviceParams(), result.deviceParams());
-            return result;
-        }
+        assert(storage->device() == device);
+        m_storage = storage;
+        m_size = size;
+        // Compute the strides for indexing multi-dimensional data.
+        m_strides = computeStrides();
+        m_offset = offset;
+        // Kernels that ignore the layout read contiguous tensors from the start of their storage, so a tensor that
+        // starts at an offset is a view.
+        m_isContiguous = offset == 0;
+    }
 
-        // Create a new TensorValue to store the result. Perform element-wise.
-        TensorValue result(m_shape, m_device, m_dType);
-        m_device->pow(deviceParams(), exp.deviceParams(), result.deviceParams());
-        return result;
+    // Constructor
+    template<typename T>
+    TensorValue(const std::initializer_list<T> & data, Shape shape, Device * device, DataType dType = DataType::kFloat32) :
+        m_dType(dType), m_shape(std::move(shape)), m_device(device)
+    {
+        validateSize(data.size(), m_shape);
+        m_storage = std::make_shared<TensorStorage>(device, data.size(), dType);
+        device->copy(data.begin(), getDataType<T>(), m_storage->data(), dType, data.size());
+        m_size = data.size();
+        // Compute the strides for indexing multi-dimensional data.
+        m_strides = computeStrides();
     }
 
-    TensorValue max() const
+    // Constructor
+    TensorValue(float value, Shape shape, Device * device, DataType dType = DataType::kFloat32) :
+        m_dType(dType), m_shape(std::move(shape)), m_device(device)
     {
-        // Create a new TensorValue to store the result. Perform element-wise.
-        TensorValue result({}, m_device, m_dType);
-        m_device->max(deviceParams(), result.deviceParams());
-        return result;
+        m_size = std::accumulate(m_shape.begin(), m_shape.end(), 1, std::multiplies<>());
+        // Each tensor array must use device specific memory allocator.
+        m_storage = std::make_shared<TensorStorage>(device, m_size, dType);
+        m_strides = computeStrides();
+        // initialize data.
+        device->fill(&value, DataType::kFloat32, deviceParams());
     }
 
-    TensorValue max(ssize_t dim, bool keepDim=false) const
+    // Constructor. The content is written by the device, so device private storage is preferred by default.
+    TensorValue(Shape shape, Device * device, DataType dType = DataType::kFloat32,
+                StorageResidency residency = StorageResidency::kDevicePrivate) :
+        m_dType(dType), m_shape(std::move(shape)), m_device(device)
     {
-        if (m_shape.empty()) return *this;      // Return itself if it's a scalar tensor.
+        m_size = std::accumulate(m_shape.begin(), m_shape.end(), 1, std::multiplies<>());
+        // Each tensor array must use device specific memory allocator.
+        m_storage = std::make_shared<TensorStorage>(device, m_size, dType, residency);
+        m_strides = computeStrides();
+    }
 
-        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
-        if (dim < 0 || dim >= static_cast<ssize_t>(m_shape.size()))
-        {
-            throw std::invalid_argument("Dimension parameter of TensorValue::max() is out of range.");
-        }
+    // Constructor
+    TensorValue(Shape shape, Device * device, size_t size, Stride strides, DataType dType = DataType::kFloat32) :
+        m_dType(dType), m_size(size), m_shape(std::move(shape)), m_strides(std::move(strides)), m_device(device)
+    {
+        validateSize(m_size, m_shape);
+        // Each tensor array must use device specific memory allocator.
+        m_storage = std::make_shared<TensorStorage>(device, m_size, dType, StorageResidency::kDevicePrivate);
+    }
 
-        Shape newShape = m_shape;
-        newShape[dim] = 1;
+    // Constructor
+    TensorValue(float value, Device * device, DataType dType = DataType::kFloat32) :
+        m_dType(dType), m_shape{}, m_device(device)
+    {
+        // Each tensor array must use device specific memory allocator.
+        m_size = 1;
+        m_storage = std::make_shared<TensorStorage>(device, m_size, dType);
+        m_strides = computeStrides();
+        device->fill(&value, DataType::kFloat32, deviceParams());
+    }
 
-        TensorValue result(newShape, device(), m_dType);            // Zero initialization is not required.
-        auto resDevParams = result.deviceParams();
-        device()->fillMin(resDevParams);       // Initialize the tensor with the lowest value.
-        device()->maxTo(deviceParams(), resDevParams);
-        return keepDim ? result : result.squeeze(dim);
+    // Returns a tensor value that has a shape but no storage yet. Lazy tensors keep their metadata in such values
+    // until they are materialized.
+    static TensorValue placeholder(Shape shape, Device * device, DataType dType = DataType::kFloat32)
+    {
+        TensorValue value;
+        value.m_dType   = dType;
+        value.m_shape   = std::move(shape);
+        value.m_device  = device;
+        value.m_size    = std::accumulate(value.m_shape.begin(), value.m_shape.end(), 1, std::multiplies<>());
+        value.m_strides = value.computeStrides();
+        return value;
     }
 
-    TensorValue argmax() const
+    // Destructor
+    ~TensorValue()
     {
-        // Create a new TensorValue to store the result. Perform element-wise.
-        TensorValue result({}, m_device, aix::DataType::kInt32);        // Index is by default in int32 type.
-        m_device->argmax(deviceParams(), result.deviceParams());
-        return result;
+        m_device = nullptr;
     }
 
-    TensorValue argmax(ssize_t dim, bool keepDim=false) const
+    // Copy constructor
+    TensorValue(const TensorValue& other) noexcept
     {
-        if (m_shape.empty()) return {0, m_shape, m_device, aix::DataType::kInt32};  // Scalar tensor.
+        copyFrom(other);
+    }
 
-        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
-        if (dim < 0 || dim >= static_cast<ssize_t>(m_shape.size()))
+    // Copy assignment operator
+    TensorValue& operator=(const TensorValue& other) noexcept
+    {
+        if (this != &other)     // Protect against self-assignment
         {
-            throw std::invalid_argument("Dimension parameter of TensorValue::argmax() is out of range.");
+            copyFrom(other);
         }
 
-        Shape newShape = m_shape;
-        newShape[dim] = 1;
-
-        TensorValue result(newShape, m_device, aix::DataType::kInt32);        // Index is by default in int32 type.
-        m_device->argmaxTo(deviceParams(), result.deviceParams(), dim);
-        return keepDim ? result : result.squeeze(dim);
+        return *this;
     }
 
-    TensorValue argmaxIndices() const
+    // Move constructor
+    TensorValue(TensorValue&& other) noexcept
     {
-        // Create a new TensorValue to store the result. Perform element-wise.
-        TensorValue result(m_shape, m_device, aix::DataType::kInt32);   // Index is by default in int32 type.
-        m_device->argmaxIndices(deviceParams(), result.deviceParams());
-        return result;
+        m_dType   = other.m_dType;
+        m_storage = other.m_storage;
+        m_size    = other.m_size;
+        m_shape   = other.m_shape;
+        m_strides = other.m_strides;
+        m_device  = other.m_device;
+        m_offset  = other.m_offset;
+        m_isContiguous = other.m_isContiguous;
+        other.m_size   = 0;
+        other.m_device = nullptr;
     }
 
-    TensorValue argmaxIndices(ssize_t dim) const
+    // Move assignment operator
+    TensorValue& operator=(TensorValue&& other) noexcept
     {
-        if (m_shape.empty()) return {1, m_shape, m_device, aix::DataType::kInt32};  // Scalar tensor.
-
-        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
-        if (dim < 0 || dim >= static_cast<ssize_t>(m_shape.size()))
+        if (this != &other)
         {
-            throw std::invalid_argument("Dimension parameter of TensorValue::argmaxIndices() is out of range.");
+            m_dType   = other.m_dType;
+            m_storage = other.m_storage;
+            m_size    = other.m_size;
+            m_shape   = other.m_shape;
+            m_strides = other.m_strides;
+            m_device  = other.m_device;
+            m_offset  = other.m_offset;
+            m_isContiguous = other.m_isContiguous;
+            other.m_size   = 0;
+            other.m_device = nullptr;
         }
 
-        TensorValue result(0, m_shape, m_device, aix::DataType::kInt32);        // Index is by default in int32 type.
-        m_device->argmaxIndicesTo(deviceParams(), result.deviceParams(), dim);
-        return result;
+        return *this;
     }
 
-    // Matrix multiplication for 2D tensors.
-    TensorValue matmul(const TensorValue & b) const
+    // Select operator.
+    TensorValue operator[](ssize_t index) const
     {
-        // Ensure both tensors are 2D or can be treated as such.
-        if (m_shape.size() != 2 || b.shape().size() != 2)
-        {
-            throw std::invalid_argument("Both tensors must be 2D for matrix multiplication.");
-        }
+        return select(0, index);
+    }
 
-        // Check if the inner dimensions match.
-        if (m_shape[1] != b.shape()[0])
-        {
-            throw std::invalid_argument("The inner dimensions of the tensors do not match.");
-        }
+    // Access element at a specific index (non-const version).
+    template<typename T>
+    T & getValueAt(const Index & indices)     { return static_cast<T*>(m_storage->data())[getIndex(indices)]; }
 
-        Shape resultShape{m_shape[0], b.shape()[1]};
+    // Access element at a specific index (const version).
+    template<typename T>
+    T getValueAt(const Index & indices) const { return static_cast<T*>(m_storage->data())[getIndex(indices)]; }
 
-        // Convert tensors to the promoted data type if necessary.
-        if (dataType() != b.dataType())
-        {
-            TensorValue lhs = *this;
-            TensorValue rhs = b;
-            auto promotedDType = promoteDataType(lhs.dataType(), rhs.dataType());
-            lhs = lhs.to(promotedDType);
-            rhs = rhs.to(promotedDType);
-            TensorValue result(resultShape, lhs.device(), promotedDType);
-            result.device()->matmul(lhs.deviceParams(), rhs.deviceParams(), result.deviceParams());
-            return result;
-        }
+    // Get the data type of the tensor.
+    DataType dataType() const      { return m_dType; }
 
-        // Result tensor shape.
-        TensorValue result(resultShape, m_device, m_dType);
-        m_device->matmul(deviceParams(), b.deviceParams(), result.deviceParams());
-        return result;
-    }
+    // Get the shape of the tensor
+    const Shape & shape() const    { return m_shape; }
 
-    // Generalized transpose function.
-    TensorValue transpose(ssize_t dim0, ssize_t dim1) const
+    // Get the strides of the tensor
+    const Stride & strides() const  { return m_strides; }
+
+    // Get the raw data of the tensor.
+    const void* data() const    { return m_storage->data(); }
+    void* data()                { return m_storage->data(); }
+
+    // Get the raw data of the tensor for device operations, which does not move device private storage to the host.
+    const void* deviceData() const  { return m_storage->deviceData(); }
+    void* deviceData()              { return m_storage->deviceData(); }
+
+    // Get storage of the tensor.
+    inline const std::shared_ptr<TensorStorage>& storage()  { return m_storage; };
+    inline size_t storageOffset() const                     { return m_offset; };
+
+    // Returns the number of in-place writes to the storage, see TensorStorage::version().
+    inline size_t version() const       { return m_storage ? m_storage->version() : 0; }
+    inline void bumpVersion() const     { if (m_storage) m_storage->bumpVersion(); }
+
+    // Get the raw data of the tensor.
+    template<typename T>
+    const T* data() const       { return static_cast<T*>(m_storage->data()); }
+    template<typename T>
+    T* data()                   { return static_cast<T*>(m_storage->data()); }
+
+    // Get the size of the data
+    size_t size() const         { return m_size; }
+
+    // Get the device
+    Device * device() const     { return m_device; }
+
+    // Get device tensor parameters.
+    DeviceTensorParams deviceParams() const
     {
-        auto shapeSize = static_cast<ssize_t>(shape().size());
-        dim0 = dim0 < 0 ? shapeSize + dim0 : dim0;
-        dim1 = dim1 < 0 ? shapeSize + dim1 : dim1;
+        return { .data=m_storage->deviceData(), .dtype=m_dType, .isContiguous=m_isContiguous, .offset=m_offset,
+                 .shape=m_shape, .size=m_size, .strides=m_strides };
+    };
 
-        // Check dimensions
-        if (dim0 < 0 || dim0 >= shapeSize || dim1 < 0 || dim1 >= shapeSize)
+    // Set the device
+    TensorValue to(Device * device) const
+    {
+        if (m_device == device) return *this;
+        if (!isContiguous()) return contiguous().to(device);
+        return {data(), m_size, m_dType, m_shape, device, m_dType};
+    }
+    inline TensorValue to(std::unique_ptr<Device>& device) const    { return to(device.get()); }
+    inline TensorValue to(std::shared_ptr<Device>& device) const    { return to(device.get()); }
+
+    template<typename T>
+    T item() const
+    {
+        if (!m_shape.empty())    // Scalar value must have no dimension.
         {
-            throw std::invalid_argument("Dimension is out of range for transpose.");
+            throw std::invalid_argument("Tensor is not a scalar.");
         }
-
-        Shape newShape = m_shape;
-        std::swap(newShape[dim0], newShape[dim1]);
-        TensorValue result(newShape, device(), m_dType);
-        m_device->transpose(deviceParams(), result.deviceParams(), dim0, dim1);
-        return result;
+        return static_cast<T*>(m_storage->data())[0];
     }
 
-    TensorValue permute(SIndex newDims) const
+    // Returns a new TensorValue with a new shape.
+    TensorValue reshape(const Shape & newShape) const
     {
-        if (newDims.size() != shape().size())
+        size_t newSize = std::accumulate(newShape.begin(), newShape.end(), 1, std::multiplies<>());
+        if (m_size != newSize)
         {
-            throw std::invalid_argument("Dimension count does not match in permute.");
+            throw std::invalid_argument("Reshape error: element count mismatch (" +
+                                        std::to_string(m_size) + " vs " + std::to_string(newSize) + ").");
         }
+        // The result shares the storage of a contiguous tensor, views are copied first.
+        if (!isContiguous()) return contiguous().reshape(newShape);
+        return {m_storage, m_size, m_offset, newShape, m_device, m_dType};
+    }
 
-        if (shape().empty()) return *this;      // Nothing to do for a scalar tensor.
-        if (shape().size() == 1 && (newDims[0] == 0 || newDims[0] == -1)) return *this;
-
-        auto shapeSize = static_cast<ssize_t>(shape().size());
-        std::vector<ssize_t> dimTable(shapeSize, -1);
+    // Equalize tensor data types by promoting data type of tensors.
+    TensorValue to(DataType newDataType) const
+    {
+        if (dataType() != newDataType)
+        {
+            if (!isContiguous()) return contiguous().to(newDataType);
+            return {deviceData(), size(), dataType(), shape(), device(), newDataType};
+        }
+        return *this;
+    }
 
-        // Check if it's an identity permutation and validate dimensions.
-        bool isIdentity = true;
-        for (ssize_t i = 0; i < shapeSize; ++i)
+    // Returns true if two TensorValue shapes are compatible for a broadcast operation.
+    static bool checkBroadcastShapes(const Shape& shape1, const Shape& shape2)
+    {
+        auto it1 = shape1.rbegin();
+        auto it2 = shape2.rbegin();
+        while (it1 != shape1.rend() || it2 != shape2.rend())
         {
-            auto& dim = newDims[i];
-            dim = dim < 0 ? shapeSize + dim : dim;
-            if (dim < 0 || dim >= shapeSize)
-            {
-                throw std::invalid_argument("Dimension is out of range for permute.");
-            }
-            if (dimTable[dim] != -1)
+            size_t dim1 = (it1 != shape1.rend()) ? *it1++ : 1;
+            size_t dim2 = (it2 != shape2.rend()) ? *it2++ : 1;
+            if (dim1 != dim2 && dim1 != 1 && dim2 != 1)
             {
-                throw std::invalid_argument("There is at least one repeated dim in permute.");
+                return false;
             }
-            dimTable[dim] = i;
-            if (dim != i) isIdentity = false;
         }
+        return true;
+    }
 
-        if (isIdentity) return *this;
-
-        // Create the new shape.
-        Shape newShape(shapeSize);
-        for (ssize_t i = 0; i < shapeSize; ++i)
+    // Returns final shape of a broadcast operation.
+    static Shape broadcastShapes(const Shape& shape1, const Shape& shape2)
+    {
+        Shape resultShape;
+        auto it1 = shape1.rbegin();
+        auto it2 = shape2.rbegin();
+        while (it1 != shape1.rend() || it2 != shape2.rend())
         {
-            newShape[i] = m_shape[newDims[i]];
+            size_t dim1 = (it1 != shape1.rend()) ? *it1++ : 1;
+            size_t dim2 = (it2 != shape2.rend()) ? *it2++ : 1;
+            if (dim1 != dim2 && dim1 != 1 && dim2 != 1)
+            {
+                throw std::invalid_argument("Shapes are not compatible for broadcasting.");
+            }
+            resultShape.push_back(std::max(dim1, dim2));
         }
+        std::reverse(resultShape.begin(), resultShape.end());
+        return resultShape;
+    }
 
-        TensorValue result(newShape, device(), m_dType);
-
-        // Perform series of transpositions.
-        Shape currShape = m_shape;
-        Stride currStride = m_strides;
-        TensorValue currTensor = *this;
+    static bool checkBroadcastTo(const Shape& sourceShape, const Shape& targetShape)
+    {
+        if (sourceShape.size() > targetShape.size()) return false;
 
-        SIndex currDims(shapeSize);
-        std::iota(currDims.begin(), currDims.end(), 0);     // Initialize to [0, 1, 2, ...]
+        auto itSrc = sourceShape.rbegin();
+        auto itTgt = targetShape.rbegin();
 
-        for (ssize_t i=0; i<shapeSize; ++i)
+        while (itTgt != targetShape.rend())
         {
-            if (currDims[i] == newDims[i]) continue;
-
-            // Find the position of newDims[i] in currentDims.
-            auto it = std::find(currDims.begin() + i, currDims.end(), newDims[i]);
-            size_t j = std::distance(currDims.begin(), it);
-
-            // Swap dimensions i and j.
-            std::swap(currDims[i], currDims[j]);
-            std::swap(currShape[i], currShape[j]);
+            size_t dimSrc = (itSrc != sourceShape.rend()) ? *itSrc++ : 1;
+            size_t dimTgt = *itTgt++;
 
-            // Perform the transpose.
-            TensorValue tempTensor(currShape, m_device, m_dType);
-            m_device->transpose(currTensor.deviceParams(), tempTensor.deviceParams(), j, i);
-            currTensor = std::move(tempTensor);
-            currStride = currTensor.strides();
+            if (dimSrc != dimTgt && dimSrc != 1)
+            {
+                return false;
+            }
         }
 
-        return currTensor;
+        return true;
     }
 
-    TensorValue squeeze(ssize_t dim) const
+    // Returns a broadcasted TensorValue with a new shape.
+    TensorValue broadcastTo(const Shape& newShape) const
     {
-        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
-        if (dim >= static_cast<ssize_t>(m_shape.size()))
+        if (shape() == newShape) return *this;
+        return broadcastView(newShape).contiguous();
+    }
+
+    // Returns a broadcasted view that shares the storage. Broadcast dimensions have zero strides. Only element-wise
+    // operations read views in place, the other operations require contiguous tensors.
+    TensorValue broadcastView(const Shape& newShape) const
+    {
+        if (shape() == newShape) return shallowCopy();
+        if (!checkBroadcastTo(shape(), newShape))
         {
-            throw std::invalid_argument("Invalid dimension for squeeze.");
+            throw std::invalid_argument("Target TensorValue shape is not broadcastable.");
         }
 
-        if (m_shape[dim] == 1)
+        // Calculate new strides for broadcasting.
+        Stride newStrides(newShape.size(), 0);
+        for (int i = m_shape.size() - 1, j = newShape.size() - 1; j >= 0; --i, --j)
         {
-            auto squeezedShape = m_shape;
-            squeezedShape.erase(squeezedShape.begin() + dim);
-            return reshape(squeezedShape);
+            if (i >= 0 && m_shape[i] == newShape[j])
+            {
+                newStrides[j] = m_strides[i];
+            }
         }
-        return *this;
+
+        // Create a new TensorValue that shares the same storage.
+        size_t newSize = std::accumulate(newShape.begin(), newShape.end(), 1, std::multiplies<>());
+        TensorValue result(m_storage, newSize, m_offset, newShape, m_device, m_dType);
+        result.m_strides = std::move(newStrides);
+        result.m_isContiguous = false;
+        return result;
     }
 
-    TensorValue unsqueeze(ssize_t dim) const
+    // Reduces the TensorValue back to the original shape.
+    TensorValue reduceTo(const Shape & originalShape) const
     {
-        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
-        if (dim > static_cast<ssize_t>(m_shape.size()))
-        {
-            throw std::invalid_argument("Invalid dimension for unsqueeze.");
-        }
-
-        auto unsqueezedShape = m_shape;
-        unsqueezedShape.insert(unsqueezedShape.begin() + dim, 1);
-        return reshape(unsqueezedShape);
+        if (shape() == originalShape) return *this;
+        // The reduction performs a summation because each element of the original tensor is used multiple times in
+        // the broadcasted operation. Summing the gradients correctly aggregates these contributions.
+        return reduceAxes(ReduceOp::kSum, originalShape);
     }
 
-    TensorValue slice(ssize_t dim=0, std::optional<ssize_t> startOpt = std::nullopt,
-                      std::optional<ssize_t> endOpt = std::nullopt, ssize_t step=1) const
+    // Reduces the TensorValue to the target shape, which is the shape of the tensor with some dimensions set to one
+    // and optionally fewer leading dimensions. Adjacent dimensions are merged, and each pass reduces one group of
+    // dimensions as an [outer, reduce, inner] view. Argmax supports only a single reduced dimension.
+    TensorValue reduceAxes(ReduceOp op, const Shape & targetShape) const
     {
-        if (m_shape.empty())
+        if (targetShape.size() > m_shape.size())
         {
-            throw std::invalid_argument("slice() cannot be applied to a 0-dim, a scalar tensor.");
+            throw std::invalid_argument("TensorValue::reduceAxes() target shape has more dimensions than the tensor.");
         }
 
-        if (step < 1)
+        // Merge the adjacent dimensions that are either kept or reduced. Dimensions of size one are dropped.
+        struct DimGroup { size_t size; bool isReduced; };
+        std::vector<DimGroup> groups;
+        size_t rankDiff = m_shape.size() - targetShape.size();
+        for (size_t i = 0; i < m_shape.size(); ++i)
         {
-            throw std::invalid_argument("Slice step must be greater than zero.");
+            size_t targetDim = i < rankDiff ? 1 : targetShape[i - rankDiff];
+            bool isReduced = targetDim != m_shape[i];
+            if (isReduced && targetDim != 1)
+            {
+                throw std::invalid_argument("TensorValue::reduceAxes() target shape is not compatible.");
+            }
+            if (m_shape[i] == 1) continue;
+            if (!groups.empty() && groups.back().isReduced == isReduced)
+            {
+                groups.back().size *= m_shape[i];
+            }
+            else
+            {
+                groups.push_back({m_shape[i], isReduced});
+            }
         }
 
-        // Normalize dimension index.
-        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
-        if (dim < 0 || dim >= static_cast<ssize_t>(m_shape.size()))
+        auto resultType = op == ReduceOp::kArgmax ? DataType::kInt32 : m_dType;
+        auto passCount = std::count_if(groups.begin(), groups.end(), [](const auto& group) { return group.isReduced; });
+        if (passCount == 0)
         {
-            throw std::invalid_argument("Dimension parameter of slice() is out of range.");
+            // Only dimensions of size one are reduced.
+            return op == ReduceOp::kArgmax ? TensorValue(0, targetShape, m_device, resultType)
+                                           : TensorValue(*this).reshape(targetShape);
         }
-
-        // Handle start and end indices.
-        ssize_t start = startOpt.value_or(0);
-        ssize_t end   = endOpt.value_or(static_cast<ssize_t>(m_shape[dim]));
-
-        // Normalize negative indices.
-        start = start < 0 ? static_cast<ssize_t>(m_shape[dim]) + start : start;
-        end   = end   < 0 ? static_cast<ssize_t>(m_shape[dim]) + end   : end;
-
-        // Clamp the start and end indices within valid bounds.
-        start = std::max<ssize_t>(0, std::min<ssize_t>(start, static_cast<ssize_t>(m_shape[dim])));
-        end   = std::max<ssize_t>(0, std::min<ssize_t>(end,   static_cast<ssize_t>(m_shape[dim])));
-
-        if (start >= end)
+        if (op == ReduceOp::kArgmax && passCount > 1)
         {
-            throw std::invalid_argument("Start index of slice() must be less than end index.");
+            throw std::invalid_argument("TensorValue::reduceAxes() supports only one reduced dimension for argmax.");
         }
 
-        // Compute new size along the sliced dimension.
-        size_t newSizeInDim = (end - start + step - 1) / step;
-
-        // Compute new offset.
-        size_t newOffset = m_offset + start * m_strides[dim];
+        // The innermost groups are reduced first, which keeps the outer groups of later passes unchanged.
+        auto src = isContiguous() ? shallowCopy() : contiguous();
+        for (size_t g = groups.size(); g-- > 0;)
+        {
+            if (!groups[g].isReduced) continue;
+            ReduceShape reduceShape{ .reduce=groups[g].size };
+            for (size_t i = 0; i < g; ++i) reduceShape.outer *= groups[i].size;
+            for (size_t i = g + 1; i < groups.size(); ++i) reduceShape.inner *= groups[i].size;
+            groups[g].size = 1;
 
-        // Compute new strides.
-        auto newStrides = m_strides;
-        newStrides[dim] *= step;
+            TensorValue result(Shape{reduceShape.outer * reduceShape.inner}, m_device, resultType);
+            m_device->reduce(op, src.deviceParams(), result.deviceParams(), reduceShape);
+            src = std::move(result);
+        }
+        return src.reshape(targetShape);
+    }
 
-        // Compute new shape.
-        auto newShape = m_shape;
-        newShape[dim] = newSizeInDim;
+    // Returns true if the tensor is contiguous.
+    bool isContiguous() const
+    {
+        return m_isContiguous;
+    }
 
-        auto newSize = std::accumulate(newShape.begin(), newShape.end(), 1, std::multiplies<>());
+    TensorValue contiguous() const
+    {
+        if (isContiguous()) return *this;
 
-        TensorValue result(m_storage, newSize, newOffset, newShape, device(), dataType());
-        result.m_strides = newStrides;
-        result.m_isContiguous = false;
-        return result.contiguous();
+        TensorValue result(m_shape, m_device, m_dType);
+        m_device->contiguous(deviceParams(), result.deviceParams());
+        return result;
     }
 
-    TensorValue sliceSet(const TensorValue& tensor, ssize_t dim=0, std::optional<ssize_t> startOpt = std::nullopt,
-                         std::optional<ssize_t> endOpt = std::nullopt, ssize_t step=1, bool inPlace=false) const
+    // Copies the elements to the given contiguous output tensor of the same shape, converting the data type if needed.
+    TensorValue & contiguous(TensorValue & out) const
     {
-        if (m_shape.empty())
+        out.validateOutput(m_shape, {this});
+        if (!isContiguous() && dataType() == out.dataType())
         {
-            throw std::invalid_argument("slice() cannot be applied to a 0-dim, a scalar tensor.");
+            m_device->contiguous(deviceParams(), out.deviceParams());
         }
-
-        if (step < 1)
+        else
         {
-            throw std::invalid_argument("Slice step must be greater than zero.");
+            auto input = isContiguous() ? shallowCopy() : contiguous();
+            m_device->copy(input.deviceData(), input.dataType(), out.deviceData(), out.dataType(), m_size);
         }
+        out.bumpVersion();
+        return out;
+    }
 
-        // Normalize dimension index.
-        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
-        if (dim < 0 || dim >= static_cast<ssize_t>(m_shape.size()))
-        {
-            throw std::invalid_argument("Dimension parameter of slice() is out of range.");
-        }
+    // Operators
 
-        // Handle start and end indices.
-        ssize_t start = startOpt.value_or(0);
-        ssize_t end   = endOpt.value_or(static_cast<ssize_t>(m_shape[dim]));
+    // Overload the + operator
+    TensorValue operator+(const TensorValue & other) const
+    {
+        return arithmeticOpFunc(&Device::add, other);
+    }
 
-        // Normalize negative indices.
-        start = start < 0 ? static_cast<ssize_t>(m_shape[dim]) + start : start;
-        end   = end   < 0 ? static_cast<ssize_t>(m_shape[dim]) + end   : end;
+    // Overload the - operator
+    TensorValue operator-(const TensorValue & other) const
+    {
+        return arithmeticOpFunc(&Device::sub, other);
+    }
 
-        // Clamp the start and end indices within valid bounds.
-        start = std::max<ssize_t>(0, std::min<ssize_t>(start, static_cast<ssize_t>(m_shape[dim])));
-        end   = std::max<ssize_t>(0, std::min<ssize_t>(end,   static_cast<ssize_t>(m_shape[dim])));
+    // Overload the * operator
+    TensorValue operator*(const TensorValue & other) const
+    {
+        return arithmeticOpFunc(&Device::mul, other);
+    }
 
-        if (start >= end)
-        {
-            throw std::invalid_argument("Start index of slice() must be less than end index.");
-        }
+    // Overload the / operator
+    TensorValue operator/(const TensorValue & other) const
+    {
+        return arithmeticOpFunc(&Device::div, other);
+    }
 
-        // Calculate the new shape for the sliced tensor.
-        Shape newShape = m_shape;
-        newShape[dim] = (end - start + step - 1) / step; // This computes the size along the slicing dimension.
+    // Overload the += operator - In-place operation.
+    TensorValue & operator+=(const TensorValue & other)
+    {
+        return arithmeticInPlaceOpFunc(&Device::add, other);
+    }
 
-        if (tensor.shape() != newShape)
-        {
-            throw std::invalid_argument("The tensor's shape does not match the new shape of sliceSet().");
-        }
+    // Overload the -= operator - In-place operation.
+    TensorValue & operator-=(const TensorValue & other)
+    {
+        return arithmeticInPlaceOpFunc(&Device::sub, other);
+    }
 
-        if (inPlace)
-        {
-            // Slice and set tensor's data to the result tensor.
-            device()->sliceSet(tensor.deviceParams(), deviceParams(), dim, start, end, step);
-            return *this;
-        }
+    // Overload the *= operator - In-place operation.
+    TensorValue & operator*=(const TensorValue & other)
+    {
+        return arithmeticInPlaceOpFunc(&Device::mul, other);
+    }
 
-        TensorValue result(0, m_shape, device(), m_dType);  // Zero initialization is required.
-        // Slice and set tensor's data to the result tensor.
-        device()->sliceSet(tensor.deviceParams(), result.deviceParams(), dim, start, end, step);
+    // Overload the /= operator - In-place operation.
+    TensorValue & operator/=(const TensorValue & other)
+    {
+        return arithmeticInPlaceOpFunc(&Device::div, other);
+    }
+
+    // Overload the unary - operator
+    TensorValue operator-() const
+    {
+        // Create a new TensorValue to store the result. Perform element-wise.
+        TensorValue result(m_shape, m_device, m_dType);
+        m_device->unary(deviceParams(), result.deviceParams());
         return result;
     }
 
-    TensorValue select(ssize_t dim, ssize_t index) const
+    TensorValue operator+(float scalar) const
     {
-        if (m_shape.empty())
-        {
-            throw std::invalid_argument("select() cannot be applied to a scalar, zero-dimension, tensor.");
-        }
-        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
-        index = index < 0 ? static_cast<ssize_t>(m_shape[dim]) + index : index;
-        return slice(dim, index, index + 1, 1).squeeze(dim);
+        return *this + TensorValue{scalar, m_shape, m_device, promoteDataTypeToFloat(m_dType)};
     }
 
-    TensorValue indexSelect(ssize_t dim, const TensorValue& indices) const
+    TensorValue operator-(float scalar) const
     {
-        if (indices.shape().size() > 1)
-        {
-            throw std::invalid_argument("Indices supposed to be a vector.");
-        }
-        if (indices.dataType() != aix::DataType::kInt32)
-        {
-            throw std::invalid_argument("Indices tensor's data type must be int32");
-        }
+        return *this - TensorValue{scalar, m_shape, m_device, promoteDataTypeToFloat(m_dType)};
+    }
 
-        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
+    TensorValue operator*(float scalar) const
+    {
+        return *this * TensorValue{scalar, m_shape, m_device, promoteDataTypeToFloat(m_dType)};
+    }
 
-        if ((!shape().empty() && (dim < 0 || static_cast<size_t>(dim) >= shape().size())) ||
-            (shape().empty() && dim != 0))
-        {
-            throw std::invalid_argument("Dimension is out of range for indexSelect operation.");
-        }
+    TensorValue operator/(float scalar) const
+    {
+        return *this / TensorValue{scalar, m_shape, m_device, promoteDataTypeToFloat(m_dType)};
+    }
 
-        auto newShape = shape();
-        if (!newShape.empty())
-        {
-            newShape[dim] = !indices.shape().empty() ? indices.shape()[0] : 1;
-        }
+    TensorValue& operator+=(float scalar)
+    {
+        return *this += TensorValue{scalar, m_shape, m_device, promoteDataTypeToFloat(m_dType)};
+    }
 
-        assert(checkMinMaxValueOverflow(0, (!shape().empty() ? shape()[dim] : 0), indices));
+    TensorValue& operator-=(float scalar)
+    {
+        return *this -= TensorValue{scalar, m_shape, m_device, m_dType};
+    }
 
-        TensorValue result(newShape, device(), dataType());
-        device()->indexSelect(deviceParams(), result.deviceParams(), indices.deviceParams(), dim);
-        return result;
+    TensorValue& operator*=(float scalar)
+    {
+        return *this *= TensorValue{scalar, m_shape, m_device, m_dType};
     }
 
-    TensorValue indexAdd(ssize_t dim, const TensorValue& indices, const TensorValue& source, bool inPlace=false) const
+    TensorValue& operator/=(float scalar)
     {
-        if (indices.shape().size() > 1)
-        {
-            throw std::invalid_argument("Indices supposed to be a vector.");
-        }
-        if (indices.dataType() != aix::DataType::kInt32)
-        {
-            throw std::invalid_argument("Indices tensor's data type must be int32");
-        }
+        return *this /= TensorValue{scalar, m_shape, m_device, m_dType};
+    }
 
-        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
+    friend TensorValue operator+(float scalar, const TensorValue & tensor)
+    {
+        auto promotedDType = promoteDataTypeToFloat(tensor.dataType());
+        return TensorValue{scalar, tensor.shape(), tensor.device(), promotedDType} + tensor;
+    }
 
-        if ((!shape().empty() && (dim < 0 || static_cast<size_t>(dim) >= shape().size())) ||
-            (shape().empty() && dim != 0))
-        {
-            throw std::invalid_argument("Dimension is out of range for indexSelect operation.");
-        }
+    friend TensorValue operator-(float scalar, const TensorValue & tensor)
+    {
+        auto promotedDType = promoteDataTypeToFloat(tensor.dataType());
+        return TensorValue{scalar, tensor.shape(), tensor.device(), promotedDType} - tensor;
+    }
 
-        auto newShape = shape();
-        if (!newShape.empty())
-        {
-            newShape[dim] = !indices.shape().empty() ? indices.shape()[0] : 1;
-        }
+    friend TensorValue operator*(float scalar, const TensorValue & tensor)
+    {
+        auto promotedDType = promoteDataTypeToFloat(tensor.dataType());
+        return TensorValue{scalar, tensor.shape(), tensor.device(), promotedDType} * tensor;
+    }
 
-        if (newShape != source.shape())
-        {
-            throw std::invalid_argument("Source shape does not match the tensor's shape.");
-        }
+    friend TensorValue operator/(float scalar, const TensorValue & tensor)
+    {
+        auto promotedDType = promoteDataTypeToFloat(tensor.dataType());
+        return TensorValue{scalar, tensor.shape(), tensor.device(), promotedDType} / tensor;
+    }
 
-        if (dataType() != source.dataType())
+    void fill(float value) const
+    {
+        if (!isContiguous())
         {
-            throw std::invalid_argument("Source data type does not match the tensor's data type.");
+            throw std::invalid_argument("fill() cannot write a view of a tensor.");
         }
+        m_device->fill(&value, DataType::kFloat32, deviceParams());
+        bumpVersion();
+    }
 
-        assert(checkMinMaxValueOverflow(0, (!shape().empty() ? shape()[dim] : 0), indices));
+    TensorValue sum() const
+    {
+        // The whole-tensor kernels read contiguous tensors.
+        auto input = isContiguous() ? shallowCopy() : contiguous();
+        TensorValue result({}, device(), m_dType);
+        m_device->sum(input.deviceParams(), result.deviceParams());
+        return result;
+    }
 
-        if (inPlace)
+    TensorValue sum(ssize_t dim, bool keepDim=false) const
+    {
+        if (m_shape.empty()) return *this;      // Return itself if it's a scalar tensor.
+
+        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
+        if (dim < 0 || dim >= static_cast<ssize_t>(m_shape.size()))
         {
-            device()->indexAdd(source.deviceParams(), deviceParams(), indices.deviceParams(), dim);
-            return *this;
+            throw std::invalid_argument("Dimension parameter of TensorValue::sum() is out of range.");
         }
 
-        TensorValue result(data(), size(), dataType(), shape(), device(), dataType());
-        device()->indexAdd(source.deviceParams(), result.deviceParams(), indices.deviceParams(), dim);
-        return result;
+        Shape resultShape = m_shape;
+        resultShape[dim] = 1;
+        auto result = reduceAxes(ReduceOp::kSum, resultShape);
+        return keepDim ? result : result.squeeze(dim);
     }
 
-    std::vector<TensorValue> split(ssize_t splitSize, ssize_t dim=0) const
+    TensorValue mean() const
     {
-        if (splitSize < 0)
-        {
-            throw std::invalid_argument("Split size must be a positive number.");
-        }
+        return sum() / size();
+    }
 
-        if (m_shape.empty())
-        {
-            throw std::invalid_argument("Split operation needs at least a 1-dim tensor.");
-        }
+    TensorValue mean(ssize_t dim, bool keepDim=false) const
+    {
+        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
+        return sum(dim, keepDim) / shape()[dim];
+    }
 
-        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
-        if (dim < 0)
-        {
-            throw std::invalid_argument("Split dimension is out of range.");
-        }
+    TensorValue sqrt() const
+    {
+        return tensorMathFunc(&Device::sqrt);
+    }
 
-        std::vector<TensorValue> tensors;       // Stores splitted tensors.
-        for (size_t i=0; i<m_shape[dim]; i+=splitSize)
-        {
-            tensors.emplace_back(slice(dim, i, i + splitSize, 1));
-        }
-        return tensors;
+    TensorValue sin() const
+    {
+        return tensorMathFunc(&Device::sin);
     }
 
-    TensorValue tril(ssize_t diagonal=0) const
+    TensorValue cos() const
     {
-        if (m_shape.size() < 2)
-        {
-            throw std::invalid_argument("Tensor must have at least two dimensions for tril operation.");
-        }
+        return tensorMathFunc(&Device::cos);
+    }
 
-        TensorValue result = *this;
-        device()->tril(result.deviceParams(), diagonal);
-        return result;
+    TensorValue tanh() const
+    {
+        return tensorMathFunc(&Device::tanh);
     }
 
-    TensorValue triu(ssize_t diagonal=0) const
+    TensorValue log() const
     {
-        if (m_shape.size() < 2)
-        {
-            throw std::invalid_argument("Tensor must have at least two dimensions for triu operation.");
-        }
+        return tensorMathFunc(&Device::log);
+    }
 
-        TensorValue result = *this;
-        device()->triu(result.deviceParams(), diagonal);
-        return result;
+    TensorValue exp() const
+    {
+        return tensorMathFunc(&Device::exp);
     }
 
-    static TensorValue cat(const std::vector<TensorValue>& tensors, ssize_t dim)
+    // Output variants of the element-wise operations write the result into the given output tensor instead of a new
+    // tensor. The output must be contiguous and have the broadcast shape of the inputs, and it can be one of the
+    // inputs. The inputs are converted to the data type of the output, which is the only case that allocates memory.
+    TensorValue & add(const TensorValue & other, TensorValue & out) const
     {
-        if (tensors.empty())
-        {
-            throw std::invalid_argument("cat() operation needs at least one tensor.");
-        }
+        return arithmeticOpTo(&Device::add, other, out);
+    }
 
-        const auto& tensor = tensors[0];
+    TensorValue & sub(const TensorValue & other, TensorValue & out) const
+    {
+        return arithmeticOpTo(&Device::sub, other, out);
+    }
 
-        if (tensor.shape().empty())
-        {
-            throw std::invalid_argument("Zero-dimensional tensor cannot be concatenated.");
-        }
+    TensorValue & mul(const TensorValue & other, TensorValue & out) const
+    {
+        return arithmeticOpTo(&Device::mul, other, out);
+    }
 
-        if (tensors.size() == 1) return tensor;
+    TensorValue & div(const TensorValue & other, TensorValue & out) const
+    {
+        return arithmeticOpTo(&Device::div, other, out);
+    }
 
-        dim = dim < 0 ? static_cast<ssize_t>(tensor.shape().size()) + dim : dim;
-        if (dim < 0 || dim >= static_cast<ssize_t>(tensor.shape().size()))
-        {
-            throw std::invalid_argument("Dimension is out of range for cat() operation.");
-        }
+    TensorValue & sqrt(TensorValue & out) const     { return tensorMathTo(&Device::sqrt, out); }
+    TensorValue & sin(TensorValue & out) const      { return tensorMathTo(&Device::sin,  out); }
+    TensorValue & cos(TensorValue & out) const      { return tensorMathTo(&Device::cos,  out); }
+    TensorValue & tanh(TensorValue & out) const     { return tensorMathTo(&Device::tanh, out); }
+    TensorValue & log(TensorValue & out) const      { return tensorMathTo(&Device::log,  out); }
+    TensorValue & exp(TensorValue & out) const      { return tensorMathTo(&Device::exp,  out); }
 
-        DataType promotedDType = tensor.dataType();
-        for (size_t i=0; i<tensors.size()-1; ++i)
+    TensorValue pow(const TensorValue & exp) const
+    {
+        if (shape() != exp.shape() || dataType() != exp.dataType())
         {
-            auto shape1 = tensors[i].shape();
-            auto shape2 = tensors[i+1].shape();
-            shape1[dim] = shape2[dim] = 0;      // Neutralize dimension sizes for comparison.
+            auto lhs = shallowCopy();
+            auto rhs = exp.shallowCopy();
+            auto result = prepareTensors(lhs, rhs);
+            result.device()->pow(lhs.deviceParams(), rhs.deviceParams(), result.deviceParams());
+            return result;
+        }
 
-            if (shape1 != shape2)
-            {
-                throw std::invalid_argument("Dimension sizes of tensors must match except in dimension " +
-                                            std::to_string(dim) + " for the cat() operation.");
-            }
-            // Tensor devices must be the same.
-            if (tensors[i].device() != tensors[i+1].device())
-            {
-                throw std::invalid_argument("Tensor devices must be the same for the cat() operation.");
-            }
-            promotedDType = promoteDataType(promotedDType, tensors[i+1].dataType());
-        }
+        // Create a new TensorValue to store the result. Perform element-wise.
+        TensorValue result(m_shape, m_device, m_dType);
+        m_device->pow(deviceParams(), exp.deviceParams(), result.deviceParams());
+        return result;
+    }
 
-        auto newShape = tensor.shape();
-        for (size_t i=1; i<tensors.size(); ++i)
-            newShape[dim] += tensors[i].shape()[dim];
+    TensorValue max() const
+    {
+        // Create a new TensorValue to store the result. Perform element-wise.
+        TensorValue result({}, m_device, m_dType);
+        auto input = isContiguous() ? shallowCopy() : contiguous();
+        m_device->max(input.deviceParams(), result.deviceParams());
+        return result;
+    }
 
-        size_t dimSize = 0;
-        TensorValue result(newShape, tensor.device(), promotedDType);
-        for (size_t i=0; i<tensors.size(); ++i)
+    TensorValue max(ssize_t dim, bool keepDim=false) const
+    {
+        if (m_shape.empty()) return *this;      // Return itself if it's a scalar tensor.
+
+        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
+        if (dim < 0 || dim >= static_cast<ssize_t>(m_shape.size()))
         {
-            result.sliceSet(tensors[i].to(promotedDType), dim, dimSize, dimSize + tensors[i].shape()[dim], 1, true);
-            dimSize += tensors[i].shape()[dim];
+            throw std::invalid_argument("Dimension parameter of TensorValue::max() is out of range.");
         }
+
+        Shape newShape = m_shape;
+        newShape[dim] = 1;
+
+        auto result = reduceAxes(ReduceOp::kMax, newShape);
+        return keepDim ? result : result.squeeze(dim);
+    }
+
+    TensorValue argmax() const
+    {
+        // Create a new TensorValue to store the result. Perform element-wise.
+        TensorValue result({}, m_device, aix::DataType::kInt32);        // Index is by default in int32 type.
+        auto input = isContiguous() ? shallowCopy() : contiguous();
+        m_device->argmax(input.deviceParams(), result.deviceParams());
         return result;
     }
 
-    // Friend function to overload operator<<
-    inline friend std::ostream& operator<<(std::ostream & os, const TensorValue & tensor);
+    TensorValue argmax(ssize_t dim, bool keepDim=false) const
+    {
+        if (m_shape.empty()) return {0, m_shape, m_device, aix::DataType::kInt32};  // Scalar tensor.
 
-private:
-    template<typename T>
-    inline TensorValue arithmeticOpFunc(const T & func, const TensorValue & other) const
+        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
+        if (dim < 0 || dim >= static_cast<ssize_t>(m_shape.size()))
+        {
+            throw std::invalid_argument("Dimension parameter of TensorValue::argmax() is out of range.");
+        }
+
+        Shape newShape = m_shape;
+        newShape[dim] = 1;
+
+        auto result = reduceAxes(ReduceOp::kArgmax, newShape);        // Index is by default in int32 type.
+        return keepDim ? result : result.squeeze(dim);
+    }
+
+    TensorValue argmaxIndices() const
     {
-        if (shape() != other.shape() || dataType() != other.dataType())
+        // Create a new TensorValue to store the result. Perform element-wise.
+        TensorValue result(m_shape, m_device, aix::DataType::kInt32);   // Index is by default in int32 type.
+        auto input = isContiguous() ? shallowCopy() : contiguous();
+        m_device->argmaxIndices(input.deviceParams(), result.deviceParams());
+        return result;
+    }
+
+    TensorValue argmaxIndices(ssize_t dim) const
+    {
+        if (m_shape.empty()) return {1, m_shape, m_device, aix::DataType::kInt32};  // Scalar tensor.
+
+        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
+        if (dim < 0 || dim >= static_cast<ssize_t>(m_shape.size()))
         {
-            TensorValue lhs = *this;
-            TensorValue rhs = other;
-            auto result = prepareTensors(lhs, rhs);
-            (result.device()->*func)(lhs.deviceParams(), rhs.deviceParams(), result.deviceParams());
-            return result;
+            throw std::invalid_argument("Dimension parameter of TensorValue::argmaxIndices() is out of range.");
         }
-        TensorValue result(m_shape, m_device, m_dType);
-        (m_device->*func)(deviceParams(), other.deviceParams(), result.deviceParams());
+
+        TensorValue result(0, m_shape, m_device, aix::DataType::kInt32);        // Index is by default in int32 type.
+        auto input = isContiguous() ? shallowCopy() : contiguous();
+        m_device->argmaxIndicesTo(input.deviceParams(), result.deviceParams(), dim);
         return result;
     }
 
-    template<typename T>
-    inline TensorValue & arithmeticInPlaceOpFunc(const T & func, const TensorValue & other)
+    // Computes a softmax operation along the dimension, see SoftmaxOp. The tensor is the first input, and the other
+    // inputs are converted to its data type. The line seed of the cross-entropy backward has the shape of the loss.
+    TensorValue softmaxOp(SoftmaxOp op, ssize_t dim, std::initializer_list<const TensorValue*> others = {}) const
     {
-        if (shape() != other.shape() || dataType() != other.dataType())
+        // A scalar is a single line of one element.
+        auto rank = static_cast<ssize_t>(m_shape.size());
+        dim = dim < 0 ? std::max<ssize_t>(rank, 1) + dim : dim;
+        if (dim < 0 || dim >= std::max<ssize_t>(rank, 1))
         {
-            TensorValue lhs = *this;
-            TensorValue rhs = other;
-            prepareTensors(lhs, rhs);
-            (m_device->*func)(lhs.deviceParams(), rhs.deviceParams(), lhs.deviceParams());
-            *this = TensorValue(lhs.data(), lhs.size(), lhs.dataType(), lhs.shape(), lhs.device(), dataType());
-            return *this;
+            throw std::invalid_argument("Dimension parameter of TensorValue::softmaxOp() is out of range.");
         }
-        else
+
+        static constexpr size_t inputCounts[] = { 1, 1, 2, 2, 2, 3 };
+        if (others.size() + 1 != inputCounts[static_cast<size_t>(op)])
         {
-            (m_device->*func)(deviceParams(), other.deviceParams(), deviceParams());
+            throw std::invalid_argument("TensorValue::softmaxOp() has a wrong number of inputs.");
         }
-        return *this;
-    }
 
-    template<typename T>
-    inline TensorValue tensorMathFunc(const T & func) const
-    {
-        auto promotedDType = promoteDataTypeToFloat(m_dType);
-        if (dataType() != promotedDType)
+        ReduceShape shape;
+        Shape lineShape = m_shape;
+        if (rank > 0)
         {
-            // This constructor requires copy operation.
-            TensorValue result(data(), m_size, m_dType, m_shape, m_device, promotedDType);
-            (m_device->*func)(result.deviceParams(), result.deviceParams());
-            return result;
+            shape.reduce = m_shape[dim];
+            for (ssize_t i = 0; i < dim; ++i) shape.outer *= m_shape[i];
+            for (ssize_t i = dim + 1; i < rank; ++i) shape.inner *= m_shape[i];
+            lineShape.erase(lineShape.begin() + dim);
         }
-        // This constructor does not require copy operation.
-        TensorValue result(m_shape, m_device, m_dType);
-        (m_device->*func)(deviceParams(), result.deviceParams());
-        return result;
-    }
 
-    // Compute the strides based on the shape of the tensor
-    Stride computeStrides() const
-    {
-        Stride strides(m_shape.size());
-        size_t stride = 1;
-        for (int64_t i = strides.size() - 1; i >= 0; --i)
+        // The kernels read contiguous inputs of the same data type and shape. Inputs of other shapes, which could be
+        // the scalar seeds of the backward pass, are broadcast.
+        auto prepare = [this](const TensorValue & input, const Shape & shape) -> TensorValue
         {
-            strides[i] = stride;
-            stride *= m_shape[i];
+            if (input.shape() != shape && !checkBroadcastShapes(input.shape(), shape))
+            {
+                throw std::invalid_argument("TensorValue::softmaxOp() input shapes do not match.");
+            }
+            auto converted = input.dataType() == m_dType ? input.shallowCopy() : input.to(m_dType);
+            if (converted.shape() != shape) return converted.broadcastTo(shape);
+            if (!converted.isContiguous()) return converted.contiguous();
+            return converted;
+        };
+
+        std::vector<TensorValue> inputs;
+        inputs.reserve(others.size() + 1);
+        inputs.emplace_back(prepare(*this, m_shape));
+        for (auto other : others)
+        {
+            bool isLineSeed = op == SoftmaxOp::kCrossEntropyBackward && inputs.size() == 2;
+            inputs.emplace_back(prepare(*other, isLineSeed ? lineShape : m_shape));
         }
-        return strides;
+
+        std::vector<DeviceTensorParams> params;
+        params.reserve(inputs.size());
+        for (const auto & input : inputs)
+        {
+            params.emplace_back(input.deviceParams());
+        }
+
+        TensorValue result(op == SoftmaxOp::kCrossEntropy ? lineShape : m_shape, m_device, m_dType);
+        m_device->softmax(op, params, result.deviceParams(), shape);
+        return result;
     }
 
-    // Get the flat index from a vector of indices
-    size_t getIndex(const Index & indices) const
+    TensorValue softmax(ssize_t dim) const          { return softmaxOp(SoftmaxOp::kSoftmax, dim);    }
+    TensorValue logSoftmax(ssize_t dim) const       { return softmaxOp(SoftmaxOp::kLogSoftmax, dim); }
+
+    // Returns the cross-entropy loss of the lines of logits along the dimension for the target probabilities.
+    TensorValue crossEntropy(const TensorValue & targets, ssize_t dim) const
     {
-        assert(indices.size() == m_shape.size());
-        return m_offset + std::inner_product(indices.begin(), indices.end(), m_strides.begin(), 0);
+        return softmaxOp(SoftmaxOp::kCrossEntropy, dim, {&targets});
     }
 
-    // Promotes data types and applies broadcasting if necessary.
-    static TensorValue prepareTensors(TensorValue & lhs, TensorValue & rhs)
+    // Matrix multiplication of the last two dimensions. Leading batch dimensions are broadcast. The transpose flags
+    // multiply the transpose of the matrices without materializing them.
+    TensorValue matmul(const TensorValue & b, bool transposeA = false, bool transposeB = false) const
     {
-        // TODO: Minimize copy operations.
-        auto promotedDType = lhs.dataType();
+        auto resultShape = matmulShape(m_shape, transposeA, b.shape(), transposeB);
+        auto promotedDType = promoteDataType(dataType(), b.dataType());
 
-        if (lhs.dataType() != rhs.dataType())
+        TensorValue lhsView, rhsView, lhsTemp, rhsTemp;
+        const auto & lhs = prepareMatmulInput(matmulOperand(*this, transposeA, lhsView), resultShape, promotedDType,
+                                              lhsTemp);
+        const auto & rhs = prepareMatmulInput(matmulOperand(b, transposeB, rhsView), resultShape, promotedDType,
+                                              rhsTemp);
+
+        TensorValue result(resultShape, lhs.device(), lhs.dataType());
+        result.matmulTo(lhs, transposeA, rhs, transposeB);
+        return result;
+    }
+
+    // Stores the matrix multiplication in the given contiguous output tensor, which cannot share the storage of the
+    // inputs. The inputs are converted to the data type of the output.
+    TensorValue & matmul(const TensorValue & b, TensorValue & out) const
+    {
+        auto resultShape = matmulShape(m_shape, false, b.shape(), false);
+        out.validateOutput(resultShape, {this, &b});
+        if (out.m_storage == m_storage || out.m_storage == b.m_storage)
         {
-            // Convert tensors to the promoted data type if necessary
-            promotedDType = promoteDataType(lhs.dataType(), rhs.dataType());
-            lhs = lhs.to(promotedDType);
-            rhs = rhs.to(promotedDType);
+            throw std::invalid_argument("The output tensor of matmul() cannot be one of its inputs.");
         }
 
-        // If shapes are different then try broadcasting.
-        if (lhs.shape() != rhs.shape())
+        bool transposeA = false;
+        bool transposeB = false;
+        TensorValue lhsView, rhsView, lhsTemp, rhsTemp;
+        const auto & lhs = prepareMatmulInput(matmulOperand(*this, transposeA, lhsView), resultShape, out.dataType(),
+                                              lhsTemp);
+        const auto & rhs = prepareMatmulInput(matmulOperand(b, transposeB, rhsView), resultShape, out.dataType(),
+                                              rhsTemp);
+        out.matmulTo(lhs, transposeA, rhs, transposeB);
+        out.bumpVersion();
+        return out;
+    }
+
+    // Multiplies the last dimension with the quantized weights of the layout, see QuantizedLayout. The result has the
+    // data type of this tensor, and its last dimension is the number of outputs.
+    TensorValue matmulQuantized(const TensorValue & weights, const QuantizedLayout & layout) const
+    {
+        if (m_shape.empty() || m_shape.back() != layout.inputs)
         {
-            Shape bcShape = broadcastShapes(lhs.shape(), rhs.shape());
-            lhs = lhs.broadcastTo(bcShape);
-            rhs = rhs.broadcastTo(bcShape);
+            throw std::invalid_argument("The last dimension must match the inputs of the quantized weights.");
+        }
+        if (weights.dataType() != DataType::kUInt8 || weights.shape() != Shape{layout.outputs, layout.rowSize()})
+        {
+            throw std::invalid_argument("Quantized weights do not match the quantization layout.");
+        }
+        if (weights.device() != m_device)
+        {
+            throw std::invalid_argument("Quantized weights must be on the device of the input.");
         }
 
-        return {lhs.shape(), lhs.device(), promotedDType};
+        // Views are copied since the kernels read contiguous rows.
+        TensorValue inputTemp, weightsTemp;
+        if (!isContiguous()) inputTemp = contiguous();
+        if (!weights.isContiguous()) weightsTemp = weights.contiguous();
+        const auto & input = isContiguous() ? *this : inputTemp;
+        const auto & w = weights.isContiguous() ? weights : weightsTemp;
+
+        Shape resultShape = m_shape;
+        resultShape.back() = layout.outputs;
+        TensorValue result(resultShape, m_device, m_dType);
+        m_device->matmulQuantized(input.deviceParams(), w.deviceParams(), layout, result.deviceParams());
+        return result;
     }
 
-    static bool checkMinMaxValueOverflow(float minValue, float maxValue, const aix::TensorValue& tensor)
+    // Returns activation(x * weights + bias) of this [..., inputs] tensor x, the [inputs, outputs] weights and the
+    // bias of the outputs in a single matrix multiplication, see Device::linear(). The inputs are converted to the
+    // data type of this tensor. The values before the activation are stored in preActivation if it is given.
+    TensorValue linear(const TensorValue & weights, const TensorValue & bias, Activation activation,
+                       TensorValue * preActivation = nullptr) const
     {
-        assert(tensor.dataType() == aix::DataType::kInt32);     // Currently supports only int32 data type.
-        tensor.device()->synchronize();
-        for (size_t i=0; i < tensor.size(); ++i)
+        if (weights.shape().size() != 2)
         {
-            if (tensor.data<int32_t>()[i] < minValue) return false;
-            if (tensor.data<int32_t>()[i] > maxValue) return false;
+            throw std::invalid_argument("The weights of linear() must be a matrix.");
         }
-        return true;
+        auto resultShape = matmulShape(m_shape, false, weights.shape(), false);
+        size_t outputs = weights.shape()[1];
+        if (bias.size() != outputs || (!bias.shape().empty() && bias.shape().back() != outputs))
+        {
+            throw std::invalid_argument("The bias of linear() must have the size of the outputs.");
+        }
+
+        // Inputs are only copied if they are views or have to be converted.
+        auto prepare = [this](const TensorValue & input, TensorValue & temp) -> const TensorValue &
+        {
+            if (input.dataType() != m_dType)
+                temp = input.to(m_dType);
+            else if (!input.isContiguous())
+                temp = input.contiguous();
+            else
+                return input;
+            return temp;
+        };
+        TensorValue xTemp, wTemp, bTemp;
+        const auto & w = prepare(weights, wTemp);
+        const auto & b = prepare(bias, bTemp);
+        // The rows of the batch dimensions are multiplied as a single matrix.
+        auto rows = std::accumulate(resultShape.begin(), resultShape.end() - 1, size_t(1), std::multiplies<>());
+        auto x = prepare(*this, xTemp).reshape({rows, m_shape.back()});
+
+        TensorValue result(Shape{rows, outputs}, m_device, m_dType);
+        DeviceTensorParams preActivationParams;
+        if (preActivation)
+        {
+            *preActivation = TensorValue(resultShape, m_device, m_dType);
+            preActivationParams = preActivation->deviceParams();
+        }
+        m_device->linear(x.deviceParams(), w.deviceParams(), b.deviceParams(), activation, preActivationParams,
+                         result.deviceParams());
+        return result.reshape(resultShape);
     }
 
-    static void validateSize(const size_t size, const Shape& shape)
+    // Returns the result shape of a matrix multiplication with broadcast batch dimensions.
+    static Shape matmulShape(const Shape & a, bool transposeA, const Shape & b, bool transposeB)
     {
-        if (size != static_cast<size_t>(std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<>())))
+        if (a.size() < 2 || b.size() < 2)
         {
-            throw std::invalid_argument("Data size does not match the tensor shape.");
+            throw std::invalid_argument("Tensors must have at least two dimensions for matrix multiplication.");
+        }
+
+        size_t rankA = a.size();
+        size_t rankB = b.size();
+        size_t rows  = transposeA ? a[rankA - 1] : a[rankA - 2];
+        size_t inner = transposeA ? a[rankA - 2] : a[rankA - 1];
+        size_t cols  = transposeB ? b[rankB - 2] : b[rankB - 1];
+
+        // Check if the inner dimensions match.
+        if (inner != (transposeB ? b[rankB - 1] : b[rankB - 2]))
+        {
+            throw std::invalid_argument("The inner dimensions of the tensors do not match.");
         }
+
+        auto resultShape = broadcastShapes(Shape(a.begin(), a.end() - 2), Shape(b.begin(), b.end() - 2));
+        resultShape.push_back(rows);
+        resultShape.push_back(cols);
+        return resultShape;
     }
 
-    // Print Tensor data
-    template<typename T>
-    void print(std::ostream & os) const
+    // Generalized transpose function.
+    TensorValue transpose(ssize_t dim0, ssize_t dim1) const
     {
-        os << std::fixed << std::setprecision(4);
+        normalizeTransposeDims(dim0, dim1);
+        Shape newShape = m_shape;
+        std::swap(newShape[dim0], newShape[dim1]);
+        TensorValue result(newShape, device(), m_dType);
+        auto input = isContiguous() ? shallowCopy() : contiguous();     // The kernel reads contiguous tensors.
+        m_device->transpose(input.deviceParams(), result.deviceParams(), dim0, dim1);
+        return result;
+    }
 
-        // Print scalar value, a tensor with no dimension.
-        if (m_shape.empty())
+    // Returns a transposed view that shares the storage. Element-wise operations read the view in place, and matmul
+    // multiplies the transposed view of a contiguous matrix without a copy.
+    TensorValue transposeView(ssize_t dim0, ssize_t dim1) const
+    {
+        normalizeTransposeDims(dim0, dim1);
+        if (dim0 == dim1) return shallowCopy();
+
+        TensorValue result = shallowCopy();
+        std::swap(result.m_shape[dim0], result.m_shape[dim1]);
+        std::swap(result.m_strides[dim0], result.m_strides[dim1]);
+        result.m_isContiguous = false;
+        return result;
+    }
+
+    TensorValue permute(SIndex newDims) const
+    {
+        if (newDims.size() != shape().size())
         {
-            if constexpr (std::is_same_v<T, uint8_t> || std::is_same_v<T, int8_t>)
-                os << static_cast<int>(item<T>()) << "\n\n";
-            else
-                os << item<T>() << "\n\n";
+            throw std::invalid_argument("Dimension count does not match in permute.");
         }
-        else if (m_shape.size() == 1)
+
+        if (shape().empty()) return *this;      // Nothing to do for a scalar tensor.
+        if (shape().size() == 1 && (newDims[0] == 0 || newDims[0] == -1)) return *this;
+
+        auto shapeSize = static_cast<ssize_t>(shape().size());
+        std::vector<ssize_t> dimTable(shapeSize, -1);
+
+        // Check if it's an identity permutation and validate dimensions.
+        bool isIdentity = true;
+        for (ssize_t i = 0; i < shapeSize; ++i)
         {
-            // Print tensor that has only one dimension.
-            for (size_t i = 0; i < m_shape[0]; ++i)
+            auto& dim = newDims[i];
+            dim = dim < 0 ? shapeSize + dim : dim;
+            if (dim < 0 || dim >= shapeSize)
             {
-                if constexpr (std::is_same_v<T, uint8_t> || std::is_same_v<T, int8_t>)
-                    os << "  " << static_cast<int>(getValueAt<T>({i})) << "\n";
-                else
-                    os << "  " << getValueAt<T>({i}) << "\n";
+                throw std::invalid_argument("Dimension is out of range for permute.");
             }
-            os << "\n";
+            if (dimTable[dim] != -1)
+            {
+                throw std::invalid_argument("There is at least one repeated dim in permute.");
+            }
+            dimTable[dim] = i;
+            if (dim != i) isIdentity = false;
         }
-        else
-        {
-            // Print tensor that has at least two dimensions.
-            std::stack<std::pair<Index, size_t>> stack;
-            stack.push({Index(), 0});
 
-            while (!stack.empty())
-            {
-                auto [indices, dim] = stack.top();
-                stack.pop();
+        if (isIdentity) return *this;
 
-                if (dim == m_shape.size() - 2)
-                {
-                    bool isOverTwo = m_shape.size() > 2;
-                    if (isOverTwo)
-                    {
-                        os << "(";
-                    }
+        // Create the new shape.
+        Shape newShape(shapeSize);
+        for (ssize_t i = 0; i < shapeSize; ++i)
+        {
+            newShape[i] = m_shape[newDims[i]];
+        }
 
-                    for (size_t i = 0; i < indices.size(); ++i)
-                    {
-                        os << indices[i];
-                        if (i < indices.size() - 1)
-                        {
-                            os << ",";
-                        }
-                    }
+        TensorValue result(newShape, device(), m_dType);
 
-                    if (isOverTwo)
-                    {
-                        os << ",.,.) =\n";
-                    }
+        // Perform series of transpositions.
+        Shape currShape = m_shape;
+        Stride currStride = m_strides;
+        TensorValue currTensor = *this;
 
-                    size_t rows = m_shape[dim];
-                    size_t cols = m_shape[dim + 1];
+        SIndex currDims(shapeSize);
+        std::iota(currDims.begin(), currDims.end(), 0);     // Initialize to [0, 1, 2, ...]
 
-                    for (size_t i = 0; i < rows; ++i)
-                    {
-                        for (size_t j = 0; j < cols; ++j)
-                        {
-                            Index subIndices = indices;
-                            subIndices.push_back(i);
-                            subIndices.push_back(j);
-                            if constexpr (std::is_same_v<T, uint8_t> || std::is_same_v<T, int8_t>)
-                                os << "  " << static_cast<int>(getValueAt<T>(subIndices));
-                            else
-                                os << "  " << getValueAt<T>(subIndices);
-                        }
-                        os << '\n';
-                    }
+        for (ssize_t i=0; i<shapeSize; ++i)
+        {
+            if (currDims[i] == newDims[i]) continue;
 
-                    os << '\n';
-                }
-                else
-                {
-                    for (size_t i = m_shape[dim]; i-- > 0;) // Process in reverse order
-                    {
-                        Index subIndices = indices;
-                        subIndices.push_back(i);
-                        stack.push({subIndices, dim + 1});
-                    }
-                }
-            }
+            // Find the position of newDims[i] in currentDims.
+            auto it = std::find(currDims.begin() + i, currDims.end(), newDims[i]);
+            size_t j = std::distance(currDims.begin(), it);
+
+            // Swap dimensions i and j.
+            std::swap(currDims[i], currDims[j]);
+            std::swap(currShape[i], currShape[j]);
+
+            // Perform the transpose.
+            TensorValue tempTensor(currShape, m_device, m_dType);
+            m_device->transpose(currTensor.deviceParams(), tempTensor.deviceParams(), j, i);
+            currTensor = std::move(tempTensor);
+            currStride = currTensor.strides();
         }
 
-        auto deviceName = device()->name();
-        // Print shape
-        switch (dataType())
+        return currTensor;
+    }
+
+    TensorValue squeeze(ssize_t dim) const
+    {
+        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
+        if (dim >= static_cast<ssize_t>(m_shape.size()))
         {
-            case DataType::kFloat64:  os << "[ " << deviceName << " Float64 {";  break;
-            case DataType::kFloat32:  os << "[ " << deviceName << " Float32 {";  break;
-            case DataType::kFloat16:  os << "[ " << deviceName << " Float16 {";  break;
-            case DataType::kBFloat16: os << "[ " << deviceName << " BFloat16 {"; break;
-            case DataType::kInt64:    os << "[ " << deviceName << " Int64 {";    break;
-            case DataType::kInt32:    os << "[ " << deviceName << " Int32 {";    break;
-            case DataType::kInt16:    os << "[ " << deviceName << " Int16 {";    break;
-            case DataType::kInt8:     os << "[ " << deviceName << " Int8 {";     break;
-            case DataType::kUInt8:    os << "[ " << deviceName << " UInt8 {";    break;
-            default:                  os << "[ " << deviceName << " Unknown {";  break;
+            throw std::invalid_argument("Invalid dimension for squeeze.");
         }
 
-        for (size_t i = 0; i < m_shape.size(); ++i)
+        if (m_shape[dim] == 1)
         {
-            os << m_shape[i];
-            if (i < m_shape.size() - 1)
-            {
-                os << ",";
-            }
+            auto squeezedShape = m_shape;
+            squeezedShape.erase(squeezedShape.begin() + dim);
+            return reshape(squeezedShape);
         }
-        os << "} ]\n";
+        return *this;
     }
 
-private:
-    bool      m_isContiguous{true};
-    DataType  m_dType{DataType::kFloat32};
-    size_t    m_size{0};        // Number of elements in DataType.
-    Shape     m_shape;          // The shape of the tensor.
-    Stride    m_strides;        // The strides for indexing the tensor.
-    size_t    m_offset{0};      // Start offset of data on storage.
-    Device *  m_device{nullptr};
-    std::shared_ptr<TensorStorage>  m_storage;      // The flat array of tensor elements.
-};
-
-
-class TensorNode
-{
-public:
-    // Constructor
-    explicit TensorNode(TensorValue value, bool requireGrad = false) :
-        m_value{std::move(value)}, m_requireGrad{requireGrad}
+    TensorValue unsqueeze(ssize_t dim) const
     {
+        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
+        if (dim > static_cast<ssize_t>(m_shape.size()))
+        {
+            throw std::invalid_argument("Invalid dimension for unsqueeze.");
+        }
+
+        auto unsqueezedShape = m_shape;
+        unsqueezedShape.insert(unsqueezedShape.begin() + dim, 1);
+        return reshape(unsqueezedShape);
     }
 
-    // Constructor
-    explicit TensorNode(const Shape & shape, Device * device, bool requireGrad = false, DataType dType = DataType::kFloat32) :
-        m_value{shape, device, dType}, m_requireGrad{requireGrad}
+    TensorValue slice(ssize_t dim=0, std::optional<ssize_t> startOpt = std::nullopt,
+                      std::optional<ssize_t> endOpt = std::nullopt, ssize_t step=1) const
     {
+        return sliceView(dim, startOpt, endOpt, step).contiguous();
     }
 
-    // Perform backpropagation to calculate gradients recursively.
-    void backward(const TensorValue & seed)
+    // Returns a view of the slice that shares the storage of this tensor.
+    TensorValue sliceView(ssize_t dim=0, std::optional<ssize_t> startOpt = std::nullopt,
+                          std::optional<ssize_t> endOpt = std::nullopt, ssize_t step=1) const
     {
-        if (m_retainGrad)
+        if (m_shape.empty())
         {
-            grad() += seed;
+            throw std::invalid_argument("slice() cannot be applied to a 0-dim, a scalar tensor.");
         }
-        m_backwardFunc(this, seed);
-    }
 
-    TensorValue& grad()
-    {
-        if (m_grad.size() == 0)
+        if (step < 1)
         {
-            m_grad = TensorValue{m_value.shape(), m_value.device(), m_value.size(), m_value.strides(), m_value.dataType()};
+            throw std::invalid_argument("Slice step must be greater than zero.");
         }
-        return m_grad;
-    }
 
-    Device * device() const          { return m_value.device(); }
+        // Normalize dimension index.
+        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
+        if (dim < 0 || dim >= static_cast<ssize_t>(m_shape.size()))
+        {
+            throw std::invalid_argument("Dimension parameter of slice() is out of range.");
+        }
 
-    std::string  m_name;
-    TensorValue  m_value;
-    bool  m_requireGrad;
-    bool  m_retainGrad{false};
-    std::shared_ptr<TensorNode>  m_a{nullptr};
-    std::shared_ptr<TensorNode>  m_b{nullptr};
-    SIndex m_dims;
-    size_t m_dim0{0};
-    size_t m_dim1{0};
-    bool m_keepDim{false};
-    TensorValue  m_indices;
-    std::optional<ssize_t> m_start;
-    std::optional<ssize_t> m_end;
-    std::vector<std::shared_ptr<TensorNode>> m_aMulti;
-    std::function<void(TensorNode * tensor, const TensorValue & seed)>  m_backwardFunc{nullptr};
+        // Handle start and end indices.
+        ssize_t start = startOpt.value_or(0);
+        ssize_t end   = endOpt.value_or(static_cast<ssize_t>(m_shape[dim]));
 
-private:
-    TensorValue  m_grad;
-};
+        // Normalize negative indices.
+        start = start < 0 ? static_cast<ssize_t>(m_shape[dim]) + start : start;
+        end   = end   < 0 ? static_cast<ssize_t>(m_shape[dim]) + end   : end;
 
+        // Clamp the start and end indices within valid bounds.
+        start = std::max<ssize_t>(0, std::min<ssize_t>(start, static_cast<ssize_t>(m_shape[dim])));
+        end   = std::max<ssize_t>(0, std::min<ssize_t>(end,   static_cast<ssize_t>(m_shape[dim])));
 
-struct TensorOptions
-{
-    inline TensorOptions requireGrad(bool state)    { m_requireGrad = state; return *this; }
-    inline TensorOptions dtype(DataType dataType)   { m_dtype = dataType;    return *this; }
-    inline TensorOptions device(Device* device)     { m_device = device;     return *this; }
-    inline TensorOptions device(std::unique_ptr<aix::Device>& device)  { m_device = device.get(); return *this; }
-    inline TensorOptions device(std::shared_ptr<aix::Device>& device)  { m_device = device.get(); return *this; }
+        if (start >= end)
+        {
+            throw std::invalid_argument("Start index of slice() must be less than end index.");
+        }
 
-    bool m_requireGrad{false};
-    aix::DataType m_dtype{aix::DataType::kFloat32};
-    aix::Device* m_device{&aix::defaultDevice};
-};
-inline TensorOptions requireGrad(bool state)    { return { .m_requireGrad=state }; }
-inline TensorOptions dtype(DataType dataType)   { return { .m_dtype=dataType    }; }
-inline TensorOptions device(Device* device)     { return { .m_device=device     }; }
-inline TensorOptions device(std::unique_ptr<aix::Device>& device)     { return { .m_device = device.get() }; }
-inline TensorOptions device(std::shared_ptr<aix::Device>& device)     { return { .m_device = device.get() }; }
+        // Compute new size along the sliced dimension.
+        size_t newSizeInDim = (end - start + step - 1) / step;
 
+        // Compute new offset.
+        size_t newOffset = m_offset + start * m_strides[dim];
 
-class Tensor
-{
-public:
-    // Constructor.
-    Tensor() = default;
+        // Compute new strides.
+        auto newStrides = m_strides;
+        newStrides[dim] *= step;
+
+        // Compute new shape.
+        auto newShape = m_shape;
+        newShape[dim] = newSizeInDim;
+
+        auto newSize = std::accumulate(newShape.begin(), newShape.end(), 1, std::multiplies<>());
+
+        TensorValue result(m_storage, newSize, newOffset, newShape, device(), dataType());
+        result.m_strides = newStrides;
+        result.m_isContiguous = false;
+        return result;
+    }
+
+    TensorValue sliceSet(const TensorValue& tensor, ssize_t dim=0, std::optional<ssize_t> startOpt = std::nullopt,
+                         std::optional<ssize_t> endOpt = std::nullopt, ssize_t step=1, bool inPlace=false) const
+    {
+        if (m_shape.empty())
+        {
+            throw std::invalid_argument("slice() cannot be applied to a 0-dim, a scalar tensor.");
+        }
+
+        if (step < 1)
+        {
+            throw std::invalid_argument("Slice step must be greater than zero.");
+        }
+
+        // Normalize dimension index.
+        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
+        if (dim < 0 || dim >= static_cast<ssize_t>(m_shape.size()))
+        {
+            throw std::invalid_argument("Dimension parameter of slice() is out of range.");
+        }
+
+        // Handle start and end indices.
+        ssize_t start = startOpt.value_or(0);
+        ssize_t end   = endOpt.value_or(static_cast<ssize_t>(m_shape[dim]));
+
+        // Normalize negative indices.
+        start = start < 0 ? static_cast<ssize_t>(m_shape[dim]) + start : start;
+        end   = end   < 0 ? static_cast<ssize_t>(m_shape[dim]) + end   : end;
+
+        // Clamp the start and end indices within valid bounds.
+        start = std::max<ssize_t>(0, std::min<ssize_t>(start, static_cast<ssize_t>(m_shape[dim])));
+        end   = std::max<ssize_t>(0, std::min<ssize_t>(end,   static_cast<ssize_t>(m_shape[dim])));
+
+        if (start >= end)
+        {
+            throw std::invalid_argument("Start index of slice() must be less than end index.");
+        }
+
+        // Calculate the new shape for the sliced tensor.
+        Shape newShape = m_shape;
+        newShape[dim] = (end - start + step - 1) / step; // This computes the size along the slicing dimension.
+
+        if (tensor.shape() != newShape)
+        {
+            throw std::invalid_argument("The tensor's shape does not match the new shape of sliceSet().");
+        }
+
+        // The kernel reads and writes contiguous tensors.
+        auto source = tensor.isContiguous() ? tensor.shallowCopy() : tensor.contiguous();
+        if (inPlace)
+        {
+            if (!isContiguous())
+            {
+                throw std::invalid_argument("In-place sliceSet() cannot write a view of a tensor.");
+            }
+            // Slice and set tensor's data to the result tensor.
+            device()->sliceSet(source.deviceParams(), deviceParams(), dim, start, end, step);
+            bumpVersion();
+            return shallowCopy();
+        }
+
+        TensorValue result(0, m_shape, device(), m_dType);  // Zero initialization is required.
+        // Slice and set tensor's data to the result tensor.
+        device()->sliceSet(source.deviceParams(), result.deviceParams(), dim, start, end, step);
+        return result;
+    }
+
+    TensorValue select(ssize_t dim, ssize_t index) const
+    {
+        if (m_shape.empty())
+        {
+            throw std::invalid_argument("select() cannot be applied to a scalar, zero-dimension, tensor.");
+        }
+        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
+        index = index < 0 ? static_cast<ssize_t>(m_shape[dim]) + index : index;
+        return slice(dim, index, index + 1, 1).squeeze(dim);
+    }
+
+    TensorValue indexSelect(ssize_t dim, const TensorValue& indices) const
+    {
+        if (indices.shape().size() > 1)
+        {
+            throw std::invalid_argument("Indices supposed to be a vector.");
+        }
+        if (indices.dataType() != aix::DataType::kInt32)
+        {
+            throw std::invalid_argument("Indices tensor's data type must be int32");
+        }
+
+        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
+
+        if ((!shape().empty() && (dim < 0 || static_cast<size_t>(dim) >= shape().size())) ||
+            (shape().empty() && dim != 0))
+        {
+            throw std::invalid_argument("Dimension is out of range for indexSelect operation.");
+        }
+
+        auto newShape = shape();
+        if (!newShape.empty())
+        {
+            newShape[dim] = !indices.shape().empty() ? indices.shape()[0] : 1;
+        }
+
+        assert(checkMinMaxValueOverflow(0, (!shape().empty() ? shape()[dim] : 0), indices));
+
+        // The kernel reads contiguous tensors.
+        auto input = isContiguous() ? shallowCopy() : contiguous();
+        auto inputIndices = indices.isContiguous() ? indices.shallowCopy() : indices.contiguous();
+        TensorValue result(newShape, device(), dataType());
+        device()->indexSelect(input.deviceParams(), result.deviceParams(), inputIndices.deviceParams(), dim);
+        return result;
+    }
+
+    TensorValue indexAdd(ssize_t dim, const TensorValue& indices, const TensorValue& source, bool inPlace=false) const
+    {
+        if (indices.shape().size() > 1)
+        {
+            throw std::invalid_argument("Indices supposed to be a vector.");
+        }
+        if (indices.dataType() != aix::DataType::kInt32)
+        {
+            throw std::invalid_argument("Indices tensor's data type must be int32");
+        }
+
+        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
+
+        if ((!shape().empty() && (dim < 0 || static_cast<size_t>(dim) >= shape().size())) ||
+            (shape().empty() && dim != 0))
+        {
+            throw std::invalid_argument("Dimension is out of range for indexSelect operation.");
+        }
+
+        auto newShape = shape();
+        if (!newShape.empty())
+        {
+            newShape[dim] = !indices.shape().empty() ? indices.shape()[0] : 1;
+        }
+
+        if (newShape != source.shape())
+        {
+            throw std::invalid_argument("Source shape does not match the tensor's shape.");
+        }
+
+        if (dataType() != source.dataType())
+        {
+            throw std::invalid_argument("Source data type does not match the tensor's data type.");
+        }
+
+        assert(checkMinMaxValueOverflow(0, (!shape().empty() ? shape()[dim] : 0), indices));
+
+        // The kernel reads and writes contiguous tensors.
+        auto input = source.isContiguous() ? source.shallowCopy() : source.contiguous();
+        auto inputIndices = indices.isContiguous() ? indices.shallowCopy() : indices.contiguous();
+        if (inPlace)
+        {
+            if (!isContiguous())
+            {
+                throw std::invalid_argument("In-place indexAdd() cannot write a view of a tensor.");
+            }
+            device()->indexAdd(input.deviceParams(), deviceParams(), inputIndices.deviceParams(), dim);
+            bumpVersion();
+            return *this;
+        }
+
+        TensorValue result = contiguous();      // A copy of the tensor.
+        device()->indexAdd(input.deviceParams(), result.deviceParams(), inputIndices.deviceParams(), dim);
+        return result;
+    }
+
+    std::vector<TensorValue> split(ssize_t splitSize, ssize_t dim=0) const
+    {
+        if (splitSize < 0)
+        {
+            throw std::invalid_argument("Split size must be a positive number.");
+        }
+
+        if (m_shape.empty())
+        {
+            throw std::invalid_argument("Split operation needs at least a 1-dim tensor.");
+        }
+
+        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
+        if (dim < 0 || dim >= static_cast<ssize_t>(m_shape.size()))
+        {
+            throw std::invalid_argument("Split dimension is out of range.");
+        }
+
+        std::vector<TensorValue> tensors;       // Stores splitted tensors.
+        for (size_t i=0; i<m_shape[dim]; i+=splitSize)
+        {
+            tensors.emplace_back(slice(dim, i, i + splitSize, 1));
+        }
+        return tensors;
+    }
+
+    // Copies the tensors of split() to the given contiguous output tensors.
+    void split(ssize_t splitSize, ssize_t dim, std::vector<TensorValue> & outs) const
+    {
+        if (splitSize < 1)
+        {
+            throw std::invalid_argument("Split size must be a positive number.");
+        }
+        if (m_shape.empty())
+        {
+            throw std::invalid_argument("Split operation needs at least a 1-dim tensor.");
+        }
+        dim = dim < 0 ? static_cast<ssize_t>(m_shape.size()) + dim : dim;
+        if (dim < 0 || dim >= static_cast<ssize_t>(m_shape.size()))
+        {
+            throw std::invalid_argument("Split dimension is out of range.");
+        }
+        auto size = static_cast<size_t>(splitSize);
+        if (outs.size() != (m_shape[dim] + size - 1) / size)
+        {
+            throw std::invalid_argument("The number of output tensors does not match the number of split tensors.");
+        }
+
+        for (size_t i=0; i<outs.size(); ++i)
+        {
+            sliceView(dim, i * size, (i + 1) * size, 1).contiguous(outs[i]);
+        }
+    }
+
+    TensorValue tril(ssize_t diagonal=0) const
+    {
+        if (m_shape.size() < 2)
+        {
+            throw std::invalid_argument("Tensor must have at least two dimensions for tril operation.");
+        }
+
+        TensorValue result = *this;
+        device()->tril(result.deviceParams(), diagonal);
+        return result;
+    }
+
+    TensorValue triu(ssize_t diagonal=0) const
+    {
+        if (m_shape.size() < 2)
+        {
+            throw std::invalid_argument("Tensor must have at least two dimensions for triu operation.");
+        }
+
+        TensorValue result = *this;
+        device()->triu(result.deviceParams(), diagonal);
+        return result;
+    }
+
+    static TensorValue cat(const std::vector<TensorValue>& tensors, ssize_t dim)
+    {
+        DataType promotedDType;
+        auto newShape = catShape(tensors, dim, promotedDType);
+        if (tensors.size() == 1) return tensors[0];
+
+        TensorValue result(newShape, tensors[0].device(), promotedDType);
+        result.catTo(tensors, dim);
+        return result;
+    }
+
+    // Concatenates the tensors into the given contiguous output tensor. The inputs are converted to the data type of
+    // the output.
+    static TensorValue & cat(const std::vector<TensorValue>& tensors, ssize_t dim, TensorValue & out)
+    {
+        DataType promotedDType;
+        auto newShape = catShape(tensors, dim, promotedDType);
+        out.validateOutput(newShape, {&tensors[0]});
+        out.catTo(tensors, dim);
+        out.bumpVersion();
+        return out;
+    }
+
+    // Friend function to overload operator<<
+    inline friend std::ostream& operator<<(std::ostream & os, const TensorValue & tensor);
+
+private:
+    // Validates the tensors of a cat() operation and returns the shape and the data type of the result. The dimension
+    // is normalized.
+    static Shape catShape(const std::vector<TensorValue>& tensors, ssize_t & dim, DataType & promotedDType)
+    {
+        if (tensors.empty())
+        {
+            throw std::invalid_argument("cat() operation needs at least one tensor.");
+        }
+
+        const auto& tensor = tensors[0];
+
+        if (tensor.shape().empty())
+        {
+            throw std::invalid_argument("Zero-dimensional tensor cannot be concatenated.");
+        }
+
+        dim = dim < 0 ? static_cast<ssize_t>(tensor.shape().size()) + dim : dim;
+        if (dim < 0 || dim >= static_cast<ssize_t>(tensor.shape().size()))
+        {
+            throw std::invalid_argument("Dimension is out of range for cat() operation.");
+        }
+
+        promotedDType = tensor.dataType();
+        for (size_t i=0; i<tensors.size()-1; ++i)
+        {
+            auto shape1 = tensors[i].shape();
+            auto shape2 = tensors[i+1].shape();
+            shape1[dim] = shape2[dim] = 0;      // Neutralize dimension sizes for comparison.
+
+            if (shape1 != shape2)
+            {
+                throw std::invalid_argument("Dimension sizes of tensors must match except in dimension " +
+                                            std::to_string(dim) + " for the cat() operation.");
+            }
+            // Tensor devices must be the same.
+            if (tensors[i].device() != tensors[i+1].device())
+            {
+                throw std::invalid_argument("Tensor devices must be the same for the cat() operation.");
+            }
+            promotedDType = promoteDataType(promotedDType, tensors[i+1].dataType());
+        }
+
+        auto newShape = tensor.shape();
+        for (size_t i=1; i<tensors.size(); ++i)
+            newShape[dim] += tensors[i].shape()[dim];
+        return newShape;
+    }
+
+    // Copies the tensors to their slices of this tensor. The slice kernel reads contiguous inputs, so an input is only
+    // copied if it has another data type or layout.
+    void catTo(const std::vector<TensorValue>& tensors, size_t dim) const
+    {
+        size_t dimSize = 0;
+        for (const auto & tensor : tensors)
+        {
+            TensorValue converted;
+            if (tensor.dataType() != m_dType)
+                converted = tensor.to(m_dType);
+            else if (!tensor.isContiguous())
+                converted = tensor.contiguous();
+            const auto & input = converted.m_storage ? converted : tensor;
+            auto end = dimSize + tensor.shape()[dim];
+            m_device->sliceSet(input.deviceParams(), deviceParams(), dim, dimSize, end, 1);
+            dimSize = end;
+        }
+    }
+
+    // Returns a contiguous operand of a matrix multiplication. The transposed view of the last two dimensions of a
+    // contiguous tensor is replaced by that tensor and the transpose flag is toggled. Other views are copied.
+    static const TensorValue & matmulOperand(const TensorValue & input, bool & transpose, TensorValue & temp)
+    {
+        if (input.isContiguous()) return input;
+
+        size_t rank = input.shape().size();
+        if (rank >= 2 && input.m_offset == 0)
+        {
+            temp = input.shallowCopy();
+            std::swap(temp.m_shape[rank - 2], temp.m_shape[rank - 1]);
+            std::swap(temp.m_strides[rank - 2], temp.m_strides[rank - 1]);
+            if (temp.m_strides == temp.computeStrides())
+            {
+                temp.m_isContiguous = true;
+                transpose = !transpose;
+                return temp;
+            }
+        }
+        temp = input.contiguous();
+        return temp;
+    }
+
+    // A batched input must either match the batch dimensions of the result or hold a single matrix. Inputs are only
+    // copied if they have to be broadcast or converted to the data type of the result.
+    static const TensorValue & prepareMatmulInput(const TensorValue & input, const Shape & resultShape,
+                                                  DataType dtype, TensorValue & temp)
+    {
+        Shape batchShape(resultShape.begin(), resultShape.end() - 2);
+        Shape inputBatchShape(input.shape().begin(), input.shape().end() - 2);
+        auto batchCount = std::accumulate(inputBatchShape.begin(), inputBatchShape.end(), size_t(1),
+                                          std::multiplies<>());
+        const TensorValue * prepared = &input;
+        if (batchCount != 1 && inputBatchShape != batchShape)
+        {
+            Shape newShape = batchShape;
+            newShape.insert(newShape.end(), input.shape().end() - 2, input.shape().end());
+            temp = input.broadcastTo(newShape);
+            prepared = &temp;
+        }
+        if (prepared->dataType() != dtype)
+        {
+            temp = prepared->to(dtype);
+            prepared = &temp;
+        }
+        return *prepared;
+    }
+
+    // Stores the multiplication of the given tensors, which have the same data type as this tensor.
+    void matmulTo(const TensorValue & a, bool transposeA, const TensorValue & b, bool transposeB)
+    {
+        if (transposeA || transposeB)
+        {
+            m_device->matmulTransposed(a.deviceParams(), transposeA, b.deviceParams(), transposeB, deviceParams());
+            return;
+        }
+        m_device->matmul(a.deviceParams(), b.deviceParams(), deviceParams());
+    }
+
+    template<typename T>
+    inline TensorValue arithmeticOpFunc(const T & func, const TensorValue & other) const
+    {
+        if (shape() != other.shape() || dataType() != other.dataType())
+        {
+            auto lhs = shallowCopy();
+            auto rhs = other.shallowCopy();
+            auto result = prepareTensors(lhs, rhs);
+            (result.device()->*func)(lhs.deviceParams(), rhs.deviceParams(), result.deviceParams());
+            return result;
+        }
+        TensorValue result(m_shape, m_device, m_dType);
+        (m_device->*func)(deviceParams(), other.deviceParams(), result.deviceParams());
+        return result;
+    }
+
+    template<typename T>
+    inline TensorValue & arithmeticInPlaceOpFunc(const T & func, const TensorValue & other)
+    {
+        if (shape() != other.shape() || dataType() != other.dataType())
+        {
+            auto lhs = shallowCopy();
+            auto rhs = other.shallowCopy();
+            auto result = prepareTensors(lhs, rhs);
+            (m_device->*func)(lhs.deviceParams(), rhs.deviceParams(), result.deviceParams());
+            *this = result.to(dataType());
+            return *this;
+        }
+        else if (!isContiguous())
+        {
+            // The result of an element-wise operation must be contiguous.
+            *this = arithmeticOpFunc(func, other);
+        }
+        else
+        {
+            (m_device->*func)(deviceParams(), other.deviceParams(), deviceParams());
+            bumpVersion();
+        }
+        return *this;
+    }
+
+    template<typename T>
+    inline TensorValue tensorMathFunc(const T & func) const
+    {
+        auto promotedDType = promoteDataTypeToFloat(m_dType);
+        if (dataType() != promotedDType)
+        {
+            // The conversion requires copy operation.
+            auto result = to(promotedDType);
+            (m_device->*func)(result.deviceParams(), result.deviceParams());
+            return result;
+        }
+        // This constructor does not require copy operation.
+        TensorValue result(m_shape, m_device, m_dType);
+        (m_device->*func)(deviceParams(), result.deviceParams());
+        return result;
+    }
+
+    template<typename T>
+    inline TensorValue & arithmeticOpTo(const T & func, const TensorValue & other, TensorValue & out) const
+    {
+        auto resultShape = shape() == other.shape() ? shape() : broadcastShapes(shape(), other.shape());
+        out.validateOutput(resultShape, {this, &other});
+        auto lhs = outputInput(*this, out);
+        auto rhs = outputInput(other, out);
+        (m_device->*func)(lhs.deviceParams(), rhs.deviceParams(), out.deviceParams());
+        out.bumpVersion();
+        return out;
+    }
+
+    template<typename T>
+    inline TensorValue & tensorMathTo(const T & func, TensorValue & out) const
+    {
+        out.validateOutput(m_shape, {this});
+        // The math kernels read strided views in place.
+        auto input = outputInput(*this, out);
+        (m_device->*func)(input.deviceParams(), out.deviceParams());
+        out.bumpVersion();
+        return out;
+    }
+
+    // Validates this tensor as the output of an operation that writes into an existing tensor.
+    void validateOutput(const Shape & resultShape, std::initializer_list<const TensorValue*> inputs) const
+    {
+        if (!m_storage || !isContiguous() || m_offset != 0)
+        {
+            throw std::invalid_argument("The output tensor must be a contiguous tensor that has storage.");
+        }
+        if (m_shape != resultShape)
+        {
+            throw std::invalid_argument("The output tensor shape does not match the shape of the result.");
+        }
+        for (auto input : inputs)
+        {
+            if (input->device() != m_device)
+            {
+                throw std::invalid_argument("The output tensor must be on the device of the inputs.");
+            }
+        }
+    }
+
+    // Returns a view of the input in the shape and the data type of the output. Only a data type conversion copies.
+    static TensorValue outputInput(const TensorValue & input, const TensorValue & out)
+    {
+        auto converted = input.dataType() == out.dataType() ? input.shallowCopy() : input.to(out.dataType());
+        return converted.broadcastView(out.shape());
+    }
+
+    // Returns a tensor that shares the storage and the layout of this tensor.
+    TensorValue shallowCopy() const
+    {
+        TensorValue result(m_storage, m_size, m_offset, m_shape, m_device, m_dType);
+        result.m_strides = m_strides;
+        result.m_isContiguous = m_isContiguous;
+        return result;
+    }
+
+    // Makes a deep copy of the given tensor. The copy of a view is contiguous.
+    void copyFrom(const TensorValue& other)
+    {
+        m_dType   = other.m_dType;
+        m_size    = other.m_size;
+        m_shape   = other.m_shape;
+        m_device  = other.m_device;
+        m_offset  = 0;
+        m_isContiguous = true;
+        m_storage = std::make_shared<TensorStorage>(m_device, other.m_size, other.m_dType,
+                                                    StorageResidency::kDevicePrivate);
+        if (other.isContiguous())
+        {
+            m_strides = other.m_strides;
+            m_device->copy(other.deviceData(), other.m_dType, deviceData(), other.m_dType, other.m_size);
+            return;
+        }
+        m_strides = computeStrides();
+        m_device->contiguous(other.deviceParams(), deviceParams());
+    }
+
+    // Compute the strides based on the shape of the tensor
+    // Converts negative transpose dimensions to positive ones and validates them.
+    void normalizeTransposeDims(ssize_t & dim0, ssize_t & dim1) const
+    {
+        auto shapeSize = static_cast<ssize_t>(shape().size());
+        dim0 = dim0 < 0 ? shapeSize + dim0 : dim0;
+        dim1 = dim1 < 0 ? shapeSize + dim1 : dim1;
+
+        // Check dimensions
+        if (dim0 < 0 || dim0 >= shapeSize || dim1 < 0 || dim1 >= shapeSize)
+        {
+            throw std::invalid_argument("Dimension is out of range for transpose.");
+        }
+    }
+
+    Stride computeStrides() const
+    {
+        Stride strides(m_shape.size());
+        size_t stride = 1;
+        for (int64_t i = strides.size() - 1; i >= 0; --i)
+        {
+            strides[i] = stride;
+            stride *= m_shape[i];
+        }
+        return strides;
+    }
+
+    // Get the flat index from a vector of indices
+    size_t getIndex(const Index & indices) const
+    {
+        assert(indices.size() == m_shape.size());
+        return m_offset + std::inner_product(indices.begin(), indices.end(), m_strides.begin(), 0);
+    }
+
+    // Promotes data types and applies broadcasting if necessary.
+    static TensorValue prepareTensors(TensorValue & lhs, TensorValue & rhs)
+    {
+        auto promotedDType = lhs.dataType();
+
+        if (lhs.dataType() != rhs.dataType())
+        {
+            // Convert tensors to the promoted data type if necessary
+            promotedDType = promoteDataType(lhs.dataType(), rhs.dataType());
+            lhs = lhs.to(promotedDType);
+            rhs = rhs.to(promotedDType);
+        }
+
+        // If shapes are different then try broadcasting. Element-wise operations read the views without a copy.
+        if (lhs.shape() != rhs.shape())
+        {
+            Shape bcShape = broadcastShapes(lhs.shape(), rhs.shape());
+            lhs = lhs.broadcastView(bcShape);
+            rhs = rhs.broadcastView(bcShape);
+        }
+
+        return {lhs.shape(), lhs.device(), promotedDType};
+    }
+
+    static bool checkMinMaxValueOverflow(float minValue, float maxValue, const aix::TensorValue& tensor)
+    {
+        assert(tensor.dataType() == aix::DataType::kInt32);     // Currently supports only int32 data type.
+        tensor.device()->synchronize();
+        for (size_t i=0; i < tensor.size(); ++i)
+        {
+            if (tensor.data<int32_t>()[i] < minValue) return false;
+            if (tensor.data<int32_t>()[i] > maxValue) return false;
+        }
+        return true;
+    }
+
+    static void validateSize(const size_t size, const Shape& shape)
+    {
+        if (size != static_cast<size_t>(std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<>())))
+        {
+            throw std::invalid_argument("Data size does not match the tensor shape.");
+        }
+    }
+
+    // Print Tensor data
+    template<typename T>
+    void print(std::ostream & os) const
+    {
+        os << std::fixed << std::setprecision(4);
+
+        // Print scalar value, a tensor with no dimension.
+        if (m_shape.empty())
+        {
+            if constexpr (std::is_same_v<T, uint8_t> || std::is_same_v<T, int8_t>)
+                os << static_cast<int>(item<T>()) << "\n\n";
+            else
+                os << item<T>() << "\n\n";
+        }
+        else if (m_shape.size() == 1)
+        {
+            // Print tensor that has only one dimension.
+            for (size_t i = 0; i < m_shape[0]; ++i)
+            {
+                if constexpr (std::is_same_v<T, uint8_t> || std::is_same_v<T, int8_t>)
+                    os << "  " << static_cast<int>(getValueAt<T>({i})) << "\n";
+                else
+                    os << "  " << getValueAt<T>({i}) << "\n";
+            }
+            os << "\n";
+        }
+        else
+        {
+            // Print tensor that has at least two dimensions.
+            std::stack<std::pair<Index, size_t>> stack;
+            stack.push({Index(), 0});
+
+            while (!stack.empty())
+            {
+                auto [indices, dim] = stack.top();
+                stack.pop();
+
+                if (dim == m_shape.size() - 2)
+                {
+                    bool isOverTwo = m_shape.size() > 2;
+                    if (isOverTwo)
+                    {
+                        os << "(";
+                    }
+
+                    for (size_t i = 0; i < indices.size(); ++i)
+                    {
+                        os << indices[i];
+                        if (i < indices.size() - 1)
+                        {
+                            os << ",";
+                        }
+                    }
+
+                    if (isOverTwo)
+                    {
+                        os << ",.,.) =\n";
+                    }
+
+                    size_t rows = m_shape[dim];
+                    size_t cols = m_shape[dim + 1];
+
+                    for (size_t i = 0; i < rows; ++i)
+                    {
+                        for (size_t j = 0; j < cols; ++j)
+                        {
+                            Index subIndices = indices;
+                            subIndices.push_back(i);
+                            subIndices.push_back(j);
+                            if constexpr (std::is_same_v<T, uint8_t> || std::is_same_v<T, int8_t>)
+                                os << "  " << static_cast<int>(getValueAt<T>(subIndices));
+                            else
+                                os << "  " << getValueAt<T>(subIndices);
+                        }
+                        os << '\n';
+                    }
+
+                    os << '\n';
+                }
+                else
+                {
+                    for (size_t i = m_shape[dim]; i-- > 0;) // Process in reverse order
+                    {
+                        Index subIndices = indices;
+                        subIndices.push_back(i);
+                        stack.push({subIndices, dim + 1});
+                    }
+                }
+            }
+        }
+
+        auto deviceName = device()->name();
+        // Print shape
+        switch (dataType())
+        {
+            case DataType::kFloat64:  os << "[ " << deviceName << " Float64 {";  break;
+            case DataType::kFloat32:  os << "[ " << deviceName << " Float32 {";  break;
+            case DataType::kFloat16:  os << "[ " << deviceName << " Float16 {";  break;
+            case DataType::kBFloat16: os << "[ " << deviceName << " BFloat16 {"; break;
+            case DataType::kInt64:    os << "[ " << deviceName << " Int64 {";    break;
+            case DataType::kInt32:    os << "[ " << deviceName << " Int32 {";    break;
+            case DataType::kInt16:    os << "[ " << deviceName << " Int16 {";    break;
+            case DataType::kInt8:     os << "[ " << deviceName << " Int8 {";     break;
+            case DataType::kUInt8:    os << "[ " << deviceName << " UInt8 {";    break;
+            default:                  os << "[ " << deviceName << " Unknown {";  break;
+        }
+
+        for (size_t i = 0; i < m_shape.size(); ++i)
+        {
+            os << m_shape[i];
+            if (i < m_shape.size() - 1)
+            {
+                os << ",";
+            }
+        }
+        os << "} ]\n";
+    }
+
+private:
+    bool      m_isContiguous{true};
+    DataType  m_dType{DataType::kFloat32};
+    size_t    m_size{0};        // Number of elements in DataType.
+    Shape     m_shape;          // The shape of the tensor.
+    Stride    m_strides;        // The strides for indexing the tensor.
+    size_t    m_offset{0};      // Start offset of data on storage.
+    Device *  m_device{nullptr};
+    std::shared_ptr<TensorStorage>  m_storage;      // The flat array of tensor elements.
+};
+
+
+// Lazy mode records element-wise tensor operations instead of executing them. Recorded operations are fused into a
+// single kernel when a tensor value is requested. The state is per thread.
+class LazyMode
+{
+public:
+    static bool isEnabled()                 { return state(); }
+    static void enable(bool enabled)        { state() = enabled; }
+
+private:
+    static bool& state()
+    {
+        thread_local bool enabled{false};
+        return enabled;
+    }
+};
+
+// Enables or disables the lazy mode in a scope and restores the previous state when it goes out of scope.
+class LazyModeGuard
+{
+public:
+    explicit LazyModeGuard(bool enabled = true) : m_prevState{LazyMode::isEnabled()}  { LazyMode::enable(enabled); }
+    ~LazyModeGuard()                                                                 { LazyMode::enable(m_prevState); }
+
+    LazyModeGuard(const LazyModeGuard&) = delete;
+    LazyModeGuard& operator=(const LazyModeGuard&) = delete;
+
+private:
+    bool m_prevState;
+};
+
+// Gradient mode records the autograd graph of tensor operations. Without it, the results of operations are value-only
+// tensors that neither require gradients nor keep their inputs alive. The state is per thread.
+class GradMode
+{
+public:
+    static bool isEnabled()                 { return state(); }
+    static void enable(bool enabled)        { state() = enabled; }
+
+private:
+    static bool& state()
+    {
+        thread_local bool enabled{true};
+        return enabled;
+    }
+};
+
+// Sets the gradient mode in a scope and restores the previous state when it goes out of scope.
+class GradModeGuard
+{
+public:
+    explicit GradModeGuard(bool enabled) : m_prevState{GradMode::isEnabled()}   { GradMode::enable(enabled); }
+    ~GradModeGuard()                                                            { GradMode::enable(m_prevState); }
+
+    GradModeGuard(const GradModeGuard&) = delete;
+    GradModeGuard& operator=(const GradModeGuard&) = delete;
+
+private:
+    bool m_prevState;
+};
+
+// Disables the gradient mode in a scope and restores the previous state when it goes out of scope.
+class NoGradGuard : public GradModeGuard
+{
+public:
+    NoGradGuard() : GradModeGuard(false)    { }
+};
+
+// Disables the gradient mode for inference while the returned guard is alive: auto guard = aix::inferenceMode();
+inline NoGradGuard inferenceMode()      { return {}; }
+
+constexpr size_t MaxFusedOperations = 16;        // Larger lazy expressions are split into multiple fused kernels.
+
+// The gradient of a table that has values only in some rows along its first dimension, such as the gradient of an
+// embedding table. A coalesced gradient has sorted unique Int32 indices and one summed row for each index.
+struct SparseGrad
+{
+    TensorValue  indices;       // Shape: [n]
+    TensorValue  rows;          // Shape: [n, the shape of a table row...]
+
+    inline bool empty() const   { return indices.size() == 0; }
+};
+
+
+class TensorNode
+{
+public:
+    // The values that the backward function of a node reads.
+    enum SavedValue : uint8_t
+    {
+        kSavedA      = 1,
+        kSavedB      = 2,
+        kSavedResult = 4,
+    };
+
+    // Constructor
+    explicit TensorNode(TensorValue value, bool requireGrad = false) :
+        m_value{std::move(value)}, m_requireGrad{requireGrad}
+    {
+    }
+
+    // Constructor
+    explicit TensorNode(const Shape & shape, Device * device, bool requireGrad = false, DataType dType = DataType::kFloat32) :
+        m_value{shape, device, dType, StorageResidency::kShared}, m_requireGrad{requireGrad}
+    {
+    }
+
+    // Perform backpropagation to calculate gradients. Nodes are visited once in topological order, after the seeds
+    // of all of their consumers are accumulated, and each accumulated seed is released once its node is processed.
+    void backward(const TensorValue & seed)
+    {
+        auto order = topologicalOrder();
+        try
+        {
+            accumulateSeed(seed);
+            for (auto node : order)
+            {
+                if (!node->m_seed) continue;
+                if (node->m_retainGrad && !node->m_isSparseGrad)
+                {
+                    node->grad() += node->m_seed.value();
+                }
+                node->validateSavedValues();
+                node->m_backwardFunc(node, node->m_seed.value());
+                node->m_seed.reset();
+                if (node->m_gradHook) node->m_gradHook();
+            }
+        }
+        catch (...)
+        {
+            // Pending seeds must not leak into the next backward pass.
+            for (auto node : order) node->m_seed.reset();
+            throw;
+        }
+    }
+
+    // Adds a gradient flowing from a consumer node. Called by backward functions during backpropagation.
+    void accumulateSeed(const TensorValue & seed)
+    {
+        if (m_seed)
+            m_seed.value() += seed;
+        else
+            m_seed.emplace(seed);
+    }
+
+    void accumulateSeed(TensorValue && seed)
+    {
+        if (m_seed)
+            m_seed.value() += seed;
+        else if (!seed.isContiguous())
+            m_seed.emplace(seed.contiguous());      // Backward functions read contiguous seeds.
+        else
+            m_seed.emplace(std::move(seed));
+    }
+
+    // Adds the rows of a sparse gradient. The rows are summed when the gradient is coalesced.
+    void accumulateSparseGrad(const TensorValue & indices, const TensorValue & rows)
+    {
+        if (Graph::isCapturing())
+        {
+            throw std::runtime_error("Sparse gradients are accumulated on the host and cannot be captured in a graph.");
+        }
+        assert(indices.dataType() == DataType::kInt32 && indices.size() == rows.shape()[0]);
+        m_sparseGrads.push_back({ indices, rows });
+        m_isSparseGradCoalesced = false;
+    }
+
+    // Adds a dense gradient of the table, which has all rows.
+    void accumulateSparseGrad(const TensorValue & seed)
+    {
+        std::vector<int32_t> indices(m_value.shape()[0]);
+        std::iota(indices.begin(), indices.end(), 0);
+        accumulateSparseGrad(TensorValue(indices.data(), indices.size(), DataType::kInt32, Shape{indices.size()},
+                                         seed.device(), DataType::kInt32),
+                             seed.reshape(m_value.shape()));
+    }
+
+    // Returns the coalesced sparse gradient. The indices are sorted and made unique on the host, and the rows of each
+    // unique index are summed on the device by an indexAdd into their segment.
+    const SparseGrad & sparseGrad()
+    {
+        if (m_isSparseGradCoalesced) return m_sparseGrads.empty() ? m_emptySparseGrad : m_sparseGrads.front();
+
+        device()->synchronize();        // The indices are read on the host.
+        std::vector<int32_t> unique;
+        for (const auto & grad : m_sparseGrads)
+        {
+            auto data = grad.indices.data<int32_t>();
+            unique.insert(unique.end(), data, data + grad.indices.size());
+        }
+        std::sort(unique.begin(), unique.end());
+        unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+        auto rowShape = m_value.shape();
+        rowShape[0] = unique.size();
+        TensorValue rows(0.0, rowShape, device(), m_value.dataType());
+        std::vector<int32_t> segments;
+        for (const auto & grad : m_sparseGrads)
+        {
+            auto data = grad.indices.data<int32_t>();
+            segments.resize(grad.indices.size());
+            for (size_t i = 0; i < segments.size(); ++i)
+            {
+                auto it = std::lower_bound(unique.begin(), unique.end(), data[i]);
+                segments[i] = static_cast<int32_t>(it - unique.begin());
+            }
+            TensorValue segmentIndices(segments.data(), segments.size(), DataType::kInt32, Shape{segments.size()},
+                                       device(), DataType::kInt32);
+            rows.indexAdd(0, segmentIndices, grad.rows, true);
+        }
+
+        m_sparseGrads.clear();
+        if (!unique.empty())
+        {
+            m_sparseGrads.push_back({ TensorValue(unique.data(), unique.size(), DataType::kInt32, Shape{unique.size()},
+                                                  device(), DataType::kInt32), std::move(rows) });
+        }
+        m_isSparseGradCoalesced = true;
+        return m_sparseGrads.empty() ? m_emptySparseGrad : m_sparseGrads.front();
+    }
+
+    void clearSparseGrad()
+    {
+        m_sparseGrads.clear();
+        m_isSparseGradCoalesced = true;
+    }
+
+    TensorValue& grad()
+    {
+        if (m_grad.size() == 0)
+        {
+            m_grad = TensorValue{m_value.shape(), m_value.device(), m_value.size(), m_value.strides(), m_value.dataType()};
+            m_grad.fill(0);     // Gradients are accumulated, so a new buffer must start from zero.
+        }
+        return m_grad;
+    }
+
+    Device * device() const          { return m_value.device(); }
+
+    // Returns the value of the node. A pending lazy expression is evaluated by a fused kernel first.
+    TensorValue & value()
+    {
+        if (isLazy()) materialize();
+        return m_value;
+    }
+
+    inline bool isLazy() const       { return m_lazyOpCode.has_value(); }
+
+    // Records the versions of the inputs and of the value when the node is linked. The saved values are checked
+    // before the backward function runs, and the inputs of a lazy node are checked before it is evaluated.
+    void saveVersions(uint8_t savedValues)
+    {
+        m_savedValues   = savedValues;
+        m_aVersion      = m_a ? m_a->m_value.version() : 0;
+        m_bVersion      = m_b ? m_b->m_value.version() : 0;
+        m_resultVersion = m_value.version();
+    }
+
+    std::string  m_name;
+    TensorValue  m_value;
+    std::optional<FusedOpCode>  m_lazyOpCode;      // The pending element-wise operation of a lazy node.
+    float  m_lazyConstant{0};
+    bool  m_requireGrad;
+    bool  m_retainGrad{false};
+    std::shared_ptr<TensorNode>  m_a{nullptr};
+    std::shared_ptr<TensorNode>  m_b{nullptr};
+    SIndex m_dims;
+    size_t m_dim0{0};
+    size_t m_dim1{0};
+    bool m_keepDim{false};
+    TensorValue  m_indices;
+    std::optional<ssize_t> m_start;
+    std::optional<ssize_t> m_end;
+    std::vector<std::shared_ptr<TensorNode>> m_aMulti;
+    std::function<void(TensorNode * tensor, const TensorValue & seed)>  m_backwardFunc{nullptr};
+    bool  m_isRecorded{true};       // False for the results of the no-grad mode, which are not part of the graph.
+    TensorValue  m_saved;           // The previous value of an in-place operation that its gradient needs.
+    uint8_t  m_savedValues{0};      // The SavedValue flags of the values that the backward function reads.
+    size_t  m_aVersion{0};
+    size_t  m_bVersion{0};
+    size_t  m_resultVersion{0};
+    bool  m_isSparseGrad{false};    // The gradient is kept as a SparseGrad instead of a dense tensor.
+    std::function<void()>  m_gradHook;      // Called after the backward pass accumulated the gradient of the node.
+    Activation  m_activation{Activation::kNone};
+
+private:
+    void validateSavedValues() const
+    {
+        if (((m_savedValues & kSavedA) && m_a && m_a->m_value.version() != m_aVersion) ||
+            ((m_savedValues & kSavedB) && m_b && m_b->m_value.version() != m_bVersion) ||
+            ((m_savedValues & kSavedResult) && m_value.version() != m_resultVersion))
+        {
+            throw std::runtime_error("A tensor needed for the gradient computation has been modified by an in-place"
+                                     " operation.");
+        }
+    }
+
+    // Fuses the pending expression of the node and its pending lazy inputs into one program and evaluates it.
+    // Fused lazy inputs are not materialized, they are recomputed in the fused kernel.
+    void materialize()
+    {
+        // Select the lazy nodes to fuse in breadth-first order. Lazy inputs beyond the limit are evaluated separately,
+        // which bounds the number of instructions and inputs of a fused kernel.
+        std::unordered_map<const TensorNode*, size_t> instructionIndices;
+        std::vector<TensorNode*> queue{this};
+        size_t fusedCount = 0;
+        for (size_t i = 0; i < queue.size(); ++i)
+        {
+            auto node = queue[i];
+            if (!node->isLazy() || node->m_lazyOpCode == FusedOpCode::kConstant) continue;
+            if (fusedCount++ >= MaxFusedOperations)
+            {
+                node->value();
+                continue;
+            }
+            for (const auto& input : { node->m_a, node->m_b })
+            {
+                if (input && instructionIndices.emplace(input.get(), 0).second) queue.emplace_back(input.get());
+            }
+        }
+        instructionIndices.clear();
+
+        FusedProgram program;
+        std::vector<TensorNode*> inputNodes;
+        fuse(this, program, inputNodes, instructionIndices);
+
+        // Fused kernels read contiguous inputs only. Broadcast views are copied.
+        std::vector<TensorValue> contiguousInputs;
+        std::vector<DeviceTensorParams> inputs;
+        inputs.reserve(inputNodes.size());
+        for (auto inputNode : inputNodes)
+        {
+            if (inputNode->m_value.isContiguous())
+            {
+                inputs.emplace_back(inputNode->m_value.deviceParams());
+                continue;
+            }
+            contiguousInputs.emplace_back(inputNode->m_value.contiguous());
+            inputs.emplace_back(contiguousInputs.back().deviceParams());
+        }
+
+        TensorValue result(m_value.shape(), m_value.device(), m_value.dataType());
+        result.device()->fusedElementwise(program, inputs, result.deviceParams());
+        m_value = std::move(result);
+        m_lazyOpCode.reset();
+        if (!m_isRecorded)
+        {
+            m_a.reset();
+            m_b.reset();
+        }
+    }
+
+    // Appends the instructions that compute the given node and returns the index of its final instruction.
+    static size_t fuse(TensorNode * node, FusedProgram & program, std::vector<TensorNode*> & inputNodes,
+                       std::unordered_map<const TensorNode*, size_t> & instructionIndices)
+    {
+        if (auto it = instructionIndices.find(node); it != instructionIndices.end()) return it->second;
+
+        FusedInstruction instruction;
+        if (!node->isLazy())
+        {
+            instruction.opCode   = FusedOpCode::kInput;
+            instruction.operand1 = inputNodes.size();
+            inputNodes.emplace_back(node);
+        }
+        else
+        {
+            // The fused kernel reads the current values of the inputs, which must be the recorded ones.
+            if ((node->m_a && node->m_a->m_value.version() != node->m_aVersion) ||
+                (node->m_b && node->m_b->m_value.version() != node->m_bVersion))
+            {
+                throw std::runtime_error("An input of a lazy tensor has been modified by an in-place operation before"
+                                         " the tensor was evaluated.");
+            }
+            instruction.opCode   = node->m_lazyOpCode.value();
+            instruction.constant = node->m_lazyConstant;
+            if (node->m_a) instruction.operand1 = fuse(node->m_a.get(), program, inputNodes, instructionIndices);
+            if (node->m_b) instruction.operand2 = fuse(node->m_b.get(), program, inputNodes, instructionIndices);
+        }
+
+        program.emplace_back(instruction);
+        instructionIndices[node] = program.size() - 1;
+        return program.size() - 1;
+    }
+
+    // Returns the nodes of the graph in topological order, starting with this node. Every node comes before the nodes
+    // it depends on. An explicit stack is used instead of recursion to support deep graphs.
+    std::vector<TensorNode*> topologicalOrder()
+    {
+        std::vector<TensorNode*> order;
+        std::unordered_set<const TensorNode*> visited{this};
+        std::vector<std::pair<TensorNode*, size_t>> stack{{this, 0}};     // The node and its next input index.
+
+        while (!stack.empty())
+        {
+            auto& [node, inputIndex] = stack.back();
+            size_t inputCount = 2 + node->m_aMulti.size();
+            TensorNode* input = nullptr;
+            while (inputIndex < inputCount && !input)
+            {
+                auto i = inputIndex++;
+                auto candidate = i == 0 ? node->m_a.get() : i == 1 ? node->m_b.get() : node->m_aMulti[i - 2].get();
+                if (candidate && visited.insert(candidate).second) input = candidate;
+            }
+
+            if (input)
+            {
+                stack.emplace_back(input, 0);
+            }
+            else
+            {
+                order.emplace_back(node);
+                stack.pop_back();
+            }
+        }
+
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+
+    TensorValue  m_grad;
+    std::optional<TensorValue>  m_seed;     // The accumulated gradient of a node during a backward pass.
+    std::vector<SparseGrad>  m_sparseGrads; // The uncoalesced sparse gradients, or the coalesced one.
+    bool  m_isSparseGradCoalesced{true};
+    inline static const SparseGrad  m_emptySparseGrad{};
+};
+
+
+struct TensorOptions
+{
+    inline TensorOptions requireGrad(bool state)    { m_requireGrad = state; return *this; }
+    inline TensorOptions dtype(DataType dataType)   { m_dtype = dataType;    return *this; }
+    inline TensorOptions device(Device* device)     { m_device = device;     return *this; }
+    inline TensorOptions device(std::unique_ptr<aix::Device>& device)  { m_device = device.get(); return *this; }
+    inline TensorOptions device(std::shared_ptr<aix::Device>& device)  { m_device = device.get(); return *this; }
+
+    bool m_requireGrad{false};
+    aix::DataType m_dtype{aix::DataType::kFloat32};
+    aix::Device* m_device{&aix::defaultDevice};
+};
+inline TensorOptions requireGrad(bool state)    { return { .m_requireGrad=state }; }
+inline TensorOptions dtype(DataType dataType)   { return { .m_dtype=dataType    }; }
+inline TensorOptions device(Device* device)     { return { .m_device=device     }; }
+inline TensorOptions device(std::unique_ptr<aix::Device>& device)     { return { .m_device = device.get() }; }
+inline TensorOptions device(std::shared_ptr<aix::Device>& device)     { return { .m_device = device.get() }; }
+
+
+class Tensor
+{
+public:
+    // Constructor.
+    Tensor() = default;
+
+    // Constructor.
+    explicit Tensor(const void* data, size_t size, DataType srcDType, const Shape & shape, const TensorOptions & opt = {})
+    {
+        // Create a new Tensor Graph Node.
+        m_data = std::make_shared<TensorNode>(TensorValue{data, size, srcDType, shape, opt.m_device, opt.m_dtype},
+                                              opt.m_requireGrad);
+        m_data->m_backwardFunc = defaultBackward;
+    }
+
+    // Constructor.
+    explicit Tensor(const std::shared_ptr<TensorStorage>& storage, size_t size, size_t offset, const Shape & shape,
+                    const TensorOptions & opt = {})
+    {
+        m_data = std::make_shared<TensorNode>(TensorValue{storage, size, offset, shape, opt.m_device, opt.m_dtype},
+                                              opt.m_requireGrad);
+        m_data->m_backwardFunc = defaultBackward;
+    }
+
+    // Constructor.
+    explicit Tensor(float value, const Shape & shape, const TensorOptions & opt = {})
+    {
+        // Create a new Tensor Graph Node. Lazy constants are filled in by the fused kernels.
+        if (LazyMode::isEnabled() && isLazyDataType(opt.m_dtype))
+        {
+            m_data = std::make_shared<TensorNode>(TensorValue::placeholder(shape, opt.m_device, opt.m_dtype),
+                                                  opt.m_requireGrad);
+            m_data->m_lazyOpCode = FusedOpCode::kConstant;
+            m_data->m_lazyConstant = value;
+        }
+        else
+        {
+            m_data = std::make_shared<TensorNode>(TensorValue{value, shape, opt.m_device, opt.m_dtype}, opt.m_requireGrad);
+        }
+        m_data->m_backwardFunc = defaultBackward;
+    }
+
+    // Constructor.
+    explicit Tensor(const Shape & shape, const TensorOptions & opt = {})
+    {
+        // Create a new Tensor Graph Node.
+        m_data = std::make_shared<TensorNode>(shape, opt.m_device, opt.m_requireGrad, opt.m_dtype);
+        m_data->m_backwardFunc = defaultBackward;
+    }
+
+    // Perform backpropagation to calculate gradients.
+    void backward(float value=1)
+    {
+        if (!m_data->m_a)
+        {
+            throw std::invalid_argument("backward() requires the result of an operation recorded with gradients.");
+        }
+        m_data->backward(TensorValue{value, m_data->m_a->m_value.shape(), device(), dataType()});
+    }
+    void backward(float value, const Shape & gradShape)  { m_data->backward(TensorValue{value, gradShape, device(), dataType()}); }
+
+    // Getters and setters for the tensor's value. A lazy tensor is materialized first.
+    inline const TensorValue & value() const    { return m_data->value(); }
+    inline TensorValue & value()                { return m_data->value(); }
+    inline bool isLazy() const                  { return m_data->isLazy(); }
+
+    // Materializes a lazy tensor and waits until the device completes all operations.
+    inline void synchronize() const             { value(); device()->synchronize(); }
+
+    // Returns the value of a scalar tensor.
+    template<typename T>
+    inline T item() const                       { synchronize(); return value().item<T>(); }
+    inline const Shape & shape() const          { return m_data->m_value.shape(); }
+    inline DataType dataType() const            { return m_data->m_value.dataType(); }
+
+    // Gradient-related methods.
+    inline const TensorValue & grad() const
+    {
+        validateRetainGradientState();
+        return m_data->grad();
+    }
+
+    inline TensorValue & grad()
+    {
+        validateRetainGradientState();
+        return m_data->grad();
+    }
+
+    inline void zeroGrad()
+    {
+        if (m_data->m_isSparseGrad)
+            m_data->clearSparseGrad();
+        else
+            m_data->grad().fill(0);
+    }
+
+    inline bool isRequireGrad() const           { return m_data->m_requireGrad; }
+    inline void retainGrad() const              { m_data->m_retainGrad = true; m_data->grad().fill(0); }
+    inline const Tensor& requireGrad(bool state) const
+    {
+        m_data->m_requireGrad = m_data->m_retainGrad = state;
+        return *this;
+    }
+
+    // Keeps the gradient of a table as the rows that its indexSelect operations along the first dimension select,
+    // see SparseGrad. Other operations add gradients of all rows. The optimizers update only the rows that have
+    // gradients.
+    const Tensor& sparseGrad(bool state) const
+    {
+        if (m_data->m_a || m_data->m_b || !m_data->m_aMulti.empty() || shape().empty())
+        {
+            throw std::invalid_argument("Only leaf tensors with at least one dimension can have sparse gradients.");
+        }
+        m_data->m_isSparseGrad = state;
+        m_data->clearSparseGrad();
+        return *this;
+    }
+
+    inline bool isSparseGrad() const            { return m_data->m_isSparseGrad; }
+
+    // Sets a function that a backward pass calls once it has accumulated all gradients of the tensor. The device could
+    // still be computing the gradient.
+    inline void gradHook(std::function<void()> hook) const     { m_data->m_gradHook = std::move(hook); }
+
+    // Returns the coalesced sparse gradient of a table.
+    inline const SparseGrad & rowGrad() const   { return m_data->sparseGrad(); }
+
+    inline Device * device() const              { return m_data->device(); }
+
+    inline void name(const std::string& name) const  { m_data->m_name = name; }
+    inline const std::string& name() const           { return m_data->m_name; }
+
+    // Returns a new Tensor with a new shape.
+    Tensor reshape(const Shape & newShape) const
+    {
+        size_t newSize = std::accumulate(newShape.begin(), newShape.end(), 1, std::multiplies<>());
+        if (value().size() != newSize)
+        {
+            throw std::invalid_argument("Reshape error: element count mismatch (" +
+                                        std::to_string(value().size()) + " vs " + std::to_string(newSize) + ").");
+        }
+
+        // The result shares the storage of a contiguous value, views are copied first.
+        auto& tv = m_data->value();
+        TensorValue dense = tv.isContiguous() ? TensorValue() : tv.contiguous();
+        auto& src = tv.isContiguous() ? tv : dense;
+        TensorOptions opt{ .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() };
+        Tensor result{src.storage(), src.size(), src.storageOffset(), newShape, opt};
+        link(result, reshapeBackwardFunc, m_data);
+        return result;
+    }
+
+    // Returns a new Tensor with a new shape. This method accepts one inferred dimension.
+    Tensor reshape(const std::initializer_list<ssize_t>& newShape) const
+    {
+        return reshape(shapeWithInferredDimToShape(newShape));
+    }
+
+    Tensor broadcastTo(const Shape & newShape) const
+    {
+        if (shape() == newShape) return *this;
+        TensorValue tValue = m_data->value().broadcastTo(newShape);
+        Tensor result{tValue.data(), tValue.size(), tValue.dataType(), tValue.shape(),
+                      { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device()}};
+        link(result, broadcastBackwardFunc, m_data);
+        return result;
+    }
+
+    // Set operation device for the tensor.
+    inline Tensor to(std::unique_ptr<Device>& device) const    { return to(*device); }
+    inline Tensor to(std::shared_ptr<Device>& device) const    { return to(*device); }
+    inline Tensor to(Device* device) const                     { return to(*device); }
+    Tensor to(Device& newDevice) const
+    {
+        if (&newDevice == m_data->device()) return *this;
+        Tensor result{shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=&newDevice }};
+        result.m_data->m_value = m_data->value().to(&newDevice);
+        link(result, toDeviceBackwardFunc, m_data);
+        return result;
+    }
+
+    Tensor to(DataType newDataType) const
+    {
+        if (dataType() == newDataType) return *this;
+        TensorOptions opt{ .m_requireGrad=isRequireGrad(), .m_dtype=newDataType, .m_device=device() };
+        Tensor result{value().data(), value().size(), value().dataType(), value().shape(), opt};
+        link(result, toDataTypeBackwardFunc, m_data);
+        return result;
+    }
+
+    static void defaultBackward(TensorNode * node, const TensorValue & seed)
+    {
+        if (node->m_isSparseGrad)
+        {
+            if (node->m_requireGrad) node->accumulateSparseGrad(seed);
+            return;
+        }
+        if (node->m_requireGrad && !node->m_retainGrad)
+        {
+            assert(node->grad().dataType() == seed.dataType());
+            node->grad() += seed;
+        }
+    }
+
+    static void reshapeBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        node->m_a->accumulateSeed(seed.reshape(node->m_a->m_value.shape()));
+    }
+
+    static void broadcastBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        // Accumulate the gradient to the original node by reducing the gradient from the broadcasted shape to the
+        // original shape. Summation is used for gradient accumulation when reducing dimensions because each element
+        // of the original tensor contributes to multiple elements of the resulting tensor after broadcasting.
+        node->m_a->accumulateSeed(seed.reduceTo(node->m_a->m_value.shape()));
+    }
+
+    static void toDeviceBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        if (seed.device() != node->m_a->m_value.device())
+        {
+            // Synchronize seed to ensure the seed's data is available before copying it to a different device.
+            seed.device()->synchronize();
+        }
+        node->m_a->accumulateSeed(seed.to(node->m_a->m_value.device()));
+    }
+
+    static void toDataTypeBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        // Ensure that the seed gradient is converted back to the data type of the original tensor.
+        node->m_a->accumulateSeed(seed.to(node->m_a->m_value.dataType()));
+    }
+
+    static void addBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a || !node->m_b) return;
+        // Calculate gradients.
+        node->m_a->accumulateSeed(seed);
+        node->m_b->accumulateSeed(seed);
+    }
+
+    static void subBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a || !node->m_b) return;
+        // Calculate gradients.
+        node->m_a->accumulateSeed(seed);
+        node->m_b->accumulateSeed(-seed);
+    }
+
+    static void mulBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a || !node->m_b) return;
+        // Calculate gradients.
+        node->m_a->accumulateSeed(node->m_b->value() * seed);
+        node->m_b->accumulateSeed(node->m_a->value() * seed);
+    }
+
+    static void divBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a || !node->m_b) return;
+        // Calculate gradients.
+        node->m_a->accumulateSeed(seed / node->m_b->value());                                               // ∂f/∂a = 1 / b
+        node->m_b->accumulateSeed(-node->m_a->value() * seed / (node->m_b->value() * node->m_b->value()));  // ∂f/∂b = -a / b^2
+    }
+
+    static void unaryBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        // Calculate gradients.
+        node->m_a->accumulateSeed(-seed);
+    }
+
+    static void sqrtBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        // The derivative of sqrt(a) with respect to 'a' is 0.5/sqrt(a).
+        // Therefore, the gradient of the input is multiplied by 0.5/sqrt(a).
+        node->m_a->accumulateSeed(0.5 / node->m_a->value().sqrt() * seed);   // ∂f/∂a = 0.5/sqrt(a)
+    }
+
+    static void sinBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        // The derivative of sin(a) with respect to 'a' is cos(a).
+        // Therefore, the gradient of the input is multiplied by cos(a).
+        node->m_a->accumulateSeed(node->m_a->value().cos() * seed);   // ∂f/∂a = cos(a)
+    }
+
+    static void cosBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        // The derivative of cos(a) with respect to 'a' is -sin(a).
+        // Therefore, the gradient of the input is multiplied by -sin(a).
+        node->m_a->accumulateSeed(-node->m_a->value().sin() * seed);   // ∂f/∂a = -sin(a)
+    }
+
+    static void tanhBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        // The derivative of tanh(a) with respect to 'a' is 1 - tanh^2(a).
+        // Therefore, the gradient of the input is multiplied by (1 - tanh^2(a)).
+        const auto & tanhValue = node->m_a->value().tanh();
+        node->m_a->accumulateSeed((float(1) - tanhValue * tanhValue) * seed);  // ∂f/∂a = (1 - tanh^2(a))
+    }
+
+    static void logBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        // TODO: Handle division by zero case.
+        // The derivative of log(a) with respect to 'a' is 1/a.
+        node->m_a->accumulateSeed(seed / node->m_a->value());  // ∂f/∂a = 1/a
+    }
+
+    static void expBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        // The derivative of exp(a) with respect to 'a' is exp(a), itself.
+        node->m_a->accumulateSeed(seed * node->m_a->value().exp());  // ∂f/∂a = exp(a)
+    }
+
+    static void maxBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        // The derivative of max(a) with respect to 'a' is a zero tensor with argmax index set to 1.
+        node->m_a->accumulateSeed(seed * node->m_a->value().argmaxIndices());
+    }
+
+    static void maxBackwardFunc2(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        // The derivative of max(a) with respect to 'a' is a zero tensor with max indexes set to 1.
+        node->m_a->accumulateSeed(seed * node->m_a->value().argmaxIndices(static_cast<ssize_t>(node->m_dim0)));
+    }
+
+    static void softmaxBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        // ∂f/∂a = f * (seed - sum(seed * f)) along the dimension, where f is softmax(a).
+        auto dim = static_cast<ssize_t>(node->m_dim0);
+        node->m_a->accumulateSeed(node->value().softmaxOp(SoftmaxOp::kSoftmaxBackward, dim, {&seed}));
+    }
+
+    static void logSoftmaxBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        // ∂f/∂a = seed - exp(f) * sum(seed) along the dimension, where f is logSoftmax(a).
+        auto dim = static_cast<ssize_t>(node->m_dim0);
+        node->m_a->accumulateSeed(node->value().softmaxOp(SoftmaxOp::kLogSoftmaxBackward, dim, {&seed}));
+    }
+
+    static void crossEntropyBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a || !node->m_b) return;
+        // ∂f/∂a = seed * (softmax(a) * sum(t) - t) for the logits 'a' and the targets 't'. The softmax is
+        // recomputed instead of keeping a tensor of the size of the logits.
+        auto dim = static_cast<ssize_t>(node->m_dim0);
+        const auto & logits  = node->m_a->value();
+        const auto & targets = node->m_b->value();
+        node->m_a->accumulateSeed(logits.softmaxOp(SoftmaxOp::kCrossEntropyBackward, dim, {&targets, &seed}));
+        if (node->m_b->m_requireGrad)
+        {
+            // ∂f/∂t = -seed * logSoftmax(a)
+            auto seedShape = logits.shape();
+            if (!seedShape.empty()) seedShape[dim] = 1;
+            auto targetsSeed = -(seed.reshape(seedShape) * logits.logSoftmax(dim));
+            node->m_b->accumulateSeed(targetsSeed.to(targets.dataType()));
+        }
+    }
+
+    static void powBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a || !node->m_b) return;
+        // The derivative of pow(a, b) with respect to 'a' is b * a^(b-1).
+        // ∂f/∂a = b * pow(a, b-1)
+        node->m_a->accumulateSeed(seed * node->m_b->value() * node->m_a->value().pow(node->m_b->value() - float(1)));
+    }
+
+    static void matmulBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a || !node->m_b) return;
+        // Assuming m_a and m_b are the input matrices a and b, respectively,
+        // and seed is ∂E/∂c, the gradient of the loss with respect to the output matrix c.
+        // Compute gradients with respect to a and b
+
+        // Corrected to use matrix multiplication for backward pass calculations
+        // Gradients of broadcast batch dimensions are summed back to the input shapes.
+        const auto & a = node->m_a->value();
+        const auto & b = node->m_b->value();
+        node->m_a->accumulateSeed(seed.matmul(b, false, true).reduceTo(a.shape()));     // ∂E/∂a = ∂E/∂c * b^T
+        if (b.shape().size() == 2 && a.size() / a.shape().back() == seed.size() / seed.shape().back())
+        {
+            // A matrix shared by all batches gets the gradient of a single multiplication of the stacked batches.
+            auto a2D = a.reshape({a.size() / a.shape().back(), a.shape().back()});
+            auto seed2D = seed.reshape({seed.size() / seed.shape().back(), seed.shape().back()});
+            node->m_b->accumulateSeed(a2D.matmul(seed2D, true, false));
+            return;
+        }
+        node->m_b->accumulateSeed(a.matmul(seed, true, false).reduceTo(b.shape()));     // ∂E/∂b = a^T * ∂E/∂c
+    }
+
+    static void linearBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a || !node->m_b || node->m_aMulti.empty()) return;
+        // The seed of the values before the activation, z, is computed in a single fused kernel.
+        TensorValue activationSeed;
+        if (node->m_activation != Activation::kNone)
+        {
+            const auto & value = node->m_activation == Activation::kGeLU ? node->m_saved : node->value();
+            activationSeed = activationBackward(node->m_activation, seed, value);
+        }
+        const auto & zSeed = node->m_activation == Activation::kNone ? seed : activationSeed;
+
+        // The rows of the batch dimensions are multiplied as a single matrix.
+        const auto & x = node->m_a->value();
+        const auto & w = node->m_b->value();
+        auto & bias = node->m_aMulti.front();
+        auto rows = zSeed.size() / w.shape()[1];
+        auto x2D = (x.isContiguous() ? x : x.contiguous()).reshape({rows, w.shape()[0]});
+        auto seed2D = (zSeed.isContiguous() ? zSeed : zSeed.contiguous()).reshape({rows, w.shape()[1]});
+        node->m_a->accumulateSeed(seed2D.matmul(w, false, true).reshape(x.shape()));   // ∂E/∂x = ∂E/∂z * w^T
+        node->m_b->accumulateSeed(x2D.matmul(seed2D, true, false));                     // ∂E/∂w = x^T * ∂E/∂z
+        bias->accumulateSeed(seed2D.sum(0, true).reshape(bias->m_value.shape()));     // ∂E/∂b = sum of ∂E/∂z rows
+    }
+
+    // Returns the seed of the values before the activation, which a single fused element-wise kernel computes from
+    // the seed of the result. The value is the result of the activation, or the value before it for GeLU.
+    static TensorValue activationBackward(Activation activation, const TensorValue & seed, const TensorValue & value)
+    {
+        FusedProgram program{ { FusedOpCode::kInput, 0 }, { FusedOpCode::kInput, 1 } };     // Seed and value.
+        auto emit = [&](FusedOpCode opCode, size_t operand1, size_t operand2 = 0)
+        {
+            program.push_back({ opCode, operand1, operand2 });
+            return program.size() - 1;
+        };
+        auto constant = [&](float number)
+        {
+            program.push_back({ FusedOpCode::kConstant, 0, 0, number });
+            return program.size() - 1;
+        };
+
+        size_t derivative = 0;
+        switch (activation)
+        {
+            case Activation::kTanh:         // 1 - y^2
+                derivative = emit(FusedOpCode::kSub, constant(1), emit(FusedOpCode::kMul, 1, 1));
+                break;
+            case Activation::kSigmoid:      // y * (1 - y)
+                derivative = emit(FusedOpCode::kMul, 1, emit(FusedOpCode::kSub, constant(1), 1));
+                break;
+            case Activation::kGeLU:
+            {
+                // 0.5 * (1 + t) + 0.5 * z * (1 - t^2) * c * (1 + 3k * z^2), where t = tanh(c * (z + k * z^3)).
+                constexpr float c = std::numbers::sqrt2_v<float> * std::numbers::inv_sqrtpi_v<float>;
+                constexpr float k = 0.044715f;
+                auto one  = constant(1);
+                auto half = constant(0.5f);
+                auto z2   = emit(FusedOpCode::kMul, 1, 1);
+                auto u    = emit(FusedOpCode::kMul, 1, emit(FusedOpCode::kAdd, one, emit(FusedOpCode::kMul,
+                                                                                         constant(k), z2)));
+                auto t    = emit(FusedOpCode::kTanh, emit(FusedOpCode::kMul, constant(c), u));
+                auto du   = emit(FusedOpCode::kMul, constant(c), emit(FusedOpCode::kAdd, one,
+                                                                      emit(FusedOpCode::kMul, constant(3 * k), z2)));
+                auto dt   = emit(FusedOpCode::kMul, emit(FusedOpCode::kSub, one, emit(FusedOpCode::kMul, t, t)), du);
+                derivative = emit(FusedOpCode::kAdd, emit(FusedOpCode::kMul, half, emit(FusedOpCode::kAdd, one, t)),
+                                  emit(FusedOpCode::kMul, half, emit(FusedOpCode::kMul, 1, dt)));
+                break;
+            }
+            default:
+                return seed;
+        }
+        emit(FusedOpCode::kMul, 0, derivative);
+
+        // Fused kernels read contiguous inputs only.
+        TensorValue seedTemp, valueTemp;
+        if (!seed.isContiguous()) seedTemp = seed.contiguous();
+        if (!value.isContiguous()) valueTemp = value.contiguous();
+        const auto & seedInput  = seed.isContiguous() ? seed : seedTemp;
+        const auto & valueInput = value.isContiguous() ? value : valueTemp;
+        TensorValue result(seed.shape(), seed.device(), seed.dataType());
+        result.device()->fusedElementwise(program, { seedInput.deviceParams(), valueInput.deviceParams() },
+                                          result.deviceParams());
+        return result;
+    }
+
+    static void transposeBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        node->m_a->accumulateSeed(seed.transposeView(node->m_dim0, node->m_dim1));
+    }
+
+    static void permuteBackwardFunc(TensorNode* node, const TensorValue& seed)
+    {
+        if (!node->m_a) return;
+
+        // Convert negative reference indices to positive.
+        SIndex orgDims = node->m_dims;
+        for (size_t i=0; i<orgDims.size(); ++i)
+        {
+            orgDims[i] = orgDims[i] < 0 ? static_cast<ssize_t>(orgDims.size()) + orgDims[i] : orgDims[i];
+        }
+
+        // Calculate permute indexes to put the dimensions back to the original positions.
+        SIndex dims(orgDims.size());
+        for (size_t i=0; i<orgDims.size(); ++i)
+        {
+            auto it = std::find(orgDims.begin(), orgDims.end(), i);
+            dims[i] = std::distance(orgDims.begin(), it);
+        }
+        node->m_a->accumulateSeed(seed.permute(dims));
+    }
+
+    static void sliceBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        node->m_a->accumulateSeed(node->m_a->value().sliceSet(seed, node->m_dim0, node->m_start, node->m_end, node->m_dim1));
+    }
+
+    static void sumBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        // For the sum operation, the gradient is simply the seed
+        node->m_a->accumulateSeed(seed);
+    }
+
+    static void sumBackwardFunc2(TensorNode* node, const TensorValue& seed)
+    {
+        if (!node->m_a) return;
+        const auto& originalShape = node->m_a->m_value.shape();
+
+        // For keepDim=False case, 1 dimension was squeezed. That dimension needs to be unsqueezed.
+        if (!node->m_keepDim)
+            node->m_a->accumulateSeed(seed.unsqueeze(static_cast<ssize_t>(node->m_dim0)).broadcastTo(originalShape));
+        else
+            node->m_a->accumulateSeed(seed.broadcastTo(originalShape));
+    }
+
+    static void squeezeBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        node->m_a->accumulateSeed(seed.unsqueeze(node->m_dim0));
+    }
+
+    static void unsqueezeBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        node->m_a->accumulateSeed(seed.squeeze(node->m_dim0));
+    }
+
+    static void trillBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        auto onesLikeSeed = TensorValue(1.0, seed.shape(), seed.device(), seed.dataType());
+        node->m_a->accumulateSeed(seed * onesLikeSeed.tril(static_cast<ssize_t>(node->m_dim0)));      // m_dim0 = diagonal
+    }
+
+    static void triuBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        auto onesLikeSeed = TensorValue(1.0, seed.shape(), seed.device(), seed.dataType());
+        node->m_a->accumulateSeed(seed * onesLikeSeed.triu(static_cast<ssize_t>(node->m_dim0)));      // m_dim0 = diagonal
+    }
+
+    static void indexSelectBackwardFunc(TensorNode * node, const TensorValue& seed)
+    {
+        if (!node->m_a) return;
+        if (node->m_a->m_isSparseGrad && node->m_dim0 == 0)
+        {
+            // Only the selected rows of a sparse table get gradients. No dense table is created.
+            if (!node->m_a->m_requireGrad) return;
+            auto rowShape = node->m_a->m_value.shape();
+            rowShape[0] = node->m_indices.size();
+            node->m_a->accumulateSparseGrad(node->m_indices.reshape(Shape{node->m_indices.size()}),
+                                            TensorValue(seed).reshape(rowShape));
+            return;
+        }
+        auto zeros = aix::TensorValue(0.0, node->m_a->m_value.shape(), seed.device(), seed.dataType());
+        node->m_a->accumulateSeed(zeros.indexAdd(static_cast<ssize_t>(node->m_dim0), node->m_indices, seed, true));
+    }
+
+    static void catBackwardFunc(TensorNode* node, const TensorValue& seed)
+    {
+        size_t numTensors = node->m_aMulti.size();
+        if (numTensors == 0) return;
+
+        // The dimension along which tensors were concatenated.
+        auto dim = static_cast<ssize_t>(node->m_dim0);
+
+        // Get the shape of the original tensors.
+        size_t dimSize = node->m_aMulti[0]->m_value.shape()[dim];
+
+        // Iterate over each original tensor and propagate the gradient.
+        for (size_t i=0; i<numTensors; ++i)
+        {
+            // Propagate this sliced gradient to the corresponding original tensor.
+            node->m_aMulti[i]->accumulateSeed(seed.slice(dim, i * dimSize, (i + 1) * dimSize, 1));
+        }
+    }
+
+    // The backward functions of the in-place operations. The input 'a' is the node of the previous value, which an
+    // in-place operation overwrites, so the gradients are computed from the result or from the saved previous value.
+    static void mulInPlaceBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a || !node->m_b) return;
+        node->m_a->accumulateSeed(node->m_b->value() * seed);
+        // The previous value is saved only if the other operand requires gradients.
+        if (node->m_b->m_requireGrad) node->m_b->accumulateSeed(node->m_saved * seed);
+    }
+
+    static void divInPlaceBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a || !node->m_b) return;
+        node->m_a->accumulateSeed(seed / node->m_b->value());                                        // ∂f/∂a = 1 / b
+        if (node->m_b->m_requireGrad)
+        {
+            node->m_b->accumulateSeed(-node->value() * seed / node->m_b->value());                  // ∂f/∂b = -f / b
+        }
+    }
+
+    static void sqrtInPlaceBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        node->m_a->accumulateSeed(0.5 / node->value() * seed);                                      // ∂f/∂a = 0.5 / f
+    }
+
+    static void tanhInPlaceBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        const auto & tanhValue = node->value();
+        node->m_a->accumulateSeed((float(1) - tanhValue * tanhValue) * seed);                       // ∂f/∂a = 1 - f^2
+    }
+
+    static void expInPlaceBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_a) return;
+        node->m_a->accumulateSeed(seed * node->value());                                            // ∂f/∂a = f
+    }
+
+    static void copyInPlaceBackwardFunc(TensorNode * node, const TensorValue & seed)
+    {
+        if (!node->m_b) return;
+        // The previous value is overwritten, so only the source gets a gradient.
+        node->m_b->accumulateSeed(seed);
+    }
+
+    // Select operator.
+    Tensor operator[](ssize_t index) const
+    {
+        return select(0, index);
+    }
+
+    // Overload the + operator
+    Tensor operator+(const Tensor & other) const
+    {
+        auto promotedDType = promoteDataType(dataType(), other.dataType());
+        Shape bcShape = broadcastShape(other.shape());
+        auto lhs = to(promotedDType).broadcastView(bcShape);
+        auto rhs = other.to(promotedDType).broadcastView(bcShape);
+        if (isLazyOp(lhs, &rhs)) return lazyOp(FusedOpCode::kAdd, lhs, &rhs, addBackwardFunc);
+
+        auto result = operationResult(shape(), isRequireGrad() || other.isRequireGrad());
+        result.m_data->m_value = lhs.m_data->value() + rhs.m_data->value();
+        link(result, addBackwardFunc, lhs.m_data, rhs.m_data);
+        return result;
+    }
+
+    // Overload the - operator
+    Tensor operator-(const Tensor & other) const
+    {
+        auto promotedDType = promoteDataType(dataType(), other.dataType());
+        Shape bcShape = broadcastShape(other.shape());
+        auto lhs = to(promotedDType).broadcastView(bcShape);
+        auto rhs = other.to(promotedDType).broadcastView(bcShape);
+        if (isLazyOp(lhs, &rhs)) return lazyOp(FusedOpCode::kSub, lhs, &rhs, subBackwardFunc);
+
+        auto result = operationResult(shape(), isRequireGrad() || other.isRequireGrad());
+        result.m_data->m_value = lhs.m_data->value() - rhs.m_data->value();
+        link(result, subBackwardFunc, lhs.m_data, rhs.m_data);
+        return result;
+    }
+
+    // Overload the * operator
+    Tensor operator*(const Tensor & other) const
+    {
+        auto promotedDType = promoteDataType(dataType(), other.dataType());
+        Shape bcShape = broadcastShape(other.shape());
+        auto lhs = to(promotedDType).broadcastView(bcShape);
+        auto rhs = other.to(promotedDType).broadcastView(bcShape);
+        if (isLazyOp(lhs, &rhs)) return lazyOp(FusedOpCode::kMul, lhs, &rhs, mulBackwardFunc);
+
+        auto result = operationResult(shape(), isRequireGrad() || other.isRequireGrad());
+        result.m_data->m_value = lhs.m_data->value() * rhs.m_data->value();
+        link(result, mulBackwardFunc, lhs.m_data, rhs.m_data);
+        return result;
+    }
+
+    // Overload the / operator
+    Tensor operator/(const Tensor & other) const
+    {
+        auto promotedDType = promoteDataType(dataType(), other.dataType());
+        Shape bcShape = broadcastShape(other.shape());
+        auto lhs = to(promotedDType).broadcastView(bcShape);
+        auto rhs = other.to(promotedDType).broadcastView(bcShape);
+        if (isLazyOp(lhs, &rhs)) return lazyOp(FusedOpCode::kDiv, lhs, &rhs, divBackwardFunc);
+
+        auto result = operationResult(bcShape, isRequireGrad() || other.isRequireGrad());
+        result.m_data->m_value = lhs.m_data->value() / rhs.m_data->value();
+        link(result, divBackwardFunc, lhs.m_data, rhs.m_data);
+        return result;
+    }
+
+    Tensor operator-() const
+    {
+        if (isLazyOp(*this)) return lazyOp(FusedOpCode::kNeg, *this, nullptr, unaryBackwardFunc);
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = -m_data->value();
+        link(result, unaryBackwardFunc, m_data);
+        return result;
+    }
+
+    Tensor operator+(const float & scalar) const
+    {
+        auto promotedFloatType = promoteDataTypeToFloat(dataType());
+        return *this + Tensor(scalar, shape(), { .m_dtype=promotedFloatType, .m_device=device() });
+    }
+
+    Tensor operator-(const float & scalar) const
+    {
+        auto promotedFloatType = promoteDataTypeToFloat(dataType());
+        return *this - Tensor(scalar, shape(), { .m_dtype=promotedFloatType, .m_device=device() });
+    }
+
+    Tensor operator*(const float & scalar) const
+    {
+        auto promotedFloatType = promoteDataTypeToFloat(dataType());
+        return *this * Tensor(scalar, shape(), { .m_dtype=promotedFloatType, .m_device=device() });
+    }
+
+    Tensor operator/(const float & scalar) const
+    {
+        auto promotedFloatType = promoteDataTypeToFloat(dataType());
+        return *this / Tensor(scalar, shape(), { .m_dtype=promotedFloatType, .m_device=device() });
+    }
+
+    friend Tensor operator+(float scalar, const Tensor & rhsTensor)
+    {
+        auto promotedFloatType = promoteDataTypeToFloat(rhsTensor.dataType());
+        Tensor tensor(scalar, rhsTensor.shape(), { .m_requireGrad=rhsTensor.isRequireGrad(), .m_dtype=promotedFloatType,
+                                                   .m_device=rhsTensor.device() });
+        return tensor + rhsTensor;
+    }
+
+    friend Tensor operator-(float scalar, const Tensor & rhsTensor)
+    {
+        auto promotedFloatType = promoteDataTypeToFloat(rhsTensor.dataType());
+        Tensor tensor(scalar, rhsTensor.shape(), { .m_requireGrad=rhsTensor.isRequireGrad(), .m_dtype=promotedFloatType,
+                                                   .m_device=rhsTensor.device() });
+        return tensor - rhsTensor;
+    }
+
+    friend Tensor operator*(float scalar, const Tensor & rhsTensor)
+    {
+        auto promotedFloatType = promoteDataTypeToFloat(rhsTensor.dataType());
+        Tensor tensor(scalar, rhsTensor.shape(), { .m_requireGrad=rhsTensor.isRequireGrad(), .m_dtype=promotedFloatType,
+                                                   .m_device=rhsTensor.device() });
+        return tensor * rhsTensor;
+    }
+
+    friend Tensor operator/(float scalar, const Tensor & rhsTensor)
+    {
+        auto promotedFloatType = promoteDataTypeToFloat(rhsTensor.dataType());
+        Tensor tensor(scalar, rhsTensor.shape(), { .m_requireGrad=rhsTensor.isRequireGrad(), .m_dtype=promotedFloatType,
+                                                   .m_device=rhsTensor.device() });
+        return tensor / rhsTensor;
+    }
+
+    Tensor sqrt() const
+    {
+        if (isLazyOp(*this)) return lazyOp(FusedOpCode::kSqrt, *this, nullptr, sqrtBackwardFunc);
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = m_data->value().sqrt();
+        link(result, sqrtBackwardFunc, m_data);
+        return result;
+    };
+
+    Tensor sin() const
+    {
+        if (isLazyOp(*this)) return lazyOp(FusedOpCode::kSin, *this, nullptr, sinBackwardFunc);
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = m_data->value().sin();
+        link(result, sinBackwardFunc, m_data);
+        return result;
+    };
+
+    Tensor cos() const
+    {
+        if (isLazyOp(*this)) return lazyOp(FusedOpCode::kCos, *this, nullptr, cosBackwardFunc);
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = m_data->value().cos();
+        link(result, cosBackwardFunc, m_data);
+        return result;
+    };
+
+    Tensor tanh() const
+    {
+        if (isLazyOp(*this)) return lazyOp(FusedOpCode::kTanh, *this, nullptr, tanhBackwardFunc);
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = m_data->value().tanh();
+        link(result, tanhBackwardFunc, m_data);
+        return result;
+    };
+
+    Tensor log() const
+    {
+        if (isLazyOp(*this)) return lazyOp(FusedOpCode::kLog, *this, nullptr, logBackwardFunc);
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = m_data->value().log();
+        link(result, logBackwardFunc, m_data);
+        return result;
+    };
+
+    Tensor exp() const
+    {
+        if (isLazyOp(*this)) return lazyOp(FusedOpCode::kExp, *this, nullptr, expBackwardFunc);
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = m_data->value().exp();
+        link(result, expBackwardFunc, m_data);
+        return result;
+    };
+
+    // In-place operations write the result into the storage of the tensor, which must be contiguous. The other operand
+    // is broadcast to the shape of the tensor and converted to its data type. When gradients are recorded, this handle
+    // is linked to a new node of the result, and the previous node keeps the graph of the previous value. The copies
+    // of the handle made before the operation share the storage but not the new node.
+    Tensor & add_(const Tensor & other)   { return inPlaceOp(&TensorValue::add, other, addBackwardFunc); }
+    Tensor & sub_(const Tensor & other)   { return inPlaceOp(&TensorValue::sub, other, subBackwardFunc); }
+    Tensor & mul_(const Tensor & other)   { return inPlaceOp(&TensorValue::mul, other, mulInPlaceBackwardFunc, true); }
+    Tensor & div_(const Tensor & other)   { return inPlaceOp(&TensorValue::div, other, divInPlaceBackwardFunc); }
+    Tensor & add_(float scalar)           { return add_(scalarLike(scalar)); }
+    Tensor & sub_(float scalar)           { return sub_(scalarLike(scalar)); }
+    Tensor & mul_(float scalar)           { return mul_(scalarLike(scalar)); }
+    Tensor & div_(float scalar)           { return div_(scalarLike(scalar)); }
+
+    Tensor & sqrt_()    { return inPlaceOp([](TensorValue & value) { value.sqrt(value); }, sqrtInPlaceBackwardFunc); }
+    Tensor & tanh_()    { return inPlaceOp([](TensorValue & value) { value.tanh(value); }, tanhInPlaceBackwardFunc); }
+    Tensor & exp_()     { return inPlaceOp([](TensorValue & value) { value.exp(value);  }, expInPlaceBackwardFunc);  }
+
+    // Copies the elements of the source, which is broadcast to the shape of the tensor.
+    Tensor & copy_(const Tensor & src)
+    {
+        return inPlaceOp([](const TensorValue &, const TensorValue & source, TensorValue & out) -> TensorValue &
+                         {
+                             return source.contiguous(out);
+                         }, src, copyInPlaceBackwardFunc);
+    }
+
+    // Fills the tensor with the value. The result is a constant that does not require gradients.
+    Tensor & fill_(float value)
+    {
+        return inPlaceOp([value](TensorValue & tensorValue) { tensorValue.fill(value); }, nullptr);
+    }
+    Tensor & zero_()    { return fill_(0); }
+
+    Tensor sum() const
+    {
+        Tensor result({}, { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
+        result.m_data->m_value = m_data->value().sum();
+        link(result, sumBackwardFunc, m_data);
+        return result;
+    }
+
+    Tensor sum(ssize_t dim, bool keepDim=false) const
+    {
+        Tensor result({}, { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
+        result.m_data->m_value = m_data->value().sum(dim, keepDim);
+        result.m_data->m_dim0 = dim >= 0 ? dim : dim + m_data->m_value.shape().size();
+        result.m_data->m_keepDim = keepDim;
+        link(result, sumBackwardFunc2, m_data);
+        return result;
+    }
+
+    Tensor mean() const
+    {
+        return sum() / value().size();
+    }
+
+    Tensor mean(ssize_t dim, bool keepDim=false) const
+    {
+        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
+        return sum(dim, keepDim) / value().shape()[dim];
+    }
+
+    Tensor max() const
+    {
+        Tensor result({}, { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
+        result.m_data->m_value = m_data->value().max();
+        link(result, maxBackwardFunc, m_data);
+        return result;
+    }
+
+    Tensor max(ssize_t dim, bool keepDim=false) const
+    {
+        Tensor result({}, { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
+        result.m_data->m_value = m_data->value().max(dim, keepDim);
+        result.m_data->m_dim0 = dim >= 0 ? dim : dim + m_data->m_value.shape().size();
+        link(result, maxBackwardFunc2, m_data);
+        return result;
+    }
+
+    Tensor softmax(ssize_t dim) const
+    {
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = m_data->value().softmax(dim);
+        result.m_data->m_dim0 = dim >= 0 ? dim : dim + std::max<size_t>(shape().size(), 1);
+        link(result, softmaxBackwardFunc, m_data);
+        return result;
+    }
+
+    Tensor logSoftmax(ssize_t dim) const
+    {
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = m_data->value().logSoftmax(dim);
+        result.m_data->m_dim0 = dim >= 0 ? dim : dim + std::max<size_t>(shape().size(), 1);
+        link(result, logSoftmaxBackwardFunc, m_data);
+        return result;
+    }
+
+    // Returns the cross-entropy loss of the lines of logits along the dimension, which fuses logSoftmax and the
+    // negative log-likelihood of the target probabilities. The result has the shape of the logits without the
+    // dimension.
+    Tensor crossEntropy(const Tensor & targets, ssize_t dim) const
+    {
+        auto value = m_data->value().crossEntropy(targets.value(), dim);
+        auto result = operationResult(value.shape(), isRequireGrad() || targets.isRequireGrad());
+        result.m_data->m_value = std::move(value);
+        result.m_data->m_dim0 = dim >= 0 ? dim : dim + std::max<size_t>(shape().size(), 1);
+        link(result, crossEntropyBackwardFunc, m_data, targets.m_data);
+        return result;
+    }
+
+    Tensor argmax() const
+    {
+        Tensor result({}, { .m_requireGrad=false, .m_dtype=dataType(), .m_device=device() });
+        result.m_data->m_value = m_data->value().argmax();
+        // argmax does not require gradient.
+        return result;
+    }
+
+    Tensor argmax(ssize_t dim, bool keepDim=false) const
+    {
+        Tensor result({}, { .m_requireGrad=false, .m_dtype=dataType(), .m_device=device() });
+        result.m_data->m_value = m_data->value().argmax(dim, keepDim);
+        // argmax does not require gradient.
+        return result;
+    }
+
+    Tensor pow(float exp) const
+    {
+        TensorOptions opt{ .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() };
+        Tensor expTensor(exp, shape(), opt);
+        Tensor result(shape(), opt);
+        result.m_data->m_value = m_data->value().pow(expTensor.m_data->value());
+        link(result, powBackwardFunc, m_data, expTensor.m_data);
+        return result;
+    }
+
+    Tensor pow(const Tensor & other) const
+    {
+        auto promotedDType = promoteDataType(dataType(), other.dataType());
+        Shape bcShape = broadcastShape(other.shape());
+        auto lhs = to(promotedDType).broadcastView(bcShape);
+        auto rhs = other.to(promotedDType).broadcastView(bcShape);        // Exponent tensor.
+
+        auto result = operationResult(bcShape, isRequireGrad());
+        result.m_data->m_value = lhs.m_data->value().pow(rhs.m_data->value());
+        link(result, powBackwardFunc, lhs.m_data, rhs.m_data);
+        return result;
+    }
+
+    Tensor matmul(const Tensor & other) const
+    {
+        auto promotedDType = promoteDataType(dataType(), other.dataType());
+        auto lhs = to(promotedDType);
+        auto rhs = other.to(promotedDType);
+
+        auto resultShape = TensorValue::matmulShape(lhs.shape(), false, rhs.shape(), false);
+        auto result = operationResult(resultShape, isRequireGrad() || rhs.isRequireGrad());
+        result.m_data->m_value = lhs.m_data->value().matmul(rhs.m_data->value());
+        link(result, matmulBackwardFunc, lhs.m_data, rhs.m_data);
+        return result;
+    }
+
+    // Multiplies the last dimension with quantized weights, see TensorValue::matmulQuantized(). The weights are frozen
+    // and no gradient is recorded, so the operation is for inference.
+    Tensor matmulQuantized(const Tensor & weights, const QuantizedLayout & layout) const
+    {
+        Tensor result({}, { .m_requireGrad=false, .m_dtype=dataType(), .m_device=device() });
+        result.m_data->m_value = m_data->value().matmulQuantized(weights.value(), layout);
+        return result;
+    }
 
-    // Constructor.
-    explicit Tensor(const void* data, size_t size, DataType srcDType, const Shape & shape, const TensorOptions & opt = {})
-    {
-        // Create a new Tensor Graph Node.
-        m_data = std::make_shared<TensorNode>(TensorValue{data, size, srcDType, shape, opt.m_device, opt.m_dtype},
-                                              opt.m_requireGrad);
-        m_data->m_backwardFunc = defaultBackward;
+    // Returns activation(x * weights + bias) of this [..., inputs] tensor x, the [inputs, outputs] weights and the
+    // bias of the outputs. A single matrix multiplication adds the bias and applies the activation in its epilogue,
+    // see TensorValue::linear().
+    Tensor linear(const Tensor & weights, const Tensor & bias, Activation activation = Activation::kNone) const
+    {
+        auto promotedDType = promoteDataType(promoteDataType(dataType(), weights.dataType()), bias.dataType());
+        auto x = to(promotedDType);
+        auto w = weights.to(promotedDType);
+        auto b = bias.to(promotedDType);
+
+        // The derivative of GeLU needs the values before the activation, the others are computed from the result.
+        bool requireGrad = x.isRequireGrad() || w.isRequireGrad() || b.isRequireGrad();
+        bool savePreActivation = requireGrad && GradMode::isEnabled() && activation == Activation::kGeLU;
+        TensorValue preActivation;
+        auto value = x.m_data->value().linear(w.m_data->value(), b.m_data->value(), activation,
+                                              savePreActivation ? &preActivation : nullptr);
+        auto result = x.operationResult(value.shape(), requireGrad);
+        result.m_data->m_value = std::move(value);
+        result.m_data->m_activation = activation;
+        result.m_data->m_saved = std::move(preActivation);
+        link(result, linearBackwardFunc, x.m_data, w.m_data);
+        if (GradMode::isEnabled()) result.m_data->m_aMulti.emplace_back(b.m_data);
+        return result;
     }
 
-    // Constructor.
-    explicit Tensor(const std::shared_ptr<TensorStorage>& storage, size_t size, size_t offset, const Shape & shape,
-                    const TensorOptions & opt = {})
+    Tensor transpose(ssize_t dim0, ssize_t dim1) const
     {
-        m_data = std::make_shared<TensorNode>(TensorValue{storage, size, offset, shape, opt.m_device, opt.m_dtype},
-                                              opt.m_requireGrad);
-        m_data->m_backwardFunc = defaultBackward;
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = m_data->value().transpose(dim0, dim1);
+        result.m_data->m_dim0 = dim0;
+        result.m_data->m_dim1 = dim1;
+        link(result, transposeBackwardFunc, m_data);
+        return result;
     }
 
-    // Constructor.
-    explicit Tensor(float value, const Shape & shape, const TensorOptions & opt = {})
+    Tensor permute(const SIndex& dims) const
     {
-        // Create a new Tensor Graph Node.
-        m_data = std::make_shared<TensorNode>(TensorValue{value, shape, opt.m_device, opt.m_dtype}, opt.m_requireGrad);
-        m_data->m_backwardFunc = defaultBackward;
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = m_data->value().permute(dims);
+        result.m_data->m_dims = dims;
+        link(result, permuteBackwardFunc, m_data);
+        return result;
     }
 
-    // Constructor.
-    explicit Tensor(const Shape & shape, const TensorOptions & opt = {})
+    Tensor slice(ssize_t dim=0, std::optional<ssize_t> startOpt = std::nullopt,
+                 std::optional<ssize_t> endOpt = std::nullopt, ssize_t step=1) const
     {
-        // Create a new Tensor Graph Node.
-        m_data = std::make_shared<TensorNode>(shape, opt.m_device, opt.m_requireGrad, opt.m_dtype);
-        m_data->m_backwardFunc = defaultBackward;
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = m_data->value().slice(dim, startOpt, endOpt, step);
+        result.m_data->m_dim0 = dim;
+        result.m_data->m_dim1 = step;
+        result.m_data->m_start = startOpt;
+        result.m_data->m_end = endOpt;
+        link(result, sliceBackwardFunc, m_data);
+        return result;
     }
 
-    // Perform backpropagation to calculate gradients recursively.
-    void backward(float value=1)  { m_data->backward(TensorValue{value, m_data->m_a->m_value.shape(), device(), dataType()}); }
-    void backward(float value, const Shape & gradShape)  { m_data->backward(TensorValue{value, gradShape, device(), dataType()}); }
+    Tensor squeeze(ssize_t dim) const
+    {
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = m_data->value().squeeze(dim);
+        result.m_data->m_dim0 = dim;
+        link(result, squeezeBackwardFunc, m_data);
+        return result;
+    }
 
-    // Getters and setters for the tensor's value.
-    inline const TensorValue & value() const    { return m_data->m_value; }
-    inline TensorValue & value()                { return m_data->m_value; }
-    inline const Shape & shape() const          { return m_data->m_value.shape(); }
-    inline DataType dataType() const            { return m_data->m_value.dataType(); }
+    Tensor unsqueeze(ssize_t dim) const
+    {
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = m_data->value().unsqueeze(dim);
+        result.m_data->m_dim0 = dim;
+        link(result, unsqueezeBackwardFunc, m_data);
+        return result;
+    }
 
-    // Gradient-related methods.
-    inline const TensorValue & grad() const
+    Tensor var(bool unbiased=true) const
     {
-        validateRetainGradientState();
-        return m_data->grad();
+        auto deviation = *this - mean();
+        auto elementCount = unbiased ? deviation.value().size() - 1 : deviation.value().size();
+        return (deviation * deviation).sum() / float(elementCount);
     }
 
-    inline TensorValue & grad()
+    Tensor var(ssize_t dim, bool unbiased=true, bool keepdim=false) const
     {
-        validateRetainGradientState();
-        return m_data->grad();
+        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
+        auto deviation = *this - mean(dim, true);
+        auto elementCount = unbiased ? shape()[dim] - 1 : shape()[dim];
+        auto var = (deviation * deviation).sum(dim, true) / float(elementCount);
+        return keepdim ? var : var.squeeze(dim);
     }
 
-    inline void zeroGrad()                      { m_data->grad().fill(0); }
-    inline bool isRequireGrad() const           { return m_data->m_requireGrad; }
-    inline void retainGrad() const              { m_data->m_retainGrad = true; m_data->grad().fill(0); }
-    inline const Tensor& requireGrad(bool state) const
+    Tensor select(ssize_t dim, ssize_t index) const
     {
-        m_data->m_requireGrad = m_data->m_retainGrad = state;
-        return *this;
+        if (shape().empty())
+        {
+            throw std::invalid_argument("select() cannot be applied to a scalar, zero-dimension, tensor.");
+        }
+        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
+        index = index < 0 ? static_cast<ssize_t>(shape()[dim]) + index : index;
+        return slice(dim, index, index + 1, 1).squeeze(dim);
     }
 
-    inline Device * device() const              { return m_data->device(); }
+    std::vector<Tensor> split(ssize_t splitSize, ssize_t dim=0) const
+    {
+        if (splitSize < 0)
+        {
+            throw std::invalid_argument("Split size must be a positive number.");
+        }
 
-    inline void name(const std::string& name) const  { m_data->m_name = name; }
-    inline const std::string& name() const           { return m_data->m_name; }
+        if (shape().empty())
+        {
+            throw std::invalid_argument("Split operation needs at least a 1-dim tensor.");
+        }
 
-    // Returns a new Tensor with a new shape.
-    Tensor reshape(const Shape & newShape) const
-    {
-        size_t newSize = std::accumulate(newShape.begin(), newShape.end(), 1, std::multiplies<>());
-        if (value().size() != newSize)
+        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
+        if (dim < 0 || dim >= static_cast<ssize_t>(shape().size()))
         {
-            throw std::invalid_argument("Reshape error: element count mismatch (" +
-                                        std::to_string(value().size()) + " vs " + std::to_string(newSize) + ").");
+            throw std::invalid_argument("Split dimension is out of range.");
         }
 
-        auto& tv = m_data->m_value;
-        TensorOptions opt{ .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() };
-        Tensor result{tv.storage(), tv.size(), tv.storageOffset(), newShape, opt};
-        result.m_data->m_a = m_data;
-        result.m_data->m_backwardFunc = reshapeBackwardFunc;
-        return result;
+        std::vector<Tensor> tensors;        // Stores splitted tensors.
+        for (size_t i = 0; i < shape()[dim]; i += splitSize)
+        {
+            tensors.emplace_back(slice(dim, i, i + splitSize, 1));
+        }
+        return tensors;
     }
 
-    // Returns a new Tensor with a new shape. This method accepts one inferred dimension.
-    Tensor reshape(const std::initializer_list<ssize_t>& newShape) const
+    Tensor tril(ssize_t diagonal=0) const
     {
-        return reshape(shapeWithInferredDimToShape(newShape));
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = m_data->value().tril(diagonal);
+        result.m_data->m_dim0 = diagonal;
+        link(result, trillBackwardFunc, m_data);
+        return result;
     }
 
-    Tensor broadcastTo(const Shape & newShape) const
+    Tensor triu(ssize_t diagonal=0) const
     {
-        if (shape() == newShape) return *this;
-        TensorValue tValue = m_data->m_value.broadcastTo(newShape);
-        Tensor result{tValue.data(), tValue.size(), tValue.dataType(), tValue.shape(),
-                      { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device()}};
-        result.m_data->m_a = m_data;            // Keep the reference to the original tensor node
-        result.m_data->m_backwardFunc = broadcastBackwardFunc;
+        auto result = operationResult(shape(), isRequireGrad());
+        result.m_data->m_value = m_data->value().triu(diagonal);
+        result.m_data->m_dim0 = diagonal;
+        link(result, triuBackwardFunc, m_data);
         return result;
     }
 
-    // Set operation device for the tensor.
-    inline Tensor to(std::unique_ptr<Device>& device) const    { return to(*device); }
-    inline Tensor to(std::shared_ptr<Device>& device) const    { return to(*device); }
-    inline Tensor to(Device* device) const                     { return to(*device); }
-    Tensor to(Device& newDevice) const
+    Tensor indexSelect(ssize_t dim, const Tensor& indices) const
     {
-        if (&newDevice == m_data->device()) return *this;
-        Tensor result{shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=&newDevice }};
-        result.m_data->m_value = m_data->m_value.to(&newDevice);
-        result.m_data->m_a = m_data;
-        result.m_data->m_backwardFunc = toDeviceBackwardFunc;
+        if (indices.shape().size() > 1)
+        {
+            throw std::invalid_argument("Indices supposed to be a vector.");
+        }
+
+        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
+
+        if ((!shape().empty() && (dim < 0 || static_cast<size_t>(dim) >= shape().size())) ||
+            (shape().empty() && dim != 0))
+        {
+            throw std::invalid_argument("Dimension is out of range for indexSelect operation.");
+        }
+
+        auto newShape = shape();
+        if (!newShape.empty())
+        {
+            newShape[dim] = !indices.shape().empty() ? indices.shape()[0] : 1;
+        }
+
+        auto result = operationResult(newShape, isRequireGrad());
+        result.m_data->m_value = m_data->value().indexSelect(dim, indices.value());
+        result.m_data->m_dim0 = dim;
+        result.m_data->m_indices = indices.value();
+        link(result, indexSelectBackwardFunc, m_data);
         return result;
     }
 
-    Tensor to(DataType newDataType) const
+    // Runs the function without recording its graph and records a single node for its result instead, which keeps
+    // only the input alive. The backward pass of the node runs the function again with the graph to compute the
+    // gradients of the input and of the parameters that the function uses. The function must be deterministic.
+    static Tensor checkpoint(const std::function<Tensor(const Tensor &)> & func, const Tensor & x, bool requireGrad)
     {
-        if (dataType() == newDataType) return *this;
-        TensorOptions opt{ .m_requireGrad=isRequireGrad(), .m_dtype=newDataType, .m_device=device() };
-        Tensor result{value().data(), value().size(), value().dataType(), value().shape(), opt};
-        result.m_data->m_a = m_data;
-        result.m_data->m_backwardFunc = toDataTypeBackwardFunc;
+        if (!GradMode::isEnabled()) return func(x);
+
+        Tensor output;
+        {
+            NoGradGuard guard;
+            output = func(x);
+        }
+
+        Tensor result;
+        result.m_data = std::make_shared<TensorNode>(output.value().broadcastView(output.shape()), requireGrad);
+        result.m_data->m_backwardFunc = defaultBackward;
+        if (!requireGrad) return result;
+
+        result.m_data->m_a = x.m_data;
+        result.m_data->saveVersions(TensorNode::kSavedA);
+        result.m_data->m_backwardFunc = [func](TensorNode * node, const TensorValue & seed)
+        {
+            // The recomputed graph starts from a leaf that shares the value of the input.
+            GradModeGuard guard(true);
+            Tensor input;
+            const auto & value = node->m_a->value();
+            input.m_data = std::make_shared<TensorNode>(value.broadcastView(value.shape()), node->m_a->m_requireGrad);
+            input.m_data->m_retainGrad = node->m_a->m_requireGrad;
+            input.m_data->m_backwardFunc = defaultBackward;
+
+            auto recomputed = func(input);
+            if (recomputed.m_data == input.m_data)
+            {
+                node->m_a->accumulateSeed(seed);
+                return;
+            }
+            if (recomputed.isRequireGrad())
+            {
+                recomputed.m_data->backward(seed);
+            }
+            if (input.m_data->m_retainGrad)
+            {
+                node->m_a->accumulateSeed(std::move(input.m_data->grad()));
+            }
+        };
         return result;
     }
 
-    static void defaultBackward(TensorNode * node, const TensorValue & seed)
+    static Tensor cat(const std::vector<Tensor>& tensors, ssize_t dim)
     {
-        if (node->m_requireGrad && !node->m_retainGrad)
+        if (tensors.empty())
         {
-            assert(node->grad().dataType() == seed.dataType());
-            node->grad() += seed;
+            throw std::invalid_argument("cat() operation needs at least one tensor.");
         }
-    }
 
-    static void reshapeBackwardFunc(TensorNode * node, const TensorValue & seed)
-    {
-        if (!node->m_a) return;
-        node->m_a->backward(seed.reshape(node->m_a->m_value.shape()));
-    }
+        const auto& tensor = tensors[0];
 
-    static void broadcastBackwardFunc(TensorNode * node, const TensorValue & seed)
-    {
-        if (!node->m_a) return;
-        // Accumulate the gradient to the original node by reducing the gradient from the broadcasted shape to the
-        // original shape. Summation is used for gradient accumulation when reducing dimensions because each element
-        // of the original tensor contributes to multiple elements of the resulting tensor after broadcasting.
-        node->m_a->backward(seed.reduceTo(node->m_a->m_value.shape()));
-    }
+        if (tensor.shape().empty())
+        {
+            throw std::invalid_argument("Zero-dimensional tensor cannot be concatenated.");
+        }
 
-    static void toDeviceBackwardFunc(TensorNode * node, const TensorValue & seed)
-    {
-        if (!node->m_a) return;
-        if (seed.device() != node->m_a->m_value.device())
+        if (tensors.size() == 1) return tensor;
+
+        dim = dim < 0 ? static_cast<ssize_t>(tensor.shape().size()) + dim : dim;
+        if (dim < 0 || dim >= static_cast<ssize_t>(tensor.shape().size()))
         {
-            // Synchronize seed to ensure the seed's data is available before copying it to a different device.
-            seed.device()->synchronize();
+            throw std::invalid_argument("Dimension is out of range for cat() operation.");
         }
-        node->m_a->backward(seed.to(node->m_a->m_value.device()));
-    }
 
-    static void toDataTypeBackwardFunc(TensorNode * node, const TensorValue & seed)
-    {
-        if (!node->m_a) return;
-        // Ensure that the seed gradient is converted back to the data type of the original tensor.
-        node->m_a->backward(seed.to(node->m_a->m_value.dataType()));
-    }
+        bool requireGrad = tensor.isRequireGrad();
+        DataType promotedDType = tensor.dataType();
+        // Tensor shapes must be the same.
+        for (size_t i=0; i<tensors.size()-1; ++i)
+        {
+            auto shape1 = tensors[i].shape();
+            auto shape2 = tensors[i+1].shape();
+            shape1[dim] = shape2[dim] = 0;      // Neutralize dimension sizes for comparison.
 
-    static void addBackwardFunc(TensorNode * node, const TensorValue & seed)
-    {
-        if (!node->m_a || !node->m_b) return;
-        // Calculate gradients.
-        node->m_a->backward(seed);
-        node->m_b->backward(seed);
-    }
+            if (shape1 != shape2)
+            {
+                throw std::invalid_argument("Dimension sizes of tensors must match except in dimension " +
+                                            std::to_string(dim) + " for the cat() operation.");
+            }
+            if (tensors[i].device() != tensors[i+1].device())
+            {
+                throw std::invalid_argument("Tensor devices must be the same for the cat() operation.");
+            }
+            requireGrad |= tensors[i+1].isRequireGrad();
+            promotedDType = promoteDataType(promotedDType, tensors[i+1].dataType());
+        }
 
-    static void subBackwardFunc(TensorNode * node, const TensorValue & seed)
-    {
-        if (!node->m_a || !node->m_b) return;
-        // Calculate gradients.
-        node->m_a->backward(seed);
-        node->m_b->backward(-seed);
+        auto newShape = tensor.shape();
+        for (size_t i=1; i<tensors.size(); ++i)
+            newShape[dim] += tensors[i].shape()[dim];
+
+        size_t dimSize = 0;
+        Tensor result(newShape, { .m_requireGrad=requireGrad, .m_dtype=promotedDType, .m_device=tensor.device() });
+        for (size_t i=0; i<tensors.size(); ++i)
+        {
+            result.value().sliceSet(tensors[i].to(promotedDType).value(), dim, dimSize, dimSize + tensors[i].shape()[dim], 1, true);
+            // Store original tensors for the back prop.
+            if (GradMode::isEnabled()) result.m_data->m_aMulti.emplace_back(tensors[i].m_data);
+            dimSize += tensors[i].shape()[dim];
+        }
+        result.m_data->m_dim0 = dim;
+        link(result, catBackwardFunc, nullptr);
+        return result;
     }
 
-    static void mulBackwardFunc(TensorNode * node, const TensorValue & seed)
+    // Friend function to overload operator<<
+    inline friend std::ostream & operator<<(std::ostream& os, const Tensor& tensor);
+
+protected:
+    inline Shape broadcastShape(const Shape& otherShape) const
     {
-        if (!node->m_a || !node->m_b) return;
-        // Calculate gradients.
-        node->m_a->backward(node->m_b->m_value * seed);
-        node->m_b->backward(node->m_a->m_value * seed);
+        return shape() == otherShape ? shape() : TensorValue::broadcastShapes(shape(), otherShape);
     }
 
-    static void divBackwardFunc(TensorNode * node, const TensorValue & seed)
+    // Returns a broadcasted view for element-wise operations, which read the value of the view without a copy.
+    Tensor broadcastView(const Shape & newShape) const
     {
-        if (!node->m_a || !node->m_b) return;
-        // Calculate gradients.
-        node->m_a->backward(seed / node->m_b->m_value);                                               // ∂f/∂a = 1 / b
-        node->m_b->backward(-node->m_a->m_value * seed / (node->m_b->m_value * node->m_b->m_value));  // ∂f/∂b = -a / b^2
+        if (shape() == newShape) return *this;
+        Tensor result;
+        result.m_data = std::make_shared<TensorNode>(m_data->value().broadcastView(newShape), isRequireGrad());
+        result.m_data->m_backwardFunc = defaultBackward;
+        link(result, broadcastBackwardFunc, m_data);
+        return result;
     }
 
-    static void unaryBackwardFunc(TensorNode * node, const TensorValue & seed)
+    // Runs an in-place operation with another operand. The previous value of the tensor is saved for the gradient of
+    // the other operand if it is requested and the other operand requires gradients.
+    template<typename F>
+    Tensor & inPlaceOp(const F & func, const Tensor & other,
+                       void (*backwardFunc)(TensorNode * node, const TensorValue & seed), bool savePrevious = false)
     {
-        if (!node->m_a) return;
-        // Calculate gradients.
-        node->m_a->backward(-seed);
+        auto requireGrad = validateInPlaceOp(other.isRequireGrad());
+        auto rhs = other.to(dataType()).broadcastView(shape());
+        auto rhsVersion = rhs.value().version();
+
+        TensorValue previous;
+        if (requireGrad && savePrevious && other.isRequireGrad()) previous = value();
+        std::invoke(func, value(), rhs.value(), value());
+        if (!requireGrad) return *this;
+
+        recordInPlaceOp(backwardFunc, rhs.m_data);
+        m_data->m_saved = std::move(previous);
+        // A gradient that reads the other operand fails if the operation overwrote it, for example in x.mul_(x).
+        m_data->m_bVersion = rhsVersion;
+        return *this;
     }
 
-    static void sqrtBackwardFunc(TensorNode * node, const TensorValue & seed)
+    // Runs an in-place operation without another operand. A missing backward function makes the result a constant.
+    template<typename F>
+    Tensor & inPlaceOp(const F & func, void (*backwardFunc)(TensorNode * node, const TensorValue & seed))
     {
-        if (!node->m_a) return;
-        // The derivative of sqrt(a) with respect to 'a' is 0.5/sqrt(a).
-        // Therefore, the gradient of the input is multiplied by 0.5/sqrt(a).
-        node->m_a->backward(0.5 / node->m_a->m_value.sqrt() * seed);   // ∂f/∂a = 0.5/sqrt(a)
+        auto requireGrad = validateInPlaceOp(false);
+        func(value());
+        if (!requireGrad) return *this;
+        if (!backwardFunc)
+        {
+            m_data = std::make_shared<TensorNode>(value().broadcastView(shape()), false);
+            m_data->m_backwardFunc = defaultBackward;
+            return *this;
+        }
+        recordInPlaceOp(backwardFunc, nullptr);
+        return *this;
     }
 
-    static void sinBackwardFunc(TensorNode * node, const TensorValue & seed)
+    // Validates the tensor of an in-place operation and returns true if the operation must be recorded.
+    bool validateInPlaceOp(bool isOtherRequireGrad) const
     {
-        if (!node->m_a) return;
-        // The derivative of sin(a) with respect to 'a' is cos(a).
-        // Therefore, the gradient of the input is multiplied by cos(a).
-        node->m_a->backward(node->m_a->m_value.cos() * seed);   // ∂f/∂a = cos(a)
+        bool isLeaf = !m_data->m_a && !m_data->m_b && m_data->m_aMulti.empty();
+        if (GradMode::isEnabled() && isRequireGrad() && isLeaf)
+        {
+            throw std::invalid_argument("In-place operations are not supported on leaf tensors that require gradients."
+                                        " Use the no-grad mode to update them.");
+        }
+        if (!value().isContiguous())
+        {
+            throw std::invalid_argument("In-place operations require a contiguous tensor.");
+        }
+        return GradMode::isEnabled() && (isRequireGrad() || isOtherRequireGrad);
     }
 
-    static void cosBackwardFunc(TensorNode * node, const TensorValue & seed)
+    // Links this handle to a new node that shares the storage of the result.
+    void recordInPlaceOp(void (*backwardFunc)(TensorNode * node, const TensorValue & seed),
+                         const std::shared_ptr<TensorNode> & other)
     {
-        if (!node->m_a) return;
-        // The derivative of cos(a) with respect to 'a' is -sin(a).
-        // Therefore, the gradient of the input is multiplied by -sin(a).
-        node->m_a->backward(-node->m_a->m_value.sin() * seed);   // ∂f/∂a = -sin(a)
+        Tensor result;
+        result.m_data = std::make_shared<TensorNode>(value().broadcastView(shape()), true);
+        link(result, backwardFunc, m_data, other);
+        m_data = std::move(result.m_data);
     }
 
-    static void tanhBackwardFunc(TensorNode * node, const TensorValue & seed)
+    // Returns a scalar operand of an in-place operation.
+    Tensor scalarLike(float scalar) const
     {
-        if (!node->m_a) return;
-        // The derivative of tanh(a) with respect to 'a' is 1 - tanh^2(a).
-        // Therefore, the gradient of the input is multiplied by (1 - tanh^2(a)).
-        const auto & tanhValue = node->m_a->m_value.tanh();
-        node->m_a->backward((float(1) - tanhValue * tanhValue) * seed);  // ∂f/∂a = (1 - tanh^2(a))
+        return Tensor{scalar, Shape{}, { .m_dtype=dataType(), .m_device=device() }};
     }
 
-    static void logBackwardFunc(TensorNode * node, const TensorValue & seed)
+    inline void validateRetainGradientState() const
     {
-        if (!node->m_a) return;
-        // TODO: Handle division by zero case.
-        // The derivative of log(a) with respect to 'a' is 1/a.
-        node->m_a->backward(seed / node->m_a->m_value);  // ∂f/∂a = 1/a
+        if (!m_data->m_requireGrad && !m_data->m_retainGrad)
+        {
+            throw std::runtime_error("Gradients for non-leaf tensors won’t be populated during automatic gradient"
+                                     " calculation. Use .retainGrad() on the non-leaf tensor if needed, or access"
+                                     " the leaf tensor instead.");
+        }
     }
 
-    static void expBackwardFunc(TensorNode * node, const TensorValue & seed)
+    // Lazy evaluation is supported only for floating point data types.
+    static inline bool isLazyDataType(DataType dtype)
     {
-        if (!node->m_a) return;
-        // The derivative of exp(a) with respect to 'a' is exp(a), itself.
-        node->m_a->backward(seed * node->m_a->m_value.exp());  // ∂f/∂a = exp(a)
+        return promoteDataTypeToFloat(dtype) == dtype;
     }
 
-    static void maxBackwardFunc(TensorNode * node, const TensorValue & seed)
+    // Returns true if an element-wise operation on the given tensors should be recorded instead of being executed.
+    static bool isLazyOp(const Tensor & a, const Tensor * b = nullptr)
     {
-        if (!node->m_a) return;
-        // The derivative of max(a) with respect to 'a' is a zero tensor with argmax index set to 1.
-        node->m_a->backward(seed * node->m_a->m_value.argmaxIndices());
+        return LazyMode::isEnabled() && isLazyDataType(a.dataType()) &&
+               (!b || (b->shape() == a.shape() && b->dataType() == a.dataType() && b->device() == a.device()));
     }
 
-    static void maxBackwardFunc2(TensorNode * node, const TensorValue & seed)
+    // Records an element-wise operation, which is evaluated when the value of the result is requested. The inputs are
+    // linked in no-grad mode as well since the fused kernel reads them, but they are released once it runs.
+    static Tensor lazyOp(FusedOpCode opCode, const Tensor & a, const Tensor * b,
+                         void (*backwardFunc)(TensorNode * node, const TensorValue & seed))
     {
-        if (!node->m_a) return;
-        // The derivative of max(a) with respect to 'a' is a zero tensor with max indexes set to 1.
-        node->m_a->backward(seed * node->m_a->m_value.argmaxIndices(static_cast<ssize_t>(node->m_dim0)));
+        Tensor result;
+        bool requireGrad = GradMode::isEnabled() && (a.isRequireGrad() || (b && b->isRequireGrad()));
+        result.m_data = std::make_shared<TensorNode>(TensorValue::placeholder(a.shape(), a.device(), a.dataType()),
+                                                     requireGrad);
+        result.m_data->m_lazyOpCode = opCode;
+        result.m_data->m_a = a.m_data;
+        result.m_data->m_b = b ? b->m_data : nullptr;
+        result.m_data->m_isRecorded = GradMode::isEnabled();
+        result.m_data->m_backwardFunc = result.m_data->m_isRecorded ? backwardFunc : defaultBackward;
+        result.m_data->saveVersions(result.m_data->m_isRecorded ? savedValues(backwardFunc) : 0);
+        return result;
     }
 
-    static void powBackwardFunc(TensorNode * node, const TensorValue & seed)
+    // Returns the result of an operation that assigns its value. The value has no storage until it is assigned.
+    Tensor operationResult(const Shape & shape, bool requireGrad) const
     {
-        if (!node->m_a || !node->m_b) return;
-        // The derivative of pow(a, b) with respect to 'a' is b * a^(b-1).
-        // ∂f/∂a = b * pow(a, b-1)
-        node->m_a->backward(seed * node->m_b->m_value * node->m_a->m_value.pow(node->m_b->m_value - float(1)));
+        Tensor result;
+        auto value = TensorValue::placeholder(shape, device(), dataType());
+        result.m_data = std::make_shared<TensorNode>(std::move(value), requireGrad);
+        result.m_data->m_backwardFunc = defaultBackward;
+        return result;
     }
 
-    static void matmulBackwardFunc(TensorNode * node, const TensorValue & seed)
+    // Links the result of an operation to its inputs for backpropagation. In no-grad mode, the result is a value-only
+    // tensor that does not require gradients.
+    static void link(const Tensor & result, void (*backwardFunc)(TensorNode * node, const TensorValue & seed),
+                     const std::shared_ptr<TensorNode> & a, const std::shared_ptr<TensorNode> & b = nullptr)
     {
-        if (!node->m_a || !node->m_b) return;
-        // Assuming m_a and m_b are the input matrices a and b, respectively,
-        // and seed is ∂E/∂c, the gradient of the loss with respect to the output matrix c.
-        // Compute gradients with respect to a and b
-
-        // Corrected to use matrix multiplication for backward pass calculations
-        node->m_a->backward(seed.matmul(node->m_b->m_value.transpose(0, 1)));      // ∂E/∂a = ∂E/∂c * b^T
-        node->m_b->backward(node->m_a->m_value.transpose(0, 1).matmul(seed));      // ∂E/∂b = a^T * ∂E/∂c
+        if (!GradMode::isEnabled())
+        {
+            result.m_data->m_requireGrad = false;
+            result.m_data->m_isRecorded  = false;
+            return;
+        }
+        result.m_data->m_a = a;
+        result.m_data->m_b = b;
+        result.m_data->m_backwardFunc = backwardFunc;
+        result.m_data->saveVersions(savedValues(backwardFunc));
     }
 
-    static void transposeBackwardFunc(TensorNode * node, const TensorValue & seed)
+    // Returns the SavedValue flags of the values that the backward function reads. The backward functions that are
+    // not listed read both inputs.
+    static uint8_t savedValues(void (*backwardFunc)(TensorNode * node, const TensorValue & seed))
     {
-        if (!node->m_a) return;
-        node->m_a->backward(seed.transpose(node->m_dim0, node->m_dim1));
+        for (auto func : { defaultBackward, reshapeBackwardFunc, broadcastBackwardFunc, toDeviceBackwardFunc,
+                           toDataTypeBackwardFunc, addBackwardFunc, subBackwardFunc, unaryBackwardFunc,
+                           transposeBackwardFunc, permuteBackwardFunc, sliceBackwardFunc, sumBackwardFunc,
+                           sumBackwardFunc2, squeezeBackwardFunc, unsqueezeBackwardFunc, trillBackwardFunc,
+                           triuBackwardFunc, indexSelectBackwardFunc, catBackwardFunc, copyInPlaceBackwardFunc })
+        {
+            if (func == backwardFunc) return 0;
+        }
+        for (auto func : { softmaxBackwardFunc, logSoftmaxBackwardFunc, sqrtInPlaceBackwardFunc,
+                           tanhInPlaceBackwardFunc, expInPlaceBackwardFunc })
+        {
+            if (func == backwardFunc) return TensorNode::kSavedResult;
+        }
+        if (backwardFunc == mulInPlaceBackwardFunc) return TensorNode::kSavedB;
+        if (backwardFunc == divInPlaceBackwardFunc) return TensorNode::kSavedB | TensorNode::kSavedResult;
+        if (backwardFunc == linearBackwardFunc)
+        {
+            return TensorNode::kSavedA | TensorNode::kSavedB | TensorNode::kSavedResult;
+        }
+        return TensorNode::kSavedA | TensorNode::kSavedB;
     }
 
-    static void permuteBackwardFunc(TensorNode* node, const TensorValue& seed)
+    Shape shapeWithInferredDimToShape(const std::initializer_list<ssize_t>& newShape) const
     {
-        if (!node->m_a) return;
+        Shape currShape = shape();
+        Shape resultShape(newShape.size());
+        ssize_t inferredDimIndex = -1;
+        size_t inferredDimCount  = 0;
+        size_t invalidDimCount   = 0;
+        ssize_t inferredDimSize  = std::accumulate(currShape.begin(), currShape.end(), 1, std::multiplies<>());
 
-        // Convert negative reference indices to positive.
-        SIndex orgDims = node->m_dims;
-        for (size_t i=0; i<orgDims.size(); ++i)
+        ssize_t i = 0;
+        for (const auto dim : newShape)
         {
-            orgDims[i] = orgDims[i] < 0 ? static_cast<ssize_t>(orgDims.size()) + orgDims[i] : orgDims[i];
+            if (dim == -1)
+            {
+                ++inferredDimCount;
+                inferredDimIndex = i;
+            }
+            else
+            {
+                inferredDimSize /= dim;
+                resultShape[i] = dim;
+            }
+            if (dim == 0 || dim < -1) ++invalidDimCount;
+            ++i;
         }
 
-        // Calculate permute indexes to put the dimensions back to the original positions.
-        SIndex dims(orgDims.size());
-        for (size_t i=0; i<orgDims.size(); ++i)
+        if (invalidDimCount > 0)
         {
-            auto it = std::find(orgDims.begin(), orgDims.end(), i);
-            dims[i] = std::distance(orgDims.begin(), it);
+            throw std::invalid_argument("Shape contains invalid dimension.");
         }
-        node->m_a->backward(seed.permute(dims));
-    }
 
-    static void sliceBackwardFunc(TensorNode * node, const TensorValue & seed)
-    {
-        if (!node->m_a) return;
-        node->m_a->backward(node->m_a->m_value.sliceSet(seed, node->m_dim0, node->m_start, node->m_end, node->m_dim1));
+        if (inferredDimCount > 1)
+        {
+            throw std::invalid_argument("Only one dimension can be inferred.");
+        }
+
+        if (inferredDimIndex >= 0)
+            resultShape[inferredDimIndex] = inferredDimSize;
+
+        return resultShape;
     }
 
-    static void sumBackwardFunc(TensorNode * node, const TensorValue & seed)
+    std::shared_ptr<TensorNode>  m_data{nullptr};
+};
+
+// Some convenience method definitions.
+
+inline Tensor tensor(float value, const TensorOptions & opt = {})
+{
+    return Tensor{value, Shape{}, opt};
+}
+
+inline Tensor tensor(const std::initializer_list<double> & data, const Shape & shape, const TensorOptions & opt = {})
+{
+    return Tensor{data.begin(), data.size(), getDataType<double>(), shape, opt};
+}
+
+inline Tensor tensor(const std::initializer_list<float> & data, const Shape & shape, const TensorOptions & opt = {})
+{
+    return Tensor{data.begin(), data.size(), getDataType<float>(), shape, opt};
+}
+
+inline Tensor tensor(const std::initializer_list<double> & data, const TensorOptions & opt = {})
+{
+    return Tensor{data.begin(), data.size(), getDataType<double>(), Shape{data.size()}, opt};
+}
+
+inline Tensor tensor(const std::initializer_list<float> & data, const TensorOptions & opt = {})
+{
+    return Tensor{data.begin(), data.size(), getDataType<float>(), Shape{data.size()}, opt};
+}
+
+inline Tensor tensor(const std::vector<double> & data, const TensorOptions & opt = {})
+{
+    return Tensor{data.data(), data.size(), getDataType<double>(), Shape{data.size()}, opt};
+}
+
+inline Tensor tensor(const std::vector<float> & data, const TensorOptions & opt = {})
+{
+    return Tensor{data.data(), data.size(), getDataType<float>(), Shape{data.size()}, opt};
+}
+
+inline Tensor ones(const Shape & shape, const TensorOptions & opt = {})
+{
+    return Tensor{1, shape, opt};
+}
+
+inline Tensor zeros(const Shape & shape, const TensorOptions & opt = {})
+{
+    return Tensor{0, shape, opt};
+}
+
+inline Tensor onesLike(const Tensor & tensor, bool requireGrad = false)
+{
+    return Tensor{1, tensor.shape(), { .m_requireGrad=requireGrad, .m_dtype=tensor.dataType(), .m_device=tensor.device() }};
+}
+
+inline Tensor zerosLike(const Tensor & tensor, bool requireGrad = false)
+{
+    return Tensor{0, tensor.shape(), { .m_requireGrad=requireGrad, .m_dtype=tensor.dataType(), .m_device=tensor.device() }};
+}
+
+inline Tensor sqrt(const Tensor & A)   { return A.sqrt(); }
+inline Tensor sin(const Tensor & A)    { return A.sin();  }
+inline Tensor cos(const Tensor & A)    { return A.cos();  }
+inline Tensor tanh(const Tensor & A)   { return A.tanh(); }
+inline Tensor log(const Tensor & A)    { return A.log();  }
+inline Tensor exp(const Tensor & A)    { return A.exp();  }
+inline Tensor sum(const Tensor & A)    { return A.sum();  }
+inline Tensor mean(const Tensor & A)   { return A.mean(); }
+inline Tensor sum(const Tensor & A, ssize_t dim, bool keepDim=false)    { return A.sum(dim, keepDim);  }
+inline Tensor mean(const Tensor & A, ssize_t dim, bool keepDim=false)   { return A.mean(dim, keepDim);  }
+inline Tensor pow(const Tensor & A, const Tensor & exp)     { return A.pow(exp); }
+inline Tensor max(const Tensor & A)         { return A.max();    }
+inline Tensor max(const Tensor & A, ssize_t dim, bool keepDim=false)   { return A.max(dim, keepDim); }
+inline Tensor argmax(const Tensor & A)      { return A.argmax(); }
+inline Tensor softmax(const Tensor & A, ssize_t dim)       { return A.softmax(dim);    }
+inline Tensor logSoftmax(const Tensor & A, ssize_t dim)    { return A.logSoftmax(dim); }
+inline Tensor crossEntropy(const Tensor & logits, const Tensor & targets, ssize_t dim)
+{
+    return logits.crossEntropy(targets, dim);
+}
+
+inline Tensor linear(const Tensor & x, const Tensor & weights, const Tensor & bias,
+                     Activation activation = Activation::kNone)
+{
+    return x.linear(weights, bias, activation);
+}
+inline Tensor matmul(const Tensor & A, const Tensor & B)    { return A.matmul(B); }
+inline Tensor matmulQuantized(const Tensor & A, const Tensor & W, const QuantizedLayout & layout)
+{
+    return A.matmulQuantized(W, layout);
+}
+inline Tensor squeeze(const Tensor & A, ssize_t dim)    { return A.squeeze(dim);    }
+inline Tensor unsqueeze(const Tensor & A, ssize_t dim)  { return A.unsqueeze(dim);  }
+inline Tensor cat(const std::vector<Tensor>& tensors, ssize_t dim)     {  return Tensor::cat(tensors, dim);  }
+inline Tensor checkpoint(const std::function<Tensor(const Tensor &)> & func, const Tensor & x, bool requireGrad=true)
+{
+    return Tensor::checkpoint(func, x, requireGrad);
+}
+inline Tensor hstack(const std::vector<Tensor>& tensors)    { return Tensor::cat(tensors, 1); }
+inline Tensor vstack(const std::vector<Tensor>& tensors)    { return Tensor::cat(tensors, 0); }
+
+// Validates the tensors of an operation that writes its result into an existing tensor. Such operations do not record
+// gradients.
+inline void validateOutputOp(std::initializer_list<const Tensor*> tensors)
+{
+    if (!GradMode::isEnabled()) return;
+    for (auto tensor : tensors)
     {
-        if (!node->m_a) return;
-        // For the sum operation, the gradient is simply the seed
-        node->m_a->backward(seed);
+        if (tensor->isRequireGrad())
+        {
+            throw std::invalid_argument("Operations with an output tensor do not record gradients. Use the no-grad mode"
+                                        " or tensors that do not require gradients.");
+        }
     }
+}
 
-    static void sumBackwardFunc2(TensorNode* node, const TensorValue& seed)
-    {
-        if (!node->m_a) return;
-        const auto& originalShape = node->m_a->m_value.shape();
+// The output variants write the result into the given contiguous output tensor, which can be one of the inputs of the
+// element-wise operations, instead of allocating a new tensor.
+inline Tensor & add(const Tensor & A, const Tensor & B, Tensor & out)
+{
+    validateOutputOp({&A, &B, &out});
+    A.value().add(B.value(), out.value());
+    return out;
+}
 
-        // For keepDim=False case, 1 dimension was squeezed. That dimension needs to be unsqueezed.
-        if (!node->m_keepDim)
-            node->m_a->backward(seed.unsqueeze(static_cast<ssize_t>(node->m_dim0)).broadcastTo(originalShape));
-        else
-            node->m_a->backward(seed.broadcastTo(originalShape));
-    }
+inline Tensor & sub(const Tensor & A, const Tensor & B, Tensor & out)
+{
+    validateOutputOp({&A, &B, &out});
+    A.value().sub(B.value(), out.value());
+    return out;
+}
+
+inline Tensor & mul(const Tensor & A, const Tensor & B, Tensor & out)
+{
+    validateOutputOp({&A, &B, &out});
+    A.value().mul(B.value(), out.value());
+    return out;
+}
+
+inline Tensor & div(const Tensor & A, const Tensor & B, Tensor & out)
+{
+    validateOutputOp({&A, &B, &out});
+    A.value().div(B.value(), out.value());
+    return out;
+}
+
+inline Tensor & sqrt(const Tensor & A, Tensor & out)
+{
+    validateOutputOp({&A, &out});
+    A.value().sqrt(out.value());
+    return out;
+}
+
+inline Tensor & sin(const Tensor & A, Tensor & out)
+{
+    validateOutputOp({&A, &out});
+    A.value().sin(out.value());
+    return out;
+}
+
+inline Tensor & cos(const Tensor & A, Tensor & out)
+{
+    validateOutputOp({&A, &out});
+    A.value().cos(out.value());
+    return out;
+}
+
+inline Tensor & tanh(const Tensor & A, Tensor & out)
+{
+    validateOutputOp({&A, &out});
+    A.value().tanh(out.value());
+    return out;
+}
 
-    static void squeezeBackwardFunc(TensorNode * node, const TensorValue & seed)
-    {
-        if (!node->m_a) return;
-        node->m_a->backward(seed.unsqueeze(node->m_dim0));
-    }
+inline Tensor & log(const Tensor & A, Tensor & out)
+{
+    validateOutputOp({&A, &out});
+    A.value().log(out.value());
+    return out;
+}
 
-    static void unsqueezeBackwardFunc(TensorNode * node, const TensorValue & seed)
-    {
-        if (!node->m_a) return;
-        node->m_a->backward(seed.squeeze(node->m_dim0));
-    }
+inline Tensor & exp(const Tensor & A, Tensor & out)
+{
+    validateOutputOp({&A, &out});
+    A.value().exp(out.value());
+    return out;
+}
 
-    static void trillBackwardFunc(TensorNode * node, const TensorValue & seed)
-    {
-        if (!node->m_a) return;
-        auto onesLikeSeed = TensorValue(1.0, seed.shape(), seed.device(), seed.dataType());
-        node->m_a->backward(seed * onesLikeSeed.tril(static_cast<ssize_t>(node->m_dim0)));      // m_dim0 = diagonal
-    }
+inline Tensor & matmul(const Tensor & A, const Tensor & B, Tensor & out)
+{
+    validateOutputOp({&A, &B, &out});
+    A.value().matmul(B.value(), out.value());
+    return out;
+}
 
-    static void triuBackwardFunc(TensorNode * node, const TensorValue & seed)
+inline Tensor & cat(const std::vector<Tensor>& tensors, ssize_t dim, Tensor & out)
+{
+    validateOutputOp({&out});
+    std::vector<TensorValue> values;
+    values.reserve(tensors.size());
+    for (const auto & tensor : tensors)
     {
-        if (!node->m_a) return;
-        auto onesLikeSeed = TensorValue(1.0, seed.shape(), seed.device(), seed.dataType());
-        node->m_a->backward(seed * onesLikeSeed.triu(static_cast<ssize_t>(node->m_dim0)));      // m_dim0 = diagonal
+        validateOutputOp({&tensor});
+        values.emplace_back(tensor.value().broadcastView(tensor.shape()));
     }
+    TensorValue::cat(values, dim, out.value());
+    return out;
+}
 
-    static void indexSelectBackwardFunc(TensorNode * node, const TensorValue& seed)
+inline void split(const Tensor & A, ssize_t splitSize, ssize_t dim, std::vector<Tensor> & outs)
+{
+    validateOutputOp({&A});
+    std::vector<TensorValue> values;
+    values.reserve(outs.size());
+    for (auto & out : outs)
     {
-        if (!node->m_a) return;
-        auto zeros = aix::TensorValue(0.0, node->m_a->m_value.shape(), seed.device(), seed.dataType());
-        node->m_a->backward(zeros.indexAdd(static_cast<ssize_t>(node->m_dim0), node->m_indices, seed, true));
+        validateOutputOp({&out});
+        values.emplace_back(out.value().broadcastView(out.shape()));
     }
+    A.value().split(splitSize, dim, values);
+}
 
-    static void catBackwardFunc(TensorNode* node, const TensorValue& seed)
-    {
-        size_t numTensors = node->m_aMulti.size();
-        if (numTensors == 0) return;
+inline Tensor var(const Tensor & A, bool unbiased=true)     { return A.var(unbiased); }
+inline Tensor var(const Tensor & A, ssize_t dim, bool unbiased=true, bool keepdim=false)
+{
+    return A.var(dim, unbiased, keepdim);
+}
 
-        // The dimension along which tensors were concatenated.
-        auto dim = static_cast<ssize_t>(node->m_dim0);
+static Tensor randn(const Shape & shape, const TensorOptions & opt = {})
+{
+    std::uniform_real_distribution<float> distr(-1, 1);
 
-        // Get the shape of the original tensors.
-        size_t dimSize = node->m_aMulti[0]->m_value.shape()[dim];
+    size_t totalSize = std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<>());
+    std::vector<float> rndData(totalSize);
 
-        // Iterate over each original tensor and propagate the gradient.
-        for (size_t i=0; i<numTensors; ++i)
-        {
-            // Propagate this sliced gradient to the corresponding original tensor.
-            node->m_aMulti[i]->backward(seed.slice(dim, i * dimSize, (i + 1) * dimSize, 1));
-        }
-    }
+    // Fill rndData with random numbers
+    std::generate(rndData.begin(), rndData.end(), [&distr]() -> float { return distr(randGen); });
 
-    // Select operator.
-    Tensor operator[](ssize_t index) const
-    {
-        return select(0, index);
-    }
+    return Tensor{rndData.data(), rndData.size(), getDataType<float>(), shape, opt};
+}
 
-    // Overload the + operator
-    Tensor operator+(const Tensor & other) const
+// Returns evenly spaced values within a given interval. The interval including start but excluding stop. [start, end)
+static Tensor arange(float start, float end, float step, const TensorOptions & opt = {})
+{
+    if (step == 0)
     {
-        auto promotedDType = promoteDataType(dataType(), other.dataType());
-        Shape bcShape = broadcastShape(other.shape());
-        auto lhs = broadcastTo(bcShape).to(promotedDType);
-        auto rhs = other.broadcastTo(bcShape).to(promotedDType);
-
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad() || other.isRequireGrad(), .m_dtype=dataType(),
-                                 .m_device=device()});
-        result.m_data->m_value = lhs.m_data->m_value + rhs.m_data->m_value;
-        result.m_data->m_a = lhs.m_data;
-        result.m_data->m_b = rhs.m_data;
-        result.m_data->m_backwardFunc = addBackwardFunc;
-        return result;
+        throw std::invalid_argument("Step must be non-zero.");
     }
 
-    // Overload the - operator
-    Tensor operator-(const Tensor & other) const
+    auto range = end - start;
+    if ((range > 0 && step < 0) || (range < 0 && step > 0))
     {
-        auto promotedDType = promoteDataType(dataType(), other.dataType());
-        Shape bcShape = broadcastShape(other.shape());
-        auto lhs = broadcastTo(bcShape).to(promotedDType);
-        auto rhs = other.broadcastTo(bcShape).to(promotedDType);
-
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad() || other.isRequireGrad(), .m_dtype=dataType(),
-                                 .m_device=device()});
-        result.m_data->m_value = lhs.m_data->m_value - rhs.m_data->m_value;
-        result.m_data->m_a = lhs.m_data;
-        result.m_data->m_b = rhs.m_data;
-        result.m_data->m_backwardFunc = subBackwardFunc;
-        return result;
+        throw std::invalid_argument("Range direction is inconsistent with step sign.");
     }
 
-    // Overload the * operator
-    Tensor operator*(const Tensor & other) const
-    {
-        auto promotedDType = promoteDataType(dataType(), other.dataType());
-        Shape bcShape = broadcastShape(other.shape());
-        auto lhs = broadcastTo(bcShape).to(promotedDType);
-        auto rhs = other.broadcastTo(bcShape).to(promotedDType);
-
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad() || other.isRequireGrad(), .m_dtype=dataType(),
-                                 .m_device=device()});
-        result.m_data->m_value = lhs.m_data->m_value * rhs.m_data->m_value;
-        result.m_data->m_a = lhs.m_data;
-        result.m_data->m_b = rhs.m_data;
-        result.m_data->m_backwardFunc = mulBackwardFunc;
-        return result;
-    }
+    auto size = static_cast<size_t>(std::ceil(range / step));
+    std::vector<float> data(size);
+    std::generate(data.begin(), data.end(), [step,x=start]() mutable -> float { float v=x; x += step; return v; });
+    return Tensor{data.data(), data.size(), getDataType<float>(), {size}, opt};
+}
+inline Tensor arange(float end, const TensorOptions & opt = {})               { return arange(0.0, end, 1.0, opt);   }
+inline Tensor arange(float start, float end, const TensorOptions & opt = {})  { return arange(start, end, 1.0, opt); }
 
-    // Overload the / operator
-    Tensor operator/(const Tensor & other) const
+static Tensor eye(size_t n, const TensorOptions & opt = {})
+{
+    std::vector<float> data(n * n, 0);
+    for (size_t i=0; i<n; ++i)
     {
-        auto promotedDType = promoteDataType(dataType(), other.dataType());
-        Shape bcShape = broadcastShape(other.shape());
-        auto lhs = broadcastTo(bcShape).to(promotedDType);
-        auto rhs = other.broadcastTo(bcShape).to(promotedDType);
-
-        Tensor result(bcShape, { .m_requireGrad=isRequireGrad() || other.isRequireGrad(), .m_dtype=dataType(),
-                                 .m_device=device() });
-        result.m_data->m_value = lhs.m_data->m_value / rhs.m_data->m_value;
-        result.m_data->m_a = lhs.m_data;
-        result.m_data->m_b = rhs.m_data;
-        result.m_data->m_backwardFunc = divBackwardFunc;
-        return result;
+        data[i * n + i] = 1;
     }
+    return Tensor{data.data(), data.size(), getDataType<float>(), aix::Shape{n, n}, opt};
+}
 
-    Tensor operator-() const
-    {
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = -m_data->m_value;
-        result.m_data->m_a = m_data;
-        result.m_data->m_backwardFunc = unaryBackwardFunc;
-        return result;
-    }
+// Optimizers Namespace
 
-    Tensor operator+(const float & scalar) const
-    {
-        auto promotedFloatType = promoteDataTypeToFloat(dataType());
-        return *this + Tensor(scalar, shape(), { .m_dtype=promotedFloatType, .m_device=device() });
-    }
 
-    Tensor operator-(const float & scalar) const
-    {
-        auto promotedFloatType = promoteDataTypeToFloat(dataType());
-        return *this - Tensor(scalar, shape(), { .m_dtype=promotedFloatType, .m_device=device() });
-    }
+namespace optim
+{
 
-    Tensor operator*(const float & scalar) const
-    {
-        auto promotedFloatType = promoteDataTypeToFloat(dataType());
-        return *this * Tensor(scalar, shape(), { .m_dtype=promotedFloatType, .m_device=device() });
-    }
+class Optimizer
+{
+public:
+    // Constructor
+    Optimizer() = default;
 
-    Tensor operator/(const float & scalar) const
-    {
-        auto promotedFloatType = promoteDataTypeToFloat(dataType());
-        return *this / Tensor(scalar, shape(), { .m_dtype=promotedFloatType, .m_device=device() });
-    }
+    // Constructor
+    explicit Optimizer(const std::vector<std::pair<std::string, Tensor>> & parameters) : m_parameters(parameters) { }
 
-    friend Tensor operator+(float scalar, const Tensor & rhsTensor)
+    // Constructor
+    explicit Optimizer(const std::vector<Tensor> & parameters)
     {
-        auto promotedFloatType = promoteDataTypeToFloat(rhsTensor.dataType());
-        Tensor tensor(scalar, rhsTensor.shape(), { .m_requireGrad=rhsTensor.isRequireGrad(), .m_dtype=promotedFloatType,
-                                                   .m_device=rhsTensor.device() });
-        return tensor + rhsTensor;
+        for (auto& param : parameters)
+        {
+            m_parameters.emplace_back("", param);
+        }
     }
 
-    friend Tensor operator-(float scalar, const Tensor & rhsTensor)
-    {
-        auto promotedFloatType = promoteDataTypeToFloat(rhsTensor.dataType());
-        Tensor tensor(scalar, rhsTensor.shape(), { .m_requireGrad=rhsTensor.isRequireGrad(), .m_dtype=promotedFloatType,
-                                                   .m_device=rhsTensor.device() });
-        return tensor - rhsTensor;
-    }
+    // Destructor
+    virtual ~Optimizer() = default;
 
-    friend Tensor operator*(float scalar, const Tensor & rhsTensor)
+    virtual void step() = 0;
+
+    virtual void zeroGrad()
     {
-        auto promotedFloatType = promoteDataTypeToFloat(rhsTensor.dataType());
-        Tensor tensor(scalar, rhsTensor.shape(), { .m_requireGrad=rhsTensor.isRequireGrad(), .m_dtype=promotedFloatType,
-                                                   .m_device=rhsTensor.device() });
-        return tensor * rhsTensor;
+        for (auto & [name, param] : m_parameters)
+        {
+            param.zeroGrad();
+        }
     }
 
-    friend Tensor operator/(float scalar, const Tensor & rhsTensor)
+    inline void setDataType(DataType dtype)
     {
-        auto promotedFloatType = promoteDataTypeToFloat(rhsTensor.dataType());
-        Tensor tensor(scalar, rhsTensor.shape(), { .m_requireGrad=rhsTensor.isRequireGrad(), .m_dtype=promotedFloatType,
-                                                   .m_device=rhsTensor.device() });
-        return tensor / rhsTensor;
+        if (dtype != DataType::kFloat64 && dtype != DataType::kFloat32 &&
+            dtype != DataType::kFloat16 && dtype != DataType::kBFloat16)
+        {
+            throw std::invalid_argument("Optimization has to perform in Float data type to be effective.");
+        }
+        m_calculationDType = dtype;
     }
 
-    Tensor sqrt() const
+protected:
+    // Creates the Float32 master weights of the Float16 and BFloat16 parameters.
+    void initializeMasterWeights()
     {
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.sqrt();
-        result.m_data->m_a = m_data;
-        result.m_data->m_backwardFunc = sqrtBackwardFunc;
-        return result;
-    };
+        for (const auto & [name, param] : m_parameters)
+        {
+            bool isLowPrecision = param.dataType() == DataType::kFloat16 || param.dataType() == DataType::kBFloat16;
+            m_master.emplace_back(isLowPrecision ? std::optional(param.value().to(DataType::kFloat32)) : std::nullopt);
+        }
+    }
 
-    Tensor sin() const
+    // Creates a zero initialized Float32 optimizer state for each parameter.
+    std::vector<TensorValue> createStates() const
     {
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.sin();
-        result.m_data->m_a = m_data;
-        result.m_data->m_backwardFunc = sinBackwardFunc;
-        return result;
-    };
+        std::vector<TensorValue> states;
+        for (const auto & [name, param] : m_parameters)
+        {
+            states.emplace_back(0, param.shape(), param.value().device(), DataType::kFloat32);
+        }
+        return states;
+    }
 
-    Tensor cos() const
+    // Updates the parameters that require gradients in place with one fused device operation per device.
+    void fusedStep(const OptimizerStepParams & step, std::vector<TensorValue> * m, std::vector<TensorValue> * v)
     {
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.cos();
-        result.m_data->m_a = m_data;
-        result.m_data->m_backwardFunc = cosBackwardFunc;
-        return result;
-    };
+        std::vector<std::pair<Device*, std::vector<OptimizerTensorParams>>> deviceTensors;
+        std::vector<TensorValue> grads;     // Keeps the converted gradients alive until the step is done.
+        for (size_t i = 0; i < m_parameters.size(); ++i)
+        {
+            auto & parameter = m_parameters[i].second;
+            if (!parameter.isRequireGrad()) continue;
 
-    Tensor tanh() const
-    {
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.tanh();
-        result.m_data->m_a = m_data;
-        result.m_data->m_backwardFunc = tanhBackwardFunc;
-        return result;
-    };
+            auto & value = parameter.value();
+            const TensorValue * grad = nullptr;
+            const TensorValue * indices = nullptr;
+            if (parameter.isSparseGrad())
+            {
+                // Only the rows of a sparse gradient are updated, so the moments of the other rows stay unchanged.
+                const auto & sparseGrad = parameter.rowGrad();
+                if (sparseGrad.empty()) continue;
+                grad = &sparseGrad.rows;
+                indices = &sparseGrad.indices;
+            }
+            else
+            {
+                grad = &parameter.grad();
+            }
+            if (!grad->isContiguous() || grad->dataType() != value.dataType())
+            {
+                grads.emplace_back(grad->contiguous().to(value.dataType()));
+                grad = &grads.back();
+            }
 
-    Tensor log() const
-    {
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.log();
-        result.m_data->m_a = m_data;
-        result.m_data->m_backwardFunc = logBackwardFunc;
-        return result;
-    };
+            OptimizerTensorParams tensor{ .param=value.deviceParams(), .grad=grad->deviceParams() };
+            if (indices) tensor.indices = indices->deviceParams();
+            if (m_master[i]) tensor.master = m_master[i]->deviceParams();
+            if (m) tensor.m = (*m)[i].deviceParams();
+            if (v) tensor.v = (*v)[i].deviceParams();
 
-    Tensor exp() const
-    {
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.exp();
-        result.m_data->m_a = m_data;
-        result.m_data->m_backwardFunc = expBackwardFunc;
-        return result;
-    };
+            auto it = std::find_if(deviceTensors.begin(), deviceTensors.end(),
+                                   [&](const auto & entry) { return entry.first == value.device(); });
+            if (it == deviceTensors.end())
+            {
+                it = deviceTensors.emplace(deviceTensors.end(), value.device(), std::vector<OptimizerTensorParams>());
+            }
+            it->second.emplace_back(std::move(tensor));
+        }
 
-    Tensor sum() const
-    {
-        Tensor result({}, { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.sum();
-        result.m_data->m_a = m_data;
-        result.m_data->m_backwardFunc = sumBackwardFunc;
-        return result;
+        for (const auto & [device, tensors] : deviceTensors)
+        {
+            device->optimizerStep(step, tensors);
+        }
     }
 
-    Tensor sum(ssize_t dim, bool keepDim=false) const
-    {
-        Tensor result({}, { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.sum(dim, keepDim);
-        result.m_data->m_a = m_data;
-        result.m_data->m_dim0 = dim >= 0 ? dim : dim + m_data->m_value.shape().size();
-        result.m_data->m_keepDim = keepDim;
-        result.m_data->m_backwardFunc = sumBackwardFunc2;
-        return result;
-    }
+    std::vector<std::pair<std::string, Tensor>> m_parameters;
+    std::vector<std::optional<TensorValue>>   m_master;   // Float32 master weights of low precision parameters.
+    DataType m_calculationDType{DataType::kFloat32};
+};
 
-    Tensor mean() const
-    {
-        return sum() / value().size();
-    }
 
-    Tensor mean(ssize_t dim, bool keepDim=false) const
+class SGD : public Optimizer
+{
+public:
+    SGD() = default;
+
+    explicit SGD(const std::vector<std::pair<std::string, Tensor>> & parameters, float lr = 0.01f,
+                 float momentum = 0.0f, float weightDecay = 0.0f)
+        : Optimizer(parameters), m_lr(lr), m_momentum(momentum), m_weightDecay(weightDecay)
     {
-        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
-        return sum(dim, keepDim) / value().shape()[dim];
+        initializeParameters();
     }
 
-    Tensor max() const
+    explicit SGD(const std::vector<Tensor> & parameters, float lr = 0.01f, float momentum = 0.0f,
+                 float weightDecay = 0.0f)
+        : Optimizer(parameters), m_lr(lr), m_momentum(momentum), m_weightDecay(weightDecay)
     {
-        Tensor result({}, { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.max();
-        result.m_data->m_a = m_data;
-        result.m_data->m_backwardFunc = maxBackwardFunc;
-        return result;
+        initializeParameters();
     }
 
-    Tensor max(ssize_t dim, bool keepDim=false) const
+    void step() final
     {
-        Tensor result({}, { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.max(dim, keepDim);
-        result.m_data->m_a = m_data;
-        result.m_data->m_dim0 = dim >= 0 ? dim : dim + m_data->m_value.shape().size();
-        result.m_data->m_backwardFunc = maxBackwardFunc2;
-        return result;
+        // A captured graph runs the step again at each replay to use the current hyperparameters.
+        Graph::hostNode([this]
+        {
+            // w' = w - lr * b, where b = momentum * b + w_gradient, or b = w_gradient without momentum.
+            OptimizerStepParams step{ .type=OptimizerType::kSGD, .lr=m_lr, .beta1=m_momentum,
+                                      .weightDecay=m_weightDecay };
+            fusedStep(step, m_momentum != 0 ? &m_buffers : nullptr, nullptr);
+        });
     }
 
-    Tensor argmax() const
+private:
+    void initializeParameters()
     {
-        Tensor result({}, { .m_requireGrad=false, .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.argmax();
-        // argmax does not require gradient.
-        return result;
+        initializeMasterWeights();
+        if (m_momentum != 0)
+        {
+            m_buffers = createStates();
+        }
     }
 
-    Tensor argmax(ssize_t dim, bool keepDim=false) const
+    float m_lr{0.01f};          // Learning rate
+    float m_momentum{0.0f};     // Momentum factor.
+    float m_weightDecay{0.0f};  // L2 penalty.
+    std::vector<TensorValue>    m_buffers;  // Momentum buffers.
+};
+
+
+class Adam : public Optimizer
+{
+public:
+    Adam() = default;
+
+    explicit Adam(const std::vector<std::pair<std::string, Tensor>> & parameters, float lr = 0.001f, float beta1 = 0.9f,
+                  float beta2 = 0.999f, float epsilon = 1e-8f, float weightDecay = 0.0f)
+        : Optimizer(parameters), m_lr(lr), m_beta1(beta1), m_beta2(beta2), m_epsilon(epsilon),
+          m_weightDecay(weightDecay)
     {
-        Tensor result({}, { .m_requireGrad=false, .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.argmax(dim, keepDim);
-        // argmax does not require gradient.
-        return result;
+        initializeParameters();
     }
 
-    Tensor pow(float exp) const
+    explicit Adam(const std::vector<Tensor> & parameters, float lr = 0.001f, float beta1 = 0.9f,
+                  float beta2 = 0.999f, float epsilon = 1e-8f, float weightDecay = 0.0f)
+        : Optimizer(parameters), m_lr(lr), m_beta1(beta1), m_beta2(beta2), m_epsilon(epsilon),
+          m_weightDecay(weightDecay)
     {
-        TensorOptions opt{ .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() };
-        Tensor expTensor(exp, shape(), opt);
-        Tensor result(shape(), opt);
-        result.m_data->m_value = m_data->m_value.pow(expTensor.m_data->m_value);
-        result.m_data->m_a = m_data;
-        result.m_data->m_b = expTensor.m_data;
-        result.m_data->m_backwardFunc = powBackwardFunc;
-        return result;
+        initializeParameters();
     }
 
-    Tensor pow(const Tensor & other) const
+    void step() final
     {
-        auto promotedDType = promoteDataType(dataType(), other.dataType());
-        Shape bcShape = broadcastShape(other.shape());
-        auto lhs = broadcastTo(bcShape).to(promotedDType);
-        auto rhs = other.broadcastTo(bcShape).to(promotedDType);        // Exponent tensor.
-
-        Tensor result(bcShape, { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = lhs.m_data->m_value.pow(rhs.m_data->m_value);
-        result.m_data->m_a = lhs.m_data;
-        result.m_data->m_b = rhs.m_data;
-        result.m_data->m_backwardFunc = powBackwardFunc;
-        return result;
+        // A captured graph runs the step again at each replay to advance the time step.
+        Graph::hostNode([this]
+        {
+            ++m_timestep;
+            OptimizerStepParams step
+            {
+                .type=m_type, .lr=m_lr, .beta1=m_beta1, .beta2=m_beta2, .epsilon=m_epsilon,
+                .weightDecay=m_weightDecay,
+                // Bias corrections of the first and the second moment estimates.
+                .biasCorrection1=float(1.0 - std::pow(m_beta1, m_timestep)),
+                .biasCorrection2=float(1.0 - std::pow(m_beta2, m_timestep)),
+            };
+            // The moments and the parameters are updated in one pass over the elements.
+            fusedStep(step, &m_m, &m_v);
+        });
     }
 
-    Tensor matmul(const Tensor & other) const
+protected:
+    void initializeParameters()
     {
-        auto promotedDType = promoteDataType(dataType(), other.dataType());
-        auto lhs = to(promotedDType);
-        auto rhs = other.to(promotedDType);
-
-        Tensor result({shape()[0], rhs.shape()[1]}, { .m_requireGrad=isRequireGrad() || rhs.isRequireGrad(),
-                                                      .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = lhs.m_data->m_value.matmul(rhs.m_data->m_value);
-        result.m_data->m_a = lhs.m_data;
-        result.m_data->m_b = rhs.m_data;
-        result.m_data->m_backwardFunc = matmulBackwardFunc;
-        return result;
+        initializeMasterWeights();
+        m_m = createStates();
+        m_v = createStates();
     }
 
-    Tensor transpose(ssize_t dim0, ssize_t dim1) const
+    OptimizerType m_type{OptimizerType::kAdam};
+    float m_lr{0.001f};         // Learning rate.
+    float m_beta1{0.9f};        // Exponential decay rate for the first moment estimates.
+    float m_beta2{0.999f};      // Exponential decay rate for the second moment estimates.
+    float m_epsilon{1e-8f};     // Small constant for numerical stability.
+    float m_weightDecay{0.0f};  // L2 penalty, or the decoupled weight decay of AdamW.
+    size_t m_timestep{0};       // Time step.
+    std::vector<TensorValue>    m_m;    // First moment vector.
+    std::vector<TensorValue>    m_v;    // Second moment vector.
+};
+
+
+// Adam with decoupled weight decay, which shrinks the weights directly instead of adding an L2 penalty to the
+// gradients.
+class AdamW : public Adam
+{
+public:
+    AdamW() { m_type = OptimizerType::kAdamW; }
+
+    explicit AdamW(const std::vector<std::pair<std::string, Tensor>> & parameters, float lr = 0.001f,
+                   float beta1 = 0.9f, float beta2 = 0.999f, float epsilon = 1e-8f, float weightDecay = 0.01f)
+        : Adam(parameters, lr, beta1, beta2, epsilon, weightDecay)
     {
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.transpose(dim0, dim1);
-        result.m_data->m_a = m_data;
-        result.m_data->m_dim0 = dim0;
-        result.m_data->m_dim1 = dim1;
-        result.m_data->m_backwardFunc = transposeBackwardFunc;
-        return result;
+        m_type = OptimizerType::kAdamW;
     }
 
-    Tensor permute(const SIndex& dims) const
+    explicit AdamW(const std::vector<Tensor> & parameters, float lr = 0.001f, float beta1 = 0.9f,
+                   float beta2 = 0.999f, float epsilon = 1e-8f, float weightDecay = 0.01f)
+        : Adam(parameters, lr, beta1, beta2, epsilon, weightDecay)
     {
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.permute(dims);
-        result.m_data->m_a = m_data;
-        result.m_data->m_dims = dims;
-        result.m_data->m_backwardFunc = permuteBackwardFunc;
-        return result;
+        m_type = OptimizerType::kAdamW;
     }
+};
 
-    Tensor slice(ssize_t dim=0, std::optional<ssize_t> startOpt = std::nullopt,
-                 std::optional<ssize_t> endOpt = std::nullopt, ssize_t step=1) const
+}   // optim namespace
+
+
+// Neural Network Namespace
+
+
+namespace nn
+{
+
+class Module
+{
+public:
+    virtual ~Module() = default;
+
+    virtual Tensor forward(Tensor x) const = 0;
+
+    // Converts a checkpoint tensor into a parameter that the module stores in another form, i.e. quantized weights.
+    using ParameterLoader = std::function<void(const TensorValue & value)>;
+
+    void registerParameter(const std::string& paramName, Tensor & tensor)
     {
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.slice(dim, startOpt, endOpt, step);
-        result.m_data->m_a = m_data;
-        result.m_data->m_dim0 = dim;
-        result.m_data->m_dim1 = step;
-        result.m_data->m_start = startOpt;
-        result.m_data->m_end = endOpt;
-        result.m_data->m_backwardFunc = sliceBackwardFunc;
-        return result;
+        m_parameters.emplace_back(paramName, tensor);
+        m_parameterLoaders.emplace_back();
     }
 
-    Tensor squeeze(ssize_t dim) const
+    // Registers a parameter with a loader, which load() calls if the checkpoint tensor has another shape or data type.
+    void registerParameter(const std::string& paramName, Tensor & tensor, ParameterLoader loader)
     {
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.squeeze(dim);
-        result.m_data->m_a = m_data;
-        result.m_data->m_dim0 = dim;
-        result.m_data->m_backwardFunc = squeezeBackwardFunc;
-        return result;
+        m_parameters.emplace_back(paramName, tensor);
+        m_parameterLoaders.emplace_back(std::move(loader));
     }
 
-    Tensor unsqueeze(ssize_t dim) const
+    void registerModule(const Module & module)
     {
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.unsqueeze(dim);
-        result.m_data->m_a = m_data;
-        result.m_data->m_dim0 = dim;
-        result.m_data->m_backwardFunc = unsqueezeBackwardFunc;
-        return result;
+        for (const auto& [paramName, param] : module.parameters())
+        {
+            m_parameters.emplace_back(paramName, param);
+        }
+        m_parameterLoaders.insert(m_parameterLoaders.end(), module.m_parameterLoaders.begin(),
+                                  module.m_parameterLoaders.end());
     }
 
-    Tensor var(bool unbiased=true) const
+    std::vector<std::pair<std::string,Tensor>> parameters() const
     {
-        auto deviation = *this - mean();
-        auto elementCount = unbiased ? deviation.value().size() - 1 : deviation.value().size();
-        return (deviation * deviation).sum() / float(elementCount);
+        return m_parameters;
     }
 
-    Tensor var(ssize_t dim, bool unbiased=true, bool keepdim=false) const
+    // Returns the loaders of the parameters in the order of parameters(). Parameters without a loader have none.
+    const std::vector<ParameterLoader> & parameterLoaders() const
     {
-        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
-        auto deviation = *this - mean(dim, true);
-        auto elementCount = unbiased ? shape()[dim] - 1 : shape()[dim];
-        auto var = (deviation * deviation).sum(dim, true) / float(elementCount);
-        return keepdim ? var : var.squeeze(dim);
+        return m_parameterLoaders;
     }
 
-    Tensor select(ssize_t dim, ssize_t index) const
+    // Returns the total number of elements (learnable parameters) in each Tensor.
+    size_t learnableParameters() const
     {
-        if (shape().empty())
+        size_t totalParams = 0;
+        for (const auto& [paramName, param]: m_parameters)
         {
-            throw std::invalid_argument("select() cannot be applied to a scalar, zero-dimension, tensor.");
+            if (param.isRequireGrad())
+            {
+                totalParams += param.value().size();
+            }
         }
-        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
-        index = index < 0 ? static_cast<ssize_t>(shape()[dim]) + index : index;
-        return slice(dim, index, index + 1, 1).squeeze(dim);
+        return totalParams;
     }
 
-    std::vector<Tensor> split(ssize_t splitSize, ssize_t dim=0) const
+    void to(std::unique_ptr<Device> & device) const   { to(*device); }
+    void to(Device * device) const                    { to(*device); }
+    void to(Device & device) const
     {
-        if (splitSize < 0)
+        for (auto& [paramName, param] : parameters())
         {
-            throw std::invalid_argument("Split size must be a positive number.");
+            param.value() = param.value().to(&device);
+            // Frozen parameters, such as quantized weights, have no gradients. Sparse gradients are discarded.
+            if (param.isSparseGrad())
+            {
+                param.zeroGrad();
+            }
+            else if (param.isRequireGrad())
+            {
+                param.grad() = param.grad().to(&device);
+            }
         }
+    }
 
-        if (shape().empty())
+    void to(DataType newDtype) const
+    {
+        for (auto& [paramName, param] : parameters())
         {
-            throw std::invalid_argument("Split operation needs at least a 1-dim tensor.");
+            if (param.isRequireGrad())
+            {
+                param.value() = param.value().to(newDtype);
+                if (param.isSparseGrad())
+                    param.zeroGrad();
+                else
+                    param.grad() = param.grad().to(newDtype);
+            }
         }
+    }
 
-        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
-        if (dim < 0)
+private:
+    std::vector<std::pair<std::string, Tensor>> m_parameters;
+    std::vector<ParameterLoader> m_parameterLoaders;
+};
+
+
+class Sequential : public Module
+{
+public:
+    // Override the forward function.
+    Tensor forward(Tensor x) const override
+    {
+        if (m_checkpointSegments == 0)
         {
-            throw std::invalid_argument("Split dimension is out of range.");
+            for (const auto & module : m_modules)
+            {
+                x = module->forward(x);
+            }
+            return x;
         }
 
-        std::vector<Tensor> tensors;        // Stores splitted tensors.
-        for (size_t i = 0; i < shape()[dim]; i += splitSize)
+        auto segments = std::min(m_checkpointSegments, m_modules.size());
+        for (size_t i = 0; i < segments; ++i)
         {
-            tensors.emplace_back(slice(dim, i, i + splitSize, 1));
+            // The segments differ by one module at most.
+            auto begin = m_modules.begin() + static_cast<ssize_t>(i * m_modules.size() / segments);
+            auto end   = m_modules.begin() + static_cast<ssize_t>((i + 1) * m_modules.size() / segments);
+            bool requireGrad = x.isRequireGrad() || std::any_of(begin, end, [](const auto & module)
+            {
+                return module->learnableParameters() > 0;
+            });
+            x = checkpoint([begin, end](const Tensor & input)
+            {
+                auto y = input;
+                for (auto it = begin; it != end; ++it)
+                {
+                    y = (*it)->forward(y);
+                }
+                return y;
+            }, x, requireGrad);
         }
-        return tensors;
+        return x;
     }
 
-    Tensor tril(ssize_t diagonal=0) const
+    // Function to add modules dynamically if needed.
+    void add(Module* module)
     {
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.tril(diagonal);
-        result.m_data->m_a = m_data;
-        result.m_data->m_dim0 = diagonal;
-        result.m_data->m_backwardFunc = trillBackwardFunc;
-        return result;
+        registerModule(*module);
+        m_modules.emplace_back(module);     // Use std::unique_ptr to take ownership of the module pointer.
     }
 
-    Tensor triu(ssize_t diagonal=0) const
+    // Splits the modules into the given number of segments of consecutive modules, and checkpoints the activations
+    // of each segment, see Tensor::checkpoint(). Only the inputs of the segments are kept until the backward pass,
+    // which runs each segment forward again. Zero disables checkpointing. The sequential must outlive the graph.
+    void checkpointSegments(size_t count)       { m_checkpointSegments = count; }
+
+protected:
+    // Use std::unique_ptr for polymorphic containment.
+    std::vector<std::unique_ptr<Module>>  m_modules;
+    size_t  m_checkpointSegments{0};
+};
+
+
+// Runs a module without keeping its intermediate activations until the backward pass, which runs the module again.
+// See Tensor::checkpoint(). This trades an extra forward pass for the memory of the activations.
+class ActivationCheckpoint : public Module
+{
+public:
+    // Constructor. Takes the ownership of the module.
+    explicit ActivationCheckpoint(Module* module) : m_module{module}
     {
-        Tensor result(shape(), { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.triu(diagonal);
-        result.m_data->m_a = m_data;
-        result.m_data->m_dim0 = diagonal;
-        result.m_data->m_backwardFunc = triuBackwardFunc;
-        return result;
+        registerModule(*m_module);
     }
 
-    Tensor indexSelect(ssize_t dim, const Tensor& indices) const
+    Tensor forward(Tensor x) const override
     {
-        if (indices.shape().size() > 1)
-        {
-            throw std::invalid_argument("Indices supposed to be a vector.");
-        }
+        // The graph shares the ownership of the module since it runs the module during the backward pass.
+        auto module = m_module;
+        bool requireGrad = x.isRequireGrad() || learnableParameters() > 0;
+        return checkpoint([module](const Tensor & input) { return module->forward(input); }, x, requireGrad);
+    }
+
+private:
+    std::shared_ptr<Module>  m_module;
+};
+
+
+class Linear : public Module
+{
+public:
+    // Constructor
+    Linear() = default;
+
+    // Constructor
+    Linear(size_t numInputs, size_t numOutputs)
+    {
+        m_w = randn({numInputs, numOutputs}, { .m_requireGrad=true });
+        m_b = randn({1,         numOutputs}, { .m_requireGrad=true });
+
+        // Register learnable parameters.
+        registerParameter("w", m_w);
+        registerParameter("b", m_b);
+    }
+
+    // Forward. The bias is added by the epilogue of the matrix multiplication.
+    Tensor forward(Tensor x) const override
+    {
+        return linear(x, m_w, m_b);
+    }
+
+    Tensor  m_w;
+    Tensor  m_b;
+};
+
+
+// A linear layer followed by an activation, which the epilogue of its matrix multiplication applies with the bias.
+// This replaces Linear and the activation module without writing the intermediate results.
+class LinearAct : public Linear
+{
+public:
+    // Constructor
+    LinearAct() = default;
+
+    // Constructor
+    LinearAct(size_t numInputs, size_t numOutputs, Activation activation) :
+        Linear(numInputs, numOutputs), m_activation{activation}
+    {
+    }
+
+    // Forward
+    Tensor forward(Tensor x) const override
+    {
+        return linear(x, m_w, m_b, m_activation);
+    }
 
-        dim = dim < 0 ? static_cast<ssize_t>(shape().size()) + dim : dim;
+    inline Activation activation() const    { return m_activation; }
 
-        if ((!shape().empty() && (dim < 0 || static_cast<size_t>(dim) >= shape().size())) ||
-            (shape().empty() && dim != 0))
-        {
-            throw std::invalid_argument("Dimension is out of range for indexSelect operation.");
-        }
+private:
+    Activation  m_activation{Activation::kNone};
+};
 
-        auto newShape = shape();
-        if (!newShape.empty())
-        {
-            newShape[dim] = !indices.shape().empty() ? indices.shape()[0] : 1;
-        }
 
-        Tensor result(newShape, { .m_requireGrad=isRequireGrad(), .m_dtype=dataType(), .m_device=device() });
-        result.m_data->m_value = m_data->m_value.indexSelect(dim, indices.value());
-        result.m_data->m_a = m_data;
-        result.m_data->m_dim0 = dim;
-        result.m_data->m_indices = indices.value();
-        result.m_data->m_backwardFunc = indexSelectBackwardFunc;
-        return result;
-    }
+// A lookup table of embedding vectors. The gradient of the table has only the rows of the looked up indices, see
+// Tensor::sparseGrad(), and the optimizers update only those rows.
+class Embedding : public Module
+{
+public:
+    // Constructor
+    Embedding() = default;
 
-    static Tensor cat(const std::vector<Tensor>& tensors, ssize_t dim)
+    // Constructor
+    Embedding(size_t numEmbeddings, size_t embeddingDim, bool sparse = true)
     {
-        if (tensors.empty())
-        {
-            throw std::invalid_argument("cat() operation needs at least one tensor.");
-        }
+        m_w = randn({numEmbeddings, embeddingDim}, { .m_requireGrad=true });
+        m_w.sparseGrad(sparse);
 
-        const auto& tensor = tensors[0];
+        // Register learnable parameters.
+        registerParameter("w", m_w);
+    }
 
-        if (tensor.shape().empty())
-        {
-            throw std::invalid_argument("Zero-dimensional tensor cannot be concatenated.");
-        }
+    // Forward. The Int32 indices of any shape select the vectors, which are appended as the last dimension.
+    Tensor forward(Tensor indices) const override
+    {
+        auto shape = indices.shape();
+        shape.emplace_back(m_w.shape()[1]);
+        return m_w.indexSelect(0, indices.reshape(Shape{indices.value().size()})).reshape(shape);
+    }
 
-        if (tensors.size() == 1) return tensor;
+    Tensor  m_w;
+};
 
-        dim = dim < 0 ? static_cast<ssize_t>(tensor.shape().size()) + dim : dim;
-        if (dim < 0 || dim >= static_cast<ssize_t>(tensor.shape().size()))
-        {
-            throw std::invalid_argument("Dimension is out of range for cat() operation.");
-        }
 
-        bool requireGrad = tensor.isRequireGrad();
-        DataType promotedDType = tensor.dataType();
-        // Tensor shapes must be the same.
-        for (size_t i=0; i<tensors.size()-1; ++i)
-        {
-            auto shape1 = tensors[i].shape();
-            auto shape2 = tensors[i+1].shape();
-            shape1[dim] = shape2[dim] = 0;      // Neutralize dimension sizes for comparison.
+// Inference-only linear layer with weight-only quantization. The weights are stored as signed 8-bit or 4-bit values
+// with a Float32 scale for each group of inputs of an output channel, see QuantizedLayout. This reads 2-4x fewer
+// weight bytes than Float16 weights. Loading a checkpoint of a Linear layer quantizes its weights.
+class QuantizedLinear : public Module
+{
+public:
+    // Constructor. A zero group size uses one scale per output channel.
+    QuantizedLinear(size_t numInputs, size_t numOutputs, size_t bits = 8, size_t groupSize = 0) :
+        m_layout{QuantizedLayout::create(numInputs, numOutputs, bits, groupSize)}
+    {
+        m_w = Tensor(0, {numOutputs, m_layout.rowSize()}, { .m_dtype=DataType::kUInt8 });
+        m_b = Tensor(0, {1, numOutputs});
 
-            if (shape1 != shape2)
-            {
-                throw std::invalid_argument("Dimension sizes of tensors must match except in dimension " +
-                                            std::to_string(dim) + " for the cat() operation.");
-            }
-            if (tensors[i].device() != tensors[i+1].device())
+        // Float weights of a checkpoint are quantized when they are loaded.
+        registerParameter("w", m_w, [w=m_w, layout=m_layout](const TensorValue & value) mutable
+        {
+            if (value.shape() != Shape{layout.inputs, layout.outputs})
             {
-                throw std::invalid_argument("Tensor devices must be the same for the cat() operation.");
+                throw std::runtime_error("Invalid parameter shape found when loading the model.");
             }
-            requireGrad |= tensors[i+1].isRequireGrad();
-            promotedDType = promoteDataType(promotedDType, tensors[i+1].dataType());
-        }
-
-        auto newShape = tensor.shape();
-        for (size_t i=1; i<tensors.size(); ++i)
-            newShape[dim] += tensors[i].shape()[dim];
-
-        size_t dimSize = 0;
-        Tensor result(newShape, { .m_requireGrad=requireGrad, .m_dtype=promotedDType, .m_device=tensor.device() });
-        for (size_t i=0; i<tensors.size(); ++i)
-        {
-            result.value().sliceSet(tensors[i].to(promotedDType).value(), dim, dimSize, dimSize + tensors[i].shape()[dim], 1, true);
-            // Store original tensors for the back prop.
-            result.m_data->m_aMulti.emplace_back(tensors[i].m_data);
-            dimSize += tensors[i].shape()[dim];
-        }
-        result.m_data->m_dim0 = dim;
-        result.m_data->m_backwardFunc = catBackwardFunc;
-        return result;
+            w.value() = quantize(value, layout, w.device());
+        });
+        registerParameter("b", m_b);
     }
 
-    // Friend function to overload operator<<
-    inline friend std::ostream & operator<<(std::ostream& os, const Tensor& tensor);
-
-protected:
-    inline Shape broadcastShape(const Shape& otherShape) const
+    // Constructor. Quantizes the weights of the linear layer.
+    explicit QuantizedLinear(const Linear & linear, size_t bits = 8, size_t groupSize = 0) :
+        QuantizedLinear(linear.m_w.shape()[0], linear.m_w.shape()[1], bits, groupSize)
     {
-        return shape() == otherShape ? shape() : TensorValue::broadcastShapes(shape(), otherShape);
+        m_w.value() = quantize(linear.m_w.value(), m_layout, linear.m_w.device());
+        m_b.value() = linear.m_b.value();
     }
 
-    inline void validateRetainGradientState() const
+    // Forward
+    Tensor forward(Tensor x) const override
     {
-        if (!m_data->m_requireGrad && !m_data->m_retainGrad)
-        {
-            throw std::runtime_error("Gradients for non-leaf tensors won’t be populated during automatic gradient"
-                                     " calculation. Use .retainGrad() on the non-leaf tensor if needed, or access"
-                                     " the leaf tensor instead.");
-        }
+        auto y = x.matmulQuantized(m_w, m_layout);
+        return y + (m_b.dataType() == y.dataType() ? m_b : m_b.to(y.dataType()));
     }
 
-    Shape shapeWithInferredDimToShape(const std::initializer_list<ssize_t>& newShape) const
+    // Returns the quantized rows of the [inputs, outputs] weights on the device.
+    static TensorValue quantize(const TensorValue & weights, const QuantizedLayout & layout, Device * device)
     {
-        Shape currShape = shape();
-        Shape resultShape(newShape.size());
-        ssize_t inferredDimIndex = -1;
-        size_t inferredDimCount  = 0;
-        size_t invalidDimCount   = 0;
-        ssize_t inferredDimSize  = std::accumulate(currShape.begin(), currShape.end(), 1, std::multiplies<>());
+        auto floatWeights = weights.to(DataType::kFloat32);
+        std::vector<uint8_t> rows(layout.outputs * layout.rowSize());
+        layout.quantize(floatWeights.data<float>(), rows.data());
+        return { rows.data(), rows.size(), DataType::kUInt8, Shape{layout.outputs, layout.rowSize()}, device,
+                 DataType::kUInt8 };
+    }
 
-        ssize_t i = 0;
-        for (const auto dim : newShape)
-        {
-            if (dim == -1)
-            {
-                ++inferredDimCount;
-                inferredDimIndex = i;
-            }
-            else
-            {
-                inferredDimSize /= dim;
-                resultShape[i] = dim;
-            }
-            if (dim == 0 || dim < -1) ++invalidDimCount;
-            ++i;
-        }
+    inline const QuantizedLayout & layout() const   { return m_layout; }
 
-        if (invalidDimCount > 0)
-        {
-            throw std::invalid_argument("Shape contains invalid dimension.");
-        }
+    Tensor  m_w;
+    Tensor  m_b;
 
-        if (inferredDimCount > 1)
-        {
-            throw std::invalid_argument("Only one dimension can be inferred.");
-        }
+private:
+    QuantizedLayout  m_layout;
+};
 
-        if (inferredDimIndex >= 0)
-            resultShape[inferredDimIndex] = inferredDimSize;
 
-        return resultShape;
+class Tanh : public Module
+{
+public:
+    // Forward
+    Tensor forward(Tensor x) const override
+    {
+        return tanh(x);
     }
-
-    std::shared_ptr<TensorNode>  m_data{nullptr};
 };
 
-// Some convenience method definitions.
 
-inline Tensor tensor(float value, const TensorOptions & opt = {})
+class Sigmoid : public Module
 {
-    return Tensor{value, Shape{}, opt};
-}
+public:
+    // Forward
+    Tensor forward(Tensor x) const override
+    {
+        return 1 / (1 + exp(-x));
+    }
+};
 
-inline Tensor tensor(const std::initializer_list<double> & data, const Shape & shape, const TensorOptions & opt = {})
-{
-    return Tensor{data.begin(), data.size(), getDataType<double>(), shape, opt};
-}
 
-inline Tensor tensor(const std::initializer_list<float> & data, const Shape & shape, const TensorOptions & opt = {})
+class Softmax : public Module
 {
-    return Tensor{data.begin(), data.size(), getDataType<float>(), shape, opt};
-}
+public:
+    // Constructor. The result always has the shape of the input, keepDim is kept for compatibility.
+    explicit Softmax(ssize_t dim=0, [[maybe_unused]] bool keepDim=false) : m_dim{dim} { }
 
-inline Tensor tensor(const std::initializer_list<double> & data, const TensorOptions & opt = {})
-{
-    return Tensor{data.begin(), data.size(), getDataType<double>(), Shape{data.size()}, opt};
-}
+    Tensor forward(Tensor x) const override
+    {
+        return x.softmax(m_dim);
+    }
 
-inline Tensor tensor(const std::initializer_list<float> & data, const TensorOptions & opt = {})
-{
-    return Tensor{data.begin(), data.size(), getDataType<float>(), Shape{data.size()}, opt};
-}
+private:
+    ssize_t m_dim{0};
+};
 
-inline Tensor tensor(const std::vector<double> & data, const TensorOptions & opt = {})
-{
-    return Tensor{data.data(), data.size(), getDataType<double>(), Shape{data.size()}, opt};
-}
 
-inline Tensor tensor(const std::vector<float> & data, const TensorOptions & opt = {})
+class LogSoftmax : public Module
 {
-    return Tensor{data.data(), data.size(), getDataType<float>(), Shape{data.size()}, opt};
-}
+public:
+    // Constructor.
+    explicit LogSoftmax(ssize_t dim=0) : m_dim{dim} { }
 
-inline Tensor ones(const Shape & shape, const TensorOptions & opt = {})
-{
-    return Tensor{1, shape, opt};
-}
+    // Forward
+    Tensor forward(Tensor x) const override
+    {
+        // LogSoftmax(x) = log(e^x / sum(e^x)) = x - log(sum(e^x))
+        return x.logSoftmax(m_dim);
+    }
 
-inline Tensor zeros(const Shape & shape, const TensorOptions & opt = {})
-{
-    return Tensor{0, shape, opt};
-}
+private:
+    ssize_t m_dim{0};
+};
 
-inline Tensor onesLike(const Tensor & tensor, bool requireGrad = false)
-{
-    return Tensor{1, tensor.shape(), { .m_requireGrad=requireGrad, .m_dtype=tensor.dataType(), .m_device=tensor.device() }};
-}
 
-inline Tensor zerosLike(const Tensor & tensor, bool requireGrad = false)
+class GeLU : public Module
 {
-    return Tensor{0, tensor.shape(), { .m_requireGrad=requireGrad, .m_dtype=tensor.dataType(), .m_device=tensor.device() }};
-}
+public:
+    // Forward
+    Tensor forward(Tensor x) const override
+    {
+        return 0.5 * x * (1.0 + tanh(std::sqrt(2.0f / std::numbers::pi_v<float>) * (x + 0.044715 * x.pow(3))));
+    }
+};
 
-inline Tensor sqrt(const Tensor & A)   { return A.sqrt(); }
-inline Tensor sin(const Tensor & A)    { return A.sin();  }
-inline Tensor cos(const Tensor & A)    { return A.cos();  }
-inline Tensor tanh(const Tensor & A)   { return A.tanh(); }
-inline Tensor log(const Tensor & A)    { return A.log();  }
-inline Tensor exp(const Tensor & A)    { return A.exp();  }
-inline Tensor sum(const Tensor & A)    { return A.sum();  }
-inline Tensor mean(const Tensor & A)   { return A.mean(); }
-inline Tensor sum(const Tensor & A, ssize_t dim, bool keepDim=false)    { return A.sum(dim, keepDim);  }
-inline Tensor mean(const Tensor & A, ssize_t dim, bool keepDim=false)   { return A.mean(dim, keepDim);  }
-inline Tensor pow(const Tensor & A, const Tensor & exp)     { return A.pow(exp); }
-inline Tensor max(const Tensor & A)         { return A.max();    }
-inline Tensor max(const Tensor & A, ssize_t dim, bool keepDim=false)   { return A.max(dim, keepDim); }
-inline Tensor argmax(const Tensor & A)      { return A.argmax(); }
-inline Tensor matmul(const Tensor & A, const Tensor & B)    { return A.matmul(B); }
-inline Tensor squeeze(const Tensor & A, ssize_t dim)    { return A.squeeze(dim);    }
-inline Tensor unsqueeze(const Tensor & A, ssize_t dim)  { return A.unsqueeze(dim);  }
-inline Tensor cat(const std::vector<Tensor>& tensors, ssize_t dim)     {  return Tensor::cat(tensors, dim);  }
-inline Tensor hstack(const std::vector<Tensor>& tensors)    { return Tensor::cat(tensors, 1); }
-inline Tensor vstack(const std::vector<Tensor>& tensors)    { return Tensor::cat(tensors, 0); }
-inline Tensor var(const Tensor & A, bool unbiased=true)     { return A.var(unbiased); }
-inline Tensor var(const Tensor & A, ssize_t dim, bool unbiased=true, bool keepdim=false)
-{
-    return A.var(dim, unbiased, keepdim);
-}
 
-static Tensor randn(const Shape & shape, const TensorOptions & opt = {})
+class MSELoss
 {
-    std::uniform_real_distribution<float> distr(-1, 1);
+public:
+    Tensor operator()(const Tensor & predictions, const Tensor & targets)
+    {
+        auto diff = predictions - targets;
+        auto loss = mean(diff * diff);
+        return loss;
+    }
+};
 
-    size_t totalSize = std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<>());
-    std::vector<float> rndData(totalSize);
 
-    // Fill rndData with random numbers
-    std::generate(rndData.begin(), rndData.end(), [&distr]() -> float { return distr(randGen); });
+class BinaryCrossEntropyLoss
+{
+public:
+    // Prediction values must be in [0..1] range.
+    Tensor operator()(const Tensor & predictions, const Tensor & targets)
+    {
+        return -mean(targets * log(predictions) + (1 - targets) * log(1 - predictions));
+    }
+};
 
-    return Tensor{rndData.data(), rndData.size(), getDataType<float>(), shape, opt};
-}
 
-// Returns evenly spaced values within a given interval. The interval including start but excluding stop. [start, end)
-static Tensor arange(float start, float end, float step, const TensorOptions & opt = {})
+class CrossEntropyLoss
 {
-    if (step == 0)
+public:
+    // Constructor. By default, prediction values must be in [0..1] range. If the predictions are logits, the loss
+    // fuses logSoftmax along the class dimension with the negative log-likelihood, and it is the mean of the losses of
+    // the samples. Targets must be (one-shot) or class probabilities.
+    explicit CrossEntropyLoss(bool fromLogits=false, ssize_t classDim=-1) :
+        m_fromLogits{fromLogits}, m_classDim{classDim}
     {
-        throw std::invalid_argument("Step must be non-zero.");
     }
 
-    auto range = end - start;
-    if ((range > 0 && step < 0) || (range < 0 && step > 0))
+    Tensor operator()(const Tensor & predictions, const Tensor & targets)
     {
-        throw std::invalid_argument("Range direction is inconsistent with step sign.");
+        if (m_fromLogits)
+        {
+            return mean(crossEntropy(predictions, targets, m_classDim));
+        }
+        return -mean(targets * log(predictions));
     }
 
-    auto size = static_cast<size_t>(std::ceil(range / step));
-    std::vector<float> data(size);
-    std::generate(data.begin(), data.end(), [step,x=start]() mutable -> float { float v=x; x += step; return v; });
-    return Tensor{data.data(), data.size(), getDataType<float>(), {size}, opt};
-}
-inline Tensor arange(float end, const TensorOptions & opt = {})               { return arange(0.0, end, 1.0, opt);   }
-inline Tensor arange(float start, float end, const TensorOptions & opt = {})  { return arange(start, end, 1.0, opt); }
+private:
+    bool    m_fromLogits{false};
+    ssize_t m_classDim{-1};
+};
 
-static Tensor eye(size_t n, const TensorOptions & opt = {})
+
+// Sums the gradient buckets of the processes of a multi-process data-parallel training. A transport, i.e. TCP or RDMA,
+// implements the reduction between its processes.
+class ProcessGroup
 {
-    std::vector<float> data(n * n, 0);
-    for (size_t i=0; i<n; ++i)
-    {
-        data[i * n + i] = 1;
-    }
-    return Tensor{data.data(), data.size(), getDataType<float>(), aix::Shape{n, n}, opt};
-}
+public:
+    virtual ~ProcessGroup() = default;
 
-// Optimizers Namespace
+    // Returns the number of processes.
+    virtual size_t size() const = 0;
 
+    // Sums the Float32 bucket of all processes in place. All processes reduce the same buckets in the same order.
+    virtual void allReduce(TensorValue & bucket) = 0;
+};
 
-namespace optim
-{
 
-class Optimizer
+// Trains replicas of a module on multiple devices. Each replica computes the gradients of its chunk of the batch in its
+// own thread, and the gradients are averaged over the replicas and the processes, so the optimizers of the replicas
+// apply the same updates. The gradients are reduced in buckets, in the reverse order of the parameters. A bucket is
+// reduced once all replicas computed its gradients, while the backward passes compute the remaining gradients.
+class DataParallel
 {
 public:
-    // Constructor
-    Optimizer() = default;
-
-    // Constructor
-    explicit Optimizer(const std::vector<std::pair<std::string, Tensor>> & parameters) : m_parameters(parameters) { }
+    using ModuleFactory = std::function<std::unique_ptr<Module>()>;
+    using LossFunction  = std::function<Tensor(Module & replica, size_t index)>;
 
-    // Constructor
-    explicit Optimizer(const std::vector<Tensor> & parameters)
+    // Constructor. The factory creates the replicas, which get the parameters of the first replica.
+    DataParallel(const std::vector<Device*> & devices, const ModuleFactory & factory,
+                 size_t bucketBytes = 25 * 1024 * 1024, std::shared_ptr<ProcessGroup> processGroup = nullptr) :
+        m_devices{devices}, m_processGroup{std::move(processGroup)}
     {
-        for (auto& param : parameters)
+        if (devices.empty())
         {
-            m_parameters.emplace_back("", param);
+            throw std::invalid_argument("DataParallel needs at least one device.");
+        }
+        for (auto device : devices)
+        {
+            m_replicas.emplace_back(factory());
+            m_replicas.back()->to(device);
         }
+        broadcastParameters();
+
+        for (size_t r = 0; r < m_replicas.size(); ++r)
+        {
+            auto & parameters = m_parameters.emplace_back();
+            for (const auto & [name, param] : m_replicas[r]->parameters())
+            {
+                if (!param.isRequireGrad()) continue;
+                if (param.isSparseGrad())
+                {
+                    throw std::invalid_argument("DataParallel does not support sparse gradients.");
+                }
+                param.gradHook([this, r, p = parameters.size()] { gradReady(r, p); });
+                parameters.emplace_back(param);
+            }
+        }
+        createBuckets(bucketBytes);
     }
 
     // Destructor
-    virtual ~Optimizer() = default;
+    ~DataParallel()
+    {
+        for (const auto & parameters : m_parameters)
+        {
+            for (const auto & param : parameters) param.gradHook(nullptr);
+        }
+    }
 
-    virtual void step() = 0;
+    DataParallel(const DataParallel &) = delete;
+    DataParallel & operator=(const DataParallel &) = delete;
 
-    virtual void zeroGrad()
+    inline size_t replicas() const                  { return m_replicas.size(); }
+    inline Module & replica(size_t index)           { return *m_replicas[index]; }
+    inline Device * device(size_t index) const      { return m_devices[index]; }
+
+    // Creates an optimizer of the type for each replica with the given hyperparameters.
+    template <typename T, typename... Args>
+    void createOptimizers(const Args & ... args)
     {
-        for (auto & [name, param] : m_parameters)
+        m_optimizers.clear();
+        for (const auto & replica : m_replicas)
         {
-            param.zeroGrad();
+            m_optimizers.emplace_back(std::make_unique<T>(replica->parameters(), args...));
         }
     }
 
-    inline void setDataType(DataType dtype)
+    // Splits the batch along the first dimension into the chunks of the replicas on their devices. The chunks differ by
+    // one sample at most.
+    std::vector<Tensor> scatter(const Tensor & batch) const
     {
-        if (dtype != DataType::kFloat64 && dtype != DataType::kFloat32 &&
-            dtype != DataType::kFloat16 && dtype != DataType::kBFloat16)
+        if (batch.shape().empty() || batch.shape()[0] < m_replicas.size())
         {
-            throw std::invalid_argument("Optimization has to perform in Float data type to be effective.");
+            throw std::invalid_argument("DataParallel needs at least one sample for each replica.");
         }
-        m_calculationDType = dtype;
+
+        std::vector<Tensor> chunks;
+        size_t batchSize = batch.shape()[0];
+        for (size_t r = 0; r < m_replicas.size(); ++r)
+        {
+            auto begin = static_cast<ssize_t>(r * batchSize / m_replicas.size());
+            auto end   = static_cast<ssize_t>((r + 1) * batchSize / m_replicas.size());
+            chunks.emplace_back(batch.slice(0, begin, end).to(m_devices[r]));
+            // The replicas read the chunks in their threads.
+            m_devices[r]->synchronize();
+        }
+        return chunks;
     }
 
-protected:
-    std::vector<std::pair<std::string, Tensor>> m_parameters;
-    DataType m_calculationDType{DataType::kFloat32};
-};
+    // Computes the losses of the replicas and their gradients, and averages the gradients. Returns the losses.
+    std::vector<Tensor> backward(const LossFunction & lossFunc)
+    {
+        for (size_t r = 0; r < m_replicas.size(); ++r)
+        {
+            m_isParamReady[r].assign(m_parameters[r].size(), false);
+            for (size_t b = 0; b < m_buckets.size(); ++b)
+            {
+                m_pendingParams[r][b] = m_buckets[b].params.size();
+            }
+        }
+        m_readyReplicas.assign(m_buckets.size(), 0);
+        m_isBackwardDone = false;
+        m_isReducing = true;
 
+        std::exception_ptr reduceError;
+        std::thread reducer([this, &reduceError]
+        {
+            try { reduceBuckets(); } catch (...) { reduceError = std::current_exception(); }
+        });
 
-class SGD : public Optimizer
-{
-public:
-    SGD() = default;
+        std::vector<Tensor> losses(m_replicas.size());
+        std::exception_ptr error;
+        try
+        {
+            run([&](size_t r)
+            {
+                // The reducer reads the gradients of all parameters. The missing ones are allocated and zeroed here,
+                // since the device of a replica is used by its thread only.
+                for (auto & param : m_parameters[r]) param.grad();
+                losses[r] = lossFunc(*m_replicas[r], r);
+                losses[r].backward();
+                m_devices[r]->synchronize();
+            });
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
 
-    explicit SGD(const std::vector<std::pair<std::string, Tensor>> & parameters, float lr = 0.01f)
-        : Optimizer(parameters), m_lr(lr) { }
+        // The buckets that have parameters without gradients are reduced last.
+        {
+            std::lock_guard<std::mutex>  lock(m_mutex);
+            m_isBackwardDone = true;
+        }
+        m_cv.notify_all();
+        reducer.join();
+        m_isReducing = false;
 
-    explicit SGD(const std::vector<Tensor> & parameters, float lr = 0.01f) : Optimizer(parameters), m_lr(lr) { }
+        if (error) std::rethrow_exception(error);
+        if (reduceError) std::rethrow_exception(reduceError);
+        return losses;
+    }
 
-    void step() final
+    // Runs the optimizers of the replicas, see createOptimizers().
+    void zeroGrad()     { run([&](size_t r) { m_optimizers[r]->zeroGrad(); m_devices[r]->synchronize(); }); }
+    void step()         { run([&](size_t r) { m_optimizers[r]->step();     m_devices[r]->synchronize(); }); }
+
+    // Copies the parameters of the first replica to the other replicas, i.e. after loading a checkpoint into it.
+    void broadcastParameters()
     {
-        for (auto & [name, param] : m_parameters)
+        auto source = m_replicas.front()->parameters();
+        m_devices.front()->synchronize();
+        for (size_t r = 1; r < m_replicas.size(); ++r)
         {
-            if (param.isRequireGrad())
+            auto params = m_replicas[r]->parameters();
+            for (size_t i = 0; i < params.size(); ++i)
             {
-                param.value() -= param.grad() * m_lr;   // w' = w - lr * w_gradient.
+                params[i].second.value() = source[i].second.value().to(m_devices[r]);
             }
+            m_devices[r]->synchronize();
         }
     }
 
 private:
-    float m_lr{0.01f};      // Learning rate
-};
+    struct Bucket
+    {
+        std::vector<size_t>  params;        // Parameter indices.
+        std::vector<size_t>  offsets;       // Offsets of the parameters in the bucket.
+        size_t  size{0};
+    };
 
+    // Runs the function for each replica in its own thread, and rethrows the first exception.
+    void run(const std::function<void(size_t)> & func)
+    {
+        bool gradMode = GradMode::isEnabled();
+        std::vector<std::exception_ptr> errors(m_replicas.size());
+        std::vector<std::thread> threads;
+        for (size_t r = 0; r < m_replicas.size(); ++r)
+        {
+            threads.emplace_back([&, r]
+            {
+                try
+                {
+                    GradModeGuard guard(gradMode);
+                    func(r);
+                }
+                catch (...)
+                {
+                    errors[r] = std::current_exception();
+                }
+            });
+        }
+        for (auto & thread : threads)
+        {
+            thread.join();
+        }
+        for (const auto & error : errors)
+        {
+            if (error) std::rethrow_exception(error);
+        }
+    }
 
-class Adam : public Optimizer
-{
-public:
-    Adam() = default;
+    // The backward pass usually computes the gradients of the last parameters first.
+    void createBuckets(size_t bucketBytes)
+    {
+        const auto & parameters = m_parameters.front();
+        m_paramBuckets.resize(parameters.size());
+        for (size_t p = parameters.size(); p-- > 0;)
+        {
+            auto size = parameters[p].value().size();
+            if (m_buckets.empty() || (m_buckets.back().size + size) * sizeof(float) > bucketBytes)
+            {
+                m_buckets.emplace_back();
+            }
+            auto & bucket = m_buckets.back();
+            bucket.params.emplace_back(p);
+            bucket.offsets.emplace_back(bucket.size);
+            bucket.size += size;
+            m_paramBuckets[p] = m_buckets.size() - 1;
+        }
+        m_pendingParams.assign(m_replicas.size(), std::vector<size_t>(m_buckets.size(), 0));
+        m_isParamReady.resize(m_replicas.size());
+    }
 
-    explicit Adam(const std::vector<std::pair<std::string, Tensor>> & parameters, float lr = 0.001f, float beta1 = 0.9f,
-                  float beta2 = 0.999f, float epsilon = 1e-8f)
-        : Optimizer(parameters), m_lr(lr), m_beta1(beta1), m_beta2(beta2), m_epsilon(epsilon)
+    // Called by the backward pass of a replica in its thread.
+    void gradReady(size_t replica, size_t param)
     {
-        initializeParameters();
+        if (!m_isReducing || m_isParamReady[replica][param]) return;
+        m_isParamReady[replica][param] = true;
+        auto bucket = m_paramBuckets[param];
+        if (--m_pendingParams[replica][bucket] > 0) return;
+
+        // The queued commands of the replica compute the gradients.
+        m_devices[replica]->synchronize();
+        {
+            std::lock_guard<std::mutex>  lock(m_mutex);
+            ++m_readyReplicas[bucket];
+        }
+        m_cv.notify_all();
     }
 
-    explicit Adam(const std::vector<Tensor> & parameters, float lr = 0.001f, float beta1 = 0.9f,
-                  float beta2 = 0.999f, float epsilon = 1e-8f)
-        : Optimizer(parameters), m_lr(lr), m_beta1(beta1), m_beta2(beta2), m_epsilon(epsilon)
+    // Reduces the buckets in order, so that all processes reduce the same buckets in the same order.
+    void reduceBuckets()
     {
-        initializeParameters();
+        for (size_t b = 0; b < m_buckets.size(); ++b)
+        {
+            {
+                std::unique_lock<std::mutex>  lock(m_mutex);
+                m_cv.wait(lock, [&] { return m_readyReplicas[b] == m_replicas.size() || m_isBackwardDone; });
+            }
+            reduceBucket(m_buckets[b]);
+        }
     }
 
-    void step() final
+    // Sums the gradients of the bucket of the replicas in a Float32 host buffer, and writes the average back.
+    void reduceBucket(const Bucket & bucket)
     {
-        ++m_timestep;
-        for (size_t i = 0; i < m_parameters.size(); ++i)
+        TensorValue sum(0.0, Shape{bucket.size}, &m_hostDevice, DataType::kFloat32);
+        TensorValue grads(Shape{bucket.size}, &m_hostDevice, DataType::kFloat32);
+        for (auto & parameters : m_parameters)
         {
-            auto& parameter = m_parameters[i].second;
+            for (size_t i = 0; i < bucket.params.size(); ++i)
+            {
+                auto & grad = parameters[bucket.params[i]].grad();
+                assert(grad.isContiguous());
+                m_hostDevice.copy(grad.data(), grad.dataType(), grads.data<float>() + bucket.offsets[i],
+                                  DataType::kFloat32, grad.size());
+            }
+            sum += grads;
+        }
+
+        size_t processCount = m_processGroup ? m_processGroup->size() : 1;
+        if (m_processGroup) m_processGroup->allReduce(sum);
+        sum *= 1.0f / static_cast<float>(m_replicas.size() * processCount);
 
-            if (parameter.isRequireGrad())
+        for (auto & parameters : m_parameters)
+        {
+            for (size_t i = 0; i < bucket.params.size(); ++i)
             {
-                // Convert the parameter's data type to the optimizer's internal calculation type.
-                auto gradFloat = parameter.grad().to(m_calculationDType);
+                auto & grad = parameters[bucket.params[i]].grad();
+                m_hostDevice.copy(sum.data<float>() + bucket.offsets[i], DataType::kFloat32, grad.data(),
+                                  grad.dataType(), grad.size());
+            }
+        }
+    }
+
+    std::vector<Device*>  m_devices;
+    std::vector<std::unique_ptr<Module>>  m_replicas;
+    std::vector<std::unique_ptr<optim::Optimizer>>  m_optimizers;
+    std::vector<std::vector<Tensor>>  m_parameters;         // The parameters of the replicas that require gradients.
+    std::shared_ptr<ProcessGroup>  m_processGroup;
+    std::vector<Bucket>  m_buckets;
+    std::vector<size_t>  m_paramBuckets;                    // The bucket of each parameter.
+    std::vector<std::vector<size_t>>  m_pendingParams;      // The parameters without gradients of the replica buckets.
+    std::vector<std::vector<bool>>    m_isParamReady;
+    std::vector<size_t>  m_readyReplicas;                   // The replicas that computed the gradients of a bucket.
+    bool  m_isBackwardDone{false};
+    bool  m_isReducing{false};
+    std::mutex  m_mutex;
+    std::condition_variable  m_cv;
+    Device  m_hostDevice;                                   // Used by the reduction thread only.
+};
 
-                // Update biased first moment estimate.
-                m_m[i] = m_beta1 * m_m[i] + float(1.0 - m_beta1) * gradFloat;
+}   // nn namespace
 
-                // Update biased second raw moment estimate.
-                m_v[i] = m_beta2 * m_v[i] + float(1.0 - m_beta2) * gradFloat * gradFloat;
 
-                // Compute bias-corrected first moment estimate.
-                TensorValue mHat = m_m[i] / float(1.0 - std::pow(m_beta1, m_timestep));
+// Auxiliary Features
 
-                // Compute bias-corrected second raw moment estimate.
-                TensorValue vHat = m_v[i] / float(1.0 - std::pow(m_beta2, m_timestep));
 
-                // Update parameter.
-                parameter.value() -= (m_lr * mHat / (vHat.sqrt() + m_epsilon)).to(parameter.dataType());
-            }
+// Checkpoint file format. Integers are stored in the native byte order of the machine.
+//   char[8]    Magic: "AIXCKPT"
+//   uint32     Format version
+//   uint32     Entry count
+//   uint64     Payload alignment
+//   Entries:   uint32 name length, name, uint32 data type, uint32 rank, uint64 dims[rank], uint64 payload offset,
+//              uint64 payload size in bytes
+//   Payloads:  Raw tensor data. Each payload starts at an offset aligned to the payload alignment, which allows mapping
+//              the payloads into memory without copying.
+constexpr char      CheckpointMagic[8]   = "AIXCKPT";
+constexpr uint32_t  CheckpointVersion    = 1;
+constexpr size_t    CheckpointAlignment  = 16384;      // Covers both 4KB and 16KB memory page sizes.
+
+struct CheckpointEntry
+{
+    std::string  name;
+    DataType     dtype{DataType::kFloat32};
+    Shape        shape;
+    size_t       offset{0};
+    size_t       byteSize{0};
+};
+
+
+// Returns a unique name for each parameter. Repeated names get an occurrence suffix, i.e. "w", "w.1", "w.2".
+inline std::vector<std::string> checkpointNames(const std::vector<std::pair<std::string,Tensor>> & params)
+{
+    std::vector<std::string> names;
+    std::unordered_set<std::string> usedNames;
+    std::unordered_map<std::string, size_t> occurrences;
+    names.reserve(params.size());
+    for (const auto& [paramName, param] : params)
+    {
+        auto name = paramName;
+        while (!usedNames.insert(name).second)
+        {
+            name = paramName + "." + std::to_string(++occurrences[paramName]);
         }
+        names.emplace_back(std::move(name));
     }
+    return names;
+}
 
-private:
-    void initializeParameters()
+
+// A read-only view of a checkpoint file. The file is mapped into memory, and tensor data is read only when a tensor
+// is requested. Requested tensors keep the mapping alive, so they can outlive the checkpoint object.
+class Checkpoint
+{
+public:
+    // Constructor
+    explicit Checkpoint(const std::string & filename)
     {
-        for (const auto & [name, param] : m_parameters)
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::ios_base::failure("Failed to open checkpoint file for reading.");
+        }
+
+        struct stat fileStat{};
+        void* address = MAP_FAILED;
+        if (::fstat(fd, &fileStat) == 0 && fileStat.st_size > 0)
+        {
+            m_size = static_cast<size_t>(fileStat.st_size);
+            // Private mapping: in-place updates of the loaded tensors are copy-on-write and never reach the file.
+            address = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+
+        if (address == MAP_FAILED)
         {
-            m_m.emplace_back(0, param.shape(), param.value().device(), m_calculationDType);
-            m_v.emplace_back(0, param.shape(), param.value().device(), m_calculationDType);
+            throw std::ios_base::failure("Failed to map checkpoint file into memory.");
         }
+        m_mapping = std::shared_ptr<void>(address, [size = m_size](void* ptr) { ::munmap(ptr, size); });
+        readHeader();
     }
 
-    float m_lr{0.001f};         // Learning rate.
-    float m_beta1{0.9f};        // Exponential decay rate for the first moment estimates.
-    float m_beta2{0.999f};      // Exponential decay rate for the second moment estimates.
-    float m_epsilon{1e-8f};     // Small constant for numerical stability.
-    size_t m_timestep{0};       // Time step.
-    std::vector<TensorValue>    m_m;    // First moment vector.
-    std::vector<TensorValue>    m_v;    // Second moment vector.
-};
+    // Returns true if the file starts with the checkpoint magic.
+    static bool isCheckpointFile(const std::string & filename)
+    {
+        std::ifstream ifs(filename, std::ios::binary);
+        char magic[sizeof(CheckpointMagic)]{};
+        ifs.read(magic, sizeof(magic));
+        return ifs && std::memcmp(magic, CheckpointMagic, sizeof(magic)) == 0;
+    }
 
-}   // optim namespace
+    inline uint32_t version() const                                { return m_version; }
+    inline const std::vector<CheckpointEntry> & entries() const     { return m_entries; }
+    inline bool contains(const std::string & name) const            { return m_entryIndices.contains(name); }
 
+    const CheckpointEntry & entry(const std::string & name) const
+    {
+        auto it = m_entryIndices.find(name);
+        if (it == m_entryIndices.end())
+        {
+            throw std::invalid_argument("Checkpoint does not contain the tensor '" + name + "'.");
+        }
+        return m_entries[it->second];
+    }
 
-// Neural Network Namespace
+    // Returns the tensor value with the given name. The payload is used without copying if the data types match and
+    // the device can access host memory. Otherwise, the payload is copied and converted to the requested data type.
+    TensorValue tensor(const std::string & name, Device * device, DataType dtype) const
+    {
+        const auto & info = entry(name);
+        auto data = static_cast<char*>(m_mapping.get()) + info.offset;
+        size_t size = info.byteSize / Device::dataTypeSize(info.dtype);
 
+        if (info.dtype == dtype && info.byteSize > 0)
+        {
+            if (auto memory = device->mapHostMemory(data, info.byteSize))
+            {
+                auto storage = std::make_shared<TensorStorage>(device, memory, info.byteSize, m_mapping);
+                return {storage, size, 0, info.shape, device, dtype};
+            }
+        }
+        return {data, size, info.dtype, info.shape, device, dtype};
+    }
 
-namespace nn
-{
+    TensorValue tensor(const std::string & name, Device * device) const
+    {
+        return tensor(name, device, entry(name).dtype);
+    }
 
-class Module
-{
-public:
-    virtual ~Module() = default;
+    // Returns the mapped payload of the tensor with the given name. The pointer is valid while the checkpoint exists.
+    const void * data(const std::string & name) const
+    {
+        return static_cast<const char*>(m_mapping.get()) + entry(name).offset;
+    }
 
-    virtual Tensor forward(Tensor x) const = 0;
+private:
+    void read(size_t & position, void * data, size_t size) const
+    {
+        if (position + size > m_size)
+        {
+            throw std::runtime_error("Invalid checkpoint file: unexpected end of header.");
+        }
+        std::memcpy(data, static_cast<const char*>(m_mapping.get()) + position, size);
+        position += size;
+    }
 
-    void registerParameter(const std::string& paramName, Tensor & tensor)
+    template<typename T>
+    T read(size_t & position) const
     {
-        m_parameters.emplace_back(paramName, tensor);
+        T value;
+        read(position, &value, sizeof(T));
+        return value;
     }
 
-    void registerModule(const Module & module)
+    void readHeader()
     {
-        for (const auto& [paramName, param] : module.parameters())
+        size_t position = 0;
+        char magic[sizeof(CheckpointMagic)];
+        read(position, magic, sizeof(magic));
+        if (std::memcmp(magic, CheckpointMagic, sizeof(magic)) != 0)
         {
-            m_parameters.emplace_back(paramName, param);
+            throw std::runtime_error("Invalid checkpoint file: magic mismatch.");
+        }
+
+        m_version = read<uint32_t>(position);
+        if (m_version != CheckpointVersion)
+        {
+            throw std::runtime_error("Unsupported checkpoint version: " + std::to_string(m_version) + ".");
+        }
+
+        auto entryCount = read<uint32_t>(position);
+        read<uint64_t>(position);       // Payload alignment is not needed to read the payloads.
+        m_entries.resize(entryCount);
+        for (size_t i=0; i<entryCount; ++i)
+        {
+            auto & info = m_entries[i];
+            info.name.resize(read<uint32_t>(position));
+            read(position, info.name.data(), info.name.size());
+            auto dtype = read<uint32_t>(position);
+            if (dtype >= DataTypeCount)
+            {
+                throw std::runtime_error("Invalid checkpoint file: unknown data type of '" + info.name + "'.");
+            }
+            info.dtype = static_cast<DataType>(dtype);
+            info.shape.resize(read<uint32_t>(position));
+            for (auto & dim : info.shape)
+            {
+                dim = read<uint64_t>(position);
+            }
+            info.offset   = read<uint64_t>(position);
+            info.byteSize = read<uint64_t>(position);
+
+            size_t elementCount = std::accumulate(info.shape.begin(), info.shape.end(), size_t(1), std::multiplies<>());
+            if (info.offset + info.byteSize > m_size || info.byteSize != elementCount * Device::dataTypeSize(info.dtype))
+            {
+                throw std::runtime_error("Invalid checkpoint file: corrupted payload of '" + info.name + "'.");
+            }
+            m_entryIndices[info.name] = i;
         }
     }
 
-    std::vector<std::pair<std::string,Tensor>> parameters() const
+    std::shared_ptr<void>  m_mapping;
+    size_t    m_size{0};
+    uint32_t  m_version{0};
+    std::vector<CheckpointEntry>  m_entries;
+    std::unordered_map<std::string, size_t>  m_entryIndices;
+};
+
+
+// Saves the named tensors to a checkpoint file.
+inline void save(const std::vector<std::pair<std::string,Tensor>> & params, const std::string & filename)
+{
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs)
+    {
+        throw std::ios_base::failure("Failed to open file for writing.");
+    }
+
+    auto align = [](size_t size) { return (size + CheckpointAlignment - 1) / CheckpointAlignment * CheckpointAlignment; };
+    auto write = [&ofs](const auto & value) { ofs.write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+
+    const auto names = checkpointNames(params);
+
+    // Compute the header size first to place the payloads at aligned offsets.
+    size_t headerSize = sizeof(CheckpointMagic) + 2 * sizeof(uint32_t) + sizeof(uint64_t);
+    for (size_t i=0; i<params.size(); ++i)
     {
-        return m_parameters;
+        headerSize += 3 * sizeof(uint32_t) + names[i].size() + (params[i].second.shape().size() + 2) * sizeof(uint64_t);
     }
 
-    // Returns the total number of elements (learnable parameters) in each Tensor.
-    size_t learnableParameters() const
+    std::vector<CheckpointEntry> entries(params.size());
+    size_t offset = align(headerSize);
+    for (size_t i=0; i<params.size(); ++i)
     {
-        size_t totalParams = 0;
-        for (const auto& [paramName, param]: m_parameters)
-        {
-            if (param.isRequireGrad())
-            {
-                totalParams += param.value().size();
-            }
-        }
-        return totalParams;
+        const auto & param = params[i].second;
+        entries[i] = { names[i], param.dataType(), param.shape(), offset,
+                       param.value().size() * Device::dataTypeSize(param.dataType()) };
+        offset = align(offset + entries[i].byteSize);
     }
 
-    void to(std::unique_ptr<Device> & device) const   { to(*device); }
-    void to(Device * device) const                    { to(*device); }
-    void to(Device & device) const
+    ofs.write(CheckpointMagic, sizeof(CheckpointMagic));
+    write(CheckpointVersion);
+    write(static_cast<uint32_t>(entries.size()));
+    write(static_cast<uint64_t>(CheckpointAlignment));
+    for (const auto & info : entries)
     {
-        for (auto& [paramName, param] : parameters())
+        write(static_cast<uint32_t>(info.name.size()));
+        ofs.write(info.name.data(), static_cast<std::streamsize>(info.name.size()));
+        write(static_cast<uint32_t>(info.dtype));
+        write(static_cast<uint32_t>(info.shape.size()));
+        for (auto dim : info.shape)
         {
-            param.value() = param.value().to(&device);
-            param.grad()  = param.grad().to(&device);
+            write(static_cast<uint64_t>(dim));
         }
+        write(static_cast<uint64_t>(info.offset));
+        write(static_cast<uint64_t>(info.byteSize));
     }
 
-    void to(DataType newDtype) const
+    // The file size is padded to the alignment as well, so that the last payload can be mapped in whole pages.
+    std::vector<char> padding(CheckpointAlignment, 0);
+    size_t position = headerSize;
+    for (size_t i=0; i<params.size(); ++i)
     {
-        for (auto& [paramName, param] : parameters())
-        {
-            if (param.isRequireGrad())
-            {
-                param.value() = param.value().to(newDtype);
-                param.grad()  = param.grad().to(newDtype);
-            }
-        }
+        const auto & param = params[i].second;
+        param.synchronize();
+        ofs.write(padding.data(), static_cast<std::streamsize>(entries[i].offset - position));
+        ofs.write(static_cast<const char*>(param.value().data()), static_cast<std::streamsize>(entries[i].byteSize));
+        position = entries[i].offset + entries[i].byteSize;
     }
+    ofs.write(padding.data(), static_cast<std::streamsize>(align(position) - position));
 
-private:
-    std::vector<std::pair<std::string, Tensor>> m_parameters;
-};
+    if (!ofs)
+    {
+        throw std::ios_base::failure("Failed to write the checkpoint file.");
+    }
+    ofs.close();
+}
 
+inline void save(const nn::Module & module, const std::string & filename)
+{
+    save(module.parameters(), filename);
+}
 
-class Sequential : public Module
+// Loads the parameters of the module from the checkpoint. If names are given, only those parameters are loaded.
+// Payloads are converted to the data types of the parameters.
+inline void load(nn::Module & module, const Checkpoint & checkpoint, const std::vector<std::string> & names = {})
 {
-public:
-    // Override the forward function.
-    Tensor forward(Tensor x) const override
+    std::unordered_set<std::string> selectedNames(names.begin(), names.end());
+    auto params = module.parameters();    // Get model parameters.
+    auto paramNames = checkpointNames(params);
+    for (size_t i=0; i<params.size(); ++i)
     {
-        for (const auto & module : m_modules)
+        if (!names.empty() && !selectedNames.erase(paramNames[i])) continue;
+
+        auto & param = params[i].second;
+        if (!checkpoint.contains(paramNames[i]))
         {
-            x = module->forward(x);
+            throw std::runtime_error("Parameter '" + paramNames[i] + "' is not found in the checkpoint.");
         }
-        return x;
+        // Parameters with a loader, such as quantized weights, convert the checkpoint tensors of other forms.
+        const auto & entry = checkpoint.entry(paramNames[i]);
+        const auto & loader = module.parameterLoaders()[i];
+        if (loader && (entry.shape != param.shape() || entry.dtype != param.dataType()))
+        {
+            loader(checkpoint.tensor(paramNames[i], &defaultDevice));
+            continue;
+        }
+        if (entry.shape != param.shape())
+        {
+            throw std::runtime_error("Invalid parameter shape found when loading the model.");
+        }
+        param.value() = checkpoint.tensor(paramNames[i], param.device(), param.dataType());
     }
 
-    // Function to add modules dynamically if needed.
-    void add(Module* module)
+    if (!selectedNames.empty())
     {
-        registerModule(*module);
-        m_modules.emplace_back(module);     // Use std::unique_ptr to take ownership of the module pointer.
+        throw std::invalid_argument("Parameter '" + *selectedNames.begin() + "' is not found in the model.");
     }
+}
 
-protected:
-    // Use std::unique_ptr for polymorphic containment.
-    std::vector<std::unique_ptr<Module>>  m_modules;
-};
-
-
-class Linear : public Module
+inline void load(nn::Module & module, const std::string & filename, const std::vector<std::string> & names = {})
 {
-public:
-    // Constructor
-    Linear() = default;
+    if (Checkpoint::isCheckpointFile(filename))
+    {
+        load(module, Checkpoint(filename), names);
+        return;
+    }
 
-    // Constructor
-    Linear(size_t numInputs, size_t numOutputs)
+    // Files without a checkpoint header store the size and the raw data of each parameter in order.
+    if (!names.empty())
     {
-        m_w = randn({numInputs, numOutputs}, { .m_requireGrad=true });
-        m_b = randn({1,         numOutputs}, { .m_requireGrad=true });
+        throw std::invalid_argument("Loading selected parameters requires a checkpoint file.");
+    }
 
-        // Register learnable parameters.
-        registerParameter("w", m_w);
-        registerParameter("b", m_b);
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs)
+    {
+        throw std::ios_base::failure("Failed to open model parameter file for reading.");
     }
 
-    // Forward
-    Tensor forward(Tensor x) const override
+    auto params = module.parameters();    // Get model parameters.
+    for (auto& [paramName, param] : params)
     {
-        return matmul(x, m_w) + m_b;
+        size_t size;
+        ifs.read(reinterpret_cast<char*>(&size), sizeof(size));         // Read size of parameter
+        if (size != param.value().size())
+        {
+            throw std::runtime_error("Invalid parameter size found when loading the model.");
+        }
+        size_t paramDTypeSize = Device::dataTypeSize(param.dataType());
+        ifs.read(reinterpret_cast<char*>(param.value().data()), size * paramDTypeSize); // Read the parameter data
     }
 
-    Tensor  m_w;
-    Tensor  m_b;
-};
+    ifs.close();
+}
 
+namespace data
+{
 
-class Tanh : public Module
+// Describes a field of the samples, i.e. the inputs or the targets. The shape does not include the sample dimension.
+struct Field
 {
-public:
-    // Forward
-    Tensor forward(Tensor x) const override
+    std::string  name;
+    DataType     dtype{DataType::kFloat32};
+    Shape        shape;
+
+    inline size_t byteSize() const
     {
-        return tanh(x);
+        auto count = std::accumulate(shape.begin(), shape.end(), size_t(1), std::multiplies<>());
+        return count * Device::dataTypeSize(dtype);
     }
 };
 
 
-class Sigmoid : public Module
+// A collection of samples with the same fields. Samples are read concurrently by the worker threads of data loaders.
+class Dataset
 {
 public:
-    // Forward
-    Tensor forward(Tensor x) const override
-    {
-        return 1 / (1 + exp(-x));
-    }
+    // Destructor
+    virtual ~Dataset() = default;
+
+    // Returns the number of samples.
+    virtual size_t size() const = 0;
+
+    virtual const std::vector<Field> & fields() const = 0;
+
+    // Copies the fields of the sample to the destinations in the order of the fields.
+    virtual void read(size_t index, const std::vector<void*> & destinations) const = 0;
 };
 
 
-class Softmax : public Module
+// An in-memory dataset. The first dimension of each tensor indexes the samples.
+class TensorDataset : public Dataset
 {
 public:
-    // Constructor.
-    explicit Softmax(ssize_t dim=0, bool keepDim=false) : m_dim{dim}, m_keepDim{keepDim} { }
+    // Constructor. The dataset keeps contiguous copies of the tensors.
+    explicit TensorDataset(const std::vector<std::pair<std::string,Tensor>> & tensors)
+    {
+        for (const auto & [name, tensor] : tensors)
+        {
+            if (tensor.shape().empty() || tensor.shape()[0] != tensors.front().second.shape()[0])
+            {
+                throw std::invalid_argument("TensorDataset requires tensors with the same number of samples.");
+            }
+            tensor.synchronize();
+            m_values.emplace_back(tensor.value().contiguous());
+            m_fields.push_back({ name, tensor.dataType(), Shape(tensor.shape().begin() + 1, tensor.shape().end()) });
+        }
+        m_size = tensors.empty() ? 0 : tensors.front().second.shape()[0];
+    }
 
-    Tensor forward(Tensor x) const override
+    size_t size() const final                           { return m_size; }
+    const std::vector<Field> & fields() const final     { return m_fields; }
+
+    void read(size_t index, const std::vector<void*> & destinations) const final
     {
-        x = (x - x.max(m_dim, m_keepDim)).exp();
-        return x / x.sum(m_dim, m_keepDim);
+        for (size_t i=0; i<m_fields.size(); ++i)
+        {
+            auto byteSize = m_fields[i].byteSize();
+            std::memcpy(destinations[i], static_cast<const char*>(m_values[i].data()) + index * byteSize, byteSize);
+        }
     }
 
 private:
-    ssize_t m_dim{0};
-    bool m_keepDim{false};
+    std::vector<TensorValue>  m_values;
+    std::vector<Field>  m_fields;
+    size_t  m_size{0};
 };
 
 
-class LogSoftmax : public Module
+// A dataset of binary shards that are memory-mapped checkpoint files. Each tensor in a shard is a field, and its first
+// dimension indexes the samples in the shard. Shards can be written by aix::save() and must contain the same fields.
+class ShardDataset : public Dataset
 {
 public:
-    // Forward
-    Tensor forward(Tensor x) const override
+    // Constructor
+    explicit ShardDataset(const std::vector<std::string> & filenames)
     {
-        // LogSoftmax(x) = log(e^x / sum(e^x)) = log(e^x) - log(sum(e^x)) = x - log(sum(e^x))
-        return x - x.exp().sum().log();
-    }
-};
+        if (filenames.empty())
+        {
+            throw std::invalid_argument("ShardDataset requires at least one shard.");
+        }
 
+        for (const auto & filename : filenames)
+        {
+            const auto & shard = m_shards.emplace_back(filename);
+            const auto & entries = shard.entries();
+            if (m_shards.size() == 1)
+            {
+                for (const auto & info : entries)
+                {
+                    m_fields.push_back({ info.name, info.dtype, Shape(info.shape.begin() + (info.shape.empty() ? 0 : 1),
+                                                                      info.shape.end()) });
+                }
+            }
 
-class GeLU : public Module
-{
-public:
-    // Forward
-    Tensor forward(Tensor x) const override
-    {
-        return 0.5 * x * (1.0 + tanh(std::sqrtf(2.0 / std::numbers::pi) * (x + 0.044715 * x.pow(3))));
+            size_t count = entries.empty() || entries.front().shape.empty() ? 0 : entries.front().shape[0];
+            auto & payloads = m_payloads.emplace_back();
+            for (const auto & field : m_fields)
+            {
+                const auto & info = shard.entry(field.name);
+                if (entries.size() != m_fields.size() || info.shape.empty() || info.shape[0] != count ||
+                    info.dtype != field.dtype || Shape(info.shape.begin() + 1, info.shape.end()) != field.shape)
+                {
+                    throw std::invalid_argument("Shard '" + filename + "' does not match the fields of the dataset.");
+                }
+                payloads.emplace_back(static_cast<const char*>(shard.data(field.name)));
+            }
+            m_sampleEnds.emplace_back((m_sampleEnds.empty() ? 0 : m_sampleEnds.back()) + count);
+        }
     }
-};
 
+    size_t size() const final                           { return m_sampleEnds.back(); }
+    const std::vector<Field> & fields() const final     { return m_fields; }
 
-class MSELoss
-{
-public:
-    Tensor operator()(const Tensor & predictions, const Tensor & targets)
+    void read(size_t index, const std::vector<void*> & destinations) const final
     {
-        auto diff = predictions - targets;
-        auto loss = mean(diff * diff);
-        return loss;
+        auto shard = static_cast<size_t>(std::upper_bound(m_sampleEnds.begin(), m_sampleEnds.end(), index) -
+                                         m_sampleEnds.begin());
+        if (shard == m_shards.size())
+        {
+            throw std::out_of_range("ShardDataset sample index is out of range.");
+        }
+        size_t localIndex = index - (shard == 0 ? 0 : m_sampleEnds[shard - 1]);
+        for (size_t i=0; i<m_fields.size(); ++i)
+        {
+            auto byteSize = m_fields[i].byteSize();
+            std::memcpy(destinations[i], m_payloads[shard][i] + localIndex * byteSize, byteSize);
+        }
     }
+
+private:
+    std::vector<Checkpoint>  m_shards;
+    std::vector<std::vector<const char*>>  m_payloads;     // Payload of each field in each shard.
+    std::vector<size_t>  m_sampleEnds;                       // Cumulative sample counts of the shards.
+    std::vector<Field>  m_fields;
 };
 
 
-class BinaryCrossEntropyLoss
+struct DataLoaderOptions
 {
-public:
-    // Prediction values must be in [0..1] range.
-    Tensor operator()(const Tensor & predictions, const Tensor & targets)
-    {
-        return -mean(targets * log(predictions) + (1 - targets) * log(1 - predictions));
-    }
+    size_t   m_batchSize{1};
+    bool     m_shuffle{false};
+    bool     m_dropLast{false};         // Drops the last batch of the epoch if it is smaller than the batch size.
+    size_t   m_workerCount{1};          // The batches are read by the caller thread if there are no workers.
+    size_t   m_prefetchCount{2};        // The number of batches that are read ahead of the returned batch.
+    aix::Device*  m_device{&aix::defaultDevice};
 };
 
 
-class CrossEntropyLoss
+// Reads the batches of a dataset in worker threads. The batch tensors are allocated by the target device on the caller
+// thread, and the workers fill them in place while the caller computes the previous batches. Shared device memory
+// serves as the staging buffer, so the batches need no separate upload.
+class DataLoader
 {
 public:
-    // Prediction values must be in [0..1] range. Targets must be (one-shot).
-    Tensor operator()(const Tensor & predictions, const Tensor & targets)
+    // Constructor
+    explicit DataLoader(std::shared_ptr<Dataset> dataset, const DataLoaderOptions & options = {}) :
+        m_dataset{std::move(dataset)}, m_options{options}
     {
-        return -mean(targets * log(predictions));
+        if (m_options.m_batchSize == 0)
+        {
+            throw std::invalid_argument("DataLoader batch size must be greater than zero.");
+        }
+        m_order.resize(m_dataset->size());
+        reset();
+        for (size_t i=0; i<m_options.m_workerCount; ++i)
+        {
+            m_workers.emplace_back([this] { work(); });
+        }
     }
-};
 
-}   // nn namespace
+    // Destructor
+    ~DataLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_workAvailable.notify_all();
+        for (auto & worker : m_workers)
+        {
+            worker.join();
+        }
+    }
 
+    DataLoader(const DataLoader &) = delete;
+    DataLoader & operator=(const DataLoader &) = delete;
 
-// Auxiliary Features
+    inline const Dataset & dataset() const      { return *m_dataset; }
 
+    size_t batchCount() const
+    {
+        auto size = m_dataset->size();
+        return m_options.m_dropLast ? size / m_options.m_batchSize
+                                    : (size + m_options.m_batchSize - 1) / m_options.m_batchSize;
+    }
 
-inline void save(const nn::Module & module, const std::string & filename)
-{
-    std::ofstream ofs(filename, std::ios::binary);
-    if (!ofs)
+    // Starts a new epoch. The samples are visited in a new random order if shuffling is enabled.
+    void reset()
     {
-        throw std::ios_base::failure("Failed to open file for writing.");
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_pendingJobs.clear();
+        // The workers could still fill the batches that they have taken.
+        m_jobDone.wait(lock, [this] { return std::all_of(m_jobs.begin(), m_jobs.end(), [](const auto & job)
+                                                         { return !job->started || job->done; }); });
+        m_jobs.clear();
+        lock.unlock();
+
+        std::iota(m_order.begin(), m_order.end(), 0);
+        if (m_options.m_shuffle)
+        {
+            std::shuffle(m_order.begin(), m_order.end(), randGen);
+        }
+        m_nextBatch = 0;
     }
 
-    const auto params = module.parameters();
-    for (const auto& [paramName, param] : params)
+    // Returns the fields of the next batch in the order of the dataset fields, or an empty vector at the end of the
+    // epoch.
+    std::vector<Tensor> next()
     {
-        const auto & value = param.value();
-        size_t size = value.size();
-        ofs.write(reinterpret_cast<const char*>(&size), sizeof(size));                       // Save parameter size
-        size_t paramDTypeSize = Device::dataTypeSize(param.dataType());
-        ofs.write(reinterpret_cast<const char*>(value.data()), size * paramDTypeSize);       // Save parameter data
+        schedule();
+        if (m_jobs.empty()) return {};
+
+        auto job = m_jobs.front();
+        m_jobs.pop_front();
+        schedule();
+
+        if (m_workers.empty())
+        {
+            read(*job);
+            job->done = true;
+        }
+        else
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_jobDone.wait(lock, [&job] { return job->done; });
+        }
+
+        if (job->error)
+        {
+            std::rethrow_exception(job->error);
+        }
+        return std::move(job->batch);
     }
 
-    ofs.close();
-}
+private:
+    struct Job
+    {
+        size_t  begin{0};           // Position of the first sample in the epoch order.
+        size_t  count{0};
+        std::vector<Tensor>  batch;
+        std::vector<char*>   destinations;
+        bool  started{false};
+        bool  done{false};
+        std::exception_ptr  error;
+    };
 
-inline void load(nn::Module & module, const std::string & filename)
-{
-    std::ifstream ifs(filename, std::ios::binary);
-    if (!ifs)
+    // Allocates the upcoming batches and queues them for the workers.
+    void schedule()
     {
-        throw std::ios_base::failure("Failed to open model parameter file for reading.");
+        std::vector<std::shared_ptr<Job>> jobs;
+        while (m_jobs.size() < m_options.m_prefetchCount + 1 && m_nextBatch < batchCount())
+        {
+            auto job = std::make_shared<Job>();
+            job->begin = m_nextBatch++ * m_options.m_batchSize;
+            job->count = std::min(m_options.m_batchSize, m_order.size() - job->begin);
+            for (const auto & field : m_dataset->fields())
+            {
+                Shape shape{job->count};
+                shape.insert(shape.end(), field.shape.begin(), field.shape.end());
+                auto & tensor = job->batch.emplace_back(shape, TensorOptions{ .m_dtype=field.dtype,
+                                                                              .m_device=m_options.m_device });
+                job->destinations.emplace_back(static_cast<char*>(tensor.value().data()));
+            }
+            m_jobs.emplace_back(job);
+            jobs.emplace_back(std::move(job));
+        }
+
+        if (jobs.empty() || m_workers.empty()) return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pendingJobs.insert(m_pendingJobs.end(), jobs.begin(), jobs.end());
+        }
+        m_workAvailable.notify_all();
     }
 
-    auto params = module.parameters();    // Get model parameters.
-    for (auto& [paramName, param] : params)
+    void read(Job & job) const
     {
-        size_t size;
-        ifs.read(reinterpret_cast<char*>(&size), sizeof(size));         // Read size of parameter
-        if (size != param.value().size())
+        try
         {
-            throw std::runtime_error("Invalid parameter size found when loading the model.");
+            const auto & fields = m_dataset->fields();
+            std::vector<size_t> byteSizes;
+            for (const auto & field : fields)
+            {
+                byteSizes.emplace_back(field.byteSize());
+            }
+
+            std::vector<void*> destinations(fields.size());
+            for (size_t i=0; i<job.count; ++i)
+            {
+                for (size_t j=0; j<fields.size(); ++j)
+                {
+                    destinations[j] = job.destinations[j] + i * byteSizes[j];
+                }
+                m_dataset->read(m_order[job.begin + i], destinations);
+            }
+        }
+        catch (...)
+        {
+            job.error = std::current_exception();
         }
-        size_t paramDTypeSize = Device::dataTypeSize(param.dataType());
-        ifs.read(reinterpret_cast<char*>(param.value().data()), size * paramDTypeSize); // Read the parameter data
     }
 
-    ifs.close();
-}
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_workAvailable.wait(lock, [this] { return m_stop || !m_pendingJobs.empty(); });
+            if (m_stop) return;
+
+            auto job = m_pendingJobs.front();
+            m_pendingJobs.pop_front();
+            job->started = true;
+            lock.unlock();
+            read(*job);
+            lock.lock();
+            job->done = true;
+            m_jobDone.notify_all();
+        }
+    }
+
+    std::shared_ptr<Dataset>  m_dataset;
+    DataLoaderOptions  m_options;
+    std::vector<size_t>  m_order;                       // Sample indices in the order of the epoch.
+    size_t  m_nextBatch{0};
+    std::deque<std::shared_ptr<Job>>  m_jobs;           // Scheduled batches in order.
+    std::deque<std::shared_ptr<Job>>  m_pendingJobs;    // Scheduled batches that are not taken by a worker yet.
+    std::vector<std::thread>  m_workers;
+    std::mutex  m_mutex;
+    std::condition_variable  m_workAvailable;
+    std::condition_variable  m_jobDone;
+    bool  m_stop{false};
+};
+
+}   // data namespace
+
 
 // Overload the << operator to print TensorValue.
 std::ostream & operator<<(std::ostream& os, const TensorValue& tensor)
@@ -0,0 +1,242 @@
+//
+//  Copyright © 2024-Present, Arkin Terli. All rights reserved.
+//
+//  NOTICE:  All information contained herein is, and remains the property of Arkin Terli.
+//  The intellectual and technical concepts contained herein are proprietary to Arkin Terli
+//  and may be covered by U.S. and Foreign Patents, patents in process, and are protected by
+//  trade secret or copyright law. Dissemination of this information or reproduction of this
+//  material is strictly forbidden unless prior written permission is obtained from Arkin Terli.
+
+#pragma once
+
+// Project includes
+// External includes
+// System includes
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <list>
+#include <map>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+
+
+namespace aix::cpu
+{
+
+#define CPU_CACHE_ALIGNMENT_SIZE        64                      // SIMD friendly alignment of all allocations.
+#ifdef __APPLE__
+// Large allocations are page sized and aligned, so that Metal devices can read them without a copy.
+#define CPU_CACHE_PAGE_SIZE             16384                   // The VM page size of Apple silicon.
+#define CPU_CACHE_LARGE_ALIGNMENT_SIZE  CPU_CACHE_PAGE_SIZE
+#else
+#define CPU_CACHE_PAGE_SIZE             4096                    // Large allocations are rounded to the page size.
+#define CPU_CACHE_LARGE_ALIGNMENT_SIZE  CPU_CACHE_ALIGNMENT_SIZE
+#endif
+#define CPU_CACHE_DEFAULT_LIMIT         (1024*1024*1024)        // Maximum number of bytes to keep in the cache: 1gb
+
+struct MemoryCacheStats
+{
+    size_t  bytesInUse{0};          // Bytes allocated and not released yet.
+    size_t  bytesCached{0};         // Bytes released and kept for reuse.
+    size_t  peakBytesInUse{0};
+    size_t  allocations{0};         // Number of allocation requests.
+    size_t  cacheHits{0};           // Number of allocation requests served from the cache.
+
+    inline double hitRate() const   { return allocations > 0 ? static_cast<double>(cacheHits) / allocations : 0; }
+};
+
+
+// Caches released memory blocks of the CPU device in size-sorted free lists to avoid system allocator calls for
+// intermediate tensors. The least recently released blocks are freed first once the cache exceeds its limit.
+class MemoryCache
+{
+public:
+    // Constructor
+    explicit MemoryCache(size_t limit = CPU_CACHE_DEFAULT_LIMIT) : m_limit{limit} { }
+
+    // Destructor
+    ~MemoryCache()
+    {
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        clearCache();
+    }
+
+    void* allocate(size_t size)
+    {
+        size = roundSize(size);
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        ++m_stats.allocations;
+
+        void* memory = reuse(size);
+        if (memory)
+        {
+            ++m_stats.cacheHits;
+        }
+        else
+        {
+            size_t alignment = size < CPU_CACHE_PAGE_SIZE ? CPU_CACHE_ALIGNMENT_SIZE : CPU_CACHE_LARGE_ALIGNMENT_SIZE;
+            memory = std::aligned_alloc(alignment, size);
+            if (!memory)
+            {
+                // Release the cached blocks and try once more before giving up.
+                clearCache();
+                memory = std::aligned_alloc(alignment, size);
+                if (!memory) throw std::bad_alloc();
+            }
+        }
+        m_allocations[memory] = size;
+
+        m_stats.bytesInUse += size;
+        m_stats.peakBytesInUse = std::max(m_stats.peakBytesInUse, m_stats.bytesInUse);
+        return memory;
+    }
+
+    void deallocate(void* memory)
+    {
+        if (!memory) return;
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+
+        auto it = m_allocations.find(memory);
+        if (it == m_allocations.end())
+        {
+            std::free(memory);      // Not allocated by the cache.
+            return;
+        }
+        size_t size = it->second;
+        m_allocations.erase(it);
+        m_stats.bytesInUse -= size;
+
+        if (size > m_limit)
+        {
+            std::free(memory);
+            return;
+        }
+
+        // Add to the cache as the most recently released block.
+        m_lruList.emplace_front(memory, size);
+        m_cacheMap.emplace(size, m_lruList.begin());
+        m_stats.bytesCached += size;
+
+        if (m_stats.bytesCached > m_limit)
+        {
+            reduceSize(m_stats.bytesCached - m_limit);
+        }
+    }
+
+    // Frees all cached blocks. Blocks in use are not affected.
+    void clear()
+    {
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        clearCache();
+    }
+
+    size_t limit()
+    {
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        return m_limit;
+    }
+
+    void limit(size_t bytes)
+    {
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        m_limit = bytes;
+        if (m_stats.bytesCached > m_limit)
+        {
+            reduceSize(m_stats.bytesCached - m_limit);
+        }
+    }
+
+    MemoryCacheStats stats()
+    {
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        return m_stats;
+    }
+
+    void resetStats()
+    {
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        m_stats.peakBytesInUse = m_stats.bytesInUse;
+        m_stats.allocations = m_stats.cacheHits = 0;
+    }
+
+private:
+    struct Block
+    {
+        void*   memory{nullptr};
+        size_t  size{0};
+    };
+
+    using LRUList  = std::list<Block>;
+    using CacheMap = std::multimap<size_t, LRUList::iterator>;
+
+    // Small sizes are rounded to the alignment size, and large ones to the page size, to improve reuse.
+    static size_t roundSize(size_t size)
+    {
+        size_t round = size < CPU_CACHE_PAGE_SIZE ? CPU_CACHE_ALIGNMENT_SIZE : CPU_CACHE_PAGE_SIZE;
+        return size < round ? round : (size + round - 1) / round * round;
+    }
+
+    // Returns a cached block of a similar size and updates the size to the size of the block.
+    void* reuse(size_t & size)
+    {
+        // Find the closest block in the cached blocks with a similar size.
+        auto it = m_cacheMap.lower_bound(size);
+        if (it == m_cacheMap.end() || it->first >= std::min(size << 1, size + (CPU_CACHE_PAGE_SIZE << 1)))
+        {
+            return nullptr;
+        }
+
+        void* memory = it->second->memory;
+        size = it->first;
+        m_stats.bytesCached -= size;
+        m_lruList.erase(it->second);
+        m_cacheMap.erase(it);
+        return memory;
+    }
+
+    void reduceSize(size_t bytesToFree)
+    {
+        size_t totalBytesFreed = 0;
+        while (!m_lruList.empty() && totalBytesFreed < bytesToFree)
+        {
+            // Free the least recently released block.
+            auto block = m_lruList.back();
+            auto [first, last] = m_cacheMap.equal_range(block.size);
+            for (auto it = first; it != last; ++it)
+            {
+                if (it->second->memory == block.memory)
+                {
+                    m_cacheMap.erase(it);
+                    break;
+                }
+            }
+            m_lruList.pop_back();
+            std::free(block.memory);
+            totalBytesFreed += block.size;
+        }
+        assert(m_stats.bytesCached >= totalBytesFreed);
+        m_stats.bytesCached -= totalBytesFreed;
+    }
+
+    void clearCache()
+    {
+        for (const auto & block : m_lruList)
+        {
+            std::free(block.memory);
+        }
+        m_lruList.clear();
+        m_cacheMap.clear();
+        m_stats.bytesCached = 0;
+    }
+
+    LRUList   m_lruList;                                // Cached blocks, the most recently released one first.
+    CacheMap  m_cacheMap;                               // Cached blocks sorted by size.
+    std::unordered_map<void*, size_t>  m_allocations;   // Sizes of the blocks in use.
+    MemoryCacheStats  m_stats;
+    size_t  m_limit{CPU_CACHE_DEFAULT_LIMIT};
+    std::mutex  m_syncObj;
+};
+
+}   // namespace aix::cpu
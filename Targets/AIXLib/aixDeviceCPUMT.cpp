@@ -0,0 +1,875 @@
+//
+//  Copyright © 2024-Present, Arkin Terli. All rights reserved.
+//
+//  NOTICE:  All information contained herein is, and remains the property of Arkin Terli.
+//  The intellectual and technical concepts contained herein are proprietary to Arkin Terli
+//  and may be covered by U.S. and Foreign Patents, patents in process, and are protected by
+//  trade secret or copyright law. Dissemination of this information or reproduction of this
+//  material is strictly forbidden unless prior written permission is obtained from Arkin Terli.
+
+// Project includes
+#include "aixDeviceCPUMT.hpp"
+// External includes
+// System includes
+
+
+namespace aix
+{
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+    for (size_t i=1; i<threadCount; ++i)
+    {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_jobCV.notify_all();
+
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+
+void ThreadPool::run(size_t taskCount, const std::function<void(size_t)>& task)
+{
+    if (taskCount == 0) return;
+
+    // Only one job can be in flight at a time.
+    std::lock_guard<std::mutex> runLock(m_runMutex);
+
+    auto job = std::make_shared<Job>();
+    job->task = &task;
+    job->taskCount = taskCount;
+    job->pendingTasks = taskCount;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = job;
+        ++m_jobGeneration;
+    }
+    m_jobCV.notify_all();
+
+    // The calling thread works on the same job instead of waiting idle.
+    execute(*job);
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_doneCV.wait(lock, [&job] { return job->pendingTasks == 0; });
+        m_job.reset();
+    }
+
+    if (job->exception)
+    {
+        std::rethrow_exception(job->exception);
+    }
+}
+
+
+void ThreadPool::workerLoop()
+{
+    size_t generation = 0;
+    while (true)
+    {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_jobCV.wait(lock, [&] { return m_stop || (m_job && m_jobGeneration != generation); });
+            if (m_stop) return;
+            generation = m_jobGeneration;
+            job = m_job;
+        }
+        // A worker that wakes up late finds no task left in the job, since it holds a reference to its own job.
+        execute(*job);
+    }
+}
+
+
+void ThreadPool::execute(Job& job)
+{
+    size_t index;
+    while ((index = job.nextTask++) < job.taskCount)
+    {
+        try
+        {
+            (*job.task)(index);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!job.exception) job.exception = std::current_exception();
+        }
+
+        if (--job.pendingTasks == 0)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_doneCV.notify_all();
+        }
+    }
+}
+
+
+DeviceCPUMT::DeviceCPUMT(size_t deviceIndex, size_t threadCount, size_t minChunkSize) : Device(deviceIndex)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    m_pool = std::make_unique<ThreadPool>(threadCount);
+    this->minChunkSize(minChunkSize);
+}
+
+
+void DeviceCPUMT::add(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("add", {&a1, &a2, &result});
+    parallelForViews({&a1, &a2}, result, [&](size_t begin, size_t end)
+    {
+        Device::add(chunkParams(a1, begin, end), chunkParams(a2, begin, end), chunkParams(result, begin, end));
+    });
+}
+
+
+void DeviceCPUMT::sub(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("sub", {&a1, &a2, &result});
+    parallelForViews({&a1, &a2}, result, [&](size_t begin, size_t end)
+    {
+        Device::sub(chunkParams(a1, begin, end), chunkParams(a2, begin, end), chunkParams(result, begin, end));
+    });
+}
+
+
+void DeviceCPUMT::mul(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("mul", {&a1, &a2, &result});
+    parallelForViews({&a1, &a2}, result, [&](size_t begin, size_t end)
+    {
+        Device::mul(chunkParams(a1, begin, end), chunkParams(a2, begin, end), chunkParams(result, begin, end));
+    });
+}
+
+
+void DeviceCPUMT::div(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("div", {&a1, &a2, &result});
+    parallelForViews({&a1, &a2}, result, [&](size_t begin, size_t end)
+    {
+        Device::div(chunkParams(a1, begin, end), chunkParams(a2, begin, end), chunkParams(result, begin, end));
+    });
+}
+
+
+void DeviceCPUMT::unary(const DeviceTensorParams& a1, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("unary", {&a1, &result});
+    parallelForViews({&a1}, result, [&](size_t begin, size_t end)
+    {
+        Device::unary(chunkParams(a1, begin, end), chunkParams(result, begin, end));
+    });
+}
+
+
+void DeviceCPUMT::fill(const void* scalar, DataType scalarDType, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("fill", {&result});
+    parallelFor(result.size, [&](size_t begin, size_t end)
+    {
+        Device::fill(scalar, scalarDType, chunkParams(result, begin, end));
+    });
+}
+
+
+void DeviceCPUMT::fillMin(const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("fillMin", {&result});
+    parallelFor(result.size, [&](size_t begin, size_t end)
+    {
+        Device::fillMin(chunkParams(result, begin, end));
+    });
+}
+
+
+void DeviceCPUMT::fusedElementwise(const FusedProgram& program, const std::vector<DeviceTensorParams>& inputs,
+                                   const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("fusedElementwise", inputs, result);
+    static const auto funcTable = std::array
+    {
+        fusedElementwiseGeneric<double    >,
+        fusedElementwiseGeneric<float     >,
+        fusedElementwiseGeneric<float16_t >,
+        fusedElementwiseGeneric<bfloat16_t>,
+        fusedElementwiseGeneric<int64_t   >,
+        fusedElementwiseGeneric<int32_t   >,
+        fusedElementwiseGeneric<int16_t   >,
+        fusedElementwiseGeneric<int8_t    >,
+        fusedElementwiseGeneric<uint8_t   >,
+    };
+
+    parallelFor(result.size, [&](size_t begin, size_t end)
+    {
+        funcTable[static_cast<size_t>(result.dtype)](program, inputs, result, begin, end);
+    });
+}
+
+
+void DeviceCPUMT::optimizerStep(const OptimizerStepParams& step, const std::vector<OptimizerTensorParams>& tensors)
+{
+    profiler::OpScope scope("optimizerStep", {});
+    static const auto funcTable = std::array
+    {
+        optimizerStepGeneric<double    >,
+        optimizerStepGeneric<float     >,
+        optimizerStepGeneric<float16_t >,
+        optimizerStepGeneric<bfloat16_t>,
+        optimizerStepGeneric<int64_t   >,
+        optimizerStepGeneric<int32_t   >,
+        optimizerStepGeneric<int16_t   >,
+        optimizerStepGeneric<int8_t    >,
+        optimizerStepGeneric<uint8_t   >,
+    };
+
+    // The parameters are flattened into one element range, so small parameters share a chunk and large ones are
+    // split across the threads.
+    std::vector<size_t> tensorBegins(tensors.size() + 1, 0);
+    for (size_t i=0; i<tensors.size(); ++i)
+    {
+        tensorBegins[i + 1] = tensorBegins[i] + tensors[i].grad.size;
+    }
+
+    parallelFor(tensorBegins.back(), [&](size_t begin, size_t end)
+    {
+        auto it = std::upper_bound(tensorBegins.begin(), tensorBegins.end(), begin) - 1;
+        for (size_t i = it - tensorBegins.begin(); i < tensors.size() && tensorBegins[i] < end; ++i)
+        {
+            size_t tensorBegin = std::max(begin, tensorBegins[i]) - tensorBegins[i];
+            size_t tensorEnd   = std::min(end, tensorBegins[i + 1]) - tensorBegins[i];
+            funcTable[static_cast<size_t>(tensors[i].param.dtype)](step, tensors[i], tensorBegin, tensorEnd);
+        }
+    });
+}
+
+
+void DeviceCPUMT::sum(const DeviceTensorParams& a, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("sum", {&a, &result});
+    auto chunks = chunkCount(a.size);
+    if (chunks == 1)
+    {
+        Device::sum(a, result);
+        return;
+    }
+
+    // Each chunk computes its partial sum, then the partial sums are summed up.
+    std::vector<uint8_t> partialSums(chunks * dataTypeSize(a.dtype));
+    DeviceTensorParams partials{ .data=partialSums.data(), .dtype=a.dtype, .isContiguous=true, .offset=0, .shape={},
+                                 .size=chunks, .strides={} };
+    parallelChunks(a.size, chunks, [&](size_t chunk, size_t begin, size_t end)
+    {
+        Device::sum(chunkParams(a, begin, end), chunkParams(partials, chunk, chunk + 1));
+    });
+    Device::sum(partials, result);
+}
+
+
+void DeviceCPUMT::sqrt(const DeviceTensorParams& a, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("sqrt", {&a, &result});
+    parallelForViews({&a}, result, [&](size_t begin, size_t end)
+    {
+        Device::sqrt(chunkParams(a, begin, end), chunkParams(result, begin, end));
+    });
+}
+
+
+void DeviceCPUMT::sin(const DeviceTensorParams& a, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("sin", {&a, &result});
+    parallelForViews({&a}, result, [&](size_t begin, size_t end)
+    {
+        Device::sin(chunkParams(a, begin, end), chunkParams(result, begin, end));
+    });
+}
+
+
+void DeviceCPUMT::cos(const DeviceTensorParams& a, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("cos", {&a, &result});
+    parallelForViews({&a}, result, [&](size_t begin, size_t end)
+    {
+        Device::cos(chunkParams(a, begin, end), chunkParams(result, begin, end));
+    });
+}
+
+
+void DeviceCPUMT::tanh(const DeviceTensorParams& a, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("tanh", {&a, &result});
+    parallelForViews({&a}, result, [&](size_t begin, size_t end)
+    {
+        Device::tanh(chunkParams(a, begin, end), chunkParams(result, begin, end));
+    });
+}
+
+
+void DeviceCPUMT::log(const DeviceTensorParams& a, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("log", {&a, &result});
+    parallelForViews({&a}, result, [&](size_t begin, size_t end)
+    {
+        Device::log(chunkParams(a, begin, end), chunkParams(result, begin, end));
+    });
+}
+
+
+void DeviceCPUMT::exp(const DeviceTensorParams& a, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("exp", {&a, &result});
+    parallelForViews({&a}, result, [&](size_t begin, size_t end)
+    {
+        Device::exp(chunkParams(a, begin, end), chunkParams(result, begin, end));
+    });
+}
+
+
+void DeviceCPUMT::pow(const DeviceTensorParams& a, const DeviceTensorParams& exp, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("pow", {&a, &exp, &result});
+    parallelForViews({&a, &exp}, result, [&](size_t begin, size_t end)
+    {
+        Device::pow(chunkParams(a, begin, end), chunkParams(exp, begin, end), chunkParams(result, begin, end));
+    });
+}
+
+
+void DeviceCPUMT::max(const DeviceTensorParams& a, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("max", {&a, &result});
+    auto chunks = chunkCount(a.size);
+    if (chunks == 1)
+    {
+        Device::max(a, result);
+        return;
+    }
+
+    std::vector<uint8_t> partialMaxs(chunks * dataTypeSize(a.dtype));
+    DeviceTensorParams partials{ .data=partialMaxs.data(), .dtype=a.dtype, .isContiguous=true, .offset=0, .shape={},
+                                 .size=chunks, .strides={} };
+    parallelChunks(a.size, chunks, [&](size_t chunk, size_t begin, size_t end)
+    {
+        Device::max(chunkParams(a, begin, end), chunkParams(partials, chunk, chunk + 1));
+    });
+    Device::max(partials, result);
+}
+
+
+void DeviceCPUMT::argmax(const DeviceTensorParams& a, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("argmax", {&a, &result});
+    if (result.dtype != DataType::kInt32)
+    {
+        throw std::invalid_argument("Device::argmax supports only int32 data type for its result.");
+    }
+
+    auto chunks = chunkCount(a.size);
+    if (chunks == 1)
+    {
+        Device::argmax(a, result);
+        return;
+    }
+
+    // The first chunk that has the maximum value contains the first occurrence of the maximum value.
+    std::vector<uint8_t> partialMaxs(chunks * dataTypeSize(a.dtype));
+    DeviceTensorParams partials{ .data=partialMaxs.data(), .dtype=a.dtype, .isContiguous=true, .offset=0, .shape={},
+                                 .size=chunks, .strides={} };
+    parallelChunks(a.size, chunks, [&](size_t chunk, size_t begin, size_t end)
+    {
+        Device::max(chunkParams(a, begin, end), chunkParams(partials, chunk, chunk + 1));
+    });
+
+    int32_t maxChunk = 0;
+    int32_t maxIndex = 0;
+    Device::argmax(partials, { .data=&maxChunk, .dtype=DataType::kInt32, .isContiguous=true, .offset=0, .shape={},
+                               .size=1, .strides={} });
+    auto begin = chunkBegin(maxChunk, chunks, a.size);
+    auto end   = chunkBegin(maxChunk + 1, chunks, a.size);
+    Device::argmax(chunkParams(a, begin, end), { .data=&maxIndex, .dtype=DataType::kInt32, .isContiguous=true,
+                                                 .offset=0, .shape={}, .size=1, .strides={} });
+    *static_cast<int32_t*>(result.data) = static_cast<int32_t>(begin) + maxIndex;
+}
+
+
+void DeviceCPUMT::argmaxIndices(const DeviceTensorParams& a, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("argmaxIndices", {&a, &result});
+    if (result.dtype != DataType::kInt32)
+    {
+        throw std::invalid_argument("Device::argmaxIndices supports only int32 data type for its result.");
+    }
+
+    if (chunkCount(a.size) == 1)
+    {
+        Device::argmaxIndices(a, result);
+        return;
+    }
+
+    int32_t maxIndex = 0;
+    int32_t zero = 0;
+    argmax(a, { .data=&maxIndex, .dtype=DataType::kInt32, .isContiguous=true, .offset=0, .shape={}, .size=1,
+                .strides={} });
+    fill(&zero, DataType::kInt32, result);
+    static_cast<int32_t*>(result.data)[maxIndex] = 1;
+}
+
+
+void DeviceCPUMT::matmul(const DeviceTensorParams& a, const DeviceTensorParams& b, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("matmul", {&a, &b, &result});
+    matmulTransposed(a, false, b, false, result);
+}
+
+
+void DeviceCPUMT::matmulTransposed(const DeviceTensorParams& a, bool transposeA, const DeviceTensorParams& b,
+                                   bool transposeB, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("matmulTransposed", {&a, &b, &result});
+    gemmTiles(a, transposeA, b, transposeB, result, {});
+}
+
+
+void DeviceCPUMT::linear(const DeviceTensorParams& a, const DeviceTensorParams& b, const DeviceTensorParams& bias,
+                         Activation activation, const DeviceTensorParams& preActivation,
+                         const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("linear", {&a, &b, &bias, &result});
+    gemmTiles(a, false, b, false, result, { bias.data, activation, preActivation.data });
+}
+
+
+void DeviceCPUMT::gemmTiles(const DeviceTensorParams& a, bool transposeA, const DeviceTensorParams& b,
+                            bool transposeB, const DeviceTensorParams& result, const GemmEpilogue& epilogue)
+{
+    static const auto funcTable = std::array
+    {
+        gemmGeneric<double    >,
+        gemmGeneric<float     >,
+        gemmGeneric<float16_t >,
+        gemmGeneric<bfloat16_t>,
+        gemmGeneric<int64_t   >,
+        gemmGeneric<int32_t   >,
+        gemmGeneric<int16_t   >,
+        gemmGeneric<int8_t    >,
+        gemmGeneric<uint8_t   >,
+    };
+
+    size_t batches = matrixCount(result);                   // Number of matrices in the result tensor
+    size_t m = result.shape[result.shape.size() - 2];       // Rows of the result matrix
+    size_t n = result.shape.back();                         // Columns of the result matrix
+    size_t inner = transposeA ? a.shape[a.shape.size() - 2] : a.shape.back();    // Inner dimension
+    auto gemmFunc = funcTable[static_cast<size_t>(result.dtype)];
+    assert(epilogue.empty() || batches == 1);
+
+    // The result matrices are split into a grid of tiles, which are computed independently. Row tiles are shrunk
+    // until there are enough tiles to keep all threads busy.
+    auto chunks = chunkCount(batches * m * n * inner);
+    size_t colTiles = (n + gemmBlockN - 1) / gemmBlockN;
+    size_t rowTileSize = std::min(gemmBlockM, std::max<size_t>((batches * m * colTiles + chunks - 1) / chunks, 1));
+    size_t rowTiles = (m + rowTileSize - 1) / rowTileSize;
+    size_t tiles = batches * rowTiles * colTiles;
+
+    parallelChunks(tiles, std::min(chunks, tiles), [&](size_t, size_t begin, size_t end)
+    {
+        for (size_t tile = begin; tile < end; ++tile)
+        {
+            size_t batch    = tile / (rowTiles * colTiles);
+            size_t rowBegin = tile / colTiles % rowTiles * rowTileSize;
+            size_t colBegin = tile % colTiles * gemmBlockN;
+            gemmFunc(matrixParams(a, batch), transposeA, matrixParams(b, batch), transposeB,
+                     matrixParams(result, batch), rowBegin, std::min(rowBegin + rowTileSize, m),
+                     colBegin, std::min(colBegin + gemmBlockN, n), epilogue);
+        }
+    });
+}
+
+
+void DeviceCPUMT::matmulQuantized(const DeviceTensorParams& a, const DeviceTensorParams& w,
+                                  const QuantizedLayout& layout, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("matmulQuantized", {&a, &w, &result});
+    static const auto funcTable = std::array
+    {
+        matmulQuantizedGeneric<double    >,
+        matmulQuantizedGeneric<float     >,
+        matmulQuantizedGeneric<float16_t >,
+        matmulQuantizedGeneric<bfloat16_t>,
+        matmulQuantizedGeneric<int64_t   >,
+        matmulQuantizedGeneric<int32_t   >,
+        matmulQuantizedGeneric<int16_t   >,
+        matmulQuantizedGeneric<int8_t    >,
+        matmulQuantizedGeneric<uint8_t   >,
+    };
+    auto func = funcTable[static_cast<size_t>(result.dtype)];
+
+    // The threads compute separate output columns, so each thread reads only its own weight rows.
+    auto chunks = std::min(chunkCount(a.size * layout.outputs), layout.outputs);
+    parallelChunks(layout.outputs, chunks, [&](size_t, size_t begin, size_t end)
+    {
+        func(a, w, layout, result, begin, end);
+    });
+}
+
+
+void DeviceCPUMT::transpose(const DeviceTensorParams& a, const DeviceTensorParams& result, size_t dim0, size_t dim1)
+{
+    profiler::OpScope scope("transpose", {&a, &result});
+    static const auto funcTable = std::array
+    {
+        transposeGeneric<double    >,
+        transposeGeneric<float     >,
+        transposeGeneric<float16_t >,
+        transposeGeneric<bfloat16_t>,
+        transposeGeneric<int64_t   >,
+        transposeGeneric<int32_t   >,
+        transposeGeneric<int16_t   >,
+        transposeGeneric<int8_t    >,
+        transposeGeneric<uint8_t   >,
+    };
+
+    parallelFor(a.size, [&](size_t begin, size_t end)
+    {
+        funcTable[static_cast<size_t>(result.dtype)](a, result, dim0, dim1, begin, end);
+    });
+}
+
+
+void DeviceCPUMT::copy(const void* src, DataType srcDType, void* dst, DataType dstDType, size_t size)
+{
+    profiler::OpScope scope("copy", dstDType, size * (dataTypeSize(srcDType) + dataTypeSize(dstDType)));
+    auto srcTypeSize = dataTypeSize(srcDType);
+    auto dstTypeSize = dataTypeSize(dstDType);
+    parallelFor(size, [&](size_t begin, size_t end)
+    {
+        Device::copy(static_cast<const uint8_t*>(src) + begin * srcTypeSize, srcDType,
+                     static_cast<uint8_t*>(dst) + begin * dstTypeSize, dstDType, end - begin);
+    });
+}
+
+
+void DeviceCPUMT::contiguous(const DeviceTensorParams& src, const DeviceTensorParams& dst)
+{
+    profiler::OpScope scope("contiguous", {&src, &dst});
+    static const auto funcTable = std::array
+    {
+        contiguousGeneric<double    >,
+        contiguousGeneric<float     >,
+        contiguousGeneric<float16_t >,
+        contiguousGeneric<bfloat16_t>,
+        contiguousGeneric<int64_t   >,
+        contiguousGeneric<int32_t   >,
+        contiguousGeneric<int16_t   >,
+        contiguousGeneric<int8_t    >,
+        contiguousGeneric<uint8_t   >,
+    };
+
+    parallelFor(dst.size, [&](size_t begin, size_t end)
+    {
+        funcTable[static_cast<size_t>(src.dtype)](src, dst, begin, end);
+    });
+}
+
+
+void DeviceCPUMT::reduce(ReduceOp op, const DeviceTensorParams& src, const DeviceTensorParams& dst,
+                         const ReduceShape& shape)
+{
+    profiler::OpScope scope("reduce", {&src, &dst});
+    if (op == ReduceOp::kArgmax && dst.dtype != DataType::kInt32)
+    {
+        throw std::invalid_argument("DeviceCPUMT::reduce supports only int32 data type for the result of argmax.");
+    }
+
+    static const auto funcTable = std::array
+    {
+        reduceGeneric<double    >,
+        reduceGeneric<float     >,
+        reduceGeneric<float16_t >,
+        reduceGeneric<bfloat16_t>,
+        reduceGeneric<int64_t   >,
+        reduceGeneric<int32_t   >,
+        reduceGeneric<int16_t   >,
+        reduceGeneric<int8_t    >,
+        reduceGeneric<uint8_t   >,
+    };
+    auto reduceFunc = funcTable[static_cast<size_t>(src.dtype)];
+
+    // Threads take whole rows of the outer dimension if there are enough of them, and blocks of columns otherwise.
+    auto chunks = chunkCount(src.size);
+    if (chunks == 1 || shape.outer >= chunks)
+    {
+        parallelChunks(shape.outer, std::min(chunks, shape.outer), [&](size_t, size_t begin, size_t end)
+        {
+            reduceFunc(op, src, dst, shape, begin, end, 0, shape.inner);
+        });
+        return;
+    }
+
+    if (shape.outer == 1 && shape.inner >= chunks)
+    {
+        parallelChunks(shape.inner, chunks, [&](size_t, size_t begin, size_t end)
+        {
+            reduceFunc(op, src, dst, shape, 0, 1, begin, end);
+        });
+        return;
+    }
+
+    // A long reduced axis with a small result is split into ranges that reduce into partial results. The indices of
+    // argmax are relative to their ranges, and the partial results of half precision types would lose the precision
+    // of the float accumulation, hence they only split the result.
+    bool isHalfFloat = src.dtype == DataType::kFloat16 || src.dtype == DataType::kBFloat16;
+    if (shape.outer > 1 || op == ReduceOp::kArgmax || isHalfFloat)
+    {
+        parallelChunks(shape.outer * shape.inner, chunks, [&](size_t, size_t begin, size_t end)
+        {
+            for (size_t o = begin / shape.inner; o * shape.inner < end; ++o)
+            {
+                size_t innerBegin = std::max(begin, o * shape.inner) - o * shape.inner;
+                size_t innerEnd = std::min(end, (o + 1) * shape.inner) - o * shape.inner;
+                reduceFunc(op, src, dst, shape, o, o + 1, innerBegin, innerEnd);
+            }
+        });
+        return;
+    }
+
+    auto typeSize = dataTypeSize(dst.dtype);
+    std::vector<uint8_t> partialBuffer(chunks * shape.inner * typeSize);
+    DeviceTensorParams partials = dst;
+    partials.data = partialBuffer.data();
+    partials.offset = 0;        // The partial results start at the beginning of their buffer, unlike the result.
+    partials.size = chunks * shape.inner;
+    partials.shape = { chunks, shape.inner };
+
+    parallelChunks(shape.reduce, chunks, [&](size_t chunk, size_t begin, size_t end)
+    {
+        auto chunkSrc = src;
+        chunkSrc.data = static_cast<uint8_t*>(src.data) + begin * shape.inner * typeSize;
+        auto chunkDst = partials;
+        chunkDst.data = partialBuffer.data() + chunk * shape.inner * typeSize;
+        reduceFunc(op, chunkSrc, chunkDst, { .outer=1, .reduce=end - begin, .inner=shape.inner }, 0, 1, 0, shape.inner);
+    });
+
+    // The partial results of the ranges form a [1, chunks, inner] tensor, which is reduced the same way.
+    reduceFunc(op, partials, dst, { .outer=1, .reduce=chunks, .inner=shape.inner }, 0, 1, 0, shape.inner);
+}
+
+
+void DeviceCPUMT::softmax(SoftmaxOp op, const std::vector<DeviceTensorParams>& inputs,
+                          const DeviceTensorParams& result, const ReduceShape& shape)
+{
+    profiler::OpScope scope("softmax", inputs, result);
+    static const auto funcTable = std::array
+    {
+        softmaxGeneric<double    >,
+        softmaxGeneric<float     >,
+        softmaxGeneric<float16_t >,
+        softmaxGeneric<bfloat16_t>,
+        softmaxGeneric<int64_t   >,
+        softmaxGeneric<int32_t   >,
+        softmaxGeneric<int16_t   >,
+        softmaxGeneric<int8_t    >,
+        softmaxGeneric<uint8_t   >,
+    };
+    auto softmaxFunc = funcTable[static_cast<size_t>(result.dtype)];
+
+    // Lines are independent. Threads take whole rows of the outer dimension if there are enough of them, and ranges
+    // of lines otherwise.
+    auto chunks = chunkCount(inputs[0].size);
+    if (chunks == 1 || shape.outer >= chunks)
+    {
+        parallelChunks(shape.outer, std::min(chunks, shape.outer), [&](size_t, size_t begin, size_t end)
+        {
+            softmaxFunc(op, inputs, result, shape, begin, end, 0, shape.inner);
+        });
+        return;
+    }
+
+    parallelChunks(shape.outer * shape.inner, std::min(chunks, shape.outer * shape.inner),
+                   [&](size_t, size_t begin, size_t end)
+    {
+        for (size_t o = begin / shape.inner; o * shape.inner < end; ++o)
+        {
+            size_t innerBegin = std::max(begin, o * shape.inner) - o * shape.inner;
+            size_t innerEnd = std::min(end, (o + 1) * shape.inner) - o * shape.inner;
+            softmaxFunc(op, inputs, result, shape, o, o + 1, innerBegin, innerEnd);
+        }
+    });
+}
+
+
+void DeviceCPUMT::sliceSet(const DeviceTensorParams& src, const DeviceTensorParams& dst,
+                           size_t dim, size_t start, size_t end, size_t step)
+{
+    profiler::OpScope scope("sliceSet", {&src, &dst});
+    static const auto funcTable = std::array
+    {
+        sliceSetGeneric<double    >,
+        sliceSetGeneric<float     >,
+        sliceSetGeneric<float16_t >,
+        sliceSetGeneric<bfloat16_t>,
+        sliceSetGeneric<int64_t   >,
+        sliceSetGeneric<int32_t   >,
+        sliceSetGeneric<int16_t   >,
+        sliceSetGeneric<int8_t    >,
+        sliceSetGeneric<uint8_t   >,
+    };
+
+    parallelFor(src.size, [&](size_t first, size_t last)
+    {
+        funcTable[static_cast<size_t>(src.dtype)](src, dst, dim, start, end, step, first, last);
+    });
+}
+
+
+void DeviceCPUMT::tril(const DeviceTensorParams& dst, ssize_t diagonal)
+{
+    profiler::OpScope scope("tril", {&dst});
+    static const auto funcTable = std::array
+    {
+        trilGeneric<double    >,
+        trilGeneric<float     >,
+        trilGeneric<float16_t >,
+        trilGeneric<bfloat16_t>,
+        trilGeneric<int64_t   >,
+        trilGeneric<int32_t   >,
+        trilGeneric<int16_t   >,
+        trilGeneric<int8_t    >,
+        trilGeneric<uint8_t   >,
+    };
+
+    parallelFor(dst.size, [&](size_t begin, size_t end)
+    {
+        funcTable[static_cast<size_t>(dst.dtype)](dst, diagonal, begin, end);
+    });
+}
+
+
+void DeviceCPUMT::triu(const DeviceTensorParams& dst, ssize_t diagonal)
+{
+    profiler::OpScope scope("triu", {&dst});
+    static const auto funcTable = std::array
+    {
+        triuGeneric<double    >,
+        triuGeneric<float     >,
+        triuGeneric<float16_t >,
+        triuGeneric<bfloat16_t>,
+        triuGeneric<int64_t   >,
+        triuGeneric<int32_t   >,
+        triuGeneric<int16_t   >,
+        triuGeneric<int8_t    >,
+        triuGeneric<uint8_t   >,
+    };
+
+    parallelFor(dst.size, [&](size_t begin, size_t end)
+    {
+        funcTable[static_cast<size_t>(dst.dtype)](dst, diagonal, begin, end);
+    });
+}
+
+
+void DeviceCPUMT::indexSelect(const DeviceTensorParams& src, const DeviceTensorParams& dst,
+                              const DeviceTensorParams& indices, size_t dim)
+{
+    profiler::OpScope scope("indexSelect", {&src, &indices, &dst});
+    static const auto funcTable = std::array
+    {
+        indexSelectGeneric<double    , int32_t>,
+        indexSelectGeneric<float     , int32_t>,
+        indexSelectGeneric<float16_t , int32_t>,
+        indexSelectGeneric<bfloat16_t, int32_t>,
+        indexSelectGeneric<int64_t   , int32_t>,
+        indexSelectGeneric<int32_t   , int32_t>,
+        indexSelectGeneric<int16_t   , int32_t>,
+        indexSelectGeneric<int8_t    , int32_t>,
+        indexSelectGeneric<uint8_t   , int32_t>,
+    };
+
+    parallelFor(dst.size, [&](size_t begin, size_t end)
+    {
+        funcTable[static_cast<size_t>(src.dtype)](src, dst, indices, dim, begin, end);
+    });
+}
+
+
+size_t DeviceCPUMT::chunkCount(size_t size) const
+{
+    return std::max<size_t>(std::min(m_pool->threadCount(), size / m_minChunkSize), 1);
+}
+
+
+void DeviceCPUMT::parallelChunks(size_t size, size_t chunks, const std::function<void(size_t, size_t, size_t)>& func)
+{
+    if (chunks <= 1)
+    {
+        func(0, 0, size);
+        return;
+    }
+
+    m_pool->run(chunks, [&](size_t chunk)
+    {
+        func(chunk, chunkBegin(chunk, chunks, size), chunkBegin(chunk + 1, chunks, size));
+    });
+}
+
+
+void DeviceCPUMT::parallelFor(size_t size, const std::function<void(size_t, size_t)>& func)
+{
+    parallelChunks(size, chunkCount(size), [&func](size_t, size_t begin, size_t end) { func(begin, end); });
+}
+
+
+void DeviceCPUMT::parallelForViews(std::initializer_list<const DeviceTensorParams*> inputs,
+                                   const DeviceTensorParams& result, const std::function<void(size_t, size_t)>& func)
+{
+    bool isContiguous = std::all_of(inputs.begin(), inputs.end(), [](auto input) { return input->isContiguous; });
+    if (isContiguous || result.shape.empty() || result.size == 0)
+    {
+        parallelFor(result.size, func);
+        return;
+    }
+
+    // The element range of a chunk of a strided view must be a range of its first dimension.
+    size_t rows = result.shape[0];
+    size_t rowSize = result.size / rows;
+    parallelChunks(rows, std::min(chunkCount(result.size), rows), [&](size_t, size_t begin, size_t end)
+    {
+        func(begin * rowSize, end * rowSize);
+    });
+}
+
+
+DeviceTensorParams DeviceCPUMT::chunkParams(const DeviceTensorParams& params, size_t begin, size_t end)
+{
+    DeviceTensorParams chunk = params;
+    if (!params.isContiguous)
+    {
+        // Strided views are split along the first dimension. See parallelForViews().
+        size_t rowSize = params.size / params.shape[0];
+        chunk.offset += begin / rowSize * params.strides[0];
+        chunk.shape[0] = (end - begin) / rowSize;
+        chunk.size = end - begin;
+        return chunk;
+    }
+    chunk.data = static_cast<uint8_t*>(params.data) + begin * dataTypeSize(params.dtype);
+    chunk.size = end - begin;
+    return chunk;
+}
+
+}   // namespace
@@ -0,0 +1,194 @@
+//
+//  Copyright © 2024-Present, Arkin Terli. All rights reserved.
+//
+//  NOTICE:  All information contained herein is, and remains the property of Arkin Terli.
+//  The intellectual and technical concepts contained herein are proprietary to Arkin Terli
+//  and may be covered by U.S. and Foreign Patents, patents in process, and are protected by
+//  trade secret or copyright law. Dissemination of this information or reproduction of this
+//  material is strictly forbidden unless prior written permission is obtained from Arkin Terli.
+
+#pragma once
+
+
+// Project includes
+#include "aix.hpp"
+// External includes
+// System includes
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace aix
+{
+
+#define CPU_MT_DEFAULT_MIN_CHUNK_SIZE       32768   // Tensors smaller than this number of elements run serially.
+
+// A persistent pool of worker threads. The calling thread also takes part in the execution of a job.
+class ThreadPool
+{
+public:
+    // Constructor. The thread count includes the calling thread, so threadCount-1 workers are created.
+    explicit ThreadPool(size_t threadCount);
+
+    // Destructor
+    ~ThreadPool();
+
+    inline size_t threadCount() const   { return m_workers.size() + 1; }
+
+    // Executes task(i) for every i in [0, taskCount) and blocks until all tasks are completed.
+    void run(size_t taskCount, const std::function<void(size_t)>& task);
+
+private:
+    struct Job
+    {
+        const std::function<void(size_t)>*  task{nullptr};
+        size_t  taskCount{0};
+        std::atomic<size_t>  nextTask{0};
+        std::atomic<size_t>  pendingTasks{0};
+        std::exception_ptr   exception;
+    };
+
+    void workerLoop();
+    void execute(Job& job);
+
+    std::vector<std::thread>  m_workers;
+    std::shared_ptr<Job>      m_job;
+    std::mutex                m_mutex;
+    std::mutex                m_runMutex;
+    std::condition_variable   m_jobCV;
+    std::condition_variable   m_doneCV;
+    size_t                    m_jobGeneration{0};
+    bool                      m_stop{false};
+};
+
+
+// CPU device that splits element-wise, reduction and indexing kernels across a persistent worker pool.
+class DeviceCPUMT : public aix::Device
+{
+public:
+    // Constructor. A thread count of zero uses all hardware threads.
+    explicit DeviceCPUMT(size_t deviceIndex = 0, size_t threadCount = 0,
+                         size_t minChunkSize = CPU_MT_DEFAULT_MIN_CHUNK_SIZE);
+
+    // Destructor
+    ~DeviceCPUMT() override = default;
+
+    DeviceType type() const override { return DeviceType::kCPU_MT; }
+    std::string name() const override { return "CPUMT"; }
+
+    inline size_t threadCount() const           { return m_pool->threadCount(); }
+    inline size_t minChunkSize() const          { return m_minChunkSize; }
+    inline void minChunkSize(size_t size)       { m_minChunkSize = std::max<size_t>(size, 1); }
+
+    void add(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result) override;
+
+    void sub(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result) override;
+
+    void mul(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result) override;
+
+    void div(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result) override;
+
+    void unary(const DeviceTensorParams& a1, const DeviceTensorParams& result) override;
+
+    void fill(const void* scalar, DataType scalarDType, const DeviceTensorParams& result) override;
+
+    void fillMin(const DeviceTensorParams& result) override;
+
+    void fusedElementwise(const FusedProgram& program, const std::vector<DeviceTensorParams>& inputs,
+                          const DeviceTensorParams& result) override;
+
+    void optimizerStep(const OptimizerStepParams& step, const std::vector<OptimizerTensorParams>& tensors) override;
+
+    void sum(const DeviceTensorParams& a, const DeviceTensorParams& result) override;
+
+    void sqrt(const DeviceTensorParams& a, const DeviceTensorParams& result) override;
+
+    void sin(const DeviceTensorParams& a, const DeviceTensorParams& result) override;
+
+    void cos(const DeviceTensorParams& a, const DeviceTensorParams& result) override;
+
+    void tanh(const DeviceTensorParams& a, const DeviceTensorParams& result) override;
+
+    void log(const DeviceTensorParams& a, const DeviceTensorParams& result) override;
+
+    void exp(const DeviceTensorParams& a, const DeviceTensorParams& result) override;
+
+    void pow(const DeviceTensorParams& a, const DeviceTensorParams& exp, const DeviceTensorParams& result) override;
+
+    void max(const DeviceTensorParams& a, const DeviceTensorParams& result) override;
+
+    void argmax(const DeviceTensorParams& a, const DeviceTensorParams& result) override;
+
+    void argmaxIndices(const DeviceTensorParams& a, const DeviceTensorParams& result) override;
+
+    void matmul(const DeviceTensorParams& a, const DeviceTensorParams& b, const DeviceTensorParams& result) override;
+
+    void matmulTransposed(const DeviceTensorParams& a, bool transposeA, const DeviceTensorParams& b,
+                          bool transposeB, const DeviceTensorParams& result) override;
+
+    void matmulQuantized(const DeviceTensorParams& a, const DeviceTensorParams& w, const QuantizedLayout& layout,
+                         const DeviceTensorParams& result) override;
+
+    void linear(const DeviceTensorParams& a, const DeviceTensorParams& b, const DeviceTensorParams& bias,
+                Activation activation, const DeviceTensorParams& preActivation,
+                const DeviceTensorParams& result) override;
+
+    void transpose(const DeviceTensorParams& a, const DeviceTensorParams& result, size_t dim0, size_t dim1) override;
+
+    void copy(const void* src, DataType srcDType, void* dst, DataType dstDType, size_t size) override;
+
+    void contiguous(const DeviceTensorParams& src, const DeviceTensorParams& dst) override;
+
+    void reduce(ReduceOp op, const DeviceTensorParams& src, const DeviceTensorParams& dst,
+                const ReduceShape& shape) override;
+
+    void softmax(SoftmaxOp op, const std::vector<DeviceTensorParams>& inputs, const DeviceTensorParams& result,
+                 const ReduceShape& shape) override;
+
+    void sliceSet(const DeviceTensorParams& src, const DeviceTensorParams& dst,
+                  size_t dim, size_t start, size_t end, size_t step) override;
+
+    void tril(const DeviceTensorParams& dst, ssize_t diagonal) override;
+
+    void triu(const DeviceTensorParams& dst, ssize_t diagonal) override;
+
+    void indexSelect(const DeviceTensorParams& src, const DeviceTensorParams& dst, const DeviceTensorParams& indices,
+                     size_t dim) override;
+
+protected:
+    // Returns the number of chunks to split the given number of elements into. Returns one for small tensors.
+    size_t chunkCount(size_t size) const;
+
+    // Splits [0, size) into the given number of chunks and calls func(chunkIndex, begin, end) for each chunk.
+    void parallelChunks(size_t size, size_t chunks, const std::function<void(size_t, size_t, size_t)>& func);
+
+    // Splits [0, size) into chunks, based on the minimum chunk size, and calls func(begin, end) for each chunk.
+    void parallelFor(size_t size, const std::function<void(size_t, size_t)>& func);
+
+    // Same as parallelFor() for the result of an element-wise operation. If any of the inputs is a strided view, the
+    // chunks are aligned to the rows of the first dimension so that chunkParams() can describe the views.
+    void parallelForViews(std::initializer_list<const DeviceTensorParams*> inputs, const DeviceTensorParams& result,
+                          const std::function<void(size_t, size_t)>& func);
+
+    // Returns the parameters of the [begin, end) element range of a tensor. The range of a strided view must be
+    // aligned to the rows of its first dimension.
+    static DeviceTensorParams chunkParams(const DeviceTensorParams& params, size_t begin, size_t end);
+
+    static inline size_t chunkBegin(size_t chunk, size_t chunks, size_t size)  { return chunk * size / chunks; }
+
+    // Computes the matrix multiplication in tiles on the threads. The epilogue is applied to single matrix results.
+    void gemmTiles(const DeviceTensorParams& a, bool transposeA, const DeviceTensorParams& b, bool transposeB,
+                   const DeviceTensorParams& result, const GemmEpilogue& epilogue);
+
+    std::unique_ptr<ThreadPool>  m_pool;
+    size_t  m_minChunkSize{CPU_MT_DEFAULT_MIN_CHUNK_SIZE};
+};
+
+}   // namespace
@@ -18,6 +18,9 @@
 // External includes
 #include <Metal/Metal.hpp>
 // System includes
+#include <bit>
+#include <filesystem>
+#include <sys/mman.h>
 
 
 namespace aix::metal
@@ -31,116 +34,102 @@ DeviceMetal::DeviceMetal(size_t deviceIndex)
     m_maxWorkingSetSize = static_cast<size_t>(static_cast<double>(m_mtlDevice->recommendedMaxWorkingSetSize()) * 0.7);
     m_allocator = std::make_unique<MetalAllocator>(m_mtlDevice, ALLOCATOR_ALIGNMENT_SIZE);
     m_bufferCache = std::make_unique<MTLBufferCache>();
-    auto defaultLibrary = createLibrary(shaders::aixDeviceMetalShaders);
-    auto nullKernelName = "nullKernel";
-
-    for (size_t i=0; i<aix::DataTypeCount; ++i)
-    {
-        auto iDType = static_cast<DataType>(i);
-        for (size_t j=0; j<aix::DataTypeCount; ++j)
-        {
-            auto jDType = static_cast<DataType>(j);
-            // Metal Framework does not support kFloat64 format.
-            bool isNull = iDType == DataType::kFloat64 || jDType == DataType::kFloat64;
-            std::string kernelName = "copy_" + toString(i) + "_" + toString(j);
-            m_compFuncPSOCopyAA[i][j] = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : kernelName);
-            kernelName = "fill_" + toString(i) + "_" + toString(j);
-            m_compFuncPSOFill[i][j]   = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : kernelName);
-        }
-
-        // Metal Framework does not support kFloat64 format.
-        bool isNull = iDType == DataType::kFloat64;
-        std::string dtypeStr = toString(i);
-        m_compFuncPSOAdd[i]         = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "add_" + dtypeStr);
-        m_compFuncPSOSub[i]         = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "sub_" + dtypeStr);
-        m_compFuncPSOMul[i]         = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "mul_" + dtypeStr);
-        m_compFuncPSODiv[i]         = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "div_" + dtypeStr);
-        m_compFuncPSOUnary[i]       = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "unary_" + dtypeStr);
-        m_compFuncPSOFillMin[i]     = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "fillMin_" + dtypeStr);
-        m_compFuncPSOSqrt[i]        = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "sqrt_" + dtypeStr);
-        m_compFuncPSOSin[i]         = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "sin_" + dtypeStr);
-        m_compFuncPSOCos[i]         = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "cos_" + dtypeStr);
-        m_compFuncPSOTanh[i]        = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "tanh_" + dtypeStr);
-        m_compFuncPSOLog[i]         = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "log_" + dtypeStr);
-        m_compFuncPSOExp[i]         = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "exp_" + dtypeStr);
-        m_compFuncPSOPow[i]         = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "pow_" + dtypeStr);
-        m_compFuncPSOSum[i]         = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "sum_" + dtypeStr);
-        m_compFuncPSOMax[i]         = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "max_" + dtypeStr);
-        m_compFuncPSOMatMulTiledBC6464888[i] = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "matrixMulTiledBC_64_64_8_8_8_" + dtypeStr);
-        m_compFuncPSOMatMulTiled32x32[i]  = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "matrixMulTiled_32_32_" + dtypeStr);
-        m_compFuncPSOMatMulTiled32x64[i]  = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "matrixMulTiled_32_64_" + dtypeStr);
-        m_compFuncPSOMatMulTiled32x128[i] = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "matrixMulTiled_32_128_" + dtypeStr);
-        m_compFuncPSOTranspose2D[i] = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "transpose2D_" + dtypeStr);
-        m_compFuncPSOTranspose2DTiled16x16x8[i] = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "transpose2DTiled_16_16_8_" + dtypeStr);
-        m_compFuncPSOTranspose2DTiled32x32x8[i] = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "transpose2DTiled_32_32_8_" + dtypeStr);
-        m_compFuncPSOTranspose[i]   = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "transpose_" + dtypeStr);
-        m_compFuncPSOContiguous[i]  = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "contiguous_" + dtypeStr);
-        m_compFuncPSOReduceTo[i]    = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "reduceTo_" + dtypeStr);
-        m_compFuncPSOMaxTo[i]       = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "maxTo_" + dtypeStr);
-        m_compFuncPSOSliceSet[i]    = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "sliceSet_" + dtypeStr);
-        m_compFuncPSOTril[i]        = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "tril_" + dtypeStr);
-        m_compFuncPSOTriu[i]        = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "triu_" + dtypeStr);
-        m_compFuncPSOIndexSelect[i] = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "indexSelect_" + dtypeStr);
-        m_compFuncPSOIndexAdd[i]    = createComputeFuncPSO(defaultLibrary, isNull ? nullKernelName : "indexAdd_" + dtypeStr);
-    }
+    m_privateBufferCache = std::make_unique<MTLBufferCache>();
+    // Pipeline states are created on first use, see computePSO().
+    m_library = createDefaultLibrary();
 
     m_cmdQueue = createCommandQueue();
-    m_cmdBuffer = m_cmdQueue->commandBuffer();
-    m_compEncoder = m_cmdBuffer->computeCommandEncoder();
+    m_id = ++m_deviceCount;
 }
 
 // Destructor
 DeviceMetal::~DeviceMetal()
 {
-    if (m_currentBatchSize > 0)
+    for (auto& [threadId, stream] : m_streams)
     {
-        std::cerr << "WARNING: Queued tensor operations detected. Did you forget to call synchronize()?" << std::endl;
-    }
+        if (stream->currentBatchSize > 0)
+        {
+            std::cerr << "WARNING: Queued tensor operations detected. Did you forget to call synchronize()?"
+                      << std::endl;
+        }
 
+        // Completed handlers of the committed command buffers access the device.
+        waitForCommandBuffers(*stream, 1);
+        releaseHostBuffers(*stream);
+        stream->compEncoder->endEncoding();
+    }
     m_bufferCache->clear();
+    m_privateBufferCache->clear();
+    for (const auto& [address, size] : m_privateAddressMap)
+    {
+        ::munmap(const_cast<void*>(address), size);
+    }
 
     // Note: No need to release MTL Buffer objects in m_allocMap.
-    m_compEncoder->endEncoding();
 
+    // Pipeline states that were never used are not created.
+    auto release = [](MTL::ComputePipelineState* compFuncPSO) { if (compFuncPSO) compFuncPSO->release(); };
     for (size_t i=0; i<aix::DataTypeCount; ++i)
     {
         for (size_t j=0; j<aix::DataTypeCount; ++j)
         {
-            m_compFuncPSOCopyAA[i][j]->release();
-            m_compFuncPSOFill[i][j]->release();
+            release(m_compFuncPSOCopyAA[i][j]);
+            release(m_compFuncPSOFill[i][j]);
         }
-        m_compFuncPSOAdd[i]->release();
-        m_compFuncPSOSub[i]->release();
-        m_compFuncPSOMul[i]->release();
-        m_compFuncPSODiv[i]->release();
-        m_compFuncPSOUnary[i]->release();
-        m_compFuncPSOSqrt[i]->release();
-        m_compFuncPSOSin[i]->release();
-        m_compFuncPSOCos[i]->release();
-        m_compFuncPSOTanh[i]->release();
-        m_compFuncPSOLog[i]->release();
-        m_compFuncPSOExp[i]->release();
-        m_compFuncPSOPow[i]->release();
-        m_compFuncPSOSum[i]->release();
-        m_compFuncPSOMax[i]->release();
-        m_compFuncPSOMatMulTiledBC6464888[i]->release();
-        m_compFuncPSOMatMulTiled32x32[i]->release();
-        m_compFuncPSOMatMulTiled32x64[i]->release();
-        m_compFuncPSOMatMulTiled32x128[i]->release();
-        m_compFuncPSOTranspose2D[i]->release();
-        m_compFuncPSOTranspose2DTiled16x16x8[i]->release();
-        m_compFuncPSOTranspose2DTiled32x32x8[i]->release();
-        m_compFuncPSOTranspose[i]->release();
-        m_compFuncPSOContiguous[i]->release();
-        m_compFuncPSOReduceTo[i]->release();
-        m_compFuncPSOMaxTo[i]->release();
-        m_compFuncPSOSliceSet[i]->release();
-        m_compFuncPSOTril[i]->release();
-        m_compFuncPSOTriu[i]->release();
-        m_compFuncPSOIndexSelect[i]->release();
-        m_compFuncPSOIndexAdd[i]->release();
+        release(m_compFuncPSOAdd[i]);
+        release(m_compFuncPSOSub[i]);
+        release(m_compFuncPSOMul[i]);
+        release(m_compFuncPSODiv[i]);
+        release(m_compFuncPSOUnary[i]);
+        release(m_compFuncPSOStrided[i]);
+        release(m_compFuncPSOFillMin[i]);
+        release(m_compFuncPSOSqrt[i]);
+        release(m_compFuncPSOSin[i]);
+        release(m_compFuncPSOCos[i]);
+        release(m_compFuncPSOTanh[i]);
+        release(m_compFuncPSOLog[i]);
+        release(m_compFuncPSOExp[i]);
+        release(m_compFuncPSOPow[i]);
+        release(m_compFuncPSOSum[i]);
+        release(m_compFuncPSOMax[i]);
+        release(m_compFuncPSOMatMulTiledBC6464888[i]);
+        release(m_compFuncPSOMatMulQuantized[i]);
+        release(m_compFuncPSOMatMulTiled32x32[i]);
+        release(m_compFuncPSOMatMulTiled32x64[i]);
+        release(m_compFuncPSOMatMulTiled32x128[i]);
+        release(m_compFuncPSOTranspose2D[i]);
+        release(m_compFuncPSOTranspose2DTiled16x16x8[i]);
+        release(m_compFuncPSOTranspose2DTiled32x32x8[i]);
+        release(m_compFuncPSOTranspose[i]);
+        release(m_compFuncPSOContiguous[i]);
+        release(m_compFuncPSOReduce[i]);
+        release(m_compFuncPSOSoftmax[i]);
+        release(m_compFuncPSOSliceSet[i]);
+        release(m_compFuncPSOTril[i]);
+        release(m_compFuncPSOTriu[i]);
+        release(m_compFuncPSOIndexSelect[i]);
+        release(m_compFuncPSOIndexAdd[i]);
+        release(m_compFuncPSOOptimizerStep[i]);
     }
 
+    for (auto& [source, compFuncPSO] : m_compFuncPSOFused)
+    {
+        compFuncPSO->release();
+    }
+
+    // The archive keeps the pipeline states that were created in this process for the next processes.
+    if (m_binaryArchive)
+    {
+        NS::Error* error = nullptr;
+        if (!m_binaryArchive->serializeToURL(fileURL(m_binaryArchiveFilename), &error))
+        {
+            std::cerr << "WARNING: Failed to save the pipeline archive. Details: "
+                      << error->localizedDescription()->utf8String() << "\n";
+        }
+        m_binaryArchive->release();
+    }
+
+    m_library->release();
     m_cmdQueue->release();
     m_mtlDevice->release();
     m_pool->release();
@@ -151,7 +140,9 @@ void* DeviceMetal::allocate(size_t size)
 {
     auto mtlBuf = newBuffer(size);
     auto contentPtr = mtlBuf->contents();
+    std::unique_lock  lock(m_allocMutex);
     m_allocMap[contentPtr] = mtlBuf;
+    trackAllocation(mtlBuf);
     return contentPtr;
 }
 
@@ -163,45 +154,170 @@ void* DeviceMetal::allocate(size_t size, DataType dtype)
 // Deallocate GPU memory if it's allocated by current device.
 void DeviceMetal::deallocate(void * memory)
 {
-    if (!isDeviceBuffer(memory))
+    auto mtlBuf = deviceBuffer(memory);
+    if (!mtlBuf)
         throw std::invalid_argument("DeviceMetal::deallocate() - Found different type of memory to free.");
-    auto mtlBuf = m_allocMap[memory];
     // IMPORTANT: Delay all deallocations of device buffers until all commands in the batch queue are executed.
-    m_tempBuffers.emplace_back(mtlBuf, mtlBuf->contents());
+    stream().tempBuffers.emplace_back(mtlBuf, memory);
+    std::unique_lock  lock(m_allocMutex);
+    m_bytesInUse -= mtlBuf->length();
+}
+
+void* DeviceMetal::allocatePrivate(size_t size, DataType dtype)
+{
+    if (!m_privateStorage) return nullptr;
+    auto mtlBuf = newBuffer(align(size, TOTAL_COMPONENT_COUNT) * dataTypeSize(dtype), true);
+    // The reserved pages are never accessible, so the host access to the private memory faults instead of reading
+    // another allocation.
+    auto address = ::mmap(nullptr, mtlBuf->length(), PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (address == MAP_FAILED)
+    {
+        m_privateBufferCache->recycle(mtlBuf);
+        return nullptr;
+    }
+    std::unique_lock  lock(m_allocMutex);
+    m_privateAddressMap[address] = mtlBuf->length();
+    m_allocMap[address] = mtlBuf;
+    trackAllocation(mtlBuf);
+    return address;
+}
+
+void* DeviceMetal::makeHostAccessible(void * memory, size_t size)
+{
+    if (!isPrivateBuffer(memory)) return memory;
+
+    // Queued commands could still write the private memory.
+    synchronize();
+    auto privateBuf = deviceBuffer(memory);
+    auto shared = allocate(privateBuf->length());
+    blitCopy(privateBuf, deviceBuffer(shared));
+    deallocate(memory);
+    std::unique_lock  lock(m_allocMutex);
+    ++m_stagingCount;
+    m_stagedSize += size;
+    return shared;
+}
+
+DeviceMetal::HeapStats DeviceMetal::heapStats()
+{
+    std::shared_lock  lock(m_allocMutex);
+    return { .sharedHeapCount=m_allocator->heapCount(MTL::StorageModeShared),
+             .sharedHeapSize=m_allocator->heapSize(MTL::StorageModeShared),
+             .privateHeapCount=m_allocator->heapCount(MTL::StorageModePrivate),
+             .privateHeapSize=m_allocator->heapSize(MTL::StorageModePrivate),
+             .cacheHitCount=m_bufferCache->hitCount() + m_privateBufferCache->hitCount(),
+             .cacheMissCount=m_bufferCache->missCount() + m_privateBufferCache->missCount(),
+             .stagingCount=m_stagingCount, .stagedSize=m_stagedSize };
+}
+
+cpu::MemoryCacheStats DeviceMetal::memoryStats()
+{
+    std::shared_lock  lock(m_allocMutex);
+    auto hitCount = m_bufferCache->hitCount() + m_privateBufferCache->hitCount();
+    return { .bytesInUse=m_bytesInUse,
+             .bytesCached=m_bufferCache->size() + m_privateBufferCache->size(),
+             .peakBytesInUse=m_peakBytesInUse,
+             .allocations=hitCount + m_bufferCache->missCount() + m_privateBufferCache->missCount(),
+             .cacheHits=hitCount };
+}
+
+void DeviceMetal::trackAllocation(const MTL::Buffer* buffer)
+{
+    m_bytesInUse += buffer->length();
+    m_peakBytesInUse = std::max(m_peakBytesInUse, m_bytesInUse);
+}
+
+void* DeviceMetal::mapHostMemory(void * memory, size_t size)
+{
+    if (reinterpret_cast<uintptr_t>(memory) % vm_page_size != 0) return nullptr;
+
+    // The host memory must stay valid and cover the page aligned size until unmapHostMemory() is called.
+    auto mtlBuf = m_mtlDevice->newBuffer(memory, align(size, vm_page_size), MTL::ResourceStorageModeShared, nullptr);
+    if (!mtlBuf) return nullptr;
+    std::unique_lock  lock(m_allocMutex);
+    m_allocMap[memory] = mtlBuf;
+    return memory;
+}
+
+void DeviceMetal::unmapHostMemory(void * memory)
+{
+    if (!isDeviceBuffer(memory))
+        throw std::invalid_argument("DeviceMetal::unmapHostMemory() - Found different type of memory to unmap.");
+    // Queued commands could still use the buffer. It must not be recycled by the buffer cache either.
+    synchronize();
+    std::unique_lock  lock(m_allocMutex);
+    m_allocMap[memory]->release();
+    m_allocMap.erase(memory);
 }
 
 void DeviceMetal::add(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("add", {&a1, &a2, &result});
+    if (isStridedView(a1) || isStridedView(a2))
+    {
+        executeStridedCmd(StridedOp::kAdd, a1, &a2, result, "add");
+        return;
+    }
     auto iDType = static_cast<size_t>(result.dtype);
-    executeTripleArrayCmd(a1, a2, result, m_compFuncPSOAdd[iDType], "add_" + toString(result.dtype));
+    auto compFuncPSO = computePSO(m_compFuncPSOAdd, "add_", iDType);
+    executeTripleArrayCmd(a1, a2, result, compFuncPSO, "add_" + toString(result.dtype));
 }
 
 void DeviceMetal::sub(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("sub", {&a1, &a2, &result});
+    if (isStridedView(a1) || isStridedView(a2))
+    {
+        executeStridedCmd(StridedOp::kSub, a1, &a2, result, "sub");
+        return;
+    }
     auto iDType = static_cast<size_t>(result.dtype);
-    executeTripleArrayCmd(a1, a2, result, m_compFuncPSOSub[iDType], "sub_" + toString(result.dtype));
+    auto compFuncPSO = computePSO(m_compFuncPSOSub, "sub_", iDType);
+    executeTripleArrayCmd(a1, a2, result, compFuncPSO, "sub_" + toString(result.dtype));
 }
 
 void DeviceMetal::mul(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("mul", {&a1, &a2, &result});
+    if (isStridedView(a1) || isStridedView(a2))
+    {
+        executeStridedCmd(StridedOp::kMul, a1, &a2, result, "mul");
+        return;
+    }
     auto iDType = static_cast<size_t>(result.dtype);
-    executeTripleArrayCmd(a1, a2, result, m_compFuncPSOMul[iDType], "mul_" + toString(result.dtype));
+    auto compFuncPSO = computePSO(m_compFuncPSOMul, "mul_", iDType);
+    executeTripleArrayCmd(a1, a2, result, compFuncPSO, "mul_" + toString(result.dtype));
 }
 
 void DeviceMetal::div(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("div", {&a1, &a2, &result});
+    if (isStridedView(a1) || isStridedView(a2))
+    {
+        executeStridedCmd(StridedOp::kDiv, a1, &a2, result, "div");
+        return;
+    }
     auto iDType = static_cast<size_t>(result.dtype);
-    executeTripleArrayCmd(a1, a2, result, m_compFuncPSODiv[iDType], "div_" + toString(result.dtype));
+    auto compFuncPSO = computePSO(m_compFuncPSODiv, "div_", iDType);
+    executeTripleArrayCmd(a1, a2, result, compFuncPSO, "div_" + toString(result.dtype));
 }
 
 void DeviceMetal::unary(const DeviceTensorParams& a1, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("unary", {&a1, &result});
+    if (isStridedView(a1))
+    {
+        executeStridedCmd(StridedOp::kNeg, a1, nullptr, result, "unary");
+        return;
+    }
     auto iDType = static_cast<size_t>(result.dtype);
-    executeDoubleArrayCmd(a1, result, m_compFuncPSOUnary[iDType], "unary_" + toString(result.dtype));
+    auto compFuncPSO = computePSO(m_compFuncPSOUnary, "unary_", iDType);
+    executeDoubleArrayCmd(a1, result, compFuncPSO, "unary_" + toString(result.dtype));
 }
 
 void DeviceMetal::fill(const void* scalar, DataType scalarDType, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("fill", {&result});
     assert(result.isContiguous == true);
     validateDataType(scalarDType);
     validateDataType(result.dtype);
@@ -217,8 +333,8 @@ void DeviceMetal::fill(const void* scalar, DataType scalarDType, const DeviceTen
 
     // bufScalar is a temporary size aligned buffer to be used as vector of 4.
     auto bufScalar = getReadOnlyMTLBuffer(scalar, 1, dataTypeSize(scalarDType), 1);
-    auto bufResult = m_allocMap[result.data];
-    auto compFuncPSO = m_compFuncPSOFill[iSrcDType][iDstDType];
+    auto bufResult = deviceBuffer(result.data);
+    auto compFuncPSO = computePSO(m_compFuncPSOFill, "fill_", iSrcDType, iDstDType);
 
     // Calculate maximum thread group dimensions
     auto asize = align(result.size, TOTAL_COMPONENT_COUNT) / TOTAL_COMPONENT_COUNT;
@@ -233,26 +349,27 @@ void DeviceMetal::fill(const void* scalar, DataType scalarDType, const DeviceTen
 
 void DeviceMetal::fillMin(const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("fillMin", {&result});
     assert(result.isContiguous == true);
     validateDataType(result.dtype);
     auto iDType = static_cast<size_t>(result.dtype);
-    auto compFuncPSO = m_compFuncPSOFillMin[iDType];
+    auto compFuncPSO = computePSO(m_compFuncPSOFillMin, "fillMin_", iDType);
 
     // Result buffer has to be allocated in advance and has to be a GPU memory.
     if (!isDeviceBuffer(result.data))
         throw std::invalid_argument("DeviceMetal::fillMin() result must have GPU memory.");
 
     // Memory could be a GPU allocated memory or system memory.
-    auto bufResult = m_allocMap[result.data];
+    auto bufResult = deviceBuffer(result.data);
 
     // Calculate maximum thread group dimensions
     auto asize = align(result.size, TOTAL_COMPONENT_COUNT) / TOTAL_COMPONENT_COUNT;
     NS::UInteger w = std::min(asize, compFuncPSO->maxTotalThreadsPerThreadgroup());
 
     // Encode the pipeline state object and its parameters.
-    m_compEncoder->setComputePipelineState(compFuncPSO);
-    m_compEncoder->setBuffer(bufResult, 0, 0);
-    m_compEncoder->dispatchThreads({asize, 1, 1}, {w, 1, 1});
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    stream().compEncoder->setBuffer(bufResult, 0, 0);
+    stream().compEncoder->dispatchThreads({asize, 1, 1}, {w, 1, 1});
 
     // Free operation is delayed until the commit is done.
     commitBatchQueue();
@@ -260,9 +377,10 @@ void DeviceMetal::fillMin(const DeviceTensorParams& result)
 
 void DeviceMetal::sum(const DeviceTensorParams& a, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("sum", {&a, &result});
     assert(a.isContiguous == result.isContiguous == true);
     auto iDType = static_cast<size_t>(result.dtype);
-    auto compFuncPSO = m_compFuncPSOSum[iDType];
+    auto compFuncPSO = computePSO(m_compFuncPSOSum, "sum_", iDType);
 
     // Result buffer has to be allocated in advance and has to be a GPU memory.
     if (!isDeviceBuffer(result.data))
@@ -271,10 +389,10 @@ void DeviceMetal::sum(const DeviceTensorParams& a, const DeviceTensorParams& res
     size_t maxThreadsPerTG = std::min<size_t>(MAX_THREADS_PER_THREADGROUP, compFuncPSO->maxTotalThreadsPerThreadgroup());
 
     auto buf1    = getReadOnlyMTLBuffer(a.data, a.size, dataTypeSize(a.dtype));
-    auto bufTemp = m_allocMap[allocate(buf1->allocatedSize())];
+    auto bufTemp = deviceBuffer(allocate(buf1->allocatedSize()));
 
     // TODO: Avoid the following copy if possible when changing the algorithm.
-    copy(buf1->contents(), a.dtype, bufTemp->contents(), result.dtype, a.size);
+    copy(a.data, a.dtype, bufTemp->contents(), result.dtype, a.size);
 
     // Apply Parallel Reduction Sum.
     size_t length = a.size - 1;
@@ -298,51 +416,95 @@ void DeviceMetal::sum(const DeviceTensorParams& a, const DeviceTensorParams& res
 
 void DeviceMetal::sqrt(const DeviceTensorParams& a, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("sqrt", {&a, &result});
+    if (isStridedView(a))
+    {
+        executeStridedCmd(StridedOp::kSqrt, a, nullptr, result, "sqrt");
+        return;
+    }
     auto iDType = static_cast<size_t>(result.dtype);
-    executeDoubleArrayCmd(a, result, m_compFuncPSOSqrt[iDType], "sqrt_" + toString(result.dtype));
+    executeDoubleArrayCmd(a, result, computePSO(m_compFuncPSOSqrt, "sqrt_", iDType), "sqrt_" + toString(result.dtype));
 }
 
 void DeviceMetal::sin(const DeviceTensorParams& a, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("sin", {&a, &result});
+    if (isStridedView(a))
+    {
+        executeStridedCmd(StridedOp::kSin, a, nullptr, result, "sin");
+        return;
+    }
     auto iDType = static_cast<size_t>(result.dtype);
-    executeDoubleArrayCmd(a, result, m_compFuncPSOSin[iDType], "sin_" + toString(result.dtype));
+    executeDoubleArrayCmd(a, result, computePSO(m_compFuncPSOSin, "sin_", iDType), "sin_" + toString(result.dtype));
 }
 
 void DeviceMetal::cos(const DeviceTensorParams& a, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("cos", {&a, &result});
+    if (isStridedView(a))
+    {
+        executeStridedCmd(StridedOp::kCos, a, nullptr, result, "cos");
+        return;
+    }
     auto iDType = static_cast<size_t>(result.dtype);
-    executeDoubleArrayCmd(a, result, m_compFuncPSOCos[iDType], "cos_" + toString(result.dtype));
+    executeDoubleArrayCmd(a, result, computePSO(m_compFuncPSOCos, "cos_", iDType), "cos_" + toString(result.dtype));
 }
 
 void DeviceMetal::tanh(const DeviceTensorParams& a, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("tanh", {&a, &result});
+    if (isStridedView(a))
+    {
+        executeStridedCmd(StridedOp::kTanh, a, nullptr, result, "tanh");
+        return;
+    }
     auto iDType = static_cast<size_t>(result.dtype);
-    executeDoubleArrayCmd(a, result, m_compFuncPSOTanh[iDType], "tanh_" + toString(result.dtype));
+    executeDoubleArrayCmd(a, result, computePSO(m_compFuncPSOTanh, "tanh_", iDType), "tanh_" + toString(result.dtype));
 }
 
 void DeviceMetal::log(const DeviceTensorParams& a, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("log", {&a, &result});
+    if (isStridedView(a))
+    {
+        executeStridedCmd(StridedOp::kLog, a, nullptr, result, "log");
+        return;
+    }
     auto iDType = static_cast<size_t>(result.dtype);
-    executeDoubleArrayCmd(a, result, m_compFuncPSOLog[iDType], "log_" + toString(result.dtype));
+    executeDoubleArrayCmd(a, result, computePSO(m_compFuncPSOLog, "log_", iDType), "log_" + toString(result.dtype));
 }
 
 void DeviceMetal::exp(const DeviceTensorParams& a, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("exp", {&a, &result});
+    if (isStridedView(a))
+    {
+        executeStridedCmd(StridedOp::kExp, a, nullptr, result, "exp");
+        return;
+    }
     auto iDType = static_cast<size_t>(result.dtype);
-    executeDoubleArrayCmd(a, result, m_compFuncPSOExp[iDType], "exp_" + toString(result.dtype));
+    executeDoubleArrayCmd(a, result, computePSO(m_compFuncPSOExp, "exp_", iDType), "exp_" + toString(result.dtype));
 }
 
 void DeviceMetal::pow(const DeviceTensorParams& a, const DeviceTensorParams& exp, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("pow", {&a, &exp, &result});
+    if (isStridedView(a) || isStridedView(exp))
+    {
+        executeStridedCmd(StridedOp::kPow, a, &exp, result, "pow");
+        return;
+    }
     auto iDType = static_cast<size_t>(result.dtype);
-    executeTripleArrayCmd(a, exp, result, m_compFuncPSOPow[iDType], "pow_" + toString(result.dtype));
+    auto compFuncPSO = computePSO(m_compFuncPSOPow, "pow_", iDType);
+    executeTripleArrayCmd(a, exp, result, compFuncPSO, "pow_" + toString(result.dtype));
 }
 
 void DeviceMetal::max(const DeviceTensorParams& a, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("max", {&a, &result});
     assert(a.isContiguous == result.isContiguous == true);
     auto iDType = static_cast<size_t>(result.dtype);
-    auto compFuncPSO = m_compFuncPSOMax[iDType];
+    auto compFuncPSO = computePSO(m_compFuncPSOMax, "max_", iDType);
 
     // Result buffer has to be allocated in advance and has to be a GPU memory.
     if (!isDeviceBuffer(result.data))
@@ -351,10 +513,10 @@ void DeviceMetal::max(const DeviceTensorParams& a, const DeviceTensorParams& res
     size_t maxThreadsPerTG = std::min<size_t>(MAX_THREADS_PER_THREADGROUP, compFuncPSO->maxTotalThreadsPerThreadgroup());
 
     auto buf1    = getReadOnlyMTLBuffer(a.data, a.size, dataTypeSize(a.dtype));
-    auto bufTemp = m_allocMap[allocate(buf1->allocatedSize())];
+    auto bufTemp = deviceBuffer(allocate(buf1->allocatedSize()));
 
     // TODO: Avoid the following copy if possible when changing the algorithm.
-    copy(buf1->contents(), a.dtype, bufTemp->contents(), a.dtype, a.size);
+    copy(a.data, a.dtype, bufTemp->contents(), a.dtype, a.size);
 
     // Apply Parallel Reduction Max.
     size_t length = a.size - 1;
@@ -378,6 +540,7 @@ void DeviceMetal::max(const DeviceTensorParams& a, const DeviceTensorParams& res
 
 void DeviceMetal::argmax(const DeviceTensorParams& a, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("argmax", {&a, &result});
     assert(a.isContiguous == result.isContiguous == true);
     if (result.dtype != DataType::kInt32)
     {
@@ -385,11 +548,16 @@ void DeviceMetal::argmax(const DeviceTensorParams& a, const DeviceTensorParams&
     }
 
     synchronize();
-    Device::argmax(a, result);
+    auto hostA = hostParams(a);
+    auto hostResult = hostParams(result);
+    Device::argmax(hostA, hostResult);
+    releaseHostParams(a, hostA, false);
+    releaseHostParams(result, hostResult, true);
 }
 
 void DeviceMetal::argmaxIndices(const DeviceTensorParams& a, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("argmaxIndices", {&a, &result});
     assert(a.isContiguous == result.isContiguous == true);
     if (result.dtype != DataType::kInt32)
     {
@@ -397,11 +565,16 @@ void DeviceMetal::argmaxIndices(const DeviceTensorParams& a, const DeviceTensorP
     }
 
     synchronize();
-    Device::argmaxIndices(a, result);
+    auto hostA = hostParams(a);
+    auto hostResult = hostParams(result);
+    Device::argmaxIndices(hostA, hostResult);
+    releaseHostParams(a, hostA, false);
+    releaseHostParams(result, hostResult, true);
 }
 
 void DeviceMetal::matmul(const DeviceTensorParams& a, const DeviceTensorParams& b, const DeviceTensorParams& result)
 {
+    profiler::OpScope scope("matmul", {&a, &b, &result});
     assert(a.isContiguous == b.isContiguous == result.isContiguous == true);
     validateDataType(result.dtype);
     auto iDType = static_cast<size_t>(result.dtype);
@@ -410,66 +583,104 @@ void DeviceMetal::matmul(const DeviceTensorParams& a, const DeviceTensorParams&
     if (!isDeviceBuffer(result.data))
         throw std::invalid_argument("DeviceMetal::matmul() result must have GPU memory.");
 
-    // Memory could be a GPU allocated memory or system memory.
-    auto buf1 = getReadOnlyMTLBuffer(a.data, a.shape[0] * a.shape[1], dataTypeSize(a.dtype));
-    auto buf2 = getReadOnlyMTLBuffer(b.data, b.shape[0] * b.shape[1], dataTypeSize(b.dtype));
-    auto bufResult = m_allocMap[result.data];
-    auto buf1Size = MatrixSize{a.shape[0], a.shape[1]};
-    auto buf2Size = MatrixSize{b.shape[0], b.shape[1]};
+    auto buf1Size = MatrixSize{a.shape[a.shape.size() - 2], a.shape.back()};
+    auto buf2Size = MatrixSize{b.shape[b.shape.size() - 2], b.shape.back()};
 
     size_t M = buf1Size.rows;
     size_t K = buf1Size.cols;
     size_t N = buf2Size.cols;
 
-    auto encodeParams = [&](const MTL::ComputePipelineState* compFuncPSO)
+    // The tiled kernels require dimensions that are multiples of their tile sizes.
+    bool commonCondition = K % 32 == 0 && N % 32 == 0 &&
+                           (result.dtype == aix::DataType::kFloat32 ||
+                            result.dtype == aix::DataType::kFloat16 ||
+                            result.dtype == aix::DataType::kBFloat16);
+    size_t alignment = !commonCondition ? 1 : M % 128 == 0 ? 128 : M % 64 == 0 ? 64 : M % 32 == 0 ? 32 : 1;
+    std::vector<TunedKernel> candidates{TunedKernel::kMatMulTiledBC6464888};
+    if (alignment >= 32)  candidates.emplace_back(TunedKernel::kMatMulTiled32x32);
+    if (alignment >= 64)  candidates.emplace_back(TunedKernel::kMatMulTiled32x64);
+    if (alignment >= 128) candidates.emplace_back(TunedKernel::kMatMulTiled32x128);
+
+    // Tuning runs the kernels on the inputs, so the commands that compute the inputs must complete first.
+    auto key = tuningKey(TunedOp::kMatMul, result.dtype, M, N, K, alignment);
+    bool isTuning = m_autotune && candidates.size() > 1 && !isTuned(key);
+    if (isTuning)
     {
-        m_compEncoder->setComputePipelineState(compFuncPSO);
-        m_compEncoder->setBuffer(buf1, 0, 0);
-        m_compEncoder->setBuffer(buf2, 0, 1);
-        m_compEncoder->setBuffer(bufResult, 0, 2);
-        m_compEncoder->setBytes(&buf1Size, sizeof(MatrixSize), 3);
-        m_compEncoder->setBytes(&buf2Size, sizeof(MatrixSize), 4);
+        synchronize();
+    }
+
+    // Memory could be a GPU allocated memory or system memory.
+    auto buf1 = getReadOnlyMTLBuffer(a.data, a.size, dataTypeSize(a.dtype));
+    auto buf2 = getReadOnlyMTLBuffer(b.data, b.size, dataTypeSize(b.dtype));
+    auto bufResult = deviceBuffer(result.data);
+
+    // Each matrix of the batch is computed by a separate slice of the threadgroup grid.
+    uint numBatches = matrixCount(result);
+    auto batchStrides = MatrixBatchStrides{matrixCount(a) == 1 ? 0 : M * K, matrixCount(b) == 1 ? 0 : K * N, M * N};
+    auto noEpilogue = MatrixEpilogue{ .activation=0, .hasBias=0, .hasPreActivation=0 };
+
+    auto encodeParams = [&](MTL::ComputeCommandEncoder* encoder, const MTL::ComputePipelineState* compFuncPSO)
+    {
+        encoder->setComputePipelineState(compFuncPSO);
+        encoder->setBuffer(buf1, 0, 0);
+        encoder->setBuffer(buf2, 0, 1);
+        encoder->setBuffer(bufResult, 0, 2);
+        encoder->setBytes(&buf1Size, sizeof(MatrixSize), 3);
+        encoder->setBytes(&buf2Size, sizeof(MatrixSize), 4);
+        encoder->setBytes(&batchStrides, sizeof(MatrixBatchStrides), 5);
+        // The kernel with boundary checks has an epilogue, which is disabled.
+        encoder->setBuffer(bufResult, 0, 6);
+        encoder->setBuffer(bufResult, 0, 7);
+        encoder->setBytes(&noEpilogue, sizeof(MatrixEpilogue), 8);
     };
 
-    auto dispatchTiled = [&](const MTL::ComputePipelineState* compFuncPSO, const size_t tileSizeX, const size_t tileSizeY)
+    auto dispatchTiled = [&](MTL::ComputeCommandEncoder* encoder, const MTL::ComputePipelineState* compFuncPSO,
+                             const size_t tileSizeX, const size_t tileSizeY)
     {
         // Encode the pipeline state object and its parameters.
         uint numThreadgroupsX = (N + tileSizeX - 1) / tileSizeX;
         uint numThreadgroupsY = (M + tileSizeY - 1) / tileSizeY;
         assert(tileSizeX * tileSizeY / tileSizeX <= compFuncPSO->maxTotalThreadsPerThreadgroup());
-        encodeParams(compFuncPSO);
-        m_compEncoder->dispatchThreadgroups({numThreadgroupsX, numThreadgroupsY, 1}, {tileSizeX, tileSizeY/tileSizeX, 1});
+        encodeParams(encoder, compFuncPSO);
+        encoder->dispatchThreadgroups({numThreadgroupsX, numThreadgroupsY, numBatches},
+                                      {tileSizeX, tileSizeY/tileSizeX, 1});
     };
 
-    bool commonCondition = K % 32 == 0 && N % 32 == 0 &&
-                           (result.dtype == aix::DataType::kFloat32 ||
-                            result.dtype == aix::DataType::kFloat16 ||
-                            result.dtype == aix::DataType::kBFloat16);
-    // Use fast matmul where dimensions are multiple of TSY.
-    // TODO: Make SIMD comparison.
-    if (M % 128 == 0 && commonCondition)
+    auto encode = [&](MTL::ComputeCommandEncoder* encoder, TunedKernel kernel)
     {
-        dispatchTiled(m_compFuncPSOMatMulTiled32x128[iDType], 32, 128);
-    }
-    else if (M % 64 == 0 && commonCondition)
-    {
-        dispatchTiled(m_compFuncPSOMatMulTiled32x64[iDType], 32, 64);
-    }
-    else if (M % 32 == 0 && commonCondition)
-    {
-        dispatchTiled(m_compFuncPSOMatMulTiled32x32[iDType], 32, 32);
-    }
-    else
-    {
-        constexpr size_t tileSize = 64;
-        constexpr size_t numThreads = 64;
-        uint numThreadgroupsX = (N + tileSize - 1) / tileSize;
-        uint numThreadgroupsY = (M + tileSize - 1) / tileSize;
-        auto compFuncPSO = m_compFuncPSOMatMulTiledBC6464888[iDType];
-        assert(numThreads <= compFuncPSO->maxTotalThreadsPerThreadgroup());
-        encodeParams(compFuncPSO);
-        m_compEncoder->dispatchThreadgroups({numThreadgroupsX, numThreadgroupsY, 1}, {numThreads, 1, 1});
-    }
+        switch (kernel)
+        {
+            case TunedKernel::kMatMulTiled32x128:
+                dispatchTiled(encoder, computePSO(m_compFuncPSOMatMulTiled32x128, "matrixMulTiled_32_128_", iDType),
+                              32, 128);
+                break;
+            case TunedKernel::kMatMulTiled32x64:
+                dispatchTiled(encoder, computePSO(m_compFuncPSOMatMulTiled32x64, "matrixMulTiled_32_64_", iDType),
+                              32, 64);
+                break;
+            case TunedKernel::kMatMulTiled32x32:
+                dispatchTiled(encoder, computePSO(m_compFuncPSOMatMulTiled32x32, "matrixMulTiled_32_32_", iDType),
+                              32, 32);
+                break;
+            default:
+            {
+                constexpr size_t tileSize = 64;
+                constexpr size_t numThreads = 64;
+                uint numThreadgroupsX = (N + tileSize - 1) / tileSize;
+                uint numThreadgroupsY = (M + tileSize - 1) / tileSize;
+                auto compFuncPSO = computePSO(m_compFuncPSOMatMulTiledBC6464888, "matrixMulTiledBC_64_64_8_8_8_",
+                                              iDType);
+                assert(numThreads <= compFuncPSO->maxTotalThreadsPerThreadgroup());
+                encodeParams(encoder, compFuncPSO);
+                encoder->dispatchThreadgroups({numThreadgroupsX, numThreadgroupsY, numBatches}, {numThreads, 1, 1});
+                break;
+            }
+        }
+    };
+
+    // Without tuning, the kernel with the largest tiles that fit the dimensions is used.
+    // TODO: Make SIMD comparison.
+    encode(stream().compEncoder, isTuning ? tuneKernel(key, candidates, encode) : tunedKernel(key, candidates));
 
     // Free operation is delayed until the commit is done.
     freeTemporaryBuffer(buf1);
@@ -477,8 +688,132 @@ void DeviceMetal::matmul(const DeviceTensorParams& a, const DeviceTensorParams&
     commitBatchQueue();
 }
 
+void DeviceMetal::matmulTransposed(const DeviceTensorParams& a, bool transposeA, const DeviceTensorParams& b,
+                                   bool transposeB, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("matmulTransposed", {&a, &b, &result});
+    // Transposed inputs are materialized into temporary GPU buffers by the transpose kernels.
+    auto transposeInput = [&](const DeviceTensorParams& mat)
+    {
+        auto rank = mat.shape.size();
+        DeviceTensorParams matT = mat;
+        matT.data = allocate(mat.size, mat.dtype);
+        std::swap(matT.shape[rank - 2], matT.shape[rank - 1]);
+        for (size_t i = rank, stride = 1; i-- > 0; stride *= matT.shape[i])
+        {
+            matT.strides[i] = stride;
+        }
+        transpose(mat, matT, rank - 2, rank - 1);
+        return matT;
+    };
+
+    auto lhs = transposeA ? transposeInput(a) : a;
+    auto rhs = transposeB ? transposeInput(b) : b;
+    matmul(lhs, rhs, result);
+
+    // Free operation is delayed until the commit is done.
+    if (transposeA) deallocate(lhs.data);
+    if (transposeB) deallocate(rhs.data);
+}
+
+void DeviceMetal::linear(const DeviceTensorParams& a, const DeviceTensorParams& b, const DeviceTensorParams& bias,
+                         Activation activation, const DeviceTensorParams& preActivation,
+                         const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("linear", {&a, &b, &bias, &result});
+    validateDataType(result.dtype);
+    auto iDType = static_cast<size_t>(result.dtype);
+
+    // Result buffers have to be allocated in advance and have to be a GPU memory.
+    if (!isDeviceBuffer(result.data) || (preActivation.data && !isDeviceBuffer(preActivation.data)))
+        throw std::invalid_argument("DeviceMetal::linear() result must have GPU memory.");
+
+    // Memory could be a GPU allocated memory or system memory.
+    auto bufA = getReadOnlyMTLBuffer(a.data, a.size, dataTypeSize(a.dtype));
+    auto bufB = getReadOnlyMTLBuffer(b.data, b.size, dataTypeSize(b.dtype));
+    auto bufBias = getReadOnlyMTLBuffer(bias.data, bias.size, dataTypeSize(bias.dtype));
+    auto bufResult = deviceBuffer(result.data);
+    auto bufPreActivation = preActivation.data ? deviceBuffer(preActivation.data) : bufResult;
+
+    auto aSize = MatrixSize{a.shape[0], a.shape[1]};
+    auto bSize = MatrixSize{b.shape[0], b.shape[1]};
+    auto batchStrides = MatrixBatchStrides{0, 0, 0};
+    auto epilogue = MatrixEpilogue{ .activation=static_cast<uint32_t>(activation), .hasBias=1,
+                                    .hasPreActivation=preActivation.data ? 1u : 0u };
+
+    // Only the kernel with boundary checks has an epilogue, which supports any shape.
+    constexpr size_t tileSize = 64;
+    constexpr size_t numThreads = 64;
+    uint numThreadgroupsX = (bSize.cols + tileSize - 1) / tileSize;
+    uint numThreadgroupsY = (aSize.rows + tileSize - 1) / tileSize;
+    auto compFuncPSO = computePSO(m_compFuncPSOMatMulTiledBC6464888, "matrixMulTiledBC_64_64_8_8_8_", iDType);
+    assert(numThreads <= compFuncPSO->maxTotalThreadsPerThreadgroup());
+
+    // Serialize resources and states to be used by the GPU.
+    auto encoder = stream().compEncoder;
+    encoder->setComputePipelineState(compFuncPSO);
+    encoder->setBuffer(bufA, 0, 0);
+    encoder->setBuffer(bufB, 0, 1);
+    encoder->setBuffer(bufResult, 0, 2);
+    encoder->setBytes(&aSize, sizeof(MatrixSize), 3);
+    encoder->setBytes(&bSize, sizeof(MatrixSize), 4);
+    encoder->setBytes(&batchStrides, sizeof(MatrixBatchStrides), 5);
+    encoder->setBuffer(bufBias, 0, 6);
+    encoder->setBuffer(bufPreActivation, 0, 7);
+    encoder->setBytes(&epilogue, sizeof(MatrixEpilogue), 8);
+    encoder->dispatchThreadgroups({numThreadgroupsX, numThreadgroupsY, 1}, {numThreads, 1, 1});
+
+    // Free operation is delayed until the commit is done.
+    freeTemporaryBuffer(bufA);
+    freeTemporaryBuffer(bufB);
+    freeTemporaryBuffer(bufBias);
+    commitBatchQueue();
+}
+
+void DeviceMetal::matmulQuantized(const DeviceTensorParams& a, const DeviceTensorParams& w,
+                                  const QuantizedLayout& layout, const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("matmulQuantized", {&a, &w, &result});
+    validateDataType(result.dtype);
+
+    // Result buffer has to be allocated in advance and has to be a GPU memory.
+    if (!isDeviceBuffer(result.data))
+        throw std::invalid_argument("DeviceMetal::matmulQuantized() result must have GPU memory.");
+
+    auto bufA = getReadOnlyMTLBuffer(a.data, a.size, dataTypeSize(a.dtype));
+    auto bufW = getReadOnlyMTLBuffer(w.data, w.size, dataTypeSize(w.dtype));
+    auto bufResult = deviceBuffer(result.data);
+    auto iDType = static_cast<size_t>(result.dtype);
+    auto compFuncPSO = computePSO(m_compFuncPSOMatMulQuantized, "matrixMulQuantized_", iDType);
+    QuantizedMatrixParams params{ .inputs=static_cast<uint32_t>(layout.inputs),
+                                  .outputs=static_cast<uint32_t>(layout.outputs),
+                                  .bits=static_cast<uint32_t>(layout.bits),
+                                  .groupSize=static_cast<uint32_t>(layout.groupSize),
+                                  .rowSize=static_cast<uint32_t>(layout.rowSize()),
+                                  .valueOffset=static_cast<uint32_t>(layout.valueOffset()) };
+
+    // Serialize resources and states to be used by the GPU.
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    stream().compEncoder->setBuffer(bufA, 0, 0);
+    stream().compEncoder->setBuffer(bufW, 0, 1);
+    stream().compEncoder->setBuffer(bufResult, 0, 2);
+    stream().compEncoder->setBytes(&params, sizeof(params), 3);
+
+    // A simdgroup computes an output of a row.
+    size_t rows = a.size / layout.inputs;
+    size_t simdWidth = compFuncPSO->threadExecutionWidth();
+    size_t tgCount = (layout.outputs + QUANTIZED_MATMUL_SIMDGROUPS - 1) / QUANTIZED_MATMUL_SIMDGROUPS;
+    stream().compEncoder->dispatchThreadgroups({tgCount, rows, 1}, {simdWidth, QUANTIZED_MATMUL_SIMDGROUPS, 1});
+
+    // Free operation is delayed until the commit is done.
+    freeTemporaryBuffer(bufA);
+    freeTemporaryBuffer(bufW);
+    commitBatchQueue();
+}
+
 void DeviceMetal::transpose(const DeviceTensorParams& a, const DeviceTensorParams& result, size_t dim0, size_t dim1)
 {
+    profiler::OpScope scope("transpose", {&a, &result});
     assert(a.isContiguous == result.isContiguous == true);
     auto iDType = static_cast<size_t>(result.dtype);
     // Use fast and simplified version of the general transpose for matrix transpose operations.
@@ -498,40 +833,39 @@ void DeviceMetal::transpose(const DeviceTensorParams& a, const DeviceTensorParam
 
     // Memory could be a GPU allocated memory or system memory.
     auto bufData       = getReadOnlyMTLBuffer(a.data, a.size, dataTypeSize(a.dtype));
-    auto bufResult     = m_allocMap[result.data];
-    auto bufStrides    = getReadOnlyMTLBuffer(a.strides.data(), a.strides.size(), sizeof(size_t));
+    auto bufResult     = deviceBuffer(result.data);
     size_t stridesSize = a.strides.size();
-    auto bufNewStrides = getReadOnlyMTLBuffer(result.strides.data(), result.strides.size(), sizeof(size_t));
     size_t newStridesSize = result.strides.size();
 
+    auto compFuncPSO = computePSO(m_compFuncPSOTranspose, "transpose_", iDType);
+
     // Serialize resources and states to be used by the GPU.
-    m_compEncoder->setComputePipelineState(m_compFuncPSOTranspose[iDType]);
-    m_compEncoder->setBuffer(bufData,        0,                       0);
-    m_compEncoder->setBuffer(bufResult,      0,                       1);
-    m_compEncoder->setBytes(&dim0,           sizeof(dim0),            2);
-    m_compEncoder->setBytes(&dim1,           sizeof(dim1),            3);
-    m_compEncoder->setBuffer(bufStrides,     0,                       4);
-    m_compEncoder->setBytes(&stridesSize,    sizeof(stridesSize),     5);
-    m_compEncoder->setBuffer(bufNewStrides,  0,                       6);
-    m_compEncoder->setBytes(&newStridesSize, sizeof(newStridesSize),  7);
-    m_compEncoder->setBytes(&a.size,         sizeof(a.size),          8);
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    stream().compEncoder->setBuffer(bufData,        0,                       0);
+    stream().compEncoder->setBuffer(bufResult,      0,                       1);
+    stream().compEncoder->setBytes(&dim0,           sizeof(dim0),            2);
+    stream().compEncoder->setBytes(&dim1,           sizeof(dim1),            3);
+    setArrayBytes(a.strides, 4);
+    stream().compEncoder->setBytes(&stridesSize,    sizeof(stridesSize),     5);
+    setArrayBytes(result.strides, 6);
+    stream().compEncoder->setBytes(&newStridesSize, sizeof(newStridesSize),  7);
+    stream().compEncoder->setBytes(&a.size,         sizeof(a.size),          8);
 
     // Calculate maximum thread group dimensions
-    NS::UInteger w = std::min(a.size, m_compFuncPSOTranspose[iDType]->maxTotalThreadsPerThreadgroup());
+    NS::UInteger w = std::min(a.size, compFuncPSO->maxTotalThreadsPerThreadgroup());
 
     // Use dispatch threads which is the most efficient but requires non-uniform grid size feature support in HW.
-    m_compEncoder->dispatchThreads({a.size, 1, 1}, {w, 1, 1});
+    stream().compEncoder->dispatchThreads({a.size, 1, 1}, {w, 1, 1});
 
     // Free operation is delayed until the commit is done.
     freeTemporaryBuffer(bufData);
     freeTemporaryBuffer(bufResult);
-    freeTemporaryBuffer(bufStrides);
-    freeTemporaryBuffer(bufNewStrides);
     commitBatchQueue();
 }
 
 void DeviceMetal::copy(const void* src, DataType srcDType, void* dst, DataType dstDType, size_t size)
 {
+    profiler::OpScope scope("copy", dstDType, size * (dataTypeSize(srcDType) + dataTypeSize(dstDType)));
     validateDataType(srcDType);
     validateDataType(dstDType);
     auto iSrcDType = static_cast<size_t>(srcDType);
@@ -543,8 +877,8 @@ void DeviceMetal::copy(const void* src, DataType srcDType, void* dst, DataType d
 
     // Memory could be a GPU allocated memory or system memory.
     auto buf1 = getReadOnlyMTLBuffer(src, size, dataTypeSize(srcDType));
-    auto bufResult = m_allocMap[dst];
-    auto compFuncPSO = m_compFuncPSOCopyAA[iSrcDType][iDstDType];
+    auto bufResult = deviceBuffer(dst);
+    auto compFuncPSO = computePSO(m_compFuncPSOCopyAA, "copy_", iSrcDType, iDstDType);
 
     // Calculate maximum thread group dimensions
     auto asize = align(size, TOTAL_COMPONENT_COUNT) / TOTAL_COMPONENT_COUNT;
@@ -558,12 +892,14 @@ void DeviceMetal::copy(const void* src, DataType srcDType, void* dst, DataType d
 
 void DeviceMetal::copyImmediate(const void* src, DataType srcDType, void* dst, DataType dstDType, size_t size)
 {
+    profiler::OpScope scope("copyImmediate", dstDType, size * (dataTypeSize(srcDType) + dataTypeSize(dstDType)));
     copy(src, srcDType, dst, dstDType, size);
     synchronize();
 }
 
 void DeviceMetal::contiguous(const DeviceTensorParams& src, const DeviceTensorParams& dst)
 {
+    profiler::OpScope scope("contiguous", {&src, &dst});
     assert(src.isContiguous == false && dst.isContiguous == true);
     validateDataType(src.dtype);
     // Result buffer has to be allocated in advance and has to be a GPU memory.
@@ -575,90 +911,143 @@ void DeviceMetal::contiguous(const DeviceTensorParams& src, const DeviceTensorPa
     size_t strideSize = src.strides.size();
     assert(shapeSize == strideSize);
 
-    auto bufSrc     = getReadOnlyMTLBuffer(src.data, src.size, dataTypeSize(src.dtype));
-    auto bufShape   = shapeSize  != 0 ? getReadOnlyMTLBuffer(src.shape.data(), shapeSize,  sizeof(size_t)) : nullptr;
-    auto bufStrides = strideSize != 0 ? getReadOnlyMTLBuffer(src.strides.data(), strideSize, sizeof(size_t)) : nullptr;
-    auto bufDst     = m_allocMap[dst.data];
-    auto computePSO = m_compFuncPSOContiguous[iDType];
+    auto bufSrc     = getReadOnlyMTLBuffer(src.data, storageSize(src), dataTypeSize(src.dtype));
+    auto bufDst     = deviceBuffer(dst.data);
+    auto compFuncPSO = computePSO(m_compFuncPSOContiguous, "contiguous_", iDType);
 
     // Serialize resources and states to be used by the GPU.
-    m_compEncoder->setComputePipelineState(computePSO);
-    m_compEncoder->setBuffer(bufSrc,     0, 0);
-    m_compEncoder->setBuffer(bufDst,     0, 1);
-    m_compEncoder->setBuffer(bufShape,   0, 2);
-    m_compEncoder->setBuffer(bufStrides, 0, 3);
-    m_compEncoder->setBytes(&shapeSize,  sizeof(shapeSize),  4);
-    m_compEncoder->setBytes(&src.offset, sizeof(src.offset), 5);
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    stream().compEncoder->setBuffer(bufSrc,     0, 0);
+    stream().compEncoder->setBuffer(bufDst,     0, 1);
+    setArrayBytes(src.shape, 2);
+    setArrayBytes(src.strides, 3);
+    stream().compEncoder->setBytes(&shapeSize,  sizeof(shapeSize),  4);
+    stream().compEncoder->setBytes(&src.offset, sizeof(src.offset), 5);
 
     // Calculate maximum thread group dimensions
-    NS::UInteger w = std::min(dst.size, computePSO->maxTotalThreadsPerThreadgroup());
+    NS::UInteger w = std::min(dst.size, compFuncPSO->maxTotalThreadsPerThreadgroup());
 
     // Use dispatch threads which is the most efficient but requires non-uniform grid size feature support in HW.
-    m_compEncoder->dispatchThreads({dst.size, 1, 1}, {w, 1, 1});
+    stream().compEncoder->dispatchThreads({dst.size, 1, 1}, {w, 1, 1});
 
     // Free operation is delayed until the commit is done.
     freeTemporaryBuffer(bufSrc);
-    freeTemporaryBuffer(bufShape);
-    freeTemporaryBuffer(bufStrides);
     commitBatchQueue();
 }
 
-void DeviceMetal::reduceTo(const DeviceTensorParams& src, const DeviceTensorParams& dst)
+void DeviceMetal::reduce(ReduceOp op, const DeviceTensorParams& src, const DeviceTensorParams& dst,
+                         const ReduceShape& shape)
 {
+    profiler::OpScope scope("reduce", {&src, &dst});
     assert(src.isContiguous == dst.isContiguous == true);
     validateDataType(src.dtype);
-    // NOTE: Metal Framework supports add and sub operations for only atomic_float, atomic_uint and atomic_int.
-    //       Since reduceTo uses atomic<T>, we can only allow certain formats for acceleration for now.
-    if (!(src.dtype == DataType::kFloat32 || src.dtype == DataType::kInt32))
+    if (op == ReduceOp::kArgmax && dst.dtype != DataType::kInt32)
     {
-        synchronize();
-        Device::reduceTo(src, dst);
-        return;
+        throw std::invalid_argument("DeviceMetal::reduce supports only int32 data type for the result of argmax.");
     }
 
-    auto iDType = static_cast<size_t>(src.dtype);
-    translation(src.data, dst.data, src.size, src.shape, dst.shape, m_compFuncPSOReduceTo[iDType], src.dtype,
-                "reduceTo_" + toString(src.dtype));
-    // NOTE: The ReduceTo function performs a sum operation. The order of these operations by GPU threads is not
-    // guaranteed, which might result in minor differences in the final results due to floating-point precision limits.
-}
+    // Result buffer has to be allocated in advance and has to be a GPU memory.
+    if (!isDeviceBuffer(dst.data))
+        throw std::invalid_argument("DeviceMetal::reduce() result must have GPU memory.");
 
-void DeviceMetal::maxTo(const DeviceTensorParams& src, const DeviceTensorParams& dst)
-{
-    assert(src.isContiguous == dst.isContiguous == true);
-    validateDataType(src.dtype);
-    // NOTE: Only certain data types are supported due to limitation of Metal Framework atomics.
-    if (!(src.dtype == DataType::kFloat32 || src.dtype == DataType::kInt32))
+    auto bufSrc = getReadOnlyMTLBuffer(src.data, src.offset + src.size, dataTypeSize(src.dtype));
+    auto bufDst = deviceBuffer(dst.data);
+    auto compFuncPSO = computePSO(m_compFuncPSOReduce, "reduce_", static_cast<size_t>(src.dtype));
+    ReduceParams params{ .outer=shape.outer, .reduce=shape.reduce, .inner=shape.inner,
+                         .op=static_cast<uint32_t>(op) };
+
+    // A threadgroup covers up to 32 adjacent columns, and the remaining threads split the reduced axis. Its height is
+    // a power of two for the tree reduction.
+    size_t maxThreadsPerTG = std::min<size_t>(MAX_THREADS_PER_THREADGROUP, compFuncPSO->maxTotalThreadsPerThreadgroup());
+    size_t tgWidth  = std::min<size_t>(shape.inner, 32);
+    size_t tgHeight = 1;
+    while (tgHeight < shape.reduce && tgWidth * tgHeight * 2 <= maxThreadsPerTG)
     {
-        synchronize();
-        Device::maxTo(src, dst);
-        return;
+        tgHeight *= 2;
     }
 
-    auto iDType = static_cast<size_t>(src.dtype);
-    translation(src.data, dst.data, src.size, src.shape, dst.shape, m_compFuncPSOMaxTo[iDType], src.dtype,
-                "maxTo_" + toString(src.dtype));
+    // Serialize resources and states to be used by the GPU.
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    stream().compEncoder->setBuffer(bufSrc, src.offset * dataTypeSize(src.dtype), 0);
+    stream().compEncoder->setBuffer(bufDst, dst.offset * dataTypeSize(dst.dtype), 1);
+    stream().compEncoder->setBytes(&params, sizeof(params), 2);
+
+    // Each threadgroup reduces a block of columns of one outer row.
+    stream().compEncoder->dispatchThreadgroups({(shape.inner + tgWidth - 1) / tgWidth, shape.outer, 1},
+                                        {tgWidth, tgHeight, 1});
+
+    // Free operation is delayed until the commit is done.
+    freeTemporaryBuffer(bufSrc);
+    commitBatchQueue();
 }
 
-void DeviceMetal::argmaxTo(const DeviceTensorParams& src, const DeviceTensorParams& dst, size_t dim)
+void DeviceMetal::softmax(SoftmaxOp op, const std::vector<DeviceTensorParams>& inputs,
+                          const DeviceTensorParams& result, const ReduceShape& shape)
 {
-    assert(src.isContiguous == dst.isContiguous == true);
-    validateDataType(src.dtype);
-    synchronize();
-    Device::argmaxTo(src, dst, dim);
+    profiler::OpScope scope("softmax", inputs, result);
+    validateDataType(result.dtype);
+
+    // Result buffer has to be allocated in advance and has to be a GPU memory.
+    if (!isDeviceBuffer(result.data))
+        throw std::invalid_argument("DeviceMetal::softmax() result must have GPU memory.");
+
+    std::vector<MTL::Buffer*> bufInputs;
+    for (const auto& input : inputs)
+    {
+        bufInputs.emplace_back(getReadOnlyMTLBuffer(input.data, input.size, dataTypeSize(input.dtype)));
+    }
+    auto bufDst = deviceBuffer(result.data);
+    auto compFuncPSO = computePSO(m_compFuncPSOSoftmax, "softmax_", static_cast<size_t>(result.dtype));
+    SoftmaxParams params{ .outer=shape.outer, .reduce=shape.reduce, .inner=shape.inner,
+                          .op=static_cast<uint32_t>(op) };
+
+    // The threadgroup size follows the reduce kernel.
+    size_t maxThreadsPerTG = std::min<size_t>(MAX_THREADS_PER_THREADGROUP, compFuncPSO->maxTotalThreadsPerThreadgroup());
+    size_t tgWidth  = std::min<size_t>(shape.inner, 32);
+    size_t tgHeight = 1;
+    while (tgHeight < shape.reduce && tgWidth * tgHeight * 2 <= maxThreadsPerTG)
+    {
+        tgHeight *= 2;
+    }
+
+    // Serialize resources and states to be used by the GPU. Unused input slots are bound to the last input.
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    for (size_t i = 0; i < 3; ++i)
+    {
+        stream().compEncoder->setBuffer(bufInputs[std::min(i, bufInputs.size() - 1)], 0, i);
+    }
+    stream().compEncoder->setBuffer(bufDst, 0, 3);
+    stream().compEncoder->setBytes(&params, sizeof(params), 4);
+
+    // Each threadgroup computes a block of lines of one outer row.
+    stream().compEncoder->dispatchThreadgroups({(shape.inner + tgWidth - 1) / tgWidth, shape.outer, 1},
+                                        {tgWidth, tgHeight, 1});
+
+    // Free operation is delayed until the commit is done.
+    for (auto buffer : bufInputs)
+    {
+        freeTemporaryBuffer(buffer);
+    }
+    commitBatchQueue();
 }
 
 void DeviceMetal::argmaxIndicesTo(const DeviceTensorParams& src, const DeviceTensorParams& dst, size_t dim)
 {
+    profiler::OpScope scope("argmaxIndicesTo", {&src, &dst});
     assert(src.isContiguous == dst.isContiguous == true);
     validateDataType(src.dtype);
     synchronize();
-    Device::argmaxIndicesTo(src, dst, dim);
+    auto hostSrc = hostParams(src);
+    auto hostDst = hostParams(dst);
+    Device::argmaxIndicesTo(hostSrc, hostDst, dim);
+    releaseHostParams(src, hostSrc, false);
+    releaseHostParams(dst, hostDst, true);
 }
 
 void DeviceMetal::sliceSet(const DeviceTensorParams& src, const DeviceTensorParams& dst,
                            size_t dim, size_t start, size_t end, size_t step)
 {
+    profiler::OpScope scope("sliceSet", {&src, &dst});
     assert(src.isContiguous == dst.isContiguous == true);
     validateDataType(src.dtype);
     // Result buffer has to be allocated in advance and has to be a GPU memory.
@@ -682,42 +1071,37 @@ void DeviceMetal::sliceSet(const DeviceTensorParams& src, const DeviceTensorPara
 
     // NOTE: For a scalar tensor shape size could be zero.
     auto bufSrc     = getReadOnlyMTLBuffer(src.data, src.size, dataTypeSize(src.dtype));
-    auto bufShape1  = shapeSize    != 0 ? getReadOnlyMTLBuffer(dst.shape.data(),   shapeSize,    sizeof(size_t)) : nullptr;
-    auto bufShape2  = newShapeSize != 0 ? getReadOnlyMTLBuffer(newShape.data(),    newShapeSize, sizeof(size_t)) : nullptr;
-    auto bufStrides = stridesSize  != 0 ? getReadOnlyMTLBuffer(dst.strides.data(), stridesSize,  sizeof(size_t)) : nullptr;
-    auto bufDst     = m_allocMap[dst.data];
-    auto compFuncPSO = m_compFuncPSOSliceSet[static_cast<size_t>(src.dtype)];
+    auto bufDst     = deviceBuffer(dst.data);
+    auto compFuncPSO = computePSO(m_compFuncPSOSliceSet, "sliceSet_", static_cast<size_t>(src.dtype));
 
     // Serialize resources and states to be used by the GPU.
-    m_compEncoder->setComputePipelineState(compFuncPSO);
-    m_compEncoder->setBuffer(bufSrc,     0, 0);
-    m_compEncoder->setBuffer(bufDst,     0, 1);
-    m_compEncoder->setBuffer(bufShape1,  0, 2);
-    m_compEncoder->setBuffer(bufShape2,  0, 3);
-    m_compEncoder->setBuffer(bufStrides, 0, 4);
-    m_compEncoder->setBytes(&shapeSize,    sizeof(shapeSize),    5);
-    m_compEncoder->setBytes(&newShapeSize, sizeof(newShapeSize), 6);
-    m_compEncoder->setBytes(&stridesSize,  sizeof(stridesSize),  7);
-    m_compEncoder->setBytes(&dim,   sizeof(dim),   8);
-    m_compEncoder->setBytes(&start, sizeof(start), 9);
-    m_compEncoder->setBytes(&step,  sizeof(step),  10);
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    stream().compEncoder->setBuffer(bufSrc,     0, 0);
+    stream().compEncoder->setBuffer(bufDst,     0, 1);
+    setArrayBytes(dst.shape, 2);
+    setArrayBytes(newShape, 3);
+    setArrayBytes(dst.strides, 4);
+    stream().compEncoder->setBytes(&shapeSize,    sizeof(shapeSize),    5);
+    stream().compEncoder->setBytes(&newShapeSize, sizeof(newShapeSize), 6);
+    stream().compEncoder->setBytes(&stridesSize,  sizeof(stridesSize),  7);
+    stream().compEncoder->setBytes(&dim,   sizeof(dim),   8);
+    stream().compEncoder->setBytes(&start, sizeof(start), 9);
+    stream().compEncoder->setBytes(&step,  sizeof(step),  10);
 
     // Calculate maximum thread group dimensions
     NS::UInteger w = std::min(src.size, compFuncPSO->maxTotalThreadsPerThreadgroup());
 
     // Use dispatch threads which is the most efficient but requires non-uniform grid size feature support in HW.
-    m_compEncoder->dispatchThreads({src.size, 1, 1}, {w, 1, 1});
+    stream().compEncoder->dispatchThreads({src.size, 1, 1}, {w, 1, 1});
 
     // Free operation is delayed until the commit is done.
     freeTemporaryBuffer(bufSrc);
-    freeTemporaryBuffer(bufShape1);
-    freeTemporaryBuffer(bufShape2);
-    freeTemporaryBuffer(bufStrides);
     commitBatchQueue();
 }
 
 void DeviceMetal::tril(const DeviceTensorParams& dst, ssize_t diagonal)
 {
+    profiler::OpScope scope("tril", {&dst});
     assert(dst.isContiguous == true);
     validateDataType(dst.dtype);
     // Result buffer has to be allocated in advance and has to be a GPU memory.
@@ -729,35 +1113,30 @@ void DeviceMetal::tril(const DeviceTensorParams& dst, ssize_t diagonal)
     assert(dst.size > 0);
 
     // NOTE: For a scalar tensor shape size could be zero.
-    auto bufShape   = shapeSize    != 0 ? getReadOnlyMTLBuffer(dst.shape.data(),    shapeSize,    sizeof(size_t)) : nullptr;
-    auto bufStrides = stridesSize  != 0 ? getReadOnlyMTLBuffer(dst.strides.data(),  stridesSize,  sizeof(size_t)) : nullptr;
-    auto bufDst     = m_allocMap[dst.data];
-    auto compFuncPSO = m_compFuncPSOTril[static_cast<size_t>(dst.dtype)];
+    auto bufDst     = deviceBuffer(dst.data);
+    auto compFuncPSO = computePSO(m_compFuncPSOTril, "tril_", static_cast<size_t>(dst.dtype));
 
     // Serialize resources and states to be used by the GPU.
-    m_compEncoder->setComputePipelineState(compFuncPSO);
-    m_compEncoder->setBuffer(bufDst,     0, 1);
-    m_compEncoder->setBuffer(bufShape,   0, 2);
-    m_compEncoder->setBuffer(bufStrides, 0, 3);
-    m_compEncoder->setBytes(&shapeSize,    sizeof(shapeSize),    4);
-    m_compEncoder->setBytes(&stridesSize,  sizeof(stridesSize),  5);
-    m_compEncoder->setBytes(&diagonal,     sizeof(diagonal),     6);
-    m_compEncoder->setBytes(&dst.size,     sizeof(dst.size),     7);
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    stream().compEncoder->setBuffer(bufDst,     0, 1);
+    setArrayBytes(dst.shape, 2);
+    setArrayBytes(dst.strides, 3);
+    stream().compEncoder->setBytes(&shapeSize,    sizeof(shapeSize),    4);
+    stream().compEncoder->setBytes(&stridesSize,  sizeof(stridesSize),  5);
+    stream().compEncoder->setBytes(&diagonal,     sizeof(diagonal),     6);
+    stream().compEncoder->setBytes(&dst.size,     sizeof(dst.size),     7);
 
     // Calculate maximum thread group dimensions
     NS::UInteger w = std::min(dst.size, compFuncPSO->maxTotalThreadsPerThreadgroup());
 
     // Use dispatch threads which is the most efficient but requires non-uniform grid size feature support in HW.
-    m_compEncoder->dispatchThreads({dst.size, 1, 1}, {w, 1, 1});
-
-    // Free operation is delayed until the commit is done.
-    freeTemporaryBuffer(bufShape);
-    freeTemporaryBuffer(bufStrides);
+    stream().compEncoder->dispatchThreads({dst.size, 1, 1}, {w, 1, 1});
     commitBatchQueue();
 }
 
 void DeviceMetal::triu(const DeviceTensorParams& dst, ssize_t diagonal)
 {
+    profiler::OpScope scope("triu", {&dst});
     assert(dst.isContiguous == true);
     validateDataType(dst.dtype);
     // Result buffer has to be allocated in advance and has to be a GPU memory.
@@ -769,36 +1148,31 @@ void DeviceMetal::triu(const DeviceTensorParams& dst, ssize_t diagonal)
     assert(dst.size > 0);
 
     // NOTE: For a scalar tensor shape size could be zero.
-    auto bufShape   = shapeSize    != 0 ? getReadOnlyMTLBuffer(dst.shape.data(),    shapeSize,    sizeof(size_t)) : nullptr;
-    auto bufStrides = stridesSize  != 0 ? getReadOnlyMTLBuffer(dst.strides.data(),  stridesSize,  sizeof(size_t)) : nullptr;
-    auto bufDst     = m_allocMap[dst.data];
-    auto compFuncPSO = m_compFuncPSOTriu[static_cast<size_t>(dst.dtype)];
+    auto bufDst     = deviceBuffer(dst.data);
+    auto compFuncPSO = computePSO(m_compFuncPSOTriu, "triu_", static_cast<size_t>(dst.dtype));
 
     // Serialize resources and states to be used by the GPU.
-    m_compEncoder->setComputePipelineState(compFuncPSO);
-    m_compEncoder->setBuffer(bufDst,     0, 1);
-    m_compEncoder->setBuffer(bufShape,   0, 2);
-    m_compEncoder->setBuffer(bufStrides, 0, 3);
-    m_compEncoder->setBytes(&shapeSize,    sizeof(shapeSize),    4);
-    m_compEncoder->setBytes(&stridesSize,  sizeof(stridesSize),  5);
-    m_compEncoder->setBytes(&diagonal,     sizeof(diagonal),     6);
-    m_compEncoder->setBytes(&dst.size,     sizeof(dst.size),     7);
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    stream().compEncoder->setBuffer(bufDst,     0, 1);
+    setArrayBytes(dst.shape, 2);
+    setArrayBytes(dst.strides, 3);
+    stream().compEncoder->setBytes(&shapeSize,    sizeof(shapeSize),    4);
+    stream().compEncoder->setBytes(&stridesSize,  sizeof(stridesSize),  5);
+    stream().compEncoder->setBytes(&diagonal,     sizeof(diagonal),     6);
+    stream().compEncoder->setBytes(&dst.size,     sizeof(dst.size),     7);
 
     // Calculate maximum thread group dimensions
     NS::UInteger w = std::min(dst.size, compFuncPSO->maxTotalThreadsPerThreadgroup());
 
     // Use dispatch threads which is the most efficient but requires non-uniform grid size feature support in HW.
-    m_compEncoder->dispatchThreads({dst.size, 1, 1}, {w, 1, 1});
-
-    // Free operation is delayed until the commit is done.
-    freeTemporaryBuffer(bufShape);
-    freeTemporaryBuffer(bufStrides);
+    stream().compEncoder->dispatchThreads({dst.size, 1, 1}, {w, 1, 1});
     commitBatchQueue();
 }
 
 void DeviceMetal::indexSelect(const DeviceTensorParams& src, const DeviceTensorParams& dst,
                               const DeviceTensorParams& indices, size_t dim)
 {
+    profiler::OpScope scope("indexSelect", {&src, &indices, &dst});
     assert(src.isContiguous == dst.isContiguous == true);
     validateDataType(src.dtype);
     // Result buffer has to be allocated in advance and has to be a GPU memory.
@@ -815,21 +1189,21 @@ void DeviceMetal::indexSelect(const DeviceTensorParams& src, const DeviceTensorP
 
     auto bufSrc      = getReadOnlyMTLBuffer(src.data, src.size, dataTypeSize(src.dtype));
     auto bufIndices  = getReadOnlyMTLBuffer(indices.data, indices.size, dataTypeSize(aix::DataType::kInt32));
-    auto bufDst      = m_allocMap[dst.data];
-    auto compFuncPSO = m_compFuncPSOIndexSelect[static_cast<size_t>(src.dtype)];
+    auto bufDst      = deviceBuffer(dst.data);
+    auto compFuncPSO = computePSO(m_compFuncPSOIndexSelect, "indexSelect_", static_cast<size_t>(src.dtype));
 
     // Serialize resources and states to be used by the GPU.
-    m_compEncoder->setComputePipelineState(compFuncPSO);
-    m_compEncoder->setBuffer(bufSrc,     0, 0);
-    m_compEncoder->setBuffer(bufDst,     0, 1);
-    m_compEncoder->setBuffer(bufIndices, 0, 2);
-    m_compEncoder->setBytes(&indices.size, sizeof(size_t), 3);
-    m_compEncoder->setBytes(&dimSize,      sizeof(size_t), 4);
-    m_compEncoder->setBytes(&sliceSize,    sizeof(size_t), 5);
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    stream().compEncoder->setBuffer(bufSrc,     0, 0);
+    stream().compEncoder->setBuffer(bufDst,     0, 1);
+    stream().compEncoder->setBuffer(bufIndices, 0, 2);
+    stream().compEncoder->setBytes(&indices.size, sizeof(size_t), 3);
+    stream().compEncoder->setBytes(&dimSize,      sizeof(size_t), 4);
+    stream().compEncoder->setBytes(&sliceSize,    sizeof(size_t), 5);
 
     NS::UInteger w = std::min(dst.size, compFuncPSO->maxTotalThreadsPerThreadgroup());
 
-    m_compEncoder->dispatchThreads({dst.size, 1, 1}, {w, 1, 1});
+    stream().compEncoder->dispatchThreads({dst.size, 1, 1}, {w, 1, 1});
 
     commitBatchQueue();
 }
@@ -837,13 +1211,22 @@ void DeviceMetal::indexSelect(const DeviceTensorParams& src, const DeviceTensorP
 void DeviceMetal::indexAdd(const DeviceTensorParams& src, const DeviceTensorParams& dst, const DeviceTensorParams& indices,
                            size_t dim)
 {
+    profiler::OpScope scope("indexAdd", {&src, &indices, &dst});
     assert(src.isContiguous == dst.isContiguous == indices.isContiguous == true);
     validateDataType(src.dtype);
-    // NOTE: Only certain data types are supported due to limitation of Metal Framework atomics.
-    if (!(src.dtype == DataType::kFloat32 || src.dtype == DataType::kInt32))
+    // NOTE: Only certain data types are supported due to limitation of Metal Framework atomics. The 16-bit floats are
+    //       added by compare-and-swap loops on 32-bit words.
+    if (!(src.dtype == DataType::kFloat32 || src.dtype == DataType::kInt32 ||
+          src.dtype == DataType::kFloat16 || src.dtype == DataType::kBFloat16))
     {
         synchronize();
-        Device::indexAdd(src, dst, indices, dim);
+        auto hostSrc = hostParams(src);
+        auto hostDst = hostParams(dst);
+        auto hostIndices = hostParams(indices);
+        Device::indexAdd(hostSrc, hostDst, hostIndices, dim);
+        releaseHostParams(src, hostSrc, false);
+        releaseHostParams(dst, hostDst, true);
+        releaseHostParams(indices, hostIndices, false);
         return;
     }
 
@@ -862,119 +1245,365 @@ void DeviceMetal::indexAdd(const DeviceTensorParams& src, const DeviceTensorPara
 
     auto bufSrc      = getReadOnlyMTLBuffer(src.data, srcBufSize, dataTypeSize(src.dtype));
     auto bufIndices  = getReadOnlyMTLBuffer(indices.data, indices.size, dataTypeSize(aix::DataType::kInt32));
-    auto bufDst      = m_allocMap[dst.data];
-    auto compFuncPSO = m_compFuncPSOIndexAdd[static_cast<size_t>(src.dtype)];
+    auto bufDst      = deviceBuffer(dst.data);
+    auto compFuncPSO = computePSO(m_compFuncPSOIndexAdd, "indexAdd_", static_cast<size_t>(src.dtype));
 
     // Serialize resources and states to be used by the GPU.
-    m_compEncoder->setComputePipelineState(compFuncPSO);
-    m_compEncoder->setBuffer(bufSrc,     0, 0);
-    m_compEncoder->setBuffer(bufDst,     0, 1);
-    m_compEncoder->setBuffer(bufIndices, 0, 2);
-    m_compEncoder->setBytes(&indices.size, sizeof(size_t), 3);
-    m_compEncoder->setBytes(&dimSize,      sizeof(size_t), 4);
-    m_compEncoder->setBytes(&sliceSize,    sizeof(size_t), 5);
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    stream().compEncoder->setBuffer(bufSrc,     0, 0);
+    stream().compEncoder->setBuffer(bufDst,     0, 1);
+    stream().compEncoder->setBuffer(bufIndices, 0, 2);
+    stream().compEncoder->setBytes(&indices.size, sizeof(size_t), 3);
+    stream().compEncoder->setBytes(&dimSize,      sizeof(size_t), 4);
+    stream().compEncoder->setBytes(&sliceSize,    sizeof(size_t), 5);
 
     NS::UInteger w = std::min(src.size, compFuncPSO->maxTotalThreadsPerThreadgroup());
 
-    m_compEncoder->dispatchThreads({src.size, 1, 1}, {w, 1, 1});
+    stream().compEncoder->dispatchThreads({src.size, 1, 1}, {w, 1, 1});
 
     commitBatchQueue();
 }
 
+void DeviceMetal::fusedElementwise(const FusedProgram& program, const std::vector<DeviceTensorParams>& inputs,
+                                   const DeviceTensorParams& result)
+{
+    profiler::OpScope scope("fusedElementwise", inputs, result);
+    validateDataType(result.dtype);
+    // Result buffer has to be allocated in advance and has to be a GPU memory.
+    if (!isDeviceBuffer(result.data))
+        throw std::invalid_argument("DeviceMetal::fusedElementwise() result must have GPU memory.");
+
+    // Each distinct program is compiled once and its pipeline state is cached.
+    auto source = fusedKernelSource(program, inputs.size(), result.dtype);
+    MTL::ComputePipelineState* compFuncPSO = nullptr;
+    {
+        std::lock_guard  lock(m_psoMutex);
+        auto it = m_compFuncPSOFused.find(source);
+        if (it == m_compFuncPSOFused.end())
+        {
+            auto library = createLibrary(source.c_str());
+            it = m_compFuncPSOFused.emplace(source, createComputeFuncPSO(library, "fusedElementwise")).first;
+            library->release();
+        }
+        compFuncPSO = it->second;
+    }
+
+    // Memory could be a GPU allocated memory or system memory.
+    std::vector<MTL::Buffer*> bufInputs;
+    for (const auto& input : inputs)
+    {
+        bufInputs.emplace_back(getReadOnlyMTLBuffer(input.data, input.size, dataTypeSize(input.dtype)));
+    }
+    auto bufResult = deviceBuffer(result.data);
+
+    // Serialize resources and states to be used by the GPU.
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    for (size_t i=0; i<bufInputs.size(); ++i)
+    {
+        stream().compEncoder->setBuffer(bufInputs[i], 0, i);
+    }
+    stream().compEncoder->setBuffer(bufResult,   0,                   bufInputs.size());
+    stream().compEncoder->setBytes(&result.size, sizeof(result.size), bufInputs.size() + 1);
+
+    // Use dispatch threads which is the most efficient but requires non-uniform grid size feature support in HW.
+    NS::UInteger w = std::min(result.size, compFuncPSO->maxTotalThreadsPerThreadgroup());
+    stream().compEncoder->dispatchThreads({result.size, 1, 1}, {w, 1, 1});
+
+    // Free operation is delayed until the commit is done.
+    for (auto bufInput : bufInputs)
+    {
+        freeTemporaryBuffer(bufInput);
+    }
+    commitBatchQueue();
+}
+
+void DeviceMetal::optimizerStep(const OptimizerStepParams& step, const std::vector<OptimizerTensorParams>& tensors)
+{
+    profiler::OpScope scope("optimizerStep", {});
+    if (std::all_of(tensors.begin(), tensors.end(), [](const auto& tensor) { return tensor.grad.size == 0; })) return;
+    auto dtype = tensors.front().param.dtype;
+    validateDataType(dtype);
+    // Integer parameters and mixed data types are updated by the CPU.
+    bool isSupported = dtype == DataType::kFloat32 || dtype == DataType::kFloat16 || dtype == DataType::kBFloat16;
+    for (const auto& tensor : tensors)
+    {
+        isSupported &= tensor.param.dtype == dtype;
+    }
+    if (!isSupported)
+    {
+        synchronize();
+        // The moments and the master weights are updated in place as well.
+        auto hostTensors = tensors;
+        for (auto& tensor : hostTensors)
+        {
+            for (auto param : { &tensor.param, &tensor.grad, &tensor.master, &tensor.m, &tensor.v, &tensor.indices })
+            {
+                *param = hostParams(*param);
+            }
+        }
+        Device::optimizerStep(step, hostTensors);
+        for (size_t i=0; i<tensors.size(); ++i)
+        {
+            releaseHostParams(tensors[i].param,  hostTensors[i].param,  true);
+            releaseHostParams(tensors[i].grad,   hostTensors[i].grad,   false);
+            releaseHostParams(tensors[i].master, hostTensors[i].master, true);
+            releaseHostParams(tensors[i].m,      hostTensors[i].m,      true);
+            releaseHostParams(tensors[i].v,      hostTensors[i].v,      true);
+            releaseHostParams(tensors[i].indices, hostTensors[i].indices, false);
+        }
+        return;
+    }
+
+    // Must match the OptimizerTensor structure of the shader.
+    struct OptimizerTensor
+    {
+        uint64_t  param{0};
+        uint64_t  grad{0};
+        uint64_t  master{0};
+        uint64_t  m{0};
+        uint64_t  v{0};
+        uint64_t  indices{0};
+        uint64_t  rowSize{0};
+        uint64_t  begin{0};
+        uint64_t  size{0};
+    };
+
+    // The updated tensors have to be GPU memory. The gradients could be in system memory.
+    auto updatedBuffer = [&](const DeviceTensorParams& params) -> MTL::Buffer*
+    {
+        if (!params.data) return nullptr;
+        if (!isDeviceBuffer(params.data))
+            throw std::invalid_argument("DeviceMetal::optimizerStep() parameters and states must have GPU memory.");
+        return deviceBuffer(params.data);
+    };
+    auto gpuAddress = [](const MTL::Buffer* buffer, const DeviceTensorParams& params) -> uint64_t
+    {
+        return buffer ? buffer->gpuAddress() + params.offset * dataTypeSize(params.dtype) : 0;
+    };
+
+    std::vector<OptimizerTensor> descriptors;
+    std::vector<MTL::Buffer*> bufGrads;     // The read-only gradients and indices.
+    size_t totalSize = 0;
+    for (const auto& tensor : tensors)
+    {
+        auto bufParam  = updatedBuffer(tensor.param);
+        auto bufMaster = updatedBuffer(tensor.master);
+        auto bufM      = updatedBuffer(tensor.m);
+        auto bufV      = updatedBuffer(tensor.v);
+        auto bufGrad   = getReadOnlyMTLBuffer(tensor.grad.data, tensor.grad.offset + tensor.grad.size,
+                                              dataTypeSize(tensor.grad.dtype));
+        bufGrads.emplace_back(bufGrad);
+        MTL::Buffer* bufIndices = nullptr;
+        if (tensor.indices.data)
+        {
+            bufIndices = getReadOnlyMTLBuffer(tensor.indices.data, tensor.indices.offset + tensor.indices.size,
+                                              dataTypeSize(tensor.indices.dtype));
+            bufGrads.emplace_back(bufIndices);
+            stream().compEncoder->useResource(bufIndices, MTL::ResourceUsageRead);
+        }
+
+        // The kernel reaches the buffers through their GPU addresses, so they have to be declared as resources.
+        for (auto buffer : { bufParam, bufMaster, bufM, bufV })
+        {
+            if (buffer) stream().compEncoder->useResource(buffer, MTL::ResourceUsageRead | MTL::ResourceUsageWrite);
+        }
+        stream().compEncoder->useResource(bufGrad, MTL::ResourceUsageRead);
+
+        descriptors.push_back({ .param=gpuAddress(bufParam, tensor.param), .grad=gpuAddress(bufGrad, tensor.grad),
+                                .master=gpuAddress(bufMaster, tensor.master), .m=gpuAddress(bufM, tensor.m),
+                                .v=gpuAddress(bufV, tensor.v), .indices=gpuAddress(bufIndices, tensor.indices),
+                                .rowSize=bufIndices ? tensor.param.size / tensor.param.shape[0] : 0,
+                                .begin=totalSize, .size=tensor.grad.size });
+        totalSize += tensor.grad.size;
+    }
+
+    // The descriptor table could exceed the size limit of setBytes().
+    auto bufDescriptors = newBuffer(descriptors.size() * sizeof(OptimizerTensor));
+    std::memcpy(bufDescriptors->contents(), descriptors.data(), descriptors.size() * sizeof(OptimizerTensor));
+    size_t tensorCount = descriptors.size();
+    auto compFuncPSO = computePSO(m_compFuncPSOOptimizerStep, "optimizerStep_", static_cast<size_t>(dtype));
+
+    // Serialize resources and states to be used by the GPU.
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    stream().compEncoder->setBuffer(bufDescriptors, 0, 0);
+    stream().compEncoder->setBytes(&tensorCount, sizeof(tensorCount), 1);
+    stream().compEncoder->setBytes(&step, sizeof(step), 2);
+
+    // A single dispatch updates the elements of all parameters.
+    NS::UInteger w = std::min(totalSize, compFuncPSO->maxTotalThreadsPerThreadgroup());
+    stream().compEncoder->dispatchThreads({totalSize, 1, 1}, {w, 1, 1});
+
+    // Free operation is delayed until the commit is done.
+    freeTemporaryBuffer(bufDescriptors);
+    for (auto bufGrad : bufGrads)
+    {
+        freeTemporaryBuffer(bufGrad);
+    }
+    commitBatchQueue();
+}
+
 void DeviceMetal::emptyCache()
 {
     m_bufferCache->clear();
+    m_privateBufferCache->clear();
     m_allocator->clearEmptyHeaps();
 }
 
-void DeviceMetal::commit()
+void DeviceMetal::commit(CommandStream& stream)
 {
-    if (m_currentBatchSize == 0) return;
+    if (stream.currentBatchSize == 0) return;
 
-    if (m_committedCmdBuffer)
+    // The CPU continues to encode the next batch while the committed ones execute, up to the in-flight limit.
+    waitForCommandBuffers(stream, m_maxCmdBuffersInFlight);
     {
-        m_committedCmdBuffer->waitUntilCompleted();
+        std::lock_guard<std::mutex>  lock(stream.inFlightMutex);
+        ++stream.cmdBuffersInFlight;
     }
-    m_compEncoder->endEncoding();
-    m_cmdBuffer->addCompletedHandler([&,tempBuffers=m_tempBuffers](MTL::CommandBuffer* commandBuffer)
+
+    stream.compEncoder->endEncoding();
+    bool isProfiling = profiler::isEnabled();
+    stream.cmdBuffer->addCompletedHandler([this,streamPtr=&stream,tempBuffers=stream.tempBuffers,isProfiling,
+                                           commandCount=stream.currentBatchSize](MTL::CommandBuffer* commandBuffer)
     {
-        CheckCommandBufferStatus(commandBuffer);
+        if (isProfiling)
+        {
+            profiler::recordGPUEvent("commandBuffer", commandBuffer->GPUStartTime(), commandBuffer->GPUEndTime(),
+                                     commandCount);
+        }
         // We must recycle the buffers only after the current command buffer execution is completed since the buffers
         // could be in use.
         for (const auto& [buf, bufPtr] : tempBuffers)
         {
-            m_bufferCache->recycle(buf);
+            auto& bufferCache = buf->storageMode() == MTL::StorageModePrivate ? m_privateBufferCache : m_bufferCache;
+            bufferCache->recycle(buf);
         }
+        {
+            std::lock_guard<std::mutex>  lock(streamPtr->inFlightMutex);
+            --streamPtr->cmdBuffersInFlight;
+        }
+        streamPtr->inFlightCV.notify_all();
+        CheckCommandBufferStatus(commandBuffer);
     });
-    m_cmdBuffer->commit();                // Execute the command
+    stream.cmdBuffer->commit();           // Execute the command
 
     // No need to track the allocations anymore for the buffer used in the last commit.
-    for (const auto& [buf, bufPtr] : m_tempBuffers)
+    std::unique_lock  lock(m_allocMutex);
+    for (const auto& [buf, bufPtr] : stream.tempBuffers)
     {
         m_allocMap.erase(bufPtr);
+        // The reserved address of a private buffer can be reused once the buffer is not tracked anymore.
+        auto it = m_privateAddressMap.find(bufPtr);
+        if (it != m_privateAddressMap.end())
+        {
+            ::munmap(bufPtr, it->second);
+            m_privateAddressMap.erase(it);
+        }
     }
+    lock.unlock();
 
-    // Reduce the size of the MTL buffer cache if the cache size is bigger than the max allowed working set size.
-    if (m_bufferCache->size() > m_maxWorkingSetSize)
+    // Reduce the size of the MTL buffer caches if the cache size is bigger than the max allowed working set size.
+    for (const auto& bufferCache : { m_bufferCache.get(), m_privateBufferCache.get() })
     {
-        m_bufferCache->reduceSize(m_bufferCache->size() - m_maxWorkingSetSize);
+        if (bufferCache->size() > m_maxWorkingSetSize)
+        {
+            bufferCache->reduceSize(bufferCache->size() - m_maxWorkingSetSize);
+        }
     }
 
-    m_tempBuffers.clear();
-    m_tempBuffers.reserve(MAX_CMD_BATCH_SIZE);
+    stream.tempBuffers.clear();
+    stream.tempBuffers.reserve(MAX_CMD_BATCH_SIZE);
 
-    m_committedCmdBuffer = m_cmdBuffer;
     // Create a new command buffer for the next batch.
-    m_cmdBuffer = m_cmdQueue->commandBuffer();
-    m_compEncoder = m_cmdBuffer->computeCommandEncoder();
+    stream.cmdBuffer = m_cmdQueue->commandBuffer();
+    stream.compEncoder = stream.cmdBuffer->computeCommandEncoder();
 
     // Update batch size metrics.
-    m_maxBatchSize = std::max(m_currentBatchSize, m_maxBatchSize);
-    m_currentBatchSize = 0;
-    m_currentWorkingSetSize = 0;
+    stream.maxBatchSize = std::max(stream.currentBatchSize, stream.maxBatchSize);
+    stream.currentBatchSize = 0;
+    stream.currentWorkingSetSize = 0;
 }
 
 void DeviceMetal::synchronize()
 {
-    commit();
-    m_committedCmdBuffer->waitUntilCompleted();
+    profiler::OpScope scope("synchronize", {});
+    auto& currentStream = stream();
+    commit(currentStream);
+    waitForCommandBuffers(currentStream, 1);      // Full barrier: wait for all committed command buffers.
+    releaseHostBuffers(currentStream);
+}
+
+DeviceMetal::CommandStream& DeviceMetal::stream() const
+{
+    // The thread keeps the stream of the device that it used last. Device ids are never reused, so the stream of a
+    // destroyed device is never returned.
+    thread_local size_t cachedDeviceId = 0;
+    thread_local CommandStream* cachedStream = nullptr;
+    if (cachedDeviceId == m_id) return *cachedStream;
+
+    std::lock_guard<std::mutex>  lock(m_streamsMutex);
+    auto& stream = m_streams[std::this_thread::get_id()];
+    if (!stream)
+    {
+        stream = std::make_unique<CommandStream>();
+        stream->cmdBuffer = m_cmdQueue->commandBuffer();
+        stream->compEncoder = stream->cmdBuffer->computeCommandEncoder();
+    }
+    cachedDeviceId = m_id;
+    cachedStream = stream.get();
+    return *stream;
+}
+
+void DeviceMetal::maxCommandBuffersInFlight(size_t count)
+{
+    m_maxCmdBuffersInFlight = std::max<size_t>(count, 1);
+}
+
+void DeviceMetal::waitForCommandBuffers(CommandStream& stream, size_t limit)
+{
+    std::unique_lock<std::mutex>  lock(stream.inFlightMutex);
+    stream.inFlightCV.wait(lock, [&stream, limit] { return stream.cmdBuffersInFlight < limit; });
 }
 
 void DeviceMetal::commitBatchQueue()
 {
-    if (++m_currentBatchSize >= MAX_CMD_BATCH_SIZE)
+    auto& currentStream = stream();
+    if (++currentStream.currentBatchSize >= MAX_CMD_BATCH_SIZE)
     {
-        commit();
+        commit(currentStream);
     }
 }
 
-MTL::Buffer* DeviceMetal::newBuffer(size_t size)
+MTL::Buffer* DeviceMetal::newBuffer(size_t size, bool isPrivate)
 {
     assert(size > 0);
     size_t asize = size < vm_page_size ? align(size, ALLOCATION_BYTE_ALIGNMENT_SIZE) : align(size, vm_page_size);
 
-    m_currentWorkingSetSize += asize;
+    auto& currentStream = stream();
+    currentStream.currentWorkingSetSize += asize;
     // Reduce memory footprint if the current working set size exceeds the limit.
-    if (m_currentWorkingSetSize * 2 >= m_maxWorkingSetSize)
+    if (currentStream.currentWorkingSetSize * 2 >= m_maxWorkingSetSize)
     {
-        commit();
+        commit(currentStream);
     }
 
     // Try to reuse a buffer from the MTL buffer cache if possible.
-    auto buffer = m_bufferCache->reuse(asize);
+    auto& bufferCache = isPrivate ? m_privateBufferCache : m_bufferCache;
+    auto buffer = bufferCache->reuse(asize);
     if (buffer)
     {
         return buffer;
     }
 
     // Allocate MTL buffer.
-    buffer = m_allocator->alloc(asize);
+    auto storageMode = isPrivate ? MTL::StorageModePrivate : MTL::StorageModeShared;
+    buffer = m_allocator->alloc(asize, storageMode);
     if (!buffer)
     {
         m_bufferCache->clear();
+        m_privateBufferCache->clear();
         std::cout << "Buffer's cache was cleared to create memory. "
                      "Consider increasing memory size to improve performance." << std::endl;
-        buffer = m_allocator->alloc(asize);
+        buffer = m_allocator->alloc(asize, storageMode);
         if (!buffer)
         {
             // Release empty heaps to satisfy the allocation request if possible.
@@ -995,26 +1624,116 @@ MTL::Buffer* DeviceMetal::newBuffer(size_t size)
 MTL::Buffer* DeviceMetal::getReadOnlyMTLBuffer(const void * address, size_t size, size_t sizeofType, size_t alignSize)
 {
     // Memory could be from other devices. Create a temporary buffer for read only case.
-    if (!isDeviceBuffer(address))
+    auto deviceBuf = deviceBuffer(address);
+    if (!deviceBuf)
     {
         auto asize = align(size, alignSize);
+        // Page-aligned host memory is read in place if zero-copy is enabled.
+        if (m_zeroCopyHostMemory)
+        {
+            auto hostBuf = getHostMTLBuffer(address, asize * sizeofType);
+            if (hostBuf) return hostBuf;
+        }
         auto buff = newBuffer(asize * sizeofType);
         std::memcpy(buff->contents(), address, size * sizeofType);
         return buff;
     }
 
-    return m_allocMap[address];    // Return MTL Buffer if the memory is from the current device.
+    return deviceBuf;    // Return MTL Buffer if the memory is from the current device.
+}
+
+
+MTL::Buffer* DeviceMetal::getHostMTLBuffer(const void * address, size_t byteSize)
+{
+    // Small arrays are cheaper to copy than to wrap.
+    if (reinterpret_cast<uintptr_t>(address) % vm_page_size != 0 || byteSize < vm_page_size) return nullptr;
+
+    auto length = align(byteSize, vm_page_size);
+    auto& hostBufferMap = stream().hostBufferMap;
+    auto it = hostBufferMap.find(address);
+    if (it != hostBufferMap.end())
+    {
+        // The wrapper could be in use by the queued commands. It can be reused only if it covers the memory.
+        return it->second->length() >= length ? it->second : nullptr;
+    }
+    if (hostBufferMap.size() >= MAX_HOST_BUFFER_CACHE_SIZE) return nullptr;
+
+    auto buffer = m_mtlDevice->newBuffer(const_cast<void*>(address), length, MTL::ResourceStorageModeShared, nullptr);
+    if (buffer)
+    {
+        hostBufferMap[address] = buffer;
+    }
+    return buffer;
+}
+
+
+DeviceTensorParams DeviceMetal::hostParams(const DeviceTensorParams& params)
+{
+    if (!isPrivateBuffer(params.data)) return params;
+    auto privateBuf = deviceBuffer(params.data);
+    auto hostParams = params;
+    hostParams.data = allocate(privateBuf->length());
+    blitCopy(privateBuf, deviceBuffer(hostParams.data));
+    return hostParams;
+}
+
+
+void DeviceMetal::releaseHostParams(const DeviceTensorParams& params, const DeviceTensorParams& hostParams,
+                                    bool isWritten)
+{
+    if (hostParams.data == params.data) return;
+    if (isWritten)
+    {
+        blitCopy(deviceBuffer(hostParams.data), deviceBuffer(params.data));
+    }
+    deallocate(hostParams.data);
+}
+
+
+void DeviceMetal::blitCopy(MTL::Buffer* src, MTL::Buffer* dst)
+{
+    // Uses a separate command buffer since the compute encoder of the batch is open.
+    auto cmdBuffer = m_cmdQueue->commandBuffer();
+    auto blitEncoder = cmdBuffer->blitCommandEncoder();
+    blitEncoder->copyFromBuffer(src, 0, dst, 0, std::min(src->length(), dst->length()));
+    blitEncoder->endEncoding();
+    cmdBuffer->commit();
+    cmdBuffer->waitUntilCompleted();
+    CheckCommandBufferStatus(cmdBuffer);
+}
+
+
+void DeviceMetal::releaseHostBuffers(CommandStream& stream)
+{
+    // The host memory could be released after synchronization, so the wrappers must not outlive it.
+    for (const auto& [address, buffer] : stream.hostBufferMap)
+    {
+        buffer->release();
+    }
+    stream.hostBufferMap.clear();
+}
+
+
+void DeviceMetal::setArrayBytes(const Stride& values, size_t index)
+{
+    // Small arrays such as shapes and strides are copied into the command buffer instead of a temporary buffer.
+    if (values.empty())
+        stream().compEncoder->setBuffer(nullptr, 0, index);
+    else
+        stream().compEncoder->setBytes(values.data(), values.size() * sizeof(size_t), index);
 }
 
 
 void DeviceMetal::freeTemporaryBuffer(MTL::Buffer * buffer)
 {
-    // Release only temporary buffer.
-    if (buffer && !isDeviceBuffer(buffer->contents()))
+    // Release only temporary buffer. Host memory wrappers are released by synchronize(). Temporary buffers are never
+    // private, and private device buffers have no contents.
+    if (buffer && buffer->storageMode() != MTL::StorageModePrivate && !isDeviceBuffer(buffer->contents()) &&
+        !isHostBuffer(buffer))
     {
         // Add the buffer to the list to be released when commit() is executed.
         // Until then, the buffer could be in use, especially when a batch command is used.
-        m_tempBuffers.emplace_back(buffer, buffer->contents());
+        stream().tempBuffers.emplace_back(buffer, buffer->contents());
     }
 }
 
@@ -1055,6 +1774,40 @@ MTL::Library* DeviceMetal::createLibrary(const char* shaders)
     return defaultLibrary;
 }
 
+MTL::Library* DeviceMetal::createDefaultLibrary()
+{
+    // The metallib that is compiled at build time saves compiling the shader source in every process. The AIX_METALLIB
+    // environment variable overrides its path.
+    std::string path;
+    if (auto envPath = std::getenv("AIX_METALLIB"))
+    {
+        path = envPath;
+    }
+#ifdef AIX_METALLIB_PATH
+    if (path.empty())
+    {
+        path = AIX_METALLIB_PATH;
+    }
+#endif
+
+    if (!path.empty() && std::filesystem::exists(path))
+    {
+        NS::Error* error = nullptr;
+        if (auto library = m_mtlDevice->newLibrary(fileURL(path), &error))
+        {
+            return library;
+        }
+        std::cerr << "WARNING: Failed to load the metallib, the shader source is compiled instead. Details: "
+                  << error->localizedDescription()->utf8String() << "\n";
+    }
+    return createLibrary(shaders::aixDeviceMetalShaders);
+}
+
+NS::URL* DeviceMetal::fileURL(const std::string & filename)
+{
+    return NS::URL::fileURLWithPath(NS::String::string(filename.c_str(), NS::UTF8StringEncoding));
+}
+
 MTL::CommandQueue* DeviceMetal::createCommandQueue()
 {
     auto cmdQueue = m_mtlDevice->newCommandQueue();
@@ -1078,25 +1831,168 @@ MTL::ComputePipelineState* DeviceMetal::createComputeFuncPSO(MTL::Library* libra
     }
 
     NS::Error* error = nullptr;
-    auto compFuncPSO = m_mtlDevice->newComputePipelineState(compFunc, &error);
+    MTL::ComputePipelineState* compFuncPSO = nullptr;
+    if (m_binaryArchive)
+    {
+        // The archive provides the compiled pipeline state if a previous process added it. Otherwise, it is compiled
+        // and added to the archive.
+        auto descriptor = MTL::ComputePipelineDescriptor::alloc()->init();
+        descriptor->setComputeFunction(compFunc);
+        descriptor->setBinaryArchives(NS::Array::array(m_binaryArchive));
+        compFuncPSO = m_mtlDevice->newComputePipelineState(descriptor, MTL::PipelineOptionNone, nullptr, &error);
+        if (compFuncPSO && !m_binaryArchive->addComputePipelineFunctions(descriptor, &error))
+        {
+            std::cerr << "WARNING: Failed to add the pipeline state to the archive.\n";
+        }
+        descriptor->release();
+    }
+    else
+    {
+        compFuncPSO = m_mtlDevice->newComputePipelineState(compFunc, &error);
+    }
+
     if (!compFuncPSO)
     {
         std::cerr << "Failed to create the pipeline state object.\n";
         exit(-1);
     }
+    compFunc->release();
+
+    return compFuncPSO;
+}
+
+MTL::ComputePipelineState* DeviceMetal::computePSO(MTL::ComputePipelineState* (& compFuncPSOs)[aix::DataTypeCount],
+                                                   const char* kernelName, size_t dtype)
+{
+    std::lock_guard  lock(m_psoMutex);
+    auto & compFuncPSO = compFuncPSOs[dtype];
+    if (!compFuncPSO)
+    {
+        // Metal Framework does not support kFloat64 format.
+        bool isNull = static_cast<DataType>(dtype) == DataType::kFloat64;
+        compFuncPSO = createComputeFuncPSO(m_library, isNull ? "nullKernel" : kernelName + toString(dtype));
+    }
+    return compFuncPSO;
+}
 
+MTL::ComputePipelineState* DeviceMetal::computePSO(MTL::ComputePipelineState* (& compFuncPSOs)[aix::DataTypeCount]
+                                                                                               [aix::DataTypeCount],
+                                                   const char* kernelName, size_t srcDType, size_t dstDType)
+{
+    std::lock_guard  lock(m_psoMutex);
+    auto & compFuncPSO = compFuncPSOs[srcDType][dstDType];
+    if (!compFuncPSO)
+    {
+        // Metal Framework does not support kFloat64 format.
+        bool isNull = static_cast<DataType>(srcDType) == DataType::kFloat64 ||
+                      static_cast<DataType>(dstDType) == DataType::kFloat64;
+        auto name = isNull ? "nullKernel" : kernelName + toString(srcDType) + "_" + toString(dstDType);
+        compFuncPSO = createComputeFuncPSO(m_library, name);
+    }
     return compFuncPSO;
 }
 
+void DeviceMetal::pipelineArchive(const std::string & filename)
+{
+    if (m_binaryArchive)
+    {
+        throw std::invalid_argument("DeviceMetal::pipelineArchive() - The pipeline archive is already set.");
+    }
+
+    // A missing or an incompatible archive file is replaced with a new archive.
+    NS::Error* error = nullptr;
+    auto descriptor = MTL::BinaryArchiveDescriptor::alloc()->init();
+    if (std::filesystem::exists(filename))
+    {
+        descriptor->setUrl(fileURL(filename));
+        m_binaryArchive = m_mtlDevice->newBinaryArchive(descriptor, &error);
+    }
+    if (!m_binaryArchive)
+    {
+        descriptor->setUrl(nullptr);
+        m_binaryArchive = m_mtlDevice->newBinaryArchive(descriptor, &error);
+    }
+    descriptor->release();
+
+    if (!m_binaryArchive)
+    {
+        throw std::runtime_error("DeviceMetal::pipelineArchive() - Failed to create the pipeline archive.");
+    }
+    m_binaryArchiveFilename = filename;
+}
+
+DeviceMetal::TuningKey DeviceMetal::tuningKey(TunedOp op, DataType dtype, size_t m, size_t n, size_t k,
+                                              size_t alignment)
+{
+    // Dimensions are bucketed by the next power of two. The alignment decides which kernels can run.
+    return { static_cast<size_t>(op), static_cast<size_t>(dtype), std::bit_ceil(m), std::bit_ceil(n), std::bit_ceil(k),
+             alignment };
+}
+
+DeviceMetal::TunedKernel DeviceMetal::tunedKernel(const TuningKey & key, const std::vector<TunedKernel> & candidates)
+{
+    auto entry = m_tuningTable.find(key);
+    auto kernel = static_cast<TunedKernel>(entry.value_or(0));
+    if (entry && std::find(candidates.begin(), candidates.end(), kernel) != candidates.end())
+    {
+        return kernel;
+    }
+    return candidates.back();
+}
+
+DeviceMetal::TunedKernel DeviceMetal::tuneKernel(const TuningKey & key, const std::vector<TunedKernel> & candidates,
+                                                 const std::function<void(MTL::ComputeCommandEncoder*, TunedKernel)> &
+                                                 encode)
+{
+    auto bestKernel = candidates.back();
+    double bestTime = std::numeric_limits<double>::max();
+    for (auto candidate : candidates)
+    {
+        // Each run executes in its own command buffer. The first run warms up the pipeline state and the caches.
+        double time = std::numeric_limits<double>::max();
+        for (size_t run=0; run<=AUTOTUNE_RUN_COUNT; ++run)
+        {
+            auto cmdBuffer = m_cmdQueue->commandBuffer();
+            auto encoder = cmdBuffer->computeCommandEncoder();
+            encode(encoder, candidate);
+            encoder->endEncoding();
+            cmdBuffer->commit();
+            cmdBuffer->waitUntilCompleted();
+            CheckCommandBufferStatus(cmdBuffer);
+            if (run > 0)
+            {
+                time = std::min(time, cmdBuffer->GPUEndTime() - cmdBuffer->GPUStartTime());
+            }
+        }
+        if (time < bestTime)
+        {
+            bestTime = time;
+            bestKernel = candidate;
+        }
+    }
+    m_tuningTable.set(key, static_cast<uint32_t>(bestKernel));
+    return bestKernel;
+}
+
+void DeviceMetal::saveTuningTable(const std::string & filename) const
+{
+    m_tuningTable.save(filename);
+}
+
+void DeviceMetal::loadTuningTable(const std::string & filename)
+{
+    m_tuningTable.load(filename);
+}
+
 void DeviceMetal::encodeComputeCommandDoubleBuffer(const MTL::Buffer* buf, MTL::Buffer* bufResult,
                                                    const MTL::ComputePipelineState* compFuncPSO, const MTL::Size& gridSize,
                                                    const MTL::Size& threadsPerTG) const
 {
     // Encode the pipeline state object and its parameters.
-    m_compEncoder->setComputePipelineState(compFuncPSO);
-    m_compEncoder->setBuffer(buf, 0, 0);
-    m_compEncoder->setBuffer(bufResult, 0, 1);
-    m_compEncoder->dispatchThreads(gridSize, threadsPerTG);
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    stream().compEncoder->setBuffer(buf, 0, 0);
+    stream().compEncoder->setBuffer(bufResult, 0, 1);
+    stream().compEncoder->dispatchThreads(gridSize, threadsPerTG);
 }
 
 void DeviceMetal::encodeComputeCommandTripleBuffer(const MTL::Buffer* buf1, const MTL::Buffer* buf2, MTL::Buffer* bufResult,
@@ -1104,11 +2000,11 @@ void DeviceMetal::encodeComputeCommandTripleBuffer(const MTL::Buffer* buf1, cons
                                                    const MTL::Size& threadsPerTG) const
 {
     // Encode the pipeline state object and its parameters.
-    m_compEncoder->setComputePipelineState(compFuncPSO);
-    m_compEncoder->setBuffer(buf1, 0, 0);
-    m_compEncoder->setBuffer(buf2, 0, 1);
-    m_compEncoder->setBuffer(bufResult, 0, 2);
-    m_compEncoder->dispatchThreads(gridSize, threadsPerTG);
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    stream().compEncoder->setBuffer(buf1, 0, 0);
+    stream().compEncoder->setBuffer(buf2, 0, 1);
+    stream().compEncoder->setBuffer(bufResult, 0, 2);
+    stream().compEncoder->dispatchThreads(gridSize, threadsPerTG);
 }
 
 void DeviceMetal::executeDoubleArrayCmd(const DeviceTensorParams& a, const DeviceTensorParams& result,
@@ -1122,7 +2018,7 @@ void DeviceMetal::executeDoubleArrayCmd(const DeviceTensorParams& a, const Devic
 
     // Memory could be a GPU allocated memory or system memory.
     auto buf = getReadOnlyMTLBuffer(a.data, a.size, dataTypeSize(a.dtype));
-    auto bufResult = m_allocMap[result.data];
+    auto bufResult = deviceBuffer(result.data);
 
     // Calculate maximum thread group dimensions
     auto asize = align(a.size, TOTAL_COMPONENT_COUNT) / TOTAL_COMPONENT_COUNT;
@@ -1148,7 +2044,7 @@ void DeviceMetal::executeTripleArrayCmd(const DeviceTensorParams& a1, const Devi
     // Memory could be a GPU allocated memory or system memory.
     auto buf1 = getReadOnlyMTLBuffer(a1.data, a1.size, dataTypeSize(a1.dtype));
     auto buf2 = getReadOnlyMTLBuffer(a2.data, a2.size, dataTypeSize(a2.dtype));
-    auto bufResult = m_allocMap[result.data];
+    auto bufResult = deviceBuffer(result.data);
 
     // Calculate maximum thread group dimensions
     auto asize = align(a1.size, TOTAL_COMPONENT_COUNT) / TOTAL_COMPONENT_COUNT;
@@ -1162,54 +2058,61 @@ void DeviceMetal::executeTripleArrayCmd(const DeviceTensorParams& a1, const Devi
     commitBatchQueue();
 }
 
-void DeviceMetal::translation(const void* src, void* dst, size_t size, const Shape& shape, const Shape& newShape,
-                              const MTL::ComputePipelineState* computePSO, DataType dtype, const std::string & name)
+void DeviceMetal::executeStridedCmd(StridedOp op, const DeviceTensorParams& a1, const DeviceTensorParams* a2,
+                                    const DeviceTensorParams& result, const std::string & cmdName)
 {
-    validateDataType(dtype);
+    assert(result.isContiguous == true);
+    validateDataType(result.dtype);
     // Result buffer has to be allocated in advance and has to be a GPU memory.
-    if (!isDeviceBuffer(dst))
-        throw std::invalid_argument("DeviceMetal::" + name + "() result must have GPU memory.");
-
-    // For a special case, two scalar tensors, use just a copy operation.
-    if (shape.empty() && newShape.empty())
-    {
-        copy(src, dtype, dst, dtype, size);
-        return;
-    }
-
-    size_t shapeSize    = shape.size();
-    size_t newShapeSize = newShape.size();
-    size_t srcBufSize   = std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<>());
-    assert(srcBufSize > 0);
+    if (!isDeviceBuffer(result.data))
+        throw std::invalid_argument("DeviceMetal::" + cmdName + "() result must have GPU memory.");
 
-    // NOTE: For a scalar tensor shape size could be zero.
-    auto bufSrc    = getReadOnlyMTLBuffer(src, srcBufSize, dataTypeSize(dtype));
-    auto bufShape1 = shapeSize    != 0 ? getReadOnlyMTLBuffer(shape.data(),    shapeSize,    sizeof(size_t)) : nullptr;
-    auto bufShape2 = newShapeSize != 0 ? getReadOnlyMTLBuffer(newShape.data(), newShapeSize, sizeof(size_t)) : nullptr;
-    auto bufDst    = m_allocMap[dst];
+    // Memory could be a GPU allocated memory or system memory. A view is smaller than its storage when broadcasted.
+    auto buf1 = getReadOnlyMTLBuffer(a1.data, storageSize(a1), dataTypeSize(a1.dtype));
+    auto buf2 = a2 ? getReadOnlyMTLBuffer(a2->data, storageSize(*a2), dataTypeSize(a2->dtype)) : buf1;
+    auto bufResult = deviceBuffer(result.data);
+    auto compFuncPSO = computePSO(m_compFuncPSOStrided, "strided_", static_cast<size_t>(result.dtype));
+    const auto& b = a2 ? *a2 : a1;
+    size_t shapeSize = result.shape.size();
+    auto opCode = static_cast<uint32_t>(op);
 
     // Serialize resources and states to be used by the GPU.
-    m_compEncoder->setComputePipelineState(computePSO);
-    m_compEncoder->setBuffer(bufSrc,    0, 0);
-    m_compEncoder->setBuffer(bufDst,    0, 1);
-    m_compEncoder->setBuffer(bufShape1, 0, 2);
-    m_compEncoder->setBuffer(bufShape2, 0, 3);
-    m_compEncoder->setBytes(&shapeSize,    sizeof(shapeSize),    4);
-    m_compEncoder->setBytes(&newShapeSize, sizeof(newShapeSize), 5);
+    stream().compEncoder->setComputePipelineState(compFuncPSO);
+    stream().compEncoder->setBuffer(buf1,      0, 0);
+    stream().compEncoder->setBuffer(buf2,      0, 1);
+    stream().compEncoder->setBuffer(bufResult, 0, 2);
+    setArrayBytes(result.shape, 3);
+    setArrayBytes(a1.strides, 4);
+    setArrayBytes(b.strides, 5);
+    stream().compEncoder->setBytes(&shapeSize, sizeof(shapeSize), 6);
+    stream().compEncoder->setBytes(&a1.offset, sizeof(a1.offset), 7);
+    stream().compEncoder->setBytes(&b.offset,  sizeof(b.offset),  8);
+    stream().compEncoder->setBytes(&opCode,    sizeof(opCode),    9);
 
     // Calculate maximum thread group dimensions
-    NS::UInteger w = std::min(size, computePSO->maxTotalThreadsPerThreadgroup());
+    NS::UInteger w = std::min(result.size, compFuncPSO->maxTotalThreadsPerThreadgroup());
 
     // Use dispatch threads which is the most efficient but requires non-uniform grid size feature support in HW.
-    m_compEncoder->dispatchThreads({size, 1, 1}, {w, 1, 1});
+    stream().compEncoder->dispatchThreads({result.size, 1, 1}, {w, 1, 1});
 
     // Free operation is delayed until the commit is done.
-    freeTemporaryBuffer(bufSrc);
-    freeTemporaryBuffer(bufShape1);
-    freeTemporaryBuffer(bufShape2);
+    freeTemporaryBuffer(buf1);
+    if (a2) freeTemporaryBuffer(buf2);
     commitBatchQueue();
 }
 
+size_t DeviceMetal::storageSize(const DeviceTensorParams& params)
+{
+    if (params.isContiguous || params.size == 0) return params.offset + params.size;
+
+    size_t lastIndex = params.offset;
+    for (size_t i = 0; i < params.shape.size(); ++i)
+    {
+        lastIndex += (params.shape[i] - 1) * params.strides[i];
+    }
+    return lastIndex + 1;
+}
+
 void DeviceMetal::transpose2D(const DeviceTensorParams& mat, const DeviceTensorParams& result)
 {
     assert(mat.isContiguous == result.isContiguous == true);
@@ -1219,52 +2122,133 @@ void DeviceMetal::transpose2D(const DeviceTensorParams& mat, const DeviceTensorP
     if (!isDeviceBuffer(result.data))
         throw std::invalid_argument("DeviceMetal::transpose2D() result must have GPU memory.");
 
-    // Memory could be a GPU allocated memory or system memory.
-    auto buf1 = getReadOnlyMTLBuffer(mat.data, mat.shape[0] * mat.shape[1], dataTypeSize(mat.dtype));
-    auto bufResult = m_allocMap[result.data];
     auto buf1Size = MatrixSize{mat.shape[0], mat.shape[1]};
-    auto compFuncPSO = m_compFuncPSOTranspose2D[iDType];
-
     size_t M = buf1Size.rows;
     size_t N = buf1Size.cols;
 
-    auto encodeParams = [&](const MTL::ComputePipelineState* compFuncPSO)
+    // The tiled kernels require dimensions that are multiples of their tile sizes.
+    size_t alignment = M % 32 == 0 && N % 32 == 0 ? 32 : M % 16 == 0 && N % 16 == 0 ? 16 : 1;
+    std::vector<TunedKernel> candidates{TunedKernel::kTranspose2D};
+    if (alignment >= 16) candidates.emplace_back(TunedKernel::kTranspose2DTiled16x16x8);
+    if (alignment >= 32) candidates.emplace_back(TunedKernel::kTranspose2DTiled32x32x8);
+
+    // Tuning runs the kernels on the input, so the commands that compute the input must complete first.
+    auto key = tuningKey(TunedOp::kTranspose2D, result.dtype, M, N, 1, alignment);
+    bool isTuning = m_autotune && candidates.size() > 1 && !isTuned(key);
+    if (isTuning)
     {
-        m_compEncoder->setComputePipelineState(compFuncPSO);
-        m_compEncoder->setBuffer(buf1, 0, 0);
-        m_compEncoder->setBuffer(bufResult, 0, 1);
-        m_compEncoder->setBytes(&buf1Size, sizeof(MatrixSize), 2);
+        synchronize();
+    }
+
+    // Memory could be a GPU allocated memory or system memory.
+    auto buf1 = getReadOnlyMTLBuffer(mat.data, mat.shape[0] * mat.shape[1], dataTypeSize(mat.dtype));
+    auto bufResult = deviceBuffer(result.data);
+
+    auto encodeParams = [&](MTL::ComputeCommandEncoder* encoder, const MTL::ComputePipelineState* compFuncPSO)
+    {
+        encoder->setComputePipelineState(compFuncPSO);
+        encoder->setBuffer(buf1, 0, 0);
+        encoder->setBuffer(bufResult, 0, 1);
+        encoder->setBytes(&buf1Size, sizeof(MatrixSize), 2);
     };
 
-    auto dispatchTiled = [&](const MTL::ComputePipelineState* compFuncPSO, const size_t tileSize, const size_t batchSize)
+    auto dispatchTiled = [&](MTL::ComputeCommandEncoder* encoder, const MTL::ComputePipelineState* compFuncPSO,
+                             const size_t tileSize, const size_t batchSize)
     {
         // Encode the pipeline state object and its parameters.
         uint numThreadgroupsX = (N + tileSize - 1) / tileSize;
         uint numThreadgroupsY = (M + tileSize - 1) / tileSize;
         assert(tileSize * batchSize <= compFuncPSO->maxTotalThreadsPerThreadgroup());
-        encodeParams(compFuncPSO);
-        m_compEncoder->dispatchThreadgroups({numThreadgroupsX, numThreadgroupsY, 1}, {tileSize, batchSize, 1});
+        encodeParams(encoder, compFuncPSO);
+        encoder->dispatchThreadgroups({numThreadgroupsX, numThreadgroupsY, 1}, {tileSize, batchSize, 1});
     };
 
-    if (M % 32 == 0 && N % 32 == 0)
+    auto encode = [&](MTL::ComputeCommandEncoder* encoder, TunedKernel kernel)
     {
-        dispatchTiled(m_compFuncPSOTranspose2DTiled32x32x8[iDType], 32, 8);
-    }
-    else if (M % 16 == 0 && N % 16 == 0)
+        switch (kernel)
+        {
+            case TunedKernel::kTranspose2DTiled32x32x8:
+                dispatchTiled(encoder, computePSO(m_compFuncPSOTranspose2DTiled32x32x8, "transpose2DTiled_32_32_8_",
+                                                  iDType), 32, 8);
+                break;
+            case TunedKernel::kTranspose2DTiled16x16x8:
+                dispatchTiled(encoder, computePSO(m_compFuncPSOTranspose2DTiled16x16x8, "transpose2DTiled_16_16_8_",
+                                                  iDType), 16, 8);
+                break;
+            default:
+            {
+                auto compFuncPSO = computePSO(m_compFuncPSOTranspose2D, "transpose2D_", iDType);
+                NS::UInteger w = compFuncPSO->threadExecutionWidth();
+                NS::UInteger h = compFuncPSO->maxTotalThreadsPerThreadgroup() / w;
+                encodeParams(encoder, compFuncPSO);
+                encoder->dispatchThreads({mat.shape[0], mat.shape[1], 1}, {w, h, 1});
+                break;
+            }
+        }
+    };
+
+    // Without tuning, the kernel with the largest tiles that fit the dimensions is used.
+    encode(stream().compEncoder, isTuning ? tuneKernel(key, candidates, encode) : tunedKernel(key, candidates));
+
+    // Free operation is delayed until the commit is done.
+    freeTemporaryBuffer(buf1);
+    commitBatchQueue();
+}
+
+std::string DeviceMetal::fusedKernelSource(const FusedProgram& program, size_t inputCount, DataType dtype)
+{
+    static const std::string typeNames[aix::DataTypeCount] =
     {
-        dispatchTiled(m_compFuncPSOTranspose2DTiled16x16x8[iDType], 16, 8);
+        "double", "float", "half", "bfloat", "long", "int", "short", "char", "uchar",
+    };
+    const auto& typeName = typeNames[static_cast<size_t>(dtype)];
+
+    std::string source = "#include <metal_stdlib>\nusing namespace metal;\n\n[[kernel]] void fusedElementwise(";
+    for (size_t i=0; i<inputCount; ++i)
+    {
+        source += "const device " + typeName + "* input" + std::to_string(i) + " [[buffer(" + std::to_string(i) + ")]], ";
     }
-    else
+    source += "device " + typeName + "* result [[buffer(" + std::to_string(inputCount) + ")]], ";
+    source += "constant size_t& size [[buffer(" + std::to_string(inputCount + 1) + ")]], ";
+    source += "uint index [[thread_position_in_grid]])\n{\n    if (index >= size) return;\n";
+
+    // Intermediate results are computed in float32.
+    for (size_t i=0; i<program.size(); ++i)
     {
-        NS::UInteger w = compFuncPSO->threadExecutionWidth();
-        NS::UInteger h = compFuncPSO->maxTotalThreadsPerThreadgroup() / w;
-        encodeParams(compFuncPSO);
-        m_compEncoder->dispatchThreads({mat.shape[0], mat.shape[1], 1}, {w, h, 1});
+        const auto& instruction = program[i];
+        auto x = "r" + std::to_string(instruction.operand1);
+        auto y = "r" + std::to_string(instruction.operand2);
+        std::string expression;
+        switch (instruction.opCode)
+        {
+            case FusedOpCode::kInput:
+                expression = "static_cast<float>(input" + std::to_string(instruction.operand1) + "[index])";
+                break;
+            case FusedOpCode::kConstant:
+            {
+                // The bit pattern keeps the constant exact.
+                uint32_t bits;
+                std::memcpy(&bits, &instruction.constant, sizeof(bits));
+                expression = "as_type<float>(" + std::to_string(bits) + "u)";
+                break;
+            }
+            case FusedOpCode::kAdd:  expression = x + " + " + y;       break;
+            case FusedOpCode::kSub:  expression = x + " - " + y;       break;
+            case FusedOpCode::kMul:  expression = x + " * " + y;       break;
+            case FusedOpCode::kDiv:  expression = x + " / " + y;       break;
+            case FusedOpCode::kNeg:  expression = "-" + x;             break;
+            case FusedOpCode::kSqrt: expression = "sqrt(" + x + ")";   break;
+            case FusedOpCode::kSin:  expression = "sin(" + x + ")";    break;
+            case FusedOpCode::kCos:  expression = "cos(" + x + ")";    break;
+            case FusedOpCode::kTanh: expression = "tanh(" + x + ")";   break;
+            case FusedOpCode::kLog:  expression = "log(" + x + ")";    break;
+            case FusedOpCode::kExp:  expression = "exp(" + x + ")";    break;
+        }
+        source += "    float r" + std::to_string(i) + " = " + expression + ";\n";
     }
 
-    // Free operation is delayed until the commit is done.
-    freeTemporaryBuffer(buf1);
-    commitBatchQueue();
+    source += "    result[index] = static_cast<" + typeName + ">(r" + std::to_string(program.size() - 1) + ");\n}\n";
+    return source;
 }
 
 const std::string& DeviceMetal::toString(size_t dtypeIndex)
@@ -12,20 +12,29 @@
 
 // Project includes
 #include "aix.hpp"
+#include "aixDeviceMetalTuning.hpp"
 // External includes
 // System includes
 #include <mach/vm_page_size.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
 
 
 // Forward declarations
 namespace NS
 {
     class AutoreleasePool;
+    class URL;
 }
 
 // Forward declarations
 namespace MTL
 {
+    class BinaryArchive;
     class Buffer;
     class ComputePipelineState;
     class CommandQueue;
@@ -41,6 +50,10 @@ namespace aix::metal
 
 #define ALLOCATOR_ALIGNMENT_SIZE            256
 #define MAX_CMD_BATCH_SIZE                  1000
+#define MAX_CMD_BUFFERS_IN_FLIGHT           2       // Number of committed command buffers the CPU can run ahead.
+#define MAX_HOST_BUFFER_CACHE_SIZE          64      // Number of host memory wrappers kept until synchronize().
+#define AUTOTUNE_RUN_COUNT                  3       // Timed runs of each candidate kernel after a warm-up run.
+#define QUANTIZED_MATMUL_SIMDGROUPS         4       // Outputs that a threadgroup of the quantized matmul computes.
 #define MAX_THREADS_PER_THREADGROUP         1024
 #define ALLOCATION_BYTE_ALIGNMENT_SIZE      32      // Should be power of two and min 32 bytes.
 #define VECTOR_TYPE_COMPONENT_COUNT         4       // i.e. float4 has 4 components.
@@ -50,6 +63,11 @@ namespace aix::metal
 class MetalAllocator;
 class MTLBufferCache;
 
+// Each thread encodes its operations into its own command stream, so that threads can run operations on one device
+// concurrently, such as inference requests on a shared model. The streams share the device memory, the buffer caches
+// and the pipeline states. A thread synchronizes only its own commands, and the tensors that its queued commands use
+// must stay alive until it synchronizes. The commands of different threads are not ordered, so a thread synchronizes
+// before other threads use its results, such as the parameters of a loaded model.
 class DeviceMetal : public aix::Device
 {
 public:
@@ -70,6 +88,18 @@ public:
     // Deallocate GPU memory if it's allocated by current device.
     void deallocate(void * memory) override;
 
+    // Wraps page-aligned host memory in an MTL Buffer without copying.
+    void* mapHostMemory(void * memory, size_t size) override;
+
+    void unmapHostMemory(void * memory) override;
+
+    // Allocates GPU private memory if private storage is enabled. The host cannot read private memory, so it is
+    // identified by a reserved virtual address instead of the MTL Buffer contents.
+    void* allocatePrivate(size_t size, DataType dtype) override;
+
+    // Copies private memory to shared memory after the queued commands complete, and releases the private memory.
+    void* makeHostAccessible(void * memory, size_t size) override;
+
     void add(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result) override;
 
     void sub(const DeviceTensorParams& a1, const DeviceTensorParams& a2, const DeviceTensorParams& result) override;
@@ -108,6 +138,16 @@ public:
 
     void matmul(const DeviceTensorParams& a, const DeviceTensorParams& b, const DeviceTensorParams& result) override;
 
+    void matmulTransposed(const DeviceTensorParams& a, bool transposeA, const DeviceTensorParams& b,
+                          bool transposeB, const DeviceTensorParams& result) override;
+
+    void matmulQuantized(const DeviceTensorParams& a, const DeviceTensorParams& w, const QuantizedLayout& layout,
+                         const DeviceTensorParams& result) override;
+
+    void linear(const DeviceTensorParams& a, const DeviceTensorParams& b, const DeviceTensorParams& bias,
+                Activation activation, const DeviceTensorParams& preActivation,
+                const DeviceTensorParams& result) override;
+
     void transpose(const DeviceTensorParams& a, const DeviceTensorParams& result, size_t dim0, size_t dim1) override;
 
     void copy(const void* src, DataType srcDType, void* dst, DataType dstDType, size_t size) override;
@@ -116,11 +156,11 @@ public:
 
     void contiguous(const DeviceTensorParams& src, const DeviceTensorParams& dst) override;
 
-    void reduceTo(const DeviceTensorParams& src, const DeviceTensorParams& dst) override;
+    void reduce(ReduceOp op, const DeviceTensorParams& src, const DeviceTensorParams& dst,
+                const ReduceShape& shape) override;
 
-    void maxTo(const DeviceTensorParams& src, const DeviceTensorParams& dst) override;
-
-    void argmaxTo(const DeviceTensorParams& src, const DeviceTensorParams& dst, size_t dim) override;
+    void softmax(SoftmaxOp op, const std::vector<DeviceTensorParams>& inputs, const DeviceTensorParams& result,
+                 const ReduceShape& shape) override;
 
     void argmaxIndicesTo(const DeviceTensorParams& src, const DeviceTensorParams& dst, size_t dim) override;
 
@@ -137,12 +177,89 @@ public:
     void indexAdd(const DeviceTensorParams& src, const DeviceTensorParams& dst, const DeviceTensorParams& indices,
                   size_t dim) override;
 
+    void fusedElementwise(const FusedProgram& program, const std::vector<DeviceTensorParams>& inputs,
+                          const DeviceTensorParams& result) override;
+
+    // Updates all parameters with one dispatch. The parameters, the master weights and the moments must be GPU memory.
+    void optimizerStep(const OptimizerStepParams& step, const std::vector<OptimizerTensorParams>& tensors) override;
+
     void emptyCache() override;
 
+    // Returns the usage of the GPU buffers, which the MTL buffer caches keep for reuse once they are released.
+    cpu::MemoryCacheStats memoryStats() override;
+
+    // Waits until the queued commands of the calling thread complete.
     void synchronize() override;
 
+    // Sets the maximum number of committed command buffers that can execute while the next batch is encoded.
+    // Only synchronize() waits for all of them. One command buffer in flight serializes the batches.
+    void maxCommandBuffersInFlight(size_t count);
+    size_t maxCommandBuffersInFlight() const        { return m_maxCmdBuffersInFlight; }
+
+    // Reads page-aligned host memory, such as CPU device tensors, in place instead of copying it. The device reads
+    // the memory asynchronously, so the host memory must stay valid and unchanged until synchronize() is called.
+    void zeroCopyHostMemory(bool enable)            { m_zeroCopyHostMemory = enable; }
+    bool zeroCopyHostMemory() const                 { return m_zeroCopyHostMemory; }
+
+    // Reads the compiled pipeline states from the archive file, if it exists, instead of compiling them. The pipeline
+    // states that the archive does not have are added, and the archive is saved when the device is destroyed. Must be
+    // called before the first operation to cover all pipeline states.
+    void pipelineArchive(const std::string & filename);
+
+    // Benchmarks the candidate matmul and transpose kernels the first time a shape bucket is seen, and dispatches the
+    // fastest kernel of the bucket afterwards. Tuning waits for the queued commands. The kernels in the tuning table
+    // are used even if autotuning is disabled.
+    void autotune(bool enable)                      { m_autotune = enable; }
+    bool autotune() const                           { return m_autotune; }
+
+    // Saves and loads the tuning table, so that later processes dispatch the tuned kernels without tuning.
+    void saveTuningTable(const std::string & filename) const;
+    void loadTuningTable(const std::string & filename);
+
+    // Keeps the results of operations in GPU private memory, which the GPU accesses without CPU cache coherency. A
+    // result moves to shared memory when the host accesses its data, which waits for the queued commands.
+    void privateStorage(bool enable)                { m_privateStorage = enable; }
+    bool privateStorage() const                     { return m_privateStorage; }
+
+    struct HeapStats
+    {
+        size_t sharedHeapCount{0};
+        size_t sharedHeapSize{0};           // Bytes.
+        size_t privateHeapCount{0};
+        size_t privateHeapSize{0};          // Bytes.
+        size_t cacheHitCount{0};            // Buffer requests that reused a cached buffer.
+        size_t cacheMissCount{0};
+        size_t stagingCount{0};             // Private buffers moved to shared memory for host access.
+        size_t stagedSize{0};               // Bytes.
+    };
+
+    // Returns the heap usage and the buffer cache statistics of the shared and the private memory.
+    HeapStats heapStats();
+
 protected:
-    void commit();
+    // The command buffer and the pending state of the operations of a thread.
+    struct CommandStream
+    {
+        MTL::CommandBuffer*          cmdBuffer{nullptr};
+        MTL::ComputeCommandEncoder*  compEncoder{nullptr};
+        std::vector<std::pair<MTL::Buffer*, void*>>    tempBuffers;
+        std::unordered_map<const void*, MTL::Buffer*>  hostBufferMap;   // See zeroCopyHostMemory().
+        size_t   currentBatchSize{0};
+        size_t   maxBatchSize{0};
+        size_t   currentWorkingSetSize{0};
+        size_t   cmdBuffersInFlight{0};         // Committed command buffers whose completed handlers did not run yet.
+        std::mutex               inFlightMutex;
+        std::condition_variable  inFlightCV;
+    };
+
+    // Returns the command stream of the calling thread, which is created at the first operation of the thread.
+    CommandStream& stream() const;
+
+    void commit()                                   { commit(stream()); }
+    void commit(CommandStream& stream);
+
+    // Blocks until fewer than the given number of committed command buffers of the stream are in flight.
+    void waitForCommandBuffers(CommandStream& stream, size_t limit);
     void commitBatchQueue();
 
     inline static void validateDataType(DataType dtype);
@@ -153,31 +270,123 @@ protected:
         size_t cols;
     };
 
+    struct MatrixBatchStrides
+    {
+        size_t a;
+        size_t b;
+        size_t result;
+    };
+
+    // Matches the epilogue parameters of the matrix multiplication kernel with boundary checks.
+    struct MatrixEpilogue
+    {
+        uint32_t activation;
+        uint32_t hasBias;
+        uint32_t hasPreActivation;
+    };
+
+    // Matches the parameters of the reduce kernel.
+    struct ReduceParams
+    {
+        size_t   outer;
+        size_t   reduce;
+        size_t   inner;
+        uint32_t op;
+    };
+
+    // Matches the parameters of the quantized matrix multiplication kernel.
+    struct QuantizedMatrixParams
+    {
+        uint32_t inputs;
+        uint32_t outputs;
+        uint32_t bits;
+        uint32_t groupSize;
+        uint32_t rowSize;
+        uint32_t valueOffset;
+    };
+
+    // Matches the parameters of the softmax kernel.
+    struct SoftmaxParams
+    {
+        size_t   outer;
+        size_t   reduce;
+        size_t   inner;
+        uint32_t op;
+    };
+
     static size_t align(size_t size, size_t alignment)
     {
         return (size + alignment - 1) & ~(alignment - 1);       // Padding for alignment.
     }
 
-    inline bool isDeviceBuffer(const void* bufPtr)
+    // Returns the MTL Buffer of the memory if it is allocated by the device. Otherwise, returns nullptr.
+    inline MTL::Buffer* deviceBuffer(const void* bufPtr)
     {
-        return m_allocMap.find(bufPtr) != m_allocMap.end();
+        std::shared_lock  lock(m_allocMutex);
+        auto it = m_allocMap.find(bufPtr);
+        return it != m_allocMap.end() ? it->second : nullptr;
     }
 
-    MTL::Buffer* newBuffer(size_t size);
+    inline bool isDeviceBuffer(const void* bufPtr)      { return deviceBuffer(bufPtr) != nullptr; }
+
+    inline bool isPrivateBuffer(const void* bufPtr)
+    {
+        std::shared_lock  lock(m_allocMutex);
+        return m_privateAddressMap.contains(bufPtr);
+    }
+
+    MTL::Buffer* newBuffer(size_t size, bool isPrivate = false);
+
+    // Adds a device allocation to the memory usage. The allocation mutex must be locked.
+    void trackAllocation(const MTL::Buffer* buffer);
+
+    // Host implementations of operations access private memory through temporary shared buffers. The device must be
+    // synchronized before, and written shared buffers are copied back to the private memory.
+    DeviceTensorParams hostParams(const DeviceTensorParams& params);
+    void releaseHostParams(const DeviceTensorParams& params, const DeviceTensorParams& hostParams, bool isWritten);
+
+    // Copies a buffer and waits for the copy. Private memory can only be copied by the GPU.
+    void blitCopy(MTL::Buffer* src, MTL::Buffer* dst);
 
     MTL::Buffer* getReadOnlyMTLBuffer(const void * address, size_t size, size_t sizeofType,
                                       size_t alignSize = TOTAL_COMPONENT_COUNT);
 
     void freeTemporaryBuffer(MTL::Buffer * buffer);
 
+    // Returns a no-copy MTL Buffer that wraps page-aligned host memory. Returns nullptr if the memory cannot be wrapped.
+    MTL::Buffer* getHostMTLBuffer(const void * address, size_t byteSize);
+
+    inline bool isHostBuffer(MTL::Buffer* buffer)
+    {
+        auto& hostBufferMap = stream().hostBufferMap;
+        auto it = hostBufferMap.find(buffer->contents());
+        return it != hostBufferMap.end() && it->second == buffer;
+    }
+
+    void releaseHostBuffers(CommandStream& stream);
+
+    void setArrayBytes(const Stride& values, size_t index);
+
     MTL::Device* createMTLDevice(size_t deviceIndex) const;
 
     MTL::Library* createLibrary(const char* shaders);
 
+    // Loads the precompiled metallib if it is available. Otherwise, compiles the shader source.
+    MTL::Library* createDefaultLibrary();
+
+    static NS::URL* fileURL(const std::string & filename);
+
     MTL::CommandQueue* createCommandQueue();
 
     MTL::ComputePipelineState* createComputeFuncPSO(MTL::Library* library, const std::string & kernelName);
 
+    // Returns the pipeline state of the kernel for the data types, which is created on first use.
+    MTL::ComputePipelineState* computePSO(MTL::ComputePipelineState* (& compFuncPSOs)[aix::DataTypeCount],
+                                          const char* kernelName, size_t dtype);
+    MTL::ComputePipelineState* computePSO(MTL::ComputePipelineState* (& compFuncPSOs)[aix::DataTypeCount]
+                                                                                      [aix::DataTypeCount],
+                                          const char* kernelName, size_t srcDType, size_t dstDType);
+
     void encodeComputeCommandDoubleBuffer(const MTL::Buffer* buf, MTL::Buffer* bufResult,
                                           const MTL::ComputePipelineState* compFuncPSO, const MTL::Size& gridSize,
                                           const MTL::Size& threadsPerTG) const;
@@ -193,12 +402,75 @@ protected:
                                const DeviceTensorParams& result, const MTL::ComputePipelineState* compFuncPSO,
                                const std::string & cmdName);
 
-    // Common method for broadcastTo and reduceTo methods.
-    void translation(const void* src, void* dst, size_t size, const Shape& shape, const Shape& newShape,
-                     const MTL::ComputePipelineState *computePSO, DataType dtype, const std::string & name);
+    // Operations and kernel variants that the autotuner selects between.
+    enum class TunedOp : uint32_t
+    {
+        kMatMul,
+        kTranspose2D,
+    };
+
+    enum class TunedKernel : uint32_t
+    {
+        kMatMulTiledBC6464888,
+        kMatMulTiled32x32,
+        kMatMulTiled32x64,
+        kMatMulTiled32x128,
+        kTranspose2D,
+        kTranspose2DTiled16x16x8,
+        kTranspose2DTiled32x32x8,
+        kCount,
+    };
+
+    using TuningKey = TuningTable::Key;
+
+    static TuningKey tuningKey(TunedOp op, DataType dtype, size_t m, size_t n, size_t k, size_t alignment);
+
+    bool isTuned(const TuningKey & key) const       { return m_tuningTable.contains(key); }
+
+    // Returns the kernel of the key in the tuning table. Otherwise, returns the last candidate.
+    TunedKernel tunedKernel(const TuningKey & key, const std::vector<TunedKernel> & candidates);
+
+    // Runs the candidates and records the fastest one in the tuning table. The inputs must be computed already.
+    TunedKernel tuneKernel(const TuningKey & key, const std::vector<TunedKernel> & candidates,
+                           const std::function<void(MTL::ComputeCommandEncoder*, TunedKernel)> & encode);
+
+    // Operation codes of the strided element-wise kernel.
+    enum class StridedOp : uint32_t
+    {
+        kAdd,
+        kSub,
+        kMul,
+        kDiv,
+        kPow,
+        kNeg,
+        kSqrt,
+        kSin,
+        kCos,
+        kTanh,
+        kLog,
+        kExp,
+    };
+
+    // Executes an element-wise operation whose inputs could be broadcast or transposed views. The second input is
+    // not used by unary operations.
+    void executeStridedCmd(StridedOp op, const DeviceTensorParams& a1, const DeviceTensorParams* a2,
+                           const DeviceTensorParams& result, const std::string & cmdName);
+
+    // Returns true if an element-wise input must be read by the strided kernel. The array kernels read contiguous
+    // tensors from the start of their storage.
+    inline static bool isStridedView(const DeviceTensorParams& params)
+    {
+        return !params.isContiguous || params.offset > 0;
+    }
+
+    // Returns the number of storage elements that a tensor view can reach.
+    static size_t storageSize(const DeviceTensorParams& params);
 
     void transpose2D(const DeviceTensorParams& mat, const DeviceTensorParams& result);
 
+    // Generates the Metal shader source of a fused element-wise program. The source is also the key of the cache.
+    static std::string fusedKernelSource(const FusedProgram& program, size_t inputCount, DataType dtype);
+
     static const std::string& toString(size_t dtype);
     inline static const std::string& toString(DataType dtype);
 
@@ -206,15 +478,16 @@ protected:
 
     NS::AutoreleasePool*   m_pool{nullptr};
     MTL::Device*           m_mtlDevice{nullptr};
-    MTL::CommandQueue*     m_cmdQueue{nullptr};
-    MTL::CommandBuffer*    m_cmdBuffer{nullptr};
-    MTL::CommandBuffer*    m_committedCmdBuffer{nullptr};
-    MTL::ComputeCommandEncoder*  m_compEncoder{nullptr};
+    MTL::CommandQueue*     m_cmdQueue{nullptr};          // Shared by the command streams.
+    MTL::Library*          m_library{nullptr};
+    MTL::BinaryArchive*    m_binaryArchive{nullptr};
+    std::string            m_binaryArchiveFilename;
     MTL::ComputePipelineState*   m_compFuncPSOAdd[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOSub[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOMul[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSODiv[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOUnary[aix::DataTypeCount]{nullptr};
+    MTL::ComputePipelineState*   m_compFuncPSOStrided[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOSqrt[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOSin[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOCos[aix::DataTypeCount]{nullptr};
@@ -225,6 +498,7 @@ protected:
     MTL::ComputePipelineState*   m_compFuncPSOSum[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOMax[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOMatMulTiledBC6464888[aix::DataTypeCount]{nullptr};
+    MTL::ComputePipelineState*   m_compFuncPSOMatMulQuantized[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOMatMulTiled32x32[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOMatMulTiled32x64[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOMatMulTiled32x128[aix::DataTypeCount]{nullptr};
@@ -232,25 +506,40 @@ protected:
     MTL::ComputePipelineState*   m_compFuncPSOTranspose2DTiled16x16x8[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOTranspose2DTiled32x32x8[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOTranspose[aix::DataTypeCount]{nullptr};
-    MTL::ComputePipelineState*   m_compFuncPSOCopyAA[aix::DataTypeCount][aix::DataTypeCount];
-    MTL::ComputePipelineState*   m_compFuncPSOFill[aix::DataTypeCount][aix::DataTypeCount];
+    MTL::ComputePipelineState*   m_compFuncPSOCopyAA[aix::DataTypeCount][aix::DataTypeCount]{};
+    MTL::ComputePipelineState*   m_compFuncPSOFill[aix::DataTypeCount][aix::DataTypeCount]{};
     MTL::ComputePipelineState*   m_compFuncPSOFillMin[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOContiguous[aix::DataTypeCount]{nullptr};
-    MTL::ComputePipelineState*   m_compFuncPSOReduceTo[aix::DataTypeCount]{nullptr};
-    MTL::ComputePipelineState*   m_compFuncPSOMaxTo[aix::DataTypeCount]{nullptr};
+    MTL::ComputePipelineState*   m_compFuncPSOReduce[aix::DataTypeCount]{nullptr};
+    MTL::ComputePipelineState*   m_compFuncPSOSoftmax[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOSliceSet[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOTril[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOTriu[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOIndexSelect[aix::DataTypeCount]{nullptr};
     MTL::ComputePipelineState*   m_compFuncPSOIndexAdd[aix::DataTypeCount]{nullptr};
-    std::vector<std::pair<MTL::Buffer*, void*>>    m_tempBuffers;
+    MTL::ComputePipelineState*   m_compFuncPSOOptimizerStep[aix::DataTypeCount]{nullptr};
+    std::unordered_map<std::string, MTL::ComputePipelineState*>  m_compFuncPSOFused;
+    std::mutex               m_psoMutex;        // Guards the pipeline states, which are created on first use.
+    TuningTable              m_tuningTable{static_cast<uint32_t>(TunedKernel::kCount)};
     std::unordered_map<const void*, MTL::Buffer*>  m_allocMap;
     std::unique_ptr<MetalAllocator>  m_allocator;
     std::unique_ptr<MTLBufferCache>  m_bufferCache;
-    size_t   m_currentBatchSize{0};
-    size_t   m_maxBatchSize{0};
+    std::unique_ptr<MTLBufferCache>  m_privateBufferCache;
+    std::unordered_map<const void*, size_t>  m_privateAddressMap;  // Reserved address sizes of private buffers.
+    std::shared_mutex        m_allocMutex;      // Guards the allocation maps and the memory statistics.
+    size_t   m_stagingCount{0};
+    size_t   m_stagedSize{0};
+    size_t   m_bytesInUse{0};               // Bytes of the device buffers that are not deallocated yet.
+    size_t   m_peakBytesInUse{0};
     size_t   m_maxWorkingSetSize{0};
-    size_t   m_currentWorkingSetSize{0};
+    size_t   m_maxCmdBuffersInFlight{MAX_CMD_BUFFERS_IN_FLIGHT};
+    bool     m_zeroCopyHostMemory{false};
+    bool     m_autotune{false};
+    bool     m_privateStorage{false};
+    size_t   m_id{0};                           // Identifies the device in the stream caches of the threads.
+    mutable std::unordered_map<std::thread::id, std::unique_ptr<CommandStream>>  m_streams;
+    mutable std::mutex       m_streamsMutex;
+    inline static std::atomic<size_t>  m_deviceCount{0};
 };
 
 }   // namespace
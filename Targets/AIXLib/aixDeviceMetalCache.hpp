@@ -44,6 +44,19 @@ public:
         return m_cacheSize;
     }
 
+    // Returns the number of the requests that reused a cached buffer and the number of the requests that did not.
+    size_t hitCount()
+    {
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        return m_hitCount;
+    }
+
+    size_t missCount()
+    {
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        return m_missCount;
+    }
+
     void clear()
     {
         std::lock_guard<std::mutex>  lock(m_syncObj);
@@ -79,6 +92,7 @@ public:
             }
         }
 
+        ++(buffer ? m_hitCount : m_missCount);
         return buffer;
     }
 
@@ -194,6 +208,8 @@ private:
     BufferHolder* m_bhHead{nullptr};
     BufferHolder* m_bhTail{nullptr};
     size_t m_cacheSize{0};
+    size_t m_hitCount{0};
+    size_t m_missCount{0};
     std::mutex m_syncObj;
 };
 
@@ -214,22 +230,26 @@ public:
         // Safely release heaps.
         for (auto heap : m_smallPool) heap->release();
         for (auto heap : m_largePool) heap->release();
+        for (auto heap : m_privateSmallPool) heap->release();
+        for (auto heap : m_privateLargePool) heap->release();
     }
 
-    // Allocate memory.
-    MTL::Buffer* alloc(size_t size)
+    // Allocate memory. Private memory is allocated from separate heaps since a heap has one storage mode.
+    MTL::Buffer* alloc(size_t size, MTL::StorageMode storageMode = MTL::StorageModeShared)
     {
         std::lock_guard<std::mutex>  lock(m_syncObj);
         size = roundSize(size, m_alignSize);
-        std::set<MTL::Heap*>& pool = (size < m_smallHeapSize / 2) ? m_smallPool : m_largePool;
+        std::set<MTL::Heap*>& pool = selectPool(size, storageMode);
         auto heap = findBestFitHeap(pool, size);
         if (!heap)
         {
-            heap = allocNewHeap(size);
+            heap = allocNewHeap(size, storageMode);
             assert(heap->usedSize() == 0);
             pool.insert(heap);
         }
-        return heap->newBuffer(size, MTL::ResourceStorageModeShared);
+        auto options = storageMode == MTL::StorageModePrivate ? MTL::ResourceStorageModePrivate
+                                                              : MTL::ResourceStorageModeShared;
+        return heap->newBuffer(size, options);
     }
 
     void dealloc(MTL::Buffer* buffer)
@@ -242,30 +262,59 @@ public:
     void clearEmptyHeaps()
     {
         std::lock_guard<std::mutex> lock(m_syncObj);
+        clearEmptyHeaps(m_smallPool);
+        clearEmptyHeaps(m_largePool);
+        clearEmptyHeaps(m_privateSmallPool);
+        clearEmptyHeaps(m_privateLargePool);
+    }
 
-        // Safely remove heap from m_smallPool.
-        for (auto it = m_smallPool.begin(); it != m_smallPool.end(); )
+    // Returns the number of heaps and their total size in bytes for the given storage mode.
+    size_t heapCount(MTL::StorageMode storageMode)
+    {
+        std::lock_guard<std::mutex> lock(m_syncObj);
+        return storageMode == MTL::StorageModePrivate ? m_privateSmallPool.size() + m_privateLargePool.size()
+                                                      : m_smallPool.size() + m_largePool.size();
+    }
+
+    size_t heapSize(MTL::StorageMode storageMode)
+    {
+        std::lock_guard<std::mutex> lock(m_syncObj);
+        bool isPrivate = storageMode == MTL::StorageModePrivate;
+        size_t size = 0;
+        for (const auto pool : { isPrivate ? &m_privateSmallPool : &m_smallPool,
+                                 isPrivate ? &m_privateLargePool : &m_largePool })
         {
-            auto& heap = *it;
-            if (heap->usedSize() == 0)
-            {
-                heap->release();
-                it = m_smallPool.erase(it);     // Erase and get the next valid iterator.
-            }
-            else
-            {
-                ++it;       // Move to the next element if no erase occurs.
-            }
+            for (auto heap : *pool) size += heap->size();
+        }
+        return size;
+    }
+
+private:
+    // Round the size to avoid fragmentation.
+    static size_t roundSize(size_t size, size_t round)
+    {
+        return (size < round) ? round : (size + (round-1)) / round * round;
+    }
+
+    std::set<MTL::Heap*>& selectPool(size_t size, MTL::StorageMode storageMode)
+    {
+        if (storageMode == MTL::StorageModePrivate)
+        {
+            return (size < m_smallHeapSize / 2) ? m_privateSmallPool : m_privateLargePool;
         }
+        return (size < m_smallHeapSize / 2) ? m_smallPool : m_largePool;
+    }
 
-        // Safely remove heaps from m_largePool.
-        for (auto it = m_largePool.begin(); it != m_largePool.end(); )
+    // Safely remove empty heaps from the pool.
+    static void clearEmptyHeaps(std::set<MTL::Heap*>& pool)
+    {
+        for (auto it = pool.begin(); it != pool.end(); )
         {
             auto& heap = *it;
             if (heap->usedSize() == 0)
             {
                 heap->release();
-                it = m_largePool.erase(it);     // Erase and get the next valid iterator.
+                it = pool.erase(it);        // Erase and get the next valid iterator.
             }
             else
             {
@@ -274,13 +323,6 @@ public:
         }
     }
 
-private:
-    // Round the size to avoid fragmentation.
-    static size_t roundSize(size_t size, size_t round)
-    {
-        return (size < round) ? round : (size + (round-1)) / round * round;
-    }
-
     // Find the best fit heap from the pool.
     MTL::Heap* findBestFitHeap(std::set<MTL::Heap*>& pool, size_t size) const
     {
@@ -292,7 +334,7 @@ private:
     }
 
     // Allocate a new Metal heap.
-    MTL::Heap* allocNewHeap(size_t size)
+    MTL::Heap* allocNewHeap(size_t size, MTL::StorageMode storageMode)
     {
         size_t heapSize = 0;
         if (size < m_smallHeapSize / 2)
@@ -312,7 +354,7 @@ private:
         auto heapDesc = MTL::HeapDescriptor::alloc()->init();
         heapDesc->setSize(heapSize);
         heapDesc->setType(MTL::HeapType::HeapTypeAutomatic);
-        heapDesc->setStorageMode(MTL::StorageModeShared);
+        heapDesc->setStorageMode(storageMode);
         heapDesc->setHazardTrackingMode(MTL::HazardTrackingModeTracked);
         heapDesc->setCpuCacheMode(MTL::CPUCacheModeDefaultCache);
         auto heap = m_device->newHeap(heapDesc);    // Create a heap.
@@ -326,6 +368,8 @@ private:
     size_t m_largeHeapSize{20*1024*1024};       // 20mb
     std::set<MTL::Heap*> m_smallPool;
     std::set<MTL::Heap*> m_largePool;
+    std::set<MTL::Heap*> m_privateSmallPool;
+    std::set<MTL::Heap*> m_privateLargePool;
     std::mutex m_syncObj;
 };
 
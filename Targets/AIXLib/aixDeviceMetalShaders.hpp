@@ -27,6 +27,34 @@ struct MatrixSize
     size_t cols;
 };
 
+// Element offsets between the matrices of batched inputs and results. A zero stride broadcasts a single matrix.
+struct MatrixBatchStrides
+{
+    size_t a;
+    size_t b;
+    size_t result;
+};
+
+// The epilogue of a matrix multiplication, which adds the bias of the result columns and applies the activation.
+// The activation values match aix::Activation.
+struct MatrixEpilogue
+{
+    uint activation;
+    uint hasBias;
+    uint hasPreActivation;      // Writes the values before the activation.
+};
+
+// Matches aix::QuantizedLayout. The sizes of a row are in bytes.
+struct QuantizedMatrixParams
+{
+    uint inputs;
+    uint outputs;
+    uint bits;
+    uint groupSize;
+    uint rowSize;
+    uint valueOffset;
+};
+
 // -----------------------------------------------------------------
 // ATOMIC UTILS
 // -----------------------------------------------------------------
@@ -499,17 +527,43 @@ template<typename T>
 }
 
 
+// Returns the activation of the epilogue of a matrix multiplication.
+template<typename T>
+inline T activate(uint activation, T value)
+{
+    float x = static_cast<float>(value);
+    switch (activation)
+    {
+        case 1:  return static_cast<T>(tanh(x));
+        case 2:  return static_cast<T>(1.0f / (1.0f + exp(-x)));
+        case 3:  return static_cast<T>(0.5f * x * (1.0f + tanh(0.7978845608f * (x + 0.044715f * x * x * x))));
+        default: return value;
+    }
+}
+
+
 // Matrix Mul Tiled with boundary checks
 // -----------------------------------------------------------------
+// The epilogue is applied to the accumulators before the results are written, so a linear layer with an activation
+// is computed in a single pass.
 template<typename T, uint BM, uint BN, uint BK, uint TM, uint TN>
 [[kernel]] void matrixMulTiledBC(const device T* inA,
                                  const device T* inB,
                                  device T* result,
                                  constant MatrixSize& matASize,
                                  constant MatrixSize& matBSize,
-                                 uint2 tgid [[threadgroup_position_in_grid]],
+                                 constant MatrixBatchStrides& batchStrides,
+                                 const device T* bias,
+                                 device T* preActivation,
+                                 constant MatrixEpilogue& epilogue,
+                                 uint3 tgid [[threadgroup_position_in_grid]],
                                  uint2 lid  [[thread_position_in_threadgroup]])
 {
+    // Move to the matrices of the batch.
+    inA    += tgid.z * batchStrides.a;
+    inB    += tgid.z * batchStrides.b;
+    result += tgid.z * batchStrides.result;
+
     // Constants defining tile and thread sizes.
     // BM: Tile size in M dimension.
     // BN: Tile size in N dimension.
@@ -591,13 +645,61 @@ template<typename T, uint BM, uint BN, uint BK, uint TM, uint TN>
             uint globalCol = tgid.x * BN + tx + l;
             if (globalRow < M && globalCol < N)
             {
-                result[globalRow * N + globalCol] = tmp[j][l];
+                T value = tmp[j][l];
+                if (epilogue.hasBias) value += bias[globalCol];
+                if (epilogue.hasPreActivation) preActivation[globalRow * N + globalCol] = value;
+                result[globalRow * N + globalCol] = activate(epilogue.activation, value);
             }
         }
     }
 }
 
 
+// Matrix Mul Quantized
+// -----------------------------------------------------------------
+// Multiplies the rows of inA with the transpose of the quantized weight rows. A simdgroup computes one output of a
+// row: the lanes read consecutive weight bytes, dequantize them in registers and the partial sums are added with
+// simd_sum. The simdgroups along y compute consecutive outputs, so the input row is shared through the cache.
+template<typename T>
+[[kernel]] void matrixMulQuantized(const device T* inA                       [[buffer(0)]],
+                                   const device uchar* weights               [[buffer(1)]],
+                                   device T* result                          [[buffer(2)]],
+                                   constant QuantizedMatrixParams& params    [[buffer(3)]],
+                                   uint2 tid    [[thread_position_in_threadgroup]],
+                                   uint2 tgid   [[threadgroup_position_in_grid]],
+                                   uint2 tgSize [[threads_per_threadgroup]])
+{
+    uint column = tgid.x * tgSize.y + tid.y;
+    if (column >= params.outputs) return;       // The whole simdgroup returns.
+
+    const device uchar* row = weights + column * params.rowSize;
+    const device float* scales = reinterpret_cast<const device float*>(row);
+    const device uchar* values = row + params.valueOffset;
+    inA += tgid.y * params.inputs;
+
+    // Each lane reads four bytes per step, which are four 8-bit or eight 4-bit values.
+    uint valuesPerStep = params.bits == 8 ? 4 : 8;
+    float acc = 0;
+    for (uint k = tid.x * valuesPerStep; k < params.inputs; k += tgSize.x * valuesPerStep)
+    {
+        uint count = min(valuesPerStep, params.inputs - k);
+        for (uint j = 0; j < count; ++j)
+        {
+            uint index = k + j;
+            int q = params.bits == 8 ? int(as_type<char>(values[index]))
+                                     : (int(as_type<char>(uchar(values[index / 2] << (index % 2 == 0 ? 4 : 0)))) >> 4);
+            acc += float(inA[index]) * float(q) * scales[index / params.groupSize];
+        }
+    }
+
+    acc = simd_sum(acc);
+    if (tid.x == 0)
+    {
+        result[tgid.y * params.outputs + column] = T(acc);
+    }
+}
+
+
 // Matrix Mul Tiled
 // -----------------------------------------------------------------
 template<typename T, uint TSX, uint TSY>
@@ -606,7 +708,8 @@ template<typename T, uint TSX, uint TSY>
                                device T* result,
                                constant MatrixSize& matASize,
                                constant MatrixSize& matBSize,
-                               uint2 tgid [[threadgroup_position_in_grid]],
+                               constant MatrixBatchStrides& batchStrides,
+                               uint3 tgid [[threadgroup_position_in_grid]],
                                uint2 lid  [[thread_position_in_threadgroup]])
 {
     const uint N = matASize.cols;
@@ -614,9 +717,9 @@ template<typename T, uint TSX, uint TSY>
 
     auto xOffset = tgid.x * TSX;
     auto yOffset = tgid.y * TSY + lid.y * TSX;
-    inA += yOffset * N;
-    inB += xOffset;
-    result += yOffset * K + xOffset;
+    inA += tgid.z * batchStrides.a + yOffset * N;
+    inB += tgid.z * batchStrides.b + xOffset;
+    result += tgid.z * batchStrides.result + yOffset * K + xOffset;
 
     // Local tile buffers.
     simdgroup_matrix<T,8,8>  A[4];
@@ -722,7 +825,7 @@ template<typename T, uint TILE_SIZE, uint BATCH_SIZE>
 
 // Transpose - Naive Implementation
 // -----------------------------------------------------------------
-size_t flattenIndex(thread size_t* indices, size_t indicesSize, device const size_t* strides)
+size_t flattenIndex(thread size_t* indices, size_t indicesSize, constant size_t* strides)
 {
     size_t index = 0;
     for (size_t i = 0; i < indicesSize; ++i)
@@ -732,7 +835,7 @@ size_t flattenIndex(thread size_t* indices, size_t indicesSize, device const siz
     return index;
 }
 
-void unflattenIndex(size_t index, device const size_t* strides, size_t stridesSize, thread size_t* outIndices)
+void unflattenIndex(size_t index, constant size_t* strides, size_t stridesSize, thread size_t* outIndices)
 {
     for (size_t i = 0; i < stridesSize; ++i)
     {
@@ -753,9 +856,9 @@ template<typename T>
                           device T* result                [[buffer(1)]],
                           constant size_t& dim0           [[buffer(2)]],
                           constant size_t& dim1           [[buffer(3)]],
-                          const device size_t* strides    [[buffer(4)]],
+                          constant size_t* strides        [[buffer(4)]],
                           constant size_t& stridesSize    [[buffer(5)]],
-                          const device size_t* newStrides [[buffer(6)]],
+                          constant size_t* newStrides     [[buffer(6)]],
                           constant size_t& newStridesSize [[buffer(7)]],
                           constant size_t& size           [[buffer(8)]],
                           uint index [[thread_position_in_grid]])
@@ -796,6 +899,52 @@ template<typename T>
 }
 
 
+// Strided - Naive Implementation
+// -----------------------------------------------------------------
+// Element-wise operations of broadcast and transposed views. The views are read through their strides without a copy.
+template<typename T>
+[[kernel]] void strided(const device T* inA        [[buffer(0)]],
+                        const device T* inB        [[buffer(1)]],
+                        device T* result           [[buffer(2)]],
+                        constant size_t* shape     [[buffer(3)]],
+                        constant size_t* stridesA  [[buffer(4)]],
+                        constant size_t* stridesB  [[buffer(5)]],
+                        constant size_t& shapeSize [[buffer(6)]],
+                        constant size_t& offsetA   [[buffer(7)]],
+                        constant size_t& offsetB   [[buffer(8)]],
+                        constant uint& op          [[buffer(9)]],
+                        uint index [[thread_position_in_grid]])
+{
+    size_t idx  = index;
+    size_t ofsA = offsetA;
+    size_t ofsB = offsetB;
+    for (int64_t dim = static_cast<int64_t>(shapeSize) - 1; dim >= 0; --dim)
+    {
+        size_t dimIndex = idx % shape[dim];
+        idx /= shape[dim];
+        ofsA += dimIndex * stridesA[dim];
+        ofsB += dimIndex * stridesB[dim];
+    }
+
+    T a = inA[ofsA];
+    switch (op)
+    {
+        case 0:  result[index] = a + inB[ofsB];    break;
+        case 1:  result[index] = a - inB[ofsB];    break;
+        case 2:  result[index] = a * inB[ofsB];    break;
+        case 3:  result[index] = a / inB[ofsB];    break;
+        case 4:  result[index] = static_cast<T>(pow(static_cast<float>(a), static_cast<float>(inB[ofsB])));  break;
+        case 6:  result[index] = static_cast<T>(sqrt(static_cast<float>(a)));   break;
+        case 7:  result[index] = static_cast<T>(sin(static_cast<float>(a)));    break;
+        case 8:  result[index] = static_cast<T>(cos(static_cast<float>(a)));    break;
+        case 9:  result[index] = static_cast<T>(tanh(static_cast<float>(a)));   break;
+        case 10: result[index] = static_cast<T>(log(static_cast<float>(a)));    break;
+        case 11: result[index] = static_cast<T>(exp(static_cast<float>(a)));    break;
+        default: result[index] = -a;               break;
+    }
+}
+
+
 // Fill - Naive Implementation
 // -----------------------------------------------------------------
 template<typename T, typename T2>
@@ -901,41 +1050,13 @@ template<typename T>
 }
 
 
-// TranslationIndex - Naive Implementation
-// -----------------------------------------------------------------
-size_t translationIndex(size_t index, device const size_t* shape, device const size_t* newShape,
-                        size_t shapeSize, size_t newShapeSize)
-{
-    size_t originalIndex  = 0;
-    size_t targetStride   = 1;
-    size_t originalStride = 1;
-
-    for (int64_t i = newShapeSize - 1, j = shapeSize - 1; i >= 0; --i)
-    {
-        size_t dimIndex = (index / targetStride) % newShape[i];
-        if (j >= 0 && shape[j] == newShape[i])
-        {
-            originalIndex += dimIndex * originalStride;
-            originalStride *= shape[--j + 1];
-        }
-        else if (j >= 0 && shape[j] == 1)
-        {
-            originalStride *= shape[--j + 1];
-        }
-        targetStride *= newShape[i];
-    }
-
-    return originalIndex;
-}
-
-
 // Contiguous - Naive Implementation
 // -----------------------------------------------------------------
 template<typename T, typename T2>
 [[kernel]] void contiguous(const device T* src       [[buffer(0)]],
                            device       T* dst       [[buffer(1)]],
-                           const device T2* shape    [[buffer(2)]],
-                           const device T2* strides  [[buffer(3)]],
+                           constant T2* shape        [[buffer(2)]],
+                           constant T2* strides      [[buffer(3)]],
                            constant T2& shapeSize    [[buffer(4)]],
                            constant T2& offset       [[buffer(5)]],
                            uint index [[thread_position_in_grid]])
@@ -954,37 +1075,225 @@ template<typename T, typename T2>
 }
 
 
-// ReduceTo - Naive Implementation
+// Reduce - Threadgroup Tree Implementation
 // -----------------------------------------------------------------
-template<typename T, typename T2>
-[[kernel]] void reduceTo(const device T* src       [[buffer(0)]],
-                         device       T* dst       [[buffer(1)]],
-                         const device T2* shape    [[buffer(2)]],
-                         const device T2* newShape [[buffer(3)]],
-                         constant T2& shapeSize    [[buffer(4)]],
-                         constant T2& newShapeSize [[buffer(5)]],
-                         uint index [[thread_position_in_grid]])
+constant uint REDUCE_OP_SUM    = 0;
+constant uint REDUCE_OP_MAX    = 1;
+constant uint REDUCE_OP_ARGMAX = 2;
+
+struct ReduceParams
 {
-    size_t originalIndex = translationIndex(index, newShape, shape, newShapeSize, shapeSize);
-    atomic_fetch_add_explicit((device atomic<T>*)&(dst[originalIndex]), src[index], memory_order_relaxed);
+    size_t  outer;
+    size_t  reduce;
+    size_t  inner;
+    uint    op;
+};
+
+// Reduces the middle axis of a contiguous [outer, reduce, inner] tensor. A threadgroup computes a block of columns of
+// one outer row. The threads along y accumulate strided elements of the reduced axis, and their partial results are
+// combined with a tree reduction in threadgroup memory. The threadgroup height must be a power of two.
+template<typename T, typename Acc>
+[[kernel]] void reduce(const device T* src              [[buffer(0)]],
+                       device void* result              [[buffer(1)]],
+                       constant ReduceParams& params    [[buffer(2)]],
+                       uint2 tid    [[thread_position_in_threadgroup]],
+                       uint2 tgid   [[threadgroup_position_in_grid]],
+                       uint2 tgSize [[threads_per_threadgroup]])
+{
+    const uint MAX_THREADS = 1024;
+    threadgroup Acc sharedValues[MAX_THREADS];
+    threadgroup int sharedIndices[MAX_THREADS];
+
+    size_t column = tgid.x * tgSize.x + tid.x;
+    bool isActive = column < params.inner;
+    size_t base = tgid.y * params.reduce * params.inner + column;
+
+    // An index of -1 marks a max or argmax without any element yet.
+    Acc value = params.op == REDUCE_OP_SUM ? Acc(0) : Acc(numeric_limits<T>::lowest());
+    int index = -1;
+    for (size_t r = tid.y; isActive && r < params.reduce; r += tgSize.y)
+    {
+        Acc x = Acc(src[base + r * params.inner]);
+        if (params.op == REDUCE_OP_SUM)
+        {
+            value += x;
+        }
+        else if (x > value || index < 0)
+        {
+            value = x;
+            index = r;
+        }
+    }
 
-    // NOTE: Metal Framework supports add and sub operations for only atomic_float, atomic_uint and atomic_int.
+    uint li = tid.y * tgSize.x + tid.x;
+    sharedValues[li]  = value;
+    sharedIndices[li] = index;
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+
+    for (uint stride = tgSize.y / 2; stride > 0; stride >>= 1)
+    {
+        if (tid.y < stride)
+        {
+            uint other = li + stride * tgSize.x;
+            if (params.op == REDUCE_OP_SUM)
+            {
+                sharedValues[li] += sharedValues[other];
+            }
+            else
+            {
+                // Among equal maxima, the first index wins.
+                Acc otherValue = sharedValues[other];
+                int otherIndex = sharedIndices[other];
+                bool isBetter = otherValue > sharedValues[li] ||
+                                (otherValue == sharedValues[li] && otherIndex < sharedIndices[li]);
+                if (otherIndex >= 0 && (sharedIndices[li] < 0 || isBetter))
+                {
+                    sharedValues[li]  = otherValue;
+                    sharedIndices[li] = otherIndex;
+                }
+            }
+        }
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+    }
+
+    if (tid.y == 0 && isActive)
+    {
+        size_t resultIndex = tgid.y * params.inner + column;
+        if (params.op == REDUCE_OP_ARGMAX)
+            ((device int*)result)[resultIndex] = sharedIndices[tid.x];
+        else
+            ((device T*)result)[resultIndex] = T(sharedValues[tid.x]);
+    }
 }
 
 
-// MaxTo - Naive Implementation
+// Softmax - Threadgroup Tree Implementation
 // -----------------------------------------------------------------
-template<typename T, typename T2>
-[[kernel]] void maxTo(const device T* src       [[buffer(0)]],
-                      device       T* dst       [[buffer(1)]],
-                      const device T2* shape    [[buffer(2)]],
-                      const device T2* newShape [[buffer(3)]],
-                      constant T2& shapeSize    [[buffer(4)]],
-                      constant T2& newShapeSize [[buffer(5)]],
-                      uint index [[thread_position_in_grid]])
+constant uint SOFTMAX_OP_SOFTMAX                = 0;
+constant uint SOFTMAX_OP_LOG_SOFTMAX            = 1;
+constant uint SOFTMAX_OP_SOFTMAX_BACKWARD       = 2;
+constant uint SOFTMAX_OP_LOG_SOFTMAX_BACKWARD   = 3;
+constant uint SOFTMAX_OP_CROSS_ENTROPY          = 4;
+constant uint SOFTMAX_OP_CROSS_ENTROPY_BACKWARD = 5;
+
+struct SoftmaxParams
+{
+    size_t  outer;
+    size_t  reduce;
+    size_t  inner;
+    uint    op;
+};
+
+// Statistics of a line. The sum of exponentials is relative to the maximum. The target sums are the sum of the
+// targets and their dot product with the logits. The backward operations only use the dot product.
+struct SoftmaxStats
 {
-    size_t originalIndex = translationIndex(index, newShape, shape, newShapeSize, shapeSize);
-    aix_atomic_fetch_max_explicit((device aix_atomic<T>*)&(dst[originalIndex]), src[index], memory_order_relaxed);
+    float  max;
+    float  sum;
+    float  targetSum;
+    float  dot;
+};
+
+inline SoftmaxStats softmaxMerge(SoftmaxStats a, SoftmaxStats b)
+{
+    // Rescales the sums to the common maximum. Comparing with the maximum keeps infinite values from making NaNs.
+    float m = max(a.max, b.max);
+    float sumA = a.max == m ? a.sum : a.sum * exp(a.max - m);
+    float sumB = b.max == m ? b.sum : b.sum * exp(b.max - m);
+    return { m, sumA + sumB, a.targetSum + b.targetSum, a.dot + b.dot };
+}
+
+// Computes a softmax operation along the middle axis of contiguous [outer, reduce, inner] inputs, see aix::SoftmaxOp.
+// A threadgroup computes a block of columns of one outer row. The threads along y compute the online softmax
+// statistics of strided elements of a line, which are merged with a tree reduction in threadgroup memory, and then
+// write the results of the same elements. The threadgroup height must be a power of two.
+template<typename T>
+[[kernel]] void softmax(const device T* x               [[buffer(0)]],
+                        const device T* other           [[buffer(1)]],
+                        const device T* lineSeed        [[buffer(2)]],
+                        device T* result                [[buffer(3)]],
+                        constant SoftmaxParams& params  [[buffer(4)]],
+                        uint2 tid    [[thread_position_in_threadgroup]],
+                        uint2 tgid   [[threadgroup_position_in_grid]],
+                        uint2 tgSize [[threads_per_threadgroup]])
+{
+    const uint MAX_THREADS = 1024;
+    threadgroup SoftmaxStats sharedStats[MAX_THREADS];
+
+    size_t column = tgid.x * tgSize.x + tid.x;
+    bool isActive = column < params.inner;
+    size_t base = tgid.y * params.reduce * params.inner + column;
+    bool hasOther = params.op != SOFTMAX_OP_SOFTMAX && params.op != SOFTMAX_OP_LOG_SOFTMAX;
+    bool isBackward = params.op == SOFTMAX_OP_SOFTMAX_BACKWARD || params.op == SOFTMAX_OP_LOG_SOFTMAX_BACKWARD;
+
+    SoftmaxStats stats = { -INFINITY, 0, 0, 0 };
+    for (size_t r = tid.y; isActive && r < params.reduce; r += tgSize.y)
+    {
+        size_t i = base + r * params.inner;
+        float v = float(x[i]);
+        float o = hasOther ? float(other[i]) : 0;
+        if (isBackward)
+        {
+            stats.dot += params.op == SOFTMAX_OP_SOFTMAX_BACKWARD ? o * v : o;
+            continue;
+        }
+        if (hasOther)
+        {
+            stats.targetSum += o;
+            stats.dot += o * v;
+        }
+        if (v > stats.max)
+        {
+            stats.sum = stats.sum * exp(stats.max - v) + 1;
+            stats.max = v;
+        }
+        else
+        {
+            stats.sum += v == stats.max ? 1 : exp(v - stats.max);
+        }
+    }
+
+    uint li = tid.y * tgSize.x + tid.x;
+    sharedStats[li] = stats;
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+
+    for (uint stride = tgSize.y / 2; stride > 0; stride >>= 1)
+    {
+        if (tid.y < stride)
+        {
+            sharedStats[li] = softmaxMerge(sharedStats[li], sharedStats[li + stride * tgSize.x]);
+        }
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+    }
+
+    if (!isActive) return;
+    stats = sharedStats[tid.x];
+    size_t line = tgid.y * params.inner + column;
+    if (params.op == SOFTMAX_OP_CROSS_ENTROPY)
+    {
+        // The loss of a line is -sum(t * logSoftmax(x)) = sum(t) * logSumExp(x) - sum(t * x).
+        if (tid.y == 0) result[line] = T(stats.targetSum * (stats.max + log(stats.sum)) - stats.dot);
+        return;
+    }
+
+    float logSumExp = stats.max + log(stats.sum);
+    float seed = params.op == SOFTMAX_OP_CROSS_ENTROPY_BACKWARD ? float(lineSeed[line]) : 0;
+    for (size_t r = tid.y; r < params.reduce; r += tgSize.y)
+    {
+        size_t i = base + r * params.inner;
+        float v = float(x[i]);
+        float o = hasOther ? float(other[i]) : 0;
+        float y;
+        switch (params.op)
+        {
+            case SOFTMAX_OP_SOFTMAX:                y = exp(v - stats.max) / stats.sum;             break;
+            case SOFTMAX_OP_LOG_SOFTMAX:            y = v - logSumExp;                              break;
+            case SOFTMAX_OP_SOFTMAX_BACKWARD:       y = v * (o - stats.dot);                        break;
+            case SOFTMAX_OP_LOG_SOFTMAX_BACKWARD:   y = o - exp(v) * stats.dot;                     break;
+            default:                                y = seed * (exp(v - logSumExp) * stats.targetSum - o);  break;
+        }
+        result[i] = T(y);
+    }
 }
 
 
@@ -993,9 +1302,9 @@ template<typename T, typename T2>
 template<typename T, typename T2>
 [[kernel]] void sliceSet(const device T* src       [[buffer(0)]],
                          device       T* dst       [[buffer(1)]],
-                         const device T2* shape    [[buffer(2)]],
-                         const device T2* newShape [[buffer(3)]],
-                         const device T2* strides  [[buffer(4)]],
+                         constant T2* shape        [[buffer(2)]],
+                         constant T2* newShape     [[buffer(3)]],
+                         constant T2* strides      [[buffer(4)]],
                          constant T2& shapeSize    [[buffer(5)]],
                          constant T2& newShapeSize [[buffer(6)]],
                          constant T2& stridesSize  [[buffer(7)]],
@@ -1027,8 +1336,8 @@ template<typename T, typename T2>
 // -----------------------------------------------------------------
 template<typename T, typename T2, typename T3>
 [[kernel]] void tril(device T* dst             [[buffer(1)]],
-                     const device T2* shape    [[buffer(2)]],
-                     const device T2* strides  [[buffer(3)]],
+                     constant T2* shape        [[buffer(2)]],
+                     constant T2* strides      [[buffer(3)]],
                      constant T2& shapeSize    [[buffer(4)]],
                      constant T2& stridesSize  [[buffer(5)]],
                      constant T3& diagonal     [[buffer(6)]],
@@ -1057,8 +1366,8 @@ template<typename T, typename T2, typename T3>
 // -----------------------------------------------------------------
 template<typename T, typename T2, typename T3>
 [[kernel]] void triu(device T* dst             [[buffer(1)]],
-                     const device T2* shape    [[buffer(2)]],
-                     const device T2* strides  [[buffer(3)]],
+                     constant T2* shape        [[buffer(2)]],
+                     constant T2* strides      [[buffer(3)]],
                      constant T2& shapeSize    [[buffer(4)]],
                      constant T2& stridesSize  [[buffer(5)]],
                      constant T3& diagonal     [[buffer(6)]],
@@ -1126,6 +1435,121 @@ template<typename T, typename T2, typename T3>
 }
 
 
+// Adds a value to a 16-bit element. Metal has no 16-bit atomics, so the 32-bit word that holds the element is updated
+// by a compare-and-swap loop. Buffers are allocated in multiples of four elements, so the word is inside the buffer.
+template<typename T>
+inline void atomicAdd16(device T* data, size_t index, T value)
+{
+    device atomic_uint* word = (device atomic_uint*)data + index / 2;
+    uint shift = (index % 2) * 16;
+    uint expected = atomic_load_explicit(word, memory_order_relaxed);
+    uint desired;
+    do
+    {
+        T sum = as_type<T>(ushort(expected >> shift)) + value;
+        desired = (expected & ~(0xFFFFu << shift)) | (uint(as_type<ushort>(sum)) << shift);
+    }
+    while (!atomic_compare_exchange_weak_explicit(word, &expected, desired, memory_order_relaxed,
+                                                 memory_order_relaxed));
+}
+
+template<typename T, typename T2, typename T3>
+[[kernel]] void indexAdd16(const device T* src       [[buffer(0)]],
+                           device T* dst             [[buffer(1)]],
+                           const device T2* indices  [[buffer(2)]],
+                           constant T3& indicesSize  [[buffer(3)]],
+                           constant T3& dimSize      [[buffer(4)]],
+                           constant T3& sliceSize    [[buffer(5)]],
+                           uint index [[thread_position_in_grid]])
+{
+    size_t elementWithinSlice = index % sliceSize;
+    size_t idx = (index / sliceSize) % indicesSize;
+    size_t outer = index / (indicesSize * sliceSize);
+    size_t dstIndex = indices[idx] * sliceSize + elementWithinSlice;
+    size_t dstOffset = outer * dimSize + dstIndex;
+    size_t srcOffset = outer * indicesSize * sliceSize + idx * sliceSize + elementWithinSlice;
+    atomicAdd16(dst, dstOffset, src[srcOffset]);
+}
+
+
+// OptimizerStep - Naive Implementation
+// -----------------------------------------------------------------
+// Hyperparameters of a fused optimizer step. Types: 0 = SGD, 1 = Adam, 2 = AdamW.
+struct OptimizerStepParams
+{
+    int   type;
+    float lr;
+    float beta1;
+    float beta2;
+    float epsilon;
+    float weightDecay;
+    float biasCorrection1;
+    float biasCorrection2;
+};
+
+// A parameter of a fused optimizer step. The tensors are addressed by their GPU addresses, so that one dispatch can
+// update all parameters. Unused tensors are null.
+template<typename T>
+struct OptimizerTensor
+{
+    device T*       param;
+    const device T* grad;
+    device float*   master;
+    device float*   m;
+    device float*   v;
+    const device int* indices;  // Row indices of a sparse gradient, or null.
+    ulong           rowSize;
+    ulong           begin;      // Index of the first gradient element of the parameter in the dispatch.
+    ulong           size;
+};
+
+template<typename T>
+[[kernel]] void optimizerStep(const device OptimizerTensor<T>* tensors  [[buffer(0)]],
+                              constant size_t& tensorCount             [[buffer(1)]],
+                              constant OptimizerStepParams& step       [[buffer(2)]],
+                              uint index [[thread_position_in_grid]])
+{
+    // Binary search the parameter of the element.
+    size_t lo = 0;
+    size_t hi = tensorCount;
+    while (hi - lo > 1)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (tensors[mid].begin <= index) lo = mid; else hi = mid;
+    }
+    const device OptimizerTensor<T>& tensor = tensors[lo];
+    size_t gi = index - tensor.begin;
+    if (gi >= tensor.size) return;
+    // A sparse gradient updates the elements of the rows of its indices.
+    size_t i = tensor.indices ? size_t(tensor.indices[gi / tensor.rowSize]) * tensor.rowSize + gi % tensor.rowSize : gi;
+
+    float w = tensor.master ? tensor.master[i] : static_cast<float>(tensor.param[i]);
+    float g = static_cast<float>(tensor.grad[gi]);
+    if (step.type == 0)
+    {
+        g += step.weightDecay * w;
+        if (tensor.m)
+        {
+            g = step.beta1 * tensor.m[i] + g;
+            tensor.m[i] = g;
+        }
+        w -= step.lr * g;
+    }
+    else
+    {
+        if (step.type == 1) g += step.weightDecay * w;
+        else                w *= 1 - step.lr * step.weightDecay;
+        float m = step.beta1 * tensor.m[i] + (1 - step.beta1) * g;
+        float v = step.beta2 * tensor.v[i] + (1 - step.beta2) * g * g;
+        tensor.m[i] = m;
+        tensor.v[i] = v;
+        w -= step.lr * (m / step.biasCorrection1) / (sqrt(v / step.biasCorrection2) + step.epsilon);
+    }
+    if (tensor.master) tensor.master[i] = w;
+    tensor.param[i] = static_cast<T>(w);
+}
+
+
 // nullKernel
 // -----------------------------------------------------------------
 [[kernel]] void nullKernel(uint index [[thread_position_in_grid]])
@@ -1390,7 +1814,11 @@ SpecializeMax("ui8",  uchar);
                                                           device type* result,     \
                                                           constant MatrixSize& matASize,  \
                                                           constant MatrixSize& matBSize,  \
-                                                          uint2 tgid [[threadgroup_position_in_grid]],  \
+                                                          constant MatrixBatchStrides& batchStrides,  \
+                                                          const device type* bias,  \
+                                                          device type* preActivation,  \
+                                                          constant MatrixEpilogue& epilogue,  \
+                                                          uint3 tgid [[threadgroup_position_in_grid]],  \
                                                           uint2 lid  [[thread_position_in_threadgroup]])
 
 #define DeclareConfigMatrixMulTiledBC(bm, bn, bk, tm, tn) \
@@ -1405,6 +1833,28 @@ SpecializeMax("ui8",  uchar);
 
 DeclareConfigMatrixMulTiledBC(64, 64, 8, 8, 8);
 
+
+// Matrix_Mul_Quantized
+// -----------------------------------------------------------------
+#define SpecializeMatrixMulQuantized(tname, type)  \
+    template [[ host_name("matrixMulQuantized_" tname) ]]  \
+    [[kernel]] void matrixMulQuantized<type>(const device type* inA                     [[buffer(0)]], \
+                                             const device uchar* weights                [[buffer(1)]], \
+                                             device type* result                        [[buffer(2)]], \
+                                             constant QuantizedMatrixParams& params     [[buffer(3)]], \
+                                             uint2 tid    [[thread_position_in_threadgroup]],          \
+                                             uint2 tgid   [[threadgroup_position_in_grid]],            \
+                                             uint2 tgSize [[threads_per_threadgroup]])
+
+SpecializeMatrixMulQuantized("f32",  float );
+SpecializeMatrixMulQuantized("f16",  half  );
+SpecializeMatrixMulQuantized("bf16", bfloat);
+SpecializeMatrixMulQuantized("i64",  long  );
+SpecializeMatrixMulQuantized("i32",  int   );
+SpecializeMatrixMulQuantized("i16",  short );
+SpecializeMatrixMulQuantized("i8",   char  );
+SpecializeMatrixMulQuantized("ui8",  uchar );
+
 // clang-format off
 // Matrix Mul Tiled
 // -----------------------------------------------------------------
@@ -1415,7 +1865,8 @@ DeclareConfigMatrixMulTiledBC(64, 64, 8, 8, 8);
                                                  device type* result,     \
                                                  constant MatrixSize& matSize1,  \
                                                  constant MatrixSize& matSize2,  \
-                                                 uint2 tgid [[threadgroup_position_in_grid]],  \
+                                                 constant MatrixBatchStrides& batchStrides,  \
+                                                 uint3 tgid [[threadgroup_position_in_grid]],  \
                                                  uint2 lid  [[thread_position_in_threadgroup]])
 
 #define ImplementSpecializedMatrixMulTiled(tname, tsx, tsy, type)  \
@@ -1425,7 +1876,8 @@ DeclareConfigMatrixMulTiledBC(64, 64, 8, 8, 8);
                                                  device type* result,     \
                                                  constant MatrixSize& matSize1,  \
                                                  constant MatrixSize& matSize2,  \
-                                                 uint2 tgid [[threadgroup_position_in_grid]],  \
+                                                 constant MatrixBatchStrides& batchStrides,  \
+                                                 uint3 tgid [[threadgroup_position_in_grid]],  \
                                                  uint2 lid  [[thread_position_in_threadgroup]])
 
 #define DeclareConfigMatrixMulTiled(tsx, tsy) \
@@ -1497,9 +1949,9 @@ DeclareConfigTranspose2DTiled(32, 8);
                               device type* result             [[buffer(1)]], \
                               constant size_t& dim0           [[buffer(2)]], \
                               constant size_t& dim1           [[buffer(3)]], \
-                              const device size_t* strides    [[buffer(4)]], \
+                              constant size_t* strides        [[buffer(4)]], \
                               constant size_t& stridesSize    [[buffer(5)]], \
-                              const device size_t* newStrides [[buffer(6)]], \
+                              constant size_t* newStrides     [[buffer(6)]], \
                               constant size_t& newStridesSize [[buffer(7)]], \
                               constant size_t& size           [[buffer(8)]], \
                               uint index [[thread_position_in_grid]])
@@ -1542,6 +1994,32 @@ SpecializeCopySet("i8",   char4  );
 SpecializeCopySet("ui8",  uchar4 );
 
 
+// Strided
+// -----------------------------------------------------------------
+#define SpecializeStrided(tname, type)  \
+    template [[ host_name("strided_" tname) ]]  \
+    [[kernel]] void strided(const device type* inA     [[buffer(0)]], \
+                            const device type* inB     [[buffer(1)]], \
+                            device type* result        [[buffer(2)]], \
+                            constant size_t* shape     [[buffer(3)]], \
+                            constant size_t* stridesA  [[buffer(4)]], \
+                            constant size_t* stridesB  [[buffer(5)]], \
+                            constant size_t& shapeSize [[buffer(6)]], \
+                            constant size_t& offsetA   [[buffer(7)]], \
+                            constant size_t& offsetB   [[buffer(8)]], \
+                            constant uint& op          [[buffer(9)]], \
+                            uint index [[thread_position_in_grid]])
+
+SpecializeStrided("f32",  float );
+SpecializeStrided("f16",  half  );
+SpecializeStrided("bf16", bfloat);
+SpecializeStrided("i64",  long  );
+SpecializeStrided("i32",  int   );
+SpecializeStrided("i16",  short );
+SpecializeStrided("i8",   char  );
+SpecializeStrided("ui8",  uchar );
+
+
 // Unary
 // -----------------------------------------------------------------
 #define SpecializeUnary(tname, type)  \
@@ -1611,8 +2089,8 @@ SpecializeFillMin("ui8",  uchar4);
     template [[ host_name("contiguous_" tname) ]]  \
     [[kernel]] void contiguous(const device type1* src       [[buffer(0)]], \
                                device       type1* dst       [[buffer(1)]], \
-                               const device type2* shape     [[buffer(2)]], \
-                               const device type2* strides   [[buffer(3)]], \
+                               constant type2* shape         [[buffer(2)]], \
+                               constant type2* strides       [[buffer(3)]], \
                                constant type2& shapeSize     [[buffer(4)]], \
                                constant type2& offset        [[buffer(5)]], \
                                uint index [[thread_position_in_grid]])
@@ -1627,68 +2105,48 @@ SpecializeContiguous("i8",   char  , size_t);
 SpecializeContiguous("ui8",  uchar , size_t);
 
 
-// ReduceTo
-// -----------------------------------------------------------------
-#define SpecializeReduceTo(tname, type1, type2)  \
-    template [[ host_name("reduceTo_" tname) ]]  \
-    [[kernel]] void reduceTo(const device type1* src       [[buffer(0)]], \
-                             device       type1* dst       [[buffer(1)]], \
-                             const device type2* shape     [[buffer(2)]], \
-                             const device type2* newShape  [[buffer(3)]], \
-                             constant type2& shapeSize     [[buffer(4)]], \
-                             constant type2& newShapeSize  [[buffer(5)]], \
-                             uint index [[thread_position_in_grid]])
-
-#define ImplementSpecializedReduceTo(tname, type1, type2)  \
-    template <> [[ host_name("reduceTo_" tname) ]]  \
-    [[kernel]] void reduceTo<type1,type2>(const device type1* src       [[buffer(0)]], \
-                                          device       type1* dst       [[buffer(1)]], \
-                                          const device type2* shape     [[buffer(2)]], \
-                                          const device type2* newShape  [[buffer(3)]], \
-                                          constant type2& shapeSize     [[buffer(4)]], \
-                                          constant type2& newShapeSize  [[buffer(5)]], \
-                                          uint index [[thread_position_in_grid]]) { }
-
-SpecializeReduceTo("f32",  float , size_t);
-SpecializeReduceTo("i32",  int   , size_t);
-ImplementSpecializedReduceTo("f16",  half  , size_t);
-ImplementSpecializedReduceTo("bf16", bfloat, size_t);
-ImplementSpecializedReduceTo("i64",  long  , size_t);
-ImplementSpecializedReduceTo("i16",  short , size_t);
-ImplementSpecializedReduceTo("i8",   char  , size_t);
-ImplementSpecializedReduceTo("ui8",  uchar , size_t);
-
-
-// MaxTo
-// -----------------------------------------------------------------
-#define SpecializeMaxTo(tname, type1, type2)  \
-    template [[ host_name("maxTo_" tname) ]]  \
-    [[kernel]] void maxTo(const device type1* src       [[buffer(0)]], \
-                          device       type1* dst       [[buffer(1)]], \
-                          const device type2* shape     [[buffer(2)]], \
-                          const device type2* newShape  [[buffer(3)]], \
-                          constant type2& shapeSize     [[buffer(4)]], \
-                          constant type2& newShapeSize  [[buffer(5)]], \
-                          uint index [[thread_position_in_grid]])
-
-#define ImplementSpecializedMaxTo(tname, type1, type2)  \
-    template <> [[ host_name("maxTo_" tname) ]]  \
-    [[kernel]] void maxTo<type1,type2>(const device type1* src       [[buffer(0)]], \
-                                       device       type1* dst       [[buffer(1)]], \
-                                       const device type2* shape     [[buffer(2)]], \
-                                       const device type2* newShape  [[buffer(3)]], \
-                                       constant type2& shapeSize     [[buffer(4)]], \
-                                       constant type2& newShapeSize  [[buffer(5)]], \
-                                       uint index [[thread_position_in_grid]]) { }
-
-SpecializeMaxTo("f32",  float , size_t);
-SpecializeMaxTo("f16",  half  , size_t);
-SpecializeMaxTo("i32",  int   , size_t);
-SpecializeMaxTo("i16",  short , size_t);
-SpecializeMaxTo("i8",   char  , size_t);
-SpecializeMaxTo("ui8",  uchar , size_t);
-ImplementSpecializedMaxTo("bf16", bfloat, size_t);
-ImplementSpecializedMaxTo("i64",  long  , size_t);
+// Reduce
+// -----------------------------------------------------------------
+#define SpecializeReduce(tname, type, acc)  \
+    template [[ host_name("reduce_" tname) ]]  \
+    [[kernel]] void reduce<type,acc>(const device type* src              [[buffer(0)]], \
+                                     device void* result                 [[buffer(1)]], \
+                                     constant ReduceParams& params       [[buffer(2)]], \
+                                     uint2 tid    [[thread_position_in_threadgroup]],   \
+                                     uint2 tgid   [[threadgroup_position_in_grid]],     \
+                                     uint2 tgSize [[threads_per_threadgroup]])
+
+SpecializeReduce("f32",  float , float);
+SpecializeReduce("f16",  half  , float);
+SpecializeReduce("bf16", bfloat, float);
+SpecializeReduce("i64",  long  , long);
+SpecializeReduce("i32",  int   , int);
+SpecializeReduce("i16",  short , int);
+SpecializeReduce("i8",   char  , int);
+SpecializeReduce("ui8",  uchar , int);
+
+
+// Softmax
+// -----------------------------------------------------------------
+#define SpecializeSoftmax(tname, type)  \
+    template [[ host_name("softmax_" tname) ]]  \
+    [[kernel]] void softmax<type>(const device type* x               [[buffer(0)]], \
+                                  const device type* other           [[buffer(1)]], \
+                                  const device type* lineSeed        [[buffer(2)]], \
+                                  device type* result                [[buffer(3)]], \
+                                  constant SoftmaxParams& params     [[buffer(4)]], \
+                                  uint2 tid    [[thread_position_in_threadgroup]],  \
+                                  uint2 tgid   [[threadgroup_position_in_grid]],    \
+                                  uint2 tgSize [[threads_per_threadgroup]])
+
+SpecializeSoftmax("f32",  float );
+SpecializeSoftmax("f16",  half  );
+SpecializeSoftmax("bf16", bfloat);
+SpecializeSoftmax("i64",  long  );
+SpecializeSoftmax("i32",  int   );
+SpecializeSoftmax("i16",  short );
+SpecializeSoftmax("i8",   char  );
+SpecializeSoftmax("ui8",  uchar );
 
 
 // SliceSet
@@ -1697,9 +2155,9 @@ ImplementSpecializedMaxTo("i64",  long  , size_t);
     template [[ host_name("sliceSet_" tname) ]]  \
     [[kernel]] void sliceSet(const device type1* src      [[buffer(0)]],  \
                              device       type1* dst      [[buffer(1)]],  \
-                             const device type2* shape    [[buffer(2)]],  \
-                             const device type2* newShape [[buffer(3)]],  \
-                             const device type2* strides  [[buffer(4)]],  \
+                             constant type2* shape        [[buffer(2)]],  \
+                             constant type2* newShape     [[buffer(3)]],  \
+                             constant type2* strides      [[buffer(4)]],  \
                              constant type2& shapeSize    [[buffer(5)]],  \
                              constant type2& newShapeSize [[buffer(6)]],  \
                              constant type2& stridesSize  [[buffer(7)]],  \
@@ -1723,8 +2181,8 @@ SpecializeSliceSet("ui8",  uchar , size_t);
 #define SpecializeTril(tname, type1, type2, type3)  \
     template [[ host_name("tril_" tname) ]]  \
     [[kernel]] void tril(device type1* dst            [[buffer(1)]], \
-                         const device type2* shape    [[buffer(2)]], \
-                         const device type2* strides  [[buffer(3)]], \
+                         constant type2* shape        [[buffer(2)]], \
+                         constant type2* strides      [[buffer(3)]], \
                          constant type2& shapeSize    [[buffer(4)]], \
                          constant type2& stridesSize  [[buffer(5)]], \
                          constant type3& diagonal     [[buffer(6)]], \
@@ -1746,8 +2204,8 @@ SpecializeTril("ui8",  uchar , size_t, int64_t);
 #define SpecializeTriu(tname, type1, type2, type3)  \
     template [[ host_name("triu_" tname) ]]  \
     [[kernel]] void triu(device type1* dst            [[buffer(1)]], \
-                         const device type2* shape    [[buffer(2)]], \
-                         const device type2* strides  [[buffer(3)]], \
+                         constant type2* shape        [[buffer(2)]], \
+                         constant type2* strides      [[buffer(3)]], \
                          constant type2& shapeSize    [[buffer(4)]], \
                          constant type2& stridesSize  [[buffer(5)]], \
                          constant type3& diagonal     [[buffer(6)]], \
@@ -1798,6 +2256,16 @@ SpecializeIndexSelect("ui8",  uchar , int, size_t);
                              constant type3& sliceSize    [[buffer(5)]], \
                              uint index [[thread_position_in_grid]])
 
+#define SpecializeIndexAdd16(tname, type1, type2, type3)  \
+    template [[ host_name("indexAdd_" tname) ]]  \
+    [[kernel]] void indexAdd16(const device type1* src      [[buffer(0)]], \
+                               device type1* dst            [[buffer(1)]], \
+                               const device type2* indices  [[buffer(2)]], \
+                               constant type3& indicesSize  [[buffer(3)]], \
+                               constant type3& dimSize      [[buffer(4)]], \
+                               constant type3& sliceSize    [[buffer(5)]], \
+                               uint index [[thread_position_in_grid]])
+
 #define ImplementSpecializedIndexAdd(tname, type1, type2, type3)  \
     template <> [[ host_name("indexAdd_" tname) ]]  \
     [[kernel]] void indexAdd<type1,type2,type3>(const device type1* src      [[buffer(0)]], \
@@ -1810,13 +2278,27 @@ SpecializeIndexSelect("ui8",  uchar , int, size_t);
 
 SpecializeIndexAdd("f32",  float , int, size_t);
 SpecializeIndexAdd("i32",  int   , int, size_t);
-ImplementSpecializedIndexAdd("f16",  half  , int, size_t);
-ImplementSpecializedIndexAdd("bf16", bfloat, int, size_t);
+SpecializeIndexAdd16("f16",  half  , int, size_t);
+SpecializeIndexAdd16("bf16", bfloat, int, size_t);
 ImplementSpecializedIndexAdd("i64",  long  , int, size_t);
 ImplementSpecializedIndexAdd("i16",  short , int, size_t);
 ImplementSpecializedIndexAdd("i8",   char  , int, size_t);
 ImplementSpecializedIndexAdd("ui8",  uchar , int, size_t);
 
+
+// OptimizerStep
+// -----------------------------------------------------------------
+#define SpecializeOptimizerStep(tname, type)  \
+    template [[ host_name("optimizerStep_" tname) ]]  \
+    [[kernel]] void optimizerStep(const device OptimizerTensor<type>* tensors  [[buffer(0)]], \
+                                  constant size_t& tensorCount                 [[buffer(1)]], \
+                                  constant OptimizerStepParams& step           [[buffer(2)]], \
+                                  uint index [[thread_position_in_grid]])
+
+SpecializeOptimizerStep("f32",  float );
+SpecializeOptimizerStep("f16",  half  );
+SpecializeOptimizerStep("bf16", bfloat);
+
 )";
 
 
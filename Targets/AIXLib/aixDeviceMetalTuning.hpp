@@ -0,0 +1,131 @@
+//
+//  Copyright © 2024-Present, Arkin Terli. All rights reserved.
+//
+//  NOTICE:  All information contained herein is, and remains the property of Arkin Terli.
+//  The intellectual and technical concepts contained herein are proprietary to Arkin Terli
+//  and may be covered by U.S. and Foreign Patents, patents in process, and are protected by
+//  trade secret or copyright law. Dissemination of this information or reproduction of this
+//  material is strictly forbidden unless prior written permission is obtained from Arkin Terli.
+
+#pragma once
+
+// Project includes
+// External includes
+// System includes
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+
+namespace aix::metal
+{
+
+// Maps the shape buckets of operations to the indices of their fastest kernels. The table does not depend on Metal,
+// the device defines the operations and the kernels.
+class TuningTable
+{
+public:
+    // The operation, the data type, the buckets of the M, N and K dimensions, and the alignment of the dimensions.
+    using Key = std::array<size_t, 6>;
+
+    // Constructor. Kernel indices must be less than the kernel count.
+    explicit TuningTable(uint32_t kernelCount) : m_kernelCount{kernelCount} { }
+
+    bool contains(const Key & key) const
+    {
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        return m_table.contains(key);
+    }
+
+    std::optional<uint32_t> find(const Key & key) const
+    {
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        auto it = m_table.find(key);
+        return it != m_table.end() ? std::optional<uint32_t>(it->second) : std::nullopt;
+    }
+
+    void set(const Key & key, uint32_t kernel)
+    {
+        if (kernel >= m_kernelCount)
+        {
+            throw std::invalid_argument("TuningTable::set() - Unknown kernel.");
+        }
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        m_table[key] = kernel;
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        return m_table.size();
+    }
+
+    void save(const std::string & filename) const
+    {
+        std::ofstream ofs(filename);
+        if (!ofs)
+        {
+            throw std::ios_base::failure("Failed to open the tuning table file for writing.");
+        }
+
+        // Each line has the values of a key and the tuned kernel.
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        for (const auto & [key, kernel] : m_table)
+        {
+            for (auto value : key)
+            {
+                ofs << value << " ";
+            }
+            ofs << kernel << "\n";
+        }
+        if (!ofs)
+        {
+            throw std::ios_base::failure("Failed to write the tuning table file.");
+        }
+    }
+
+    // Adds the entries of the file to the table. Entries of the same keys are replaced.
+    void load(const std::string & filename)
+    {
+        std::ifstream ifs(filename);
+        if (!ifs)
+        {
+            throw std::ios_base::failure("Failed to open the tuning table file for reading.");
+        }
+
+        Key key;
+        uint32_t kernel;
+        std::map<Key, uint32_t>  entries;
+        while (ifs >> key[0] >> key[1] >> key[2] >> key[3] >> key[4] >> key[5] >> kernel)
+        {
+            if (kernel >= m_kernelCount)
+            {
+                throw std::runtime_error("Invalid tuning table file: unknown kernel.");
+            }
+            entries[key] = kernel;
+        }
+        if (!ifs.eof())
+        {
+            throw std::runtime_error("Invalid tuning table file.");
+        }
+
+        // An invalid file leaves the table unchanged.
+        std::lock_guard<std::mutex>  lock(m_syncObj);
+        for (const auto & [entryKey, entryKernel] : entries)
+        {
+            m_table[entryKey] = entryKernel;
+        }
+    }
+
+private:
+    std::map<Key, uint32_t>  m_table;
+    uint32_t  m_kernelCount;
+    mutable std::mutex  m_syncObj;
+};
+
+}   // namespace aix::metal
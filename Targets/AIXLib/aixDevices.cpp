@@ -10,6 +10,7 @@
 // Project includes
 #include "aix.hpp"
 #include "aixDevices.hpp"
+#include "aixDeviceCPUMT.hpp"
 #if defined(__APPLE__) && defined(__arm64__)
 #include "aixDeviceMetal.hpp"
 #endif
@@ -35,6 +36,9 @@ std::unique_ptr<aix::Device> createDevice(aix::DeviceType type, size_t deviceInd
         case DeviceType::kCPU:
             return std::make_unique<aix::Device>(deviceIndex);
 
+        case DeviceType::kCPU_MT:
+            return std::make_unique<aix::DeviceCPUMT>(deviceIndex);
+
         default:
             break;
     }
@@ -12,7 +12,15 @@
 // Project includes
 // External includes
 // System includes
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define AIX_X86_F16C
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 
 // NOTE: C++23 will introduce float16_t and bfloat16_t as new types. The following classes are intended to be used
@@ -523,7 +531,8 @@ private:
         0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00,
         0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00,
         0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00,
-        0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00
+        0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00,
+        0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00, 0xFC00
     };
 
     static inline const uint8_t  m_shiftTable[512] =
@@ -751,6 +760,104 @@ private:
     uint16_t m_data;
 };
 
+
+// Bulk conversions between the 16-bit floating point types and float32. Float16 conversions use the hardware
+// conversion instructions when they are available: F16C on x86 and NEON on ARM64. The F16C variants are compiled in
+// every x86 build and selected at runtime, like the CPU kernels. The other conversions are plain loops that the
+// compiler can vectorize.
+
+#ifdef AIX_X86_F16C
+// Returns true if the CPU supports the F16C conversion instructions.
+inline bool hasF16C()
+{
+    static const bool isSupported = __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+    return isSupported;
+}
+
+// Converts the elements in groups of eight, and returns the number of converted elements.
+__attribute__((target("avx,f16c")))
+inline size_t convertToFloat32F16C(const float16_t* src, float* dst, size_t size)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        auto halfs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(halfs));
+    }
+    return i;
+}
+
+__attribute__((target("avx,f16c")))
+inline size_t convertFromFloat32F16C(const float* src, float16_t* dst, size_t size)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        auto halfs = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), halfs);
+    }
+    return i;
+}
+#endif
+
+inline void convertToFloat32(const float16_t* src, float* dst, size_t size)
+{
+    size_t i = 0;
+#if defined(AIX_X86_F16C)
+    if (hasF16C()) i = convertToFloat32F16C(src, dst, size);
+#elif defined(__aarch64__)
+    for (; i + 4 <= size; i += 4)
+    {
+        auto halfs = vreinterpret_f16_u16(vld1_u16(reinterpret_cast<const uint16_t*>(src + i)));
+        vst1q_f32(dst + i, vcvt_f32_f16(halfs));
+    }
+#endif
+    for (; i < size; ++i)
+    {
+        dst[i] = src[i].toFloat32();
+    }
+}
+
+inline void convertFromFloat32(const float* src, float16_t* dst, size_t size)
+{
+    size_t i = 0;
+#if defined(AIX_X86_F16C)
+    if (hasF16C()) i = convertFromFloat32F16C(src, dst, size);
+#elif defined(__aarch64__)
+    for (; i + 4 <= size; i += 4)
+    {
+        auto halfs = vcvt_f16_f32(vld1q_f32(src + i));
+        vst1_u16(reinterpret_cast<uint16_t*>(dst + i), vreinterpret_u16_f16(halfs));
+    }
+#endif
+    for (; i < size; ++i)
+    {
+        dst[i] = src[i];
+    }
+}
+
+inline void convertToFloat32(const bfloat16_t* src, float* dst, size_t size)
+{
+    auto srcBits = reinterpret_cast<const uint16_t*>(src);
+    for (size_t i = 0; i < size; ++i)
+    {
+        uint32_t bits = static_cast<uint32_t>(srcBits[i]) << 16;
+        std::memcpy(dst + i, &bits, sizeof(bits));
+    }
+}
+
+inline void convertFromFloat32(const float* src, bfloat16_t* dst, size_t size)
+{
+    auto dstBits = reinterpret_cast<uint16_t*>(dst);
+    for (size_t i = 0; i < size; ++i)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, src + i, sizeof(bits));
+        // Branchless round-to-nearest-even, the same rounding as the scalar conversion.
+        dstBits[i] = static_cast<uint16_t>((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+    }
+}
+
 }   // namespace
 
 
@@ -0,0 +1,310 @@
+//
+//  Copyright © 2024-Present, Arkin Terli. All rights reserved.
+//
+//  NOTICE:  All information contained herein is, and remains the property of Arkin Terli.
+//  The intellectual and technical concepts contained herein are proprietary to Arkin Terli
+//  and may be covered by U.S. and Foreign Patents, patents in process, and are protected by
+//  trade secret or copyright law. Dissemination of this information or reproduction of this
+//  material is strictly forbidden unless prior written permission is obtained from Arkin Terli.
+
+#pragma once
+
+// Project includes
+// External includes
+// System includes
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+
+namespace aix
+{
+
+// A vector of trivially copyable elements that stores up to N elements inline and allocates from the heap only when
+// it grows beyond N elements. Tensor shapes, strides and indices rarely have more than a few dimensions, so they are
+// created and copied by every operation without any allocator call.
+template <typename T, size_t N>
+class SmallVector
+{
+    static_assert(std::is_trivially_copyable_v<T>, "SmallVector supports only trivially copyable types.");
+    static_assert(N > 0, "SmallVector needs an inline capacity.");
+
+public:
+    using value_type             = T;
+    using size_type              = size_t;
+    using difference_type        = std::ptrdiff_t;
+    using reference              = T&;
+    using const_reference        = const T&;
+    using pointer                = T*;
+    using const_pointer          = const T*;
+    using iterator               = T*;
+    using const_iterator         = const T*;
+    using reverse_iterator       = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    // Constructors
+    SmallVector() noexcept { }
+
+    explicit SmallVector(size_t count, const T& value = T())        { assign(count, value); }
+
+    template <std::input_iterator InputIt>
+    SmallVector(InputIt first, InputIt last)                        { assign(first, last); }
+
+    SmallVector(std::initializer_list<T> values)                    { assign(values.begin(), values.end()); }
+
+    SmallVector(const std::vector<T>& values)                       { assign(values.begin(), values.end()); }
+
+    SmallVector(const SmallVector& other)                           { assign(other.begin(), other.end()); }
+
+    SmallVector(SmallVector&& other) noexcept                       { moveFrom(other); }
+
+    // Destructor
+    ~SmallVector()                                                  { release(); }
+
+    SmallVector& operator=(const SmallVector& other)
+    {
+        if (this != &other)
+        {
+            assign(other.begin(), other.end());
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(std::initializer_list<T> values)
+    {
+        assign(values.begin(), values.end());
+        return *this;
+    }
+
+    void assign(size_t count, const T& value)
+    {
+        clear();
+        reserve(count);
+        std::fill_n(m_data, count, value);
+        m_size = count;
+    }
+
+    template <std::input_iterator InputIt>
+    void assign(InputIt first, InputIt last)
+    {
+        clear();
+        if constexpr (std::forward_iterator<InputIt>)
+        {
+            reserve(static_cast<size_t>(std::distance(first, last)));
+        }
+        for (; first != last; ++first)
+        {
+            push_back(*first);
+        }
+    }
+
+    // Element access
+    inline T& operator[](size_t index)                  { assert(index < m_size); return m_data[index]; }
+    inline const T& operator[](size_t index) const      { assert(index < m_size); return m_data[index]; }
+
+    T& at(size_t index)
+    {
+        if (index >= m_size) throw std::out_of_range("SmallVector index is out of range.");
+        return m_data[index];
+    }
+
+    const T& at(size_t index) const
+    {
+        if (index >= m_size) throw std::out_of_range("SmallVector index is out of range.");
+        return m_data[index];
+    }
+
+    inline T& front()                                   { assert(m_size > 0); return m_data[0]; }
+    inline const T& front() const                       { assert(m_size > 0); return m_data[0]; }
+    inline T& back()                                    { assert(m_size > 0); return m_data[m_size - 1]; }
+    inline const T& back() const                        { assert(m_size > 0); return m_data[m_size - 1]; }
+    inline T* data() noexcept                           { return m_data; }
+    inline const T* data() const noexcept               { return m_data; }
+
+    // Iterators
+    inline iterator begin() noexcept                    { return m_data; }
+    inline const_iterator begin() const noexcept        { return m_data; }
+    inline const_iterator cbegin() const noexcept       { return m_data; }
+    inline iterator end() noexcept                      { return m_data + m_size; }
+    inline const_iterator end() const noexcept          { return m_data + m_size; }
+    inline const_iterator cend() const noexcept         { return m_data + m_size; }
+    inline reverse_iterator rbegin() noexcept           { return reverse_iterator(end()); }
+    inline const_reverse_iterator rbegin() const        { return const_reverse_iterator(end()); }
+    inline reverse_iterator rend() noexcept             { return reverse_iterator(begin()); }
+    inline const_reverse_iterator rend() const          { return const_reverse_iterator(begin()); }
+
+    // Capacity
+    inline bool empty() const noexcept                  { return m_size == 0; }
+    inline size_t size() const noexcept                 { return m_size; }
+    inline size_t capacity() const noexcept             { return m_capacity; }
+    inline bool isInline() const noexcept               { return m_data == m_inline; }
+
+    void reserve(size_t capacity)
+    {
+        if (capacity <= m_capacity) return;
+        auto data = new T[capacity];
+        std::copy(m_data, m_data + m_size, data);
+        release();
+        m_data     = data;
+        m_capacity = capacity;
+    }
+
+    // Modifiers
+    inline void clear() noexcept                        { m_size = 0; }
+
+    inline void push_back(const T& value)
+    {
+        if (m_size == m_capacity)
+        {
+            T copy = value;         // The value could be an element of this vector.
+            reserve(m_capacity * 2);
+            m_data[m_size++] = copy;
+            return;
+        }
+        m_data[m_size++] = value;
+    }
+
+    template <typename... Args>
+    T& emplace_back(Args&&... args)
+    {
+        push_back(T(std::forward<Args>(args)...));
+        return back();
+    }
+
+    inline void pop_back()                              { assert(m_size > 0); --m_size; }
+
+    void resize(size_t count, const T& value = T())
+    {
+        if (count > m_size)
+        {
+            T copy = value;
+            if (count > m_capacity)
+            {
+                reserve(std::max(count, m_capacity * 2));
+            }
+            std::fill(m_data + m_size, m_data + count, copy);
+        }
+        m_size = count;
+    }
+
+    iterator insert(const_iterator pos, const T& value)
+    {
+        return insert(pos, 1, value);
+    }
+
+    iterator insert(const_iterator pos, size_t count, const T& value)
+    {
+        T copy = value;
+        auto index = openGap(pos, count);
+        std::fill_n(m_data + index, count, copy);
+        return m_data + index;
+    }
+
+    template <std::forward_iterator InputIt>
+    iterator insert(const_iterator pos, InputIt first, InputIt last)
+    {
+        // The range is copied first since it could be a part of this vector.
+        SmallVector values(first, last);
+        auto index = openGap(pos, values.size());
+        std::copy(values.begin(), values.end(), m_data + index);
+        return m_data + index;
+    }
+
+    iterator insert(const_iterator pos, std::initializer_list<T> values)
+    {
+        return insert(pos, values.begin(), values.end());
+    }
+
+    iterator erase(const_iterator pos)
+    {
+        return erase(pos, pos + 1);
+    }
+
+    iterator erase(const_iterator first, const_iterator last)
+    {
+        assert(begin() <= first && first <= last && last <= end());
+        auto index = static_cast<size_t>(first - begin());
+        auto count = static_cast<size_t>(last - first);
+        std::copy(m_data + index + count, m_data + m_size, m_data + index);
+        m_size -= count;
+        return m_data + index;
+    }
+
+    // Comparisons
+    friend bool operator==(const SmallVector& lhs, const SmallVector& rhs)
+    {
+        return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+    }
+
+    friend bool operator<(const SmallVector& lhs, const SmallVector& rhs)
+    {
+        return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+    }
+
+private:
+    // Moves the elements at and after the position to make room for count elements, and returns the gap index.
+    size_t openGap(const_iterator pos, size_t count)
+    {
+        assert(begin() <= pos && pos <= end());
+        auto index = static_cast<size_t>(pos - begin());
+        if (m_size + count > m_capacity)
+        {
+            reserve(std::max(m_size + count, m_capacity * 2));
+        }
+        std::copy_backward(m_data + index, m_data + m_size, m_data + m_size + count);
+        m_size += count;
+        return index;
+    }
+
+    void moveFrom(SmallVector& other) noexcept
+    {
+        if (other.isInline())
+        {
+            std::copy(other.m_data, other.m_data + other.m_size, m_inline);
+            m_data     = m_inline;
+            m_capacity = N;
+        }
+        else
+        {
+            // Heap storage changes the owner without copying the elements.
+            m_data     = other.m_data;
+            m_capacity = other.m_capacity;
+            other.m_data     = other.m_inline;
+            other.m_capacity = N;
+        }
+        m_size = other.m_size;
+        other.m_size = 0;
+    }
+
+    void release() noexcept
+    {
+        if (!isInline())
+        {
+            delete [] m_data;
+            m_data     = m_inline;
+            m_capacity = N;
+        }
+    }
+
+    T*      m_data{m_inline};
+    size_t  m_size{0};
+    size_t  m_capacity{N};
+    T       m_inline[N];
+};
+
+}   // namespace aix
@@ -64,6 +64,22 @@ TEST_CASE("Activation Func - Softmax")
         CheckVectorApproxValues(result, tensor({0.1192, 0.1192, 0.8808, 0.8808}, input.shape()));
     }
 
+    SUBCASE("2x3 dimension - dim 1")
+    {
+        auto input = tensor({1.0, 2.0, 3.0, 1.0, 1.0, 1.0}, Shape{2,3});
+        auto result = nn::Softmax(1).forward(input);
+        CHECK(result.shape() == input.shape());
+        CheckVectorApproxValues(result, tensor({0.0900306, 0.244728, 0.665241, 0.333333, 0.333333, 0.333333},
+                                               input.shape()));
+    }
+
+    SUBCASE("large values")
+    {
+        auto input = tensor({1000.0, 1001.0, -1000.0}, Shape{3});
+        auto result = nn::Softmax().forward(input);
+        CheckVectorApproxValues(result, tensor({0.268941, 0.731059, 0.0}, input.shape()));
+    }
+
     // Note: Results are consistent with those from PyTorch.
 }
 
@@ -78,5 +94,14 @@ TEST_CASE("Activation Func - LogSoftmax")
         CheckVectorApproxValues(result, tensor({-1.0126, -1.3845, -0.951199}, input.shape()));
     }
 
+    SUBCASE("2x3 dimension - dim 1")
+    {
+        auto input = tensor({1.0, 2.0, 3.0, 1.0, 1.0, 1.0}, Shape{2,3});
+        auto result = nn::LogSoftmax(1).forward(input);
+        CHECK(result.shape() == input.shape());
+        CheckVectorApproxValues(result, tensor({-2.40761, -1.40761, -0.407606, -1.09861, -1.09861, -1.09861},
+                                               input.shape()));
+    }
+
     // Note: Results are consistent with those from PyTorch.
 }
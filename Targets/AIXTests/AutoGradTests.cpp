@@ -284,6 +284,76 @@ TEST_CASE("Auto Grad - transpose")
 }
 
 
+TEST_CASE("Auto Grad - batched matmul")
+{
+    SUBCASE("[2x2x2] x [2x2]")
+    {
+        auto a = aix::tensor({1.0,2.0,3.0,4.0,5.0,6.0,7.0,8.0}, Shape{2,2,2}, { .m_requireGrad=true });
+        auto b = aix::tensor({1.0,2.0,3.0,4.0}, Shape{2,2}, { .m_requireGrad=true });
+        auto z = a.matmul(b);
+        z.backward(1, z.shape());
+
+        CHECK(z.shape() == Shape{2,2,2});
+        CHECK(a.grad().shape() == a.shape());
+        CHECK(b.grad().shape() == b.shape());
+        CheckVectorApproxValues(a.grad(), tensor({3.0,7.0,3.0,7.0,3.0,7.0,3.0,7.0}, a.shape()).value());
+        CheckVectorApproxValues(b.grad(), tensor({16.0,16.0,20.0,20.0}, b.shape()).value());
+    }
+
+    SUBCASE("[2x1x1x2] x [3x2x1]")
+    {
+        auto a = aix::tensor({1.0,2.0,3.0,4.0}, Shape{2,1,1,2}, { .m_requireGrad=true });
+        auto b = aix::tensor({1.0,1.0,1.0,0.0,0.0,1.0}, Shape{3,2,1}, { .m_requireGrad=true });
+        auto z = a.matmul(b);
+        z.backward(1, z.shape());
+
+        CHECK(z.shape() == Shape{2,3,1,1});
+        CheckVectorApproxValues(a.grad(), tensor({2.0,2.0,2.0,2.0}, a.shape()).value());
+        CheckVectorApproxValues(b.grad(), tensor({4.0,6.0,4.0,6.0,4.0,6.0}, b.shape()).value());
+    }
+}
+
+
+TEST_CASE("Auto Grad - fused linear")
+{
+    std::vector<std::pair<Activation, std::shared_ptr<nn::Module>>> activations
+    {
+        { Activation::kNone,    nullptr },
+        { Activation::kTanh,    std::make_shared<nn::Tanh>()    },
+        { Activation::kSigmoid, std::make_shared<nn::Sigmoid>() },
+        { Activation::kGeLU,    std::make_shared<nn::GeLU>()    },
+    };
+
+    for (const auto & [activation, module] : activations)
+    {
+        // The fused layer matches the separate operations, and so do the gradients of all inputs.
+        nn::LinearAct fused(4, 3, activation);
+        auto x = aix::randn({2, 5, 4}, { .m_requireGrad=true });
+        auto y = matmul(x, fused.m_w) + fused.m_b;
+        auto expected = module ? module->forward(y) : y;
+        (expected * expected).sum().backward();
+        TensorValue xGrad = x.grad();
+        TensorValue wGrad = fused.m_w.grad();
+        TensorValue bGrad = fused.m_b.grad();
+        x.zeroGrad();
+        fused.m_w.zeroGrad();
+        fused.m_b.zeroGrad();
+
+        auto z = fused.forward(x);
+        (z * z).sum().backward();
+        CHECK(z.shape() == Shape{2, 5, 3});
+        CheckVectorApproxValues(z, expected);
+        CheckVectorApproxValues(x.grad(), xGrad);
+        CheckVectorApproxValues(fused.m_w.grad(), wGrad);
+        CheckVectorApproxValues(fused.m_b.grad(), bGrad);
+    }
+
+    auto x = aix::randn({2, 4});
+    CHECK_THROWS_AS(linear(x, aix::randn({3, 3}), aix::randn({1, 3})), std::invalid_argument);
+    CHECK_THROWS_AS(linear(x, aix::randn({4, 3}), aix::randn({1, 2})), std::invalid_argument);
+}
+
+
 TEST_CASE("Auto Grad - Broadcast from [1x3] to [2x3]")
 {
     auto shape1 = Shape{1, 3};
@@ -3168,3 +3238,136 @@ TEST_CASE("Auto Grad - permute()")
                                                   6.0, 12.0, 18.0, 24.0}, a.shape()).value());
     }
 }
+
+
+TEST_CASE("Auto Grad - topological backward")
+{
+    SUBCASE("shared nodes are visited once")
+    {
+        // Each level doubles the number of paths from the result to x. A path-based traversal would not finish.
+        auto x = tensor({1.0, 2.0}, Shape{2}, { .m_requireGrad=true });
+        auto y = x * 1;
+        for (size_t i=0; i<40; ++i)
+        {
+            y = y + y;
+        }
+        y.backward(1, y.shape());
+        CheckVectorApproxValues(x.grad(), tensor({1099511627776.0, 1099511627776.0}, Shape{2}).value());
+    }
+
+    SUBCASE("seeds are accumulated before propagation")
+    {
+        auto x = tensor({2.0, 3.0}, Shape{2}, { .m_requireGrad=true });
+        auto y = x * x;
+        y.retainGrad();
+        auto z = y * 3 + y.sin() - y / 2;
+        z.backward(1, z.shape());
+        // ∂z/∂y = 3 + cos(y) - 0.5
+        CheckVectorApproxValues(y.grad(), tensor({2.5 + std::cos(4.0), 2.5 + std::cos(9.0)}, Shape{2}).value());
+        CheckVectorApproxValues(x.grad(), tensor({4 * (2.5 + std::cos(4.0)), 6 * (2.5 + std::cos(9.0))},
+                                                 Shape{2}).value());
+
+        // A second pass accumulates into the same gradients.
+        z.backward(1, z.shape());
+        CheckVectorApproxValues(x.grad(), tensor({8 * (2.5 + std::cos(4.0)), 12 * (2.5 + std::cos(9.0))},
+                                                 Shape{2}).value());
+    }
+
+    SUBCASE("deep graph")
+    {
+        auto x = tensor({1.0, 2.0}, Shape{2}, { .m_requireGrad=true });
+        auto y = x * 1;
+        for (size_t i=0; i<5000; ++i)
+        {
+            y = y + x;
+        }
+        y.backward(1, y.shape());
+        CheckVectorApproxValues(x.grad(), tensor({5001.0, 5001.0}, Shape{2}).value());
+    }
+}
+
+
+TEST_CASE("Auto Grad - no grad mode")
+{
+    auto x = tensor({1.0, 2.0}, Shape{2}, { .m_requireGrad=true });
+
+    SUBCASE("operations do not record the graph")
+    {
+        CHECK(GradMode::isEnabled());
+        {
+            NoGradGuard guard;
+            CHECK(!GradMode::isEnabled());
+            auto y = (x * x + x).sum();
+            CHECK(y.isRequireGrad() == false);
+            CHECK(y.value().item<float>() == Approx(8));
+            CHECK_THROWS_AS(y.backward(), std::invalid_argument);
+        }
+        CHECK(GradMode::isEnabled());
+
+        // Recording resumes after the guard.
+        auto z = (x * x).sum();
+        CHECK(z.isRequireGrad() == true);
+        z.backward();
+        CheckVectorApproxValues(x.grad(), tensor({2.0, 4.0}, Shape{2}).value());
+    }
+
+    SUBCASE("guards nest")
+    {
+        {
+            auto guard = inferenceMode();
+            {
+                NoGradGuard inner;
+                CHECK(!GradMode::isEnabled());
+            }
+            CHECK(!GradMode::isEnabled());
+        }
+        CHECK(GradMode::isEnabled());
+    }
+
+    SUBCASE("lazy mode")
+    {
+        LazyModeGuard lazy;
+        NoGradGuard guard;
+        auto y = x * 2 + 1;
+        CHECK(y.isRequireGrad() == false);
+        CheckVectorApproxValues(y.value(), tensor({3.0, 5.0}, Shape{2}).value());
+    }
+}
+
+
+TEST_CASE("Auto Grad - softmax")
+{
+    auto weights = tensor({0.1, 0.7, -0.4, 1.2, -0.3, 0.9}, Shape{2,3});
+
+    for (ssize_t dim : {0, 1, -1})
+    {
+        // The fused operations must match the composition of the element-wise operations.
+        auto x  = tensor({0.5, -1.0, 2.0, 0.25, 3.0, -0.5}, Shape{2,3}, { .m_requireGrad=true });
+        auto xr = tensor({0.5, -1.0, 2.0, 0.25, 3.0, -0.5}, Shape{2,3}, { .m_requireGrad=true });
+        auto e  = (xr - xr.max(dim, true)).exp();
+        auto reference = e / e.sum(dim, true);
+        (softmax(x, dim) * weights).sum().backward();
+        (reference * weights).sum().backward();
+        CheckVectorApproxValues(softmax(x, dim), reference);
+        CheckVectorApproxValues(x.grad(), xr.grad());
+
+        auto y  = tensor({0.5, -1.0, 2.0, 0.25, 3.0, -0.5}, Shape{2,3}, { .m_requireGrad=true });
+        auto yr = tensor({0.5, -1.0, 2.0, 0.25, 3.0, -0.5}, Shape{2,3}, { .m_requireGrad=true });
+        auto logReference = yr - (yr - yr.max(dim, true)).exp().sum(dim, true).log() - yr.max(dim, true);
+        (logSoftmax(y, dim) * weights).sum().backward();
+        (logReference * weights).sum().backward();
+        CheckVectorApproxValues(logSoftmax(y, dim), logReference);
+        CheckVectorApproxValues(y.grad(), yr.grad());
+    }
+
+    SUBCASE("cross-entropy targets")
+    {
+        auto logits  = tensor({1.0, 2.0, 3.0}, Shape{3}, { .m_requireGrad=true });
+        auto targets = tensor({0.2, 0.3, 0.5}, Shape{3}, { .m_requireGrad=true });
+        crossEntropy(logits, targets, 0).backward(1, Shape{});
+        // ∂loss/∂t = -logSoftmax(x)
+        CheckVectorApproxValues(targets.grad(), tensor({2.40761, 1.40761, 0.407606}, Shape{3}).value());
+        CheckVectorApproxValues(logits.grad(), tensor({0.0900306 - 0.2, 0.244728 - 0.3, 0.665241 - 0.5},
+                                                      Shape{3}).value());
+    }
+}
@@ -10,10 +10,15 @@
 // Project includes
 #include "Utils.hpp"
 #include <aix.hpp>
+#include <aixDeviceCPUMT.hpp>
+#include <aixDeviceMetalTuning.hpp>
 #include <aixDevices.hpp>
 // External includes
 #include <doctest/doctest.h>
 // System includes
+#include <cstring>
+#include <set>
+#include <thread>
 
 using namespace aix;
 
@@ -26,7 +31,7 @@ std::uniform_real_distribution<float>  distr(-1, 1);
 std::vector<size_t>  testSizes = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 31, 32, 33, 63, 64, 65,
                                    127, 128, 129, 255, 256, 257, 511, 512, 513, 1023, 1024, 1025, 2047, 2048, 2049 };
 
-std::vector<DeviceType>  testDeviceTypes = { aix::DeviceType::kGPU_METAL };
+std::vector<DeviceType>  testDeviceTypes = { aix::DeviceType::kGPU_METAL, aix::DeviceType::kCPU_MT };
 
 
 bool verifyResults(const aix::TensorValue & tv1, const aix::TensorValue & tv2, float epsilon = EPSILON)
@@ -560,6 +565,103 @@ bool testMaxWithDim(Device* testDevice)
 }
 
 
+bool testReduceWithDim(Device* testDevice)
+{
+    for (size_t i=0; i<aix::DataTypeCount; ++i)
+    {
+        auto dtype = static_cast<DataType>(i);
+        // Apple Metal Framework does not support kFloat64 data type.
+        if (testDevice->type() == DeviceType::kGPU_METAL && dtype == DataType::kFloat64) continue;
+
+        aix::Device  refDevice;     // Reference/CPU device.
+
+        auto shape  = createRandomShape(1, 6);      // max element size 6^6 = 46,656
+        ssize_t dim = std::rand() % static_cast<ssize_t>(shape.size());
+
+        // Integer values keep the sums exact, hence independent of the summation order.
+        auto array       = aix::randn(shape).value().to(&refDevice) * 4;
+        array            = (array.to(DataType::kInt32).to(DataType::kFloat32) / 4).to(dtype);
+        auto deviceArray = array.to(testDevice);
+        auto epsilon     = dtype == DataType::kFloat16 || dtype == DataType::kBFloat16 ? EPSILON_F16 : EPSILON;
+
+        auto sumResult    = deviceArray.sum(dim);
+        auto argmaxResult = deviceArray.argmax(dim, true);
+        testDevice->synchronize();
+
+        // Compare results with the true/reference results
+        if (!verifyResults(array.sum(dim), sumResult, epsilon) ||
+            !verifyResults(array.argmax(dim, true), argmaxResult))
+        {
+            #ifdef DEBUG_LOG
+            std::cout << "----------------------" << std::endl;
+            std::cout << "Array" << std::endl << array << std::endl;
+            std::cout << "Expected Result" << std::endl << array.sum(dim) << std::endl;
+            std::cout << "Device Result" << std::endl << sumResult << std::endl;
+            #endif
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool testSoftmax(Device* testDevice)
+{
+    const std::vector<DataType> dtypes{ DataType::kFloat64, DataType::kFloat32, DataType::kFloat16,
+                                        DataType::kBFloat16 };
+    for (auto dtype : dtypes)
+    {
+        // Apple Metal Framework does not support kFloat64 data type.
+        if (testDevice->type() == DeviceType::kGPU_METAL && dtype == DataType::kFloat64) continue;
+
+        aix::Device  refDevice;     // Reference/CPU device.
+
+        auto shape  = createRandomShape(1, 6);      // max element size 6^6 = 46,656
+        ssize_t dim = std::rand() % static_cast<ssize_t>(shape.size());
+        auto lineShape = shape;
+        lineShape.erase(lineShape.begin() + dim);
+
+        auto x     = (aix::randn(shape).value().to(&refDevice) * 4).to(dtype);
+        auto other = aix::randn(shape).value().to(&refDevice).to(dtype);
+        auto seed  = aix::randn(lineShape).value().to(&refDevice).to(dtype);
+        auto deviceX     = x.to(testDevice);
+        auto deviceOther = other.to(testDevice);
+        auto deviceSeed  = seed.to(testDevice);
+        auto epsilon     = dtype == DataType::kFloat16 || dtype == DataType::kBFloat16 ? EPSILON_F16 : 1e-4;
+
+        for (size_t i=0; i<=static_cast<size_t>(SoftmaxOp::kCrossEntropyBackward); ++i)
+        {
+            auto op = static_cast<SoftmaxOp>(i);
+            auto compute = [op, dim](const TensorValue & a, const TensorValue & b, const TensorValue & lineSeed)
+            {
+                if (op == SoftmaxOp::kSoftmax || op == SoftmaxOp::kLogSoftmax) return a.softmaxOp(op, dim);
+                if (op == SoftmaxOp::kCrossEntropyBackward) return a.softmaxOp(op, dim, {&b, &lineSeed});
+                return a.softmaxOp(op, dim, {&b});
+            };
+
+            auto result = compute(deviceX, deviceOther, deviceSeed);
+            testDevice->synchronize();
+
+            // Compare results with the true/reference results
+            auto expected = compute(x, other, seed);
+            if (!verifyResults(expected, result, epsilon))
+            {
+                #ifdef DEBUG_LOG
+                std::cout << "----------------------" << std::endl;
+                std::cout << "Array" << std::endl << x << std::endl;
+                std::cout << "Expected Result" << std::endl << expected << std::endl;
+                std::cout << "Device Result" << std::endl << result << std::endl;
+                #endif
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
 bool testSlice(Device* testDevice)
 {
     for (size_t i=0; i<aix::DataTypeCount; ++i)
@@ -961,6 +1063,88 @@ bool testMatMul(Device* testDevice, size_t n, size_t inner, size_t m)
 }
 
 
+bool testMatMulBatched(Device* testDevice, const Shape& batchA, const Shape& batchB, size_t n, size_t inner,
+                       size_t m)
+{
+    for (size_t i=0; i<aix::DataTypeCount; ++i)
+    {
+        auto dtype = static_cast<DataType>(i);
+        // Apple Metal Framework does not support kFloat64 data type.
+        if (testDevice->type() == DeviceType::kGPU_METAL &&
+            (dtype == DataType::kFloat64 || dtype == DataType::kFloat16 || dtype == DataType::kBFloat16)) continue;
+
+        aix::Device  refDevice;     // Reference/CPU device.
+
+        auto shapeA = batchA;
+        auto shapeB = batchB;
+        shapeA.insert(shapeA.end(), {n, inner});
+        shapeB.insert(shapeB.end(), {inner, m});
+        auto matA = (11 + 10 * aix::randn(shapeA)).to(dtype).value();
+        auto matB = (11 + 10 * aix::randn(shapeB)).to(dtype).value();
+
+        auto cpuResult    = matA.to(&refDevice).matmul(matB.to(&refDevice));
+        auto deviceResult = matA.to(testDevice).matmul(matB.to(testDevice));
+        testDevice->synchronize();
+
+        // Compare true/cpu result with gpu result
+        if (!verifyResults(cpuResult, deviceResult))
+        {
+            #ifdef DEBUG_LOG
+            std::cout << "----------------------" << std::endl;
+            std::cout << "MatA" << std::endl << matA << std::endl;
+            std::cout << "MatB" << std::endl << matB << std::endl;
+            std::cout << "Expected Result" << std::endl << cpuResult << std::endl;
+            std::cout << "Device Result" << std::endl << deviceResult << std::endl;
+            #endif
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool testMatMulTransposed(Device* testDevice, size_t n, size_t inner, size_t m, bool transposeA, bool transposeB)
+{
+    for (size_t i=0; i<aix::DataTypeCount; ++i)
+    {
+        auto dtype = static_cast<DataType>(i);
+        // Apple Metal Framework does not support kFloat64 data type.
+        if (testDevice->type() == DeviceType::kGPU_METAL &&
+            (dtype == DataType::kFloat64 || dtype == DataType::kFloat16 || dtype == DataType::kBFloat16)) continue;
+
+        aix::Device  refDevice;     // Reference/CPU device.
+
+        auto matA = (11 + 10 * aix::randn({n, inner})).to(dtype).value();
+        auto matB = (11 + 10 * aix::randn({inner, m})).to(dtype).value();
+        auto matAT = transposeA ? matA.transpose(0, 1) : matA;
+        auto matBT = transposeB ? matB.transpose(0, 1) : matB;
+        auto cpuResult    = aix::TensorValue({n, m}, &refDevice).to(dtype);
+        auto deviceResult = aix::TensorValue({n, m}, testDevice).to(dtype);
+
+        refDevice.matmul(matA.deviceParams(), matB.deviceParams(), cpuResult.deviceParams());
+        testDevice->matmulTransposed(matAT.deviceParams(), transposeA, matBT.deviceParams(), transposeB,
+                                     deviceResult.deviceParams());
+        testDevice->synchronize();
+
+        // Compare true/cpu result with gpu result
+        if (!verifyResults(cpuResult, deviceResult))
+        {
+            #ifdef DEBUG_LOG
+            std::cout << "----------------------" << std::endl;
+            std::cout << "MatA" << std::endl << matA << std::endl;
+            std::cout << "MatB" << std::endl << matB << std::endl;
+            std::cout << "Expected Result" << std::endl << cpuResult << std::endl;
+            std::cout << "Device Result" << std::endl << deviceResult << std::endl;
+            #endif
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
 bool testTranspose2D(Device* testDevice, size_t n, size_t m)
 {
     for (size_t i=0; i<aix::DataTypeCount; ++i)
@@ -1268,12 +1452,243 @@ bool testReduceTo(Device* testDevice)
 }
 
 
+bool testFusedElementwise(Device* testDevice, size_t n)
+{
+    for (auto dtype : { DataType::kFloat64, DataType::kFloat32, DataType::kFloat16, DataType::kBFloat16 })
+    {
+        // Apple Metal Framework does not support kFloat64 data type.
+        if (testDevice->type() == DeviceType::kGPU_METAL && dtype == DataType::kFloat64) continue;
+
+        auto array     = aix::randn({1, n}).to(dtype);
+        auto cpuResult = (1 / (1 + (-array).exp()) * (1 + array * array).sqrt() - array.tanh() * 0.5f).value();
+
+        aix::LazyModeGuard  guard;
+        auto deviceArray  = array.to(*testDevice);
+        auto lazyResult   = 1 / (1 + (-deviceArray).exp()) * (1 + deviceArray * deviceArray).sqrt() -
+                            deviceArray.tanh() * 0.5f;
+        if (!lazyResult.isLazy()) return false;
+        auto deviceResult = lazyResult.value();
+        testDevice->synchronize();
+
+        // Fused kernels round only the final result. Eager kernels round every intermediate result.
+        bool isHalf = dtype == DataType::kFloat16 || dtype == DataType::kBFloat16;
+        if (!verifyResults(cpuResult, deviceResult, isHalf ? EPSILON_F16 * 10 : EPSILON))
+        {
+            #ifdef DEBUG_LOG
+            std::cout << "----------------------" << std::endl;
+            std::cout << "Array" << std::endl << array.value() << std::endl;
+            std::cout << "Expected Result" << std::endl << cpuResult << std::endl;
+            std::cout << "Device Result" << std::endl << deviceResult << std::endl;
+            #endif
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool testBroadcastElementwise(Device* testDevice, size_t n)
+{
+    for (auto dtype : { DataType::kFloat32, DataType::kFloat16, DataType::kInt32 })
+    {
+        auto a = (aix::randn({n, 3}) * 4).to(dtype);
+        auto b = (aix::randn({3}) * 4).to(dtype);
+        auto r = aix::randn({n, 1});
+        auto c = (r * r + 1).to(dtype);
+
+        // Operands are broadcast views, which are read in place by the device.
+        auto cpuResult = (-(a + b) * c - b / c + c.pow(b * 0)).value();
+
+        auto da = a.to(*testDevice);
+        auto db = b.to(*testDevice);
+        auto dc = c.to(*testDevice);
+        auto deviceResult = (-(da + db) * dc - db / dc + dc.pow(db * 0)).value();
+        testDevice->synchronize();
+
+        if (!verifyResults(cpuResult, deviceResult, dtype == DataType::kFloat16 ? EPSILON_F16 * 10 : EPSILON))
+        {
+            #ifdef DEBUG_LOG
+            std::cout << "----------------------" << std::endl;
+            std::cout << "Expected Result" << std::endl << cpuResult << std::endl;
+            std::cout << "Device Result" << std::endl << deviceResult << std::endl;
+            #endif
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool testStridedMath(Device* testDevice, size_t n)
+{
+    for (auto dtype : { DataType::kFloat32, DataType::kFloat16, DataType::kInt32 })
+    {
+        auto r = aix::randn({3, n});
+        auto a = (r * r + 1).value().to(dtype);
+        auto q = aix::randn({3});
+        auto b = (q * q * 0.25 + 1).value().to(dtype);
+
+        // Operands are transposed and broadcast views, which are read in place by the math kernels.
+        auto compute = [](const TensorValue& x, const TensorValue& y)
+        {
+            auto view = x.transposeView(0, 1);
+            return (view.sqrt() + view.sin() * view.cos() - view.tanh() + view.log() + (-view).exp() + view.pow(y)) /
+                   y.broadcastView(view.shape()).sqrt();
+        };
+
+        auto cpuResult = compute(a, b);
+        auto deviceResult = compute(a.to(testDevice), b.to(testDevice));
+        testDevice->synchronize();
+
+        if (!verifyResults(cpuResult, deviceResult, dtype == DataType::kFloat16 ? EPSILON_F16 * 10 : EPSILON))
+        {
+            #ifdef DEBUG_LOG
+            std::cout << "----------------------" << std::endl;
+            std::cout << "Expected Result" << std::endl << cpuResult << std::endl;
+            std::cout << "Device Result" << std::endl << deviceResult << std::endl;
+            #endif
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool testOptimizerStep(Device* testDevice, size_t n)
+{
+    for (auto dtype : { DataType::kFloat32, DataType::kFloat16 })
+    {
+        std::vector<Shape> shapes{ Shape{n}, Shape{n, 3}, Shape{7} };
+        std::vector<Tensor> cpuParams, deviceParams;
+        for (const auto& shape : shapes)
+        {
+            auto param = aix::randn(shape);
+            auto data = param.value().data();
+            cpuParams.emplace_back(data, param.value().size(), DataType::kFloat32, shape,
+                                   TensorOptions{ .m_requireGrad=true, .m_dtype=dtype });
+            deviceParams.emplace_back(data, param.value().size(), DataType::kFloat32, shape,
+                                      TensorOptions{ .m_requireGrad=true, .m_dtype=dtype, .m_device=testDevice });
+        }
+
+        auto runSteps = [&](optim::Optimizer& cpuOptimizer, optim::Optimizer& deviceOptimizer)
+        {
+            for (size_t step=0; step<3; ++step)
+            {
+                for (size_t i=0; i<shapes.size(); ++i)
+                {
+                    auto grad = aix::randn(shapes[i]).to(dtype).value();
+                    cpuParams[i].grad() = grad;
+                    deviceParams[i].grad() = grad.to(testDevice);
+                }
+                cpuOptimizer.step();
+                deviceOptimizer.step();
+            }
+            testDevice->synchronize();
+        };
+
+        optim::SGD cpuSGD(cpuParams, 0.1f, 0.9f, 0.01f), deviceSGD(deviceParams, 0.1f, 0.9f, 0.01f);
+        runSteps(cpuSGD, deviceSGD);
+        optim::Adam cpuAdam(cpuParams, 0.01f), deviceAdam(deviceParams, 0.01f);
+        runSteps(cpuAdam, deviceAdam);
+        optim::AdamW cpuAdamW(cpuParams, 0.01f), deviceAdamW(deviceParams, 0.01f);
+        runSteps(cpuAdamW, deviceAdamW);
+
+        for (size_t i=0; i<shapes.size(); ++i)
+        {
+            auto cpuResult = cpuParams[i].value();
+            auto deviceResult = deviceParams[i].value();
+            if (!verifyResults(cpuResult, deviceResult, dtype == DataType::kFloat16 ? EPSILON_F16 * 10 : EPSILON))
+            {
+                #ifdef DEBUG_LOG
+                std::cout << "----------------------" << std::endl;
+                std::cout << "Expected Result" << std::endl << cpuResult << std::endl;
+                std::cout << "Device Result" << std::endl << deviceResult << std::endl;
+                #endif
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+bool testMatmulQuantized(Device* testDevice, size_t n)
+{
+    for (auto dtype : { DataType::kFloat32, DataType::kFloat16 })
+    {
+        for (auto [bits, groupSize] : { std::pair<size_t, size_t>{8, 0}, {8, 32}, {4, 0}, {4, 16} })
+        {
+            auto layout = QuantizedLayout::create(n, 5, bits, groupSize);
+            auto w = nn::QuantizedLinear::quantize(aix::randn({n, 5}).value(), layout, &aix::defaultDevice);
+            auto a = aix::randn({3, n}).to(dtype).value();
+
+            auto cpuResult = a.matmulQuantized(w, layout);
+            auto deviceResult = a.to(testDevice).matmulQuantized(w.to(testDevice), layout);
+            testDevice->synchronize();
+
+            if (!verifyResults(cpuResult, deviceResult, dtype == DataType::kFloat16 ? EPSILON_F16 * 10 : EPSILON))
+            {
+                #ifdef DEBUG_LOG
+                std::cout << "----------------------" << std::endl;
+                std::cout << "Expected Result" << std::endl << cpuResult << std::endl;
+                std::cout << "Device Result" << std::endl << deviceResult << std::endl;
+                #endif
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+bool testLinear(Device* testDevice, size_t n, size_t inner, size_t m)
+{
+    for (auto activation : { Activation::kNone, Activation::kTanh, Activation::kSigmoid, Activation::kGeLU })
+    {
+        aix::Device  refDevice;     // Reference/CPU device.
+
+        auto matA = aix::randn({n, inner}).value();
+        auto matB = aix::randn({inner, m}).value();
+        auto bias = aix::randn({1, m}).value();
+        auto cpuResult           = aix::TensorValue({n, m}, &refDevice);
+        auto cpuPreActivation    = aix::TensorValue({n, m}, &refDevice);
+        auto deviceResult        = aix::TensorValue({n, m}, testDevice);
+        auto devicePreActivation = aix::TensorValue({n, m}, testDevice);
+
+        refDevice.linear(matA.deviceParams(), matB.deviceParams(), bias.deviceParams(), activation,
+                         cpuPreActivation.deviceParams(), cpuResult.deviceParams());
+        testDevice->linear(matA.deviceParams(), matB.deviceParams(), bias.deviceParams(), activation,
+                           devicePreActivation.deviceParams(), deviceResult.deviceParams());
+        testDevice->synchronize();
+
+        // Compare true/cpu result with gpu result
+        if (!verifyResults(cpuResult, deviceResult) || !verifyResults(cpuPreActivation, devicePreActivation))
+        {
+            #ifdef DEBUG_LOG
+            std::cout << "----------------------" << std::endl;
+            std::cout << "Expected Result" << std::endl << cpuResult << std::endl;
+            std::cout << "Device Result" << std::endl << deviceResult << std::endl;
+            #endif
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
 TEST_CASE("Device Tests - createDevice")
 {
     std::vector<aix::DeviceType> deviceTypes
     {
         aix::DeviceType::kCPU,
-        aix::DeviceType::kGPU_METAL
+        aix::DeviceType::kGPU_METAL,
+        aix::DeviceType::kCPU_MT,
     };
 
     for (const auto type : deviceTypes)
@@ -1512,6 +1927,44 @@ TEST_CASE("Device Tests - Max with dim")
 }
 
 
+TEST_CASE("Device Tests - Reduce with dim")
+{
+    // For each available devices, tests sum and argmax operations with dimension.
+    for (auto deviceType : testDeviceTypes)
+    {
+        // Check if the devices is available.
+        auto device = aix::createDevice(deviceType);
+        if (!device) continue;      // Skip if the device is not available.
+
+        // Create a new device per test
+        for (size_t i=0; i<100; ++i)
+        {
+            auto device2 = aix::createDevice(deviceType);
+            CHECK(testReduceWithDim(&*device2));
+        }
+    }
+}
+
+
+TEST_CASE("Device Tests - Softmax")
+{
+    // For each available devices, tests softmax operations.
+    for (auto deviceType : testDeviceTypes)
+    {
+        // Check if the devices is available.
+        auto device = aix::createDevice(deviceType);
+        if (!device) continue;      // Skip if the device is not available.
+
+        // Create a new device per test
+        for (size_t i=0; i<testSizes.size(); ++i)
+        {
+            auto device2 = aix::createDevice(deviceType);
+            CHECK(testSoftmax(&*device2));
+        }
+    }
+}
+
+
 TEST_CASE("Device Tests - Slice")
 {
     // For each available devices, tests add operation.
@@ -1717,6 +2170,43 @@ TEST_CASE("Device Tests - MatMul")
 }
 
 
+TEST_CASE("Device Tests - MatMul Batched")
+{
+    for (auto deviceType : testDeviceTypes)
+    {
+        // Check if the devices is available.
+        auto device = aix::createDevice(deviceType);
+        if (!device) continue;      // Skip if the device is not available.
+
+        CHECK(testMatMulBatched(&*device, {3}, {3}, 7, 5, 3));
+        CHECK(testMatMulBatched(&*device, {4}, {}, 33, 17, 9));
+        CHECK(testMatMulBatched(&*device, {}, {4}, 33, 17, 9));
+        CHECK(testMatMulBatched(&*device, {2, 1}, {3}, 5, 7, 9));
+        CHECK(testMatMulBatched(&*device, {2, 3}, {2, 3}, 64, 32, 128));
+        CHECK(testMatMulBatched(&*device, {8}, {1}, 129, 65, 257));
+    }
+}
+
+
+TEST_CASE("Device Tests - MatMul Transposed")
+{
+    for (auto deviceType : testDeviceTypes)
+    {
+        // Check if the devices is available.
+        auto device = aix::createDevice(deviceType);
+        if (!device) continue;      // Skip if the device is not available.
+
+        for (auto [transposeA, transposeB] : { std::pair{true, false}, std::pair{false, true}, std::pair{true, true} })
+        {
+            CHECK(testMatMulTransposed(&*device, 1, 1, 1, transposeA, transposeB));
+            CHECK(testMatMulTransposed(&*device, 7, 5, 3, transposeA, transposeB));
+            CHECK(testMatMulTransposed(&*device, 64, 32, 128, transposeA, transposeB));
+            CHECK(testMatMulTransposed(&*device, 257, 129, 513, transposeA, transposeB));
+        }
+    }
+}
+
+
 TEST_CASE("Device Tests - Transpose2D")
 {
     // For each available devices, tests add operation.
@@ -1856,6 +2346,75 @@ TEST_CASE("Device Tests - reduceTo")
 }
 
 
+TEST_CASE("Device Tests - reduceTo, maxTo and argmaxTo")
+{
+    // Sources and results start at storage offsets of two elements.
+    constexpr size_t offset = 2;
+    auto testWrappers = [&](Device & device)
+    {
+        auto params = [&](TensorValue & storage, const Shape & shape)
+        {
+            size_t size = 1;
+            for (auto dim : shape) size *= dim;
+            return DeviceTensorParams{ .data=storage.data(), .dtype=storage.dataType(), .isContiguous=true,
+                                       .offset=offset, .shape=shape, .size=size, .strides={} };
+        };
+
+        auto check = [&](auto reduceFunc, const Shape & shape, DataType dtype, std::initializer_list<float> expected)
+        {
+            TensorValue storage(-1, Shape{expected.size() + offset}, &device, dtype);
+            reduceFunc(params(storage, shape));
+            device.synchronize();
+            auto result = storage.to(DataType::kFloat32);
+            CHECK(result.data<float>()[0] == -1);
+            CHECK(result.data<float>()[1] == -1);
+            for (size_t i = 0; i < expected.size(); ++i)
+            {
+                CHECK(result.data<float>()[i + offset] == Approx(std::data(expected)[i]));
+            }
+        };
+
+        auto storage = TensorValue({0.0, 0.0, 1.0, 5.0, 3.0, 4.0, 2.0, 6.0}, Shape{8}, &device);
+        auto src = params(storage, Shape{2, 3});
+        auto reduceTo = [&](auto dst) { device.reduceTo(src, dst); };
+        check(reduceTo, Shape{1, 3}, DataType::kFloat32, {5.0, 7.0, 9.0});
+        check(reduceTo, Shape{3},    DataType::kFloat32, {5.0, 7.0, 9.0});
+        check(reduceTo, Shape{2, 1}, DataType::kFloat32, {9.0, 12.0});
+        check(reduceTo, Shape{1},    DataType::kFloat32, {21.0});
+        check(reduceTo, Shape{2, 3}, DataType::kFloat32, {1.0, 5.0, 3.0, 4.0, 2.0, 6.0});
+
+        auto maxTo = [&](auto dst) { device.maxTo(src, dst); };
+        check(maxTo, Shape{1, 3}, DataType::kFloat32, {4.0, 5.0, 6.0});
+        check(maxTo, Shape{2, 1}, DataType::kFloat32, {5.0, 6.0});
+        check(maxTo, Shape{1, 1}, DataType::kFloat32, {6.0});
+
+        check([&](auto dst) { device.argmaxTo(src, dst, 0); }, Shape{1, 3}, DataType::kInt32, {1.0, 0.0, 1.0});
+        check([&](auto dst) { device.argmaxTo(src, dst, 1); }, Shape{2, 1}, DataType::kInt32, {1.0, 2.0});
+
+        // A long reduced axis with a single result is split into partial results by the multithreaded CPU device.
+        auto longStorage = aix::arange(-2.0, 1000.0).value().to(&device);
+        auto longSrc = params(longStorage, Shape{1000});
+        check([&](auto dst) { device.reduceTo(longSrc, dst); }, Shape{1}, DataType::kFloat32, {499500.0});
+        check([&](auto dst) { device.maxTo(longSrc, dst); }, Shape{1}, DataType::kFloat32, {999.0});
+        check([&](auto dst) { device.argmaxTo(longSrc, dst, 0); }, Shape{1}, DataType::kInt32, {999.0});
+    };
+
+    aix::Device  refDevice;
+    testWrappers(refDevice);
+    for (auto deviceType : testDeviceTypes)
+    {
+        // Check if the devices is available.
+        auto device = aix::createDevice(deviceType);
+        if (!device) continue;      // Skip if the device is not available.
+        testWrappers(*device);
+    }
+
+    // A minimum chunk size of 16 splits the long axis across the worker threads.
+    aix::DeviceCPUMT device(0, 4, 16);
+    testWrappers(device);
+}
+
+
 TEST_CASE("Device Tests - indexSelect")
 {
     // For each available devices, tests add operation.
@@ -1894,6 +2453,342 @@ TEST_CASE("Device Tests - indexAdd")
 }
 
 
+TEST_CASE("Device Tests - Fused Elementwise")
+{
+    // For each available devices, tests lazy fused element-wise operations.
+    for (auto deviceType : testDeviceTypes)
+    {
+        // Check if the devices is available.
+        auto device = aix::createDevice(deviceType);
+        if (!device) continue;      // Skip if the device is not available.
+
+        for (auto size: testSizes)
+        {
+            CHECK(testFusedElementwise(&*device, size));
+        }
+    }
+}
+
+
+TEST_CASE("Device Tests - Broadcast Elementwise")
+{
+    // For each available devices, tests element-wise operations of broadcast views.
+    for (auto deviceType : testDeviceTypes)
+    {
+        // Check if the devices is available.
+        auto device = aix::createDevice(deviceType);
+        if (!device) continue;      // Skip if the device is not available.
+
+        for (auto size: testSizes)
+        {
+            CHECK(testBroadcastElementwise(&*device, size));
+        }
+    }
+}
+
+
+TEST_CASE("Device Tests - Strided Math")
+{
+    // For each available devices, tests math functions of transposed and broadcast views.
+    for (auto deviceType : testDeviceTypes)
+    {
+        // Check if the devices is available.
+        auto device = aix::createDevice(deviceType);
+        if (!device) continue;      // Skip if the device is not available.
+
+        for (auto size: testSizes)
+        {
+            CHECK(testStridedMath(&*device, size));
+        }
+    }
+}
+
+
+TEST_CASE("Device Tests - Optimizer Step")
+{
+    // For each available devices, tests fused optimizer steps.
+    for (auto deviceType : testDeviceTypes)
+    {
+        // Check if the devices is available.
+        auto device = aix::createDevice(deviceType);
+        if (!device) continue;      // Skip if the device is not available.
+
+        for (auto size: testSizes)
+        {
+            CHECK(testOptimizerStep(&*device, size));
+        }
+    }
+}
+
+
+TEST_CASE("Device Tests - Matmul Quantized")
+{
+    // For each available devices, tests the quantized matrix multiplication.
+    for (auto deviceType : testDeviceTypes)
+    {
+        // Check if the devices is available.
+        auto device = aix::createDevice(deviceType);
+        if (!device) continue;      // Skip if the device is not available.
+
+        for (auto size: testSizes)
+        {
+            CHECK(testMatmulQuantized(&*device, size));
+        }
+    }
+}
+
+
+TEST_CASE("Device Tests - Linear")
+{
+    // For each available devices, tests the matrix multiplication with the bias and activation epilogue.
+    for (auto deviceType : testDeviceTypes)
+    {
+        // Check if the devices is available.
+        auto device = aix::createDevice(deviceType);
+        if (!device) continue;      // Skip if the device is not available.
+
+        for (auto size: testSizes)
+        {
+            CHECK(testLinear(&*device, size, 7, size + 3));
+        }
+        CHECK(testLinear(&*device, 130, 258, 514));
+    }
+}
+
+
+TEST_CASE("Device Tests - CPU memory cache")
+{
+    aix::Device device;
+    auto stats = device.memoryStats();
+    CHECK(stats.bytesInUse == 0);
+
+    // Allocations are aligned for SIMD instructions and released blocks are reused.
+    auto memory1 = device.allocate(100);
+    CHECK(reinterpret_cast<uintptr_t>(memory1) % 64 == 0);
+    CHECK(device.memoryStats().bytesInUse == 128);
+    device.deallocate(memory1);
+    CHECK(device.memoryStats().bytesInUse == 0);
+    CHECK(device.memoryStats().bytesCached == 128);
+
+    auto memory2 = device.allocate(120, DataType::kInt8);
+    CHECK(memory2 == memory1);
+    stats = device.memoryStats();
+    CHECK(stats.allocations == 2);
+    CHECK(stats.cacheHits == 1);
+    CHECK(stats.hitRate() == Approx(0.5));
+    CHECK(stats.bytesCached == 0);
+
+    // A block that is much larger than the request is not reused.
+    device.deallocate(memory2);
+    auto memory3 = device.allocate(16);
+    CHECK(memory3 != memory2);
+    device.deallocate(memory3);
+    CHECK(device.memoryStats().bytesCached == 192);
+    CHECK(device.memoryStats().peakBytesInUse == 128);
+
+    // The cache limit evicts the least recently released blocks.
+    device.memoryCacheLimit(100);
+    CHECK(device.memoryStats().bytesCached == 64);
+    device.emptyCache();
+    CHECK(device.memoryStats().bytesCached == 0);
+
+    // Tensors of the device use the cache.
+    device.memoryCacheLimit(1024 * 1024);
+    {
+        auto x = aix::randn({64, 64}).to(device);
+        auto y = (x * x + x).value();
+        CHECK(device.memoryStats().bytesInUse >= 2 * 64 * 64 * sizeof(float));
+    }
+    CHECK(device.memoryStats().bytesInUse == 0);
+    CHECK(device.memoryStats().bytesCached > 0);
+    CHECK(device.memoryStats().cacheHits > 0);
+}
+
+
+TEST_CASE("Device Tests - private storage")
+{
+    // Emulates a device with private memory that the host must not access before it is staged.
+    class PrivateDevice : public aix::Device
+    {
+    public:
+        void* allocatePrivate(size_t size, DataType dtype) override
+        {
+            auto memory = allocate(size, dtype);
+            m_privateMemory.insert(memory);
+            return memory;
+        }
+
+        void* makeHostAccessible(void * memory, size_t size) override
+        {
+            if (!m_privateMemory.erase(memory)) return memory;
+            auto hostMemory = allocate(size);
+            std::memcpy(hostMemory, memory, size);
+            deallocate(memory);
+            ++m_stagingCount;
+            return hostMemory;
+        }
+
+        std::set<void*> m_privateMemory;
+        size_t m_stagingCount{0};
+    };
+
+    PrivateDevice device;
+    auto x = aix::tensor({1.0, 2.0, 3.0}, { .m_device=&device });
+    CHECK_FALSE(x.value().storage()->isPrivate());
+
+    // The results of the operations stay private while the device uses them.
+    auto y = x * x + x;
+    CHECK(y.value().storage()->isPrivate());
+    CHECK(device.m_stagingCount == 0);
+
+    // The first host access stages the memory once.
+    CHECK(y.value().getValueAt<float>({2}) == Approx(12));
+    CHECK(y.value().getValueAt<float>({1}) == Approx(6));
+    CHECK_FALSE(y.value().storage()->isPrivate());
+    CHECK(device.m_stagingCount == 1);
+    CheckVectorApproxValues(y, aix::tensor({2.0, 6.0, 12.0}));
+
+    // Threads that access a shared tensor first at the same time stage its memory once.
+    auto storage = (x * 3).value().storage();
+    CHECK(storage->isPrivate());
+    auto stagingCount = device.m_stagingCount;
+    std::vector<float> values(8);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        threads.emplace_back([&, i] { values[i] = static_cast<const float*>(storage->data())[2]; });
+    }
+    for (auto & thread : threads) thread.join();
+    CHECK(device.m_stagingCount == stagingCount + 1);
+    CHECK(std::count(values.begin(), values.end(), 9.0f) == 8);
+
+    // Tensors created by users are written by the host.
+    aix::Tensor z({2}, { .m_device=&device });
+    CHECK_FALSE(z.value().storage()->isPrivate());
+
+    // Devices without private memory fall back to shared memory.
+    aix::Device sharedDevice;
+    auto w = aix::tensor({1.0, 2.0}, { .m_device=&sharedDevice }) * 2;
+    CHECK_FALSE(w.value().storage()->isPrivate());
+}
+
+
+TEST_CASE("Device Tests - profiler")
+{
+    aix::Device  device;
+    auto a = aix::tensor({1.0, 2.0, 3.0, 4.0, 5.0, 6.0}, {2, 3}).to(device);
+    auto b = aix::tensor({1.0, 2.0, 3.0, 4.0, 5.0, 6.0}, {3, 2}).to(device);
+
+    aix::profiler::clear();
+    aix::profiler::start();
+    CHECK(aix::profiler::isEnabled());
+    auto c = (a.matmul(b) + 1).value();
+    aix::profiler::stop();
+    auto d = (a * 2).value();       // Not recorded.
+
+    auto events = aix::profiler::events();
+    REQUIRE(events.size() >= 3);
+    size_t matmulCount = 0;
+    for (const auto & event : events)
+    {
+        CHECK(event.category == "op");
+        CHECK(event.threadIndex > 0);
+        CHECK(event.duration >= 0);
+        CHECK(event.name != "matmulTransposed");        // Nested device calls belong to the outer operation.
+        CHECK(event.name != "mul");
+        if (event.name == "matmul")
+        {
+            ++matmulCount;
+            CHECK(event.shapes == "[2,3] [3,2] [2,2]");
+            CHECK(event.bytes == 16 * sizeof(float));
+            CHECK(event.dtype == DataType::kFloat32);
+        }
+    }
+    CHECK(matmulCount == 1);
+
+    auto stats = aix::profiler::aggregate();
+    CHECK(std::find_if(stats.begin(), stats.end(), [](const auto & s) { return s.name == "add"; }) != stats.end());
+    CHECK(aix::profiler::summary().find("matmul") != std::string::npos);
+
+    std::string traceFile = "profiler_trace_test.json";
+    aix::profiler::saveChromeTrace(traceFile);
+    std::ifstream ifs(traceFile);
+    std::string trace((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    CHECK(trace.starts_with("{\"traceEvents\":["));
+    CHECK(trace.find("\"name\":\"matmul\"") != std::string::npos);
+    CHECK(trace.find("\"shapes\":\"[2,3] [3,2] [2,2]\"") != std::string::npos);
+    ifs.close();
+    std::filesystem::remove(traceFile);
+
+    aix::profiler::clear();
+    CHECK(aix::profiler::events().empty());
+}
+
+
+TEST_CASE("Device Tests - CPU MT chunked kernels")
+{
+    // A minimum chunk size of one splits even the smallest tensors across the worker threads.
+    aix::DeviceCPUMT device(0, 4, 1);
+    CHECK(device.threadCount() == 4);
+
+    for (auto size: testSizes)
+    {
+        CHECK(testAdd(&device, size));
+        CHECK(testSub(&device, size));
+        CHECK(testMul(&device, size));
+        CHECK(testDiv(&device, size));
+        CHECK(testUnary(&device, size));
+        CHECK(testSqrt(&device, size));
+        CHECK(testSin(&device, size));
+        CHECK(testCos(&device, size));
+        CHECK(testTanh(&device, size));
+        CHECK(testLog(&device, size));
+        CHECK(testExp(&device, size));
+        CHECK(testPow(&device, size));
+        CHECK(testMax(&device, size));
+        CHECK(testCopy(&device, size));
+        CHECK(testFill(&device, size));
+        CHECK(testFillMin(&device, size));
+        CHECK(testFusedElementwise(&device, size));
+        CHECK(testBroadcastElementwise(&device, size));
+        CHECK(testStridedMath(&device, size));
+        CHECK(testOptimizerStep(&device, size));
+    }
+
+    CHECK(testMaxWithDim(&device));
+    CHECK(testReduceWithDim(&device));
+    CHECK(testSoftmax(&device));
+    CHECK(testSlice(&device));
+    CHECK(testSliceSet(&device));
+    CHECK(testTril(&device));
+    CHECK(testTriu(&device));
+    CHECK(testTranspose(&device));
+    CHECK(testPermute(&device));
+    CHECK(testReduceTo(&device));
+    CHECK(testIndexSelect(&device));
+    CHECK(testIndexAdd(&device));
+
+    for (size_t n = 1; n < 8; n+=2)
+    {
+        CHECK(testMatMul(&device, n, 3, n + 2));
+    }
+    CHECK(testMatMul(&device, 65, 33, 17));
+    CHECK(testMatMulTransposed(&device, 65, 33, 17, true, false));
+    CHECK(testMatMulTransposed(&device, 65, 33, 17, false, true));
+
+    // Partial reductions must reproduce the results of the serial kernels.
+    auto x = aix::tensor({1.0, 7.0, 3.0, 7.0, -2.0, 5.0, 0.0, 4.0, 6.0}, {3, 3}).to(device);
+    CHECK(x.sum().value().item<float>() == Approx(31));
+    CHECK(x.max().value().item<float>() == Approx(7));
+    CHECK(x.argmax().value().item<int32_t>() == 1);
+    auto indices = x.value().argmaxIndices();
+    CHECK(indices.data<int32_t>()[1] == 1);
+    CHECK(indices.sum().item<int32_t>() == 1);
+    CheckVectorApproxValues(x.sum(0, true), aix::tensor({8.0, 9.0, 14.0}, {1, 3}));
+    CheckVectorApproxValues(x.max(1, true), aix::tensor({7.0, 7.0, 6.0}, {3, 1}));
+}
+
+
 TEST_CASE("Device Tests - batch compute")
 {
     // If a device uses an advanced command queuing method, subsequent commands should be executed properly once the
@@ -2300,6 +3195,9 @@ TEST_CASE("Device Tests - batch compute")
 
 TEST_CASE("Device Tests - long command batch queue")
 {
+    // The test queues device commands, without the graph that would keep the intermediate results alive.
+    aix::NoGradGuard noGrad;
+
     for (auto deviceType : testDeviceTypes)
     {
         // Check if the devices is available.
@@ -2369,3 +3267,86 @@ TEST_CASE("Device Tests - loop without sync")
 
     CHECK(loss.value().item<float>() <= kLossThreshold);
 }
+
+
+TEST_CASE("Device Tests - concurrent inference")
+{
+    // Threads run one model on a device at the same time. Each thread encodes its operations into its own command
+    // stream and synchronizes only its own commands.
+    auto device = aix::createDevice(aix::DeviceType::kGPU_METAL);
+    if (!device) return;        // Skip if the device is not available.
+
+    aix::nn::Sequential model;
+    model.add(new aix::nn::Linear(8, 16));
+    model.add(new aix::nn::Tanh());
+    model.add(new aix::nn::Linear(16, 4));
+    auto input = aix::randn({32, 8});
+    auto expected = model.forward(input).value();
+    model.to(device);
+    device->synchronize();      // The commands of other threads are not ordered after the commands of this thread.
+
+    constexpr size_t kNumThreads = 4;
+    std::vector<std::vector<float>> results(kNumThreads);
+    std::vector<std::thread> threads;
+    for (size_t i=0; i<kNumThreads; ++i)
+    {
+        threads.emplace_back([&, i]
+        {
+            auto guard = aix::inferenceMode();
+            for (size_t run=0; run<10; ++run)
+            {
+                auto result = model.forward(input.to(device));
+                result.synchronize();
+                auto data = result.value().data<float>();
+                results[i].assign(data, data + result.value().size());
+            }
+        });
+    }
+    for (auto & thread : threads)
+    {
+        thread.join();
+    }
+
+    for (const auto & result : results)
+    {
+        REQUIRE(result.size() == expected.size());
+        for (size_t i=0; i<result.size(); ++i)
+        {
+            CHECK(result[i] == Approx(expected.data<float>()[i]));
+        }
+    }
+}
+
+
+TEST_CASE("Device Tests - Tuning table save and load")
+{
+    // The tuning table does not need a Metal device.
+    std::string tableFile = "tuning_table_test.txt";
+    metal::TuningTable table(3);
+    table.set({0, 1, 64, 128, 32, 4}, 2);
+    table.set({1, 2, 16, 16, 1, 1}, 0);
+    table.set({0, 1, 64, 128, 32, 4}, 1);       // Replaces the kernel of the key.
+    CHECK(table.size() == 2);
+    CHECK(table.contains({1, 2, 16, 16, 1, 1}));
+    CHECK_FALSE(table.find({1, 2, 16, 16, 1, 2}).has_value());
+    CHECK_THROWS_AS(table.set({0, 0, 1, 1, 1, 1}, 3), std::invalid_argument);
+    table.save(tableFile);
+
+    metal::TuningTable loaded(3);
+    loaded.load(tableFile);
+    CHECK(loaded.size() == 2);
+    CHECK(loaded.find({0, 1, 64, 128, 32, 4}) == 1u);
+    CHECK(loaded.find({1, 2, 16, 16, 1, 1}) == 0u);
+
+    // Files with unknown kernels are rejected, and the table stays unchanged.
+    metal::TuningTable smaller(1);
+    CHECK_THROWS_AS(smaller.load(tableFile), std::runtime_error);
+    CHECK(smaller.size() == 0);
+
+    std::ofstream(tableFile) << "0 1 64 128 32 four 1\n";
+    CHECK_THROWS_AS(loaded.load(tableFile), std::runtime_error);
+    CHECK(loaded.size() == 2);
+
+    std::filesystem::remove(tableFile);
+    CHECK_THROWS_AS(loaded.load(tableFile), std::ios_base::failure);
+}
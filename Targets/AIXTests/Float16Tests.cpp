@@ -12,7 +12,10 @@
 // External includes
 #include <doctest/doctest.h>
 // System includes
+#include <cmath>
+#include <limits>
 #include <sstream>
+#include <vector>
 
 
 using namespace aix;
@@ -281,3 +284,44 @@ TEST_CASE("bfloat16_t Tests")
         CHECK(f2 == doctest::Approx(-1));
     }
 }
+
+
+TEST_CASE("Bulk float16_t and bfloat16_t conversions")
+{
+    // The size is not a multiple of the vector widths, so the scalar tail is tested as well.
+    std::vector<float> values;
+    for (size_t i=0; i<37; ++i)
+    {
+        values.emplace_back((static_cast<float>(i) - 18.0f) * 0.37f);
+    }
+    values.back() = -std::numeric_limits<float>::infinity();
+
+    SUBCASE("float16_t")
+    {
+        std::vector<float16_t> halfs(values.size());
+        std::vector<float> floats(values.size());
+        convertFromFloat32(values.data(), halfs.data(), values.size());
+        convertToFloat32(halfs.data(), floats.data(), halfs.size());
+        for (size_t i=0; i<values.size() - 1; ++i)
+        {
+            CHECK(floats[i] == doctest::Approx(float16_t(values[i]).toFloat32()).epsilon(0.001));
+            CHECK(floats[i] == halfs[i].toFloat32());
+        }
+        CHECK(std::isinf(floats.back()));
+        CHECK(floats.back() < 0);
+    }
+
+    SUBCASE("bfloat16_t")
+    {
+        std::vector<bfloat16_t> halfs(values.size());
+        std::vector<float> floats(values.size());
+        convertFromFloat32(values.data(), halfs.data(), values.size());
+        convertToFloat32(halfs.data(), floats.data(), halfs.size());
+        for (size_t i=0; i<values.size(); ++i)
+        {
+            // The bulk conversions round the same as the scalar conversions.
+            CHECK(halfs[i] == bfloat16_t(values[i]));
+            CHECK(floats[i] == bfloat16_t(values[i]).toFloat32());
+        }
+    }
+}
@@ -13,6 +13,7 @@
 // External includes
 #include <doctest/doctest.h>
 // System includes
+#include <set>
 
 using namespace aix;
 
@@ -141,3 +142,500 @@ TEST_CASE("Model - Save/Load Test")
         std::filesystem::remove(testModelFile);
     }
 }
+
+
+TEST_CASE("Model - Checkpoint")
+{
+    std::string testModelFile = "model_checkpoint_test.pth";
+    auto createModel = [](DataType dtype)
+    {
+        auto model = std::make_unique<aix::nn::Sequential>();
+        model->add(new aix::nn::Linear(2, 8));
+        model->add(new aix::nn::Tanh());
+        model->add(new aix::nn::Linear(8, 1));
+        model->to(dtype);
+        return model;
+    };
+
+    auto inputs = aix::tensor({0.0, 0.0,
+                               0.0, 1.0,
+                               1.0, 0.0,
+                               1.0, 1.0}, {4, 2});
+    auto model1 = createModel(DataType::kFloat32);
+    aix::save(*model1, testModelFile);
+
+    SUBCASE("Header index")
+    {
+        Checkpoint checkpoint(testModelFile);
+        CHECK(checkpoint.version() == CheckpointVersion);
+        REQUIRE(checkpoint.entries().size() == 4);
+        CHECK(checkpoint.entries()[0].name == "w");
+        CHECK(checkpoint.entries()[1].name == "b");
+        CHECK(checkpoint.entries()[2].name == "w.1");
+        CHECK(checkpoint.entries()[3].name == "b.1");
+        CHECK(checkpoint.entry("w").shape == Shape{2, 8});
+        CHECK(checkpoint.entry("b.1").dtype == DataType::kFloat32);
+        for (const auto & entry : checkpoint.entries())
+        {
+            CHECK(entry.offset % CheckpointAlignment == 0);
+        }
+        CHECK(std::filesystem::file_size(testModelFile) % CheckpointAlignment == 0);
+        CHECK_THROWS_AS(checkpoint.entry("missing"), std::invalid_argument);
+    }
+
+    SUBCASE("Zero-copy load")
+    {
+        auto model2 = createModel(DataType::kFloat32);
+        aix::load(*model2, testModelFile);
+        for (const auto & [name, param] : model2->parameters())
+        {
+            CHECK(reinterpret_cast<uintptr_t>(param.value().data()) % static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE)) == 0);
+        }
+        CheckVectorApproxValues(model1->forward(inputs), model2->forward(inputs));
+    }
+
+    SUBCASE("Load with data type conversion")
+    {
+        auto model2 = createModel(DataType::kFloat64);
+        aix::load(*model2, testModelFile);
+        CHECK(model2->parameters()[0].second.dataType() == DataType::kFloat64);
+        CheckVectorApproxValues(model1->forward(inputs), model2->forward(inputs.to(DataType::kFloat64)).to(DataType::kFloat32));
+    }
+
+    SUBCASE("Partial load")
+    {
+        auto model2 = createModel(DataType::kFloat32);
+        auto b1 = model2->parameters()[3].second.value().to(DataType::kFloat32);
+        aix::load(*model2, testModelFile, {"w", "w.1"});
+        auto params1 = model1->parameters();
+        auto params2 = model2->parameters();
+        CheckVectorApproxValues(params2[0].second, params1[0].second);
+        CheckVectorApproxValues(params2[2].second, params1[2].second);
+        CheckVectorApproxValues(params2[3].second.value(), b1);
+        CHECK_THROWS_AS(aix::load(*model2, testModelFile, {"missing"}), std::invalid_argument);
+    }
+
+    SUBCASE("Lazy tensor access")
+    {
+        Checkpoint checkpoint(testModelFile);
+        auto w = checkpoint.tensor("w.1", &aix::defaultDevice, DataType::kFloat16);
+        CHECK(w.shape() == Shape{8, 1});
+        CHECK(w.dataType() == DataType::kFloat16);
+        CheckVectorApproxValues(w.to(DataType::kFloat32), model1->parameters()[2].second.value(), 1e-2);
+    }
+
+    SUBCASE("Legacy format")
+    {
+        std::ofstream ofs(testModelFile, std::ios::binary);
+        for (const auto & [name, param] : model1->parameters())
+        {
+            size_t size = param.value().size();
+            ofs.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            ofs.write(static_cast<const char*>(param.value().data()), static_cast<std::streamsize>(size * sizeof(float)));
+        }
+        ofs.close();
+
+        auto model2 = createModel(DataType::kFloat32);
+        aix::load(*model2, testModelFile);
+        CheckVectorApproxValues(model1->forward(inputs), model2->forward(inputs));
+    }
+
+    std::filesystem::remove(testModelFile);
+}
+
+
+TEST_CASE("Model - Quantized linear")
+{
+    // Multiples of 0.1 up to 0.7 are exact 4-bit values, since each group of four weights has the maximum magnitude.
+    auto createLinear = []()
+    {
+        auto linear = std::make_unique<nn::Linear>(16, 3);
+        std::vector<float> weights(16 * 3);
+        for (size_t k=0; k<16; ++k)
+        {
+            for (size_t n=0; n<3; ++n)
+            {
+                int value = k % 4 == 0 ? (n % 2 == 0 ? 7 : -7) : static_cast<int>((k * 7 + n * 3) % 13) - 6;
+                weights[k * 3 + n] = static_cast<float>(value) * 0.1f;
+            }
+        }
+        linear->m_w.value() = Tensor(weights.data(), weights.size(), DataType::kFloat32, {16, 3}).value();
+        return linear;
+    };
+    auto linear = createLinear();
+    auto x = aix::randn({5, 16});
+    auto expected = linear->forward(x);
+
+    nn::QuantizedLinear q4(*linear, 4);
+    CHECK(q4.layout().rowSize() == 12);
+    CHECK(q4.m_w.dataType() == DataType::kUInt8);
+    CHECK(q4.m_w.shape() == Shape{3, 12});
+    CheckVectorApproxValues(q4.forward(x), expected);
+    CheckVectorApproxValues(nn::QuantizedLinear(*linear, 4, 4).forward(x), expected);
+    CheckVectorApproxValues(nn::QuantizedLinear(*linear, 8, 8).forward(x), expected, 1e-2);
+
+    // The results have the data type and the batch dimensions of the inputs.
+    auto y = q4.forward(x.to(DataType::kFloat16).reshape({5, 1, 16}));
+    CHECK(y.shape() == Shape{5, 1, 3});
+    CHECK(y.dataType() == DataType::kFloat16);
+    CheckVectorApproxValues(y.reshape({5, 3}).to(DataType::kFloat32), expected, 1e-2);
+
+    CHECK_THROWS_AS(nn::QuantizedLinear(16, 3, 2), std::invalid_argument);
+    CHECK_THROWS_AS(nn::QuantizedLinear(16, 3, 4, 3), std::invalid_argument);
+    CHECK_THROWS_AS(x.matmulQuantized(q4.m_w, QuantizedLayout::create(8, 3, 4)), std::invalid_argument);
+
+    std::string testModelFile = "model_quantized_test.pth";
+    SUBCASE("Quantize on load")
+    {
+        nn::Sequential model;
+        model.add(createLinear().release());
+        aix::save(model, testModelFile);
+
+        nn::Sequential quantized;
+        quantized.add(new nn::QuantizedLinear(16, 3, 4, 8));
+        aix::load(quantized, testModelFile);
+        CheckVectorApproxValues(quantized.forward(x), model.forward(x));
+    }
+
+    SUBCASE("Quantized checkpoint")
+    {
+        aix::save(q4, testModelFile);
+        Checkpoint checkpoint(testModelFile);
+        CHECK(checkpoint.entry("w").dtype == DataType::kUInt8);
+        CHECK(checkpoint.entry("w").byteSize == 3 * 12);
+
+        nn::QuantizedLinear loaded(16, 3, 4);
+        aix::load(loaded, checkpoint);
+        CheckVectorApproxValues(loaded.forward(x), expected);
+    }
+    std::filesystem::remove(testModelFile);
+}
+
+
+TEST_CASE("Model - Activation checkpointing")
+{
+    class CountingTanh : public aix::nn::Module
+    {
+    public:
+        Tensor forward(Tensor x) const final
+        {
+            ++m_forwardCount;
+            return tanh(x);
+        }
+
+        mutable size_t m_forwardCount{0};
+    };
+
+    auto createModel = []()
+    {
+        auto model = std::make_unique<aix::nn::Sequential>();
+        model->add(new aix::nn::Linear(2, 8));
+        model->add(new aix::nn::Tanh());
+        model->add(new aix::nn::Linear(8, 8));
+        model->add(new aix::nn::Tanh());
+        model->add(new aix::nn::Linear(8, 1));
+        return model;
+    };
+
+    auto inputs  = tensor({0.0, 0.0, 1.0, 0.0, 0.0, 1.0, 1.0, 1.0}, {4, 2});
+    auto targets = tensor({0.0, 1.0, 1.0, 0.0}, {4, 1});
+
+    auto reference = createModel();
+    auto loss = nn::MSELoss()(reference->forward(inputs), targets);
+    loss.backward();
+
+    SUBCASE("Sequential segments")
+    {
+        for (size_t segments : {1, 2, 5, 8})
+        {
+            auto model = createModel();
+            for (size_t i=0; i<model->parameters().size(); ++i)
+            {
+                model->parameters()[i].second.value() = reference->parameters()[i].second.value();
+            }
+            model->checkpointSegments(segments);
+
+            auto checkpointedLoss = nn::MSELoss()(model->forward(inputs), targets);
+            checkpointedLoss.backward();
+            CHECK(checkpointedLoss.value().item<float>() == Approx(loss.value().item<float>()));
+            for (size_t i=0; i<model->parameters().size(); ++i)
+            {
+                CheckVectorApproxValues(model->parameters()[i].second.grad(), reference->parameters()[i].second.grad());
+            }
+        }
+    }
+
+    SUBCASE("Module wrapper")
+    {
+        auto counter = new CountingTanh();
+        aix::nn::ActivationCheckpoint checkpointed(counter);
+        auto x = tensor({0.5, -1.0}, Shape{2}, { .m_requireGrad=true });
+        auto y = checkpointed.forward(x * 2);
+        CHECK(counter->m_forwardCount == 1);
+        CHECK(y.isRequireGrad());
+
+        // The backward pass recomputes the module.
+        y.backward(1, y.shape());
+        CHECK(counter->m_forwardCount == 2);
+        CheckVectorApproxValues(y, tanh(x * 2));
+        CheckVectorApproxValues(x.grad(), tensor({2 * (1 - std::pow(std::tanh(1.0), 2)),
+                                                  2 * (1 - std::pow(std::tanh(-2.0), 2))}, Shape{2}).value());
+
+        // The no-grad mode runs the module once without a graph.
+        NoGradGuard guard;
+        CHECK(checkpointed.forward(x).isRequireGrad() == false);
+        CHECK(counter->m_forwardCount == 3);
+    }
+}
+
+
+TEST_CASE("Model - Graph capture and replay")
+{
+    auto createModel = []()
+    {
+        auto model = std::make_unique<aix::nn::Sequential>();
+        model->add(new aix::nn::Linear(2, 8));
+        model->add(new aix::nn::Tanh());
+        model->add(new aix::nn::Linear(8, 1));
+        return model;
+    };
+
+    std::vector<std::vector<float>> batches{ {0, 0, 1, 0, 0, 1, 1, 1}, {1, 1, 0, 1, 1, 0, 0, 0} };
+    auto targets = tensor({0.0, 1.0, 1.0, 0.0}, {4, 1});
+    constexpr size_t kNumSteps = 6;
+
+    aix::Device cpu;
+    aix::GraphDevice device(&cpu);
+
+    auto runTest = [&](auto createOptimizer)
+    {
+        auto reference = createModel();
+        auto model = createModel();
+        for (size_t i=0; i<model->parameters().size(); ++i)
+        {
+            model->parameters()[i].second.value() = reference->parameters()[i].second.value();
+        }
+        model->to(device);
+        auto referenceOptimizer = createOptimizer(reference->parameters());
+        auto optimizer = createOptimizer(model->parameters());
+
+        auto x = Tensor(batches[0].data(), batches[0].size(), DataType::kFloat32, Shape{4, 2}).to(device);
+        auto y = targets.to(device);
+        Tensor loss;
+        auto step = [&]()
+        {
+            optimizer.zeroGrad();
+            loss = nn::MSELoss()(model->forward(x), y);
+            loss.backward();
+            optimizer.step();
+        };
+
+        Graph graph;
+        for (size_t i=0; i<kNumSteps; ++i)
+        {
+            auto & batch = batches[i % batches.size()];
+            auto inputs = Tensor(batch.data(), batch.size(), DataType::kFloat32, Shape{4, 2});
+            referenceOptimizer.zeroGrad();
+            auto referenceLoss = nn::MSELoss()(reference->forward(inputs), targets);
+            referenceLoss.backward();
+            referenceOptimizer.step();
+
+            // New inputs are written into the captured input tensor.
+            std::copy(batch.begin(), batch.end(), x.value().data<float>());
+            auto allocations = cpu.memoryStats().allocations;
+            if (i == 0)
+            {
+                graph = capture(step);
+                CHECK(graph.nodeCount() > 0);
+            }
+            else
+            {
+                graph.replay();
+                CHECK(cpu.memoryStats().allocations == allocations);     // The replay reuses the captured memory.
+            }
+
+            CHECK(loss.value().item<float>() == Approx(referenceLoss.value().item<float>()));
+            for (size_t j=0; j<model->parameters().size(); ++j)
+            {
+                CheckVectorApproxValues(model->parameters()[j].second, reference->parameters()[j].second);
+            }
+        }
+    };
+
+    SUBCASE("SGD")
+    {
+        runTest([](const auto & parameters) { return optim::SGD(parameters, 0.1f, 0.9f); });
+    }
+
+    SUBCASE("Adam")
+    {
+        runTest([](const auto & parameters) { return optim::Adam(parameters, 0.01f); });
+    }
+
+    SUBCASE("Buffer release")
+    {
+        auto bytesInUse = cpu.memoryStats().bytesInUse;
+        {
+            auto a = tensor({1.0, 2.0}, Shape{2}).to(device);
+            Tensor b;
+            auto graph = capture([&]() { b = a * a + a; });
+            a.value().data<float>()[0] = 3;
+            graph.replay();
+            CheckVectorApproxValues(b, tensor({12.0, 6.0}, Shape{2}));
+            CHECK_THROWS_AS(capture([&]() { capture([](){}); }), std::invalid_argument);
+        }
+        // The intermediate buffers of the capture are released with the graph.
+        CHECK(cpu.memoryStats().bytesInUse == bytesInUse);
+    }
+}
+
+
+TEST_CASE("Model - Data parallel")
+{
+    auto createModel = []()
+    {
+        auto model = std::make_unique<aix::nn::Sequential>();
+        model->add(new aix::nn::Linear(2, 8));
+        model->add(new aix::nn::Tanh());
+        model->add(new aix::nn::Linear(8, 1));
+        return model;
+    };
+
+    // Two processes with the same gradients keep the averages of the replicas.
+    struct TestProcessGroup : public nn::ProcessGroup
+    {
+        size_t size() const override                { return 2; }
+        void allReduce(TensorValue & bucket) override     { bucket *= 2.0f; ++reducedBuckets; }
+        size_t  reducedBuckets{0};
+    };
+
+    aix::Device device1;
+    aix::Device device2;
+    auto processGroup = std::make_shared<TestProcessGroup>();
+    // The small buckets split the parameters into multiple buckets.
+    nn::DataParallel model({ &device1, &device2 }, createModel, 64, processGroup);
+    CHECK(model.replicas() == 2);
+    CheckVectorApproxValues(model.replica(0).parameters()[0].second, model.replica(1).parameters()[0].second);
+
+    auto reference = createModel();
+    for (size_t i=0; i<reference->parameters().size(); ++i)
+    {
+        reference->parameters()[i].second.value() = model.replica(0).parameters()[i].second.value();
+    }
+    optim::SGD referenceOptimizer(reference->parameters(), 0.1f, 0.9f);
+    model.createOptimizers<optim::SGD>(0.1f, 0.9f);
+
+    auto inputs  = tensor({0.0, 0.0, 1.0, 0.0, 0.0, 1.0, 1.0, 1.0}, {4, 2});
+    auto targets = tensor({0.0, 1.0, 1.0, 0.0}, {4, 1});
+    auto inputChunks  = model.scatter(inputs);
+    auto targetChunks = model.scatter(targets);
+    CHECK(inputChunks[1].shape() == Shape{2, 2});
+    CHECK(inputChunks[1].device() == &device2);
+
+    for (size_t i=0; i<3; ++i)
+    {
+        referenceOptimizer.zeroGrad();
+        nn::MSELoss()(reference->forward(inputs), targets).backward();
+        referenceOptimizer.step();
+
+        model.zeroGrad();
+        auto losses = model.backward([&](nn::Module & replica, size_t index)
+        {
+            return nn::MSELoss()(replica.forward(inputChunks[index]), targetChunks[index]);
+        });
+        CHECK(losses.size() == 2);
+        model.step();
+
+        for (size_t j=0; j<reference->parameters().size(); ++j)
+        {
+            CheckVectorApproxValues(model.replica(0).parameters()[j].second, reference->parameters()[j].second);
+            CheckVectorApproxValues(model.replica(1).parameters()[j].second, reference->parameters()[j].second);
+        }
+    }
+    CHECK(processGroup->reducedBuckets > 3);
+
+    CHECK_THROWS_AS(model.scatter(tensor({1.0}, Shape{1})), std::invalid_argument);
+    CHECK_THROWS_AS(nn::DataParallel({}, createModel), std::invalid_argument);
+}
+
+
+TEST_CASE("Data - DataLoader")
+{
+    // Each target is ten times its input, which allows checking that the fields of the samples stay together.
+    auto inputs  = aix::arange(0, 14).reshape({7, 2});
+    auto targets = inputs * 10;
+    auto dataset = std::make_shared<aix::data::TensorDataset>(
+        std::vector<std::pair<std::string,Tensor>>{{"inputs", inputs}, {"targets", targets}});
+    CHECK(dataset->size() == 7);
+    CHECK(dataset->fields()[1].name == "targets");
+    CHECK(dataset->fields()[1].shape == Shape{2});
+
+    SUBCASE("Batches in order")
+    {
+        for (size_t workerCount : {0, 1, 3})
+        {
+            aix::data::DataLoader loader(dataset, { .m_batchSize=3, .m_workerCount=workerCount });
+            CHECK(loader.batchCount() == 3);
+            for (size_t epoch=0; epoch<2; ++epoch)
+            {
+                size_t sample = 0;
+                for (auto batch = loader.next(); !batch.empty(); batch = loader.next())
+                {
+                    size_t count = std::min<size_t>(3, 7 - sample);
+                    CHECK(batch.size() == 2);
+                    CHECK(batch[0].shape() == Shape{count, 2});
+                    auto expected = aix::arange(sample * 2, (sample + count) * 2).reshape(Shape{count, 2});
+                    CheckVectorApproxValues(batch[0], expected);
+                    CheckVectorApproxValues(batch[1], batch[0] * 10);
+                    sample += count;
+                }
+                CHECK(sample == 7);
+                CHECK(loader.next().empty());
+                loader.reset();
+            }
+        }
+    }
+
+    SUBCASE("Shuffle and drop last")
+    {
+        aix::data::DataLoader loader(dataset, { .m_batchSize=2, .m_shuffle=true, .m_dropLast=true, .m_workerCount=2,
+                                                .m_prefetchCount=1 });
+        CHECK(loader.batchCount() == 3);
+        std::set<float> samples;
+        for (auto batch = loader.next(); !batch.empty(); batch = loader.next())
+        {
+            CHECK(batch[0].shape() == Shape{2, 2});
+            CheckVectorApproxValues(batch[1], batch[0] * 10);
+            for (size_t i=0; i<2; ++i)
+            {
+                samples.insert(batch[0].value().getValueAt<float>({i, 0}));
+            }
+        }
+        // Six distinct samples are visited and one is dropped.
+        CHECK(samples.size() == 6);
+    }
+
+    SUBCASE("Shards")
+    {
+        const std::vector<std::string> shardFiles{"aixDataShard0.aix", "aixDataShard1.aix"};
+        aix::save({{"inputs", inputs.slice(0, 0, 4)}, {"targets", targets.slice(0, 0, 4)}}, shardFiles[0]);
+        aix::save({{"inputs", inputs.slice(0, 4, 7)}, {"targets", targets.slice(0, 4, 7)}}, shardFiles[1]);
+
+        auto shards = std::make_shared<aix::data::ShardDataset>(shardFiles);
+        CHECK(shards->size() == 7);
+        aix::data::DataLoader loader(shards, { .m_batchSize=7 });
+        auto batch = loader.next();
+        CheckVectorApproxValues(batch[0], inputs);
+        CheckVectorApproxValues(batch[1], targets);
+        CHECK(loader.next().empty());
+
+        // The shards must contain the same fields.
+        aix::save({{"inputs", inputs}}, shardFiles[1]);
+        CHECK_THROWS_AS(aix::data::ShardDataset{shardFiles}, std::invalid_argument);
+
+        for (const auto & file : shardFiles)
+        {
+            std::filesystem::remove(file);
+        }
+    }
+}
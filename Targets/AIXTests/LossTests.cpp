@@ -49,3 +49,24 @@ TEST_CASE("Loss Func - BinaryCrossEntropy - 2x2")
     CHECK(loss.value().item<float>() == doctest::Approx(0.648247));
     // Note: Results are consistent with those from PyTorch.
 }
+
+
+TEST_CASE("Loss Func - CrossEntropy - Logits")
+{
+    auto logits  = aix::tensor({1.0, 2.0, 3.0, 1.0, 1.0, 1.0}, Shape{2, 3}, { .m_requireGrad=true });
+    auto target  = aix::tensor({0.0, 0.0, 1.0, 1.0, 0.0, 0.0}, Shape{2, 3});
+
+    auto ceLoss  = aix::nn::CrossEntropyLoss(true);
+    auto loss    = ceLoss(logits, target);
+    loss.backward();
+
+    CHECK(loss.dataType() == DataType::kFloat32);
+    CHECK(loss.value().item<float>() == doctest::Approx(0.753109));
+    CheckVectorApproxValues(logits.grad(), tensor({0.0450153, 0.122364, -0.16738,
+                                                   -0.333333, 0.166667, 0.166667}, logits.shape()).value());
+
+    // The loss of probabilities averages over all elements.
+    auto probabilities = aix::nn::Softmax(1).forward(logits);
+    CHECK(aix::nn::CrossEntropyLoss()(probabilities, target).value().item<float>() == doctest::Approx(0.753109 / 3));
+    // Note: Results are consistent with those from PyTorch.
+}
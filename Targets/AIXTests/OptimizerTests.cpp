@@ -81,3 +81,117 @@ TEST_CASE("Adam optimizer test")
     CHECK(u.grad().item<float>()  == Approx(0.00182182));
     // Note: Results are consistent with those from PyTorch.
 }
+
+
+TEST_CASE("SGD momentum optimizer test")
+{
+    auto x = tensor(1, { .m_requireGrad=true });
+
+    // b' = momentum * b + w_gradient, w' = w - lr * b'.
+    optim::SGD optimizer({x}, 0.1f, 0.9f);
+    for (auto expected : { 0.8f, 0.42f, -0.122f })
+    {
+        x.grad().fill(2);
+        optimizer.step();
+        CHECK(x.value().item<float>() == Approx(expected));
+    }
+}
+
+
+TEST_CASE("AdamW optimizer test")
+{
+    auto x = tensor(1, { .m_requireGrad=true });
+
+    // The weight decay shrinks the weight before the Adam update, which is lr * sign(gradient) at the first step.
+    optim::AdamW optimizer({x}, 0.1f, 0.9f, 0.999f, 1e-8f, 0.1f);
+    x.grad().fill(2);
+    optimizer.step();
+    CHECK(x.value().item<float>() == Approx(0.89f));
+
+    // Adam adds the weight decay to the gradient instead.
+    auto y = tensor(1, { .m_requireGrad=true });
+    optim::Adam adam({y}, 0.1f, 0.9f, 0.999f, 1e-8f, 0.1f);
+    y.grad().fill(2);
+    adam.step();
+    CHECK(y.value().item<float>() == Approx(0.9f));
+}
+
+
+TEST_CASE("Optimizer master weights test")
+{
+    auto x = tensor(1, { .m_requireGrad=true, .m_dtype=DataType::kFloat16 });
+
+    // Updates smaller than the Float16 precision accumulate in the Float32 master weights.
+    optim::SGD optimizer({x}, 1e-4f);
+    for (size_t i=0; i<10; ++i)
+    {
+        x.grad().fill(1);
+        optimizer.step();
+    }
+
+    CHECK(x.dataType() == DataType::kFloat16);
+    CHECK(static_cast<float>(x.value().item<float16_t>()) == Approx(0.999f).epsilon(0.001));
+    CHECK(static_cast<float>(x.value().item<float16_t>()) < 1.0f);
+}
+
+
+TEST_CASE("Embedding sparse gradient test")
+{
+    nn::Embedding embedding(5, 2);
+    auto indices = tensor({ 1.0, 3.0, 1.0 }, Shape{3}, { .m_dtype=DataType::kInt32 });
+    CHECK(embedding.forward(indices).shape() == Shape{3, 2});
+
+    // The rows of the duplicate indices are summed. Only the looked up rows have gradients.
+    embedding.forward(indices).sum().backward();
+    CHECK(embedding.m_w.isSparseGrad());
+    CheckVectorApproxValues(embedding.m_w.rowGrad().indices,
+                            tensor({ 1.0, 3.0 }, Shape{2}).value().to(DataType::kInt32));
+    CheckVectorApproxValues(embedding.m_w.rowGrad().rows, tensor({ 2.0, 2.0, 1.0, 1.0 }, Shape{2, 2}).value());
+
+    // Dense gradients of the table add all rows.
+    embedding.forward(indices).sum().backward();
+    embedding.m_w.sum().backward();
+    CheckVectorApproxValues(embedding.m_w.rowGrad().indices,
+                            tensor({ 0.0, 1.0, 2.0, 3.0, 4.0 }, Shape{5}).value().to(DataType::kInt32));
+    CheckVectorApproxValues(embedding.m_w.rowGrad().rows,
+                            tensor({ 1.0, 1.0, 5.0, 5.0, 1.0, 1.0, 3.0, 3.0, 1.0, 1.0 }, Shape{5, 2}).value());
+
+    embedding.m_w.zeroGrad();
+    CHECK(embedding.m_w.rowGrad().empty());
+}
+
+
+TEST_CASE("Embedding sparse optimizer test")
+{
+    nn::Embedding sparse(5, 2);
+    nn::Embedding dense(5, 2, false);
+    dense.m_w.value() = sparse.m_w.value();
+    optim::Adam sparseOptimizer(sparse.parameters(), 0.1f);
+    optim::Adam denseOptimizer(dense.parameters(), 0.1f);
+
+    auto train = [&](const Tensor & indices)
+    {
+        for (auto [model, optimizer] : { std::pair<nn::Embedding*, optim::Adam*>{ &sparse, &sparseOptimizer },
+                                         std::pair<nn::Embedding*, optim::Adam*>{ &dense,  &denseOptimizer  } })
+        {
+            optimizer->zeroGrad();
+            auto e = model->forward(indices);
+            (e * e).sum().backward();
+            optimizer->step();
+        }
+    };
+
+    // The rows without gradients have zero moments at the first step, so they do not change in both updates.
+    train(tensor({ 1.0, 3.0, 1.0 }, Shape{3}, { .m_dtype=DataType::kInt32 }));
+    CheckVectorApproxValues(sparse.m_w, dense.m_w);
+    TensorValue afterFirstStep = sparse.m_w.value();
+
+    // The sparse update keeps the rows of the first step, which the momentum of the dense update changes.
+    train(tensor({ 0.0 }, Shape{1}, { .m_dtype=DataType::kInt32 }));
+    auto rows = tensor({ 1.0, 3.0 }, Shape{2}, { .m_dtype=DataType::kInt32 }).value();
+    CheckVectorApproxValues(sparse.m_w.value().indexSelect(0, rows), afterFirstStep.indexSelect(0, rows));
+    auto row0 = tensor({ 0.0 }, Shape{1}, { .m_dtype=DataType::kInt32 }).value();
+    CheckVectorApproxValues(sparse.m_w.value().indexSelect(0, row0), dense.m_w.value().indexSelect(0, row0));
+    auto denseRows = dense.m_w.value().indexSelect(0, rows);
+    CHECK(denseRows.data<float>()[0] != afterFirstStep.indexSelect(0, rows).data<float>()[0]);
+}
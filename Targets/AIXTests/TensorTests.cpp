@@ -3106,3 +3106,243 @@ TEST_CASE("Tensor - permute()")
                                                  8.0, 16.0, 24.0}, {4,2,3}));
     }
 }
+
+
+TEST_CASE("Tensor - lazy mode")
+{
+    auto sigmoid = [](const Tensor& x) { return 1 / (1 + (-x).exp()); };
+
+    SUBCASE("fused result")
+    {
+        auto x = tensor({-2.0, -1.0, 0.0, 1.0, 2.0}, Shape{5});
+        LazyModeGuard guard;
+        CHECK(LazyMode::isEnabled());
+        auto y = sigmoid(x) * x;
+        CHECK(y.isLazy());
+        CheckVectorApproxValues(y, tensor({-0.238406, -0.268941, 0.0, 0.731059, 1.761594}, Shape{5}));
+        CHECK_FALSE(y.isLazy());
+    }
+
+    SUBCASE("guard restores state")
+    {
+        {
+            LazyModeGuard guard;
+            {
+                LazyModeGuard innerGuard(false);
+                CHECK_FALSE(LazyMode::isEnabled());
+                CHECK_FALSE((tensor({1.0}, Shape{1}) + 1).isLazy());
+            }
+            CHECK(LazyMode::isEnabled());
+        }
+        CHECK_FALSE(LazyMode::isEnabled());
+    }
+
+    SUBCASE("item")
+    {
+        LazyModeGuard guard;
+        auto x = tensor(3.0f);
+        auto y = (x * x + 1).sqrt();
+        CHECK(y.isLazy());
+        CHECK(y.item<float>() == Approx(3.162278f));
+    }
+
+    SUBCASE("long chain")
+    {
+        auto x = tensor({0.5, 1.0, 1.5}, Shape{3});
+        auto eager = x;
+        for (size_t i=0; i<3 * MaxFusedOperations; ++i) eager = eager * 0.9f + 0.1f;
+
+        LazyModeGuard guard;
+        auto lazy = x;
+        for (size_t i=0; i<3 * MaxFusedOperations; ++i) lazy = lazy * 0.9f + 0.1f;
+        CHECK(lazy.isLazy());
+        CheckVectorApproxValues(lazy, eager);
+    }
+
+    SUBCASE("non-fusable ops materialize inputs")
+    {
+        LazyModeGuard guard;
+        auto x = tensor({1.0, 2.0, 3.0, 4.0}, {2, 2});
+        auto y = (x + 1).matmul(x * 2);
+        CHECK_FALSE(y.isLazy());
+        CheckVectorApproxValues(y, tensor({22.0, 32.0, 38.0, 56.0}, {2, 2}));
+        CHECK((x + 1).sum().value().item<float>() == Approx(14));
+    }
+
+    SUBCASE("backward")
+    {
+        auto x1 = tensor({-1.0, 0.5, 2.0}, {3}, { .m_requireGrad=true });
+        auto y1 = tensor({ 3.0, 1.0, 0.25}, {3}, { .m_requireGrad=true });
+        auto z1 = (sigmoid(x1) * y1 - x1.tanh() / y1).sum();
+        z1.backward();
+
+        LazyModeGuard guard;
+        auto x2 = tensor({-1.0, 0.5, 2.0}, {3}, { .m_requireGrad=true });
+        auto y2 = tensor({ 3.0, 1.0, 0.25}, {3}, { .m_requireGrad=true });
+        auto z2 = (sigmoid(x2) * y2 - x2.tanh() / y2).sum();
+        z2.backward();
+
+        CHECK(z2.value().item<float>() == Approx(z1.value().item<float>()));
+        CheckVectorApproxValues(x2.grad(), x1.grad());
+        CheckVectorApproxValues(y2.grad(), y1.grad());
+    }
+}
+
+
+TEST_CASE("Tensor - In-place operations")
+{
+    SUBCASE("values")
+    {
+        auto x = tensor({1.0, 2.0, 3.0, 4.0}, {2, 2});
+        x.add_(tensor({1.0, 2.0}, Shape{2})).mul_(2).sub_(1);
+        CheckVectorApproxValues(x, tensor({3.0, 7.0, 7.0, 11.0}, {2, 2}));
+        x.div_(tensor({2.0}, Shape{1}, { .m_dtype=DataType::kFloat64 }));
+        CheckVectorApproxValues(x, tensor({1.5, 3.5, 3.5, 5.5}, {2, 2}));
+        CHECK(x.dataType() == DataType::kFloat32);
+
+        auto y = tensor({0.0, 1.0}, Shape{2});
+        y.exp_();
+        CheckVectorApproxValues(y, tensor({1.0, 2.718282}, Shape{2}));
+        y.copy_(tensor({4.0}, Shape{1})).sqrt_();
+        CheckVectorApproxValues(y, tensor({2.0, 2.0}, Shape{2}));
+        y.zero_();
+        CheckVectorApproxValues(y, tensor({0.0, 0.0}, Shape{2}));
+    }
+
+    SUBCASE("gradients")
+    {
+        auto x = tensor({1.0, 2.0, 3.0}, Shape{3}, { .m_requireGrad=true });
+        auto w = tensor({2.0, 3.0, 4.0}, Shape{3}, { .m_requireGrad=true });
+        auto y = x * 2;
+        y.add_(1).mul_(w).tanh_();
+        y.sum().backward();
+
+        auto x2 = tensor({1.0, 2.0, 3.0}, Shape{3}, { .m_requireGrad=true });
+        auto w2 = tensor({2.0, 3.0, 4.0}, Shape{3}, { .m_requireGrad=true });
+        (((x2 * 2 + 1) * w2).tanh()).sum().backward();
+        CheckVectorApproxValues(y, ((x2 * 2 + 1) * w2).tanh());
+        CheckVectorApproxValues(x.grad(), x2.grad());
+        CheckVectorApproxValues(w.grad(), w2.grad());
+    }
+
+    SUBCASE("saved tensor modified")
+    {
+        auto x = tensor({1.0, 2.0}, Shape{2}, { .m_requireGrad=true });
+        auto h = x + 1;
+        auto y = h * h;
+        h.mul_(2);
+        CHECK_THROWS_AS(y.sum().backward(), std::runtime_error);
+
+        // Operations that do not read their inputs in the backward pass allow in-place changes of them.
+        auto a = x + 1;
+        auto b = a + x;
+        a.exp_();
+        b.sum().backward();
+        CheckVectorApproxValues(x.grad(), tensor({2.0, 2.0}, Shape{2}).value());
+
+        auto s = (x * 1).softmax(0);
+        auto t = s.sum();
+        s.add_(1);
+        CHECK_THROWS_AS(t.backward(), std::runtime_error);
+
+        auto c = x * 1;
+        auto d = c * 1;
+        d.mul_(c);
+        c.zero_();
+        CHECK_THROWS_AS(d.sum().backward(), std::runtime_error);
+
+        // In-place writes through the values are counted as well.
+        auto e = x * 1;
+        auto f = e * e;
+        auto version = e.value().version();
+        e.value().indexAdd(0, TensorValue({1}, Shape{1}, e.device(), DataType::kInt32),
+                           TensorValue({1.0}, Shape{1}, e.device()), true);
+        CHECK(e.value().version() == version + 1);
+        CheckVectorApproxValues(e, tensor({1.0, 3.0}, Shape{2}));
+        CHECK_THROWS_AS(f.sum().backward(), std::runtime_error);
+    }
+
+    SUBCASE("leaf tensors")
+    {
+        auto x = tensor({1.0, 2.0}, Shape{2}, { .m_requireGrad=true });
+        CHECK_THROWS_AS(x.add_(1), std::invalid_argument);
+        {
+            NoGradGuard guard;
+            x.add_(1);
+        }
+        CheckVectorApproxValues(x, tensor({2.0, 3.0}, Shape{2}));
+    }
+
+    SUBCASE("lazy inputs")
+    {
+        LazyModeGuard guard;
+        auto x = tensor({1.0, 2.0}, Shape{2});
+        auto y = x * 2;
+        x.add_(1);
+        CHECK_THROWS_AS(y.value(), std::runtime_error);
+    }
+}
+
+
+TEST_CASE("Tensor - Output tensor operations")
+{
+    aix::Device device;
+    TensorOptions opt{ .m_device=&device };
+    auto a   = tensor({1.0, 2.0, 3.0, 4.0}, {2, 2}, opt);
+    auto b   = tensor({10.0, 20.0}, Shape{2}, opt);
+    auto out = zeros({2, 2}, opt);
+
+    SUBCASE("element-wise")
+    {
+        add(a, b, out);
+        CheckVectorApproxValues(out, tensor({11.0, 22.0, 13.0, 24.0}, {2, 2}));
+        auto allocations = device.memoryStats().allocations;
+        mul(out, a, out);
+        sub(out, a, out);
+        div(out, b, out);
+        CHECK(device.memoryStats().allocations == allocations);
+        CheckVectorApproxValues(out, tensor({1.0, 2.1, 3.6, 4.6}, {2, 2}));
+
+        auto zero = zeros({2, 2}, opt);
+        allocations = device.memoryStats().allocations;
+        exp(zero, out);
+        sqrt(out, out);
+        CHECK(device.memoryStats().allocations == allocations);
+        CheckVectorApproxValues(out, tensor({1.0, 1.0, 1.0, 1.0}, {2, 2}));
+    }
+
+    SUBCASE("matmul")
+    {
+        matmul(a, a, out);
+        CheckVectorApproxValues(out, tensor({7.0, 10.0, 15.0, 22.0}, {2, 2}));
+        CHECK_THROWS_AS(matmul(a, out, out), std::invalid_argument);
+    }
+
+    SUBCASE("cat and split")
+    {
+        auto result = zeros({4, 2}, opt);
+        std::vector<Tensor> parts{zeros({2, 2}, opt), zeros({2, 2}, opt)};
+        auto allocations = device.memoryStats().allocations;
+        for (size_t i=0; i<3; ++i)
+        {
+            cat({a, parts[1]}, 0, result);
+            split(result, 2, 0, parts);
+            add(parts[1], a, parts[1]);
+        }
+        CHECK(device.memoryStats().allocations == allocations);
+        CheckVectorApproxValues(result, tensor({1.0, 2.0, 3.0, 4.0, 2.0, 4.0, 6.0, 8.0}, {4, 2}));
+        CheckVectorApproxValues(parts[1], tensor({3.0, 6.0, 9.0, 12.0}, {2, 2}));
+    }
+
+    SUBCASE("validation")
+    {
+        CHECK_THROWS_AS(add(a, b, b), std::invalid_argument);
+        Tensor offsetView(out.value().storage(), 2, 2, Shape{2}, opt);
+        CHECK_THROWS_AS(add(b, b, offsetView), std::invalid_argument);
+        auto x = tensor({1.0, 2.0, 3.0, 4.0}, {2, 2}, { .m_requireGrad=true, .m_device=&device });
+        CHECK_THROWS_AS(add(x, b, out), std::invalid_argument);
+        NoGradGuard guard;
+        add(x, b, out);
+        CheckVectorApproxValues(out, tensor({11.0, 22.0, 13.0, 24.0}, {2, 2}));
+    }
+}
@@ -10,6 +10,7 @@
 // Project includes
 #include "Utils.hpp"
 #include <aix.hpp>
+#include <aixDeviceCPUMT.hpp>
 // External includes
 #include <doctest/doctest.h>
 // System includes
@@ -156,6 +157,31 @@ TEST_CASE("TensorValue - matmul()")
         CHECK(result.size() == 8);
         CheckVectorApproxValues(result, TensorValue({40.0, 34.0, 28.0, 22.0, 112.0, 97.0, 82.0, 67.0}, Shape{2, 4}, &testDevice));
     }
+
+    SUBCASE("A[2x2x2] B[2x2] batched multiplication")
+    {
+        TensorValue A = TensorValue({1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0}, Shape{2, 2, 2}, &testDevice);
+        TensorValue B = TensorValue({1.0, 2.0, 3.0, 4.0}, Shape{2, 2}, &testDevice);
+        auto result = A.matmul(B);
+        CHECK(result.shape() == Shape{2,2,2});
+        CheckVectorApproxValues(result, TensorValue({7.0, 10.0, 15.0, 22.0, 23.0, 34.0, 31.0, 46.0}, Shape{2, 2, 2}, &testDevice));
+    }
+
+    SUBCASE("A[2x1x1x2] B[3x2x1] broadcast batch multiplication")
+    {
+        TensorValue A = TensorValue({1.0, 2.0, 3.0, 4.0}, Shape{2, 1, 1, 2}, &testDevice);
+        TensorValue B = TensorValue({1.0, 1.0, 1.0, 0.0, 0.0, 1.0}, Shape{3, 2, 1}, &testDevice);
+        auto result = A.matmul(B);
+        CHECK(result.shape() == Shape{2,3,1,1});
+        CheckVectorApproxValues(result, TensorValue({3.0, 1.0, 2.0, 7.0, 3.0, 4.0}, Shape{2, 3, 1, 1}, &testDevice));
+    }
+
+    SUBCASE("Must fail due to a batch dimension mismatch")
+    {
+        TensorValue A = TensorValue(1.0, Shape{2, 2, 2}, &testDevice);
+        TensorValue B = TensorValue(1.0, Shape{3, 2, 2}, &testDevice);
+        DOCTEST_CHECK_THROWS_AS(A.matmul(B), std::invalid_argument);
+    }
 }
 
 
@@ -548,6 +574,34 @@ TEST_CASE("TensorValue - Sum with dim")
 }
 
 
+TEST_CASE("TensorValue - Sum with dim - long axes")
+{
+    // 0.1 is 0.0999755859375 in Float16. Accumulating the sums in Float16 would stall far below 409.5.
+    SUBCASE("Float16 rows")
+    {
+        auto t = TensorValue(0.1f, Shape{2, 4096}, &testDevice, DataType::kFloat16).sum(1);
+        CHECK(t.shape() == Shape{2});
+        CHECK(static_cast<float>(t.data<float16_t>()[0]) == Approx(409.5f));
+        CHECK(static_cast<float>(t.data<float16_t>()[1]) == Approx(409.5f));
+    }
+
+    SUBCASE("Float16 columns")
+    {
+        auto t = TensorValue(0.1f, Shape{4096, 3}, &testDevice, DataType::kFloat16).sum(0);
+        CHECK(t.shape() == Shape{3});
+        CHECK(static_cast<float>(t.data<float16_t>()[2]) == Approx(409.5f));
+    }
+
+    SUBCASE("Multiple reduced dimensions")
+    {
+        auto t = TensorValue(1.0f, Shape{2, 3, 4}, &testDevice).reduceTo(Shape{3, 1});
+        CHECK(t.shape() == Shape{3, 1});
+        CheckVectorApproxValues(t, TensorValue({8.0, 8.0, 8.0}, t.shape(), &testDevice));
+        CHECK_THROWS_AS({ t.reduceTo(Shape{2, 1}); }, std::invalid_argument);
+    }
+}
+
+
 TEST_CASE("TensorValue - Mean")
 {
     auto x = TensorValue({1.0, 2.0, 3.0, 4.0}, {2, 2}, &testDevice);
@@ -1030,6 +1084,215 @@ TEST_CASE("TensorValue - broadcast")
 }
 
 
+TEST_CASE("TensorValue - broadcast views")
+{
+    auto a = TensorValue({1.0, 2.0, 3.0, 4.0, 5.0, 6.0}, Shape{2, 3}, &testDevice);
+    auto b = TensorValue({10.0, 20.0, 30.0}, Shape{3}, &testDevice);
+    auto c = TensorValue({2.0, 4.0}, Shape{2, 1}, &testDevice);
+
+    SUBCASE("View shares the storage")
+    {
+        auto view = b.broadcastView({2, 3});
+        CHECK(view.isContiguous() == false);
+        CHECK(view.size() == 6);
+        CHECK(view.shape() == Shape{2, 3});
+        CHECK(view.strides() == Stride{0, 1});
+        CHECK(view.data() == b.data());
+        CheckVectorApproxValues(view.contiguous(), TensorValue({10.0, 20.0, 30.0, 10.0, 20.0, 30.0}, Shape{2, 3},
+                                                               &testDevice));
+    }
+
+    SUBCASE("Element-wise operations")
+    {
+        CheckVectorApproxValues(a + b, TensorValue({11.0, 22.0, 33.0, 14.0, 25.0, 36.0}, Shape{2, 3}, &testDevice));
+        CheckVectorApproxValues(b - a, TensorValue({9.0, 18.0, 27.0, 6.0, 15.0, 24.0}, Shape{2, 3}, &testDevice));
+        CheckVectorApproxValues(a * c, TensorValue({2.0, 4.0, 6.0, 16.0, 20.0, 24.0}, Shape{2, 3}, &testDevice));
+        CheckVectorApproxValues(a / c, TensorValue({0.5, 1.0, 1.5, 1.0, 1.25, 1.5}, Shape{2, 3}, &testDevice));
+        CheckVectorApproxValues(b + c, TensorValue({12.0, 22.0, 32.0, 14.0, 24.0, 34.0}, Shape{2, 3}, &testDevice));
+        CheckVectorApproxValues(c.pow(TensorValue({1.0, 2.0, 3.0}, Shape{3}, &testDevice)),
+                                TensorValue({2.0, 4.0, 8.0, 4.0, 16.0, 64.0}, Shape{2, 3}, &testDevice));
+        CheckVectorApproxValues(-b.broadcastView({2, 3}), TensorValue({-10.0, -20.0, -30.0, -10.0, -20.0, -30.0},
+                                                                      Shape{2, 3}, &testDevice));
+    }
+
+    SUBCASE("A view of a view")
+    {
+        auto view = c.broadcastView({2, 3}).broadcastView({2, 2, 3});
+        CHECK(view.strides() == Stride{0, 1, 0});
+        CheckVectorApproxValues(view + b, TensorValue({12.0, 22.0, 32.0, 14.0, 24.0, 34.0,
+                                                       12.0, 22.0, 32.0, 14.0, 24.0, 34.0}, Shape{2, 2, 3}, &testDevice));
+    }
+
+    SUBCASE("In-place operations")
+    {
+        auto t = b;
+        t += a;
+        CheckVectorApproxValues(t, TensorValue({11.0, 22.0, 33.0, 14.0, 25.0, 36.0}, Shape{2, 3}, &testDevice));
+        auto view = b.broadcastView({2, 3});
+        view *= c;
+        CHECK(view.isContiguous());
+        CheckVectorApproxValues(view, TensorValue({20.0, 40.0, 60.0, 40.0, 80.0, 120.0}, Shape{2, 3}, &testDevice));
+        CheckVectorApproxValues(b, TensorValue({10.0, 20.0, 30.0}, Shape{3}, &testDevice));
+    }
+
+    SUBCASE("Conversions materialize the view")
+    {
+        auto view = b.broadcastView({2, 3}).to(DataType::kFloat64);
+        CHECK(view.isContiguous());
+        CheckVectorApproxValues(view, TensorValue({10.0, 20.0, 30.0, 10.0, 20.0, 30.0}, Shape{2, 3}, &testDevice,
+                                                  DataType::kFloat64));
+    }
+
+    SUBCASE("Broadcasting allocates only the result")
+    {
+        auto allocations = testDevice.memoryStats().allocations;
+        auto result = a + b;
+        CHECK(testDevice.memoryStats().allocations == allocations + 1);
+    }
+}
+
+
+TEST_CASE("TensorValue - transpose views")
+{
+    auto a = TensorValue({1.0, 2.0, 3.0, 4.0, 5.0, 6.0}, Shape{2, 3}, &testDevice);
+    auto b = TensorValue({1.0, 2.0, 3.0, 4.0, 5.0, 6.0}, Shape{3, 2}, &testDevice);
+    auto expected = a.transpose(0, 1);
+
+    SUBCASE("View shares the storage")
+    {
+        auto view = a.transposeView(0, -1);
+        CHECK(view.isContiguous() == false);
+        CHECK(view.shape() == Shape{3, 2});
+        CHECK(view.strides() == Stride{1, 3});
+        CHECK(view.data() == a.data());
+        CheckVectorApproxValues(view.contiguous(), expected);
+        CHECK_THROWS_AS(a.transposeView(0, 2), std::invalid_argument);
+    }
+
+    SUBCASE("Element-wise operations")
+    {
+        auto view = a.transposeView(0, 1);
+        CheckVectorApproxValues(view + b, expected + b);
+        CheckVectorApproxValues(b * view, b * expected);
+        CheckVectorApproxValues(-view, -expected);
+        CheckVectorApproxValues(view.sqrt(), expected.sqrt());
+        CheckVectorApproxValues(view.sin(),  expected.sin());
+        CheckVectorApproxValues(view.cos(),  expected.cos());
+        CheckVectorApproxValues(view.tanh(), expected.tanh());
+        CheckVectorApproxValues(view.log(),  expected.log());
+        CheckVectorApproxValues(view.exp(),  expected.exp());
+        CheckVectorApproxValues(view.pow(b), expected.pow(b));
+    }
+
+    SUBCASE("Math functions of integer views")
+    {
+        auto view = a.to(DataType::kInt32).transposeView(0, 1);
+        CheckVectorApproxValues(view.sqrt(), expected.sqrt());
+    }
+
+    SUBCASE("Output variants")
+    {
+        auto out = TensorValue(Shape{3, 2}, &testDevice);
+        a.transposeView(0, 1).exp(out);
+        CheckVectorApproxValues(out, expected.exp());
+    }
+
+    SUBCASE("Math functions read the storage offset")
+    {
+        auto row = a.sliceView(0, 1, 2);
+        CHECK(row.storageOffset() == 3);
+        CheckVectorApproxValues(row.sqrt(), TensorValue({4.0, 5.0, 6.0}, Shape{1, 3}, &testDevice).sqrt());
+        CheckVectorApproxValues(-row, TensorValue({-4.0, -5.0, -6.0}, Shape{1, 3}, &testDevice));
+    }
+
+    SUBCASE("Other operations copy views")
+    {
+        auto view = a.transposeView(0, 1);
+        auto reshaped = view.reshape(Shape{6});
+        CHECK(reshaped.isContiguous());
+        CheckVectorApproxValues(reshaped, TensorValue({1.0, 4.0, 2.0, 5.0, 3.0, 6.0}, Shape{6}, &testDevice));
+        CheckVectorApproxValues(view.transpose(0, 1), a);
+
+        auto indices = TensorValue({2, 0}, Shape{2}, &testDevice, DataType::kInt32);
+        CheckVectorApproxValues(view.indexSelect(0, indices),
+                                TensorValue({3.0, 6.0, 1.0, 4.0}, Shape{2, 2}, &testDevice));
+        auto source = TensorValue({10.0, 20.0, 30.0, 40.0}, Shape{2, 2}, &testDevice);
+        CheckVectorApproxValues(view.indexAdd(0, indices, source),
+                                TensorValue({31.0, 44.0, 2.0, 5.0, 13.0, 26.0}, Shape{3, 2}, &testDevice));
+        CheckVectorApproxValues(b.indexAdd(0, indices, source.transposeView(0, 1)),
+                                TensorValue({21.0, 42.0, 3.0, 4.0, 15.0, 36.0}, Shape{3, 2}, &testDevice));
+
+        // In-place operations do not write views.
+        CHECK_THROWS_AS(view.fill(0), std::invalid_argument);
+        CHECK_THROWS_AS(view.indexAdd(0, indices, source, true), std::invalid_argument);
+        CHECK_THROWS_AS(view.sliceSet(source, 0, 0, 2, 1, true), std::invalid_argument);
+    }
+
+    SUBCASE("Matmul multiplies the transposed views of matrices in place")
+    {
+        auto at = a.transposeView(0, 1);
+        auto bt = b.transposeView(0, 1);
+        CheckVectorApproxValues(at.matmul(bt), expected.matmul(b.transpose(0, 1)));
+        CheckVectorApproxValues(bt.matmul(at), b.transpose(0, 1).matmul(expected));
+        CheckVectorApproxValues(at.matmul(bt, true, true), a.matmul(b));
+        CheckVectorApproxValues(a.matmul(at), a.matmul(expected));
+
+        auto out = TensorValue(Shape{3, 3}, &testDevice);
+        at.matmul(bt, out);
+        CheckVectorApproxValues(out, expected.matmul(b.transpose(0, 1)));
+    }
+
+    SUBCASE("Matmul copies other views")
+    {
+        // Swapping the batch dimension does not transpose the matrices.
+        auto t = TensorValue({1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0}, Shape{2, 2, 2}, &testDevice);
+        auto view = t.transposeView(0, 1);
+        CheckVectorApproxValues(view.matmul(t), t.transpose(0, 1).matmul(t));
+    }
+}
+
+
+TEST_CASE("TensorValue - view reductions")
+{
+    // A minimum chunk size of one splits the reductions of the multithreaded device across its threads.
+    DeviceCPUMT  mtDevice(0, 4, 1);
+    for (Device * device : { static_cast<Device*>(&testDevice), static_cast<Device*>(&mtDevice) })
+    {
+        auto a = TensorValue({1.0, 2.0, 3.0, 4.0, 5.0, 6.0}, Shape{2, 3}, device);
+
+        {
+            // A slice view starts at a storage offset.
+            auto row = a.sliceView(0, 1, 2, 1);
+            CHECK(row.sum().item<float>() == 15.0f);
+            CHECK(row.max().item<float>() == 6.0f);
+            CHECK(row.mean().item<float>() == 5.0f);
+            CHECK(row.argmax().item<int32_t>() == 2);
+            CheckVectorApproxValues(row.argmaxIndices().to(DataType::kFloat32),
+                                    TensorValue({0.0, 0.0, 1.0}, Shape{1, 3}, device));
+            CheckVectorApproxValues(row.sum(1), TensorValue({15.0}, Shape{1}, device));
+        }
+
+        {
+            // A transposed view has swapped strides.
+            auto view = a.transposeView(0, 1);
+            CHECK(view.sum().item<float>() == 21.0f);
+            CHECK(view.max().item<float>() == 6.0f);
+            CHECK(view.argmax().item<int32_t>() == 5);
+            CheckVectorApproxValues(view.argmaxIndices(0).to(DataType::kFloat32),
+                                    TensorValue({0.0, 0.0, 0.0, 0.0, 1.0, 1.0}, Shape{3, 2}, device));
+            CheckVectorApproxValues(view.max(1), TensorValue({4.0, 5.0, 6.0}, Shape{3}, device));
+        }
+
+        {
+            // A broadcast view has zero strides.
+            auto view = a.sliceView(0, 0, 1, 1).broadcastView(Shape{4, 3});
+            CHECK(view.sum().item<float>() == 24.0f);
+            CHECK(view.mean().item<float>() == 2.0f);
+        }
+    }
+}
+
+
 TEST_CASE("TensorValue - Data Type Conversion")
 {
     auto f32Data = std::initializer_list<float>{1.0, 2.0, 3.0};
@@ -3543,3 +3806,39 @@ TEST_CASE("TensorValue - permute()")
     }
 
 }
+
+
+TEST_CASE("TensorValue - Shapes beyond the inline capacity")
+{
+    SUBCASE("Shape storage")
+    {
+        Shape shape{2, 3};
+        CHECK(shape.isInline());
+        CHECK(shape == std::vector<size_t>{2, 3});
+
+        // The storage moves to the heap after the inline capacity and keeps the elements.
+        for (size_t i = 0; i < TENSOR_INLINE_DIMENSIONS; ++i)
+        {
+            shape.insert(shape.begin() + 1, 1);
+        }
+        CHECK(!shape.isInline());
+        CHECK(shape.size() == TENSOR_INLINE_DIMENSIONS + 2);
+        CHECK(shape.front() == 2);
+        CHECK(shape.back() == 3);
+
+        auto moved = std::move(shape);
+        CHECK(shape.empty());
+        CHECK(moved.size() == TENSOR_INLINE_DIMENSIONS + 2);
+        moved.erase(moved.begin() + 1, moved.end() - 1);
+        CHECK(moved == Shape{2, 3});
+    }
+
+    SUBCASE("Transpose")
+    {
+        auto t = TensorValue({1.0, 2.0, 3.0, 4.0, 5.0, 6.0}, {1,2,1,1,1,1,1,1,1,3}, &testDevice);
+        auto result = t.transpose(1, 9).contiguous();
+        CHECK(result.shape() == Shape{1,3,1,1,1,1,1,1,1,2});
+        CheckVectorApproxValues(result, TensorValue({1.0, 4.0, 2.0, 5.0, 3.0, 6.0}, result.shape(), &testDevice));
+        CHECK(result.reshape({3,2}).shape() == Shape{3,2});
+    }
+}